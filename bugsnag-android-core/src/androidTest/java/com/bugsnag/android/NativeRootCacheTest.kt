@@ -0,0 +1,24 @@
+package com.bugsnag.android
+
+import android.content.Context
+import androidx.test.core.app.ApplicationProvider
+import org.junit.Assert.assertEquals
+import org.junit.Test
+
+class NativeRootCacheTest {
+    companion object {
+        init {
+            System.loadLibrary("bugsnag-root-detection")
+            System.loadLibrary("bugsnag-root-detection-test")
+        }
+    }
+
+    external fun run(cacheDir: String): Int
+
+    @Test
+    fun testPassesNativeSuite() {
+        val context = ApplicationProvider.getApplicationContext<Context>()
+        // failures are logged under the BugsnagRootTest tag
+        assertEquals(0, run(context.cacheDir.absolutePath))
+    }
+}
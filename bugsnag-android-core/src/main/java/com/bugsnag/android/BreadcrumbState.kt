@@ -28,7 +28,11 @@ internal class BreadcrumbState(
     private val store = arrayOfNulls<Breadcrumb?>(maxBreadcrumbs)
     private val index = AtomicInteger(0)
 
-    fun add(breadcrumb: Breadcrumb) {
+    /**
+     * Add a breadcrumb, which is [fromNative] if native events already have it
+     */
+    @JvmOverloads
+    fun add(breadcrumb: Breadcrumb, fromNative: Boolean = false) {
         if (maxBreadcrumbs == 0 || !callbackState.runOnBreadcrumbTasks(breadcrumb, logger)) {
             return
         }
@@ -42,9 +46,9 @@ internal class BreadcrumbState(
             StateEvent.AddBreadcrumb(
                 breadcrumb.impl.message,
                 breadcrumb.impl.type,
-                // an encoding of milliseconds since the epoch
-                "t${breadcrumb.impl.timestamp.time}",
-                breadcrumb.impl.metadata ?: mutableMapOf()
+                breadcrumb.impl.timestamp.time,
+                breadcrumb.impl.metadata ?: mutableMapOf(),
+                fromNative
             )
         }
     }
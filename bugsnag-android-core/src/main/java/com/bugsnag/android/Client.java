@@ -921,6 +921,18 @@ public class Client implements MetadataAware, CallbackAware, UserAware, FeatureF
         }
     }
 
+    /**
+     * Leave a breadcrumb which native code has already added to native events, so that
+     * it is not passed back to them
+     */
+    void leaveNativeBreadcrumb(@NonNull String message,
+                               @NonNull BreadcrumbType type,
+                               @NonNull Date timestamp) {
+        Breadcrumb crumb = new Breadcrumb(message, type, new HashMap<String, Object>(),
+                timestamp, logger);
+        breadcrumbState.add(crumb, true);
+    }
+
     /**
      * Intended for internal use only - leaves a breadcrumb if the type is enabled for automatic
      * breadcrumbs.
@@ -1036,6 +1048,16 @@ public class Client implements MetadataAware, CallbackAware, UserAware, FeatureF
         launchCrashTracker.markLaunchCompleted();
     }
 
+    /**
+     * Count a handled error which was written straight to the event store,
+     * such as by native code, in the current session and deliver it
+     */
+    void deliverStoredHandledEvent(@NonNull File eventFile) {
+        sessionTracker.incrementHandledAndCopy();
+        deliveryDelegate.updateState(StateEvent.NotifyHandled.INSTANCE);
+        eventStore.flushStoredFileAsync(eventFile);
+    }
+
     SessionTracker getSessionTracker() {
         return sessionTracker;
     }
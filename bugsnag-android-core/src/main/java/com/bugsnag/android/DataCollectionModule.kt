@@ -5,6 +5,7 @@ import com.bugsnag.android.internal.dag.ConfigModule
 import com.bugsnag.android.internal.dag.ContextModule
 import com.bugsnag.android.internal.dag.DependencyModule
 import com.bugsnag.android.internal.dag.SystemServiceModule
+import java.io.File
 
 /**
  * A dependency module which constructs the objects that collect data in Bugsnag. For example, this
@@ -40,7 +41,11 @@ internal class DataCollectionModule(
     }
 
     private val rootDetector by future {
-        RootDetector(logger = logger, deviceBuildInfo = deviceBuildInfo)
+        RootDetector(
+            logger = logger,
+            deviceBuildInfo = deviceBuildInfo,
+            nativeCheckCache = File(cfg.persistenceDirectory.value, "root-detection")
+        )
     }
 
     val deviceDataCollector by future {
@@ -150,6 +150,27 @@ class EventStore extends FileStore {
         }
     }
 
+    /**
+     * Deliver a single stored event in the background, such as one written
+     * straight to the store by native code, without flushing the others
+     */
+    void flushStoredFileAsync(final File eventFile) {
+        if (!queueStoredFile(eventFile)) {
+            return;
+        }
+        try {
+            bgTaskSevice.submitTask(TaskType.ERROR_REQUEST, new Runnable() {
+                @Override
+                public void run() {
+                    flushEventFile(eventFile);
+                }
+            });
+        } catch (RejectedExecutionException exception) {
+            cancelQueuedFiles(Collections.singleton(eventFile));
+            logger.w("Failed to flush a stored error, retaining it for later.");
+        }
+    }
+
     void flushReports(Collection<File> storedReports) {
         if (!storedReports.isEmpty()) {
             int size = storedReports.size();
@@ -18,8 +18,12 @@ internal data class FeatureFlagState(
     }
 
     override fun addFeatureFlags(featureFlags: Iterable<FeatureFlag>) {
-        featureFlags.forEach { (name, variant) ->
-            addFeatureFlag(name, variant)
+        val flags = featureFlags.toList()
+        this.featureFlags.addFeatureFlags(flags)
+        if (flags.isNotEmpty()) {
+            updateState {
+                StateEvent.AddFeatureFlags(flags)
+            }
         }
     }
 
@@ -40,8 +44,8 @@ internal data class FeatureFlagState(
     fun emitObservableEvent() {
         val flags = toList()
 
-        flags.forEach { (name, variant) ->
-            updateState { StateEvent.AddFeatureFlag(name, variant) }
+        if (flags.isNotEmpty()) {
+            updateState { StateEvent.AddFeatureFlags(flags) }
         }
     }
 
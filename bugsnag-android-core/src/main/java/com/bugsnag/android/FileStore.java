@@ -9,6 +9,8 @@ import java.io.FileNotFoundException;
 import java.io.FileOutputStream;
 import java.io.OutputStreamWriter;
 import java.io.Writer;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collection;
@@ -71,19 +73,25 @@ abstract class FileStore {
         return true;
     }
 
-    void enqueueContentForDelivery(String content, String filename) {
+    /**
+     * Stores the remaining bytes of an encoded payload as-is. The content is
+     * UTF-8 JSON, or JSON that was gzip-compressed natively.
+     */
+    void enqueueContentForDelivery(ByteBuffer content, String filename) {
         if (!isStorageDirValid(storageDir)) {
             return;
         }
         discardOldestFileIfNeeded();
 
         lock.lock();
-        Writer out = null;
+        FileOutputStream out = null;
         String filePath = new File(storageDir, filename).getAbsolutePath();
         try {
-            FileOutputStream fos = new FileOutputStream(filePath);
-            out = new BufferedWriter(new OutputStreamWriter(fos, "UTF-8"));
-            out.write(content);
+            out = new FileOutputStream(filePath);
+            FileChannel channel = out.getChannel();
+            while (content.hasRemaining()) {
+                channel.write(content);
+            }
         } catch (Exception exc) {
             File eventFile = new File(filePath);
 
@@ -203,6 +211,19 @@ abstract class FileStore {
         }
     }
 
+    /**
+     * Mark a stored file as queued for delivery, returning false if it
+     * already is
+     */
+    boolean queueStoredFile(File file) {
+        lock.lock();
+        try {
+            return queuedFiles.add(file);
+        } finally {
+            lock.unlock();
+        }
+    }
+
     void cancelQueuedFiles(Collection<File> files) {
         lock.lock();
         try {
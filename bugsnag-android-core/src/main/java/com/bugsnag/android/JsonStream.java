@@ -1,12 +1,14 @@
 package com.bugsnag.android;
 
+import com.bugsnag.android.internal.JsonHelper;
+
 import androidx.annotation.NonNull;
 import androidx.annotation.Nullable;
 
 import java.io.BufferedReader;
 import java.io.File;
-import java.io.FileInputStream;
 import java.io.IOException;
+import java.io.InputStream;
 import java.io.InputStreamReader;
 import java.io.Reader;
 import java.io.Writer;
@@ -81,8 +83,8 @@ public class JsonStream extends JsonWriter {
         // Copy the file contents onto the stream
         Reader input = null;
         try {
-            FileInputStream fis = new FileInputStream(file);
-            input = new BufferedReader(new InputStreamReader(fis, "UTF-8"));
+            InputStream stream = JsonHelper.INSTANCE.openPayload(file);
+            input = new BufferedReader(new InputStreamReader(stream, "UTF-8"));
             IOUtils.copy(input, out);
         } finally {
             IOUtils.closeQuietly(input);
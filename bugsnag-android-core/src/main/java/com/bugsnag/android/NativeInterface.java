@@ -7,7 +7,10 @@ import androidx.annotation.NonNull;
 import androidx.annotation.Nullable;
 
 import java.io.File;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.nio.charset.Charset;
+import java.util.ArrayList;
 import java.util.Collection;
 import java.util.Date;
 import java.util.HashMap;
@@ -23,6 +26,24 @@ public class NativeInterface {
     // The default charset on Android is always UTF-8
     private static Charset UTF8Charset = Charset.defaultCharset();
 
+    // the frame, symbol and load addresses and line number of each native frame
+    private static final int NATIVE_FRAME_ADDRESS_COUNT = 4;
+
+    // the type, timestamp and message length of each queued native breadcrumb
+    private static final int NATIVE_BREADCRUMB_HEADER_SIZE = 1 + 8 + 4;
+
+    // in the order of bugsnag_breadcrumb_type
+    private static final BreadcrumbType[] NATIVE_BREADCRUMB_TYPES = {
+        BreadcrumbType.MANUAL,
+        BreadcrumbType.ERROR,
+        BreadcrumbType.LOG,
+        BreadcrumbType.NAVIGATION,
+        BreadcrumbType.PROCESS,
+        BreadcrumbType.REQUEST,
+        BreadcrumbType.STATE,
+        BreadcrumbType.USER
+    };
+
     /**
      * Static reference used if not using Bugsnag.start()
      */
@@ -60,6 +81,17 @@ public class NativeInterface {
         return new File(persistenceDirectory, "bugsnag-native").getAbsolutePath();
     }
 
+    /**
+     * Retrieve the directory of the event store, which native code can write
+     * handled errors to directly, see {@link #deliverStoredEvent}
+     */
+    @NonNull
+    public static String getEventStorePath() {
+        ImmutableConfig config = getClient().getConfig();
+        File persistenceDirectory = config.getPersistenceDirectory().getValue();
+        return new File(persistenceDirectory, "bugsnag-errors").getAbsolutePath();
+    }
+
     /**
      * Retrieve user data from the static Client instance as a Map
      */
@@ -125,6 +157,16 @@ public class NativeInterface {
         return deviceData;
     }
 
+    /**
+     * Retrieve the context, app, device and user data read by the native layer
+     * when it is installed, packed into one buffer by NativeStateSnapshot
+     */
+    @NonNull
+    @SuppressWarnings("unused")
+    public static byte[] getStateSnapshot() {
+        return NativeStateSnapshot.encode(getClient());
+    }
+
     /**
      * Retrieve the CPU ABI(s) for the current device
      */
@@ -204,6 +246,34 @@ public class NativeInterface {
         getClient().leaveBreadcrumb(name, new HashMap<String, Object>(), type);
     }
 
+    /**
+     * Leave the breadcrumbs which native code has already added to native events, and
+     * queued to be passed on in a batch. Each is a bugsnag_breadcrumb_type byte, its
+     * timestamp in milliseconds as an int64 and then a uint32 length and the UTF-8 bytes
+     * of its message, in native byte order. A truncated breadcrumb ends the batch.
+     */
+    public static void leaveNativeBreadcrumbs(@NonNull byte[] packed) {
+        if (packed == null) {
+            return;
+        }
+        Client client = getClient();
+        ByteBuffer buffer = ByteBuffer.wrap(packed).order(ByteOrder.nativeOrder());
+        while (buffer.remaining() >= NATIVE_BREADCRUMB_HEADER_SIZE) {
+            int type = buffer.get() & 0xff;
+            long timestamp = buffer.getLong();
+            int length = buffer.getInt();
+            if (length < 0 || length > buffer.remaining()) {
+                return;
+            }
+            String message = new String(packed, buffer.position(), length, UTF8Charset);
+            buffer.position(buffer.position() + length);
+            client.leaveNativeBreadcrumb(message,
+                    type < NATIVE_BREADCRUMB_TYPES.length
+                            ? NATIVE_BREADCRUMB_TYPES[type] : BreadcrumbType.MANUAL,
+                    new Date(timestamp));
+        }
+    }
+
     /**
      * Leaves a breadcrumb on the static client instance
      */
@@ -307,7 +377,8 @@ public class NativeInterface {
      *                          captured. Used to determine whether the report
      *                          should be discarded, based on configured release
      *                          stages
-     * @param payloadBytes The raw JSON payload of the event
+     * @param payloadBytes The raw JSON payload of the event, which may be
+     *                     gzip-compressed
      * @param apiKey The apiKey for the event
      * @param isLaunching whether the crash occurred when the app was launching
      */
@@ -319,7 +390,31 @@ public class NativeInterface {
         if (payloadBytes == null) {
             return;
         }
-        String payload = new String(payloadBytes, UTF8Charset);
+        deliverReport(releaseStageBytes, ByteBuffer.wrap(payloadBytes), apiKey, isLaunching);
+    }
+
+    /**
+     * Deliver a report, serialized as an event JSON payload held in a direct
+     * buffer of native memory. The buffer is only valid for the duration of
+     * this call and must not be retained.
+     *
+     * @param releaseStageBytes The release stage in which the event was
+     *                          captured. Used to determine whether the report
+     *                          should be discarded, based on configured release
+     *                          stages
+     * @param payloadBuffer The raw JSON payload of the event, which may be
+     *                      gzip-compressed
+     * @param apiKey The apiKey for the event
+     * @param isLaunching whether the crash occurred when the app was launching
+     */
+    @SuppressWarnings("unused")
+    public static void deliverReport(@Nullable byte[] releaseStageBytes,
+                                     @NonNull ByteBuffer payloadBuffer,
+                                     @NonNull String apiKey,
+                                     boolean isLaunching) {
+        if (payloadBuffer == null) {
+            return;
+        }
         String releaseStage = releaseStageBytes == null
                 ? null
                 : new String(releaseStageBytes, UTF8Charset);
@@ -330,12 +425,41 @@ public class NativeInterface {
                 || !config.shouldDiscardByReleaseStage()) {
             EventStore eventStore = client.getEventStore();
 
-            String filename = eventStore.getNdkFilename(payload, apiKey);
+            String filename = eventStore.getNdkFilename(payloadBuffer, apiKey);
             if (isLaunching) {
                 filename = filename.replace(".json", "startupcrash.json");
             }
-            eventStore.enqueueContentForDelivery(payload, filename);
+            // the payload is stored without decoding, and read back by sniffing
+            // for a gzip header
+            eventStore.enqueueContentForDelivery(payloadBuffer, filename);
+        }
+    }
+
+    /**
+     * Deliver a handled error which native code has already written to the
+     * event store as a JSON payload, in place of notifying it through the JVM.
+     * The error is counted in the current session, and the file is deleted if
+     * the error should be discarded.
+     *
+     * @param path the file holding the payload, in the event store directory
+     * @param errorClass the class of the error, used to decide whether it is
+     *                   discarded
+     */
+    @SuppressWarnings("unused")
+    public static void deliverStoredEvent(@NonNull String path,
+                                          @Nullable String errorClass) {
+        if (path == null) {
+            return;
+        }
+        Client client = getClient();
+        File eventFile = new File(path);
+        if (client.getConfig().shouldDiscardError(errorClass)) {
+            if (!eventFile.delete()) {
+                eventFile.deleteOnExit();
+            }
+            return;
         }
+        client.deliverStoredHandledEvent(eventFile);
     }
 
     /**
@@ -358,6 +482,39 @@ public class NativeInterface {
         notify(name, message, severity, stacktrace);
     }
 
+    /**
+     * Notifies using the Android SDK with an error which native code reported
+     * several times within its aggregation window, of which only the first was
+     * reported as it happened
+     *
+     * @param nameBytes the error name
+     * @param messageBytes the error message
+     * @param severity the error severity
+     * @param stacktrace a stacktrace
+     * @param occurrences the number of times the error occurred after the first
+     * @param windowMillis the length of the window the occurrences were counted in
+     */
+    public static void notifyAggregated(@NonNull final byte[] nameBytes,
+                                        @NonNull final byte[] messageBytes,
+                                        @NonNull final Severity severity,
+                                        @NonNull final StackTraceElement[] stacktrace,
+                                        final int occurrences,
+                                        final long windowMillis) {
+        if (nameBytes == null || messageBytes == null || stacktrace == null) {
+            return;
+        }
+        String name = new String(nameBytes, UTF8Charset);
+        String message = new String(messageBytes, UTF8Charset);
+        notify(name, message, severity, stacktrace, new OnErrorCallback() {
+            @Override
+            public boolean onError(@NonNull Event event) {
+                event.addMetadata("aggregation", "occurrences", occurrences);
+                event.addMetadata("aggregation", "windowMillis", windowMillis);
+                return true;
+            }
+        });
+    }
+
     /**
      * Notifies using the Android SDK
      *
@@ -370,6 +527,14 @@ public class NativeInterface {
                               @NonNull final String message,
                               @NonNull final Severity severity,
                               @NonNull final StackTraceElement[] stacktrace) {
+        notify(name, message, severity, stacktrace, null);
+    }
+
+    private static void notify(@NonNull final String name,
+                               @NonNull final String message,
+                               @NonNull final Severity severity,
+                               @NonNull final StackTraceElement[] stacktrace,
+                               @Nullable final OnErrorCallback onError) {
         if (getClient().getConfig().shouldDiscardError(name)) {
             return;
         }
@@ -392,7 +557,7 @@ public class NativeInterface {
                         err.setType(ErrorType.C);
                     }
                 }
-                return true;
+                return onError == null || onError.onError(event);
             }
         });
     }
@@ -415,6 +580,89 @@ public class NativeInterface {
                 client.logger);
     }
 
+    /**
+     * Unpack native stackframes which are passed as primitive arrays rather than as one
+     * object per frame. Each frame has four addresses: the frame, symbol and load
+     * addresses and then the line number. Each also has two names, its method and then
+     * its file, which are UTF-8 and each terminated by a NUL byte.
+     *
+     * @param addresses the addresses of each frame
+     * @param names the names of each frame
+     * @param type the type of the frames
+     * @return the frames, or as many as the names are complete for
+     */
+    @NonNull
+    public static List<Stackframe> createNativeStackframes(@NonNull long[] addresses,
+                                                           @NonNull byte[] names,
+                                                           @Nullable ErrorType type) {
+        int count = addresses.length / NATIVE_FRAME_ADDRESS_COUNT;
+        List<Stackframe> frames = new ArrayList<>(count);
+        int offset = 0;
+        for (int index = 0; index < count; index++) {
+            int methodEnd = indexOfNul(names, offset);
+            int fileEnd = indexOfNul(names, methodEnd + 1);
+            if (fileEnd >= names.length) {
+                break;
+            }
+            String method = new String(names, offset, methodEnd - offset, UTF8Charset);
+            String file = new String(names, methodEnd + 1, fileEnd - methodEnd - 1,
+                    UTF8Charset);
+            offset = fileEnd + 1;
+
+            int base = index * NATIVE_FRAME_ADDRESS_COUNT;
+            NativeStackframe frame = new NativeStackframe(method, file,
+                    addresses[base + 3], addresses[base], addresses[base + 1],
+                    addresses[base + 2], null, type);
+            frames.add(new Stackframe(frame));
+        }
+        return frames;
+    }
+
+    /**
+     * Create the native threads captured alongside an ANR, whose frames are unpacked by
+     * {@link #createNativeStackframes(long[], byte[], ErrorType)} and follow those of the ANR.
+     *
+     * @param frames the unpacked frames
+     * @param firstFrame the index of the first frame of the first thread
+     * @param threads the id and number of frames of each thread
+     * @param names the name of each thread, UTF-8 and terminated by a NUL byte
+     * @param logger the logger of the threads
+     * @return the threads, or as many as there are frames and names for
+     */
+    @NonNull
+    public static List<Thread> createNativeThreads(@NonNull List<Stackframe> frames,
+                                                   int firstFrame,
+                                                   @NonNull long[] threads,
+                                                   @NonNull byte[] names,
+                                                   @NonNull Logger logger) {
+        List<Thread> nativeThreads = new ArrayList<>(threads.length / 2);
+        int frameOffset = firstFrame;
+        int nameOffset = 0;
+        for (int index = 0; index + 1 < threads.length; index += 2) {
+            int nameEnd = indexOfNul(names, nameOffset);
+            int frameEnd = frameOffset + (int) threads[index + 1];
+            if (nameEnd >= names.length || frameEnd > frames.size()) {
+                break;
+            }
+            String name = new String(names, nameOffset, nameEnd - nameOffset, UTF8Charset);
+            List<Stackframe> stacktrace =
+                    new ArrayList<>(frames.subList(frameOffset, frameEnd));
+            nativeThreads.add(new Thread(threads[index], name, ThreadType.C, false,
+                    Thread.State.UNKNOWN, new Stacktrace(stacktrace), logger));
+            nameOffset = nameEnd + 1;
+            frameOffset = frameEnd;
+        }
+        return nativeThreads;
+    }
+
+    private static int indexOfNul(@NonNull byte[] bytes, int start) {
+        int index = start;
+        while (index < bytes.length && bytes[index] != 0) {
+            index++;
+        }
+        return index;
+    }
+
     @NonNull
     public static Logger getLogger() {
         return getClient().getConfig().getLogger();
@@ -0,0 +1,190 @@
+package com.bugsnag.android;
+
+import androidx.annotation.NonNull;
+import androidx.annotation.Nullable;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+import java.util.Date;
+import java.util.Map;
+
+/**
+ * Packs the app, device and user state which the native layer reads when it is
+ * installed into a single buffer, so that it is passed in one JNI call rather
+ * than a map lookup for every field. The layout is decoded by
+ * bsg_event_apply_state_snapshot() in event.c, and VERSION must be changed
+ * along with it.
+ *
+ * Strings are a uint32 length and their UTF-8 bytes, with null written as an
+ * empty string. Numbers are written in native byte order, with null written
+ * as 0.
+ */
+final class NativeStateSnapshot {
+
+    static final byte VERSION = 1;
+
+    private static final int INITIAL_CAPACITY = 1024;
+    private static final Charset UTF8 = Charset.forName("UTF-8");
+
+    private ByteBuffer buffer =
+            ByteBuffer.allocate(INITIAL_CAPACITY).order(ByteOrder.nativeOrder());
+
+    private NativeStateSnapshot() {
+    }
+
+    @NonNull
+    static byte[] encode(@NonNull Client client) {
+        NativeStateSnapshot snapshot = new NativeStateSnapshot();
+        snapshot.putByte(VERSION);
+        snapshot.putString(client.getContext());
+        snapshot.putApp(client.getAppDataCollector());
+        snapshot.putDevice(client.getDeviceDataCollector());
+        snapshot.putUser(client.getUser());
+
+        byte[] packed = new byte[snapshot.buffer.position()];
+        snapshot.buffer.flip();
+        snapshot.buffer.get(packed);
+        return packed;
+    }
+
+    private void putApp(@NonNull AppDataCollector source) {
+        AppWithState app = source.generateAppWithState();
+        putString(app.getBinaryArch());
+        putString(app.getBuildUuid());
+        putString(app.getId());
+        putString(app.getReleaseStage());
+        putString(app.getType());
+        putString(app.getVersion());
+        putLong(app.getDuration());
+        putLong(app.getDurationInForeground());
+        putLong(app.getVersionCode());
+        putBoolean(app.getInForeground());
+
+        Map<String, Object> metadata = source.getAppDataMetadata();
+        putString(stringValue(metadata.get("name")));
+        putString(stringValue(metadata.get("processName")));
+        putDouble(numberValue(metadata.get("memoryLimit")));
+        putBoolean(booleanValue(metadata.get("backgroundWorkRestricted")));
+    }
+
+    private void putDevice(@NonNull DeviceDataCollector source) {
+        DeviceWithState device = source.generateDeviceWithState(new Date().getTime());
+        String[] cpuAbi = device.getCpuAbi();
+        if (cpuAbi == null) {
+            putInt(0);
+        } else {
+            putInt(cpuAbi.length);
+            for (String abi : cpuAbi) {
+                putString(abi);
+            }
+        }
+        putString(device.getId());
+        putString(device.getLocale());
+        putString(device.getManufacturer());
+        putString(device.getModel());
+        putString(device.getOrientation());
+        putString(device.getOsVersion());
+
+        Map<String, Object> runtimeVersions = device.getRuntimeVersions();
+        Object osBuild = null;
+        Object apiLevel = null;
+        if (runtimeVersions != null) {
+            osBuild = runtimeVersions.get("osBuild");
+            apiLevel = runtimeVersions.get("androidApiLevel");
+        }
+        putString(stringValue(osBuild));
+        putInt(apiLevelValue(apiLevel));
+        putLong(device.getTotalMemory());
+        putBoolean(device.getJailbroken());
+
+        Map<String, Object> metadata = source.getDeviceMetadata();
+        putString(stringValue(metadata.get("brand")));
+        putDouble(numberValue(metadata.get("dpi")));
+        putBoolean(booleanValue(metadata.get("emulator")));
+        putString(stringValue(metadata.get("locationStatus")));
+        putString(stringValue(metadata.get("networkAccess")));
+        putDouble(numberValue(metadata.get("screenDensity")));
+        putString(stringValue(metadata.get("screenResolution")));
+    }
+
+    private void putUser(@NonNull User user) {
+        putString(user.getId());
+        putString(user.getName());
+        putString(user.getEmail());
+    }
+
+    @Nullable
+    private static String stringValue(@Nullable Object value) {
+        return value == null ? null : value.toString();
+    }
+
+    @Nullable
+    private static Number numberValue(@Nullable Object value) {
+        return value instanceof Number ? (Number) value : null;
+    }
+
+    @Nullable
+    private static Boolean booleanValue(@Nullable Object value) {
+        return value instanceof Boolean ? (Boolean) value : null;
+    }
+
+    private static int apiLevelValue(@Nullable Object value) {
+        if (value instanceof Number) {
+            return ((Number) value).intValue();
+        }
+        if (value != null) {
+            try {
+                return Integer.parseInt(value.toString());
+            } catch (NumberFormatException ignored) {
+                // reported as 0, as an unreadable level was before
+            }
+        }
+        return 0;
+    }
+
+    private void ensureCapacity(int length) {
+        if (buffer.remaining() >= length) {
+            return;
+        }
+        int capacity = buffer.capacity() * 2;
+        while (capacity - buffer.position() < length) {
+            capacity *= 2;
+        }
+        ByteBuffer grown = ByteBuffer.allocate(capacity).order(ByteOrder.nativeOrder());
+        buffer.flip();
+        grown.put(buffer);
+        buffer = grown;
+    }
+
+    private void putByte(byte value) {
+        ensureCapacity(1);
+        buffer.put(value);
+    }
+
+    private void putBoolean(@Nullable Boolean value) {
+        putByte((byte) (value != null && value ? 1 : 0));
+    }
+
+    private void putInt(int value) {
+        ensureCapacity(4);
+        buffer.putInt(value);
+    }
+
+    private void putLong(@Nullable Number value) {
+        ensureCapacity(8);
+        buffer.putLong(value == null ? 0 : value.longValue());
+    }
+
+    private void putDouble(@Nullable Number value) {
+        ensureCapacity(8);
+        buffer.putDouble(value == null ? 0 : value.doubleValue());
+    }
+
+    private void putString(@Nullable String value) {
+        byte[] bytes = value == null ? new byte[0] : value.getBytes(UTF8);
+        ensureCapacity(4 + bytes.length);
+        buffer.putInt(bytes.length);
+        buffer.put(bytes);
+    }
+}
@@ -18,6 +18,7 @@ internal class RootDetector @JvmOverloads constructor(
     private val deviceBuildInfo: DeviceBuildInfo = DeviceBuildInfo.defaultInfo(),
     private val rootBinaryLocations: List<String> = ROOT_INDICATORS,
     private val buildProps: File = BUILD_PROP_FILE,
+    private val nativeCheckCache: File? = null,
     private val logger: Logger
 ) {
 
@@ -42,11 +43,15 @@ internal class RootDetector @JvmOverloads constructor(
     }
 
     private val libraryLoaded = AtomicBoolean(false)
+    private val nativeChecksStarted = AtomicBoolean(false)
 
     init {
         try {
             System.loadLibrary("bugsnag-root-detection")
             libraryLoaded.set(true)
+            nativeChecksStarted.set(
+                startNativeRootChecks(nativeCheckCache?.absolutePath, deviceBuildInfo.fingerprint)
+            )
         } catch (ignored: UnsatisfiedLinkError) {
             // library couldn't load. This could be due to root detection countermeasures,
             // or down to genuine OS level bugs with library loading - in either case
@@ -131,10 +136,23 @@ internal class RootDetector @JvmOverloads constructor(
 
     private external fun performNativeRootChecks(): Boolean
 
+    /**
+     * Starts the native root checks on a background thread, or reads their result from
+     * [cachePath] if they already ran since the device booted into the same build.
+     * Returns false if the checks could not be started.
+     */
+    private external fun startNativeRootChecks(cachePath: String?, fingerprint: String?): Boolean
+
+    /**
+     * Waits for the checks started by [startNativeRootChecks] and returns their result
+     */
+    private external fun awaitNativeRootChecks(): Boolean
+
     /**
      * Performs root checks which require native code.
      */
     private fun nativeCheckRoot(): Boolean = when {
+        nativeChecksStarted.get() -> awaitNativeRootChecks()
         libraryLoaded.get() -> performNativeRootChecks()
         else -> false
     }
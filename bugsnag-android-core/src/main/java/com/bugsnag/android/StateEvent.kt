@@ -10,7 +10,8 @@ sealed class StateEvent { // JvmField allows direct field access optimizations
         @JvmField val releaseStage: String?,
         @JvmField val lastRunInfoPath: String,
         @JvmField val consecutiveLaunchCrashes: Int,
-        @JvmField val sendThreads: ThreadSendPolicy
+        @JvmField val sendThreads: ThreadSendPolicy,
+        @JvmField val maxReportedThreads: Int
     ) : StateEvent()
 
     object DeliverPending : StateEvent()
@@ -31,8 +32,16 @@ sealed class StateEvent { // JvmField allows direct field access optimizations
     class AddBreadcrumb(
         @JvmField val message: String,
         @JvmField val type: BreadcrumbType,
-        @JvmField val timestamp: String,
-        @JvmField val metadata: MutableMap<String, Any?>
+        /**
+         * When the breadcrumb was left, in milliseconds since the epoch
+         */
+        @JvmField val timestamp: Long,
+        @JvmField val metadata: MutableMap<String, Any?>,
+        /**
+         * Whether the breadcrumb was left from native code, which already added it to
+         * native events
+         */
+        @JvmField val fromNative: Boolean = false
     ) : StateEvent()
 
     object NotifyHandled : StateEvent()
@@ -74,6 +83,10 @@ sealed class StateEvent { // JvmField allows direct field access optimizations
         @JvmField val variant: String? = null
     ) : StateEvent()
 
+    class AddFeatureFlags(
+        @JvmField val featureFlags: List<FeatureFlag>
+    ) : StateEvent()
+
     class ClearFeatureFlag(
         @JvmField val name: String
     ) : StateEvent()
@@ -2,6 +2,7 @@ package com.bugsnag.android.internal
 
 import com.bugsnag.android.repackaged.dslplatform.json.DslJson
 import com.bugsnag.android.repackaged.dslplatform.json.JsonWriter
+import java.io.BufferedInputStream
 import java.io.File
 import java.io.FileInputStream
 import java.io.FileNotFoundException
@@ -10,6 +11,7 @@ import java.io.IOException
 import java.io.InputStream
 import java.io.OutputStream
 import java.util.Date
+import java.util.zip.GZIPInputStream
 
 internal object JsonHelper {
 
@@ -69,11 +71,31 @@ internal object JsonHelper {
 
     fun deserialize(file: File): MutableMap<in String, out Any> {
         try {
-            FileInputStream(file).use { stream -> return deserialize(stream) }
+            openPayload(file).use { stream -> return deserialize(stream) }
         } catch (ex: FileNotFoundException) {
             throw ex
         } catch (ex: IOException) {
             throw IOException("Could not deserialize from $file", ex)
         }
     }
+
+    /**
+     * Opens a stored payload for reading, decompressing it if it was written with
+     * gzip (as payloads from the NDK plugin may be).
+     */
+    fun openPayload(file: File): InputStream {
+        val stream = BufferedInputStream(FileInputStream(file))
+        try {
+            stream.mark(2)
+            val isGzip = stream.read() == GZIP_MAGIC_FIRST && stream.read() == GZIP_MAGIC_SECOND
+            stream.reset()
+            return if (isGzip) GZIPInputStream(stream) else stream
+        } catch (ex: IOException) {
+            stream.close()
+            throw ex
+        }
+    }
+
+    private const val GZIP_MAGIC_FIRST = 0x1f
+    private const val GZIP_MAGIC_SECOND = 0x8b
 }
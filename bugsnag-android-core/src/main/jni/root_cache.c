@@ -0,0 +1,68 @@
+#include "root_cache.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ROOT_CACHE_VERSION "1"
+
+char *bsg_root_cache_key(const char *boot_id, const char *fingerprint) {
+  char key[BSG_ROOT_CACHE_SIZE];
+  const int len = snprintf(key, sizeof(key), "%s\n%s\n%s\n",
+                           ROOT_CACHE_VERSION, boot_id, fingerprint);
+  // the result is written after the key, which must fit alongside it
+  if (len <= 0 || len >= BSG_ROOT_CACHE_SIZE - 2) {
+    return NULL;
+  }
+  return strdup(key);
+}
+
+bool bsg_root_cache_read(const char *path, const char *key, bool *rooted) {
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  char buff[BSG_ROOT_CACHE_SIZE];
+  const ssize_t len = read(fd, buff, sizeof(buff) - 1);
+  close(fd);
+  if (len <= 0) {
+    return false;
+  }
+  buff[len] = '\0';
+  const size_t key_len = strlen(key);
+  if (strncmp(buff, key, key_len) != 0) {
+    return false;
+  }
+  const char result = buff[key_len];
+  if (result != '0' && result != '1') {
+    return false;
+  }
+  *rooted = result == '1';
+  return true;
+}
+
+bool bsg_root_cache_write(const char *path, const char *key, bool rooted) {
+  char tmp_path[PATH_MAX];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >=
+      (int)sizeof(tmp_path)) {
+    return false;
+  }
+  char buff[BSG_ROOT_CACHE_SIZE];
+  const int len =
+      snprintf(buff, sizeof(buff), "%s%c\n", key, rooted ? '1' : '0');
+  const int fd =
+      open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  const bool written = write(fd, buff, (size_t)len) == len;
+  close(fd);
+  if (!written || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,39 @@
+#ifndef BUGSNAG_ROOT_CACHE_H
+#define BUGSNAG_ROOT_CACHE_H
+/**
+ * The cached result of the native root checks, keyed by the boot id and build
+ * fingerprint, as a device is not rooted or unrooted without rebooting
+ */
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The most bytes written to a cache file */
+#define BSG_ROOT_CACHE_SIZE 512
+
+/**
+ * The key which a cached result must have been written with, which must be
+ * freed, or NULL if it is too long to cache
+ */
+char *bsg_root_cache_key(const char *boot_id, const char *fingerprint);
+
+/**
+ * @return true if a result was cached at path with key, which is set in
+ *         rooted
+ */
+bool bsg_root_cache_read(const char *path, const char *key, bool *rooted);
+
+/**
+ * Write the result to a temporary file which replaces the cache at path, so
+ * that a partly written cache is never read
+ *
+ * @return false if the cache was left as it was
+ */
+bool bsg_root_cache_write(const char *path, const char *key, bool rooted);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -6,9 +6,15 @@ extern "C" {
 #endif
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "root_cache.h"
+
 static const char *su_paths[] = {
         // Common binaries
         "/system/xbin/su",
@@ -109,12 +115,189 @@ static bool is_rooted() {
   return false;
 }
 
-#include <stdio.h>
+/*
+ * The asynchronous checks run every probe above from a pool of threads, each
+ * taking the next probe until one finds root or none are left. The result is
+ * cached against the boot id and build fingerprint, as a device is not rooted
+ * or unrooted without rebooting, so later launches in the same boot do not
+ * touch the filesystem.
+ */
+
+#define ROOT_PROBE_THREADS 3
+
+static pthread_mutex_t root_check_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t root_check_thread;
+/** Whether root_check_thread is running or has not yet been joined */
+static bool root_check_running = false;
+static bool root_check_done = false;
+static bool root_check_rooted = false;
+
+static int next_probe = 0;
+static bool probe_found_root = false;
+
+/** The path of the cache file, or NULL if results are not cached */
+static char *root_cache_path = NULL;
+/** The contents of the cache file apart from the result, or NULL */
+static char *root_cache_key = NULL;
+
+static int probe_count(void) {
+  return su_paths_count + should_not_be_writable_count +
+         should_not_be_creatable_count;
+}
+
+/**
+ * @return true if the probe at index indicates the device is rooted
+ */
+static bool run_probe(int index) {
+  if (index < su_paths_count) {
+    return does_path_exist(su_paths[index]);
+  }
+  index -= su_paths_count;
+  if (index < should_not_be_writable_count) {
+    return is_path_writable(should_not_be_writable[index]);
+  }
+  index -= should_not_be_writable_count;
+  return can_create_file(should_not_be_creatable[index]);
+}
+
+static void *run_probes(void *unused) {
+  const int count = probe_count();
+  int index;
+  while (!__atomic_load_n(&probe_found_root, __ATOMIC_ACQUIRE) &&
+         (index = __atomic_fetch_add(&next_probe, 1, __ATOMIC_ACQ_REL)) <
+             count) {
+    if (run_probe(index)) {
+      __atomic_store_n(&probe_found_root, true, __ATOMIC_RELEASE);
+    }
+  }
+  return NULL;
+}
+
+static bool read_boot_id(char *boot_id, size_t size) {
+  const int fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  const ssize_t len = read(fd, boot_id, size - 1);
+  close(fd);
+  if (len <= 0) {
+    return false;
+  }
+  boot_id[len] = '\0';
+  char *newline = strchr(boot_id, '\n');
+  if (newline != NULL) {
+    *newline = '\0';
+  }
+  return boot_id[0] != '\0';
+}
+
+/**
+ * Build the key which a cached result must have been written with, or leave
+ * it NULL if there is no boot id or fingerprint to key it by
+ */
+static void create_cache_key(const char *fingerprint) {
+  char boot_id[64];
+  if (fingerprint == NULL || !read_boot_id(boot_id, sizeof(boot_id))) {
+    return;
+  }
+  root_cache_key = bsg_root_cache_key(boot_id, fingerprint);
+}
+
+/**
+ * @return true if a result was cached with the current key, which is set in
+ *         rooted
+ */
+static bool read_cached_result(bool *rooted) {
+  return root_cache_path != NULL && root_cache_key != NULL &&
+         bsg_root_cache_read(root_cache_path, root_cache_key, rooted);
+}
+
+static void write_cached_result(bool rooted) {
+  if (root_cache_path != NULL && root_cache_key != NULL) {
+    bsg_root_cache_write(root_cache_path, root_cache_key, rooted);
+  }
+}
+
+static void *run_root_checks(void *unused) {
+  pthread_t helpers[ROOT_PROBE_THREADS - 1];
+  bool started[ROOT_PROBE_THREADS - 1];
+  for (int i = 0; i < ROOT_PROBE_THREADS - 1; i++) {
+    // the probes a helper would have taken are run by the others instead
+    started[i] = pthread_create(&helpers[i], NULL, run_probes, NULL) == 0;
+  }
+  run_probes(NULL);
+  for (int i = 0; i < ROOT_PROBE_THREADS - 1; i++) {
+    if (started[i]) {
+      pthread_join(helpers[i], NULL);
+    }
+  }
+  const bool rooted = __atomic_load_n(&probe_found_root, __ATOMIC_ACQUIRE);
+  write_cached_result(rooted);
+  root_check_rooted = rooted;
+  return NULL;
+}
+
+static char *copy_jstring(JNIEnv *env, jstring value) {
+  if (value == NULL) {
+    return NULL;
+  }
+  const char *chars = (*env)->GetStringUTFChars(env, value, NULL);
+  if (chars == NULL) {
+    return NULL;
+  }
+  char *copy = strdup(chars);
+  (*env)->ReleaseStringUTFChars(env, value, chars);
+  return copy;
+}
+
 JNIEXPORT jboolean JNICALL
 Java_com_bugsnag_android_RootDetector_performNativeRootChecks(JNIEnv *env, jobject thiz) {
   return is_rooted();
 }
 
+JNIEXPORT jboolean JNICALL
+Java_com_bugsnag_android_RootDetector_startNativeRootChecks(
+    JNIEnv *env, jobject thiz, jstring cache_path, jstring fingerprint) {
+  pthread_mutex_lock(&root_check_lock);
+  bool started = true;
+  if (root_check_running || root_check_done) {
+    goto exit;
+  }
+
+  root_cache_path = copy_jstring(env, cache_path);
+  char *fingerprint_chars = copy_jstring(env, fingerprint);
+  create_cache_key(fingerprint_chars);
+  free(fingerprint_chars);
+  if (read_cached_result(&root_check_rooted)) {
+    root_check_done = true;
+    goto exit;
+  }
+
+  started = pthread_create(&root_check_thread, NULL, run_root_checks, NULL) == 0;
+  root_check_running = started;
+
+exit:
+  pthread_mutex_unlock(&root_check_lock);
+  return started;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_bugsnag_android_RootDetector_awaitNativeRootChecks(JNIEnv *env, jobject thiz) {
+  pthread_mutex_lock(&root_check_lock);
+  if (root_check_running) {
+    pthread_join(root_check_thread, NULL);
+    root_check_running = false;
+    root_check_done = true;
+  } else if (!root_check_done) {
+    // the checks were never started, so are run on the calling thread
+    root_check_rooted = is_rooted();
+    root_check_done = true;
+  }
+  const bool rooted = root_check_rooted;
+  pthread_mutex_unlock(&root_check_lock);
+  return rooted;
+}
+
 #ifdef __cplusplus
 }
 #endif
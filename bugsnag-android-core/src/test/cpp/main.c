@@ -0,0 +1,25 @@
+#include <android/log.h>
+#include <jni.h>
+
+#define GREATEST_FPRINTF(ignore, fmt, ...)                                    \
+    __android_log_print(ANDROID_LOG_INFO, "BugsnagRootTest", fmt, ##__VA_ARGS__)
+
+#include <greatest/greatest.h>
+
+SUITE(suite_root_cache);
+
+/** The directory the tests may write cache files to */
+const char *root_cache_test_dir;
+
+GREATEST_MAIN_DEFS();
+
+JNIEXPORT jint JNICALL Java_com_bugsnag_android_NativeRootCacheTest_run(
+    JNIEnv *env, jobject thiz, jstring cache_dir) {
+    root_cache_test_dir = (*env)->GetStringUTFChars(env, cache_dir, NULL);
+    int argc = 0;
+    char *argv[] = {};
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(suite_root_cache);
+    (*env)->ReleaseStringUTFChars(env, cache_dir, root_cache_test_dir);
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,118 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <greatest/greatest.h>
+
+#include <root_cache.h>
+
+#define ROOT_CACHE_TEST_BOOT_ID "6c6fa9ea-1d74-4b2c-a3a4-3a7a2b2cd9b8"
+#define ROOT_CACHE_TEST_FINGERPRINT "google/sdk_gphone/generic:11/RSR1/1:user"
+
+extern const char *root_cache_test_dir;
+
+static char cache_path[PATH_MAX];
+static char tmp_path[PATH_MAX];
+
+static void reset_cache_files(void) {
+  snprintf(cache_path, sizeof(cache_path), "%s/root.cache",
+           root_cache_test_dir);
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+  remove(cache_path);
+  rmdir(tmp_path);
+  remove(tmp_path);
+}
+
+TEST test_root_cache_round_trip(void) {
+  reset_cache_files();
+  char *key =
+      bsg_root_cache_key(ROOT_CACHE_TEST_BOOT_ID, ROOT_CACHE_TEST_FINGERPRINT);
+  ASSERT(key != NULL);
+  bool rooted = false;
+  ASSERT_FALSE(bsg_root_cache_read(cache_path, key, &rooted));
+
+  ASSERT(bsg_root_cache_write(cache_path, key, true));
+  ASSERT(bsg_root_cache_read(cache_path, key, &rooted));
+  ASSERT(rooted);
+  ASSERT(bsg_root_cache_write(cache_path, key, false));
+  ASSERT(bsg_root_cache_read(cache_path, key, &rooted));
+  ASSERT_FALSE(rooted);
+  free(key);
+  PASS();
+}
+
+TEST test_root_cache_invalidated(void) {
+  reset_cache_files();
+  char *key =
+      bsg_root_cache_key(ROOT_CACHE_TEST_BOOT_ID, ROOT_CACHE_TEST_FINGERPRINT);
+  ASSERT(bsg_root_cache_write(cache_path, key, true));
+
+  // a result is not trusted after a reboot or a system update
+  char *rebooted_key = bsg_root_cache_key(
+      "0f3a6c1e-54b7-4d0e-9a52-0d3e4f5a6b7c", ROOT_CACHE_TEST_FINGERPRINT);
+  char *updated_key = bsg_root_cache_key(
+      ROOT_CACHE_TEST_BOOT_ID, "google/sdk_gphone/generic:12/SP1A/2:user");
+  bool rooted = false;
+  ASSERT_FALSE(bsg_root_cache_read(cache_path, rebooted_key, &rooted));
+  ASSERT_FALSE(bsg_root_cache_read(cache_path, updated_key, &rooted));
+  ASSERT_FALSE(rooted);
+
+  // and neither is one keyed by a prefix of the fingerprint
+  char *prefix_key = bsg_root_cache_key(ROOT_CACHE_TEST_BOOT_ID, "google");
+  ASSERT_FALSE(bsg_root_cache_read(cache_path, prefix_key, &rooted));
+
+  // a fingerprint too long to cache alongside the result is not keyed
+  char fingerprint[BSG_ROOT_CACHE_SIZE];
+  memset(fingerprint, 'a', sizeof(fingerprint) - 1);
+  fingerprint[sizeof(fingerprint) - 1] = '\0';
+  ASSERT_EQ(NULL, bsg_root_cache_key(ROOT_CACHE_TEST_BOOT_ID, fingerprint));
+
+  ASSERT(bsg_root_cache_read(cache_path, key, &rooted));
+  ASSERT(rooted);
+  free(key);
+  free(rebooted_key);
+  free(updated_key);
+  free(prefix_key);
+  PASS();
+}
+
+TEST test_root_cache_replaced_by_rename(void) {
+  reset_cache_files();
+  char *key =
+      bsg_root_cache_key(ROOT_CACHE_TEST_BOOT_ID, ROOT_CACHE_TEST_FINGERPRINT);
+  bool rooted = false;
+
+  // a temporary file left by a process killed mid-write is overwritten
+  FILE *partial = fopen(tmp_path, "w");
+  fputs("1\n6c6f", partial);
+  fclose(partial);
+  ASSERT(bsg_root_cache_write(cache_path, key, true));
+  ASSERT(access(tmp_path, F_OK) != 0);
+  ASSERT(bsg_root_cache_read(cache_path, key, &rooted));
+  ASSERT(rooted);
+
+  // the cache is left as it was if the temporary file cannot be written
+  ASSERT_EQ(0, mkdir(tmp_path, 0700));
+  ASSERT_FALSE(bsg_root_cache_write(cache_path, key, false));
+  ASSERT(bsg_root_cache_read(cache_path, key, &rooted));
+  ASSERT(rooted);
+  rmdir(tmp_path);
+
+  // and a partly written cache is never read
+  FILE *truncated = fopen(cache_path, "w");
+  fputs(key, truncated);
+  fclose(truncated);
+  ASSERT_FALSE(bsg_root_cache_read(cache_path, key, &rooted));
+  remove(cache_path);
+  free(key);
+  PASS();
+}
+
+SUITE(suite_root_cache) {
+  RUN_TEST(test_root_cache_round_trip);
+  RUN_TEST(test_root_cache_invalidated);
+  RUN_TEST(test_root_cache_replaced_by_rename);
+}
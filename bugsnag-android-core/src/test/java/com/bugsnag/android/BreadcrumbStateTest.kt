@@ -300,4 +300,20 @@ class BreadcrumbStateTest {
 
         assertEquals(25, breadcrumbState.copy().size)
     }
+
+    /**
+     * Breadcrumbs which native code already has are marked so that they are not passed back
+     */
+    @Test
+    fun testFromNativeState() {
+        val events = mutableListOf<StateEvent.AddBreadcrumb>()
+        breadcrumbState.addObserver(StateObserver { events.add(it as StateEvent.AddBreadcrumb) })
+
+        breadcrumbState.add(Breadcrumb("jvm", NoopLogger))
+        breadcrumbState.add(Breadcrumb("native", NoopLogger), true)
+
+        assertEquals(2, breadcrumbState.copy().size)
+        assertFalse(events[0].fromNative)
+        assertTrue(events[1].fromNative)
+    }
 }
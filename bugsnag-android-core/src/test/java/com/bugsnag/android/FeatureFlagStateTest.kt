@@ -56,9 +56,8 @@ internal class FeatureFlagStateTest {
         assertEquals(2, featureFlags.size)
         assertTrue(featureFlags.containsAll(flags))
 
-        assertEquals(2, events.size)
-        assertTrue(events[0] is StateEvent.AddFeatureFlag)
-        assertTrue(events[1] is StateEvent.AddFeatureFlag)
+        val event = events.single() as StateEvent.AddFeatureFlags
+        assertEquals(flags, event.featureFlags)
     }
 
     @Test
@@ -104,20 +103,15 @@ internal class FeatureFlagStateTest {
         events.clear()
 
         state.emitObservableEvent()
-        assertEquals(3, events.size)
-        val addSampleGroup = events
-            .filterIsInstance<StateEvent.AddFeatureFlag>()
-            .find { it.name == "sample_group" }
+        val flags = (events.single() as StateEvent.AddFeatureFlags).featureFlags
+        assertEquals(3, flags.size)
+        val addSampleGroup = flags.find { it.name == "sample_group" }
         assertEquals("4321", addSampleGroup?.variant)
 
-        val addListingView = events
-            .filterIsInstance<StateEvent.AddFeatureFlag>()
-            .find { it.name == "listing_view" }
+        val addListingView = flags.find { it.name == "listing_view" }
         assertEquals("legacy", addListingView?.variant)
 
-        val addDemoMode = events
-            .filterIsInstance<StateEvent.AddFeatureFlag>()
-            .find { it.name == "demo_mode" }
+        val addDemoMode = flags.find { it.name == "demo_mode" }
         assertNotNull(addDemoMode)
         assertNull(addDemoMode!!.variant)
     }
@@ -6,7 +6,9 @@ import org.junit.Before;
 import org.junit.Test;
 
 import java.io.File;
+import java.io.FileOutputStream;
 import java.io.StringWriter;
+import java.util.zip.GZIPOutputStream;
 
 public class JsonStreamFileTest {
 
@@ -57,4 +59,16 @@ public class JsonStreamFileTest {
         assertEquals("[]", writer.toString());
     }
 
+    @Test
+    public void testGzipFileValue() throws Throwable {
+        GZIPOutputStream out = new GZIPOutputStream(new FileOutputStream(file));
+        out.write("{\"foo\":\"bar\"}".getBytes("UTF-8"));
+        out.close();
+        stream.beginArray();
+        stream.value(file);
+        stream.value(file);
+        stream.endArray();
+        assertEquals("[{\"foo\":\"bar\"},{\"foo\":\"bar\"}]", writer.toString());
+    }
+
 }
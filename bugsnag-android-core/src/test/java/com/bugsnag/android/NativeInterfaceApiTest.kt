@@ -6,6 +6,7 @@ import com.bugsnag.android.BugsnagTestUtils.generateDeviceWithState
 import com.bugsnag.android.internal.ImmutableConfig
 import org.junit.Assert.assertArrayEquals
 import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
 import org.junit.Assert.assertTrue
 import org.junit.Before
 import org.junit.Test
@@ -18,6 +19,7 @@ import org.mockito.Mockito.times
 import org.mockito.Mockito.verify
 import org.mockito.Mockito.`when`
 import org.mockito.junit.MockitoJUnitRunner
+import java.nio.ByteBuffer
 import java.nio.file.Files
 
 /**
@@ -216,7 +218,34 @@ internal class NativeInterfaceApiTest {
     @Test
     fun deliverReport() {
         NativeInterface.deliverReport(null, "{}".toByteArray(), "", false)
-        verify(eventStore, times(1)).enqueueContentForDelivery(eq("{}"), any())
+        val expected = ByteBuffer.wrap("{}".toByteArray())
+        verify(eventStore, times(1)).enqueueContentForDelivery(eq(expected), any())
+    }
+
+    @Test
+    fun deliverReportBuffer() {
+        val buffer = ByteBuffer.allocateDirect(2).put("{}".toByteArray())
+        buffer.flip()
+        NativeInterface.deliverReport(null, buffer, "", false)
+        val expected = ByteBuffer.wrap("{}".toByteArray())
+        verify(eventStore, times(1)).enqueueContentForDelivery(eq(expected), any())
+    }
+
+    @Test
+    fun deliverStoredEvent() {
+        val file = Files.createTempFile("stored", ".json").toFile()
+        NativeInterface.deliverStoredEvent(file.absolutePath, "SIGPIPE")
+        verify(client, times(1)).deliverStoredHandledEvent(eq(file))
+        assertTrue(file.exists())
+    }
+
+    @Test
+    fun deliverStoredEventDiscarded() {
+        val file = Files.createTempFile("stored", ".json").toFile()
+        `when`(immutableConfig.shouldDiscardError("SIGPIPE")).thenReturn(true)
+        NativeInterface.deliverStoredEvent(file.absolutePath, "SIGPIPE")
+        verify(client, times(0)).deliverStoredHandledEvent(any())
+        assertFalse(file.exists())
     }
 
     @Test
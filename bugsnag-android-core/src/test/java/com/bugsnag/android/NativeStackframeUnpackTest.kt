@@ -0,0 +1,64 @@
+package com.bugsnag.android
+
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertNull
+import org.junit.Test
+
+class NativeStackframeUnpackTest {
+
+    @Test
+    fun unpacksEachFrame() {
+        val addresses = longArrayOf(0x1004, 0x1000, 0x800, 12, 0x2010, 0x2000, 0x800, 0)
+        val names = "crash_write\u0000libfoo.so\u0000\u0000libbar.so\u0000".toByteArray()
+        val frames = NativeInterface.createNativeStackframes(addresses, names, ErrorType.C)
+
+        assertEquals(2, frames.size)
+        val first = frames[0]
+        assertEquals("crash_write", first.method)
+        assertEquals("libfoo.so", first.file)
+        assertEquals(12L, first.lineNumber)
+        assertEquals(0x1004L, first.frameAddress)
+        assertEquals(0x1000L, first.symbolAddress)
+        assertEquals(0x800L, first.loadAddress)
+        assertNull(first.isPC)
+        assertEquals(ErrorType.C, first.type)
+
+        val second = frames[1]
+        assertEquals("", second.method)
+        assertEquals("libbar.so", second.file)
+        assertEquals(0x2010L, second.frameAddress)
+    }
+
+    @Test
+    fun stopsAtIncompleteNames() {
+        val addresses = longArrayOf(0x1004, 0x1000, 0x800, 0, 0x2010, 0x2000, 0x800, 0)
+        val names = "crash_write\u0000libfoo.so\u0000truncated".toByteArray()
+        val frames = NativeInterface.createNativeStackframes(addresses, names, null)
+
+        assertEquals(1, frames.size)
+        assertEquals("crash_write", frames[0].method)
+    }
+
+    @Test
+    fun createsThreadsFromTheFollowingFrames() {
+        val addresses = longArrayOf(1, 0, 0, 0, 2, 0, 0, 0, 3, 0, 0, 0)
+        val names = "anr\u0000a\u0000main\u0000b\u0000worker\u0000c\u0000".toByteArray()
+        val frames = NativeInterface.createNativeStackframes(addresses, names, ErrorType.C)
+        val threads = NativeInterface.createNativeThreads(
+            frames,
+            1,
+            longArrayOf(1234, 1, 1240, 1),
+            "main\u0000RenderThread\u0000".toByteArray(),
+            NoopLogger
+        )
+
+        assertEquals(2, threads.size)
+        assertEquals(1234L, threads[0].id)
+        assertEquals("main", threads[0].name)
+        assertEquals(ThreadType.C, threads[0].type)
+        assertEquals(Thread.State.UNKNOWN, threads[0].state)
+        assertEquals(listOf(2L), threads[0].stacktrace.map { it.frameAddress })
+        assertEquals("RenderThread", threads[1].name)
+        assertEquals(listOf(3L), threads[1].stacktrace.map { it.frameAddress })
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef BUGSNAG_JNI_COMMON_CACHE_H
+#define BUGSNAG_JNI_COMMON_CACHE_H
+
+#include <jni.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The Java VM and any classes used by both the NDK and ANR plugins, looked up
+ * once and held as global refs so that reporting does not need to call
+ * FindClass or GetMethodID.
+ */
+typedef struct {
+  bool initialized;
+
+  JavaVM *jvm;
+} bsg_jni_common_cache_t;
+
+extern bsg_jni_common_cache_t *const bsg_jni_common_cache;
+
+/**
+ * Populate all references in the common JNI cache. This is safe to call more
+ * than once, and only the first successful call has any effect.
+ *
+ * @param env The JNI env
+ * @return false if an error occurs, in which case the cache is unusable.
+ */
+bool bsg_jni_common_cache_init(JNIEnv *env);
+
+/**
+ * Get the current JNI environment, attaching if necessary.
+ * The environment will be detached automatically on thread termination.
+ * @return The current JNI environment, or NULL if the cache is not initialized
+ * or in case of JNI error (which will be logged).
+ */
+JNIEnv *bsg_jni_common_get_env(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_JNI_COMMON_CACHE_H
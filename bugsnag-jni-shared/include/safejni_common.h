@@ -0,0 +1,83 @@
+#ifndef BUGSNAG_SAFEJNI_COMMON_H
+#define BUGSNAG_SAFEJNI_COMMON_H
+
+#include <jni.h>
+#include <stdbool.h>
+
+/**
+ * The safe JNI wrappers used by both the NDK and ANR plugins. Each checks if
+ * an exception is pending after the call and if so clears it, so that
+ * execution can continue providing the caller checks the return value.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Clear any pending exception, describing it to the log first.
+ *
+ * @return true if an exception was pending
+ */
+bool bsg_check_and_clear_exc(JNIEnv *env);
+
+/**
+ * A safe wrapper for the JNI's FindClass. This method checks if an exception is
+ * pending and if so clears it so that execution can continue.
+ * The caller is responsible for handling the invalid return value of NULL.
+ *
+ * @return the class, or NULL if the class could not be found.
+ */
+jclass bsg_safe_find_class(JNIEnv *env, const char *clz_name);
+
+/**
+ * A safe wrapper for the JNI's GetMethodID. This method checks if an exception
+ * is pending and if so clears it so that execution can continue.
+ * The caller is responsible for handling the invalid return value of NULL.
+ *
+ * @return the method ID, or NULL if the method could not be found.
+ */
+jmethodID bsg_safe_get_method_id(JNIEnv *env, jclass clz, const char *name,
+                                 const char *sig);
+
+/**
+ * A safe wrapper for the JNI's NewStringUtf. This method checks if an
+ * exception is pending and if so clears it so that execution can continue.
+ * The caller is responsible for handling the invalid return value of NULL.
+ *
+ * @return the java string or NULL if it could not be created
+ */
+jstring bsg_safe_new_string_utf(JNIEnv *env, const char *str);
+
+/**
+ * A safe wrapper for the JNI's GetStaticFieldId. This method checks if an
+ * exception is pending and if so clears it so that execution can continue.
+ */
+jfieldID bsg_safe_get_static_field_id(JNIEnv *env, jclass clz, const char *name,
+                                      const char *sig);
+
+/**
+ * A safe wrapper for the JNI's GetStaticObjectField. This method checks if an
+ * exception is pending and if so clears it so that execution can continue.
+ * The caller is responsible for handling the invalid return value of NULL.
+ */
+jobject bsg_safe_get_static_object_field(JNIEnv *env, jclass clz,
+                                         jfieldID field);
+
+/**
+ * A safe wrapper for the JNI's NewObject. This method checks if an
+ * exception is pending and if so clears it so that execution can continue.
+ * The caller is responsible for handling the invalid return value of NULL.
+ */
+jobject bsg_safe_new_object(JNIEnv *env, jclass clz, jmethodID method, ...);
+
+/**
+ * A safe wrapper for the JNI's DeleteLocalRef. This method checks if the env
+ * is NULL and no-ops if so.
+ */
+void bsg_safe_delete_local_ref(JNIEnv *env, jobject obj);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_SAFEJNI_COMMON_H
@@ -0,0 +1,21 @@
+#ifndef BUGSNAG_SIGNAL_COMMON_H
+#define BUGSNAG_SIGNAL_COMMON_H
+
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Install handler on the highest real-time signal which has no handler yet,
+ * so that the NDK and ANR plugins never claim the same one.
+ *
+ * @return the signal claimed, or 0 if every real-time signal is in use
+ */
+int bsg_claim_rt_signal(void (*handler)(int, siginfo_t *, void *));
+
+#ifdef __cplusplus
+}
+#endif
+#endif
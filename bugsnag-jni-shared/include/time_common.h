@@ -0,0 +1,19 @@
+#ifndef BUGSNAG_TIME_COMMON_H
+#define BUGSNAG_TIME_COMMON_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The CLOCK_MONOTONIC time in nanoseconds, as System.nanoTime() returns in the
+ * JVM. Async-safe, so it can time the work of signal handlers.
+ */
+uint64_t bsg_monotonic_time_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
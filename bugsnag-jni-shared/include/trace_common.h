@@ -0,0 +1,46 @@
+#ifndef BUGSNAG_TRACE_COMMON_H
+#define BUGSNAG_TRACE_COMMON_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Named sections around the work of the NDK and ANR plugins, which show up in
+ * Perfetto and systrace captures of the app. Sections are written with
+ * ATrace from libandroid, which is looked up at runtime as it is only
+ * available from API 23. Until tracing is enabled, and on older devices,
+ * beginning and ending a section does nothing.
+ */
+
+/** The system property which enables tracing when set to 1 */
+#define BSG_TRACE_PROPERTY "debug.bugsnag.trace"
+
+/**
+ * Enable or disable tracing, looking up ATrace the first time it is enabled.
+ * Returns false if tracing was requested but ATrace is not available. A
+ * section which is open when tracing is disabled is left without its end.
+ */
+bool bsg_trace_set_enabled(bool enabled);
+
+/**
+ * Enable tracing if BSG_TRACE_PROPERTY is set, so that it can be switched on
+ * with adb for a build which does not configure it
+ */
+void bsg_trace_enable_from_property(void);
+
+/**
+ * Begin a section on the current thread. Sections nest, and each must be
+ * ended on the thread which began it.
+ */
+void bsg_trace_begin(const char *name);
+
+/** End the section most recently begun on the current thread */
+void bsg_trace_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,79 @@
+#include "jni_common_cache.h"
+
+#include <android/log.h>
+#include <pthread.h>
+#include <stddef.h>
+
+#ifndef BUGSNAG_LOG
+#define BUGSNAG_LOG(fmt, ...)                                                  \
+  __android_log_print(ANDROID_LOG_WARN, "Bugsnag", fmt, ##__VA_ARGS__)
+#endif
+
+#define JNI_VERSION JNI_VERSION_1_6
+
+static bsg_jni_common_cache_t jni_common_cache;
+bsg_jni_common_cache_t *const bsg_jni_common_cache = &jni_common_cache;
+
+static pthread_mutex_t jni_common_cache_init_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t jni_cleanup_key;
+
+static void detach_java_env(void *env) {
+  JavaVM *jvm = bsg_jni_common_cache->jvm;
+  if (bsg_jni_common_cache->initialized && env != NULL) {
+    (*jvm)->DetachCurrentThread(jvm);
+  }
+}
+
+JNIEnv *bsg_jni_common_get_env(void) {
+  if (!__atomic_load_n(&bsg_jni_common_cache->initialized, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+
+  JavaVM *jvm = bsg_jni_common_cache->jvm;
+  JNIEnv *env = NULL;
+  switch ((*jvm)->GetEnv(jvm, (void **)&env, JNI_VERSION)) {
+  case JNI_OK:
+    return env;
+  case JNI_EDETACHED:
+    if ((*jvm)->AttachCurrentThread(jvm, &env, NULL) != JNI_OK) {
+      BUGSNAG_LOG("Could not attach thread to JVM");
+      return NULL;
+    }
+    if (env == NULL) {
+      BUGSNAG_LOG("AttachCurrentThread filled a NULL JNIEnv");
+      return NULL;
+    }
+
+    // attach a destructor to detach the env before the thread terminates
+    pthread_setspecific(jni_cleanup_key, env);
+
+    return env;
+  default:
+    BUGSNAG_LOG("Could not get JNIEnv");
+    return NULL;
+  }
+}
+
+bool bsg_jni_common_cache_init(JNIEnv *env) {
+  if (env == NULL) {
+    return false;
+  }
+  pthread_mutex_lock(&jni_common_cache_init_lock);
+  if (bsg_jni_common_cache->initialized) {
+    goto exit;
+  }
+
+  (*env)->GetJavaVM(env, &bsg_jni_common_cache->jvm);
+  if (bsg_jni_common_cache->jvm == NULL) {
+    BUGSNAG_LOG("JNI Cache Init Error: Could not get global JavaVM");
+    goto exit;
+  }
+
+  pthread_key_create(&jni_cleanup_key, detach_java_env);
+
+  __atomic_store_n(&bsg_jni_common_cache->initialized, true, __ATOMIC_RELEASE);
+
+exit:
+  pthread_mutex_unlock(&jni_common_cache_init_lock);
+  return bsg_jni_common_cache->initialized;
+}
@@ -0,0 +1,111 @@
+#include "safejni_common.h"
+
+#include <android/log.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#ifndef BUGSNAG_LOG
+#define BUGSNAG_LOG(fmt, ...)                                                  \
+  __android_log_print(ANDROID_LOG_WARN, "Bugsnag", fmt, ##__VA_ARGS__)
+#endif
+
+bool bsg_check_and_clear_exc(JNIEnv *env) {
+  if (env == NULL) {
+    return false;
+  }
+  if ((*env)->ExceptionCheck(env)) {
+    BUGSNAG_LOG("BUG: JNI Native->Java call threw an exception:");
+
+    // Print a trace to stderr so that we can debug it
+    (*env)->ExceptionDescribe(env);
+
+    // Trigger more accurate dalvik trace (this will also crash the app).
+
+    // Code review check: THIS MUST BE COMMENTED OUT IN CHECKED IN CODE!
+    //(*env)->FindClass(env, NULL);
+
+    // Clear the exception so that we don't crash.
+    (*env)->ExceptionClear(env);
+    return true;
+  }
+  return false;
+}
+
+jclass bsg_safe_find_class(JNIEnv *env, const char *clz_name) {
+  if (env == NULL || clz_name == NULL) {
+    return NULL;
+  }
+  jclass clz = (*env)->FindClass(env, clz_name);
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  return clz;
+}
+
+jmethodID bsg_safe_get_method_id(JNIEnv *env, jclass clz, const char *name,
+                                 const char *sig) {
+  if (env == NULL || clz == NULL || name == NULL || sig == NULL) {
+    return NULL;
+  }
+  jmethodID methodId = (*env)->GetMethodID(env, clz, name, sig);
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  return methodId;
+}
+
+jstring bsg_safe_new_string_utf(JNIEnv *env, const char *str) {
+  if (env == NULL || str == NULL) {
+    return NULL;
+  }
+  jstring jstr = (*env)->NewStringUTF(env, str);
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  return jstr;
+}
+
+jfieldID bsg_safe_get_static_field_id(JNIEnv *env, jclass clz, const char *name,
+                                      const char *sig) {
+  if (env == NULL || clz == NULL || name == NULL || sig == NULL) {
+    return NULL;
+  }
+  jfieldID field_id = (*env)->GetStaticFieldID(env, clz, name, sig);
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  return field_id;
+}
+
+jobject bsg_safe_get_static_object_field(JNIEnv *env, jclass clz,
+                                         jfieldID field) {
+  if (env == NULL || clz == NULL || field == NULL) {
+    return NULL;
+  }
+  jobject obj = (*env)->GetStaticObjectField(env, clz, field);
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  return obj;
+}
+
+jobject bsg_safe_new_object(JNIEnv *env, jclass clz, jmethodID method, ...) {
+  if (env == NULL || clz == NULL || method == NULL) {
+    return NULL;
+  }
+  va_list args;
+  va_start(args, method);
+  jobject obj = (*env)->NewObjectV(env, clz, method, args);
+  va_end(args);
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  return obj;
+}
+
+void bsg_safe_delete_local_ref(JNIEnv *env, jobject obj) {
+  if (env == NULL || obj == NULL) {
+    return;
+  }
+  (*env)->DeleteLocalRef(env, obj);
+}
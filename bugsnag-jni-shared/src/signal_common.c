@@ -0,0 +1,23 @@
+#include "signal_common.h"
+
+#include <string.h>
+
+int bsg_claim_rt_signal(void (*handler)(int, siginfo_t *, void *)) {
+  // signals are claimed from the top of the range, which is the least used
+  for (int signum = SIGRTMAX; signum >= SIGRTMIN; signum--) {
+    struct sigaction current;
+    if (sigaction(signum, NULL, &current) != 0 ||
+        (current.sa_flags & SA_SIGINFO) || current.sa_handler != SIG_DFL) {
+      continue;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_sigaction = handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+    if (sigaction(signum, &action, NULL) == 0) {
+      return signum;
+    }
+  }
+  return 0;
+}
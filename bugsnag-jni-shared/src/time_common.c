@@ -0,0 +1,9 @@
+#include "time_common.h"
+
+#include <time.h>
+
+uint64_t bsg_monotonic_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
@@ -0,0 +1,70 @@
+#include "trace_common.h"
+
+#include <android/log.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/system_properties.h>
+
+#ifndef BUGSNAG_LOG
+#define BUGSNAG_LOG(fmt, ...)                                                  \
+  __android_log_print(ANDROID_LOG_WARN, "Bugsnag", fmt, ##__VA_ARGS__)
+#endif
+
+typedef void (*atrace_begin_section)(const char *);
+typedef void (*atrace_end_section)(void);
+
+static atrace_begin_section begin_section;
+static atrace_end_section end_section;
+
+static pthread_once_t atrace_once = PTHREAD_ONCE_INIT;
+static bool atrace_available = false;
+static bool trace_enabled = false;
+
+static void load_atrace(void) {
+  // libandroid is always loaded, so this only finds the existing handle
+  void *libandroid = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+  if (libandroid == NULL) {
+    return;
+  }
+  // assigned through the pointer's storage, as -pedantic rejects casting
+  // the result of dlsym to a function pointer
+  *(void **)&begin_section = dlsym(libandroid, "ATrace_beginSection");
+  *(void **)&end_section = dlsym(libandroid, "ATrace_endSection");
+  atrace_available = begin_section != NULL && end_section != NULL;
+}
+
+bool bsg_trace_set_enabled(bool enabled) {
+  if (enabled) {
+    pthread_once(&atrace_once, load_atrace);
+    if (!atrace_available) {
+      BUGSNAG_LOG("Tracing is not available before API 23");
+      return false;
+    }
+  }
+  __atomic_store_n(&trace_enabled, enabled, __ATOMIC_RELEASE);
+  return true;
+}
+
+void bsg_trace_enable_from_property(void) {
+  char value[PROP_VALUE_MAX];
+  if (__system_property_get(BSG_TRACE_PROPERTY, value) > 0 &&
+      strcmp(value, "1") == 0) {
+    bsg_trace_set_enabled(true);
+  }
+}
+
+void bsg_trace_begin(const char *name) {
+  if (!__atomic_load_n(&trace_enabled, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  begin_section(name);
+}
+
+void bsg_trace_end(void) {
+  if (!__atomic_load_n(&trace_enabled, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  end_section();
+}
@@ -12,6 +12,19 @@ internal class AnrPlugin : Plugin {
             "not report ANRs. See https://docs.bugsnag.com/platforms/android/anr-link-errors"
         private const val ANR_ERROR_CLASS = "ANR"
         private const val ANR_ERROR_MSG = "Application did not respond to UI input"
+        private const val ANR_HANDLER_SECTION = "anrHandler"
+
+        /**
+         * The points at which the native handler recorded each timestamp after SIGQUIT was
+         * received, in the order of bsg_anr_time in anr_handler.c
+         */
+        private val ANR_HANDLER_TIMES = listOf(
+            "unwoundNs",
+            "watchdogWokeNs",
+            "googleCalledNs",
+            "threadsCapturedNs",
+            "handedOffNs"
+        )
 
         internal fun doesJavaTraceLeadToNativeTrace(
             javaTrace: Array<StackTraceElement>
@@ -32,6 +45,7 @@ internal class AnrPlugin : Plugin {
     private external fun setUnwindFunction(unwindFunction: Long)
     private external fun enableAnrReporting()
     private external fun disableAnrReporting()
+    private external fun setNativeThreadCapture(maxThreads: Int, budgetMillis: Long): Boolean
 
     private fun loadClass(clz: String): Class<*>? {
         return try {
@@ -93,11 +107,36 @@ internal class AnrPlugin : Plugin {
         }
     }
 
+    /**
+     * Also report the native stacks of the main thread and up to [maxThreads] of the other
+     * threads which have used the most CPU time when an ANR occurs, as threads of type "c".
+     * They are captured after the ANR has been passed to Google's handler, and for no longer
+     * than [budgetMillis], which is capped at 5 seconds. Each thread takes about 100KB,
+     * which is allocated now. A [maxThreads] of less than 0 stops capturing threads.
+     *
+     * The stacks are only captured when the NDK plugin is also loaded. Returns false if
+     * capturing could not be enabled.
+     */
+    fun setThreadCapture(maxThreads: Int, budgetMillis: Long): Boolean {
+        return libraryLoader.isLoaded && setNativeThreadCapture(maxThreads, budgetMillis)
+    }
+
     /**
      * Notifies bugsnag that an ANR has occurred, by generating an Error report and populating it
      * with details of the ANR. Intended for internal use only.
+     *
+     * The native stackframes are packed into [frameAddresses] and [frameNames] rather
+     * than passed as objects, see [NativeInterface.createNativeStackframes]. They are followed
+     * by those of any other [threads] captured, see [NativeInterface.createNativeThreads].
+     * [timestamps] are when the native handler reached each point in handling the ANR.
      */
-    private fun notifyAnrDetected(nativeTrace: List<NativeStackframe>) {
+    private fun notifyAnrDetected(
+        frameAddresses: LongArray,
+        frameNames: ByteArray,
+        threads: LongArray?,
+        threadNames: ByteArray?,
+        timestamps: LongArray
+    ) {
         try {
             if (client.immutableConfig.shouldDiscardError(ANR_ERROR_CLASS)) {
                 return
@@ -117,10 +156,17 @@ internal class AnrPlugin : Plugin {
             err.errorClass = ANR_ERROR_CLASS
             err.errorMessage = ANR_ERROR_MSG
 
+            val frames = NativeInterface.createNativeStackframes(
+                frameAddresses,
+                frameNames,
+                ErrorType.C
+            )
+            val anrFrameCount = (frames.size - threadFrameCount(threads)).coerceAtLeast(0)
+
             // append native stackframes to error/thread stacktrace
             if (hasNativeComponent) {
                 // update error stacktrace
-                val nativeFrames = nativeTrace.map { Stackframe(it) }
+                val nativeFrames = frames.subList(0, anrFrameCount)
                 err.stacktrace.addAll(0, nativeFrames)
 
                 // update thread stacktrace
@@ -128,6 +174,14 @@ internal class AnrPlugin : Plugin {
                 errThread?.stacktrace?.addAll(0, nativeFrames)
             }
 
+            if (threads != null && threadNames != null) {
+                val nativeThreads = NativeInterface.createNativeThreads(
+                    frames, anrFrameCount, threads, threadNames, client.logger
+                )
+                event.threads.addAll(nativeThreads)
+            }
+
+            addHandlerTiming(event, timestamps)
             // wait and poll for error info to be collected. this occurs just before the ANR dialog
             // is displayed
             collector.collectAnrErrorDetails(client, event)
@@ -135,4 +189,35 @@ internal class AnrPlugin : Plugin {
             client.logger.e("Internal error reporting ANR", exception)
         }
     }
+
+    /**
+     * Add how long after SIGQUIT was received the native handler reached each point, and
+     * the event was ready to be reported, to the 'anrHandler' metadata section
+     */
+    private fun addHandlerTiming(event: Event, timestamps: LongArray) {
+        if (timestamps.isEmpty()) {
+            return
+        }
+        // the native timestamps are from CLOCK_MONOTONIC, as System.nanoTime() is
+        val received = timestamps[0]
+        ANR_HANDLER_TIMES.forEachIndexed { index, name ->
+            if (index + 1 < timestamps.size) {
+                event.addMetadata(ANR_HANDLER_SECTION, name, timestamps[index + 1] - received)
+            }
+        }
+        event.addMetadata(ANR_HANDLER_SECTION, "reportedNs", System.nanoTime() - received)
+    }
+
+    /**
+     * The number of frames of each thread, which are the second of each pair
+     */
+    private fun threadFrameCount(threads: LongArray?): Int {
+        var count = 0
+        if (threads != null) {
+            for (index in 1 until threads.size step 2) {
+                count += threads[index].toInt()
+            }
+        }
+        return count
+    }
 }
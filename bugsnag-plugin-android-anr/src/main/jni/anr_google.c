@@ -57,106 +57,131 @@
 // Functionality in this file:
 //
 // - bsg_google_anr_init (NOT async-safe): Find and save the Google ANR handler
-//   thread ID and the process ID, which are needed to make the syscall.
+//   thread ID and the process ID, which are needed to make the syscall. Only
+//   the first threads are checked, as the runtime starts its handler early on.
 //
-// - bsg_google_anr_call (async-safe): Make the syscall to send a SIGQUIT
-//   directly to the runtime library's ANR handler thread.
+// - bsg_google_anr_call: Check that the saved thread is still the Google ANR
+//   handler, scanning every thread for it again if not, and then make the
+//   syscall to send a SIGQUIT directly to it.
 
 #include "anr_google.h"
 
-#include <ctype.h>
 #include <dirent.h>
-#include <inttypes.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
-static pid_t process_id = -1;
-static pid_t google_thread_id = -1;
+#include "utils/proc.h"
 
-static bool is_thread_named_signal_catcher(pid_t tid) {
-  static const char *const SIGNAL_CATCHER_THREAD_NAME = "Signal Catcher";
+/**
+ * How many threads bsg_google_anr_init() checks. The runtime starts its
+ * handler before the app runs, so it is among the first threads listed.
+ */
+#define SIGNAL_CATCHER_INIT_BUDGET 32
 
-  bool success = false;
-  char buff[256];
+static const char SIGNAL_CATCHER_THREAD_NAME[] = "Signal Catcher";
 
-  snprintf(buff, sizeof(buff), "/proc/%d/comm", tid);
-  FILE *fp = fopen(buff, "r");
-  if (fp == NULL) {
-    return false;
-  }
+static pid_t process_id = -1;
+static pid_t google_thread_id = -1;
 
-  if (fgets(buff, sizeof(buff), fp) != NULL) {
-    success = strncmp(buff, SIGNAL_CATCHER_THREAD_NAME,
-                      strlen(SIGNAL_CATCHER_THREAD_NAME)) == 0;
-  }
+/** The comm file of google_thread_id, to check it without formatting a path */
+static char google_thread_comm_path[64];
 
-  fclose(fp);
-  return success;
+static bool is_comm_signal_catcher(int dir_fd, const char *path) {
+  char buff[32];
+  return bsg_read_proc_file(dir_fd, path, buff, sizeof(buff)) &&
+         strncmp(buff, SIGNAL_CATCHER_THREAD_NAME,
+                 sizeof(SIGNAL_CATCHER_THREAD_NAME) - 1) == 0;
 }
 
-static bool is_thread_signal_catcher_sigblk(pid_t tid) {
+static bool is_thread_signal_catcher_sigblk(int task_fd, pid_t tid) {
   static const uint64_t SIGNAL_CATCHER_THREAD_SIGBLK = 0x1000;
-  static const char *SIGBLK_HEADER = "SigBlk:\t";
-  const size_t SIGBLK_HEADER_LENGTH = strlen(SIGBLK_HEADER);
-
-  char buff[256];
-  uint64_t sigblk = 0;
+  static const char SIGBLK_HEADER[] = "\nSigBlk:\t";
 
-  snprintf(buff, sizeof(buff), "/proc/%d/status", tid);
-  FILE *fp = fopen(buff, "r");
-  if (fp == NULL) {
+  char path[32];
+  snprintf(path, sizeof(path), "%d/status", tid);
+  // the status file is around 1.5KB, and SigBlk is in the first half
+  char buff[2048];
+  if (!bsg_read_proc_file(task_fd, path, buff, sizeof(buff))) {
     return false;
   }
-
-  while (fgets(buff, sizeof(buff), fp) != NULL) {
-    if (strncmp(buff, SIGBLK_HEADER, SIGBLK_HEADER_LENGTH) == 0) {
-      sigblk = strtoull(buff + SIGBLK_HEADER_LENGTH, NULL, 16);
-      break;
-    }
+  const char *sigblk = strstr(buff, SIGBLK_HEADER);
+  if (sigblk == NULL) {
+    return false;
   }
-  fclose(fp);
-  return sigblk == SIGNAL_CATCHER_THREAD_SIGBLK;
+  return strtoull(sigblk + sizeof(SIGBLK_HEADER) - 1, NULL, 16) ==
+         SIGNAL_CATCHER_THREAD_SIGBLK;
 }
 
-bool bsg_google_anr_init() {
-  pid_t pid = getpid();
-  pid_t tid = -1;
-
-  char path[256];
+/**
+ * Check up to budget threads, or all threads with a budget of 0, and save the
+ * first which is the Google ANR handler
+ */
+static bool find_signal_catcher(pid_t pid, int budget) {
+  char path[32];
   snprintf(path, sizeof(path), "/proc/%d/task", pid);
-  DIR *dir = opendir(path);
+  int task_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (task_fd < 0) {
+    return false;
+  }
+  DIR *dir = fdopendir(task_fd);
   if (dir == NULL) {
+    close(task_fd);
     return false;
   }
 
+  pid_t tid = -1;
+  int checked = 0;
   struct dirent *dent;
-  while ((dent = readdir(dir)) != NULL) {
+  while ((budget == 0 || checked < budget) && (dent = readdir(dir)) != NULL) {
     if (dent->d_name[0] < '0' || dent->d_name[0] > '9') {
       continue;
     }
+    checked++;
 
-    tid = strtol(dent->d_name, NULL, 10);
-    if (is_thread_named_signal_catcher(tid) &&
-        is_thread_signal_catcher_sigblk(tid)) {
+    // the name is checked first, as it is the cheaper file to read
+    snprintf(path, sizeof(path), "%s/comm", dent->d_name);
+    tid = (pid_t)strtol(dent->d_name, NULL, 10);
+    if (is_comm_signal_catcher(task_fd, path) &&
+        is_thread_signal_catcher_sigblk(task_fd, tid)) {
       break;
     }
     tid = -1;
   }
+  // also closes task_fd
   closedir(dir);
 
   if (tid < 0) {
     return false;
   }
-
+  snprintf(google_thread_comm_path, sizeof(google_thread_comm_path),
+           "/proc/%d/task/%d/comm", pid, tid);
   google_thread_id = tid;
-  process_id = pid;
   return true;
 }
 
+bool bsg_google_anr_init() {
+  process_id = getpid();
+  return find_signal_catcher(process_id, SIGNAL_CATCHER_INIT_BUDGET);
+}
+
 void bsg_google_anr_call() {
-  if (process_id >= 0 && google_thread_id >= 0) {
-    syscall(SYS_tgkill, process_id, google_thread_id, SIGQUIT);
+  if (process_id < 0) {
+    return;
+  }
+  // a thread id can be reused once its thread has stopped, so the name is
+  // checked before signalling it
+  if (google_thread_id < 0 ||
+      !is_comm_signal_catcher(AT_FDCWD, google_thread_comm_path)) {
+    google_thread_id = -1;
+    if (!find_signal_catcher(process_id, 0)) {
+      return;
+    }
   }
+  syscall(SYS_tgkill, process_id, google_thread_id, SIGQUIT);
 }
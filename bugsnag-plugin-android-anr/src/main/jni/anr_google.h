@@ -5,24 +5,26 @@
 
 /**
  * Initialize the Google ANR caller. This must be called before any other
- * functions in this file. If the call fails, all other calls in this file will
- * be no-ops.
+ * functions in this file. Only the first threads of the process are checked
+ * for Google's "Signal Catcher" thread, and if it is not found then every
+ * thread is checked for it on the next bsg_google_anr_call().
  *
  * Note: This function is NOT async-safe.
  *
- * @return true if successful.
+ * @return true if the thread was found.
  */
 bool bsg_google_anr_init(void);
 
 /**
  * Raises a SIGQUIT signal directly on Google's "Signal Catcher" thread in the
  * runtime library. This function will no-op if bsg_google_anr_init() was not
- * called, or the call failed.
+ * called, or the thread cannot be found. The thread found before is checked by
+ * its name, and only if that has changed are all threads checked again.
  *
  * Note: This MUST be called from a non-signal-handler thread (create a separate
  * thread that waits to call this function).
  *
- * Note: This function is async-safe.
+ * Note: This function is async-safe, unless the thread has to be found again.
  */
 void bsg_google_anr_call(void);
 
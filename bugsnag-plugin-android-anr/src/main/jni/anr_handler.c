@@ -3,17 +3,21 @@
 #include <errno.h>
 #include <jni.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <linux/futex.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include "anr_google.h"
+#include "anr_threads.h"
+#include "jni_common_cache.h"
+#include "safejni_common.h"
+#include "time_common.h"
+#include "trace_common.h"
 #include "unwind_func.h"
 #include "utils/string.h"
 
-#define JNI_VERSION JNI_VERSION_1_6
-
 // Lock for changing the handler configuration
 static pthread_mutex_t bsg_anr_handler_config = PTHREAD_MUTEX_INITIALIZER;
 
@@ -23,232 +27,181 @@ static bool enabled = false;
 static bool installed = false;
 
 static pthread_t watchdog_thread;
-static bool should_wait_for_semaphore = false;
-static sem_t watchdog_thread_semaphore;
-static volatile bool watchdog_thread_triggered = false;
+// Set by the SIGQUIT handler, and waited on by the watchdog thread as a futex
+static int watchdog_thread_triggered = 0;
 
 static jmethodID mthd_notify_anr_detected = NULL;
 static jobject obj_plugin = NULL;
-static jclass frame_class = NULL;
-static jobject error_type = NULL;
-static jmethodID frame_init = NULL;
 
 static bugsnag_stackframe anr_stacktrace[BUGSNAG_FRAMES_MAX];
 static ssize_t anr_stacktrace_length = 0;
 
-static unwind_func unwind_stack_function;
-
-// duplication required for JNI methods that originally came from
-// bugsnag-plugin-android-ndk. Until a shared C module is available
-// for sharing common code when PLAT-5794 is addressed, this
-// duplication is a necessary evil.
+// The frame, symbol and load addresses and the line number of each frame
+#define BSG_ANR_FRAME_ADDRESS_COUNT 4
 
-static JavaVM *jvm = NULL;
-static pthread_key_t jni_cleanup_key;
+// A stacktrace packed for the JVM by pack_stacktrace()
+static jlong anr_frame_addresses[BUGSNAG_FRAMES_MAX *
+                                 BSG_ANR_FRAME_ADDRESS_COUNT];
+static char anr_frame_names[BUGSNAG_FRAMES_MAX *
+                            (sizeof(anr_stacktrace[0].method) +
+                             sizeof(anr_stacktrace[0].filename) + 2)];
 
-static void detach_env(void *env) {
-  if (jvm != NULL && env != NULL) {
-    (*jvm)->DetachCurrentThread(jvm);
-  }
-}
-
-static JNIEnv *get_env() {
-  if (jvm == NULL) {
-    return NULL;
-  }
-
-  JNIEnv *env = NULL;
-  switch ((*jvm)->GetEnv(jvm, (void **)&env, JNI_VERSION)) {
-  case JNI_OK:
-    return env;
-  case JNI_EDETACHED:
-    if ((*jvm)->AttachCurrentThread(jvm, &env, NULL) != JNI_OK) {
-      BUGSNAG_LOG("Could not attach thread to JVM");
-      return NULL;
-    }
-    if (env == NULL) {
-      BUGSNAG_LOG("AttachCurrentThread filled a NULL JNIEnv");
-      return NULL;
-    }
-
-    // attach a destructor to detach the env before the thread terminates
-    pthread_setspecific(jni_cleanup_key, env);
+static unwind_func unwind_stack_function;
 
-    return env;
-  default:
-    BUGSNAG_LOG("Could not get JNIEnv");
-    return NULL;
-  }
+/**
+ * The points at which the latest ANR was handled, which are reported to show
+ * where the time before it is reported goes
+ */
+typedef enum {
+  /** handle_sigquit() was entered */
+  BSG_ANR_TIME_SIGQUIT,
+  /** The stack of the thread which received SIGQUIT was unwound */
+  BSG_ANR_TIME_UNWOUND,
+  /** The watchdog thread woke for the ANR */
+  BSG_ANR_TIME_WATCHDOG_WOKE,
+  /** The ANR was passed to Google's handler */
+  BSG_ANR_TIME_GOOGLE_CALLED,
+  /** Any other threads configured were captured */
+  BSG_ANR_TIME_THREADS_CAPTURED,
+  /** The ANR was packed, and is about to be passed to the JVM */
+  BSG_ANR_TIME_HANDED_OFF,
+  BSG_ANR_TIME_COUNT
+} bsg_anr_time;
+
+// CLOCK_MONOTONIC times, as System.nanoTime() in the JVM
+static jlong anr_timestamps[BSG_ANR_TIME_COUNT];
+
+static void record_anr_time(bsg_anr_time point) {
+  anr_timestamps[point] = (jlong)bsg_monotonic_time_ns();
 }
 
-static bool check_and_clear_exc(JNIEnv *env) {
+static bool configure_anr_jni_impl(JNIEnv *env) {
   if (env == NULL) {
     return false;
   }
-  if ((*env)->ExceptionCheck(env)) {
-    BUGSNAG_LOG("BUG: JNI Native->Java call threw an exception:");
-
-    // Print a trace to stderr so that we can debug it
-    (*env)->ExceptionDescribe(env);
-
-    // Trigger more accurate dalvik trace (this will also crash the app).
-
-    // Code review check: THIS MUST BE COMMENTED OUT IN CHECKED IN CODE!
-    //(*env)->FindClass(env, NULL);
-
-    // Clear the exception so that we don't crash.
-    (*env)->ExceptionClear(env);
-    return true;
-  }
-  return false;
-}
-
-static jclass safe_find_class(JNIEnv *env, const char *clz_name) {
-  if (env == NULL || clz_name == NULL) {
-    return NULL;
-  }
-  jclass clz = (*env)->FindClass(env, clz_name);
-  if (check_and_clear_exc(env)) {
-    return NULL;
-  }
-  return clz;
-}
 
-static jmethodID safe_get_method_id(JNIEnv *env, jclass clz, const char *name,
-                                    const char *sig) {
-  if (env == NULL || clz == NULL || name == NULL || sig == NULL) {
-    return NULL;
+  jclass clz = bsg_safe_find_class(env, "com/bugsnag/android/AnrPlugin");
+  if (clz == NULL) {
+    return false;
   }
-  jmethodID methodId = (*env)->GetMethodID(env, clz, name, sig);
-  if (check_and_clear_exc(env)) {
-    return NULL;
+  mthd_notify_anr_detected = bsg_safe_get_method_id(
+      env, clz, "notifyAnrDetected", "([J[B[J[B[J)V");
+  if (mthd_notify_anr_detected == NULL) {
+    return false;
   }
-  return methodId;
-}
 
-static jfieldID safe_get_static_field_id(JNIEnv *env, jclass clz,
-                                         const char *name, const char *sig) {
-  if (env == NULL || clz == NULL || name == NULL || sig == NULL) {
-    return NULL;
-  }
-  jfieldID fid = (*env)->GetStaticFieldID(env, clz, name, sig);
-  if (check_and_clear_exc(env)) {
-    return NULL;
-  }
-  return fid;
+  // Initialize the VM last so that no env is available if any part of the
+  // init goes wrong.
+  return bsg_jni_common_cache_init(env);
 }
 
-static jobject safe_get_static_object_field(JNIEnv *env, jclass clz,
-                                            jfieldID field) {
-  if (env == NULL || clz == NULL || field == NULL) {
-    return NULL;
-  }
-  jobject obj = (*env)->GetStaticObjectField(env, clz, field);
-  if (check_and_clear_exc(env)) {
-    return NULL;
+static bool configure_anr_jni(JNIEnv *env) {
+  bool success = configure_anr_jni_impl(env);
+  if (!success) {
+    BUGSNAG_LOG("Failed to fetch Java VM. ANR handler not installed.");
   }
-  return obj;
+  return success;
 }
 
-static jobject safe_new_object(JNIEnv *env, jclass clz, jmethodID method, ...) {
-  if (env == NULL || clz == NULL) {
-    return NULL;
-  }
-  va_list args;
-  va_start(args, method);
-  jobject obj = (*env)->NewObjectV(env, clz, method, args);
-  va_end(args);
-  if (check_and_clear_exc(env)) {
-    return NULL;
+static size_t stacktrace_names_length(const bugsnag_stackframe *frames,
+                                      ssize_t frame_count) {
+  size_t length = 0;
+  for (ssize_t i = 0; i < frame_count; i++) {
+    length += strnlen(frames[i].method, sizeof(frames[i].method)) + 1;
+    length += strnlen(frames[i].filename, sizeof(frames[i].filename)) + 1;
   }
-  return obj;
+  return length;
 }
 
-static jstring safe_new_string_utf(JNIEnv *env, const char *str) {
-  if (env == NULL || str == NULL) {
-    return NULL;
-  }
-  jstring jstr = (*env)->NewStringUTF(env, str);
-  if (check_and_clear_exc(env)) {
-    return NULL;
-  }
-  return jstr;
+/**
+ * Pack the frame, symbol and load addresses and line number of each frame into
+ * anr_frame_addresses, and its method and filename into anr_frame_names, with
+ * each name terminated by a NUL. This is the layout unpacked by
+ * NativeInterface.createNativeStackframes().
+ *
+ * @return the length of the names, in bytes
+ */
+static size_t pack_stacktrace(const bugsnag_stackframe *frames,
+                              ssize_t frame_count) {
+  size_t names_length = 0;
+  for (ssize_t i = 0; i < frame_count; i++) {
+    const bugsnag_stackframe *frame = frames + i;
+    jlong *addresses = anr_frame_addresses + i * BSG_ANR_FRAME_ADDRESS_COUNT;
+    addresses[0] = (jlong)frame->frame_address;
+    addresses[1] = (jlong)frame->symbol_address;
+    addresses[2] = (jlong)frame->load_address;
+    addresses[3] = (jlong)frame->line_number;
+
+    const size_t method_length = strnlen(frame->method, sizeof(frame->method));
+    memcpy(anr_frame_names + names_length, frame->method, method_length);
+    names_length += method_length;
+    anr_frame_names[names_length++] = '\0';
+
+    const size_t filename_length =
+        strnlen(frame->filename, sizeof(frame->filename));
+    memcpy(anr_frame_names + names_length, frame->filename, filename_length);
+    names_length += filename_length;
+    anr_frame_names[names_length++] = '\0';
+  }
+  return names_length;
 }
 
-static void safe_delete_local_ref(JNIEnv *env, jobject obj) {
-  if (env != NULL && obj != NULL) {
-    (*env)->DeleteLocalRef(env, obj);
-  }
+/**
+ * Pack a stacktrace into the arrays at the given offsets, which are advanced
+ * past it
+ */
+static bool copy_stacktrace(JNIEnv *env, const bugsnag_stackframe *frames,
+                            ssize_t frame_count, jlongArray jaddresses,
+                            jsize *address_offset, jbyteArray jnames,
+                            jsize *names_offset) {
+  const size_t names_length = pack_stacktrace(frames, frame_count);
+  const jsize address_count =
+      (jsize)(frame_count * BSG_ANR_FRAME_ADDRESS_COUNT);
+  (*env)->SetLongArrayRegion(env, jaddresses, *address_offset, address_count,
+                             anr_frame_addresses);
+  (*env)->SetByteArrayRegion(env, jnames, *names_offset, (jsize)names_length,
+                             (const jbyte *)anr_frame_names);
+  *address_offset += address_count;
+  *names_offset += (jsize)names_length;
+  return !bsg_check_and_clear_exc(env);
 }
 
-// End of duplication
-
-static bool configure_anr_jni_impl(JNIEnv *env) {
-  if (env == NULL) {
-    return false;
-  }
-
-  jclass clz = safe_find_class(env, "com/bugsnag/android/AnrPlugin");
-  if (clz == NULL) {
-    return false;
-  }
-  mthd_notify_anr_detected =
-      safe_get_method_id(env, clz, "notifyAnrDetected", "(Ljava/util/List;)V");
-  if (mthd_notify_anr_detected == NULL) {
-    return false;
-  }
-
-  // find ErrorType class
-  jclass error_type_class =
-      safe_find_class(env, "com/bugsnag/android/ErrorType");
-  if (error_type_class == NULL) {
-    return false;
-  }
-  jfieldID error_type_field = safe_get_static_field_id(
-      env, error_type_class, "C", "Lcom/bugsnag/android/ErrorType;");
-  if (error_type_field == NULL) {
-    return false;
-  }
-  error_type =
-      safe_get_static_object_field(env, error_type_class, error_type_field);
-  if (error_type == NULL) {
-    return false;
+/**
+ * Pass the id and number of frames of each captured thread as pairs
+ * in jthreads, and their names in jthread_names each terminated by a NUL
+ */
+static bool new_thread_arrays(JNIEnv *env, const bsg_anr_thread *threads,
+                              size_t thread_count, jlongArray *jthreads,
+                              jbyteArray *jthread_names) {
+  jlong ids[(BSG_ANR_THREADS_MAX + 1) * 2];
+  char names[(BSG_ANR_THREADS_MAX + 1) * sizeof(threads[0].name)];
+  jsize id_count = 0;
+  jsize names_length = 0;
+  for (size_t i = 0; i < thread_count; i++) {
+    if (!threads[i].captured) {
+      continue;
+    }
+    ids[id_count++] = threads[i].tid;
+    ids[id_count++] = threads[i].frame_count;
+    const size_t length =
+        strnlen(threads[i].name, sizeof(threads[i].name) - 1);
+    memcpy(names + names_length, threads[i].name, length);
+    names_length += (jsize)length;
+    names[names_length++] = '\0';
   }
-  error_type = (*env)->NewGlobalRef(env, error_type);
 
-  // find NativeStackFrame class
-  frame_class = safe_find_class(env, "com/bugsnag/android/NativeStackframe");
-  if (frame_class == NULL) {
+  *jthreads = (*env)->NewLongArray(env, id_count);
+  if (bsg_check_and_clear_exc(env) || *jthreads == NULL) {
     return false;
   }
-  frame_class = (*env)->NewGlobalRef(env, frame_class);
-
-  // find NativeStackframe ctor
-  frame_init = safe_get_method_id(
-      env, frame_class, "<init>",
-      "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/Number;Ljava/lang/"
-      "Long;Ljava/lang/Long;Ljava/lang/Long;Ljava/lang/Boolean;Lcom/bugsnag/"
-      "android/ErrorType;)V");
-  if (frame_init == NULL) {
-    return false;
-  }
-
-  // Initialize jvm last so that it's guaranteed NULL if any part of the init
-  // goes wrong.
-  if ((*env)->GetJavaVM(env, &jvm) != JNI_OK) {
+  *jthread_names = (*env)->NewByteArray(env, names_length);
+  if (bsg_check_and_clear_exc(env) || *jthread_names == NULL) {
     return false;
   }
-
-  pthread_key_create(&jni_cleanup_key, detach_env);
-  return true;
-}
-
-static bool configure_anr_jni(JNIEnv *env) {
-  bool success = configure_anr_jni_impl(env);
-  if (!success) {
-    BUGSNAG_LOG("Failed to fetch Java VM. ANR handler not installed.");
-  }
-  return success;
+  (*env)->SetLongArrayRegion(env, *jthreads, 0, id_count, ids);
+  (*env)->SetByteArrayRegion(env, *jthread_names, 0, names_length,
+                             (const jbyte *)names);
+  return !bsg_check_and_clear_exc(env);
 }
 
 static void notify_anr_detected() {
@@ -256,76 +209,100 @@ static void notify_anr_detected() {
     return;
   }
 
-  JNIEnv *env = get_env();
+  JNIEnv *env = bsg_jni_common_get_env();
   if (env == NULL) {
     return;
   }
 
-  jclass list_class = safe_find_class(env, "java/util/LinkedList");
-  if (list_class == NULL) {
-    return;
-  }
-  jmethodID list_init = safe_get_method_id(env, list_class, "<init>", "()V");
-  if (list_init == NULL) {
-    return;
-  }
-  jmethodID list_add =
-      safe_get_method_id(env, list_class, "add", "(Ljava/lang/Object;)Z");
-  if (list_add == NULL) {
-    return;
-  }
-  jclass int_class = safe_find_class(env, "java/lang/Integer");
-  if (int_class == NULL) {
-    return;
-  }
-  jmethodID int_init = safe_get_method_id(env, int_class, "<init>", "(I)V");
-  if (int_init == NULL) {
-    return;
-  }
-  jclass long_class = safe_find_class(env, "java/lang/Long");
-  if (long_class == NULL) {
-    return;
-  }
-  jmethodID long_init = safe_get_method_id(env, long_class, "<init>", "(J)V");
-  if (long_init == NULL) {
-    return;
+  // the other threads are captured after the ANR has been passed to Google's
+  // handler, so that it is not delayed
+  size_t thread_count = 0;
+  bsg_trace_begin("bugsnag:anr-capture-threads");
+  const bsg_anr_thread *threads =
+      bsg_anr_threads_capture(unwind_stack_function, &thread_count);
+  bsg_trace_end();
+  bool threads_held = true;
+  record_anr_time(BSG_ANR_TIME_THREADS_CAPTURED);
+  bsg_trace_begin("bugsnag:anr-copy-frames");
+  bool copying = true;
+
+  // the frames are passed as two arrays rather than as objects, as the main
+  // thread is already blocked by the time an ANR is reported. The frames of
+  // the other threads follow those of the ANR.
+  ssize_t frame_count = anr_stacktrace_length;
+  size_t names_length =
+      stacktrace_names_length(anr_stacktrace, anr_stacktrace_length);
+  for (size_t i = 0; i < thread_count; i++) {
+    if (threads[i].captured) {
+      frame_count += threads[i].frame_count;
+      names_length +=
+          stacktrace_names_length(threads[i].frames, threads[i].frame_count);
+    }
   }
 
-  jobject jlist = safe_new_object(env, list_class, list_init);
-  if (jlist == NULL) {
-    return;
-  }
-  for (ssize_t i = 0; i < anr_stacktrace_length; i++) {
-    bugsnag_stackframe *frame = anr_stacktrace + i;
-    jobject jmethod = safe_new_string_utf(env, frame->method);
-    jobject jfilename = safe_new_string_utf(env, frame->filename);
-    jobject jline_number =
-        safe_new_object(env, int_class, int_init, (jint)frame->line_number);
-    jobject jframe_address = safe_new_object(env, long_class, long_init,
-                                             (jlong)frame->frame_address);
-    jobject jsymbol_address = safe_new_object(env, long_class, long_init,
-                                              (jlong)frame->symbol_address);
-    jobject jload_address =
-        safe_new_object(env, long_class, long_init, (jlong)frame->load_address);
-    jobject jframe = safe_new_object(
-        env, frame_class, frame_init, jmethod, jfilename, jline_number,
-        jframe_address, jsymbol_address, jload_address, NULL, error_type);
-    if (jframe != NULL) {
-      (*env)->CallBooleanMethod(env, jlist, list_add, jframe);
-      check_and_clear_exc(env);
+  jlongArray jtimestamps = NULL;
+  jlongArray jthreads = NULL;
+  jbyteArray jthread_names = NULL;
+  jbyteArray jnames = NULL;
+  jlongArray jaddresses = (*env)->NewLongArray(
+      env, (jsize)(frame_count * BSG_ANR_FRAME_ADDRESS_COUNT));
+  if (bsg_check_and_clear_exc(env) || jaddresses == NULL) {
+    goto exit;
+  }
+  jnames = (*env)->NewByteArray(env, (jsize)names_length);
+  if (bsg_check_and_clear_exc(env) || jnames == NULL) {
+    goto exit;
+  }
+  jsize address_offset = 0;
+  jsize names_offset = 0;
+  if (!copy_stacktrace(env, anr_stacktrace, anr_stacktrace_length, jaddresses,
+                       &address_offset, jnames, &names_offset)) {
+    goto exit;
+  }
+  if (threads != NULL) {
+    for (size_t i = 0; i < thread_count; i++) {
+      if (threads[i].captured &&
+          !copy_stacktrace(env, threads[i].frames, threads[i].frame_count,
+                           jaddresses, &address_offset, jnames,
+                           &names_offset)) {
+        goto exit;
+      }
+    }
+    if (!new_thread_arrays(env, threads, thread_count, &jthreads,
+                           &jthread_names)) {
+      goto exit;
     }
-    safe_delete_local_ref(env, jmethod);
-    safe_delete_local_ref(env, jfilename);
-    safe_delete_local_ref(env, jline_number);
-    safe_delete_local_ref(env, jframe_address);
-    safe_delete_local_ref(env, jsymbol_address);
-    safe_delete_local_ref(env, jload_address);
-    safe_delete_local_ref(env, jframe);
   }
-
-  (*env)->CallVoidMethod(env, obj_plugin, mthd_notify_anr_detected, jlist);
-  check_and_clear_exc(env);
-  safe_delete_local_ref(env, jlist);
+  bsg_anr_threads_release();
+  threads_held = false;
+  bsg_trace_end();
+  copying = false;
+
+  jtimestamps = (*env)->NewLongArray(env, BSG_ANR_TIME_COUNT);
+  if (bsg_check_and_clear_exc(env) || jtimestamps == NULL) {
+    goto exit;
+  }
+  record_anr_time(BSG_ANR_TIME_HANDED_OFF);
+  (*env)->SetLongArrayRegion(env, jtimestamps, 0, BSG_ANR_TIME_COUNT,
+                             anr_timestamps);
+  bsg_trace_begin("bugsnag:anr-notify");
+  (*env)->CallVoidMethod(env, obj_plugin, mthd_notify_anr_detected, jaddresses,
+                         jnames, jthreads, jthread_names, jtimestamps);
+  bsg_check_and_clear_exc(env);
+  bsg_trace_end();
+
+exit:
+  if (copying) {
+    bsg_trace_end();
+  }
+  if (threads_held) {
+    bsg_anr_threads_release();
+  }
+  bsg_safe_delete_local_ref(env, jtimestamps);
+  bsg_safe_delete_local_ref(env, jthread_names);
+  bsg_safe_delete_local_ref(env, jthreads);
+  bsg_safe_delete_local_ref(env, jnames);
+  bsg_safe_delete_local_ref(env, jaddresses);
 }
 
 static inline void block_sigquit() {
@@ -349,46 +326,39 @@ static inline void unblock_sigquit() {
 }
 
 static inline void trigger_sigquit_watchdog_thread() {
-  // Set the trigger flag for the fallback spin-lock in
-  // sigquit_watchdog_thread_main()
-  watchdog_thread_triggered = true;
-
-  if (should_wait_for_semaphore) {
-    // Although sem_post() is not officially marked as async-safe, the Android
-    // implementation simply does an atomic compare-and-exchange when there is
-    // only one thread waiting (which is the case here).
-    // https://cs.android.com/android/platform/superproject/+/master:bionic/libc/bionic/semaphore.cpp;l=289?q=sem_post&ss=android
-    if (sem_post(&watchdog_thread_semaphore) != 0) {
-      // The only possible failure from sem_post is EOVERFLOW, which won't
-      // happen in this code. But just to be thorough...
-      BUGSNAG_LOG("Could not unlock Bugsnag sigquit handler semaphore");
-    }
-  }
+  // Both the store and the futex system call are async-safe, unlike sem_post()
+  // which is not guaranteed to be.
+  __atomic_store_n(&watchdog_thread_triggered, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &watchdog_thread_triggered, FUTEX_WAKE_PRIVATE, 1, NULL,
+          NULL, 0);
 }
 
 static void watchdog_wait_for_trigger() {
-  static const useconds_t delay_100ms = 100000;
-
-  // Use sem_wait() if possible, falling back to polling.
-  watchdog_thread_triggered = false;
-  if (!should_wait_for_semaphore || sem_wait(&watchdog_thread_semaphore) != 0) {
-    while (!watchdog_thread_triggered) {
-      usleep(delay_100ms);
-    }
+  // Block until trigger_sigquit_watchdog_thread() runs, taking the trigger so
+  // that the next wait blocks again. The wait returns early if the trigger has
+  // already been set, and is retried if it is interrupted.
+  while (__atomic_exchange_n(&watchdog_thread_triggered, 0, __ATOMIC_ACQ_REL) ==
+         0) {
+    syscall(SYS_futex, &watchdog_thread_triggered, FUTEX_WAIT_PRIVATE, 0, NULL,
+            NULL, 0);
   }
 }
 
 _Noreturn static void *sigquit_watchdog_thread_main(__unused void *_) {
-  static const useconds_t delay_100ms = 100000;
-
   for (;;) {
     watchdog_wait_for_trigger();
+    record_anr_time(BSG_ANR_TIME_WATCHDOG_WOKE);
+    bsg_trace_begin("bugsnag:anr");
 
     // Trigger Google ANR processing (occurs on a different thread).
+    bsg_trace_begin("bugsnag:anr-google");
     bsg_google_anr_call();
+    bsg_trace_end();
+    record_anr_time(BSG_ANR_TIME_GOOGLE_CALLED);
 
     // Trigger our ANR processing on our JNI worker thread (if enabled).
     notify_anr_detected();
+    bsg_trace_end();
 
     // Unblock SIGQUIT again so that handle_sigquit() will run again.
     unblock_sigquit();
@@ -397,6 +367,9 @@ _Noreturn static void *sigquit_watchdog_thread_main(__unused void *_) {
 
 static void handle_sigquit(__unused int signum, siginfo_t *info,
                            void *user_context) {
+  // bsg_monotonic_time_ns() is async-safe
+  record_anr_time(BSG_ANR_TIME_SIGQUIT);
+
   // Re-block SIGQUIT so that the Google handler can trigger.
   // Do it in this handler so that the signal pending flags flip on the next
   // context switch and will be off when the next sigquit_watchdog_thread_main()
@@ -408,6 +381,7 @@ static void handle_sigquit(__unused int signum, siginfo_t *info,
     anr_stacktrace_length =
         unwind_stack_function(anr_stacktrace, info, user_context);
   }
+  record_anr_time(BSG_ANR_TIME_UNWOUND);
 
   // Tell sigquit_watchdog_thread_main() to report an ANR.
   trigger_sigquit_watchdog_thread();
@@ -415,18 +389,11 @@ static void handle_sigquit(__unused int signum, siginfo_t *info,
 
 static void install_signal_handler() {
   if (!bsg_google_anr_init()) {
-    BUGSNAG_LOG("Failed to initialize Google ANR caller. ANRs won't be sent to "
-                "Google.");
+    BUGSNAG_LOG("Failed to find Google's ANR handler thread. It will be "
+                "looked for again when an ANR occurs.");
     // We can still report to Bugsnag, so continue.
   }
 
-  if (sem_init(&watchdog_thread_semaphore, 0, 0) == 0) {
-    should_wait_for_semaphore = true;
-  } else {
-    BUGSNAG_LOG("Failed to init semaphore");
-    // We can still poll watchdog_thread_triggered, so continue.
-  }
-
   // Start the watchdog thread sigquit_watchdog_thread_main().
   if (pthread_create(&watchdog_thread, NULL, sigquit_watchdog_thread_main,
                      NULL) != 0) {
@@ -456,6 +423,7 @@ static void install_signal_handler() {
 bool bsg_handler_install_anr(JNIEnv *env, jobject plugin) {
   pthread_mutex_lock(&bsg_anr_handler_config);
 
+  bsg_trace_enable_from_property();
   enabled = true;
   if (!installed && configure_anr_jni(env) && plugin != NULL) {
     obj_plugin = (*env)->NewGlobalRef(env, plugin);
@@ -0,0 +1,304 @@
+#include "anr_threads.h"
+
+#include <android/log.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "anr_handler.h"
+#include "signal_common.h"
+#include "time_common.h"
+#include "utils/proc.h"
+
+/*
+ * Each target is signalled with a real-time signal which no one else handles,
+ * and unwinds its own stack from the handler into its bsg_anr_thread. The
+ * capturing thread waits on the state of that thread as a futex, and abandons
+ * it once the budget runs out. A handler which is still unwinding when it is
+ * abandoned keeps its buffer, which is not freed while it is in use.
+ */
+
+typedef enum {
+  BSG_ANR_THREAD_IDLE,
+  /** The thread has been signalled, and its handler has not yet run */
+  BSG_ANR_THREAD_PENDING,
+  /** The handler is unwinding the thread */
+  BSG_ANR_THREAD_CAPTURING,
+  BSG_ANR_THREAD_DONE,
+  /** The capturing thread stopped waiting before the handler ran */
+  BSG_ANR_THREAD_ABANDONED,
+} bsg_anr_thread_state;
+
+static pthread_mutex_t bsg_anr_threads_config = PTHREAD_MUTEX_INITIALIZER;
+
+/** The signal used to capture threads, or 0 if it is not installed */
+static int capture_signal = 0;
+static int max_capture_threads = -1;
+static uint64_t capture_budget_ns = 0;
+
+/** The main thread and then up to max_capture_threads others */
+static bsg_anr_thread *capture_threads = NULL;
+static size_t capture_threads_size = 0;
+
+/** The thread whose handler is being waited for, if any */
+static bsg_anr_thread *capture_target = NULL;
+static unwind_func capture_unwind = NULL;
+
+static bool change_state(bsg_anr_thread *thread, int expected, int desired) {
+  return __atomic_compare_exchange_n(&thread->state, &expected, desired, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void handle_capture_signal(int signum, siginfo_t *info,
+                                  void *user_context) {
+  bsg_anr_thread *thread = __atomic_load_n(&capture_target, __ATOMIC_ACQUIRE);
+  // a signal can arrive after the capturing thread stopped waiting for it
+  if (thread == NULL || thread->tid != (pid_t)syscall(SYS_gettid) ||
+      !change_state(thread, BSG_ANR_THREAD_PENDING, BSG_ANR_THREAD_CAPTURING)) {
+    return;
+  }
+  thread->frame_count = capture_unwind(thread->frames, info, user_context);
+  __atomic_store_n(&thread->state, BSG_ANR_THREAD_DONE, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &thread->state, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL,
+          0);
+}
+
+static bool install_capture_signal(void) {
+  if (capture_signal != 0) {
+    return true;
+  }
+  capture_signal = bsg_claim_rt_signal(handle_capture_signal);
+  if (capture_signal != 0) {
+    return true;
+  }
+  BUGSNAG_LOG("No signal is available for capturing ANR threads");
+  return false;
+}
+
+static bool is_capture_in_use(void) {
+  for (size_t i = 0; i < capture_threads_size; i++) {
+    if (__atomic_load_n(&capture_threads[i].state, __ATOMIC_ACQUIRE) ==
+        BSG_ANR_THREAD_CAPTURING) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool bsg_anr_threads_configure(int max_threads, int64_t budget_ms) {
+  pthread_mutex_lock(&bsg_anr_threads_config);
+  bool configured = false;
+  if (max_threads < 0) {
+    max_capture_threads = -1;
+    configured = true;
+    goto exit;
+  }
+  if (max_threads > BSG_ANR_THREADS_MAX) {
+    max_threads = BSG_ANR_THREADS_MAX;
+  }
+  if (budget_ms <= 0 || budget_ms > BSG_ANR_THREADS_BUDGET_MAX_MS) {
+    budget_ms = BSG_ANR_THREADS_BUDGET_MAX_MS;
+  }
+  if (!install_capture_signal()) {
+    goto exit;
+  }
+
+  const size_t size = (size_t)max_threads + 1;
+  if (size > capture_threads_size) {
+    bsg_anr_thread *threads = calloc(size, sizeof(bsg_anr_thread));
+    if (threads == NULL) {
+      BUGSNAG_LOG("Could not allocate buffers for capturing ANR threads");
+      goto exit;
+    }
+    // a handler still unwinding after its capture was abandoned keeps the
+    // buffer it is writing to
+    if (!is_capture_in_use()) {
+      free(capture_threads);
+    }
+    capture_threads = threads;
+    capture_threads_size = size;
+  }
+  max_capture_threads = max_threads;
+  capture_budget_ns = budget_ms * 1000000;
+  configured = true;
+
+exit:
+  pthread_mutex_unlock(&bsg_anr_threads_config);
+  return configured;
+}
+
+typedef struct {
+  pid_t tid;
+  uint64_t cpu_time;
+} bsg_busy_thread;
+
+/**
+ * The user and system time of a thread, from fields 14 and 15 of its stat
+ * file, or 0 if it cannot be read
+ */
+static uint64_t read_cpu_time(int task_fd, const char *tid) {
+  char path[32];
+  char buff[512];
+  snprintf(path, sizeof(path), "%s/stat", tid);
+  if (!bsg_read_proc_file(task_fd, path, buff, sizeof(buff))) {
+    return 0;
+  }
+  // the name in field 2 can contain spaces and brackets, so fields are counted
+  // from the bracket after it
+  const char *field = strrchr(buff, ')');
+  if (field == NULL) {
+    return 0;
+  }
+  for (int index = 2; index < 14 && field != NULL; index++) {
+    field = strchr(field + 1, ' ');
+  }
+  if (field == NULL) {
+    return 0;
+  }
+  char *stime = NULL;
+  const uint64_t utime = strtoull(field + 1, &stime, 10);
+  return utime + strtoull(stime, NULL, 10);
+}
+
+/**
+ * Find up to count of the threads with the most CPU time, other than the
+ * main and current threads, stopping at deadline_ns
+ *
+ * @return the number of threads found
+ */
+static size_t find_busy_threads(pid_t pid, pid_t current_tid,
+                                bsg_busy_thread *busy, size_t count,
+                                uint64_t deadline_ns) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/task", pid);
+  int task_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (task_fd < 0) {
+    return 0;
+  }
+  DIR *dir = fdopendir(task_fd);
+  if (dir == NULL) {
+    close(task_fd);
+    return 0;
+  }
+
+  size_t found = 0;
+  struct dirent *dent;
+  while ((dent = readdir(dir)) != NULL &&
+         bsg_monotonic_time_ns() < deadline_ns) {
+    if (dent->d_name[0] < '0' || dent->d_name[0] > '9') {
+      continue;
+    }
+    const pid_t tid = (pid_t)strtol(dent->d_name, NULL, 10);
+    if (tid == pid || tid == current_tid) {
+      continue;
+    }
+    const uint64_t cpu_time = read_cpu_time(task_fd, dent->d_name);
+    if (found == count &&
+        (count == 0 || cpu_time <= busy[count - 1].cpu_time)) {
+      continue;
+    }
+    // insert the thread in order of CPU time, dropping the least busy
+    size_t index = found < count ? found++ : count - 1;
+    while (index > 0 && busy[index - 1].cpu_time < cpu_time) {
+      busy[index] = busy[index - 1];
+      index--;
+    }
+    busy[index].tid = tid;
+    busy[index].cpu_time = cpu_time;
+  }
+  // also closes task_fd
+  closedir(dir);
+  return found;
+}
+
+static void read_thread_name(pid_t pid, bsg_anr_thread *thread) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/task/%d/comm", pid, thread->tid);
+  if (!bsg_read_proc_file(AT_FDCWD, path, thread->name, sizeof(thread->name))) {
+    thread->name[0] = '\0';
+    return;
+  }
+  char *newline = strchr(thread->name, '\n');
+  if (newline != NULL) {
+    *newline = '\0';
+  }
+}
+
+/**
+ * Signal the thread and wait until its handler has unwound it or deadline_ns
+ * passes
+ */
+static void capture_thread(pid_t pid, bsg_anr_thread *thread,
+                           uint64_t deadline_ns) {
+  thread->captured = false;
+  __atomic_store_n(&thread->state, BSG_ANR_THREAD_PENDING, __ATOMIC_RELEASE);
+  __atomic_store_n(&capture_target, thread, __ATOMIC_RELEASE);
+  if (syscall(SYS_tgkill, pid, thread->tid, capture_signal) != 0) {
+    goto exit;
+  }
+
+  int state;
+  uint64_t now;
+  while ((state = __atomic_load_n(&thread->state, __ATOMIC_ACQUIRE)) !=
+             BSG_ANR_THREAD_DONE &&
+         (now = bsg_monotonic_time_ns()) < deadline_ns) {
+    const uint64_t remaining = deadline_ns - now;
+    struct timespec timeout = {.tv_sec = (time_t)(remaining / 1000000000),
+                               .tv_nsec = (long)(remaining % 1000000000)};
+    syscall(SYS_futex, &thread->state, FUTEX_WAIT_PRIVATE, state, &timeout,
+            NULL, 0);
+  }
+
+exit:
+  __atomic_store_n(&capture_target, NULL, __ATOMIC_RELEASE);
+  change_state(thread, BSG_ANR_THREAD_PENDING, BSG_ANR_THREAD_ABANDONED);
+  thread->captured =
+      __atomic_load_n(&thread->state, __ATOMIC_ACQUIRE) == BSG_ANR_THREAD_DONE;
+}
+
+const bsg_anr_thread *bsg_anr_threads_capture(unwind_func unwind,
+                                              size_t *count) {
+  pthread_mutex_lock(&bsg_anr_threads_config);
+  *count = 0;
+  if (max_capture_threads < 0 || unwind == NULL || is_capture_in_use()) {
+    return NULL;
+  }
+  const uint64_t deadline_ns = bsg_monotonic_time_ns() + capture_budget_ns;
+  const pid_t pid = getpid();
+  const pid_t current_tid = (pid_t)syscall(SYS_gettid);
+  capture_unwind = unwind;
+
+  bsg_busy_thread busy[BSG_ANR_THREADS_MAX];
+  const size_t busy_count =
+      find_busy_threads(pid, current_tid, busy,
+                        (size_t)max_capture_threads, deadline_ns);
+  capture_threads[0].tid = pid;
+  for (size_t i = 0; i < busy_count; i++) {
+    capture_threads[i + 1].tid = busy[i].tid;
+  }
+
+  size_t captured = 0;
+  for (; captured < busy_count + 1; captured++) {
+    bsg_anr_thread *thread = capture_threads + captured;
+    if (bsg_monotonic_time_ns() >= deadline_ns) {
+      break;
+    }
+    read_thread_name(pid, thread);
+    capture_thread(pid, thread, deadline_ns);
+  }
+  *count = captured;
+  return capture_threads;
+}
+
+void bsg_anr_threads_release(void) {
+  pthread_mutex_unlock(&bsg_anr_threads_config);
+}
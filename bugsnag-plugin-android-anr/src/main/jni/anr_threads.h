@@ -0,0 +1,73 @@
+#ifndef BUGSNAG_ANR_THREADS_H
+#define BUGSNAG_ANR_THREADS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "unwind_func.h"
+
+/**
+ * Captures the native stacks of the main thread and the busiest other threads
+ * when an ANR occurs. Each thread is sent a signal directly, and unwinds itself
+ * into its own buffer from the handler while the capturing thread waits, until
+ * every thread is captured or the time budget runs out.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The most threads besides the main thread which are captured */
+#define BSG_ANR_THREADS_MAX 16
+
+/** The largest time budget for capturing threads */
+#define BSG_ANR_THREADS_BUDGET_MAX_MS 5000
+
+typedef struct {
+  pid_t tid;
+  char name[16];
+  /** Whether the thread was unwound in time, and frame_count can be read */
+  bool captured;
+  ssize_t frame_count;
+  /** A bsg_anr_thread_state, which the capture signal handler waits on */
+  int state;
+  bugsnag_stackframe frames[BUGSNAG_FRAMES_MAX];
+} bsg_anr_thread;
+
+/**
+ * Capture the main thread and up to max_threads of the other threads with the
+ * most CPU time, within budget_ms, which is capped at
+ * BSG_ANR_THREADS_BUDGET_MAX_MS. A max_threads of less than 0 disables
+ * capturing, and more than BSG_ANR_THREADS_MAX is capped.
+ *
+ * The buffers for each thread are allocated here, rather than when an ANR
+ * occurs, and take sizeof(bsg_anr_thread) each.
+ *
+ * Note: This function is NOT async-safe.
+ *
+ * @return false if capturing could not be enabled
+ */
+bool bsg_anr_threads_configure(int max_threads, int64_t budget_ms);
+
+/**
+ * Capture the configured threads with unwind, skipping the calling thread. The
+ * threads must be released with bsg_anr_threads_release() once they have been
+ * read, which must be done even if none are returned.
+ *
+ * @param count set to the number of threads returned, which are not captured if
+ *              they could not be unwound in time
+ * @return the threads, or NULL if capturing is disabled
+ */
+const bsg_anr_thread *bsg_anr_threads_capture(unwind_func unwind,
+                                              size_t *count);
+
+/**
+ * Release the threads returned by bsg_anr_threads_capture()
+ */
+void bsg_anr_threads_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,4 +1,5 @@
 #include "anr_handler.h"
+#include "anr_threads.h"
 #include "unwind_func.h"
 #include <android/log.h>
 #include <jni.h>
@@ -22,6 +23,14 @@ JNIEXPORT void JNICALL Java_com_bugsnag_android_AnrPlugin_setUnwindFunction(
   bsg_set_unwind_function((unwind_func)unwind_function);
 }
 
+JNIEXPORT jboolean JNICALL
+Java_com_bugsnag_android_AnrPlugin_setNativeThreadCapture(JNIEnv *env,
+                                                          jobject thiz,
+                                                          jint max_threads,
+                                                          jlong budget_ms) {
+  return bsg_anr_threads_configure(max_threads, budget_ms);
+}
+
 #ifdef __cplusplus
 }
 #endif
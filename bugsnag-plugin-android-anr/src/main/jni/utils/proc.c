@@ -0,0 +1,22 @@
+#include "proc.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+bool bsg_read_proc_file(int dir_fd, const char *path, char *buff, size_t size) {
+  int fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  size_t length = 0;
+  while (length < size - 1) {
+    ssize_t count = read(fd, buff + length, size - 1 - length);
+    if (count <= 0) {
+      break;
+    }
+    length += (size_t)count;
+  }
+  close(fd);
+  buff[length] = '\0';
+  return length > 0;
+}
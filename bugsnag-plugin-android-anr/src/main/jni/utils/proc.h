@@ -0,0 +1,23 @@
+#ifndef BUGSNAG_UTILS_PROC_H
+#define BUGSNAG_UTILS_PROC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read up to size - 1 bytes of a file such as one in /proc into buff,
+ * terminating it. path is relative to dir_fd, which can be AT_FDCWD. Only
+ * async-safe calls are used.
+ *
+ * @return true if anything was read
+ */
+bool bsg_read_proc_file(int dir_fd, const char *path, char *buff, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,3 +1,8 @@
--keepattributes LineNumberTable,SourceFile
+-keepattributes LineNumberTable,SourceFile,RuntimeInvisibleAnnotations
 -keep class com.bugsnag.android.ndk.NativeBridge { *; }
 -keep class com.bugsnag.android.NdkPlugin { *; }
+-keep class com.bugsnag.android.ndk.CriticalNatives { *; }
+-keep @interface dalvik.annotation.optimization.CriticalNative
+-keepclassmembers class com.bugsnag.android.ndk.CriticalNatives {
+    @dalvik.annotation.optimization.CriticalNative <methods>;
+}
@@ -0,0 +1,41 @@
+package com.bugsnag.android.ndk
+
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Test
+import java.io.File
+import java.util.UUID
+
+/**
+ * Generates a backlog of reports in every format, legacy and current, and
+ * times delivering it: reading, migrating and serializing each report in
+ * turn for the latency percentiles, and then through the parallel pipeline
+ * used by deliverReportsAtPaths. Filter the device logs by 'BugsnagNDKBench'
+ * for the results.
+ */
+class NativeBacklogBenchmark {
+    companion object {
+        private const val BACKLOG_SIZE = 2700
+
+        init {
+            System.loadLibrary("bugsnag-ndk")
+            System.loadLibrary("bugsnag-ndk-bench")
+        }
+    }
+
+    external fun generate(dir: String, count: Int): Int
+    external fun run(dir: String): String
+
+    @Test
+    fun benchmarkBacklogDelivery() {
+        val dir = File(System.getProperty("java.io.tmpdir"), "backlog-${UUID.randomUUID()}")
+        dir.mkdirs()
+        try {
+            assertEquals(BACKLOG_SIZE, generate(dir.absolutePath, BACKLOG_SIZE))
+            val report = run(dir.absolutePath)
+            assertTrue(report.lines().any { it.startsWith("pipeline ") })
+        } finally {
+            dir.deleteRecursively()
+        }
+    }
+}
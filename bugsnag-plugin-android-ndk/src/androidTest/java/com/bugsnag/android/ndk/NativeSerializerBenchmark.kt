@@ -0,0 +1,27 @@
+package com.bugsnag.android.ndk
+
+import org.junit.Assert.assertTrue
+import org.junit.Test
+
+/**
+ * Times converting a full event to JSON, writing and reading it, and reading
+ * each legacy event format. Filter the device logs by 'BugsnagNDKBench' for
+ * the results.
+ */
+class NativeSerializerBenchmark {
+    companion object {
+        init {
+            System.loadLibrary("bugsnag-ndk")
+            System.loadLibrary("bugsnag-ndk-bench")
+        }
+    }
+
+    external fun run(path: String): String
+
+    @Test
+    fun benchmarkSerializers() {
+        val eventFile = createTempFile()
+        val report = run(eventFile.absolutePath)
+        assertTrue(report.lines().any { it.startsWith("bsg_read_event v8 ") })
+    }
+}
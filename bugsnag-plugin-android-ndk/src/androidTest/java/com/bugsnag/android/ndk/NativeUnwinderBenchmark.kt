@@ -0,0 +1,26 @@
+package com.bugsnag.android.ndk
+
+import android.os.Build
+import org.junit.Assert.assertTrue
+import org.junit.Test
+
+/**
+ * Times each native unwinder at several stack depths, with and without a
+ * signal context. Filter the device logs by 'BugsnagNDKBench' for the results.
+ */
+class NativeUnwinderBenchmark {
+    companion object {
+        init {
+            System.loadLibrary("bugsnag-ndk")
+            System.loadLibrary("bugsnag-ndk-bench")
+        }
+    }
+
+    external fun run(apiLevel: Int): String
+
+    @Test
+    fun benchmarkUnwinders() {
+        val report = run(Build.VERSION.SDK_INT)
+        assertTrue(report.lines().any { it.startsWith("libunwind ") })
+    }
+}
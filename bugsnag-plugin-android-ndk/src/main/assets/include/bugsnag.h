@@ -29,6 +29,19 @@ void bugsnag_notify(const char *name, const char *message,
 void bugsnag_notify_env(JNIEnv *env, const char *name, const char *message,
                         bugsnag_severity severity);
 
+/**
+ * Sends an error report to Bugsnag from a worker thread, so that the calling
+ * thread only unwinds its stack. The stack is symbolicated and the report is
+ * built and delivered afterwards, so breadcrumbs and metadata changed in the
+ * meantime may be included. The error is dropped if too many reports are
+ * already waiting, and long names and messages are truncated.
+ * @param name     The name of the error
+ * @param message  The error message
+ * @param severity The severity of the error
+ */
+void bugsnag_notify_async(const char *name, const char *message,
+                          bugsnag_severity severity);
+
 /**
  * Set the current user
  * @param id    The identifier of the user
@@ -50,6 +63,29 @@ void bugsnag_leave_breadcrumb(const char *message,
 void bugsnag_leave_breadcrumb_env(JNIEnv *env, const char *message,
                                   bugsnag_breadcrumb_type type);
 
+/**
+ * Set the operation the calling thread is performing. If the thread crashes,
+ * the operation replaces the context of the report. Only the calling thread's
+ * own context is changed, without taking a lock, so this is cheap enough to
+ * call as often as the operation changes.
+ * @param operation the operation, or NULL to clear it
+ */
+void bugsnag_thread_set_operation(const char *operation);
+
+/**
+ * Set a metadata value of the calling thread, which is added to the "thread"
+ * section of the report if the thread crashes. A thread can hold up to 8
+ * values; long names and values are truncated.
+ * @param name  the name of the value
+ * @param value the value, or NULL to remove it
+ */
+void bugsnag_thread_set_metadata(const char *name, const char *value);
+
+/**
+ * Clear the operation and metadata of the calling thread
+ */
+void bugsnag_thread_clear_context(void);
+
 /**
  * Adds a callback which is invoked whenever a fatal error occurs. The callback
  * will be passed a pointer to the event payload as a parameter, allowing for
@@ -1,13 +1,106 @@
 package com.bugsnag.android
 
+import android.os.Process
 import com.bugsnag.android.ndk.NativeBridge
+import com.bugsnag.android.ndk.NativeCrashMemoryRegion
 import java.util.concurrent.atomic.AtomicBoolean
 
 internal class NdkPlugin : Plugin {
 
-    private companion object {
+    companion object {
         private const val LOAD_ERR_MSG = "Native library could not be linked. Bugsnag will " +
             "not report NDK errors. See https://docs.bugsnag.com/platforms/android/ndk-link-errors"
+
+        /**
+         * Arm the native crash handlers as soon as the plugin is installed, and read the
+         * app, device and user state they report on a background thread rather than
+         * before returning. Native crashes in between are still reported, with only the
+         * state set since install, and are marked with crashHandler.statePending. Must be
+         * set before Bugsnag is started.
+         */
+        @JvmStatic
+        @Volatile
+        var populateStateInBackground = false
+
+        /**
+         * Keep the native state, including breadcrumbs, context and metadata, in a file
+         * mapping rather than on the heap, so that it survives the process being killed
+         * without a crash being handled, such as by the low memory killer. The state of
+         * the previous run can then be reported with [reportLastRunTermination]. Must be
+         * set before Bugsnag is started.
+         */
+        @JvmStatic
+        @Volatile
+        var journalState = false
+
+        /**
+         * Write trace sections around the native work of installing, adding breadcrumbs
+         * and delivering reports, so that it can be seen by name in Perfetto and systrace
+         * captures. Sections are only written from API 23. Must be set before Bugsnag is
+         * started to include install, see also [setTracingEnabled]. Tracing can also be
+         * enabled without a rebuild by setting the system property debug.bugsnag.trace to 1.
+         */
+        @JvmStatic
+        @Volatile
+        var traceNativeSections = false
+
+        /**
+         * Share the app and device state which does not change while a build runs, such as
+         * the app version and device model, between the processes of the app through a
+         * template file beside the report directory. The first process to read the state
+         * writes the template, and later processes map it at install rather than reading the
+         * same state over JNI, and read the rest in the background as with
+         * [populateStateInBackground]. Must be set before Bugsnag is started.
+         */
+        @JvmStatic
+        @Volatile
+        var shareEventTemplate = false
+
+        /**
+         * The most native reports delivered from a backlog at launch, 0 for no limit.
+         * Reports are delivered launch crashes first and then newest first, using an
+         * index kept beside the report directory rather than reading each report, and
+         * those beyond the limit are discarded unread. Must be set before Bugsnag is
+         * started.
+         */
+        @JvmStatic
+        @Volatile
+        var maxPendingReports = 0
+
+        /**
+         * The most frames unwound for a native crash caught by the signal handler, 0 for
+         * the full depth. Unwinding stops at the limit, so a deeply recursive stack is not
+         * walked any further than is reported. Must be set before Bugsnag is started.
+         */
+        @JvmStatic
+        @Volatile
+        var maxCrashStackFrames = 0
+
+        /**
+         * The most frames unwound for an uncaught C++ exception, 0 for the full depth. Must
+         * be set before Bugsnag is started.
+         */
+        @JvmStatic
+        @Volatile
+        var maxTerminateStackFrames = 0
+
+        /**
+         * The most frames unwound from the main thread's native stack for an ANR, 0 for the
+         * full depth. Must be set before Bugsnag is started.
+         */
+        @JvmStatic
+        @Volatile
+        var maxAnrStackFrames = 0
+
+        /**
+         * The most frames unwound for a handled error from bugsnag_notify() and its
+         * variants, 0 for the full depth. The top 16 frames are usually enough to group a
+         * handled error, and unwinding fewer frames makes each notify cheaper. Must be set
+         * before Bugsnag is started.
+         */
+        @JvmStatic
+        @Volatile
+        var maxNotifyStackFrames = 0
     }
 
     private val libraryLoader = LibraryLoader()
@@ -22,7 +115,17 @@ internal class NdkPlugin : Plugin {
     private var client: Client? = null
 
     private fun initNativeBridge(client: Client): NativeBridge {
-        val nativeBridge = NativeBridge()
+        val nativeBridge = NativeBridge(
+            populateStateInBackground,
+            journalState,
+            traceNativeSections,
+            shareEventTemplate,
+            maxPendingReports,
+            maxCrashStackFrames,
+            maxTerminateStackFrames,
+            maxAnrStackFrames,
+            maxNotifyStackFrames
+        )
         client.addObserver(nativeBridge)
         client.setupNdkPlugin()
         return nativeBridge
@@ -64,6 +167,211 @@ internal class NdkPlugin : Plugin {
         }
     }
 
+    /**
+     * Time the available unwinders on a background thread and use the quickest
+     * which agrees with the default for errors captured outside a signal
+     * handler, such as by bugsnag_notify(). The result is kept until the app
+     * version changes, so calibration only runs once per version.
+     */
+    fun calibrateUnwinders() {
+        nativeBridge?.calibrateUnwinders()
+    }
+
+    /**
+     * Load the unwinding libraries used by native crash handlers, which are otherwise
+     * left until the first stack is unwound outside of a crash. Call this once the app
+     * is idle, such as after startup. Until then crashes on older arm32 devices are
+     * unwound without libcorkscrew, and each crash parses the memory maps again.
+     */
+    fun prepareUnwinders() {
+        nativeBridge?.prepareUnwinders()
+    }
+
+    /**
+     * Leave symbolicating the stacktraces of native crashes until they are
+     * delivered, so that less work is done in the crash handler. Frames are
+     * still symbolicated on delivery when the same build of their library is
+     * loaded, and have their file and relative address otherwise.
+     */
+    fun setDeferredSymbolication(enabled: Boolean) {
+        nativeBridge?.setDeferredSymbolication(enabled)
+    }
+
+    /**
+     * Add breadcrumbs left by bugsnag_leave_breadcrumb() straight to native events,
+     * rather than passing each through the JVM and back. They are passed on to the
+     * JVM in batches shortly afterwards, and before bugsnag_notify() reports an error.
+     * OnBreadcrumbCallbacks then run for the JVM copy, and cannot change or discard
+     * the native one. Returns false if the fast path could not be enabled.
+     */
+    fun setNativeBreadcrumbFastPath(enabled: Boolean): Boolean {
+        return nativeBridge?.setBreadcrumbFastPath(enabled) ?: false
+    }
+
+    /**
+     * Write one report for a native crash which repeats, such as in a crash loop,
+     * while that report is waiting to be delivered. Each repeat only increments
+     * a count, reported as crashHandler.repeatCount in the event's metadata.
+     * Returns false if de-duplication could not be enabled.
+     */
+    fun setCrashDeduplication(enabled: Boolean): Boolean {
+        return nativeBridge?.setCrashDeduplication(enabled) ?: false
+    }
+
+    /**
+     * Coalesce errors reported by bugsnag_notify() which repeat with the same name and
+     * top frames. The first is reported as it happens, and further occurrences within
+     * windowMillis are only counted and then reported as a single error, with the count
+     * in its aggregation metadata. A window of 0 disables aggregation. Returns false if
+     * aggregation could not be enabled.
+     */
+    fun setNotifyAggregationWindow(windowMillis: Long): Boolean {
+        return nativeBridge?.setNotifyAggregationWindow(windowMillis) ?: false
+    }
+
+    /**
+     * Write errors reported by bugsnag_notify() straight to the event store as JSON,
+     * using the native copy of the event, rather than passing their stack frames to the
+     * JVM to be captured and serialized again. Stored errors are counted in the session
+     * and delivered as saved errors are, so they run OnSendCallbacks but not
+     * OnErrorCallbacks, and do not include the JVM threads. Returns false if they cannot
+     * be stored, in which case errors are notified through the JVM as before.
+     */
+    fun setHandledEventsStored(enabled: Boolean): Boolean {
+        return nativeBridge?.setHandledEventsStored(enabled) ?: false
+    }
+
+    /**
+     * Report the native state journaled by the previous run as an unhandled error, once
+     * the app knows that run was killed, such as from ApplicationExitInfo. Threads,
+     * feature flags and large metadata values are not included. Returns false if no
+     * state was kept, as the previous run handled a crash or [journalState] was not set.
+     */
+    fun reportLastRunTermination(errorClass: String, message: String): Boolean {
+        return nativeBridge?.reportLastRunTermination(errorClass, message) ?: false
+    }
+
+    /**
+     * Limit how many threads, and for how long, native crash handlers capture
+     * thread states. Once either is reached the threads are reported as
+     * truncated. A value of 0 or less leaves that limit at its default.
+     */
+    fun setThreadCaptureBudget(maxThreads: Int, maxTimeMillis: Long) {
+        nativeBridge?.setThreadCaptureBudget(maxThreads, maxTimeMillis)
+    }
+
+    /**
+     * Give the native signal handler [millis] to write a report, after which
+     * each stage which overruns its share of the time is abandoned: the stack
+     * is reported from the crash address alone, threads are not captured and
+     * the on error callback is not run, while the report is still written and
+     * the signal passed on to the previous handler. A value of 0 or less
+     * removes the deadline.
+     */
+    fun setCrashDeadline(millis: Long) {
+        nativeBridge?.setCrashDeadline(millis)
+    }
+
+    /**
+     * Write native crash reports from a helper thread, started now, rather
+     * than from the signal handler on the crashing thread. The crashing thread
+     * waits while the helper unwinds its stack and writes the report, so that
+     * the work runs on a healthy stack instead of the small signal stack. If
+     * the helper does not take a crash promptly the crashing thread writes the
+     * report itself. Returns false if the helper could not be started.
+     */
+    fun setCrashHelperEnabled(enabled: Boolean): Boolean {
+        return nativeBridge?.setCrashHelperEnabled(enabled) ?: false
+    }
+
+    /**
+     * Fault in the signal stack, native environment, event file and other
+     * buffers used by native crash handlers, so that a crash in a process which
+     * is short of memory is not handled through page faults. With [lock] the
+     * pages are also locked into memory, which is limited by RLIMIT_MEMLOCK.
+     * Returns the footprint of each region, which is also logged.
+     */
+    fun prepareCrashMemory(lock: Boolean): List<NativeCrashMemoryRegion> {
+        return nativeBridge?.prepareCrashMemory(lock) ?: emptyList()
+    }
+
+    /**
+     * How often the native layer has dropped data which did not fit its capacities, or
+     * unwound a stack only partly, since the process started or [reset] was last passed.
+     * Use these to size the native capacities, and to tell whether the unwinder chosen
+     * for a device is losing frames.
+     */
+    fun getHealthCounters(reset: Boolean = false): Map<String, Long> {
+        return nativeBridge?.getHealthCounters(reset) ?: emptyMap()
+    }
+
+    /**
+     * Keep a table of the live threads, so that native crash handlers copy
+     * the names of registered threads rather than reading them from
+     * /proc/self/task. The table is filled when it is enabled, and is kept
+     * up to date by [registerThread] and [unregisterThread]. Threads which
+     * were not registered are still read from /proc/self/task. The state of
+     * registered threads is reported as "unknown".
+     */
+    fun setThreadRegistryEnabled(enabled: Boolean) {
+        nativeBridge?.setThreadRegistryEnabled(enabled)
+    }
+
+    /**
+     * Start or stop writing trace sections around the native work, see
+     * [traceNativeSections]. Returns false if tracing is not available on this device.
+     */
+    fun setTracingEnabled(enabled: Boolean): Boolean {
+        return nativeBridge?.setTracingEnabled(enabled) ?: false
+    }
+
+    /**
+     * Drop native crashes which match any of these rules before they are
+     * handled, so that no stack, threads or report are captured for them and
+     * no on_error callback is run. Crashes are matched on their error class,
+     * such as "SIGSEGV" or the type name of an uncaught C++ exception, on the
+     * file name or path of the library containing the crash address of a
+     * signal, or on the number of the signal which was raised. Replaces any
+     * earlier rules. Returns false if the rules could not be set.
+     */
+    fun setNativeEventFilters(
+        errorClasses: Collection<String> = emptyList(),
+        modules: Collection<String> = emptyList(),
+        signals: Collection<Int> = emptyList()
+    ): Boolean {
+        var signalMask = 0L
+        signals.filter { it in 1 until Long.SIZE_BITS }.forEach {
+            signalMask = signalMask or (1L shl it)
+        }
+        return nativeBridge?.setEventFilters(
+            errorClasses.toTypedArray(),
+            modules.toTypedArray(),
+            signalMask
+        ) ?: false
+    }
+
+    /**
+     * Record that a thread has started or has been renamed, for example from a
+     * thread factory or a native thread observer
+     */
+    fun registerThread(tid: Int, name: String) {
+        nativeBridge?.registerThread(tid, name)
+    }
+
+    /**
+     * Register the calling thread with its current name
+     */
+    fun registerCurrentThread() {
+        registerThread(Process.myTid(), Thread.currentThread().name)
+    }
+
+    /**
+     * Record that a thread has stopped
+     */
+    fun unregisterThread(tid: Int) {
+        nativeBridge?.unregisterThread(tid)
+    }
+
     fun getSignalUnwindStackFunction(): Long {
         val bridge = nativeBridge
         if (bridge != null) {
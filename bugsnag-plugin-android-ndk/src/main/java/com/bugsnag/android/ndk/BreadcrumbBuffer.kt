@@ -0,0 +1,125 @@
+package com.bugsnag.android.ndk
+
+import com.bugsnag.android.BreadcrumbType
+import java.io.ByteArrayOutputStream
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.concurrent.Executors
+import java.util.concurrent.ScheduledExecutorService
+import java.util.concurrent.ThreadFactory
+import java.util.concurrent.TimeUnit
+
+/**
+ * Coalesces breadcrumbs so that bursts of them, such as from network and
+ * lifecycle observers, reach the native layer in a single JNI call. Pending
+ * breadcrumbs are flushed a short time after the first is added, once enough
+ * have built up, or when [flush] is called before an error is captured.
+ *
+ * Each breadcrumb is packed as a bugsnag_breadcrumb_type byte, a uint32 length
+ * and the UTF-8 bytes of its name, its timestamp in milliseconds since the
+ * epoch as an int64, and a uint32 length and its [PackedMetadata]. The layout
+ * is decoded by
+ * bsg_event_add_packed_breadcrumbs() in event.c.
+ */
+internal class BreadcrumbBuffer(
+    private val flushDelayMs: Long = DEFAULT_FLUSH_DELAY_MS,
+    private val addBreadcrumbs: (ByteArray) -> Unit
+) {
+
+    private val pending = ByteArrayOutputStream()
+    private var pendingCount = 0
+    private var flushScheduled = false
+
+    private val executor: ScheduledExecutorService by lazy {
+        Executors.newSingleThreadScheduledExecutor(
+            ThreadFactory { runnable ->
+                Thread(runnable, "Bugsnag NDK breadcrumbs").apply { isDaemon = true }
+            }
+        )
+    }
+
+    fun add(name: String, type: BreadcrumbType, timestamp: Long, metadata: Map<String, Any?>) {
+        val packed = encode(name, type, timestamp, metadata)
+        synchronized(this) {
+            pending.write(packed)
+            pendingCount++
+            if (pendingCount >= MAX_PENDING_CRUMBS || pending.size() >= MAX_PENDING_BYTES) {
+                flushPending()
+            } else if (!flushScheduled) {
+                flushScheduled = true
+                executor.schedule({ flush() }, flushDelayMs, TimeUnit.MILLISECONDS)
+            }
+        }
+    }
+
+    /**
+     * Pass any pending breadcrumbs to the native layer now
+     */
+    fun flush() {
+        synchronized(this) {
+            flushScheduled = false
+            flushPending()
+        }
+    }
+
+    // batches are passed on while the lock is held so that they keep their order
+    private fun flushPending() {
+        if (pendingCount == 0) {
+            return
+        }
+        val batch = pending.toByteArray()
+        pending.reset()
+        pendingCount = 0
+        addBreadcrumbs(batch)
+    }
+
+    private fun encode(
+        name: String,
+        type: BreadcrumbType,
+        timestamp: Long,
+        metadata: Map<String, Any?>
+    ): ByteArray {
+        val nameBytes = name.toByteArray(Charsets.UTF_8)
+        val metadataBytes = PackedMetadata.encode(metadata) ?: EMPTY
+        val size = 1 + LENGTH_SIZE * 2 + TIMESTAMP_SIZE + nameBytes.size + metadataBytes.size
+        return ByteBuffer.allocate(size).order(ByteOrder.nativeOrder())
+            .put(nativeType(type))
+            .putInt(nameBytes.size).put(nameBytes)
+            .putLong(timestamp)
+            .putInt(metadataBytes.size).put(metadataBytes)
+            .array()
+    }
+
+    private fun nativeType(type: BreadcrumbType): Byte = when (type) {
+        BreadcrumbType.MANUAL -> TYPE_MANUAL
+        BreadcrumbType.ERROR -> TYPE_ERROR
+        BreadcrumbType.LOG -> TYPE_LOG
+        BreadcrumbType.NAVIGATION -> TYPE_NAVIGATION
+        BreadcrumbType.PROCESS -> TYPE_PROCESS
+        BreadcrumbType.REQUEST -> TYPE_REQUEST
+        BreadcrumbType.STATE -> TYPE_STATE
+        BreadcrumbType.USER -> TYPE_USER
+    }
+
+    companion object {
+        const val DEFAULT_FLUSH_DELAY_MS = 100L
+
+        // values of bugsnag_breadcrumb_type
+        private const val TYPE_MANUAL: Byte = 0
+        private const val TYPE_ERROR: Byte = 1
+        private const val TYPE_LOG: Byte = 2
+        private const val TYPE_NAVIGATION: Byte = 3
+        private const val TYPE_PROCESS: Byte = 4
+        private const val TYPE_REQUEST: Byte = 5
+        private const val TYPE_STATE: Byte = 6
+        private const val TYPE_USER: Byte = 7
+
+        // the native ring holds at most 50 breadcrumbs in 32KB
+        private const val MAX_PENDING_CRUMBS = 50
+        private const val MAX_PENDING_BYTES = 32 * 1024
+
+        private const val LENGTH_SIZE = 4
+        private const val TIMESTAMP_SIZE = 8
+        private val EMPTY = ByteArray(0)
+    }
+}
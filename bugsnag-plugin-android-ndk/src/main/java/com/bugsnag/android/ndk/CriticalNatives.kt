@@ -0,0 +1,26 @@
+package com.bugsnag.android.ndk
+
+import dalvik.annotation.optimization.CriticalNative
+
+/**
+ * Fast paths for the state updates which the app lifecycle triggers most
+ * often. These skip most of the cost of a JNI transition, and so only take
+ * primitives: strings are passed as ids registered with
+ * [NativeBridge.setStringId]. They are only registered, and so can only be
+ * called, when [NativeBridge.hasCriticalNatives] is true.
+ */
+internal object CriticalNatives {
+    /**
+     * Returns [value], which JNI_OnLoad uses to check that the runtime honours
+     * @CriticalNative before relying on it
+     */
+    @JvmStatic @CriticalNative external fun echo(value: Int): Int
+
+    @JvmStatic @CriticalNative external fun addHandledEvent()
+    @JvmStatic @CriticalNative external fun addUnhandledEvent()
+    @JvmStatic @CriticalNative external fun updateIsLaunching(isLaunching: Boolean)
+    @JvmStatic @CriticalNative external fun updateInForeground(inForeground: Boolean, activityId: Int)
+    @JvmStatic @CriticalNative external fun updateLowMemory(newValue: Boolean, memoryTrimLevelId: Int)
+    @JvmStatic @CriticalNative external fun addMetadataDouble(tabId: Int, keyId: Int, value: Double)
+    @JvmStatic @CriticalNative external fun addMetadataBoolean(tabId: Int, keyId: Int, value: Boolean)
+}
@@ -1,6 +1,7 @@
 package com.bugsnag.android.ndk
 
 import android.os.Build
+import com.bugsnag.android.FeatureFlag
 import com.bugsnag.android.NativeInterface
 import com.bugsnag.android.StateEvent
 import com.bugsnag.android.StateEvent.AddBreadcrumb
@@ -19,6 +20,8 @@ import com.bugsnag.android.StateEvent.UpdateOrientation
 import com.bugsnag.android.StateEvent.UpdateUser
 import com.bugsnag.android.internal.StateObserver
 import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 import java.nio.charset.Charset
 import java.util.UUID
 import java.util.concurrent.atomic.AtomicBoolean
@@ -26,13 +29,48 @@ import java.util.concurrent.locks.ReentrantLock
 
 /**
  * Observes changes in the Bugsnag environment, propagating them to the native layer
+ *
+ * With [populateInBackground] the native crash handlers are armed as soon as the install
+ * message arrives, and the app, device and user state is read on a background thread.
+ *
+ * With [journalState] the native state is kept in a file mapping beside the report
+ * directory, so that it outlives a process which is killed, see [reportLastRunTermination].
+ *
+ * With [traceSections] trace sections are written around the native work from install onwards.
+ *
+ * With [shareEventTemplate] the static app and device state is shared with the other processes
+ * of the app through a template file beside the report directory, see [NdkPlugin.shareEventTemplate].
+ *
+ * With [maxPendingReports] more than 0, pending native reports beyond that many are discarded
+ * before delivery, keeping launch crashes and the newest reports.
+ *
+ * The stack depth limits cap the frames unwound for native crashes, uncaught C++ exceptions,
+ * ANRs and handled errors respectively, with 0 for the full depth, see
+ * [NdkPlugin.maxNotifyStackFrames].
  */
-class NativeBridge : StateObserver {
+class NativeBridge(
+    private val populateInBackground: Boolean = false,
+    private val journalState: Boolean = false,
+    private val traceSections: Boolean = false,
+    private val shareEventTemplate: Boolean = false,
+    private val maxPendingReports: Int = 0,
+    private val maxCrashStackFrames: Int = 0,
+    private val maxTerminateStackFrames: Int = 0,
+    private val maxAnrStackFrames: Int = 0,
+    private val maxNotifyStackFrames: Int = 0
+) : StateObserver {
 
     private val lock = ReentrantLock()
     private val installed = AtomicBoolean(false)
     private val reportDirectory: String = NativeInterface.getNativeReportPath()
     private val logger = NativeInterface.getLogger()
+    private val breadcrumbBuffer = BreadcrumbBuffer { addBreadcrumbs(it) }
+    private val stateBuffer = StateBuffer(
+        updateSingle = { updateSingleState(it) },
+        updateState = { changed, flags, packed -> updateState(changed, flags, packed) }
+    )
+    private val criticalNatives by lazy { hasCriticalNatives() }
+    private val stringIds = NativeStringIds { id, value -> setStringId(id, makeSafe(value)) }
 
     private val is32bit: Boolean
         get() {
@@ -48,7 +86,15 @@ class NativeBridge : StateObserver {
         autoDetectNdkCrashes: Boolean,
         apiLevel: Int,
         is32bit: Boolean,
-        threadSendPolicy: Int
+        threadSendPolicy: Int,
+        maxThreads: Int,
+        populateInBackground: Boolean,
+        journalState: Boolean,
+        shareEventTemplate: Boolean,
+        maxCrashStackFrames: Int,
+        maxTerminateStackFrames: Int,
+        maxAnrStackFrames: Int,
+        maxNotifyStackFrames: Int
     )
 
     external fun startedSession(
@@ -59,7 +105,9 @@ class NativeBridge : StateObserver {
     )
 
     external fun deliverReportAtPath(filePath: String)
-    external fun addBreadcrumb(name: String, type: String, timestamp: String, metadata: Any)
+    external fun deliverReportsAtPaths(filePaths: Array<String>, maxReports: Int)
+    external fun addBreadcrumb(name: String, type: String, timestamp: Long, metadata: ByteArray?)
+    external fun addBreadcrumbs(packed: ByteArray)
     external fun addMetadataString(tab: String, key: String, value: String)
     external fun addMetadataDouble(tab: String, key: String, value: Double)
     external fun addMetadataBoolean(tab: String, key: String, value: Boolean)
@@ -73,14 +121,89 @@ class NativeBridge : StateObserver {
     external fun updateIsLaunching(isLaunching: Boolean)
     external fun updateLastRunInfo(consecutiveLaunchCrashes: Int)
     external fun updateOrientation(orientation: String)
+    external fun updateState(changed: Int, flags: Int, packed: ByteArray)
     external fun updateUserId(newValue: String)
     external fun updateUserEmail(newValue: String)
     external fun updateUserName(newValue: String)
     external fun getSignalUnwindStackFunction(): Long
     external fun updateLowMemory(newValue: Boolean, memoryTrimLevelDescription: String)
     external fun addFeatureFlag(name: String, variant: String?)
+    external fun addFeatureFlags(packed: ByteArray)
     external fun clearFeatureFlag(name: String)
     external fun clearFeatureFlags()
+    external fun calibrateUnwinders()
+    external fun prepareUnwinders()
+    external fun setDeferredSymbolication(enabled: Boolean)
+    external fun setBreadcrumbFastPath(enabled: Boolean): Boolean
+    external fun setCrashDeduplication(enabled: Boolean): Boolean
+    external fun setNotifyAggregationWindow(windowMillis: Long): Boolean
+    external fun setHandledEventStore(directory: String?, stagingDirectory: String?): Boolean
+
+    /**
+     * Write handled errors reported from native code straight to the event store, staging
+     * them in the native report directory until they are complete
+     */
+    fun setHandledEventsStored(enabled: Boolean): Boolean {
+        if (!enabled) {
+            return setHandledEventStore(null, null)
+        }
+        val directory = File(NativeInterface.getEventStorePath())
+        if (!directory.isDirectory && !directory.mkdirs()) {
+            return false
+        }
+        return setHandledEventStore(directory.absolutePath, reportDirectory)
+    }
+    external fun writeLastRunJournal(reportPath: String, errorClass: String, message: String): Boolean
+    external fun setThreadCaptureBudget(maxThreads: Int, maxTimeMillis: Long)
+    external fun setCrashDeadline(millis: Long)
+    external fun setCrashHelperEnabled(enabled: Boolean): Boolean
+    external fun setThreadRegistryEnabled(enabled: Boolean)
+    external fun registerThread(tid: Int, name: String)
+    external fun unregisterThread(tid: Int)
+    external fun setLockStatsEnabled(enabled: Boolean)
+    external fun getLockStatsData(reset: Boolean): LongArray?
+
+    /**
+     * Statistics for the native locks recorded since they were enabled with
+     * [setLockStatsEnabled] or last reset, for each group of callers
+     */
+    fun getLockStats(reset: Boolean = false): List<NativeLockStats> {
+        val data = getLockStatsData(reset) ?: return emptyList()
+        return NativeLockStats.decode(data)
+    }
+
+    external fun getHealthCountersData(reset: Boolean): LongArray?
+
+    /**
+     * The number of times the native layer has dropped, overwritten or truncated data, or
+     * fallen back to a shorter stack, since the process started or the counters were last
+     * reset, by name. The same counters are reported in the ndkHealth section of native
+     * crash reports.
+     */
+    fun getHealthCounters(reset: Boolean = false): Map<String, Long> {
+        val data = getHealthCountersData(reset) ?: return emptyMap()
+        return HEALTH_COUNTER_NAMES.zip(data.toList()).toMap()
+    }
+
+    external fun prepareCrashMemoryData(lock: Boolean): LongArray?
+    external fun setStringId(id: Int, value: String): Boolean
+    external fun hasCriticalNatives(): Boolean
+    external fun setTracingEnabled(enabled: Boolean): Boolean
+    external fun setEventFilters(
+        errorClasses: Array<String>,
+        modules: Array<String>,
+        signalMask: Long
+    ): Boolean
+
+    /**
+     * Fault in the memory used by the crash handlers, so that handling a crash
+     * does not wait on page faults, and lock it into memory if [lock] is set.
+     * Returns the size of each region which was prepared.
+     */
+    fun prepareCrashMemory(lock: Boolean): List<NativeCrashMemoryRegion> {
+        val data = prepareCrashMemoryData(lock) ?: return emptyList()
+        return NativeCrashMemoryRegion.decode(data)
+    }
 
     override fun onStateChange(event: StateEvent) {
         if (isInvalidMessage(event)) return
@@ -94,14 +217,25 @@ class NativeBridge : StateObserver {
                 makeSafe(event.section),
                 makeSafe(event.key ?: "")
             )
-            is AddBreadcrumb -> addBreadcrumb(
-                makeSafe(event.message),
-                makeSafe(event.type.toString()),
-                makeSafe(event.timestamp),
-                event.metadata
-            )
-            NotifyHandled -> addHandledEvent()
-            NotifyUnhandled -> addUnhandledEvent()
+            is AddBreadcrumb -> if (!event.fromNative) {
+                breadcrumbBuffer.add(
+                    makeSafe(event.message),
+                    event.type,
+                    event.timestamp,
+                    event.metadata
+                )
+            }
+            NotifyHandled -> {
+                breadcrumbBuffer.flush()
+                stateBuffer.flush()
+                if (criticalNatives) CriticalNatives.addHandledEvent() else addHandledEvent()
+            }
+            NotifyUnhandled -> {
+                // the crash handler may be about to run
+                breadcrumbBuffer.flush()
+                stateBuffer.flush()
+                if (criticalNatives) CriticalNatives.addUnhandledEvent() else addUnhandledEvent()
+            }
             PauseSession -> pausedSession()
             is StartSession -> startedSession(
                 makeSafe(event.id),
@@ -109,24 +243,28 @@ class NativeBridge : StateObserver {
                 event.handledCount,
                 event.unhandledCount
             )
-            is UpdateContext -> updateContext(makeSafe(event.context ?: ""))
-            is UpdateInForeground -> updateInForeground(
+            is UpdateContext -> stateBuffer.updateContext(event.context ?: "")
+            is UpdateInForeground -> stateBuffer.updateInForeground(
                 event.inForeground,
-                makeSafe(event.contextActivity ?: "")
+                event.contextActivity ?: ""
             )
             is StateEvent.UpdateLastRunInfo -> updateLastRunInfo(event.consecutiveLaunchCrashes)
-            is StateEvent.UpdateIsLaunching -> updateIsLaunching(event.isLaunching)
-            is UpdateOrientation -> updateOrientation(event.orientation ?: "")
+            is StateEvent.UpdateIsLaunching -> stateBuffer.updateIsLaunching(event.isLaunching)
+            is UpdateOrientation -> stateBuffer.updateOrientation(event.orientation ?: "")
             is UpdateUser -> {
                 updateUserId(makeSafe(event.user.id ?: ""))
                 updateUserName(makeSafe(event.user.name ?: ""))
                 updateUserEmail(makeSafe(event.user.email ?: ""))
             }
-            is StateEvent.UpdateMemoryTrimEvent -> updateLowMemory(event.isLowMemory, event.memoryTrimLevelDescription)
+            is StateEvent.UpdateMemoryTrimEvent -> stateBuffer.updateLowMemory(
+                event.isLowMemory,
+                event.memoryTrimLevelDescription
+            )
             is StateEvent.AddFeatureFlag -> addFeatureFlag(
                 makeSafe(event.name),
                 event.variant?.let { makeSafe(it) }
             )
+            is StateEvent.AddFeatureFlags -> addFeatureFlags(packFeatureFlags(event.featureFlags))
             is StateEvent.ClearFeatureFlag -> clearFeatureFlag(makeSafe(event.name))
             is StateEvent.ClearFeatureFlags -> clearFeatureFlags()
         }
@@ -149,10 +287,13 @@ class NativeBridge : StateObserver {
             val outDir = File(reportDirectory)
             if (outDir.exists()) {
                 val fileList = outDir.listFiles()
-                if (fileList != null) {
-                    for (file in fileList) {
-                        deliverReportAtPath(file.absolutePath)
-                    }
+                if (fileList != null && fileList.isNotEmpty()) {
+                    // reports are ordered by the native report index, then read and
+                    // encoded in parallel and delivered in that order
+                    deliverReportsAtPaths(
+                        fileList.map { it.absolutePath }.toTypedArray(),
+                        maxPendingReports
+                    )
                 }
             } else {
                 logger.w("Payload directory does not exist, cannot read pending reports")
@@ -164,6 +305,20 @@ class NativeBridge : StateObserver {
         }
     }
 
+    /**
+     * Report the native state journaled by the previous run as an unhandled error, such
+     * as when it is known to have been killed. Returns false if no state was kept, which
+     * is the case if the previous run handled a crash or did not journal its state.
+     */
+    fun reportLastRunTermination(errorClass: String, message: String): Boolean {
+        val reportPath = File(reportDirectory, "${UUID.randomUUID()}.crash").absolutePath
+        if (!writeLastRunJournal(reportPath, makeSafe(errorClass), makeSafe(message))) {
+            return false
+        }
+        deliverReportAtPath(reportPath)
+        return true
+    }
+
     private fun handleInstallMessage(arg: Install) {
         lock.lock()
         try {
@@ -171,6 +326,9 @@ class NativeBridge : StateObserver {
                 logger.w("Received duplicate setup message with arg: $arg")
             } else {
                 val reportPath = File(reportDirectory, "${UUID.randomUUID()}.crash").absolutePath
+                if (traceSections && !setTracingEnabled(true)) {
+                    logger.w("Native trace sections are not available on this device")
+                }
                 install(
                     makeSafe(arg.apiKey),
                     reportPath,
@@ -179,7 +337,15 @@ class NativeBridge : StateObserver {
                     arg.autoDetectNdkCrashes,
                     Build.VERSION.SDK_INT,
                     is32bit,
-                    arg.sendThreads.ordinal
+                    arg.sendThreads.ordinal,
+                    arg.maxReportedThreads,
+                    populateInBackground,
+                    journalState,
+                    shareEventTemplate,
+                    maxCrashStackFrames,
+                    maxTerminateStackFrames,
+                    maxAnrStackFrames,
+                    maxNotifyStackFrames
                 )
                 installed.set(true)
             }
@@ -189,16 +355,114 @@ class NativeBridge : StateObserver {
     }
 
     private fun handleAddMetadata(arg: AddMetadata) {
-        if (arg.key != null) {
-            when (val newValue = arg.value) {
-                is String -> addMetadataString(arg.section, arg.key!!, makeSafe(newValue))
-                is Boolean -> addMetadataBoolean(arg.section, arg.key!!, newValue)
-                is Number -> addMetadataDouble(arg.section, arg.key!!, newValue.toDouble())
-                else -> Unit
+        val key = arg.key ?: return
+        when (val newValue = arg.value) {
+            is String -> addMetadataString(arg.section, key, makeSafe(newValue))
+            is Boolean -> {
+                val ids = criticalIdsOf(arg.section, key)
+                if (ids != null) {
+                    CriticalNatives.addMetadataBoolean(ids.first, ids.second, newValue)
+                } else {
+                    addMetadataBoolean(arg.section, key, newValue)
+                }
+            }
+            is Number -> {
+                val ids = criticalIdsOf(arg.section, key)
+                if (ids != null) {
+                    CriticalNatives.addMetadataDouble(ids.first, ids.second, newValue.toDouble())
+                } else {
+                    addMetadataDouble(arg.section, key, newValue.toDouble())
+                }
             }
+            else -> Unit
         }
     }
 
+    /**
+     * Pass a change which [StateBuffer] did not batch with any others through the call
+     * for its field
+     */
+    private fun updateSingleState(change: StateBuffer.Change) {
+        val string = change.string ?: ""
+        when (change.field) {
+            StateBuffer.CONTEXT -> updateContext(makeSafe(string))
+            StateBuffer.IN_FOREGROUND -> handleUpdateInForeground(change.value, string)
+            StateBuffer.IS_LAUNCHING -> handleUpdateIsLaunching(change.value)
+            StateBuffer.ORIENTATION -> updateOrientation(string)
+            StateBuffer.LOW_MEMORY -> handleUpdateLowMemory(change.value, string)
+        }
+    }
+
+    private fun handleUpdateInForeground(inForeground: Boolean, activity: String) {
+        val activityId = criticalIdOf(activity)
+        if (activityId != NativeStringIds.NO_ID) {
+            CriticalNatives.updateInForeground(inForeground, activityId)
+        } else {
+            updateInForeground(inForeground, makeSafe(activity))
+        }
+    }
+
+    private fun handleUpdateIsLaunching(isLaunching: Boolean) {
+        if (criticalNatives) {
+            CriticalNatives.updateIsLaunching(isLaunching)
+        } else {
+            updateIsLaunching(isLaunching)
+        }
+    }
+
+    private fun handleUpdateLowMemory(isLowMemory: Boolean, trimLevel: String) {
+        val trimLevelId = criticalIdOf(trimLevel)
+        if (trimLevelId != NativeStringIds.NO_ID) {
+            CriticalNatives.updateLowMemory(isLowMemory, trimLevelId)
+        } else {
+            updateLowMemory(isLowMemory, trimLevel)
+        }
+    }
+
+    /**
+     * The id of [value] for [CriticalNatives], or [NativeStringIds.NO_ID] if
+     * the string must be passed to the JNI method instead
+     */
+    private fun criticalIdOf(value: String): Int {
+        return if (criticalNatives) stringIds.idOf(value) else NativeStringIds.NO_ID
+    }
+
+    private fun criticalIdsOf(section: String, key: String): Pair<Int, Int>? {
+        val sectionId = criticalIdOf(section)
+        val keyId = criticalIdOf(key)
+        if (sectionId == NativeStringIds.NO_ID || keyId == NativeStringIds.NO_ID) {
+            return null
+        }
+        return Pair(sectionId, keyId)
+    }
+
+    /**
+     * Pack a batch of feature flags for bsg_set_packed_feature_flags() in
+     * featureflags.c: the uint32 length and UTF-8 bytes of each name, then of
+     * its variant, or [NO_VARIANT] if it has none.
+     */
+    private fun packFeatureFlags(featureFlags: List<FeatureFlag>): ByteArray {
+        val encoded = featureFlags.map { flag ->
+            Pair(
+                flag.name.toByteArray(Charsets.UTF_8),
+                flag.variant?.toByteArray(Charsets.UTF_8)
+            )
+        }
+        val size = encoded.sumBy { (name, variant) ->
+            LENGTH_SIZE * 2 + name.size + (variant?.size ?: 0)
+        }
+        val buffer = ByteBuffer.allocate(size).order(ByteOrder.nativeOrder())
+        encoded.forEach { (name, variant) ->
+            buffer.putInt(name.size).put(name)
+            if (variant != null) {
+                buffer.putInt(variant.size).put(variant)
+            } else {
+                buffer.putInt(NO_VARIANT)
+            }
+        }
+        return buffer.array()
+    }
+
     /**
      * Ensure the string is safe to be passed to native layer by forcing the encoding
      * to UTF-8.
@@ -207,4 +471,24 @@ class NativeBridge : StateObserver {
         // The Android platform default charset is always UTF-8
         return String(text.toByteArray(Charset.defaultCharset()))
     }
+
+    private companion object {
+        const val LENGTH_SIZE = 4
+
+        // UINT32_MAX
+        const val NO_VARIANT = -1
+
+        // bsg_health_counter_names in health_counters.c
+        val HEALTH_COUNTER_NAMES = listOf(
+            "metadataSpilled",
+            "metadataDropped",
+            "breadcrumbsOverwritten",
+            "breadcrumbsDropped",
+            "threadsOverCapacity",
+            "threadsOverBudget",
+            "mapsParseFailed",
+            "unwindSingleFrame",
+            "unwindFramesLimited"
+        )
+    }
 }
@@ -0,0 +1,48 @@
+package com.bugsnag.android.ndk
+
+/**
+ * The memory footprint of one region used by the native crash handlers, as
+ * prepared by [NativeBridge.prepareCrashMemory]
+ */
+class NativeCrashMemoryRegion internal constructor(
+    /** The region, such as "signalStack" or "eventFile" */
+    val region: String,
+    val bytes: Long,
+    /** The pages spanned by the region, each of which has been faulted in */
+    val pages: Long,
+    /** Whether the pages were locked into memory */
+    val locked: Boolean
+) {
+
+    override fun toString(): String {
+        return "NativeCrashMemoryRegion(region=$region, bytes=$bytes, pages=$pages, locked=$locked)"
+    }
+
+    internal companion object {
+        /** In the order of bsg_crash_memory_region */
+        private val REGIONS = listOf(
+            "signalStack",
+            "environment",
+            "eventFile",
+            "threads",
+            "metadataArena"
+        )
+
+        private const val VALUES_PER_REGION = 3
+
+        /**
+         * Decode the values returned by NativeBridge.prepareCrashMemoryData: the
+         * bytes, pages and locked flag of each region. Regions which are not
+         * in use are left out.
+         */
+        fun decode(data: LongArray): List<NativeCrashMemoryRegion> {
+            if (data.size != REGIONS.size * VALUES_PER_REGION) {
+                return emptyList()
+            }
+            return REGIONS.mapIndexed { index, region ->
+                val start = index * VALUES_PER_REGION
+                NativeCrashMemoryRegion(region, data[start], data[start + 1], data[start + 2] != 0L)
+            }.filter { it.bytes > 0 }
+        }
+    }
+}
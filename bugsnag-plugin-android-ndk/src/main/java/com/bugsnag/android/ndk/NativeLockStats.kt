@@ -0,0 +1,79 @@
+package com.bugsnag.android.ndk
+
+/**
+ * Contention and latency statistics for one group of callers of the locks taken
+ * by the native layer, recorded while enabled with
+ * [NativeBridge.setLockStatsEnabled].
+ *
+ * Each histogram has [BUCKET_COUNT] buckets: the first counts durations under
+ * 1us, and each bucket after spans twice the range of the one before, so that
+ * the last counts durations of 8.192ms or more.
+ */
+class NativeLockStats internal constructor(
+    /** The callers, such as "metadata" or "session" */
+    val site: String,
+    /** The time over which the statistics were recorded */
+    val elapsedNs: Long,
+    /** The number of times the lock was taken */
+    val calls: Long,
+    /** The number of times the lock was already held by another caller */
+    val contendedCalls: Long,
+    val totalWaitNs: Long,
+    val maxWaitNs: Long,
+    val totalHoldNs: Long,
+    val maxHoldNs: Long,
+    val waitHistogram: LongArray,
+    val holdHistogram: LongArray
+) {
+
+    override fun toString(): String {
+        return "NativeLockStats(site=$site, elapsedNs=$elapsedNs, calls=$calls, " +
+            "contendedCalls=$contendedCalls, totalWaitNs=$totalWaitNs, maxWaitNs=$maxWaitNs, " +
+            "totalHoldNs=$totalHoldNs, maxHoldNs=$maxHoldNs)"
+    }
+
+    internal companion object {
+        const val BUCKET_COUNT = 15
+
+        /** In the order of bsg_lock_site */
+        private val SITES = listOf("metadata", "featureFlags", "appState", "session")
+
+        private const val COUNTER_COUNT = 6
+        private const val VALUES_PER_SITE = COUNTER_COUNT + BUCKET_COUNT * 2
+
+        private const val CALLS = 0
+        private const val CONTENDED_CALLS = 1
+        private const val TOTAL_WAIT = 2
+        private const val MAX_WAIT = 3
+        private const val TOTAL_HOLD = 4
+        private const val MAX_HOLD = 5
+
+        /**
+         * Decode the values returned by NativeBridge.getLockStatsData: the elapsed
+         * time followed by the counters and histograms of each site
+         */
+        fun decode(data: LongArray): List<NativeLockStats> {
+            if (data.size != 1 + SITES.size * VALUES_PER_SITE) {
+                return emptyList()
+            }
+            val elapsedNs = data[0]
+            return SITES.mapIndexed { index, site ->
+                val start = 1 + index * VALUES_PER_SITE
+                val waitStart = start + COUNTER_COUNT
+                val holdStart = waitStart + BUCKET_COUNT
+                NativeLockStats(
+                    site,
+                    elapsedNs,
+                    data[start + CALLS],
+                    data[start + CONTENDED_CALLS],
+                    data[start + TOTAL_WAIT],
+                    data[start + MAX_WAIT],
+                    data[start + TOTAL_HOLD],
+                    data[start + MAX_HOLD],
+                    data.copyOfRange(waitStart, holdStart),
+                    data.copyOfRange(holdStart, holdStart + BUCKET_COUNT)
+                )
+            }
+        }
+    }
+}
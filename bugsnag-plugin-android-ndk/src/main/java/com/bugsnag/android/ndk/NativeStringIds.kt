@@ -0,0 +1,41 @@
+package com.bugsnag.android.ndk
+
+import java.util.concurrent.ConcurrentHashMap
+
+/**
+ * Assigns the ids of strings passed to [CriticalNatives], registering each
+ * string natively the first time it is seen. Ids run out after
+ * [MAX_STRING_IDS] strings, which should be passed as strings instead.
+ */
+internal class NativeStringIds(private val register: (Int, String) -> Boolean) {
+
+    private val ids = ConcurrentHashMap<String, Int>()
+    private var nextId = 0
+
+    /**
+     * The id of [value], or [NO_ID] if it could not be given one
+     */
+    fun idOf(value: String): Int {
+        ids[value]?.let { return it }
+        synchronized(this) {
+            ids[value]?.let { return it }
+            if (nextId >= MAX_STRING_IDS) {
+                return NO_ID
+            }
+            // an id which failed to register is not reused
+            val id = nextId++
+            if (!register(id, value)) {
+                return NO_ID
+            }
+            ids[value] = id
+            return id
+        }
+    }
+
+    companion object {
+        const val NO_ID = -1
+
+        // BSG_STRING_ID_COUNT in string_ids.h
+        const val MAX_STRING_IDS = 256
+    }
+}
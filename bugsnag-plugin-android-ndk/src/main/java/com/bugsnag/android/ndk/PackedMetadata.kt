@@ -0,0 +1,76 @@
+package com.bugsnag.android.ndk
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Packs metadata into a single buffer so that it can be passed to the native
+ * layer in one JNI call, rather than several calls for every key. The layout
+ * is decoded by bsg_crumb_record_add_packed() in event.c.
+ *
+ * Each value is a type byte, a uint32 length and the UTF-8 bytes of its key,
+ * followed by a bool byte, a double, or a uint32 length and the UTF-8 bytes of
+ * a string. Numbers are written in native byte order. Values of any other type
+ * are skipped, as they cannot be stored natively.
+ */
+internal object PackedMetadata {
+
+    // values of bugsnag_metadata_type
+    private const val TYPE_BOOL: Byte = 1
+    private const val TYPE_STRING: Byte = 2
+    private const val TYPE_NUMBER: Byte = 3
+
+    private const val LENGTH_SIZE = 4
+    private const val DOUBLE_SIZE = 8
+
+    /**
+     * Returns the packed metadata, or null if there are no values which can be
+     * stored natively
+     */
+    fun encode(metadata: Map<String, Any?>): ByteArray? {
+        val names = ArrayList<ByteArray>(metadata.size)
+        val values = ArrayList<Any>(metadata.size)
+        var size = 0
+
+        for (entry in metadata.entries) {
+            // maps passed from Java may still hold null keys
+            val key: Any? = entry.key
+            if (key !is String) {
+                continue
+            }
+            val value: Any = when (val raw = entry.value) {
+                is Boolean -> raw
+                is Number -> raw.toDouble()
+                is String -> raw.toByteArray(Charsets.UTF_8)
+                else -> continue
+            }
+            val name = key.toByteArray(Charsets.UTF_8)
+            size += 1 + LENGTH_SIZE + name.size + when (value) {
+                is ByteArray -> LENGTH_SIZE + value.size
+                is Double -> DOUBLE_SIZE
+                else -> 1
+            }
+            names.add(name)
+            values.add(value)
+        }
+
+        if (names.isEmpty()) {
+            return null
+        }
+
+        val buffer = ByteBuffer.allocate(size).order(ByteOrder.nativeOrder())
+        for (index in names.indices) {
+            val name = names[index]
+            when (val value = values[index]) {
+                is ByteArray -> putName(buffer, TYPE_STRING, name).putInt(value.size).put(value)
+                is Double -> putName(buffer, TYPE_NUMBER, name).putDouble(value)
+                is Boolean -> putName(buffer, TYPE_BOOL, name).put((if (value) 1 else 0).toByte())
+            }
+        }
+        return buffer.array()
+    }
+
+    private fun putName(buffer: ByteBuffer, type: Byte, name: ByteArray): ByteBuffer {
+        return buffer.put(type).putInt(name.size).put(name)
+    }
+}
@@ -0,0 +1,139 @@
+package com.bugsnag.android.ndk
+
+import java.io.ByteArrayOutputStream
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.concurrent.Executors
+import java.util.concurrent.ScheduledExecutorService
+import java.util.concurrent.ThreadFactory
+import java.util.concurrent.TimeUnit
+
+/**
+ * Coalesces changes to the app and device state, such as the several which an
+ * activity transition makes back to back, so that they reach the native layer
+ * in a single call and are published to crash handlers together. Pending
+ * changes are flushed a short time after the first, or when [flush] is called
+ * before an error is captured. Later changes to a field replace earlier ones.
+ *
+ * A batch is passed as a bitmask of the fields changed, a bitmask of their
+ * boolean values and the strings of the changed fields in the order of their
+ * bits, each a uint32 length and its UTF-8 bytes in native byte order. The
+ * layout is decoded by NativeBridge_updateState() in bugsnag_ndk.c. A batch of
+ * a single change is passed to [updateSingle] instead, which can use the
+ * cheaper calls for that field.
+ */
+internal class StateBuffer(
+    private val flushDelayMs: Long = DEFAULT_FLUSH_DELAY_MS,
+    private val updateSingle: (StateBuffer.Change) -> Unit,
+    private val updateState: (Int, Int, ByteArray) -> Unit
+) {
+
+    /**
+     * A change to one field, and the string which goes with it if there is one
+     */
+    class Change(val field: Int, val value: Boolean, val string: String?)
+
+    private val pending = arrayOfNulls<Change>(FIELD_COUNT)
+    private var changed = 0
+    private var flushScheduled = false
+
+    private val executor: ScheduledExecutorService by lazy {
+        Executors.newSingleThreadScheduledExecutor(
+            ThreadFactory { runnable ->
+                Thread(runnable, "Bugsnag NDK state").apply { isDaemon = true }
+            }
+        )
+    }
+
+    fun updateContext(context: String) = add(Change(CONTEXT, false, context))
+
+    fun updateInForeground(inForeground: Boolean, activity: String) =
+        add(Change(IN_FOREGROUND, inForeground, activity))
+
+    fun updateIsLaunching(isLaunching: Boolean) = add(Change(IS_LAUNCHING, isLaunching, null))
+
+    fun updateOrientation(orientation: String) = add(Change(ORIENTATION, false, orientation))
+
+    fun updateLowMemory(isLowMemory: Boolean, trimLevel: String) =
+        add(Change(LOW_MEMORY, isLowMemory, trimLevel))
+
+    private fun add(change: Change) {
+        synchronized(this) {
+            pending[Integer.numberOfTrailingZeros(change.field)] = change
+            changed = changed or change.field
+            if (!flushScheduled) {
+                flushScheduled = true
+                executor.schedule({ flush() }, flushDelayMs, TimeUnit.MILLISECONDS)
+            }
+        }
+    }
+
+    /**
+     * Pass any pending changes to the native layer now
+     */
+    fun flush() {
+        synchronized(this) {
+            flushScheduled = false
+            flushPending()
+        }
+    }
+
+    // batches are passed on while the lock is held so that they keep their order
+    private fun flushPending() {
+        if (changed == 0) {
+            return
+        }
+        val changes = pending.filterNotNull()
+        val fields = changed
+        pending.fill(null)
+        changed = 0
+
+        if (changes.size == 1) {
+            updateSingle(changes[0])
+            return
+        }
+        var flags = 0
+        val strings = ByteArrayOutputStream()
+        val length = ByteBuffer.allocate(LENGTH_SIZE).order(ByteOrder.nativeOrder())
+        changes.forEach { change ->
+            if (change.value) {
+                flags = flags or change.field
+            }
+            change.string?.let {
+                val bytes = it.toByteArray(Charsets.UTF_8)
+                length.clear()
+                strings.write(length.putInt(bytes.size).array())
+                strings.write(bytes)
+            }
+        }
+        updateState(fields, nativeFlags(flags), strings.toByteArray())
+    }
+
+    // the values are passed in the bits of their own field
+    private fun nativeFlags(flags: Int): Int {
+        var native = 0
+        if (flags and IN_FOREGROUND != 0) native = native or FLAG_IN_FOREGROUND
+        if (flags and IS_LAUNCHING != 0) native = native or FLAG_IS_LAUNCHING
+        if (flags and LOW_MEMORY != 0) native = native or FLAG_LOW_MEMORY
+        return native
+    }
+
+    companion object {
+        const val DEFAULT_FLUSH_DELAY_MS = 10L
+
+        // the BSG_STATE_ fields in bugsnag_ndk.c, in the order their strings are packed
+        const val CONTEXT = 1 shl 0
+        const val IN_FOREGROUND = 1 shl 1
+        const val IS_LAUNCHING = 1 shl 2
+        const val ORIENTATION = 1 shl 3
+        const val LOW_MEMORY = 1 shl 4
+        private const val FIELD_COUNT = 5
+
+        // the BSG_STATE_FLAG_ values in bugsnag_ndk.c
+        private const val FLAG_IN_FOREGROUND = 1 shl 0
+        private const val FLAG_IS_LAUNCHING = 1 shl 1
+        private const val FLAG_LOW_MEMORY = 1 shl 2
+
+        private const val LENGTH_SIZE = 4
+    }
+}
@@ -0,0 +1,13 @@
+package dalvik.annotation.optimization
+
+/**
+ * Declares ART's @CriticalNative annotation, which is not in the public SDK
+ * the plugin compiles against. ART matches it by name, and on Android 8.0 and
+ * above calls the annotated static native methods without a JNIEnv or class.
+ * Annotated methods may only take and return primitives, and must be
+ * registered with RegisterNatives. The consumer ProGuard rules keep it, and
+ * JNI_OnLoad checks it is honoured before registering the annotated methods.
+ */
+@Retention(AnnotationRetention.BINARY)
+@Target(AnnotationTarget.FUNCTION)
+internal annotation class CriticalNative
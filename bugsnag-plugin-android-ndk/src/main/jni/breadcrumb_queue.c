@@ -0,0 +1,185 @@
+#include "breadcrumb_queue.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "jni_cache.h"
+#include "safejni.h"
+#include "utils/logger.h"
+
+/*
+ * Each queued breadcrumb is a bugsnag_breadcrumb_type byte, its timestamp in
+ * milliseconds since the epoch as an int64 and a uint32 length and the bytes
+ * of its name, in native byte order. The layout is decoded by
+ * NativeInterface.leaveNativeBreadcrumbs().
+ *
+ * Flushes copy the queue out under queue_lock and then call into the JVM
+ * holding only flush_lock, so that breadcrumbs can be queued during the call
+ * while batches still reach the JVM in order.
+ */
+
+#define QUEUE_HEADER_SIZE (1 + sizeof(int64_t) + sizeof(uint32_t))
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_changed = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool queue_enabled = false;
+static bool flusher_started = false;
+static bugsnag_event *queue_event = NULL;
+
+static uint8_t queue[BSG_CRUMB_QUEUE_SIZE];
+static size_t queue_used = 0;
+/** The batch being passed to the JVM, guarded by flush_lock */
+static uint8_t flush_buffer[BSG_CRUMB_QUEUE_SIZE];
+
+static void flush_queue(JNIEnv *env) {
+  pthread_mutex_lock(&flush_lock);
+  pthread_mutex_lock(&queue_lock);
+  const size_t length = queue_used;
+  memcpy(flush_buffer, queue, length);
+  queue_used = 0;
+  pthread_mutex_unlock(&queue_lock);
+
+  if (length > 0) {
+    jbyteArray batch =
+        bsg_byte_ary_from_bytes(env, (const char *)flush_buffer, length);
+    if (batch != NULL) {
+      bsg_safe_call_static_void_method(
+          env, bsg_jni_cache->NativeInterface,
+          bsg_jni_cache->NativeInterface_leaveNativeBreadcrumbs, batch);
+      bsg_safe_delete_local_ref(env, batch);
+    }
+  }
+  pthread_mutex_unlock(&flush_lock);
+}
+
+static bool is_batch_full(void) {
+  return queue_used >= BSG_CRUMB_QUEUE_SIZE / 2;
+}
+
+static void *run_flusher(void *unused) {
+  JNIEnv *env = bsg_jni_cache_get_env();
+  if (env == NULL) {
+    return NULL;
+  }
+  for (;;) {
+    pthread_mutex_lock(&queue_lock);
+    while (queue_used == 0) {
+      pthread_cond_wait(&queue_changed, &queue_lock);
+    }
+    // wait for more breadcrumbs to join the batch, unless it is already full
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)BSG_CRUMB_QUEUE_FLUSH_DELAY_MS * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    while (queue_used != 0 && !is_batch_full() &&
+           pthread_cond_timedwait(&queue_changed, &queue_lock, &deadline) !=
+               ETIMEDOUT) {
+    }
+    pthread_mutex_unlock(&queue_lock);
+    flush_queue(env);
+  }
+  return NULL;
+}
+
+static bool start_flusher(void) {
+  if (flusher_started) {
+    return true;
+  }
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  const int result = pthread_create(&thread, &attr, run_flusher, NULL);
+  pthread_attr_destroy(&attr);
+  if (result != 0) {
+    BUGSNAG_LOG("Failed to start the breadcrumb flusher: %s", strerror(result));
+    return false;
+  }
+  pthread_setname_np(thread, "bsg-crumb-flush");
+  __atomic_store_n(&flusher_started, true, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool bsg_breadcrumb_queue_set_enabled(JNIEnv *env, bugsnag_event *next_event,
+                                      bool enabled) {
+  pthread_mutex_lock(&flush_lock);
+  const bool started = !enabled || start_flusher();
+  if (enabled && started) {
+    queue_event = next_event;
+  }
+  __atomic_store_n(&queue_enabled, enabled && started, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&flush_lock);
+  if (!enabled) {
+    flush_queue(env);
+  }
+  return started;
+}
+
+/**
+ * Queue a breadcrumb for the JVM, dropping it if the queue is full as it has
+ * already been added to the next event
+ */
+static void queue_breadcrumb(const char *message, bugsnag_breadcrumb_type type,
+                             int64_t timestamp_ms) {
+  const size_t name_length = strlen(message);
+  pthread_mutex_lock(&queue_lock);
+  if (BSG_CRUMB_QUEUE_SIZE - queue_used < QUEUE_HEADER_SIZE + name_length) {
+    goto exit;
+  }
+  const bool was_empty = queue_used == 0;
+  const bool was_full = is_batch_full();
+  const uint32_t length = (uint32_t)name_length;
+  uint8_t *pos = queue + queue_used;
+  *pos++ = (uint8_t)type;
+  memcpy(pos, &timestamp_ms, sizeof(timestamp_ms));
+  pos += sizeof(timestamp_ms);
+  memcpy(pos, &length, sizeof(length));
+  pos += sizeof(length);
+  memcpy(pos, message, name_length);
+  queue_used += QUEUE_HEADER_SIZE + name_length;
+  if (was_empty || (!was_full && is_batch_full())) {
+    pthread_cond_signal(&queue_changed);
+  }
+
+exit:
+  pthread_mutex_unlock(&queue_lock);
+}
+
+bool bsg_breadcrumb_queue_add(const char *message,
+                              bugsnag_breadcrumb_type type) {
+  if (!__atomic_load_n(&queue_enabled, __ATOMIC_ACQUIRE) || message == NULL) {
+    return false;
+  }
+  if (type > BSG_CRUMB_USER) {
+    type = BSG_CRUMB_MANUAL;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  const int64_t timestamp_ms =
+      (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+  bugsnag_event *event = queue_event;
+  const uint32_t length = bsg_crumb_record_size(message, 0);
+  uint64_t ticket;
+  void *record = bsg_event_claim_breadcrumb(event, length, &ticket);
+  if (record != NULL) {
+    bsg_crumb_record_init(record, length, message, timestamp_ms, type);
+    bsg_event_publish_breadcrumb(event, ticket);
+  }
+  queue_breadcrumb(message, type, timestamp_ms);
+  return true;
+}
+
+void bsg_breadcrumb_queue_flush(JNIEnv *env) {
+  if (!__atomic_load_n(&flusher_started, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  flush_queue(env);
+}
@@ -0,0 +1,51 @@
+/**
+ * A fast path for breadcrumbs left from native code, which are added straight
+ * to the next event and queued for the JVM breadcrumb store, rather than
+ * passing through the JVM and back. A flusher thread passes queued
+ * breadcrumbs on in batches, shortly after the first is queued or once enough
+ * have built up.
+ */
+#ifndef BUGSNAG_BREADCRUMB_QUEUE_H
+#define BUGSNAG_BREADCRUMB_QUEUE_H
+
+#include <jni.h>
+#include <stdbool.h>
+
+#include "event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** How long a queued breadcrumb waits for others to be flushed with it */
+#define BSG_CRUMB_QUEUE_FLUSH_DELAY_MS 100
+
+/** The size of the queue, which drops breadcrumbs for the JVM once full */
+#define BSG_CRUMB_QUEUE_SIZE (32 * 1024)
+
+/**
+ * Enable or disable the fast path, which adds breadcrumbs to next_event. The
+ * flusher thread is started the first time it is enabled, and any queued
+ * breadcrumbs are flushed when it is disabled. Returns false if the flusher
+ * could not be started.
+ */
+bool bsg_breadcrumb_queue_set_enabled(JNIEnv *env, bugsnag_event *next_event,
+                                      bool enabled);
+
+/**
+ * Add a breadcrumb to the next event and queue it for the JVM breadcrumb
+ * store. Returns false without adding it if the fast path is disabled.
+ */
+bool bsg_breadcrumb_queue_add(const char *message,
+                              bugsnag_breadcrumb_type type);
+
+/**
+ * Pass any queued breadcrumbs to the JVM now, such as before an error is
+ * reported from native code so that they are included in it
+ */
+void bsg_breadcrumb_queue_flush(JNIEnv *env);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
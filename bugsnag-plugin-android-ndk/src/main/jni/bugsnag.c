@@ -1,13 +1,19 @@
 /** \brief The public API
  */
 #include "../assets/include/bugsnag.h"
+#include "breadcrumb_queue.h"
 #include "bugsnag_ndk.h"
 #include "event.h"
+#include "event_store.h"
 #include "jni_cache.h"
 #include "metadata.h"
+#include "notify_aggregator.h"
+#include "notify_queue.h"
 #include "safejni.h"
+#include "utils/module_index.h"
 #include "utils/stack_unwinder.h"
 #include "utils/string.h"
+#include "utils/thread_context.h"
 #include <jni.h>
 #include <pthread.h>
 #include <stdio.h>
@@ -41,6 +47,9 @@ void bugsnag_set_user(const char *id, const char *email, const char *name) {
 
 void bugsnag_leave_breadcrumb(const char *message,
                               bugsnag_breadcrumb_type type) {
+  if (bsg_breadcrumb_queue_add(message, type)) {
+    return;
+  }
   JNIEnv *env = bsg_jni_cache_get_env();
   if (env == NULL) {
     return;
@@ -49,6 +58,16 @@ void bugsnag_leave_breadcrumb(const char *message,
   bugsnag_leave_breadcrumb_env(env, message, type);
 }
 
+void bugsnag_thread_set_operation(const char *operation) {
+  bsg_thread_context_set_operation(operation);
+}
+
+void bugsnag_thread_set_metadata(const char *name, const char *value) {
+  bsg_thread_context_set_value(name, value);
+}
+
+void bugsnag_thread_clear_context(void) { bsg_thread_context_clear(); }
+
 static jfieldID parse_jseverity(JNIEnv *env, bugsnag_severity severity) {
   if (!bsg_jni_cache->initialized) {
     return NULL;
@@ -67,6 +86,102 @@ static jfieldID parse_jseverity(JNIEnv *env, bugsnag_severity severity) {
   }
 }
 
+/*
+ * Frames from the same library share its path, and mostly share symbols with
+ * earlier errors, so their Java strings are kept as global refs in a direct
+ * mapped cache which replaces an entry when another string hashes to it. A
+ * frame's method can replace its filename, so each frame takes a local ref to
+ * the strings it uses rather than holding on to the cached global refs.
+ */
+
+#define BSG_JSTRING_CACHE_SIZE 128
+
+typedef struct {
+  uint32_t hash;
+  char value[256];
+  jstring string;
+} bsg_jstring_cache_entry;
+
+static pthread_mutex_t jstring_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bsg_jstring_cache_entry jstring_cache[BSG_JSTRING_CACHE_SIZE];
+/** The class of every native frame, which is empty */
+static jstring empty_jstring = NULL;
+/** Set while memory is low, when the cache is emptied and not refilled */
+static bool jstring_cache_disabled = false;
+
+void bsg_notify_set_low_memory(bool low_memory) {
+  __atomic_store_n(&jstring_cache_disabled, low_memory, __ATOMIC_RELEASE);
+}
+
+static uint32_t jstring_cache_hash(const char *value) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; value[i] != '\0'; i++) {
+    hash = (hash ^ (uint8_t)value[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static jstring new_global_jstring(JNIEnv *env, const char *value) {
+  jstring local = bsg_safe_new_string_utf(env, value);
+  if (local == NULL) {
+    return NULL;
+  }
+  jstring global = (*env)->NewGlobalRef(env, local);
+  bsg_safe_delete_local_ref(env, local);
+  return global;
+}
+
+/**
+ * Find or create the Java string for value, which is a global ref owned by the
+ * cache. Must be called with jstring_cache_lock held.
+ */
+static jstring cached_jstring(JNIEnv *env, const char *value) {
+  const uint32_t hash = jstring_cache_hash(value);
+  bsg_jstring_cache_entry *entry =
+      &jstring_cache[hash % BSG_JSTRING_CACHE_SIZE];
+  if (entry->string != NULL && entry->hash == hash &&
+      strncmp(entry->value, value, sizeof(entry->value)) == 0) {
+    return entry->string;
+  }
+  jstring string = new_global_jstring(env, value);
+  if (string == NULL) {
+    return NULL;
+  }
+  if (entry->string != NULL) {
+    (*env)->DeleteGlobalRef(env, entry->string);
+  }
+  entry->hash = hash;
+  bsg_strncpy(entry->value, value, sizeof(entry->value));
+  entry->string = string;
+  return string;
+}
+
+/**
+ * Release every string in the cache. Must be called with jstring_cache_lock
+ * held.
+ */
+static void clear_jstring_cache(JNIEnv *env) {
+  for (int i = 0; i < BSG_JSTRING_CACHE_SIZE; i++) {
+    if (jstring_cache[i].string != NULL) {
+      (*env)->DeleteGlobalRef(env, jstring_cache[i].string);
+      jstring_cache[i].string = NULL;
+    }
+  }
+}
+
+/**
+ * The Java string for value as a local ref for the caller to delete, taken
+ * from the cache unless it is disabled
+ */
+static jstring frame_jstring(JNIEnv *env, const char *value, bool use_cache) {
+  if (!use_cache) {
+    return bsg_safe_new_string_utf(env, value);
+  }
+  jstring cached = cached_jstring(env, value);
+  return cached == NULL ? NULL : (*env)->NewLocalRef(env, cached);
+}
+
 static void populate_notify_stacktrace(JNIEnv *env,
                                        bugsnag_stackframe *stacktrace,
                                        ssize_t frame_count,
@@ -75,69 +190,159 @@ static void populate_notify_stacktrace(JNIEnv *env,
     return;
   }
 
-  for (int i = 0; i < frame_count; i++) {
-    bugsnag_stackframe frame = stacktrace[i];
-
-    // create Java string objects for class/filename/method
-    jstring class = bsg_safe_new_string_utf(env, "");
-    if (class == NULL) {
+  pthread_mutex_lock(&jstring_cache_lock);
+  const bool use_cache =
+      !__atomic_load_n(&jstring_cache_disabled, __ATOMIC_ACQUIRE);
+  if (!use_cache) {
+    clear_jstring_cache(env);
+  }
+  if (empty_jstring == NULL) {
+    empty_jstring = new_global_jstring(env, "");
+    if (empty_jstring == NULL) {
       goto exit;
     }
+  }
+  for (int i = 0; i < frame_count; i++) {
+    bugsnag_stackframe *frame = &stacktrace[i];
 
-    // populate filename
-    jstring filename = bsg_safe_new_string_utf(env, frame.filename);
+    jstring filename = frame_jstring(env, frame->filename, use_cache);
     if (filename == NULL) {
       goto exit;
     }
 
-    // populate method
+    // frames without a symbol are named by their address, which is not cached
     jstring method = NULL;
-    if (bsg_strlen(frame.method) == 0) {
+    if (bsg_strlen(frame->method) == 0) {
       char frame_address[32];
       snprintf(frame_address, sizeof(frame_address), "0x%lx",
-               (unsigned long)frame.frame_address);
+               (unsigned long)frame->frame_address);
       method = bsg_safe_new_string_utf(env, frame_address);
     } else {
-      method = bsg_safe_new_string_utf(env, frame.method);
+      method = frame_jstring(env, frame->method, use_cache);
     }
     if (method == NULL) {
+      bsg_safe_delete_local_ref(env, filename);
       goto exit;
     }
 
     // create StackTraceElement object
-    jobject jframe =
-        bsg_safe_new_object(env, bsg_jni_cache->StackTraceElement,
-                            bsg_jni_cache->StackTraceElement_constructor, class,
-                            method, filename, frame.line_number);
+    jobject jframe = bsg_safe_new_object(
+        env, bsg_jni_cache->StackTraceElement,
+        bsg_jni_cache->StackTraceElement_constructor, empty_jstring, method,
+        filename, frame->line_number);
+    bsg_safe_delete_local_ref(env, method);
+    bsg_safe_delete_local_ref(env, filename);
     if (jframe == NULL) {
       goto exit;
     }
 
     bsg_safe_set_object_array_element(env, trace, i, jframe);
-    goto exit;
-
-  exit:
-    bsg_safe_delete_local_ref(env, filename);
-    bsg_safe_delete_local_ref(env, class);
+    bsg_safe_delete_local_ref(env, jframe);
   }
+
+exit:
+  pthread_mutex_unlock(&jstring_cache_lock);
 }
 
 void bugsnag_notify_env(JNIEnv *env, const char *name, const char *message,
                         bugsnag_severity severity) {
+  if (!bsg_jni_cache->initialized) {
+    BUGSNAG_LOG("bugsnag_notify_env failed: JNI cache not initialized.");
+    return;
+  }
+
+  // pick up any libraries loaded since the last error, while it is safe to
+  bsg_module_index_refresh();
+
+  bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX];
+  memset(stacktrace, 0, sizeof(stacktrace));
+  ssize_t frame_count = bsg_unwind_stack_frames(
+      bsg_configured_unwind_style(), stacktrace,
+      bsg_stack_depth_limit(BSG_CAPTURE_NOTIFY), NULL, NULL);
+  // repeats are only counted, so are not worth symbolicating
+  if (bsg_notify_aggregator_add(name, message, severity, stacktrace,
+                                frame_count)) {
+    return;
+  }
+  bsg_insert_fileinfo(frame_count, stacktrace);
+  bsg_warm_signal_unwinder(bsg_configured_signal_unwind_style(), stacktrace,
+                           frame_count);
+  bsg_notify_stacktrace(env, name, message, severity, stacktrace, frame_count);
+}
+
+void bugsnag_notify_async(const char *name, const char *message,
+                          bugsnag_severity severity) {
+  if (!bsg_jni_cache->initialized) {
+    BUGSNAG_LOG("bugsnag_notify_async failed: JNI cache not initialized.");
+    return;
+  }
+  // only the frame addresses are needed, as the worker symbolicates them
+  bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX];
+  const ssize_t frame_count = bsg_unwind_stack_frames(
+      bsg_configured_unwind_style(), stacktrace,
+      bsg_stack_depth_limit(BSG_CAPTURE_NOTIFY), NULL, NULL);
+  if (bsg_notify_aggregator_add(name, message, severity, stacktrace,
+                                frame_count)) {
+    return;
+  }
+  if (!bsg_notify_queue_add(name, message, severity, stacktrace,
+                            frame_count)) {
+    BUGSNAG_LOG("bugsnag_notify_async dropped an error, as the queue is full");
+  }
+}
+
+/**
+ * Write an error straight to the event store and pass its path to
+ * NativeInterface.deliverStoredEvent(), returning false if it was not stored
+ */
+static bool deliver_stored_event(JNIEnv *env, const char *name,
+                                 const char *message,
+                                 bugsnag_severity severity,
+                                 bugsnag_stackframe *stacktrace,
+                                 ssize_t frame_count, int occurrences,
+                                 int64_t window_ms) {
+  char path[BSG_EVENT_STORE_PATH_MAX];
+  if (!bsg_event_store_write(name, message, severity, stacktrace, frame_count,
+                             occurrences, window_ms, path, sizeof(path))) {
+    return false;
+  }
+  jstring jpath = bsg_safe_new_string_utf(env, path);
+  jstring jname = name != NULL ? bsg_safe_new_string_utf(env, name) : NULL;
+  if (jpath != NULL) {
+    // the stored file is delivered on a later flush if this call fails
+    bsg_safe_call_static_void_method(
+        env, bsg_jni_cache->NativeInterface,
+        bsg_jni_cache->NativeInterface_deliverStoredEvent, jpath, jname);
+  }
+  bsg_safe_delete_local_ref(env, jname);
+  bsg_safe_delete_local_ref(env, jpath);
+  return true;
+}
+
+/**
+ * Report an error through NativeInterface.notify(), or notifyAggregated() if
+ * it repeated within an aggregation window. Errors are written straight to
+ * the event store instead where that is enabled.
+ */
+static void notify_stacktrace(JNIEnv *env, const char *name,
+                              const char *message, bugsnag_severity severity,
+                              bugsnag_stackframe *stacktrace,
+                              ssize_t frame_count, int occurrences,
+                              int64_t window_ms) {
   jobjectArray jtrace = NULL;
   jobject jseverity = NULL;
   jbyteArray jname = NULL;
   jbyteArray jmessage = NULL;
 
-  if (!bsg_jni_cache->initialized) {
-    BUGSNAG_LOG("bugsnag_notify_env failed: JNI cache not initialized.");
-    goto exit;
+  // breadcrumbs left from native code are already in the copied event
+  if (bsg_event_store_is_enabled() &&
+      deliver_stored_event(env, name, message, severity, stacktrace,
+                           frame_count, occurrences, window_ms)) {
+    return;
   }
 
-  bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX];
-  memset(stacktrace, 0, sizeof(stacktrace));
-  ssize_t frame_count =
-      bsg_unwind_stack(bsg_configured_unwind_style(), stacktrace, NULL, NULL);
+  // so that breadcrumbs left from native code are in the error
+  bsg_breadcrumb_queue_flush(env);
 
   // create StackTraceElement array
   jtrace = bsg_safe_new_object_array(env, frame_count,
@@ -164,9 +369,16 @@ void bugsnag_notify_env(JNIEnv *env, const char *name, const char *message,
   jname = bsg_byte_ary_from_string(env, name);
   jmessage = bsg_byte_ary_from_string(env, message);
 
-  bsg_safe_call_static_void_method(env, bsg_jni_cache->NativeInterface,
-                                   bsg_jni_cache->NativeInterface_notify, jname,
-                                   jmessage, jseverity, jtrace);
+  if (occurrences > 0) {
+    bsg_safe_call_static_void_method(
+        env, bsg_jni_cache->NativeInterface,
+        bsg_jni_cache->NativeInterface_notifyAggregated, jname, jmessage,
+        jseverity, jtrace, (jint)occurrences, (jlong)window_ms);
+  } else {
+    bsg_safe_call_static_void_method(env, bsg_jni_cache->NativeInterface,
+                                     bsg_jni_cache->NativeInterface_notify,
+                                     jname, jmessage, jseverity, jtrace);
+  }
 
   goto exit;
 
@@ -179,6 +391,22 @@ exit:
   bsg_safe_delete_local_ref(env, jseverity);
 }
 
+void bsg_notify_stacktrace(JNIEnv *env, const char *name, const char *message,
+                           bugsnag_severity severity,
+                           bugsnag_stackframe *stacktrace,
+                           ssize_t frame_count) {
+  notify_stacktrace(env, name, message, severity, stacktrace, frame_count, 0,
+                    0);
+}
+
+void bsg_notify_aggregated(JNIEnv *env, const char *name, const char *message,
+                           bugsnag_severity severity,
+                           bugsnag_stackframe *stacktrace, ssize_t frame_count,
+                           int occurrences, int64_t window_ms) {
+  notify_stacktrace(env, name, message, severity, stacktrace, frame_count,
+                    occurrences, window_ms);
+}
+
 void bugsnag_set_user_env(JNIEnv *env, const char *id, const char *email,
                           const char *name) {
 
@@ -242,6 +470,9 @@ void bugsnag_leave_breadcrumb_env(JNIEnv *env, const char *message,
   jbyteArray jmessage = NULL;
   jobject jtype = NULL;
 
+  if (bsg_breadcrumb_queue_add(message, type)) {
+    return;
+  }
   if (!bsg_jni_cache->initialized) {
     BUGSNAG_LOG(
         "bugsnag_leave_breadcrumb_env failed: JNI cache not initialized.");
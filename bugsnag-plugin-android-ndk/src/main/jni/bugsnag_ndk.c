@@ -3,44 +3,96 @@
 #include <arpa/inet.h>
 #include <jni.h>
 #include <pthread.h>
+#include <sys/system_properties.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "breadcrumb_queue.h"
 #include "event.h"
+#include "event_store.h"
 #include "featureflags.h"
 #include "handlers/cpp_handler.h"
 #include "handlers/signal_handler.h"
 #include "jni_cache.h"
 #include "metadata.h"
+#include "notify_aggregator.h"
 #include "safejni.h"
+#include "trace_common.h"
+#include "utils/crash_info.h"
+#include "utils/crash_memory.h"
+#include "utils/crash_signatures.h"
+#include "utils/crash_watchdog.h"
+#include "utils/event_filter.h"
+#include "utils/event_template.h"
+#include "utils/health_counters.h"
+#include "utils/lock_stats.h"
+#include "utils/module_index.h"
+#include "utils/symbol_cache.h"
+#include "utils/unwinder_calibration.h"
+#include "utils/pending_reports.h"
+#include "utils/report_index.h"
 #include "utils/serializer.h"
+#include "utils/state_journal.h"
 #include "utils/string.h"
+#include "utils/string_ids.h"
+#include "utils/thread_registry.h"
+#include "utils/threads.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 static bsg_environment *bsg_global_env;
-static pthread_mutex_t bsg_global_env_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bsg_instrumented_mutex bsg_global_env_write_mutex =
+    BSG_INSTRUMENTED_MUTEX_INITIALIZER;
 
 /**
  * All functions which will edit the environment (unless they are handling a
  * crash) must first request the lock
  */
-static void request_env_write_lock(void) {
-  pthread_mutex_lock(&bsg_global_env_write_mutex);
+static void request_env_write_lock(bsg_lock_site site) {
+  bsg_instrumented_lock(&bsg_global_env_write_mutex, site);
 }
 
 /**
  * Once editing is complete, the lock must be released
  */
 static void release_env_write_lock(void) {
-  pthread_mutex_unlock(&bsg_global_env_write_mutex);
+  bsg_instrumented_unlock(&bsg_global_env_write_mutex);
 }
 
+static bsg_instrumented_mutex bsg_event_state_write_mutex =
+    BSG_INSTRUMENTED_MUTEX_INITIALIZER;
+
+/**
+ * Functions which edit the event state change the copy returned here instead
+ * of next_event. They have their own lock, so that they do not wait for
+ * metadata and other larger changes to the environment.
+ */
+static bsg_event_state *begin_state_update(bsg_lock_site site) {
+  bsg_instrumented_lock(&bsg_event_state_write_mutex, site);
+  return bsg_event_state_begin_update(&bsg_global_env->event_state);
+}
+
+/**
+ * Once editing is complete, the state is published for crash handlers
+ */
+static void publish_state_update(void) {
+  bsg_event_state_publish(&bsg_global_env->event_state);
+  bsg_instrumented_unlock(&bsg_event_state_write_mutex);
+}
+
+/**
+ * Starting and pausing sessions only excludes other changes to the session.
+ * Events are counted without a lock.
+ */
+static bsg_instrumented_mutex bsg_session_write_mutex =
+    BSG_INSTRUMENTED_MUTEX_INITIALIZER;
+
 bsg_unwinder bsg_configured_unwind_style() {
   if (bsg_global_env != NULL)
-    return bsg_global_env->unwind_style;
+    // may be replaced by unwinder calibration
+    return __atomic_load_n(&bsg_global_env->unwind_style, __ATOMIC_RELAXED);
 
   return BSG_CUSTOM_UNWIND;
 }
@@ -76,7 +128,60 @@ bool bsg_run_on_error() {
   return true;
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_NdkPlugin_enableCrashReporting(
+bugsnag_event *bsg_copy_next_event(void) {
+  if (bsg_global_env == NULL) {
+    return NULL;
+  }
+  bugsnag_event *event = bsg_event_alloc();
+  if (event == NULL) {
+    return NULL;
+  }
+  request_env_write_lock(BSG_LOCK_SITE_METADATA);
+  const bugsnag_event *next_event = &bsg_global_env->next_event;
+  memcpy(event, next_event, sizeof(bugsnag_event));
+  // the buffers of the next event are left to it, and copied where needed
+  event->threads = NULL;
+  event->thread_capacity = 0;
+  event->thread_count = 0;
+  event->feature_flags = NULL;
+  event->feature_flag_count = 0;
+  event->feature_flag_strings = NULL;
+  event->feature_flag_strings_size = 0;
+  event->feature_flags_encoded = NULL;
+  event->feature_flags_encoded_size = 0;
+  bool copied = bsg_set_feature_flags(event, next_event->feature_flags,
+                                      next_event->feature_flag_count);
+  if (next_event->metadata_arena.capacity > 0) {
+    copied = bsg_metadata_arena_reserve(&event->metadata_arena,
+                                        next_event->metadata_arena.capacity) &&
+             copied;
+    if (event->metadata_arena.data != NULL) {
+      memcpy(event->metadata_arena.data, next_event->metadata_arena.data,
+             next_event->metadata_arena.length);
+      event->metadata_arena.length = next_event->metadata_arena.length;
+    }
+  }
+  release_env_write_lock();
+
+  if (!copied) {
+    bsg_free_event_copy(event);
+    return NULL;
+  }
+  bsg_populate_event_state(bsg_global_env, event);
+  return event;
+}
+
+void bsg_free_event_copy(bugsnag_event *event) {
+  if (event == NULL) {
+    return;
+  }
+  bsg_free_feature_flags(event);
+  bsg_metadata_arena_free(&event->metadata_arena);
+  bsg_event_free_threads(event);
+  free(event);
+}
+
+static void JNICALL Java_com_bugsnag_android_NdkPlugin_enableCrashReporting(
     JNIEnv *env, jobject _this) {
   if (bsg_global_env == NULL) {
     BUGSNAG_LOG(
@@ -87,53 +192,36 @@ JNIEXPORT void JNICALL Java_com_bugsnag_android_NdkPlugin_enableCrashReporting(
   bsg_handler_install_cpp(bsg_global_env);
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_NdkPlugin_disableCrashReporting(
+static void JNICALL Java_com_bugsnag_android_NdkPlugin_disableCrashReporting(
     JNIEnv *env, jobject _this) {
   bsg_handler_uninstall_signal();
   bsg_handler_uninstall_cpp();
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_bugsnag_android_NdkPlugin_getBinaryArch(JNIEnv *env, jobject _this) {
+static const char *binary_arch(void) {
 #if defined(__i386__)
-  const char *binary_arch = "x86";
+  return "x86";
 #elif defined(__x86_64__)
-  const char *binary_arch = "x86_64";
+  return "x86_64";
 #elif defined(__arm__)
-  const char *binary_arch = "arm32";
+  return "arm32";
 #elif defined(__aarch64__)
-  const char *binary_arch = "arm64";
+  return "arm64";
 #else
-  const char *binary_arch = "unknown";
+  return "unknown";
 #endif
-  return bsg_safe_new_string_utf(env, binary_arch);
 }
 
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_enableCrashReporting(JNIEnv *env,
-                                                               jobject _this) {
-  if (bsg_global_env == NULL) {
-    BUGSNAG_LOG(
-        "Attempted to enable crash reporting without first calling install()");
-    return;
-  }
-  bsg_handler_install_signal(bsg_global_env);
-  bsg_handler_install_cpp(bsg_global_env);
-}
-
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_disableCrashReporting(JNIEnv *env,
-                                                                jobject _this) {
-  bsg_handler_uninstall_signal();
-  bsg_handler_uninstall_cpp();
+static jstring JNICALL
+Java_com_bugsnag_android_NdkPlugin_getBinaryArch(JNIEnv *env, jobject _this) {
+  return bsg_safe_new_string_utf(env, binary_arch());
 }
 
 /**
  * Updates information to be serialized to LastRunInfo if this session
  * terminates abnormally.
  */
-void bsg_update_next_run_info(bsg_environment *env) {
-  bool launching = env->next_event.app.is_launching;
+void bsg_update_next_run_info(bsg_environment *env, bool launching) {
   char *crashed_value = launching ? "true" : "false";
   int launch_crashes = env->consecutive_launch_crashes;
   if (launching) {
@@ -144,56 +232,316 @@ void bsg_update_next_run_info(bsg_environment *env) {
           launch_crashes, crashed_value);
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_install(
+/**
+ * The symbol cache is kept beside the report directory rather than in it, as
+ * every file in the report directory is delivered as a report
+ */
+static void bsg_init_symbol_cache(bsg_environment *env,
+                                  const char *build_uuid) {
+  char path[sizeof(env->next_event_path) + 16];
+  bsg_strncpy(path, env->next_event_path, sizeof(path));
+  char *separator = strrchr(path, '/');
+  if (separator == NULL) {
+    return;
+  }
+  strcpy(separator, "-symbols.cache");
+  bsg_symbol_cache_init(path, build_uuid);
+}
+
+/**
+ * Fill an event with the fields known natively, which are all it holds if a
+ * crash happens before the rest of the state is populated in the background
+ */
+static void prepare_minimal_event(bugsnag_event *event, int api_level) {
+  bsg_strncpy(event->app.binary_arch, binary_arch(),
+              sizeof(event->app.binary_arch));
+  event->app.is_launching = true;
+  event->device.api_level = api_level;
+  bsg_strncpy(event->device.os_name, bsg_os_name(),
+              sizeof(event->device.os_name));
+}
+
+static void copy_if_unset(char *dest, const char *value, size_t size) {
+  if (dest[0] == '\0') {
+    bsg_strncpy(dest, value, size);
+  }
+}
+
+/**
+ * Fill the event state from a populated event, keeping the fields which the
+ * bridge has changed from their initial values since install, as those are
+ * newer than the populated event
+ */
+static void merge_populated_state(const bugsnag_event *populated) {
+  bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+  bsg_app_info app = populated->app;
+  if (state->app.in_foreground || state->app.active_screen[0] != '\0') {
+    app.in_foreground = state->app.in_foreground;
+    bsg_strncpy(app.active_screen, state->app.active_screen,
+                sizeof(app.active_screen));
+    app.duration_in_foreground_ms_offset =
+        state->app.duration_in_foreground_ms_offset;
+  } else if (app.in_foreground) {
+    state->foreground_start_time = bsg_global_env->start_time;
+  }
+  app.is_launching = state->app.is_launching;
+  state->app = app;
+
+  bsg_device_info device = populated->device;
+  if (state->device.orientation[0] != '\0') {
+    bsg_strncpy(device.orientation, state->device.orientation,
+                sizeof(device.orientation));
+  }
+  state->device = device;
+
+  copy_if_unset(state->user.id, populated->user.id, sizeof(state->user.id));
+  copy_if_unset(state->user.name, populated->user.name,
+                sizeof(state->user.name));
+  copy_if_unset(state->user.email, populated->user.email,
+                sizeof(state->user.email));
+  copy_if_unset(state->context, populated->context, sizeof(state->context));
+  publish_state_update();
+}
+
+/**
+ * Add the metadata of a populated event which has not been set since install
+ */
+static void merge_populated_metadata(const bugsnag_event *populated) {
+  const bugsnag_metadata *metadata = &populated->metadata;
+  bugsnag_event *event = &bsg_global_env->next_event;
+  request_env_write_lock(BSG_LOCK_SITE_METADATA);
+  for (int i = 0; i < metadata->value_count; i++) {
+    const bsg_metadata_value *value = &metadata->values[i];
+    const char *section = bsg_metadata_value_section(metadata, value);
+    const char *name = bsg_metadata_value_name(metadata, value);
+    if (bugsnag_event_has_metadata(event, section, name) !=
+        BSG_METADATA_NONE_VALUE) {
+      continue;
+    }
+    switch (value->type) {
+    case BSG_METADATA_BOOL_VALUE:
+      bugsnag_event_add_metadata_bool(event, section, name, value->bool_value);
+      break;
+    case BSG_METADATA_CHAR_VALUE:
+      bugsnag_event_add_metadata_string(event, section, name,
+                                        value->char_value);
+      break;
+    case BSG_METADATA_NUMBER_VALUE:
+      bugsnag_event_add_metadata_double(event, section, name,
+                                        value->double_value);
+      break;
+    default:
+      break;
+    }
+  }
+  release_env_write_lock();
+}
+
+/**
+ * Whether the static fields of the event are shared with the other processes
+ * of the app through the event template, set at install
+ */
+static bool bsg_share_event_template = false;
+
+/**
+ * Populate an event from the Java layer and merge it into the installed
+ * environment, taking ownership of the event
+ */
+static void populate_installed_state(JNIEnv *env, bugsnag_event *populated) {
+  bsg_populate_event(env, populated);
+  if (bsg_share_event_template) {
+    bsg_event_template_publish(bsg_global_env->next_event_path, populated);
+  }
+  merge_populated_state(populated);
+  merge_populated_metadata(populated);
+  bsg_init_symbol_cache(bsg_global_env, populated->app.build_uuid);
+  if (bsg_strlen(populated->device.os_build) > 0) {
+    bsg_strncpy(bsg_global_env->report_header.os_build,
+                populated->device.os_build,
+                sizeof(bsg_global_env->report_header.os_build));
+  }
+  free(populated);
+  __atomic_store_n(&bsg_global_env->state_populated, true, __ATOMIC_RELEASE);
+}
+
+static void *run_state_population(void *populated) {
+  JNIEnv *env = bsg_jni_cache_get_env();
+  if (env == NULL) {
+    BUGSNAG_LOG("Could not populate the native state without a JNIEnv");
+    free(populated);
+    return NULL;
+  }
+  populate_installed_state(env, populated);
+  BUGSNAG_LOG("Populated the native state in the background");
+  return NULL;
+}
+
+/**
+ * Populate the installed environment on a background thread, or on this one
+ * if a thread cannot be started
+ */
+static void populate_state_in_background(JNIEnv *env) {
+  bugsnag_event *populated = bsg_event_alloc();
+  if (populated == NULL) {
+    BUGSNAG_LOG("Could not allocate an event to populate the native state");
+    return;
+  }
+  memset(populated, 0, sizeof(bugsnag_event));
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  const int result =
+      pthread_create(&thread, &attr, run_state_population, populated);
+  pthread_attr_destroy(&attr);
+  if (result == 0) {
+    pthread_setname_np(thread, "bsg-ndk-populate");
+  } else {
+    BUGSNAG_LOG("Failed to start populating the native state: %s",
+                strerror(result));
+    populate_installed_state(env, populated);
+  }
+}
+
+/**
+ * Allocate the environment in the state journal beside the report directory,
+ * or on the heap if it is not journaled or cannot be mapped
+ */
+static bsg_environment *allocate_environment(JNIEnv *env, jstring _event_path,
+                                             bool journal_state) {
+  if (journal_state) {
+    const char *event_path = bsg_safe_get_string_utf_chars(env, _event_path);
+    if (event_path != NULL) {
+      bsg_environment *journaled = bsg_state_journal_map(event_path);
+      bsg_safe_release_string_utf_chars(env, _event_path, event_path);
+      if (journaled != NULL) {
+        return journaled;
+      }
+    }
+  }
+  // aligned so that the groups of fields written by different threads each
+  // start on a cache line, which calloc() does not guarantee
+  void *allocated = NULL;
+  if (posix_memalign(&allocated, BSG_CACHE_LINE_SIZE,
+                     sizeof(bsg_environment)) != 0) {
+    return NULL;
+  }
+  memset(allocated, 0, sizeof(bsg_environment));
+  return allocated;
+}
+
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_install(
     JNIEnv *env, jobject _this, jstring _api_key, jstring _event_path,
     jstring _last_run_info_path, jint consecutive_launch_crashes,
     jboolean auto_detect_ndk_crashes, jint _api_level, jboolean is32bit,
-    jint send_threads) {
+    jint send_threads, jint max_threads, jboolean populate_in_background,
+    jboolean journal_state, jboolean share_event_template,
+    jint max_crash_frames, jint max_terminate_frames, jint max_anr_frames,
+    jint max_notify_frames) {
+  bsg_trace_enable_from_property();
+  bsg_trace_begin("bugsnag:install");
 
   if (!bsg_jni_cache_init(env)) {
     BUGSNAG_LOG("Could not init JNI jni_cache.");
   }
 
-  bsg_environment *bugsnag_env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *bugsnag_env =
+      allocate_environment(env, _event_path, (bool)journal_state);
   bsg_set_unwind_types((int)_api_level, (bool)is32bit,
                        &bugsnag_env->signal_unwind_style,
                        &bugsnag_env->unwind_style);
+  // negative limits are treated as 0, the full depth
+  bsg_set_stack_depth_limit(BSG_CAPTURE_SIGNAL,
+                            max_crash_frames > 0 ? max_crash_frames : 0);
+  bsg_set_stack_depth_limit(BSG_CAPTURE_CPP_TERMINATE,
+                            max_terminate_frames > 0 ? max_terminate_frames
+                                                     : 0);
+  bsg_set_stack_depth_limit(BSG_CAPTURE_ANR,
+                            max_anr_frames > 0 ? max_anr_frames : 0);
+  bsg_set_stack_depth_limit(BSG_CAPTURE_NOTIFY,
+                            max_notify_frames > 0 ? max_notify_frames : 0);
+  bsg_module_index_refresh();
   bugsnag_env->report_header.big_endian =
       htonl(47) == 47; // potentially too clever, see man 3 htonl
   bugsnag_env->report_header.version = BUGSNAG_EVENT_VERSION;
   bugsnag_env->consecutive_launch_crashes = consecutive_launch_crashes;
   bugsnag_env->send_threads = send_threads;
 
+  // reserve the threads before the crash file, which is sized to hold them
+  const int thread_capacity =
+      send_threads == SEND_THREADS_NEVER
+          ? 0
+          : (max_threads < BUGSNAG_THREADS_LIMIT ? max_threads
+                                                 : BUGSNAG_THREADS_LIMIT);
+  if (!bsg_event_reserve_threads(&bugsnag_env->next_event, thread_capacity)) {
+    BUGSNAG_LOG("Failed to reserve %d threads", thread_capacity);
+  }
+  bugsnag_env->thread_capture_max_count =
+      bugsnag_env->next_event.thread_capacity;
+  bugsnag_env->task_dir_fd =
+      send_threads != SEND_THREADS_NEVER ? bsg_open_task_dir() : -1;
+
   // copy event path to env struct
   const char *event_path = bsg_safe_get_string_utf_chars(env, _event_path);
   if (event_path == NULL) {
+    bsg_trace_end();
     return;
   }
   sprintf(bugsnag_env->next_event_path, "%s", event_path);
   bsg_safe_release_string_utf_chars(env, _event_path, event_path);
+  if (!bsg_serialize_prepare_event_file(bugsnag_env)) {
+    BUGSNAG_LOG("Could not pre-allocate crash file: %s",
+                bugsnag_env->next_event_path);
+  }
+  bsg_report_index_enable(bugsnag_env->next_event_path);
 
   // copy last run info path to env struct
   const char *last_run_info_path =
       bsg_safe_get_string_utf_chars(env, _last_run_info_path);
   if (last_run_info_path == NULL) {
+    bsg_trace_end();
     return;
   }
   bsg_strncpy(bugsnag_env->last_run_info_path, last_run_info_path,
               sizeof(bugsnag_env->last_run_info_path));
   bsg_safe_release_string_utf_chars(env, _last_run_info_path,
                                     last_run_info_path);
+  if (!bsg_serialize_prepare_last_run_info_file(bugsnag_env)) {
+    BUGSNAG_LOG("Could not open last run info file: %s",
+                bugsnag_env->last_run_info_path);
+  }
 
   if ((bool)auto_detect_ndk_crashes) {
     bsg_handler_install_signal(bugsnag_env);
     bsg_handler_install_cpp(bugsnag_env);
   }
 
-  // populate metadata from Java layer
-  bsg_populate_event(env, &bugsnag_env->next_event);
-  time(&bugsnag_env->start_time);
-  if (bugsnag_env->next_event.app.in_foreground) {
-    bugsnag_env->foreground_start_time = bugsnag_env->start_time;
+  // the static fields from a template are enough to report a crash with, so
+  // the rest is populated in the background as if that had been asked for
+  bsg_share_event_template = (bool)share_event_template;
+  const bool populate_later =
+      (bool)populate_in_background ||
+      (bsg_share_event_template &&
+       bsg_event_template_apply(bugsnag_env->next_event_path,
+                                &bugsnag_env->next_event));
+  if (populate_later) {
+    prepare_minimal_event(&bugsnag_env->next_event, (int)_api_level);
+  } else {
+    // populate metadata from Java layer
+    bsg_populate_event(env, &bugsnag_env->next_event);
+    if (bsg_share_event_template) {
+      bsg_event_template_publish(bugsnag_env->next_event_path,
+                                 &bugsnag_env->next_event);
+    }
+    bsg_init_symbol_cache(bugsnag_env,
+                          bugsnag_env->next_event.app.build_uuid);
+    bugsnag_env->state_populated = true;
   }
+  time(&bugsnag_env->start_time);
+  bsg_event_state_init(&bugsnag_env->event_state, &bugsnag_env->next_event,
+                       bugsnag_env->next_event.app.in_foreground
+                           ? bugsnag_env->start_time
+                           : 0);
 
   // If set, save os build info to report info header
   if (bsg_strlen(bugsnag_env->next_event.device.os_build) > 0) {
@@ -213,23 +561,106 @@ JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_install(
   bugsnag_env->next_event.feature_flag_count = 0;
   bugsnag_env->next_event.feature_flags = NULL;
 
+  // reserve room for metadata which does not fit in the event struct now, as
+  // it may be added from the signal handler where nothing can be allocated
+  if (!bsg_metadata_arena_reserve(&bugsnag_env->next_event.metadata_arena,
+                                  BUGSNAG_METADATA_ARENA_SIZE)) {
+    BUGSNAG_LOG("Failed to reserve the metadata arena");
+  }
+
   bsg_global_env = bugsnag_env;
-  bsg_update_next_run_info(bsg_global_env);
+  bsg_update_next_run_info(bsg_global_env,
+                           bugsnag_env->next_event.app.is_launching);
+  if (populate_later) {
+    populate_state_in_background(env);
+  }
   BUGSNAG_LOG("Initialization complete!");
+  bsg_trace_end();
+}
+
+/**
+ * Serializes deliveries, so that reports are handed to NativeInterface one at
+ * a time
+ */
+static pthread_mutex_t bsg_native_delivery_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Hand a prepared report to NativeInterface.deliverReport()
+ */
+static void bsg_deliver_pending_report(const char *path,
+                                       bsg_pending_report *report,
+                                       void *context) {
+  JNIEnv *env = context;
+  jobject jbuffer = NULL;
+  jbyteArray jpayload = NULL;
+  jbyteArray jstage = NULL;
+  jstring japi_key = NULL;
+
+  if (report->payload == NULL) {
+    // the reason has already been logged
+    return;
+  }
+  bsg_trace_begin("bugsnag:deliver-jni");
+
+  // generate releaseStage bytearray
+  jstage = bsg_byte_ary_from_string(env, report->release_stage);
+  if (jstage == NULL) {
+    goto exit;
+  }
+
+  japi_key = bsg_safe_new_string_utf(env, report->api_key);
+  if (japi_key == NULL) {
+    goto exit;
+  }
+
+  // wrap the (possibly gzip-compressed) payload without copying it onto the
+  // Java heap. The buffer only borrows the memory: NativeInterface consumes it
+  // before returning, and the payload is freed once this callback completes.
+  jbuffer = bsg_safe_new_direct_byte_buffer(env, report->payload,
+                                            (jlong)report->payload_length);
+  if (jbuffer != NULL) {
+    bsg_safe_call_static_void_method(
+        env, bsg_jni_cache->NativeInterface,
+        bsg_jni_cache->NativeInterface_deliverReportBuffer, jstage, jbuffer,
+        japi_key, report->is_launching);
+    goto exit;
+  }
+
+  // direct buffers are unsupported by this VM, fall back to a bytearray copy
+  jpayload =
+      bsg_byte_ary_from_bytes(env, report->payload, report->payload_length);
+  if (jpayload != NULL) {
+    bsg_safe_call_static_void_method(
+        env, bsg_jni_cache->NativeInterface,
+        bsg_jni_cache->NativeInterface_deliverReport, jstage, jpayload,
+        japi_key, report->is_launching);
+  }
+
+exit:
+  bsg_safe_release_byte_array_elements(env, jstage,
+                                       (jbyte *)report->release_stage);
+  bsg_safe_release_byte_array_elements(env, jpayload,
+                                       (jbyte *)report->payload);
+  // batches can be large, so don't wait for the JNI frame to pop
+  bsg_safe_delete_local_ref(env, japi_key);
+  bsg_safe_delete_local_ref(env, jstage);
+  bsg_safe_delete_local_ref(env, jpayload);
+  bsg_safe_delete_local_ref(env, jbuffer);
+  bsg_trace_end();
+}
+
+static bool bsg_is_current_event_path(const char *path) {
+  // the pre-allocated file for the current process is not a pending report
+  return bsg_global_env != NULL &&
+         strcmp(path, bsg_global_env->next_event_path) == 0;
 }
 
-JNIEXPORT void JNICALL
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_deliverReportAtPath(
     JNIEnv *env, jobject _this, jstring _report_path) {
-  static pthread_mutex_t bsg_native_delivery_mutex = PTHREAD_MUTEX_INITIALIZER;
   pthread_mutex_lock(&bsg_native_delivery_mutex);
 
   const char *event_path = NULL;
-  bugsnag_event *event = NULL;
-  jbyteArray jpayload = NULL;
-  jbyteArray jstage = NULL;
-  char *payload = NULL;
-  jstring japi_key = NULL;
 
   if (!bsg_jni_cache->initialized) {
     BUGSNAG_LOG("deliverReportAtPath failed: JNI cache not initialized.");
@@ -237,93 +668,94 @@ Java_com_bugsnag_android_ndk_NativeBridge_deliverReportAtPath(
   }
 
   event_path = bsg_safe_get_string_utf_chars(env, _report_path);
-  if (event_path == NULL) {
+  if (event_path == NULL || bsg_is_current_event_path(event_path)) {
     goto exit;
   }
-  event = bsg_deserialize_event_from_file((char *)event_path);
+  bsg_trace_begin("bugsnag:deliverReportAtPath");
+  bsg_prepare_pending_reports(&event_path, 1, bsg_deliver_pending_report, env);
+  bsg_trace_end();
 
-  // remove persisted NDK struct early - this reduces the chance of crash loops
-  // in delivery.
-  remove(event_path);
+exit:
+  bsg_safe_release_string_utf_chars(env, _report_path, event_path);
+  pthread_mutex_unlock(&bsg_native_delivery_mutex);
+}
 
-  if (event == NULL) {
-    BUGSNAG_LOG("Failed to read event at file: %s", event_path);
-    goto exit;
-  }
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_deliverReportsAtPaths(
+    JNIEnv *env, jobject _this, jobjectArray _report_paths,
+    jint max_reports) {
+  pthread_mutex_lock(&bsg_native_delivery_mutex);
+
+  jsize path_count = 0;
+  char **paths = NULL;
+  size_t count = 0;
 
-  payload = bsg_serialize_event_to_json_string(event);
-  if (payload == NULL) {
-    BUGSNAG_LOG("Failed to serialize event as JSON: %s", event_path);
+  if (!bsg_jni_cache->initialized) {
+    BUGSNAG_LOG("deliverReportsAtPaths failed: JNI cache not initialized.");
     goto exit;
   }
 
-  // generate payload bytearray
-  jpayload = bsg_byte_ary_from_string(env, payload);
-  if (jpayload == NULL) {
+  path_count = bsg_safe_get_array_length(env, _report_paths);
+  if (path_count <= 0) {
     goto exit;
   }
-
-  // generate releaseStage bytearray
-  jstage = bsg_byte_ary_from_string(env, event->app.release_stage);
-  if (jstage == NULL) {
+  paths = calloc(path_count, sizeof(char *));
+  if (paths == NULL) {
     goto exit;
   }
 
-  // call NativeInterface.deliverReport()
-  japi_key = bsg_safe_new_string_utf(env, event->api_key);
-  if (japi_key != NULL) {
-    bool is_launching = event->app.is_launching;
-    bsg_safe_call_static_void_method(
-        env, bsg_jni_cache->NativeInterface,
-        bsg_jni_cache->NativeInterface_deliverReport, jstage, jpayload,
-        japi_key, is_launching);
+  // copy the paths out first, so that the JNI strings are not held by workers
+  for (jsize index = 0; index < path_count; index++) {
+    jstring jpath =
+        bsg_safe_get_object_array_element(env, _report_paths, index);
+    const char *path = bsg_safe_get_string_utf_chars(env, jpath);
+    if (path != NULL && !bsg_is_current_event_path(path)) {
+      paths[count] = strdup(path);
+      if (paths[count] != NULL) {
+        count++;
+      }
+    }
+    bsg_safe_release_string_utf_chars(env, jpath, path);
+    bsg_safe_delete_local_ref(env, jpath);
   }
 
+  bsg_trace_begin("bugsnag:deliverReportsAtPaths");
+  // launch crashes and the newest reports go first, and any beyond the
+  // backlog limit are discarded unread
+  const size_t deliver_count = bsg_report_index_order(
+      paths, count, max_reports > 0 ? (size_t)max_reports : 0);
+  bsg_prepare_pending_reports((const char *const *)paths, deliver_count,
+                              bsg_deliver_pending_report, env);
+  bsg_trace_end();
+
 exit:
-  bsg_safe_release_string_utf_chars(env, _report_path, event_path);
-  if (event != NULL) {
-    bsg_safe_release_byte_array_elements(env, jstage,
-                                         (jbyte *)event->app.release_stage);
-    bsg_free_feature_flags(event);
-    free(event);
+  for (size_t index = 0; index < count; index++) {
+    free(paths[index]);
   }
-  bsg_safe_release_byte_array_elements(env, jpayload, (jbyte *)payload);
-  free(payload);
-
+  free(paths);
   pthread_mutex_unlock(&bsg_native_delivery_mutex);
 }
 
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_addHandledEvent(JNIEnv *env,
-                                                          jobject _this) {
+static void count_event(bool unhandled) {
   if (bsg_global_env == NULL) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_event *event = &bsg_global_env->next_event;
+  bsg_event_state_count_event(&bsg_global_env->event_state, unhandled);
+}
 
-  if (bugsnag_event_has_session(event)) {
-    event->handled_events++;
-  }
-  release_env_write_lock();
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_addHandledEvent(JNIEnv *env,
+                                                          jobject _this) {
+  count_event(false);
 }
 
-JNIEXPORT void JNICALL
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_addUnhandledEvent(JNIEnv *env,
                                                             jobject _this) {
-  if (bsg_global_env == NULL) {
-    return;
-  }
-  request_env_write_lock();
-  bugsnag_event *event = &bsg_global_env->next_event;
-
-  if (bugsnag_event_has_session(event)) {
-    event->unhandled_events++;
-  }
-  release_env_write_lock();
+  count_event(true);
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_startedSession(
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_startedSession(
     JNIEnv *env, jobject _this, jstring session_id_, jstring start_date_,
     jint handled_count, jint unhandled_count) {
   if (bsg_global_env == NULL || session_id_ == NULL) {
@@ -332,412 +764,504 @@ JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_startedSession(
   char *session_id = (char *)bsg_safe_get_string_utf_chars(env, session_id_);
   char *started_at = (char *)bsg_safe_get_string_utf_chars(env, start_date_);
   if (session_id != NULL && started_at != NULL) {
-    request_env_write_lock();
-    bugsnag_event_start_session(&bsg_global_env->next_event, session_id,
+    bsg_instrumented_lock(&bsg_session_write_mutex, BSG_LOCK_SITE_SESSION);
+    bsg_event_state_set_session(&bsg_global_env->event_state, session_id,
                                 started_at, handled_count, unhandled_count);
-    release_env_write_lock();
+    bsg_instrumented_unlock(&bsg_session_write_mutex);
   }
   bsg_safe_release_string_utf_chars(env, session_id_, session_id);
   bsg_safe_release_string_utf_chars(env, start_date_, started_at);
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_pausedSession(
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_pausedSession(
     JNIEnv *env, jobject _this) {
   if (bsg_global_env == NULL) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_event *event = &bsg_global_env->next_event;
-  memset(event->session_id, 0, bsg_strlen(event->session_id));
-  memset(event->session_start, 0, bsg_strlen(event->session_start));
-  event->handled_events = 0;
-  event->unhandled_events = 0;
-  release_env_write_lock();
+  bsg_instrumented_lock(&bsg_session_write_mutex, BSG_LOCK_SITE_SESSION);
+  bsg_event_state_set_session(&bsg_global_env->event_state, NULL, NULL, 0, 0);
+  bsg_instrumented_unlock(&bsg_session_write_mutex);
+}
+
+static bugsnag_breadcrumb_type parse_crumb_type(const char *type) {
+  if (strcmp(type, "user") == 0) {
+    return BSG_CRUMB_USER;
+  } else if (strcmp(type, "error") == 0) {
+    return BSG_CRUMB_ERROR;
+  } else if (strcmp(type, "log") == 0) {
+    return BSG_CRUMB_LOG;
+  } else if (strcmp(type, "navigation") == 0) {
+    return BSG_CRUMB_NAVIGATION;
+  } else if (strcmp(type, "request") == 0) {
+    return BSG_CRUMB_REQUEST;
+  } else if (strcmp(type, "state") == 0) {
+    return BSG_CRUMB_STATE;
+  } else if (strcmp(type, "process") == 0) {
+    return BSG_CRUMB_PROCESS;
+  } else {
+    return BSG_CRUMB_MANUAL;
+  }
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_addBreadcrumb(
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_addBreadcrumb(
     JNIEnv *env, jobject _this, jstring name_, jstring crumb_type,
-    jstring timestamp_, jobject metadata) {
+    jlong timestamp, jbyteArray metadata) {
 
   if (!bsg_jni_cache->initialized) {
     BUGSNAG_LOG("addBreadcrumb failed: JNI cache not initialized.");
     return;
   }
+  bsg_trace_begin("bugsnag:addBreadcrumb");
   const char *name = bsg_safe_get_string_utf_chars(env, name_);
   const char *type = bsg_safe_get_string_utf_chars(env, crumb_type);
-  const char *timestamp = bsg_safe_get_string_utf_chars(env, timestamp_);
-
-  if (name != NULL && type != NULL && timestamp != NULL) {
-    bugsnag_breadcrumb *crumb = calloc(1, sizeof(bugsnag_breadcrumb));
-    bsg_strncpy(crumb->name, name, sizeof(crumb->name));
-    bsg_strncpy(crumb->timestamp, timestamp, sizeof(crumb->timestamp));
-    if (strcmp(type, "user") == 0) {
-      crumb->type = BSG_CRUMB_USER;
-    } else if (strcmp(type, "error") == 0) {
-      crumb->type = BSG_CRUMB_ERROR;
-    } else if (strcmp(type, "log") == 0) {
-      crumb->type = BSG_CRUMB_LOG;
-    } else if (strcmp(type, "navigation") == 0) {
-      crumb->type = BSG_CRUMB_NAVIGATION;
-    } else if (strcmp(type, "request") == 0) {
-      crumb->type = BSG_CRUMB_REQUEST;
-    } else if (strcmp(type, "state") == 0) {
-      crumb->type = BSG_CRUMB_STATE;
-    } else if (strcmp(type, "process") == 0) {
-      crumb->type = BSG_CRUMB_PROCESS;
-    } else {
-      crumb->type = BSG_CRUMB_MANUAL;
-    }
-
-    bsg_populate_crumb_metadata(env, crumb, metadata);
-    request_env_write_lock();
-    bugsnag_event_add_breadcrumb(&bsg_global_env->next_event, crumb);
-    release_env_write_lock();
 
-    free(crumb);
+  if (name != NULL && type != NULL) {
+    // the breadcrumb is filled in place in the ring, without taking the env
+    // lock, so other threads can add breadcrumbs at the same time
+    const jsize metadata_length =
+        metadata != NULL ? bsg_safe_get_array_length(env, metadata) : 0;
+    const uint32_t length = bsg_crumb_record_size(
+        name, metadata_length > 0 ? (size_t)metadata_length : 0);
+    uint64_t ticket;
+    void *record = bsg_event_claim_breadcrumb(&bsg_global_env->next_event,
+                                              length, &ticket);
+    if (record != NULL) {
+      bsg_crumb_record_init(record, length, name, (int64_t)timestamp,
+                            parse_crumb_type(type));
+      bsg_populate_crumb_metadata(env, record, length, metadata,
+                                  metadata_length);
+      bsg_event_publish_breadcrumb(&bsg_global_env->next_event, ticket);
+    }
   }
   bsg_safe_release_string_utf_chars(env, name_, name);
   bsg_safe_release_string_utf_chars(env, crumb_type, type);
-  bsg_safe_release_string_utf_chars(env, timestamp_, timestamp);
+  bsg_trace_end();
 }
 
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_updateAppVersion(JNIEnv *env,
-                                                           jobject _this,
-                                                           jstring new_value) {
-  if (bsg_global_env == NULL) {
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_addBreadcrumbs(
+    JNIEnv *env, jobject _this, jbyteArray packed_) {
+
+  if (!bsg_jni_cache->initialized) {
+    BUGSNAG_LOG("addBreadcrumbs failed: JNI cache not initialized.");
     return;
   }
-  char *value = (char *)bsg_safe_get_string_utf_chars(env, new_value);
-  if (value == NULL) {
+  const jsize length = bsg_safe_get_array_length(env, packed_);
+  if (length <= 0) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_app_set_version(&bsg_global_env->next_event, value);
-  release_env_write_lock();
-  bsg_safe_release_string_utf_chars(env, new_value, value);
-}
-
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_updateBuildUUID(JNIEnv *env,
-                                                          jobject _this,
-                                                          jstring new_value) {
-  if (bsg_global_env == NULL) {
+  jbyte *packed = malloc((size_t)length);
+  if (packed == NULL) {
     return;
   }
-  char *value = (char *)bsg_safe_get_string_utf_chars(env, new_value);
-  if (value == NULL) {
-    return;
+  // the batch is copied once, and each breadcrumb is then filled in place in
+  // the ring as with addBreadcrumb
+  if (bsg_safe_get_byte_array_region(env, packed_, 0, length, packed) &&
+      !bsg_event_add_packed_breadcrumbs(&bsg_global_env->next_event, packed,
+                                        (size_t)length)) {
+    BUGSNAG_LOG("Malformed breadcrumb batch");
   }
-  request_env_write_lock();
-  bugsnag_app_set_build_uuid(&bsg_global_env->next_event, value);
-  release_env_write_lock();
-  bsg_safe_release_string_utf_chars(env, new_value, value);
+  free(packed);
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_updateContext(
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_updateContext(
     JNIEnv *env, jobject _this, jstring new_value) {
-  if (bsg_global_env == NULL) {
-    return;
-  }
-  char *value = (char *)bsg_safe_get_string_utf_chars(env, new_value);
-  if (value == NULL) {
+  if (bsg_global_env == NULL || new_value == NULL) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_event_set_context(&bsg_global_env->next_event, value);
-  release_env_write_lock();
-  if (new_value != NULL) {
-    bsg_safe_release_string_utf_chars(env, new_value, value);
-  }
+  bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+  bsg_safe_copy_string_utf(env, new_value, state->context,
+                           sizeof(state->context));
+  publish_state_update();
 }
 
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_updateInForeground(
-    JNIEnv *env, jobject _this, jboolean new_value, jstring activity_) {
-  if (bsg_global_env == NULL) {
-    return;
-  }
-  char *activity = (char *)bsg_safe_get_string_utf_chars(env, activity_);
-  request_env_write_lock();
-  bool was_in_foreground = bsg_global_env->next_event.app.in_foreground;
-  bsg_global_env->next_event.app.in_foreground = (bool)new_value;
-  bsg_strncpy(bsg_global_env->next_event.app.active_screen, activity,
-              sizeof(bsg_global_env->next_event.app.active_screen));
-  if ((bool)new_value) {
+static void apply_in_foreground(bsg_event_state *state, bool new_value,
+                                const char *activity) {
+  bool was_in_foreground = state->app.in_foreground;
+  state->app.in_foreground = new_value;
+  bsg_strncpy(state->app.active_screen, activity,
+              sizeof(state->app.active_screen));
+  if (new_value) {
     if (!was_in_foreground) {
-      time(&bsg_global_env->foreground_start_time);
+      time(&state->foreground_start_time);
     }
   } else {
-    bsg_global_env->foreground_start_time = 0;
-    bsg_global_env->next_event.app.duration_in_foreground_ms_offset = 0;
-  }
-  release_env_write_lock();
-  if (activity_ != NULL) {
-    bsg_safe_release_string_utf_chars(env, activity_, activity);
+    state->foreground_start_time = 0;
+    state->app.duration_in_foreground_ms_offset = 0;
   }
 }
 
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_updateIsLaunching(
-    JNIEnv *env, jobject _this, jboolean new_value) {
+static void update_in_foreground(bool new_value, const char *activity) {
+  bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+  apply_in_foreground(state, new_value, activity);
+  publish_state_update();
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_updateInForeground(
+    JNIEnv *env, jobject _this, jboolean new_value, jstring activity_) {
   if (bsg_global_env == NULL) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_app_set_is_launching(&bsg_global_env->next_event, new_value);
-  bsg_update_next_run_info(bsg_global_env);
-  release_env_write_lock();
+  char activity[sizeof(bsg_global_env->next_event.app.active_screen)];
+  const bool has_activity =
+      bsg_safe_copy_string_utf(env, activity_, activity, sizeof(activity));
+  update_in_foreground((bool)new_value, has_activity ? activity : NULL);
 }
 
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_updateLowMemory(
-    JNIEnv *env, jobject _this, jboolean low_memory,
-    jstring memory_trim_level_description) {
+static void apply_is_launching(bsg_event_state *state, bool new_value) {
+  state->app.is_launching = new_value;
+  bsg_update_next_run_info(bsg_global_env, state->app.is_launching);
+}
+
+static void update_is_launching(bool new_value) {
   if (bsg_global_env == NULL) {
     return;
   }
+  bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+  apply_is_launching(state, new_value);
+  publish_state_update();
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_updateIsLaunching(
+    JNIEnv *env, jobject _this, jboolean new_value) {
+  update_is_launching((bool)new_value);
+}
 
-  char *memory_trim_level =
-      (char *)bsg_safe_get_string_utf_chars(env, memory_trim_level_description);
+/**
+ * The size of the stack buffers metadata section names, keys and other short
+ * strings are copied into. This is longer than BSG_METADATA_NAME_MAX, so that
+ * names are truncated by the metadata as they are when set through the C API.
+ */
+#define BSG_JNI_NAME_BUFFER_SIZE 64
 
-  if (memory_trim_level == NULL) {
-    return;
-  }
+/**
+ * Whether the native caches have been trimmed because memory is low, guarded
+ * by the env write lock
+ */
+static bool bsg_low_memory_trimmed = false;
 
-  request_env_write_lock();
+static void update_low_memory(bool low_memory, const char *memory_trim_level) {
+  request_env_write_lock(BSG_LOCK_SITE_METADATA);
   bugsnag_event_add_metadata_bool(&bsg_global_env->next_event, "app",
-                                  "lowMemory", (bool)low_memory);
+                                  "lowMemory", low_memory);
   bugsnag_event_add_metadata_string(&bsg_global_env->next_event, "app",
                                     "memoryTrimLevel", memory_trim_level);
+  const bool changed = low_memory != bsg_low_memory_trimmed;
+  if (changed) {
+    bsg_low_memory_trimmed = low_memory;
+    bsg_feature_flags_set_low_memory(&bsg_global_env->next_event, low_memory);
+  }
   release_env_write_lock();
-  if (memory_trim_level_description != NULL) {
-    bsg_safe_release_string_utf_chars(env, memory_trim_level_description,
-                                      memory_trim_level);
+
+  // caches outside of the event are trimmed without holding up its setters,
+  // and refill themselves once memory recovers
+  if (changed) {
+    bsg_notify_set_low_memory(low_memory);
+    if (low_memory) {
+      bsg_symbol_cache_release();
+    }
   }
 }
 
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_updateOrientation(JNIEnv *env,
-                                                            jobject _this,
-                                                            jstring new_value) {
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_updateLowMemory(
+    JNIEnv *env, jobject _this, jboolean low_memory,
+    jstring memory_trim_level_description) {
   if (bsg_global_env == NULL) {
     return;
   }
-
-  char *value = (char *)bsg_safe_get_string_utf_chars(env, new_value);
-  if (value == NULL) {
-    return;
-  }
-  request_env_write_lock();
-  bugsnag_device_set_orientation(&bsg_global_env->next_event, value);
-  release_env_write_lock();
-  if (new_value != NULL) {
-    bsg_safe_release_string_utf_chars(env, new_value, value);
+  char memory_trim_level[BSG_JNI_NAME_BUFFER_SIZE];
+  if (bsg_safe_copy_string_utf(env, memory_trim_level_description,
+                               memory_trim_level, sizeof(memory_trim_level))) {
+    update_low_memory((bool)low_memory, memory_trim_level);
   }
 }
 
-JNIEXPORT void JNICALL
-Java_com_bugsnag_android_ndk_NativeBridge_updateReleaseStage(
-    JNIEnv *env, jobject _this, jstring new_value) {
+/*
+ * The fields changed by a call to updateState, in the order their strings are
+ * packed. Each string is a uint32 length and its UTF-8 bytes, in native byte
+ * order, as packed by StateBuffer.
+ */
+#define BSG_STATE_CONTEXT (1 << 0)
+#define BSG_STATE_IN_FOREGROUND (1 << 1)
+#define BSG_STATE_IS_LAUNCHING (1 << 2)
+#define BSG_STATE_ORIENTATION (1 << 3)
+#define BSG_STATE_LOW_MEMORY (1 << 4)
+
+/** The boolean values passed to updateState */
+#define BSG_STATE_FLAG_IN_FOREGROUND (1 << 0)
+#define BSG_STATE_FLAG_IS_LAUNCHING (1 << 1)
+#define BSG_STATE_FLAG_LOW_MEMORY (1 << 2)
+
+/**
+ * Read the next string of a packed state update into dest, truncating it to
+ * fit. Returns false if the update is malformed.
+ */
+static bool read_packed_state_string(const jbyte *packed, size_t length,
+                                     size_t *offset, char *dest, size_t size) {
+  uint32_t string_length;
+  if (length - *offset < sizeof(string_length)) {
+    return false;
+  }
+  memcpy(&string_length, packed + *offset, sizeof(string_length));
+  *offset += sizeof(string_length);
+  if (length - *offset < string_length) {
+    return false;
+  }
+  const size_t copied = string_length < size ? string_length : size - 1;
+  memcpy(dest, packed + *offset, copied);
+  dest[copied] = '\0';
+  *offset += string_length;
+  return true;
+}
+
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_updateState(
+    JNIEnv *env, jobject _this, jint changed, jint flags, jbyteArray packed_) {
   if (bsg_global_env == NULL) {
     return;
   }
-  char *value = (char *)bsg_safe_get_string_utf_chars(env, new_value);
-  if (value == NULL) {
+  char context[sizeof(bsg_global_env->event_state.copies[0].context)];
+  char activity[sizeof(bsg_global_env->next_event.app.active_screen)];
+  char orientation[sizeof(bsg_global_env->next_event.device.orientation)];
+  char memory_trim_level[BSG_JNI_NAME_BUFFER_SIZE];
+
+  // the strings are copied out before taking any lock, and are usually short
+  // enough for the stack. A long context still updates the other fields.
+  jbyte packed_stack[1024];
+  jbyte *packed = packed_stack;
+  const jsize length = bsg_safe_get_array_length(env, packed_);
+  if (length < 0) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_app_set_release_stage(&bsg_global_env->next_event, value);
-  release_env_write_lock();
-  if (new_value != NULL) {
-    bsg_safe_release_string_utf_chars(env, new_value, value);
+  if ((size_t)length > sizeof(packed_stack)) {
+    packed = malloc((size_t)length);
+    if (packed == NULL) {
+      BUGSNAG_LOG("Failed to allocate state update of %d bytes", (int)length);
+      return;
+    }
+  }
+  bool valid = length == 0 || bsg_safe_get_byte_array_region(
+                                  env, packed_, 0, length, packed);
+  size_t offset = 0;
+  const struct {
+    int field;
+    char *dest;
+    size_t size;
+  } strings[] = {
+      {BSG_STATE_CONTEXT, context, sizeof(context)},
+      {BSG_STATE_IN_FOREGROUND, activity, sizeof(activity)},
+      {BSG_STATE_ORIENTATION, orientation, sizeof(orientation)},
+      {BSG_STATE_LOW_MEMORY, memory_trim_level, sizeof(memory_trim_level)},
+  };
+  for (size_t i = 0; valid && i < sizeof(strings) / sizeof(strings[0]); i++) {
+    if ((changed & strings[i].field) &&
+        !read_packed_state_string(packed, (size_t)length, &offset,
+                                  strings[i].dest, strings[i].size)) {
+      BUGSNAG_LOG("Malformed state update");
+      valid = false;
+    }
+  }
+  if (packed != packed_stack) {
+    free(packed);
+  }
+  if (!valid) {
+    return;
+  }
+
+  if (changed & (BSG_STATE_CONTEXT | BSG_STATE_IN_FOREGROUND |
+                 BSG_STATE_IS_LAUNCHING | BSG_STATE_ORIENTATION)) {
+    bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+    if (changed & BSG_STATE_CONTEXT) {
+      bsg_strncpy(state->context, context, sizeof(state->context));
+    }
+    if (changed & BSG_STATE_IN_FOREGROUND) {
+      apply_in_foreground(state, flags & BSG_STATE_FLAG_IN_FOREGROUND,
+                          activity);
+    }
+    if (changed & BSG_STATE_IS_LAUNCHING) {
+      apply_is_launching(state, flags & BSG_STATE_FLAG_IS_LAUNCHING);
+    }
+    if (changed & BSG_STATE_ORIENTATION) {
+      bsg_strncpy(state->device.orientation, orientation,
+                  sizeof(state->device.orientation));
+    }
+    publish_state_update();
+  }
+  // low memory is recorded in the metadata, under its own lock
+  if (changed & BSG_STATE_LOW_MEMORY) {
+    update_low_memory(flags & BSG_STATE_FLAG_LOW_MEMORY, memory_trim_level);
   }
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_updateUserId(
-    JNIEnv *env, jobject _this, jstring new_value) {
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_updateOrientation(JNIEnv *env,
+                                                            jobject _this,
+                                                            jstring new_value) {
   if (bsg_global_env == NULL) {
     return;
   }
-  char *value = (char *)bsg_safe_get_string_utf_chars(env, new_value);
-  if (value == NULL) {
+
+  if (new_value == NULL) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_event *event = &bsg_global_env->next_event;
-  bugsnag_user user = bugsnag_event_get_user(event);
-  bugsnag_event_set_user(event, value, user.email, user.name);
-  release_env_write_lock();
-  if (new_value != NULL) {
-    bsg_safe_release_string_utf_chars(env, new_value, value);
-  }
+  bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+  bsg_safe_copy_string_utf(env, new_value, state->device.orientation,
+                           sizeof(state->device.orientation));
+  publish_state_update();
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_updateUserName(
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_updateUserId(
     JNIEnv *env, jobject _this, jstring new_value) {
-  if (bsg_global_env == NULL) {
+  if (bsg_global_env == NULL || new_value == NULL) {
     return;
   }
-  char *value = (char *)bsg_safe_get_string_utf_chars(env, new_value);
-  if (value == NULL) {
+  bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+  bsg_safe_copy_string_utf(env, new_value, state->user.id,
+                           sizeof(state->user.id));
+  publish_state_update();
+}
+
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_updateUserName(
+    JNIEnv *env, jobject _this, jstring new_value) {
+  if (bsg_global_env == NULL || new_value == NULL) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_event *event = &bsg_global_env->next_event;
-  bugsnag_user user = bugsnag_event_get_user(event);
-  bugsnag_event_set_user(event, user.id, user.email, value);
-  release_env_write_lock();
-  if (new_value != NULL) {
-    bsg_safe_release_string_utf_chars(env, new_value, value);
-  }
+  bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+  bsg_safe_copy_string_utf(env, new_value, state->user.name,
+                           sizeof(state->user.name));
+  publish_state_update();
 }
 
-JNIEXPORT void JNICALL
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_updateUserEmail(JNIEnv *env,
                                                           jobject _this,
                                                           jstring new_value) {
-  if (bsg_global_env == NULL) {
-    return;
-  }
-  char *value = (char *)bsg_safe_get_string_utf_chars(env, new_value);
-  if (value == NULL) {
+  if (bsg_global_env == NULL || new_value == NULL) {
     return;
   }
-  request_env_write_lock();
-  bugsnag_event *event = &bsg_global_env->next_event;
-  bugsnag_user user = bugsnag_event_get_user(event);
-  bugsnag_event_set_user(event, user.id, value, user.name);
-  release_env_write_lock();
-  if (new_value != NULL) {
-    bsg_safe_release_string_utf_chars(env, new_value, value);
-  }
+  bsg_event_state *state = begin_state_update(BSG_LOCK_SITE_APP_STATE);
+  bsg_safe_copy_string_utf(env, new_value, state->user.email,
+                           sizeof(state->user.email));
+  publish_state_update();
 }
 
-JNIEXPORT void JNICALL
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_addMetadataString(
     JNIEnv *env, jobject _this, jstring tab_, jstring key_, jstring value_) {
   if (bsg_global_env == NULL) {
     return;
   }
-  char *tab = (char *)bsg_safe_get_string_utf_chars(env, tab_);
-  char *key = (char *)bsg_safe_get_string_utf_chars(env, key_);
+  char tab[BSG_JNI_NAME_BUFFER_SIZE];
+  char key[BSG_JNI_NAME_BUFFER_SIZE];
+  if (!bsg_safe_copy_string_utf(env, tab_, tab, sizeof(tab)) ||
+      !bsg_safe_copy_string_utf(env, key_, key, sizeof(key))) {
+    return;
+  }
+  // values are unbounded, so are still copied by the runtime
   char *value = (char *)bsg_safe_get_string_utf_chars(env, value_);
-
-  if (tab != NULL && key != NULL && value != NULL) {
-    request_env_write_lock();
-    bugsnag_event_add_metadata_string(&bsg_global_env->next_event, tab, key,
-                                      value);
-    release_env_write_lock();
+  if (value == NULL) {
+    return;
   }
-  bsg_safe_release_string_utf_chars(env, tab_, tab);
-  bsg_safe_release_string_utf_chars(env, key_, key);
+  request_env_write_lock(BSG_LOCK_SITE_METADATA);
+  bugsnag_event_add_metadata_string(&bsg_global_env->next_event, tab, key,
+                                    value);
+  release_env_write_lock();
   bsg_safe_release_string_utf_chars(env, value_, value);
 }
 
-JNIEXPORT void JNICALL
+static void add_metadata_double(const char *tab, const char *key,
+                                double value) {
+  request_env_write_lock(BSG_LOCK_SITE_METADATA);
+  bugsnag_event_add_metadata_double(&bsg_global_env->next_event, tab, key,
+                                    value);
+  release_env_write_lock();
+}
+
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_addMetadataDouble(
     JNIEnv *env, jobject _this, jstring tab_, jstring key_, jdouble value_) {
   if (bsg_global_env == NULL) {
     return;
   }
-  char *tab = (char *)bsg_safe_get_string_utf_chars(env, tab_);
-  char *key = (char *)bsg_safe_get_string_utf_chars(env, key_);
-  if (tab != NULL && key != NULL) {
-    request_env_write_lock();
-    bugsnag_event_add_metadata_double(&bsg_global_env->next_event, tab, key,
-                                      (double)value_);
+  char tab[BSG_JNI_NAME_BUFFER_SIZE];
+  char key[BSG_JNI_NAME_BUFFER_SIZE];
+  if (bsg_safe_copy_string_utf(env, tab_, tab, sizeof(tab)) &&
+      bsg_safe_copy_string_utf(env, key_, key, sizeof(key))) {
+    add_metadata_double(tab, key, (double)value_);
   }
+}
+
+static void add_metadata_bool(const char *tab, const char *key, bool value) {
+  request_env_write_lock(BSG_LOCK_SITE_METADATA);
+  bugsnag_event_add_metadata_bool(&bsg_global_env->next_event, tab, key, value);
   release_env_write_lock();
-  bsg_safe_release_string_utf_chars(env, tab_, tab);
-  bsg_safe_release_string_utf_chars(env, key_, key);
 }
 
-JNIEXPORT void JNICALL
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_addMetadataBoolean(
     JNIEnv *env, jobject _this, jstring tab_, jstring key_, jboolean value_) {
   if (bsg_global_env == NULL) {
     return;
   }
-  char *tab = (char *)bsg_safe_get_string_utf_chars(env, tab_);
-  char *key = (char *)bsg_safe_get_string_utf_chars(env, key_);
-  if (tab != NULL && key != NULL) {
-    request_env_write_lock();
-    bugsnag_event_add_metadata_bool(&bsg_global_env->next_event, tab, key,
-                                    (bool)value_);
-    release_env_write_lock();
+  char tab[BSG_JNI_NAME_BUFFER_SIZE];
+  char key[BSG_JNI_NAME_BUFFER_SIZE];
+  if (bsg_safe_copy_string_utf(env, tab_, tab, sizeof(tab)) &&
+      bsg_safe_copy_string_utf(env, key_, key, sizeof(key))) {
+    add_metadata_bool(tab, key, (bool)value_);
   }
-  bsg_safe_release_string_utf_chars(env, tab_, tab);
-  bsg_safe_release_string_utf_chars(env, key_, key);
 }
 
-JNIEXPORT void JNICALL
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_clearMetadataTab(JNIEnv *env,
                                                            jobject _this,
                                                            jstring tab_) {
   if (bsg_global_env == NULL) {
     return;
   }
-  char *tab = (char *)bsg_safe_get_string_utf_chars(env, tab_);
-  if (tab == NULL) {
+  char tab[BSG_JNI_NAME_BUFFER_SIZE];
+  if (!bsg_safe_copy_string_utf(env, tab_, tab, sizeof(tab))) {
     return;
   }
-  request_env_write_lock();
+  request_env_write_lock(BSG_LOCK_SITE_METADATA);
   bugsnag_event_clear_metadata_section(&bsg_global_env->next_event, tab);
   release_env_write_lock();
-  bsg_safe_release_string_utf_chars(env, tab_, tab);
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_removeMetadata(
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_removeMetadata(
     JNIEnv *env, jobject _this, jstring tab_, jstring key_) {
   if (bsg_global_env == NULL) {
     return;
   }
-  char *tab = (char *)bsg_safe_get_string_utf_chars(env, tab_);
-  char *key = (char *)bsg_safe_get_string_utf_chars(env, key_);
-
-  if (tab != NULL && key != NULL) {
-    request_env_write_lock();
+  char tab[BSG_JNI_NAME_BUFFER_SIZE];
+  char key[BSG_JNI_NAME_BUFFER_SIZE];
+  if (bsg_safe_copy_string_utf(env, tab_, tab, sizeof(tab)) &&
+      bsg_safe_copy_string_utf(env, key_, key, sizeof(key))) {
+    request_env_write_lock(BSG_LOCK_SITE_METADATA);
     bugsnag_event_clear_metadata(&bsg_global_env->next_event, tab, key);
     release_env_write_lock();
   }
-
-  bsg_safe_release_string_utf_chars(env, tab_, tab);
-  bsg_safe_release_string_utf_chars(env, key_, key);
-}
-
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_updateMetadata(
-    JNIEnv *env, jobject _this, jobject metadata) {
-  if (bsg_global_env == NULL) {
-    return;
-  }
-
-  if (!bsg_jni_cache->initialized) {
-    BUGSNAG_LOG("updateMetadata failed: JNI cache not initialized.");
-    return;
-  }
-  request_env_write_lock();
-  bsg_populate_metadata(env, &bsg_global_env->next_event.metadata, metadata);
-  release_env_write_lock();
 }
 
 // Unwind the stack using the configured unwind style for signal handlers.
 // This function gets exposed via
-// Java_com_bugsnag_android_ndk_NativeBridge_getSignalUnwindStackFunction()
+// Java_com_bugsnag_android_ndk_NativeBridge_getSignalUnwindStackFunction(),
+// which the ANR plugin unwinds with, so it is limited to the ANR depth.
 static ssize_t
 bsg_unwind_stack_signal(bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
                         siginfo_t *info, void *user_context) __asyncsafe {
   return bsg_unwind_stack(bsg_configured_signal_unwind_style(), stacktrace,
-                          info, user_context);
+                          bsg_stack_depth_limit(BSG_CAPTURE_ANR), info,
+                          user_context);
 }
 
-JNIEXPORT jlong JNICALL
+static jlong JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_getSignalUnwindStackFunction(
     JNIEnv *env, jobject thiz) {
   return (jlong)bsg_unwind_stack_signal;
 }
 
-JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_addFeatureFlag(
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_addFeatureFlag(
     JNIEnv *env, jobject thiz, jstring name_, jstring variant_) {
 
   if (bsg_global_env == NULL) {
@@ -748,7 +1272,7 @@ JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_addFeatureFlag(
   char *variant = (char *)bsg_safe_get_string_utf_chars(env, variant_);
 
   if (name != NULL) {
-    request_env_write_lock();
+    request_env_write_lock(BSG_LOCK_SITE_FEATURE_FLAGS);
     bsg_set_feature_flag(&bsg_global_env->next_event, name, variant);
     release_env_write_lock();
   }
@@ -757,7 +1281,32 @@ JNIEXPORT void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_addFeatureFlag(
   bsg_safe_release_string_utf_chars(env, variant_, variant);
 }
 
-JNIEXPORT void JNICALL
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_addFeatureFlags(
+    JNIEnv *env, jobject thiz, jbyteArray packed_) {
+
+  if (bsg_global_env == NULL) {
+    return;
+  }
+  const jsize length = bsg_safe_get_array_length(env, packed_);
+  if (length <= 0) {
+    return;
+  }
+  jbyte *packed = malloc((size_t)length);
+  if (packed == NULL) {
+    return;
+  }
+  if (bsg_safe_get_byte_array_region(env, packed_, 0, length, packed)) {
+    request_env_write_lock(BSG_LOCK_SITE_FEATURE_FLAGS);
+    if (!bsg_set_packed_feature_flags(&bsg_global_env->next_event, packed,
+                                      (size_t)length)) {
+      BUGSNAG_LOG("Failed to set feature flag batch");
+    }
+    release_env_write_lock();
+  }
+  free(packed);
+}
+
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_clearFeatureFlag(JNIEnv *env,
                                                            jobject thiz,
                                                            jstring name_) {
@@ -769,7 +1318,7 @@ Java_com_bugsnag_android_ndk_NativeBridge_clearFeatureFlag(JNIEnv *env,
   char *name = (char *)bsg_safe_get_string_utf_chars(env, name_);
 
   if (name != NULL) {
-    request_env_write_lock();
+    request_env_write_lock(BSG_LOCK_SITE_FEATURE_FLAGS);
     bsg_clear_feature_flag(&bsg_global_env->next_event, name);
     release_env_write_lock();
   }
@@ -777,18 +1326,587 @@ Java_com_bugsnag_android_ndk_NativeBridge_clearFeatureFlag(JNIEnv *env,
   bsg_safe_release_string_utf_chars(env, name_, name);
 }
 
-JNIEXPORT void JNICALL
+static void JNICALL
 Java_com_bugsnag_android_ndk_NativeBridge_clearFeatureFlags(JNIEnv *env,
                                                             jobject thiz) {
   if (bsg_global_env == NULL) {
     return;
   }
 
-  request_env_write_lock();
+  request_env_write_lock(BSG_LOCK_SITE_FEATURE_FLAGS);
   bsg_free_feature_flags(&bsg_global_env->next_event);
   release_env_write_lock();
 }
 
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_calibrateUnwinders(JNIEnv *env,
+                                                             jobject thiz) {
+  if (bsg_global_env == NULL) {
+    return;
+  }
+  // kept beside the report directory, like the symbol cache
+  char path[sizeof(bsg_global_env->next_event_path) + 16];
+  bsg_strncpy(path, bsg_global_env->next_event_path, sizeof(path));
+  char *separator = strrchr(path, '/');
+  if (separator == NULL) {
+    return;
+  }
+  strcpy(separator, "-unwinder");
+  bsg_start_unwinder_calibration(path, bsg_global_env->next_event.app.version,
+                                 bsg_global_env->next_event.app.version_code,
+                                 &bsg_global_env->unwind_style);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_prepareUnwinders(JNIEnv *env,
+                                                           jobject thiz) {
+  if (bsg_global_env == NULL) {
+    return;
+  }
+  bsg_prepare_unwinders(bsg_global_env->signal_unwind_style,
+                        bsg_configured_unwind_style());
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setDeferredSymbolication(
+    JNIEnv *env, jobject thiz, jboolean enabled) {
+  if (bsg_global_env == NULL) {
+    return;
+  }
+  bsg_global_env->defer_symbolication = (bool)enabled;
+}
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setBreadcrumbFastPath(
+    JNIEnv *env, jobject thiz, jboolean enabled) {
+  if (bsg_global_env == NULL) {
+    return false;
+  }
+  return bsg_breadcrumb_queue_set_enabled(env, &bsg_global_env->next_event,
+                                          (bool)enabled);
+}
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setCrashDeduplication(
+    JNIEnv *env, jobject thiz, jboolean enabled) {
+  if (bsg_global_env == NULL) {
+    return false;
+  }
+  if (!enabled) {
+    bsg_crash_signatures_disable();
+    return true;
+  }
+  return bsg_crash_signatures_enable(bsg_global_env->next_event_path);
+}
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_writeLastRunJournal(
+    JNIEnv *env, jobject thiz, jstring _report_path, jstring _error_class,
+    jstring _message) {
+  const char *report_path = bsg_safe_get_string_utf_chars(env, _report_path);
+  const char *error_class = bsg_safe_get_string_utf_chars(env, _error_class);
+  const char *message = bsg_safe_get_string_utf_chars(env, _message);
+  bool result = false;
+  if (report_path != NULL && error_class != NULL && message != NULL) {
+    result =
+        bsg_state_journal_write_last_run(report_path, error_class, message);
+  }
+  bsg_safe_release_string_utf_chars(env, _report_path, report_path);
+  bsg_safe_release_string_utf_chars(env, _error_class, error_class);
+  bsg_safe_release_string_utf_chars(env, _message, message);
+  return result;
+}
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setNotifyAggregationWindow(
+    JNIEnv *env, jobject thiz, jlong window_millis) {
+  return bsg_notify_aggregator_set_window((int64_t)window_millis);
+}
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setHandledEventStore(
+    JNIEnv *env, jobject thiz, jstring _directory,
+    jstring _staging_directory) {
+  const char *directory = bsg_safe_get_string_utf_chars(env, _directory);
+  const char *staging_directory =
+      bsg_safe_get_string_utf_chars(env, _staging_directory);
+  const bool result =
+      bsg_event_store_set_directory(directory, staging_directory);
+  bsg_safe_release_string_utf_chars(env, _directory, directory);
+  bsg_safe_release_string_utf_chars(env, _staging_directory,
+                                    staging_directory);
+  return (jboolean)result;
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setThreadCaptureBudget(
+    JNIEnv *env, jobject thiz, jint max_threads, jlong max_time_millis) {
+  if (bsg_global_env == NULL) {
+    return;
+  }
+  const int capacity = bsg_global_env->next_event.thread_capacity;
+  bsg_global_env->thread_capture_max_count =
+      max_threads > 0 && max_threads < capacity ? (size_t)max_threads
+                                                : (size_t)capacity;
+  bsg_global_env->thread_capture_max_ns =
+      max_time_millis > 0 ? (uint64_t)max_time_millis * 1000000 : 0;
+}
+
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_setCrashDeadline(
+    JNIEnv *env, jobject thiz, jlong millis) {
+  if (bsg_global_env == NULL) {
+    return;
+  }
+  if (millis <= 0 || !bsg_crash_watchdog_install()) {
+    bsg_global_env->crash_deadline_ns = 0;
+    return;
+  }
+  bsg_global_env->crash_deadline_ns = (uint64_t)millis * 1000000;
+}
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setCrashHelperEnabled(
+    JNIEnv *env, jobject thiz, jboolean enabled) {
+  return (jboolean)bsg_handler_set_crash_helper((bool)enabled);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setThreadRegistryEnabled(
+    JNIEnv *env, jobject thiz, jboolean enabled) {
+  bsg_thread_registry_set_enabled((bool)enabled);
+}
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setTracingEnabled(JNIEnv *env,
+                                                            jobject thiz,
+                                                            jboolean enabled) {
+  return (jboolean)bsg_trace_set_enabled((bool)enabled);
+}
+
+static void JNICALL Java_com_bugsnag_android_ndk_NativeBridge_registerThread(
+    JNIEnv *env, jobject thiz, jint tid, jstring _name) {
+  const char *name = bsg_safe_get_string_utf_chars(env, _name);
+  if (name == NULL) {
+    return;
+  }
+  bsg_thread_registry_add((pid_t)tid, name);
+  bsg_safe_release_string_utf_chars(env, _name, name);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_unregisterThread(JNIEnv *env,
+                                                           jobject thiz,
+                                                           jint tid) {
+  bsg_thread_registry_remove((pid_t)tid);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setLockStatsEnabled(
+    JNIEnv *env, jobject thiz, jboolean enabled) {
+  bsg_lock_stats_set_enabled((bool)enabled);
+}
+
+/**
+ * The number of values in the array returned by getLockStatsData per lock site
+ */
+#define BSG_LOCK_STATS_VALUES_PER_SITE (6 + BSG_LOCK_STATS_BUCKETS * 2)
+
+static jlongArray JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_getLockStatsData(JNIEnv *env,
+                                                           jobject thiz,
+                                                           jboolean reset) {
+  bsg_lock_site_stats stats[BSG_LOCK_SITE_COUNT];
+  jlong values[1 + BSG_LOCK_SITE_COUNT * BSG_LOCK_STATS_VALUES_PER_SITE];
+  size_t index = 0;
+
+  values[index++] = (jlong)bsg_lock_stats_read(stats, (bool)reset);
+  for (int site = 0; site < BSG_LOCK_SITE_COUNT; site++) {
+    values[index++] = (jlong)stats[site].calls;
+    values[index++] = (jlong)stats[site].contended_calls;
+    values[index++] = (jlong)stats[site].total_wait_ns;
+    values[index++] = (jlong)stats[site].max_wait_ns;
+    values[index++] = (jlong)stats[site].total_hold_ns;
+    values[index++] = (jlong)stats[site].max_hold_ns;
+    for (int bucket = 0; bucket < BSG_LOCK_STATS_BUCKETS; bucket++) {
+      values[index++] = (jlong)stats[site].wait_histogram[bucket];
+    }
+    for (int bucket = 0; bucket < BSG_LOCK_STATS_BUCKETS; bucket++) {
+      values[index++] = (jlong)stats[site].hold_histogram[bucket];
+    }
+  }
+  return bsg_long_ary_from_longs(env, values, index);
+}
+
+static jlongArray JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_getHealthCountersData(
+    JNIEnv *env, jobject thiz, jboolean reset) {
+  bsg_health_counters counters;
+  jlong values[BSG_HEALTH_COUNTER_COUNT];
+  bsg_health_read(&counters, (bool)reset);
+  for (int i = 0; i < BSG_HEALTH_COUNTER_COUNT; i++) {
+    values[i] = (jlong)counters.counts[i];
+  }
+  return bsg_long_ary_from_longs(env, values, BSG_HEALTH_COUNTER_COUNT);
+}
+
+/**
+ * Copy the strings of a Java array, returning the number copied. The copies
+ * must be released with free_strings().
+ */
+static size_t copy_strings(JNIEnv *env, jobjectArray array, char ***out) {
+  *out = NULL;
+  const jsize length = bsg_safe_get_array_length(env, array);
+  if (length <= 0) {
+    return 0;
+  }
+  char **strings = calloc(length, sizeof(char *));
+  if (strings == NULL) {
+    return 0;
+  }
+  size_t count = 0;
+  for (jsize index = 0; index < length; index++) {
+    jstring jstr = bsg_safe_get_object_array_element(env, array, index);
+    const char *str = bsg_safe_get_string_utf_chars(env, jstr);
+    if (str != NULL) {
+      strings[count] = strdup(str);
+      if (strings[count] != NULL) {
+        count++;
+      }
+    }
+    bsg_safe_release_string_utf_chars(env, jstr, str);
+    bsg_safe_delete_local_ref(env, jstr);
+  }
+  *out = strings;
+  return count;
+}
+
+static void free_strings(char **strings, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    free(strings[i]);
+  }
+  free(strings);
+}
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_setEventFilters(
+    JNIEnv *env, jobject thiz, jobjectArray _error_classes,
+    jobjectArray _modules, jlong signal_mask) {
+  char **error_classes;
+  char **modules;
+  const size_t class_count = copy_strings(env, _error_classes, &error_classes);
+  const size_t module_count = copy_strings(env, _modules, &modules);
+  const bool result = bsg_event_filter_set(
+      (const char *const *)error_classes, class_count,
+      (const char *const *)modules, module_count, (uint64_t)signal_mask);
+  free_strings(error_classes, class_count);
+  free_strings(modules, module_count);
+  return (jboolean)result;
+}
+
+static jlongArray JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_prepareCrashMemoryData(
+    JNIEnv *env, jobject thiz, jboolean lock) {
+  if (bsg_global_env == NULL) {
+    return NULL;
+  }
+  bsg_crash_memory_footprint footprint[BSG_CRASH_MEMORY_REGION_COUNT];
+  jlong values[BSG_CRASH_MEMORY_REGION_COUNT * 3];
+  size_t index = 0;
+
+  bsg_prepare_crash_memory(bsg_global_env, (bool)lock, footprint);
+  for (int region = 0; region < BSG_CRASH_MEMORY_REGION_COUNT; region++) {
+    values[index++] = (jlong)footprint[region].size;
+    values[index++] = (jlong)footprint[region].page_count;
+    values[index++] = footprint[region].locked ? 1 : 0;
+  }
+  return bsg_long_ary_from_longs(env, values, index);
+}
+
+static jboolean JNICALL Java_com_bugsnag_android_ndk_NativeBridge_setStringId(
+    JNIEnv *env, jobject thiz, jint id, jstring value_) {
+  const char *value = bsg_safe_get_string_utf_chars(env, value_);
+  if (value == NULL) {
+    return false;
+  }
+  const bool registered = bsg_string_id_set((int)id, value);
+  bsg_safe_release_string_utf_chars(env, value_, value);
+  return registered;
+}
+
+/**
+ * Whether the methods of CriticalNatives were registered in JNI_OnLoad
+ */
+static bool bsg_critical_natives_registered = false;
+
+static jboolean JNICALL
+Java_com_bugsnag_android_ndk_NativeBridge_hasCriticalNatives(JNIEnv *env,
+                                                             jobject thiz) {
+  return bsg_critical_natives_registered;
+}
+
+/*
+ * The @CriticalNative methods of CriticalNatives, which the runtime calls
+ * without a JNIEnv or class. Each takes the ids of strings registered with
+ * setStringId() rather than the strings, and ignores ids which are not
+ * registered.
+ */
+
+/**
+ * Returns value unchanged, unless the runtime passed a JNIEnv and class in its
+ * place because @CriticalNative was stripped from the method
+ */
+static jint JNICALL
+Java_com_bugsnag_android_ndk_CriticalNatives_echo(jint value) {
+  return value;
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_CriticalNatives_addHandledEvent(void) {
+  count_event(false);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_CriticalNatives_addUnhandledEvent(void) {
+  count_event(true);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_CriticalNatives_updateIsLaunching(
+    jboolean new_value) {
+  update_is_launching((bool)new_value);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_CriticalNatives_updateInForeground(
+    jboolean new_value, jint activity_id) {
+  const char *activity = bsg_string_id_get((int)activity_id);
+  if (bsg_global_env == NULL || activity == NULL) {
+    return;
+  }
+  update_in_foreground((bool)new_value, activity);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_CriticalNatives_updateLowMemory(
+    jboolean low_memory, jint memory_trim_level_id) {
+  const char *memory_trim_level = bsg_string_id_get((int)memory_trim_level_id);
+  if (bsg_global_env == NULL || memory_trim_level == NULL) {
+    return;
+  }
+  update_low_memory((bool)low_memory, memory_trim_level);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_CriticalNatives_addMetadataDouble(jint tab_id,
+                                                               jint key_id,
+                                                               jdouble value) {
+  const char *tab = bsg_string_id_get((int)tab_id);
+  const char *key = bsg_string_id_get((int)key_id);
+  if (bsg_global_env == NULL || tab == NULL || key == NULL) {
+    return;
+  }
+  add_metadata_double(tab, key, (double)value);
+}
+
+static void JNICALL
+Java_com_bugsnag_android_ndk_CriticalNatives_addMetadataBoolean(
+    jint tab_id, jint key_id, jboolean value) {
+  const char *tab = bsg_string_id_get((int)tab_id);
+  const char *key = bsg_string_id_get((int)key_id);
+  if (bsg_global_env == NULL || tab == NULL || key == NULL) {
+    return;
+  }
+  add_metadata_bool(tab, key, (bool)value);
+}
+
+#define BSG_PLUGIN_METHOD(name, signature)                                     \
+  { #name, signature, (void *)Java_com_bugsnag_android_NdkPlugin_##name }
+#define BSG_BRIDGE_METHOD(name, signature)                                     \
+  {                                                                            \
+    #name, signature,                                                          \
+        (void *)Java_com_bugsnag_android_ndk_NativeBridge_##name               \
+  }
+
+#define BSG_CRITICAL_METHOD(name, signature)                                   \
+  {                                                                            \
+    #name, signature,                                                          \
+        (void *)Java_com_bugsnag_android_ndk_CriticalNatives_##name            \
+  }
+
+static const JNINativeMethod bsg_ndk_plugin_methods[] = {
+    BSG_PLUGIN_METHOD(enableCrashReporting, "()V"),
+    BSG_PLUGIN_METHOD(disableCrashReporting, "()V"),
+    BSG_PLUGIN_METHOD(getBinaryArch, "()Ljava/lang/String;"),
+};
+
+static const JNINativeMethod bsg_native_bridge_methods[] = {
+    BSG_BRIDGE_METHOD(install,
+                      "(Ljava/lang/String;Ljava/lang/String;"
+                      "Ljava/lang/String;IZIZIIZZZIIII)V"),
+    BSG_BRIDGE_METHOD(startedSession,
+                      "(Ljava/lang/String;Ljava/lang/String;II)V"),
+    BSG_BRIDGE_METHOD(deliverReportAtPath, "(Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(deliverReportsAtPaths, "([Ljava/lang/String;I)V"),
+    BSG_BRIDGE_METHOD(addBreadcrumb,
+                      "(Ljava/lang/String;Ljava/lang/String;J[B)V"),
+    BSG_BRIDGE_METHOD(addBreadcrumbs, "([B)V"),
+    BSG_BRIDGE_METHOD(addMetadataString,
+                      "(Ljava/lang/String;Ljava/lang/String;"
+                      "Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(addMetadataDouble,
+                      "(Ljava/lang/String;Ljava/lang/String;D)V"),
+    BSG_BRIDGE_METHOD(addMetadataBoolean,
+                      "(Ljava/lang/String;Ljava/lang/String;Z)V"),
+    BSG_BRIDGE_METHOD(addHandledEvent, "()V"),
+    BSG_BRIDGE_METHOD(addUnhandledEvent, "()V"),
+    BSG_BRIDGE_METHOD(clearMetadataTab, "(Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(removeMetadata,
+                      "(Ljava/lang/String;Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(pausedSession, "()V"),
+    BSG_BRIDGE_METHOD(updateContext, "(Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(updateInForeground, "(ZLjava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(updateIsLaunching, "(Z)V"),
+    BSG_BRIDGE_METHOD(updateOrientation, "(Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(updateState, "(II[B)V"),
+    BSG_BRIDGE_METHOD(updateUserId, "(Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(updateUserEmail, "(Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(updateUserName, "(Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(getSignalUnwindStackFunction, "()J"),
+    BSG_BRIDGE_METHOD(updateLowMemory, "(ZLjava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(addFeatureFlag,
+                      "(Ljava/lang/String;Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(addFeatureFlags, "([B)V"),
+    BSG_BRIDGE_METHOD(clearFeatureFlag, "(Ljava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(clearFeatureFlags, "()V"),
+    BSG_BRIDGE_METHOD(calibrateUnwinders, "()V"),
+    BSG_BRIDGE_METHOD(prepareUnwinders, "()V"),
+    BSG_BRIDGE_METHOD(setDeferredSymbolication, "(Z)V"),
+    BSG_BRIDGE_METHOD(setBreadcrumbFastPath, "(Z)Z"),
+    BSG_BRIDGE_METHOD(setCrashDeduplication, "(Z)Z"),
+    BSG_BRIDGE_METHOD(setNotifyAggregationWindow, "(J)Z"),
+    BSG_BRIDGE_METHOD(setHandledEventStore,
+                      "(Ljava/lang/String;Ljava/lang/String;)Z"),
+    BSG_BRIDGE_METHOD(writeLastRunJournal,
+                      "(Ljava/lang/String;Ljava/lang/String;"
+                      "Ljava/lang/String;)Z"),
+    BSG_BRIDGE_METHOD(setThreadCaptureBudget, "(IJ)V"),
+    BSG_BRIDGE_METHOD(setCrashDeadline, "(J)V"),
+    BSG_BRIDGE_METHOD(setCrashHelperEnabled, "(Z)Z"),
+    BSG_BRIDGE_METHOD(setThreadRegistryEnabled, "(Z)V"),
+    BSG_BRIDGE_METHOD(registerThread, "(ILjava/lang/String;)V"),
+    BSG_BRIDGE_METHOD(unregisterThread, "(I)V"),
+    BSG_BRIDGE_METHOD(setLockStatsEnabled, "(Z)V"),
+    BSG_BRIDGE_METHOD(getLockStatsData, "(Z)[J"),
+    BSG_BRIDGE_METHOD(getHealthCountersData, "(Z)[J"),
+    BSG_BRIDGE_METHOD(prepareCrashMemoryData, "(Z)[J"),
+    BSG_BRIDGE_METHOD(setStringId, "(ILjava/lang/String;)Z"),
+    BSG_BRIDGE_METHOD(hasCriticalNatives, "()Z"),
+    BSG_BRIDGE_METHOD(setTracingEnabled, "(Z)Z"),
+    BSG_BRIDGE_METHOD(setEventFilters,
+                      "([Ljava/lang/String;[Ljava/lang/String;J)Z"),
+};
+
+static const JNINativeMethod bsg_critical_methods[] = {
+    BSG_CRITICAL_METHOD(echo, "(I)I"),
+    BSG_CRITICAL_METHOD(addHandledEvent, "()V"),
+    BSG_CRITICAL_METHOD(addUnhandledEvent, "()V"),
+    BSG_CRITICAL_METHOD(updateIsLaunching, "(Z)V"),
+    BSG_CRITICAL_METHOD(updateInForeground, "(ZI)V"),
+    BSG_CRITICAL_METHOD(updateLowMemory, "(ZI)V"),
+    BSG_CRITICAL_METHOD(addMetadataDouble, "(IID)V"),
+    BSG_CRITICAL_METHOD(addMetadataBoolean, "(IIZ)V"),
+};
+
+/**
+ * The first API level, Android 8.0, which supports @CriticalNative
+ */
+#define BSG_CRITICAL_NATIVE_MIN_API_LEVEL 26
+
+/**
+ * Passed through CriticalNatives.echo(), and only returned unchanged if the
+ * runtime calls it without a JNIEnv and class
+ */
+#define BSG_CRITICAL_NATIVE_PROBE 0x42534743
+
+/**
+ * The API level of the device, before install() has been called
+ */
+static int device_api_level(void) {
+  char value[PROP_VALUE_MAX] = "";
+  __system_property_get("ro.build.version.sdk", value);
+  return atoi(value);
+}
+
+/**
+ * Register the native methods of a class, which are not exported from the
+ * library for the runtime to look up by name
+ */
+static bool register_methods(JNIEnv *env, const char *class_name,
+                             const JNINativeMethod *methods, jint count) {
+  jclass clz = bsg_safe_find_class(env, class_name);
+  if (clz == NULL) {
+    BUGSNAG_LOG("Failed to find %s", class_name);
+    return false;
+  }
+  const bool registered =
+      bsg_safe_register_natives(env, clz, methods, count);
+  if (!registered) {
+    BUGSNAG_LOG("Failed to register the native methods of %s", class_name);
+  }
+  bsg_safe_delete_local_ref(env, clz);
+  return registered;
+}
+
+/**
+ * Register the methods of CriticalNatives, and check that the runtime honours
+ * their @CriticalNative annotation. The annotation is declared by the plugin,
+ * and an app's shrinker could strip it, leaving the methods called as normal
+ * JNI methods with a JNIEnv and class in place of their arguments.
+ */
+static bool register_critical_methods(JNIEnv *env) {
+  const char *class_name = "com/bugsnag/android/ndk/CriticalNatives";
+  const jint count =
+      sizeof(bsg_critical_methods) / sizeof(bsg_critical_methods[0]);
+  if (!register_methods(env, class_name, bsg_critical_methods, count)) {
+    return false;
+  }
+  jclass clz = bsg_safe_find_class(env, class_name);
+  jmethodID echo = bsg_safe_get_static_method_id(env, clz, "echo", "(I)I");
+  const bool honoured = bsg_safe_call_static_int_method(
+                            env, clz, echo, BSG_CRITICAL_NATIVE_PROBE) ==
+                        BSG_CRITICAL_NATIVE_PROBE;
+  if (!honoured) {
+    BUGSNAG_LOG("@CriticalNative is not honoured for %s", class_name);
+    bsg_safe_unregister_natives(env, clz);
+  }
+  bsg_safe_delete_local_ref(env, clz);
+  return honoured;
+}
+
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+  JNIEnv *env;
+  if ((*vm)->GetEnv(vm, (void **)&env, JNI_VERSION_1_6) != JNI_OK) {
+    return JNI_ERR;
+  }
+  const jint plugin_count =
+      sizeof(bsg_ndk_plugin_methods) / sizeof(bsg_ndk_plugin_methods[0]);
+  const jint bridge_count =
+      sizeof(bsg_native_bridge_methods) / sizeof(bsg_native_bridge_methods[0]);
+  if (!register_methods(env, "com/bugsnag/android/NdkPlugin",
+                        bsg_ndk_plugin_methods, plugin_count) ||
+      !register_methods(env, "com/bugsnag/android/ndk/NativeBridge",
+                        bsg_native_bridge_methods, bridge_count)) {
+    return JNI_ERR;
+  }
+
+  // older runtimes ignore @CriticalNative and pass a JNIEnv and class to
+  // these methods, so they are only registered where it is honoured
+  if (device_api_level() >= BSG_CRITICAL_NATIVE_MIN_API_LEVEL) {
+    bsg_critical_natives_registered = register_critical_methods(env);
+  }
+  return JNI_VERSION_1_6;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,7 @@
 
 #include "../assets/include/bugsnag.h"
 #include "event.h"
+#include "event_state.h"
 #include "utils/logger.h"
 #include "utils/stack_unwinder.h"
 
@@ -15,6 +16,13 @@
 extern "C" {
 #endif
 
+/**
+ * The fields are grouped by who writes them, each group starting on its own
+ * cache line: the configuration set at install, which is only read afterwards,
+ * then the state written by the NativeBridge setters, then next_event which
+ * breadcrumbs and metadata are written to, and last the fields written only
+ * when a crash is handled.
+ */
 typedef struct {
   /**
    * Unwinding style used for signal-safe handling
@@ -32,48 +40,109 @@ typedef struct {
    * File path on disk where the next crash report will be written if needed.
    */
   char next_event_path[384];
+  /**
+   * Shared mapping of next_event_path, created and sized at install time so
+   * that a crash handler only needs to copy the event into place. NULL if the
+   * file could not be mapped, in which case the file is opened and written
+   * when a crash occurs.
+   */
+  void *next_event_mapping;
+  /**
+   * The size of next_event_mapping, which has room for the threads reserved
+   * in next_event
+   */
+  size_t next_event_mapping_size;
+  /**
+   * Open descriptor for next_event_path, only valid while next_event_mapping
+   * is set
+   */
+  int next_event_fd;
   /**
    * File path on disk where the last run info will be written if needed.
    */
   char last_run_info_path[384];
   /**
-   * The next value to be written to last run info if a crash occurs
+   * Open descriptor for last_run_info_path, so that a crash handler rewrites
+   * the file in place rather than looking up and creating it. Only valid while
+   * last_run_info_open is set.
    */
-  char next_last_run_info[256];
+  int last_run_info_fd;
+  bool last_run_info_open;
   /**
    * The value of consecutiveLaunchCrashes, used when a crash occurs
    */
   int consecutive_launch_crashes;
-  /**
-   * Cache of static metadata and event info. Exception/time information is
-   * populated at crash time.
-   */
-  bugsnag_event next_event;
   /**
    * Time when installed
    */
   time_t start_time;
+
+  bsg_on_error on_error;
+
   /**
-   * Time when last re-entering foreground
+   * Controls whether we should capture and serialize the state of all threads
+   * at the time of an error.
+   */
+  bsg_thread_send_policy send_threads;
+  /**
+   * Open descriptor for /proc/self/task, so that thread states are read
+   * without looking up the directory at crash time. -1 if it is unavailable.
+   */
+  int task_dir_fd;
+  /**
+   * The most threads captured in a crash handler, at most the threads reserved
+   * in next_event
+   */
+  size_t thread_capture_max_count;
+  /**
+   * How long a crash handler spends capturing threads before the list is
+   * marked as truncated, or 0 for no limit
+   */
+  uint64_t thread_capture_max_ns;
+  /**
+   * How long the signal handler has to write a report, measured from when it
+   * is entered, or 0 for no limit. Stages which overrun their share are
+   * abandoned for cheaper fallbacks, see bsg_handler_fallback.
+   */
+  uint64_t crash_deadline_ns;
+
+  /**
+   * Whether crash handlers leave symbolicating the stacktrace until the event
+   * is delivered, recording only the frame addresses and their modules
    */
-  time_t foreground_start_time;
+  bool defer_symbolication;
+  /**
+   * Whether next_event has been populated from the Java layer. An install
+   * which populates it in the background arms the crash handlers first, and
+   * events captured before it completes are marked with
+   * BSG_HANDLER_FALLBACK_STATE_PENDING.
+   */
+  bool state_populated;
+
+  /**
+   * The parts of next_event which change most often. These are updated here
+   * rather than in next_event, and copied into it at crash time.
+   */
+  bsg_event_state_buffer event_state __bsg_cache_aligned;
+  /**
+   * Cache of static metadata and event info. Exception/time information is
+   * populated at crash time.
+   */
+  bugsnag_event next_event __bsg_cache_aligned;
+
   /**
    * true if a crash is currently being handled. Disallows multiple crashes
    * from being processed simultaneously
    */
-  bool handling_crash;
+  bool handling_crash __bsg_cache_aligned;
   /**
    * true if a handler has completed crash handling
    */
   bool crash_handled;
-
-  bsg_on_error on_error;
-
   /**
-   * Controls whether we should capture and serialize the state of all threads
-   * at the time of an error.
+   * The next value to be written to last run info if a crash occurs
    */
-  bsg_thread_send_policy send_threads;
+  char next_last_run_info[256];
 } bsg_environment;
 
 /**
@@ -82,6 +151,12 @@ typedef struct {
  */
 bsg_unwinder bsg_configured_unwind_style();
 
+/**
+ * Get the configured unwind style for async-safe environments such as signal
+ * handlers.
+ */
+bsg_unwinder bsg_configured_signal_unwind_style();
+
 /**
  * Invokes the user-supplied on_error callback, if it has been set. This allows
  * users to mutate the bugsnag_event payload before it is persisted to disk, and
@@ -92,6 +167,43 @@ bsg_unwinder bsg_configured_unwind_style();
  */
 bool bsg_run_on_error();
 
+/**
+ * Copy the next event, along with the current app, device, user and context,
+ * so that it can be filled in as a handled error without holding the lock on
+ * the environment. The copy has no threads, and its breadcrumbs are those
+ * which were complete when it was taken. Returns NULL if the copy could not
+ * be allocated. It must be released with bsg_free_event_copy().
+ */
+bugsnag_event *bsg_copy_next_event(void);
+
+void bsg_free_event_copy(bugsnag_event *event);
+
+/**
+ * Report a handled error through the JVM with a stacktrace which has already
+ * been unwound and symbolicated, as bugsnag_notify_env() does once it has
+ * unwound the calling thread
+ */
+void bsg_notify_stacktrace(JNIEnv *env, const char *name, const char *message,
+                           bugsnag_severity severity,
+                           bugsnag_stackframe *stacktrace,
+                           ssize_t frame_count);
+
+/**
+ * Stop caching the Java strings of native frames while memory is low, so that
+ * the cache is released by the next error reported and refilled once memory
+ * recovers
+ */
+void bsg_notify_set_low_memory(bool low_memory);
+
+/**
+ * Report a handled error as bsg_notify_stacktrace() does, along with the
+ * number of times it occurred after the first within an aggregation window
+ */
+void bsg_notify_aggregated(JNIEnv *env, const char *name, const char *message,
+                           bugsnag_severity severity,
+                           bugsnag_stackframe *stacktrace, ssize_t frame_count,
+                           int occurrences, int64_t window_ms);
+
 #ifdef __cplusplus
 }
 #endif
@@ -35,6 +35,14 @@
 #include <math.h>
 #include <errno.h>
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PARSON_SCAN_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PARSON_SCAN_SSE2
+#endif
+
 /* Apparently sscanf is not implemented in some "standard" libraries, so don't use it, if you
  * don't have to. */
 #define sscanf THINK_TWICE_ABOUT_USING_SSCANF
@@ -61,6 +69,7 @@
 
 static JSON_Malloc_Function parson_malloc = malloc;
 static JSON_Free_Function parson_free = free;
+static JSON_Number_Serialization_Function parson_number_serialization_function = NULL;
 
 #define IS_CONT(b) (((unsigned char)(b) & 0xC0) == 0x80) /* is utf-8 continuation byte */
 
@@ -145,6 +154,20 @@ static int    json_serialize_string(const char *string, char *buf);
 static int    append_indent(char *buf, int level);
 static int    append_string(char *buf, const char *string);
 
+/* Growable output buffer, written in a single pass over the tree */
+typedef struct json_out_buffer_t {
+    char  *data;
+    size_t length;
+    size_t capacity;
+    int    use_heap; /* grown with realloc, rather than parson_malloc */
+} JSON_Out_Buffer;
+
+static int    out_buffer_reserve(JSON_Out_Buffer *out, size_t extra);
+static int    out_buffer_append(JSON_Out_Buffer *out, const char *string, size_t len);
+static int    json_serialize_to_out_buffer_r(const JSON_Value *value, JSON_Out_Buffer *out, int level, int is_pretty);
+static int    json_serialize_string_to_out_buffer(const char *string, JSON_Out_Buffer *out);
+static char * json_serialize_single_pass(const JSON_Value *value, int is_pretty);
+
 /* Various */
 static char * parson_strndup(const char *string, size_t n) {
     char *output_string = (char*)parson_malloc(n + 1);
@@ -989,7 +1012,11 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
             if (buf != NULL) {
                 num_buf = buf;
             }
-            written = sprintf(num_buf, FLOAT_FORMAT, num);
+            if (parson_number_serialization_function != NULL) {
+                written = parson_number_serialization_function(num, buf);
+            } else {
+                written = sprintf(num_buf, FLOAT_FORMAT, num);
+            }
             if (written < 0) {
                 return -1;
             }
@@ -1088,6 +1115,263 @@ static int append_string(char *buf, const char *string) {
 #undef APPEND_STRING
 #undef APPEND_INDENT
 
+/* Escaping scan */
+static int needs_escape(unsigned char c) {
+    return c < 0x20 || c == '\"' || c == '\\' || c == '/';
+}
+
+size_t json_string_unescaped_length(const char *string, size_t len) {
+    size_t i = 0;
+#if defined(PARSON_SCAN_SSE2)
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i control_max = _mm_set1_epi8(0x1f);
+    __m128i chunk, escapes;
+    int mask = 0;
+    for (; i + 16 <= len; i += 16) {
+        chunk = _mm_loadu_si128((const __m128i *)(string + i));
+        /* a byte is a control character when the unsigned min with 0x1f leaves it unchanged */
+        escapes = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, slash),
+                         _mm_cmpeq_epi8(_mm_min_epu8(chunk, control_max), chunk)));
+        mask = _mm_movemask_epi8(escapes);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+#elif defined(PARSON_SCAN_NEON)
+    const uint8x16_t quote = vdupq_n_u8('\"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t slash = vdupq_n_u8('/');
+    const uint8x16_t space = vdupq_n_u8(0x20);
+    uint8x16_t chunk, escapes;
+    uint64_t mask = 0;
+    for (; i + 16 <= len; i += 16) {
+        chunk = vld1q_u8((const uint8_t *)string + i);
+        escapes = vorrq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)),
+                           vorrq_u8(vceqq_u8(chunk, slash), vcltq_u8(chunk, space)));
+        /* narrow each byte to a nibble, so the 16 results fit in 64 bits */
+        mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(escapes), 4)), 0);
+        if (mask != 0) {
+            return i + (size_t)(__builtin_ctzll(mask) >> 2);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (needs_escape((unsigned char)string[i])) {
+            return i;
+        }
+    }
+    return len;
+}
+
+/* Single pass serialization */
+#define OUT_BUFFER_MIN_CAPACITY 256
+
+static int out_buffer_reserve(JSON_Out_Buffer *out, size_t extra) {
+    size_t needed = out->length + extra + 1; /* room for the terminator */
+    size_t new_capacity = 0;
+    char *new_data = NULL;
+    if (needed <= out->capacity) {
+        return 0;
+    }
+    new_capacity = MAX(MAX(out->capacity * 2, needed), OUT_BUFFER_MIN_CAPACITY);
+    if (out->use_heap) {
+        new_data = (char*)realloc(out->data, new_capacity);
+    } else {
+        new_data = (char*)parson_malloc(new_capacity);
+        if (new_data != NULL && out->data != NULL) {
+            memcpy(new_data, out->data, out->length);
+            parson_free(out->data);
+        }
+    }
+    if (new_data == NULL) {
+        return -1;
+    }
+    out->data = new_data;
+    out->capacity = new_capacity;
+    return 0;
+}
+
+static int out_buffer_append(JSON_Out_Buffer *out, const char *string, size_t len) {
+    if (out_buffer_reserve(out, len) < 0) {
+        return -1;
+    }
+    memcpy(out->data + out->length, string, len);
+    out->length += len;
+    return 0;
+}
+
+#define OUT_APPEND(str) do { if (out_buffer_append(out, (str), SIZEOF_TOKEN(str)) < 0) { return -1; } } while(0)
+
+static int json_serialize_to_out_buffer_r(const JSON_Value *value, JSON_Out_Buffer *out, int level, int is_pretty)
+{
+    const char *key = NULL, *string = NULL;
+    JSON_Array *array = NULL;
+    JSON_Object *object = NULL;
+    size_t i = 0, count = 0;
+    int j = 0, written = -1;
+
+    switch (json_value_get_type(value)) {
+        case JSONArray:
+            array = json_value_get_array(value);
+            count = json_array_get_count(array);
+            OUT_APPEND("[");
+            if (count > 0 && is_pretty) {
+                OUT_APPEND("\n");
+            }
+            for (i = 0; i < count; i++) {
+                for (j = 0; is_pretty && j < level + 1; j++) {
+                    OUT_APPEND("    ");
+                }
+                if (json_serialize_to_out_buffer_r(json_array_get_value(array, i), out, level+1, is_pretty) < 0) {
+                    return -1;
+                }
+                if (i < (count - 1)) {
+                    OUT_APPEND(",");
+                }
+                if (is_pretty) {
+                    OUT_APPEND("\n");
+                }
+            }
+            for (j = 0; count > 0 && is_pretty && j < level; j++) {
+                OUT_APPEND("    ");
+            }
+            OUT_APPEND("]");
+            return 0;
+        case JSONObject:
+            object = json_value_get_object(value);
+            count  = json_object_get_count(object);
+            OUT_APPEND("{");
+            if (count > 0 && is_pretty) {
+                OUT_APPEND("\n");
+            }
+            for (i = 0; i < count; i++) {
+                key = json_object_get_name(object, i);
+                if (key == NULL) {
+                    return -1;
+                }
+                for (j = 0; is_pretty && j < level + 1; j++) {
+                    OUT_APPEND("    ");
+                }
+                if (json_serialize_string_to_out_buffer(key, out) < 0) {
+                    return -1;
+                }
+                OUT_APPEND(":");
+                if (is_pretty) {
+                    OUT_APPEND(" ");
+                }
+                /* values are in the same order as the names */
+                if (json_serialize_to_out_buffer_r(object->values[i], out, level+1, is_pretty) < 0) {
+                    return -1;
+                }
+                if (i < (count - 1)) {
+                    OUT_APPEND(",");
+                }
+                if (is_pretty) {
+                    OUT_APPEND("\n");
+                }
+            }
+            for (j = 0; count > 0 && is_pretty && j < level; j++) {
+                OUT_APPEND("    ");
+            }
+            OUT_APPEND("}");
+            return 0;
+        case JSONString:
+            string = json_value_get_string(value);
+            if (string == NULL) {
+                return -1;
+            }
+            return json_serialize_string_to_out_buffer(string, out);
+        case JSONBoolean:
+            if (json_value_get_boolean(value)) {
+                OUT_APPEND("true");
+            } else {
+                OUT_APPEND("false");
+            }
+            return 0;
+        case JSONNumber:
+            if (out_buffer_reserve(out, NUM_BUF_SIZE) < 0) {
+                return -1;
+            }
+            if (parson_number_serialization_function != NULL) {
+                written = parson_number_serialization_function(json_value_get_number(value), out->data + out->length);
+            } else {
+                written = sprintf(out->data + out->length, FLOAT_FORMAT, json_value_get_number(value));
+            }
+            if (written < 0) {
+                return -1;
+            }
+            out->length += (size_t)written;
+            return 0;
+        case JSONNull:
+            OUT_APPEND("null");
+            return 0;
+        case JSONError:
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+static int json_serialize_string_to_out_buffer(const char *string, JSON_Out_Buffer *out) {
+    static const char hex[] = "0123456789abcdef";
+    size_t len = strlen(string), pos = 0, run = 0;
+    char escape[6] = { '\\', 'u', '0', '0', '0', '0' };
+    size_t escape_len = 0;
+    unsigned char c = '\0';
+    OUT_APPEND("\"");
+    while (pos < len) {
+        /* copy the run of characters which need no escaping in one go */
+        run = json_string_unescaped_length(string + pos, len - pos);
+        if (run > 0 && out_buffer_append(out, string + pos, run) < 0) {
+            return -1;
+        }
+        pos += run;
+        if (pos == len) {
+            break;
+        }
+        c = (unsigned char)string[pos++];
+        escape_len = 2;
+        switch (c) {
+            case '\"': escape[1] = '\"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '/':  escape[1] = '/'; break; /* to make json embeddable in xml\/html */
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                escape[1] = 'u';
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 0xf];
+                escape_len = 6;
+                break;
+        }
+        if (out_buffer_append(out, escape, escape_len) < 0) {
+            return -1;
+        }
+    }
+    OUT_APPEND("\"");
+    return 0;
+}
+
+#undef OUT_APPEND
+
+static char * json_serialize_single_pass(const JSON_Value *value, int is_pretty) {
+    JSON_Out_Buffer out = { NULL, 0, 0, 0 };
+    if (json_serialize_to_out_buffer_r(value, &out, 0, is_pretty) < 0 ||
+        out_buffer_reserve(&out, 0) < 0) {
+        parson_free(out.data);
+        return NULL;
+    }
+    out.data[out.length] = '\0';
+    return out.data;
+}
+
 /* Parser API */
 JSON_Value * json_parse_file(const char *filename) {
     char *file_contents = read_file(filename);
@@ -1525,22 +1809,23 @@ JSON_Status json_serialize_to_file(const JSON_Value *value, const char *filename
 }
 
 char * json_serialize_to_string(const JSON_Value *value) {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
+    return json_serialize_single_pass(value, 0);
+}
+
+char * json_serialize_into_buffer(const JSON_Value *value, char *buf, size_t *buf_size_in_bytes) {
+    JSON_Out_Buffer out;
+    out.data = buf;
+    out.length = 0;
+    out.capacity = buf == NULL ? 0 : *buf_size_in_bytes;
+    out.use_heap = 1;
+    if (json_serialize_to_out_buffer_r(value, &out, 0, 0) < 0 ||
+        out_buffer_reserve(&out, 0) < 0) {
+        free(out.data);
         return NULL;
     }
-    buf = (char*)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
-    }
-    serialization_result = json_serialize_to_buffer(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
-        return NULL;
-    }
-    return buf;
+    out.data[out.length] = '\0';
+    *buf_size_in_bytes = out.capacity;
+    return out.data;
 }
 
 size_t json_serialization_size_pretty(const JSON_Value *value) {
@@ -1585,22 +1870,7 @@ JSON_Status json_serialize_to_file_pretty(const JSON_Value *value, const char *f
 }
 
 char * json_serialize_to_string_pretty(const JSON_Value *value) {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size_pretty(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
-        return NULL;
-    }
-    buf = (char*)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
-    }
-    serialization_result = json_serialize_to_buffer_pretty(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
-        return NULL;
-    }
-    return buf;
+    return json_serialize_single_pass(value, 1);
 }
 
 void json_free_serialized_string(char *string) {
@@ -2044,3 +2314,7 @@ void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Fu
     parson_malloc = malloc_fun;
     parson_free = free_fun;
 }
+
+void json_set_number_serialization_function(JSON_Number_Serialization_Function fun) {
+    parson_number_serialization_function = fun;
+}
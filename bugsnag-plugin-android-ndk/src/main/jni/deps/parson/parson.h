@@ -56,10 +56,17 @@ typedef int JSON_Status;
 typedef void * (*JSON_Malloc_Function)(size_t);
 typedef void   (*JSON_Free_Function)(void *);
 
+/* A function which writes num into buf and returns the number of characters written, excluding the
+   terminator. buf is NULL when only the length is needed, and otherwise has room for 64 bytes. */
+typedef int (*JSON_Number_Serialization_Function)(double num, char *buf);
+
 /* Call only once, before calling any other function from parson API. If not called, malloc and free
    from stdlib will be used for all allocations */
 void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun);
 
+/* Sets the function used to serialize numbers, or NULL to use sprintf with "%1.17g" */
+void json_set_number_serialization_function(JSON_Number_Serialization_Function fun);
+
 /* Parses first JSON value in a file, returns NULL in case of error */
 JSON_Value * json_parse_file(const char *filename);
 
@@ -75,10 +82,17 @@ JSON_Value * json_parse_string(const char *string);
 JSON_Value * json_parse_string_with_comments(const char *string);
 
 /* Serialization */
+/* Returns the length of the prefix of string (of len bytes) which needs no escaping when
+   serialized, scanning 16 bytes at a time where SSE2 or NEON is available */
+size_t      json_string_unescaped_length(const char *string, size_t len);
 size_t      json_serialization_size(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
 JSON_Status json_serialize_to_file(const JSON_Value *value, const char *filename);
 char *      json_serialize_to_string(const JSON_Value *value);
+/* Serializes into buf, a buffer of *buf_size_in_bytes bytes from malloc (or NULL), in a single pass,
+   growing it with realloc as needed. Returns the buffer, to be freed with free, and updates
+   *buf_size_in_bytes to its capacity. On failure buf is freed and NULL returned. */
+char *      json_serialize_into_buffer(const JSON_Value *value, char *buf, size_t *buf_size_in_bytes);
 
 /* Pretty serialization */
 size_t      json_serialization_size_pretty(const JSON_Value *value); /* returns 0 on fail */
@@ -1,7 +1,186 @@
 #include "event.h"
+#include "utils/health_counters.h"
 #include "utils/string.h"
+#include <sched.h>
+#include <stdlib.h>
 #include <string.h>
 
+const char *bsg_metadata_value_section(const bugsnag_metadata *metadata,
+                                       const bsg_metadata_value *value) {
+  return value->section < metadata->names_length
+             ? &metadata->names[value->section]
+             : "";
+}
+
+const char *bsg_metadata_value_name(const bugsnag_metadata *metadata,
+                                    const bsg_metadata_value *value) {
+  return value->name < metadata->names_length ? &metadata->names[value->name]
+                                              : "";
+}
+
+/**
+ * Find or add a name to a block of '\0' terminated names, storing its offset.
+ * Returns false if it is absent and there is no room to add it.
+ */
+static bool intern_name(char *names, uint16_t *names_length, const char *name,
+                        uint16_t *offset) {
+  const size_t length = strnlen(name, BSG_METADATA_NAME_MAX);
+  if (length == 0) {
+    *offset = 0;
+    return true;
+  }
+
+  // offset 0 is reserved for the empty name
+  size_t pos = 1;
+  while (pos < *names_length) {
+    const size_t stored_length = strlen(&names[pos]);
+    if (stored_length == length && memcmp(&names[pos], name, length) == 0) {
+      *offset = (uint16_t)pos;
+      return true;
+    }
+    pos += stored_length + 1;
+  }
+
+  if (pos + length + 1 > BUGSNAG_METADATA_NAMES_SIZE) {
+    return false;
+  }
+  names[0] = '\0';
+  memcpy(&names[pos], name, length);
+  names[pos + length] = '\0';
+  *names_length = (uint16_t)(pos + length + 1);
+  *offset = (uint16_t)pos;
+  return true;
+}
+
+/**
+ * Drop any names which are no longer referenced by a value, such as those of
+ * values which have been cleared
+ */
+static void compact_metadata_names(bugsnag_metadata *metadata) {
+  char names[BUGSNAG_METADATA_NAMES_SIZE];
+  uint16_t names_length = 0;
+  for (int i = 0; i < metadata->value_count; i++) {
+    bsg_metadata_value *value = &metadata->values[i];
+    if (value->type == BSG_METADATA_NONE_VALUE) {
+      value->section = 0;
+      value->name = 0;
+      continue;
+    }
+    // the names in use already fit, so they always fit once compacted
+    intern_name(names, &names_length,
+                bsg_metadata_value_section(metadata, value), &value->section);
+    intern_name(names, &names_length, bsg_metadata_value_name(metadata, value),
+                &value->name);
+  }
+  memcpy(metadata->names, names, names_length);
+  metadata->names_length = names_length;
+}
+
+static bool intern_metadata_names(bugsnag_metadata *metadata,
+                                  const char *section, const char *name,
+                                  bsg_metadata_value *value) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (intern_name(metadata->names, &metadata->names_length, section,
+                    &value->section) &&
+        intern_name(metadata->names, &metadata->names_length, name,
+                    &value->name)) {
+      return true;
+    }
+    compact_metadata_names(metadata);
+  }
+  return false;
+}
+
+/**
+ * Compare a stored section or name with a key, as it would be once truncated
+ * to BSG_METADATA_NAME_MAX
+ */
+static bool metadata_key_equals(const char *stored, const char *key) {
+  return strncmp(stored, key, BSG_METADATA_NAME_MAX) == 0;
+}
+
+static uint32_t metadata_key_hash(const char *section, const char *name) {
+  // FNV-1a over the section and name, truncated to BSG_METADATA_NAME_MAX
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < BSG_METADATA_NAME_MAX && section[i] != '\0'; i++) {
+    hash = (hash ^ (uint8_t)section[i]) * 16777619u;
+  }
+  hash = (hash ^ 0xff) * 16777619u;
+  for (size_t i = 0; i < BSG_METADATA_NAME_MAX && name[i] != '\0'; i++) {
+    hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static uint32_t metadata_value_hash(const bugsnag_metadata *metadata,
+                                    const bsg_metadata_value *value) {
+  return metadata_key_hash(bsg_metadata_value_section(metadata, value),
+                           bsg_metadata_value_name(metadata, value));
+}
+
+/**
+ * Find the index slot which refers to the value with the given section and
+ * name, or the empty slot where it would be inserted
+ */
+static size_t metadata_index_probe(const bugsnag_metadata *metadata,
+                                   const bsg_metadata_index *index,
+                                   const char *section, const char *name) {
+  size_t slot = metadata_key_hash(section, name) % BSG_METADATA_INDEX_SIZE;
+  // the index is never more than half full, so an empty slot is always found
+  while (index->slots[slot] != 0) {
+    const bsg_metadata_value *value = &metadata->values[index->slots[slot] - 1];
+    if (metadata_key_equals(bsg_metadata_value_section(metadata, value),
+                            section) &&
+        metadata_key_equals(bsg_metadata_value_name(metadata, value), name)) {
+      break;
+    }
+    slot = (slot + 1) % BSG_METADATA_INDEX_SIZE;
+  }
+  return slot;
+}
+
+static int metadata_index_find(const bugsnag_metadata *metadata,
+                               const bsg_metadata_index *index,
+                               const char *section, const char *name) {
+  size_t slot = metadata_index_probe(metadata, index, section, name);
+  return (int)index->slots[slot] - 1;
+}
+
+/**
+ * Empty an index slot, shifting back any later entries in the same probe
+ * sequence so that lookups never need to skip over removed entries
+ */
+static void metadata_index_remove_slot(const bugsnag_metadata *metadata,
+                                       bsg_metadata_index *index,
+                                       size_t hole) {
+  size_t slot = (hole + 1) % BSG_METADATA_INDEX_SIZE;
+  while (index->slots[slot] != 0) {
+    const bsg_metadata_value *value = &metadata->values[index->slots[slot] - 1];
+    size_t home =
+        metadata_value_hash(metadata, value) % BSG_METADATA_INDEX_SIZE;
+    // the entry may fill the hole unless its home lies in (hole, slot]
+    bool reachable = hole <= slot ? (home > hole && home <= slot)
+                                  : (home > hole || home <= slot);
+    if (!reachable) {
+      index->slots[hole] = index->slots[slot];
+      hole = slot;
+    }
+    slot = (slot + 1) % BSG_METADATA_INDEX_SIZE;
+  }
+  index->slots[hole] = 0;
+}
+
+static void metadata_index_remove(const bugsnag_metadata *metadata,
+                                  bsg_metadata_index *index, int position) {
+  const bsg_metadata_value *value = &metadata->values[position];
+  size_t slot = metadata_index_probe(
+      metadata, index, bsg_metadata_value_section(metadata, value),
+      bsg_metadata_value_name(metadata, value));
+  if (index->slots[slot] == position + 1) {
+    metadata_index_remove_slot(metadata, index, slot);
+  }
+}
+
 static int find_next_free_metadata_index(bugsnag_metadata *const metadata) {
   if (metadata->value_count < BUGSNAG_METADATA_MAX) {
     return metadata->value_count;
@@ -16,109 +195,421 @@ static int find_next_free_metadata_index(bugsnag_metadata *const metadata) {
 }
 
 static int allocate_metadata_index(bugsnag_metadata *metadata,
+                                   bsg_metadata_index *index,
                                    const char *section, const char *name) {
-  int index = find_next_free_metadata_index(metadata);
-  if (index < 0) {
-    return index;
-  }
-  bsg_strncpy(metadata->values[index].section, section,
-              sizeof(metadata->values[index].section));
-  bsg_strncpy(metadata->values[index].name, name,
-              sizeof(metadata->values[index].name));
+  size_t slot = 0;
+  if (index != NULL) {
+    slot = metadata_index_probe(metadata, index, section, name);
+    if (index->slots[slot] != 0) {
+      // replace the existing value
+      return index->slots[slot] - 1;
+    }
+  }
+  int position = find_next_free_metadata_index(metadata);
+  if (position < 0) {
+    return position;
+  }
+  if (!intern_metadata_names(metadata, section, name,
+                             &metadata->values[position])) {
+    return -1;
+  }
   if (metadata->value_count < BUGSNAG_METADATA_MAX) {
-    metadata->value_count = index + 1;
+    metadata->value_count = position + 1;
   }
-  return index;
+  if (index != NULL) {
+    index->slots[slot] = (uint16_t)(position + 1);
+  }
+  return position;
 }
 
-void bsg_add_metadata_value_double(bugsnag_metadata *metadata,
+void bsg_event_layout_init(bsg_event_layout *layout) {
+  layout->metadata_max = BUGSNAG_METADATA_MAX;
+  layout->crumbs_max = BUGSNAG_CRUMBS_MAX;
+  layout->threads_max = BUGSNAG_THREADS_MAX;
+  layout->frames_max = BUGSNAG_FRAMES_MAX;
+}
+
+bool bsg_add_metadata_value_double(bugsnag_metadata *metadata,
+                                   bsg_metadata_index *index,
                                    const char *section, const char *name,
                                    double value) {
-  int index = allocate_metadata_index(metadata, section, name);
-  if (index >= 0) {
-    metadata->values[index].type = BSG_METADATA_NUMBER_VALUE;
-    metadata->values[index].double_value = value;
+  int position = allocate_metadata_index(metadata, index, section, name);
+  if (position >= 0) {
+    metadata->values[position].type = BSG_METADATA_NUMBER_VALUE;
+    metadata->values[position].double_value = value;
   }
+  return position >= 0;
 }
 
-void bsg_add_metadata_value_str(bugsnag_metadata *metadata, const char *section,
+bool bsg_add_metadata_value_str(bugsnag_metadata *metadata,
+                                bsg_metadata_index *index, const char *section,
                                 const char *name, const char *value) {
-  int index = allocate_metadata_index(metadata, section, name);
-  if (index >= 0) {
-    metadata->values[index].type = BSG_METADATA_CHAR_VALUE;
-    bsg_strncpy(metadata->values[index].char_value, value,
-                sizeof(metadata->values[index].char_value));
+  int position = allocate_metadata_index(metadata, index, section, name);
+  if (position >= 0) {
+    metadata->values[position].type = BSG_METADATA_CHAR_VALUE;
+    bsg_strncpy(metadata->values[position].char_value, value,
+                sizeof(metadata->values[position].char_value));
   }
+  return position >= 0;
 }
 
-void bsg_add_metadata_value_bool(bugsnag_metadata *metadata,
+bool bsg_add_metadata_value_bool(bugsnag_metadata *metadata,
+                                 bsg_metadata_index *index,
                                  const char *section, const char *name,
                                  bool value) {
-  int index = allocate_metadata_index(metadata, section, name);
-  if (index >= 0) {
-    metadata->values[index].type = BSG_METADATA_BOOL_VALUE;
-    metadata->values[index].bool_value = value;
+  int position = allocate_metadata_index(metadata, index, section, name);
+  if (position >= 0) {
+    metadata->values[position].type = BSG_METADATA_BOOL_VALUE;
+    metadata->values[position].bool_value = value;
   }
+  return position >= 0;
+}
+
+void bsg_event_index_metadata(bugsnag_event *event) {
+  bugsnag_metadata *metadata = &event->metadata;
+  bsg_metadata_index *index = &event->metadata_index;
+  memset(index, 0, sizeof(bsg_metadata_index));
+  if (metadata->value_count > BUGSNAG_METADATA_MAX) {
+    metadata->value_count = BUGSNAG_METADATA_MAX;
+  }
+  for (int i = 0; i < metadata->value_count; i++) {
+    const bsg_metadata_value *value = &metadata->values[i];
+    if (value->type == BSG_METADATA_NONE_VALUE) {
+      continue;
+    }
+    size_t slot = metadata_index_probe(
+        metadata, index, bsg_metadata_value_section(metadata, value),
+        bsg_metadata_value_name(metadata, value));
+    index->slots[slot] = (uint16_t)(i + 1);
+  }
+}
+
+/**
+ * The header of each record in a bsg_metadata_arena. It is followed by the
+ * '\0' terminated section and name, then value_length bytes of value. String
+ * values include their terminator.
+ */
+typedef struct {
+  uint8_t type;
+  uint8_t section_length;
+  uint8_t name_length;
+  uint8_t reserved;
+  uint32_t value_length;
+} bsg_metadata_record;
+
+bool bsg_metadata_arena_reserve(bsg_metadata_arena *arena, uint32_t capacity) {
+  arena->data = calloc(1, capacity);
+  arena->capacity = arena->data != NULL ? capacity : 0;
+  arena->length = 0;
+  return arena->data != NULL;
+}
+
+void bsg_metadata_arena_free(bsg_metadata_arena *arena) {
+  free(arena->data);
+  arena->data = NULL;
+  arena->capacity = 0;
+  arena->length = 0;
+}
+
+bugsnag_event *bsg_event_alloc(void) {
+  void *event = NULL;
+  const size_t size = sizeof(bugsnag_event);
+  if (posix_memalign(&event, BSG_CACHE_LINE_SIZE, size) != 0) {
+    return NULL;
+  }
+  return event;
+}
+
+bool bsg_event_reserve_threads(bugsnag_event *event, int capacity) {
+  bsg_event_free_threads(event);
+  if (capacity <= 0) {
+    return capacity == 0;
+  }
+  event->threads = calloc((size_t)capacity, sizeof(bsg_thread));
+  event->thread_capacity = event->threads != NULL ? capacity : 0;
+  return event->threads != NULL;
+}
+
+void bsg_event_free_threads(bugsnag_event *event) {
+  free(event->threads);
+  event->threads = NULL;
+  event->thread_capacity = 0;
+  event->thread_count = 0;
+}
+
+static bool metadata_record_value_is_valid(const bsg_metadata_record *record,
+                                           const char *value) {
+  switch (record->type) {
+  case BSG_METADATA_BOOL_VALUE:
+    return record->value_length == sizeof(bool);
+  case BSG_METADATA_NUMBER_VALUE:
+    return record->value_length == sizeof(double);
+  case BSG_METADATA_CHAR_VALUE:
+    return record->value_length > 0 && value[record->value_length - 1] == '\0';
+  default:
+    return false;
+  }
+}
+
+bool bsg_metadata_arena_next(const bsg_metadata_arena *arena, uint32_t *offset,
+                             bsg_metadata_arena_value *value) {
+  const uint32_t length =
+      arena->length < arena->capacity ? arena->length : arena->capacity;
+  bsg_metadata_record record;
+  if (arena->data == NULL || *offset >= length ||
+      length - *offset < sizeof(record)) {
+    return false;
+  }
+  // records are packed, so the header may not be aligned
+  memcpy(&record, &arena->data[*offset], sizeof(record));
+  const char *section = &arena->data[*offset + sizeof(record)];
+  const char *name = section + record.section_length + 1;
+  const char *data = name + record.name_length + 1;
+  const uint64_t size = sizeof(record) + record.section_length + 1 +
+                        record.name_length + 1 + (uint64_t)record.value_length;
+  if (size > length - *offset || section[record.section_length] != '\0' ||
+      name[record.name_length] != '\0' ||
+      !metadata_record_value_is_valid(&record, data)) {
+    return false;
+  }
+
+  value->section = section;
+  value->name = name;
+  value->type = (bugsnag_metadata_type)record.type;
+  value->bool_value = false;
+  value->char_value = NULL;
+  value->double_value = 0.0;
+  switch (value->type) {
+  case BSG_METADATA_BOOL_VALUE:
+    memcpy(&value->bool_value, data, sizeof(bool));
+    break;
+  case BSG_METADATA_NUMBER_VALUE:
+    memcpy(&value->double_value, data, sizeof(double));
+    break;
+  default:
+    value->char_value = data;
+    break;
+  }
+  *offset += (uint32_t)size;
+  return true;
+}
+
+/**
+ * Find the arena record with the given section and name, storing its offset
+ * and size
+ */
+static bool metadata_arena_find(const bsg_metadata_arena *arena,
+                                const char *section, const char *name,
+                                uint32_t *out_offset, uint32_t *out_size,
+                                bsg_metadata_arena_value *value) {
+  uint32_t offset = 0;
+  uint32_t next = 0;
+  while (bsg_metadata_arena_next(arena, &next, value)) {
+    if (metadata_key_equals(value->section, section) &&
+        metadata_key_equals(value->name, name)) {
+      *out_offset = offset;
+      *out_size = next - offset;
+      return true;
+    }
+    offset = next;
+  }
+  return false;
+}
+
+static void metadata_arena_remove_range(bsg_metadata_arena *arena,
+                                        uint32_t offset, uint32_t size) {
+  memmove(&arena->data[offset], &arena->data[offset + size],
+          arena->length - offset - size);
+  arena->length -= size;
+}
+
+static void metadata_arena_remove(bsg_metadata_arena *arena,
+                                  const char *section, const char *name) {
+  uint32_t offset;
+  uint32_t size;
+  bsg_metadata_arena_value value;
+  if (metadata_arena_find(arena, section, name, &offset, &size, &value)) {
+    metadata_arena_remove_range(arena, offset, size);
+  }
+}
+
+static void metadata_arena_remove_section(bsg_metadata_arena *arena,
+                                          const char *section) {
+  uint32_t offset = 0;
+  uint32_t next = 0;
+  bsg_metadata_arena_value value;
+  while (bsg_metadata_arena_next(arena, &next, &value)) {
+    if (metadata_key_equals(value.section, section)) {
+      metadata_arena_remove_range(arena, offset, next - offset);
+      next = offset;
+    } else {
+      offset = next;
+    }
+  }
+}
+
+/**
+ * Append a record to the arena, which must not already hold a value with the
+ * same section and name. Returns false if there is no room for it.
+ */
+static bool metadata_arena_add(bsg_metadata_arena *arena, const char *section,
+                               const char *name, bugsnag_metadata_type type,
+                               const void *value, size_t value_length) {
+  bsg_metadata_record record = {
+      .type = (uint8_t)type,
+      .section_length = (uint8_t)strnlen(section, BSG_METADATA_NAME_MAX),
+      .name_length = (uint8_t)strnlen(name, BSG_METADATA_NAME_MAX),
+      .value_length = (uint32_t)value_length,
+  };
+  const size_t size = sizeof(record) + record.section_length + 1 +
+                      record.name_length + 1 + value_length;
+  if (arena->data == NULL || arena->length > arena->capacity ||
+      size > arena->capacity - arena->length) {
+    return false;
+  }
+
+  char *dest = &arena->data[arena->length];
+  memcpy(dest, &record, sizeof(record));
+  dest += sizeof(record);
+  memcpy(dest, section, record.section_length);
+  dest[record.section_length] = '\0';
+  dest += record.section_length + 1;
+  memcpy(dest, name, record.name_length);
+  dest[record.name_length] = '\0';
+  dest += record.name_length + 1;
+  memcpy(dest, value, value_length);
+  arena->length += (uint32_t)size;
+  return true;
+}
+
+/**
+ * Count a value which did not fit in the event, and whether it was then
+ * dropped as the arena had no room for it either
+ */
+static void count_metadata_spill(bool added_to_arena) {
+  bsg_health_count(added_to_arena ? BSG_HEALTH_METADATA_SPILLED
+                                  : BSG_HEALTH_METADATA_DROPPED);
+}
+
+static void metadata_clear(bugsnag_metadata *metadata,
+                           bsg_metadata_index *index, const char *section,
+                           const char *name) {
+  size_t slot = metadata_index_probe(metadata, index, section, name);
+  if (index->slots[slot] == 0) {
+    return;
+  }
+  int position = index->slots[slot] - 1;
+  int last = metadata->value_count - 1;
+  metadata_index_remove_slot(metadata, index, slot);
+
+  if (position != last) {
+    // the last value fills the gap, so its index slot has to follow it
+    const bsg_metadata_value *moved = &metadata->values[last];
+    slot = metadata_index_probe(metadata, index,
+                                bsg_metadata_value_section(metadata, moved),
+                                bsg_metadata_value_name(metadata, moved));
+    bool moved_indexed = index->slots[slot] == last + 1;
+    memcpy(&metadata->values[position], moved, sizeof(bsg_metadata_value));
+    if (moved_indexed) {
+      index->slots[slot] = (uint16_t)(position + 1);
+    }
+  }
+  metadata->values[last].type = BSG_METADATA_NONE_VALUE;
+  metadata->value_count--;
 }
 
 void bugsnag_event_add_metadata_double(void *event_ptr, const char *section,
                                        const char *name, double value) {
   bugsnag_event *event = (bugsnag_event *)event_ptr;
-  bsg_add_metadata_value_double(&event->metadata, section, name, value);
+  metadata_arena_remove(&event->metadata_arena, section, name);
+  if (!bsg_add_metadata_value_double(&event->metadata, &event->metadata_index,
+                                     section, name, value)) {
+    count_metadata_spill(metadata_arena_add(&event->metadata_arena, section,
+                                            name, BSG_METADATA_NUMBER_VALUE,
+                                            &value, sizeof(value)));
+  }
 }
 
 void bugsnag_event_add_metadata_string(void *event_ptr, const char *section,
                                        const char *name, const char *value) {
   bugsnag_event *event = (bugsnag_event *)event_ptr;
-  bsg_add_metadata_value_str(&event->metadata, section, name, value);
+  metadata_arena_remove(&event->metadata_arena, section, name);
+  // strings which would be truncated are kept whole in the arena if possible
+  const size_t length = strlen(value);
+  if (length >= sizeof(((bsg_metadata_value *)0)->char_value) &&
+      metadata_arena_add(&event->metadata_arena, section, name,
+                         BSG_METADATA_CHAR_VALUE, value, length + 1)) {
+    metadata_clear(&event->metadata, &event->metadata_index, section, name);
+    return;
+  }
+  if (!bsg_add_metadata_value_str(&event->metadata, &event->metadata_index,
+                                  section, name, value)) {
+    count_metadata_spill(metadata_arena_add(&event->metadata_arena, section,
+                                            name, BSG_METADATA_CHAR_VALUE,
+                                            value, length + 1));
+  }
 }
 
 void bugsnag_event_add_metadata_bool(void *event_ptr, const char *section,
                                      const char *name, bool value) {
   bugsnag_event *event = (bugsnag_event *)event_ptr;
-  bsg_add_metadata_value_bool(&event->metadata, section, name, value);
+  metadata_arena_remove(&event->metadata_arena, section, name);
+  if (!bsg_add_metadata_value_bool(&event->metadata, &event->metadata_index,
+                                   section, name, value)) {
+    count_metadata_spill(metadata_arena_add(&event->metadata_arena, section,
+                                            name, BSG_METADATA_BOOL_VALUE,
+                                            &value, sizeof(value)));
+  }
 }
 
 void bugsnag_event_clear_metadata(void *event_ptr, const char *section,
                                   const char *name) {
   bugsnag_event *event = (bugsnag_event *)event_ptr;
-  for (int i = 0; i < event->metadata.value_count; ++i) {
-    if (strcmp(event->metadata.values[i].section, section) == 0 &&
-        strcmp(event->metadata.values[i].name, name) == 0) {
-      memcpy(&event->metadata.values[i],
-             &event->metadata.values[event->metadata.value_count - 1],
-             sizeof(bsg_metadata_value));
-      event->metadata.values[event->metadata.value_count - 1].type =
-          BSG_METADATA_NONE_VALUE;
-      event->metadata.value_count--;
-      break;
-    }
-  }
+  metadata_clear(&event->metadata, &event->metadata_index, section, name);
+  metadata_arena_remove(&event->metadata_arena, section, name);
 }
 
 void bugsnag_event_clear_metadata_section(void *event_ptr,
                                           const char *section) {
   bugsnag_event *event = (bugsnag_event *)event_ptr;
-  for (int i = 0; i < event->metadata.value_count; ++i) {
-    if (strcmp(event->metadata.values[i].section, section) == 0) {
-      event->metadata.values[i].type = BSG_METADATA_NONE_VALUE;
+  bugsnag_metadata *metadata = &event->metadata;
+  for (int i = 0; i < metadata->value_count; ++i) {
+    bsg_metadata_value *value = &metadata->values[i];
+    if (value->type != BSG_METADATA_NONE_VALUE &&
+        metadata_key_equals(bsg_metadata_value_section(metadata, value),
+                            section)) {
+      metadata_index_remove(metadata, &event->metadata_index, i);
+      value->type = BSG_METADATA_NONE_VALUE;
     }
   }
+  metadata_arena_remove_section(&event->metadata_arena, section);
 }
 
 bsg_metadata_value bugsnag_get_metadata_value(void *event_ptr,
                                               const char *section,
                                               const char *name) {
   bugsnag_event *event = (bugsnag_event *)event_ptr;
-
-  for (int k = 0; k < event->metadata.value_count; ++k) {
-    bsg_metadata_value val = event->metadata.values[k];
-    if (strcmp(val.section, section) == 0 && strcmp(val.name, name) == 0) {
-      return val;
-    }
+  int position = metadata_index_find(&event->metadata, &event->metadata_index,
+                                     section, name);
+  if (position >= 0) {
+    return event->metadata.values[position];
   }
   bsg_metadata_value data;
+  memset(&data, 0, sizeof(data));
   data.type = BSG_METADATA_NONE_VALUE;
+
+  uint32_t offset;
+  uint32_t size;
+  bsg_metadata_arena_value value;
+  if (metadata_arena_find(&event->metadata_arena, section, name, &offset,
+                          &size, &value)) {
+    data.type = value.type;
+    data.bool_value = value.bool_value;
+    data.double_value = value.double_value;
+    if (value.char_value != NULL) {
+      bsg_strncpy(data.char_value, value.char_value, sizeof(data.char_value));
+    }
+  }
   return data;
 }
 
@@ -142,12 +633,20 @@ double bugsnag_event_get_metadata_double(void *event_ptr, const char *section,
 char *bugsnag_event_get_metadata_string(void *event_ptr, const char *section,
                                         const char *name) {
   bugsnag_event *event = (bugsnag_event *)event_ptr;
+  int position = metadata_index_find(&event->metadata, &event->metadata_index,
+                                     section, name);
+  if (position >= 0) {
+    return event->metadata.values[position].char_value;
+  }
 
-  for (int k = 0; k < event->metadata.value_count; ++k) {
-    if (strcmp(event->metadata.values[k].section, section) == 0 &&
-        strcmp(event->metadata.values[k].name, name) == 0) {
-      return event->metadata.values[k].char_value;
-    }
+  uint32_t offset;
+  uint32_t size;
+  bsg_metadata_arena_value value;
+  if (metadata_arena_find(&event->metadata_arena, section, name, &offset,
+                          &size, &value) &&
+      value.char_value != NULL) {
+    // the whole string, which is only stored in the arena
+    return (char *)value.char_value;
   }
   return NULL;
 }
@@ -201,25 +700,986 @@ void bugsnag_event_set_user(void *event_ptr, const char *id, const char *email,
   bsg_strncpy(event->user.name, name, sizeof(event->user.name));
 }
 
+/**
+ * The header of each breadcrumb record in bugsnag_event.crumb_data. It is
+ * followed by the '\0' terminated name and timestamp, then value_count
+ * metadata values. Each value is a type byte and a '\0' terminated name, then
+ * a bool byte, an unaligned double or a '\0' terminated string.
+ */
+typedef struct {
+  /** The size of the record in bytes, including this header */
+  uint32_t length;
+  uint8_t type;
+  uint8_t name_length;
+  uint8_t value_count;
+  uint8_t reserved;
+  int64_t timestamp_ms;
+} bsg_crumb_record;
+
+/**
+ * The header of records written by v11 to v14, which were followed by the
+ * terminated name and then the terminated timestamp string
+ */
+typedef struct {
+  uint32_t length;
+  uint8_t type;
+  uint8_t name_length;
+  uint8_t timestamp_length;
+  uint8_t value_count;
+} bsg_crumb_record_v14;
+
+/**
+ * The longest breadcrumb name and string value stored in a record, which match
+ * the fields of bugsnag_breadcrumb
+ */
+#define BSG_CRUMB_NAME_MAX (sizeof(((bugsnag_breadcrumb *)0)->name) - 1)
+#define BSG_CRUMB_STRING_MAX                                                   \
+  (sizeof(((bsg_metadata_value *)0)->char_value) - 1)
+
+static void crumb_record_header(const void *record, bsg_crumb_record *header) {
+  // records are packed, so the header may not be aligned
+  memcpy(header, record, sizeof(bsg_crumb_record));
+}
+
+uint32_t bsg_crumb_record_size(const char *name, size_t packed_length) {
+  const size_t size = sizeof(bsg_crumb_record) +
+                      strnlen(name, BSG_CRUMB_NAME_MAX) + 1 + packed_length;
+  return size < UINT32_MAX ? (uint32_t)size : UINT32_MAX;
+}
+
+void bsg_crumb_record_init(void *record, uint32_t capacity, const char *name,
+                           int64_t timestamp_ms, bugsnag_breadcrumb_type type) {
+  bsg_crumb_record header = {
+      .type = (uint8_t)type,
+      .name_length = (uint8_t)strnlen(name, BSG_CRUMB_NAME_MAX),
+      .timestamp_ms = timestamp_ms,
+  };
+  char *dest = record;
+  header.length = sizeof(header) + header.name_length + 1;
+  if (header.length > capacity) {
+    return;
+  }
+  memcpy(dest + sizeof(header), name, header.name_length);
+  dest[sizeof(header) + header.name_length] = '\0';
+  memcpy(record, &header, sizeof(header));
+}
+
+static bool read_timestamp_digits(const char **pos, int count, int *value) {
+  *value = 0;
+  for (int i = 0; i < count; i++) {
+    const char c = (*pos)[i];
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    *value = *value * 10 + (c - '0');
+  }
+  *pos += count;
+  return true;
+}
+
+/**
+ * The number of days from the epoch to a date in the proleptic Gregorian
+ * calendar, without the time zone handling of timegm(3)
+ */
+static int64_t days_from_civil(int year, int month, int day) {
+  year -= month <= 2;
+  const int era = (year >= 0 ? year : year - 399) / 400;
+  const int year_of_era = year - era * 400;
+  const int day_of_year =
+      (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const int day_of_era =
+      year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return (int64_t)era * 146097 + day_of_era - 719468;
+}
+
+int64_t bsg_crumb_timestamp_parse(const char *timestamp) {
+  if (timestamp[0] == 't') {
+    return strtoll(&timestamp[1], NULL, 10);
+  }
+
+  // yyyy-MM-ddTHH:mm:ss[.SSS](Z|+HH:mm|-HH:mm)
+  const char *pos = timestamp;
+  int year, month, day, hour, minute, second, millis = 0;
+  if (!read_timestamp_digits(&pos, 4, &year) || *pos++ != '-' ||
+      !read_timestamp_digits(&pos, 2, &month) || *pos++ != '-' ||
+      !read_timestamp_digits(&pos, 2, &day) || *pos++ != 'T' ||
+      !read_timestamp_digits(&pos, 2, &hour) || *pos++ != ':' ||
+      !read_timestamp_digits(&pos, 2, &minute) || *pos++ != ':' ||
+      !read_timestamp_digits(&pos, 2, &second) || month < 1 || month > 12) {
+    return 0;
+  }
+  if (*pos == '.') {
+    pos++;
+    // only milliseconds are kept, from however many digits there are
+    int digits = 0;
+    for (; *pos >= '0' && *pos <= '9'; pos++, digits++) {
+      if (digits < 3) {
+        millis = millis * 10 + (*pos - '0');
+      }
+    }
+    for (; digits < 3; digits++) {
+      millis *= 10;
+    }
+  }
+  int offset_minutes = 0;
+  if (*pos == '+' || *pos == '-') {
+    const int sign = *pos++ == '-' ? -1 : 1;
+    int offset_hours, offset_mins;
+    if (!read_timestamp_digits(&pos, 2, &offset_hours)) {
+      return 0;
+    }
+    if (*pos == ':') {
+      pos++;
+    }
+    if (!read_timestamp_digits(&pos, 2, &offset_mins)) {
+      return 0;
+    }
+    offset_minutes = sign * (offset_hours * 60 + offset_mins);
+  } else if (*pos != 'Z') {
+    return 0;
+  }
+
+  const int64_t seconds = days_from_civil(year, month, day) * 86400 +
+                          hour * 3600 + (minute - offset_minutes) * 60 + second;
+  return seconds * 1000 + millis;
+}
+
+/**
+ * Append a value to a record. The name and string value may overlap the end
+ * of the record, as with packed metadata stored in place.
+ */
+static bool crumb_record_append(void *record, uint32_t capacity,
+                                bugsnag_metadata_type type, const char *name,
+                                size_t name_length, const void *value,
+                                size_t value_length, bool terminate_value) {
+  bsg_crumb_record header;
+  crumb_record_header(record, &header);
+  if (name_length > BSG_METADATA_NAME_MAX) {
+    name_length = BSG_METADATA_NAME_MAX;
+  }
+  const size_t size =
+      1 + name_length + 1 + value_length + (terminate_value ? 1 : 0);
+  if (header.length > capacity || size > capacity - header.length ||
+      header.value_count >= BUGSNAG_METADATA_MAX) {
+    return false;
+  }
+
+  char *dest = (char *)record + header.length;
+  *dest++ = (char)type;
+  memmove(dest, name, name_length);
+  dest[name_length] = '\0';
+  dest += name_length + 1;
+  memmove(dest, value, value_length);
+  if (terminate_value) {
+    dest[value_length] = '\0';
+  }
+  header.length += (uint32_t)size;
+  header.value_count++;
+  memcpy(record, &header, sizeof(header));
+  return true;
+}
+
+bool bsg_crumb_record_add_value(void *record, uint32_t capacity,
+                                const bsg_metadata_arena_value *value) {
+  const size_t name_length = strlen(value->name);
+  switch (value->type) {
+  case BSG_METADATA_BOOL_VALUE:
+    return crumb_record_append(record, capacity, value->type, value->name,
+                               name_length, &value->bool_value, sizeof(bool),
+                               false);
+  case BSG_METADATA_NUMBER_VALUE:
+    return crumb_record_append(record, capacity, value->type, value->name,
+                               name_length, &value->double_value,
+                               sizeof(double), false);
+  case BSG_METADATA_CHAR_VALUE:
+    return crumb_record_append(
+        record, capacity, value->type, value->name, name_length,
+        value->char_value, strnlen(value->char_value, BSG_CRUMB_STRING_MAX),
+        true);
+  default:
+    // cleared values are dropped
+    return true;
+  }
+}
+
+/**
+ * Read a uint32 length prefixed string from packed metadata, stopping at any
+ * '\0' within it
+ */
+static bool read_packed_string(const uint8_t **data, const uint8_t *end,
+                               const char **out_string, size_t *out_length) {
+  uint32_t length;
+  if ((size_t)(end - *data) < sizeof(length)) {
+    return false;
+  }
+  memcpy(&length, *data, sizeof(length));
+  *data += sizeof(length);
+  if ((size_t)(end - *data) < length) {
+    return false;
+  }
+  *out_string = (const char *)*data;
+  *out_length = strnlen(*out_string, length);
+  *data += length;
+  return true;
+}
+
+bool bsg_crumb_record_add_packed(void *record, uint32_t capacity,
+                                 const void *packed, size_t length) {
+  const uint8_t *pos = packed;
+  const uint8_t *end = pos + length;
+
+  // each value takes fewer bytes in the record than it does packed, so values
+  // stored in place are always read before they are overwritten
+  while (pos < end) {
+    const uint8_t type = *pos++;
+    const char *name;
+    size_t name_length;
+    if (!read_packed_string(&pos, end, &name, &name_length)) {
+      return false;
+    }
+    switch (type) {
+    case BSG_METADATA_BOOL_VALUE: {
+      if (pos == end) {
+        return false;
+      }
+      const bool value = *pos++ != 0;
+      crumb_record_append(record, capacity, type, name, name_length, &value,
+                          sizeof(value), false);
+      break;
+    }
+    case BSG_METADATA_NUMBER_VALUE: {
+      double value;
+      if ((size_t)(end - pos) < sizeof(value)) {
+        return false;
+      }
+      memcpy(&value, pos, sizeof(value));
+      pos += sizeof(value);
+      crumb_record_append(record, capacity, type, name, name_length, &value,
+                          sizeof(value), false);
+      break;
+    }
+    case BSG_METADATA_CHAR_VALUE: {
+      const char *value;
+      size_t value_length;
+      if (!read_packed_string(&pos, end, &value, &value_length)) {
+        return false;
+      }
+      if (value_length > BSG_CRUMB_STRING_MAX) {
+        value_length = BSG_CRUMB_STRING_MAX;
+      }
+      crumb_record_append(record, capacity, type, name, name_length, value,
+                          value_length, true);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Read the value at *offset in a record and advance offset past it, returning
+ * false if it is malformed
+ */
+static bool crumb_record_next_value(const char *record, uint32_t length,
+                                    uint32_t *offset,
+                                    bsg_metadata_arena_value *value) {
+  if (*offset >= length) {
+    return false;
+  }
+  const char *pos = &record[*offset];
+  const char *end = &record[length];
+  value->section = "metaData";
+  value->type = (bugsnag_metadata_type)*pos++;
+  value->name = pos;
+  pos += strnlen(pos, (size_t)(end - pos));
+  if (pos == end) {
+    return false;
+  }
+  pos++;
+  value->bool_value = false;
+  value->char_value = NULL;
+  value->double_value = 0.0;
+
+  switch (value->type) {
+  case BSG_METADATA_BOOL_VALUE:
+    if (pos == end) {
+      return false;
+    }
+    value->bool_value = *pos++ != 0;
+    break;
+  case BSG_METADATA_NUMBER_VALUE:
+    if ((size_t)(end - pos) < sizeof(double)) {
+      return false;
+    }
+    memcpy(&value->double_value, pos, sizeof(double));
+    pos += sizeof(double);
+    break;
+  case BSG_METADATA_CHAR_VALUE:
+    value->char_value = pos;
+    pos += strnlen(pos, (size_t)(end - pos));
+    if (pos == end) {
+      return false;
+    }
+    pos++;
+    break;
+  default:
+    return false;
+  }
+  *offset = (uint32_t)(pos - record);
+  return true;
+}
+
+/**
+ * Check a record of at most length bytes and read its name, timestamp and
+ * type, returning false if it is malformed
+ */
+static bool crumb_record_read(const char *record, uint32_t length,
+                              bsg_breadcrumb_view *crumb) {
+  bsg_crumb_record header;
+  if (length < sizeof(header)) {
+    return false;
+  }
+  crumb_record_header(record, &header);
+  const uint32_t values = sizeof(header) + header.name_length + 1;
+  if (header.length < values || header.length > length ||
+      record[values - 1] != '\0') {
+    return false;
+  }
+
+  crumb->name = &record[sizeof(header)];
+  crumb->timestamp_ms = header.timestamp_ms;
+  crumb->type = (bugsnag_breadcrumb_type)header.type;
+  crumb->record = record;
+  crumb->length = header.length;
+  crumb->next_value = values;
+  crumb->values_remaining = header.value_count;
+
+  // check every value, so that reading them back cannot fail part way
+  uint32_t offset = values;
+  bsg_metadata_arena_value value;
+  for (int i = 0; i < header.value_count; i++) {
+    if (!crumb_record_next_value(record, header.length, &offset, &value)) {
+      return false;
+    }
+  }
+  return offset == header.length;
+}
+
+bool bsg_breadcrumb_next_value(bsg_breadcrumb_view *crumb,
+                               bsg_metadata_arena_value *value) {
+  if (crumb->values_remaining <= 0 ||
+      !crumb_record_next_value(crumb->record, crumb->length,
+                               &crumb->next_value, value)) {
+    return false;
+  }
+  crumb->values_remaining--;
+  return true;
+}
+
+#define BSG_CRUMB_RING_FROZEN ((uint64_t)1 << 63)
+#define BSG_CRUMB_SLOT_BUSY ((uint64_t)1 << 63)
+/**
+ * A slot closed by bsg_event_freeze_breadcrumbs(). It reads as busy with a
+ * later claim than any writer holds, so every writer leaves it alone.
+ */
+#define BSG_CRUMB_SLOT_CLOSED UINT64_MAX
+
+static void update_crumb_bounds(bugsnag_event *event, uint64_t claimed) {
+  const uint64_t oldest =
+      __atomic_load_n(&event->crumb_ring.oldest, __ATOMIC_RELAXED);
+  if (oldest >= claimed) {
+    // this breadcrumb has already been evicted
+    return;
+  }
+  // concurrent writers may store these out of order, which is corrected once
+  // the ring is frozen
+  const uint64_t count = claimed - oldest;
+  __atomic_store_n(&event->crumb_count,
+                   count < BUGSNAG_CRUMBS_MAX ? (int)count : BUGSNAG_CRUMBS_MAX,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&event->crumb_first_index,
+                   (int)(oldest % BUGSNAG_CRUMBS_MAX), __ATOMIC_RELAXED);
+}
+
+/**
+ * Mark a slot as being written by a claim, once any earlier lap of the ring
+ * has finished with it. Returns false if a later claim already has the slot.
+ */
+static bool acquire_crumb_slot(bsg_crumb_ring *ring, int slot,
+                               uint64_t ticket) {
+  uint64_t *state = &ring->published[slot];
+  uint64_t current = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+  for (;;) {
+    if (current & BSG_CRUMB_SLOT_BUSY) {
+      if ((current & ~BSG_CRUMB_SLOT_BUSY) > ticket) {
+        // a later breadcrumb is being written here, or the slot is closed
+        return false;
+      }
+      // wait for an earlier lap of the ring to finish with the slot
+      sched_yield();
+      current = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+      continue;
+    }
+    if (current >= ticket) {
+      // a later breadcrumb has already replaced this one
+      return false;
+    }
+    if (__atomic_compare_exchange_n(state, &current,
+                                    ticket | BSG_CRUMB_SLOT_BUSY, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return true;
+    }
+  }
+}
+
+/**
+ * Reserve bytes for the record of a claim, which must be the next claim to do
+ * so. Records never wrap around the end of crumb_data, one which would is
+ * moved to the start instead. Returns false once the ring has been frozen.
+ */
+static bool reserve_crumb_bytes(bsg_crumb_ring *ring, uint64_t claim,
+                                uint32_t length, uint64_t *out_start) {
+  uint64_t reserved = __atomic_load_n(&ring->reserved, __ATOMIC_RELAXED);
+  uint64_t start;
+  do {
+    if (reserved & BSG_CRUMB_RING_FROZEN) {
+      return false;
+    }
+    start = reserved;
+    const uint64_t offset = start % BUGSNAG_CRUMB_BYTES;
+    if (offset + length > BUGSNAG_CRUMB_BYTES) {
+      start += BUGSNAG_CRUMB_BYTES - offset;
+    }
+  } while (!__atomic_compare_exchange_n(&ring->reserved, &reserved,
+                                        start + length, false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED));
+
+  const int slot = (int)(claim % BUGSNAG_CRUMBS_MAX);
+  __atomic_store_n(&ring->start[slot], start, __ATOMIC_RELAXED);
+  __atomic_store_n(&ring->length[slot], length, __ATOMIC_RELAXED);
+
+  // this slot's previous breadcrumb is replaced, and any whose bytes are
+  // reused are evicted
+  const uint64_t end = start + length;
+  uint64_t oldest = __atomic_load_n(&ring->oldest, __ATOMIC_RELAXED);
+  if (claim + 1 > BUGSNAG_CRUMBS_MAX &&
+      oldest < claim + 1 - BUGSNAG_CRUMBS_MAX) {
+    oldest = claim + 1 - BUGSNAG_CRUMBS_MAX;
+  }
+  while (oldest < claim &&
+         end - __atomic_load_n(&ring->start[oldest % BUGSNAG_CRUMBS_MAX],
+                               __ATOMIC_RELAXED) >
+             BUGSNAG_CRUMB_BYTES) {
+    oldest++;
+  }
+  __atomic_store_n(&ring->oldest, oldest, __ATOMIC_RELAXED);
+  *out_start = start;
+  return true;
+}
+
+/**
+ * Wait for any earlier breadcrumbs still being written to bytes which a new
+ * record reuses, so that they cannot overwrite it
+ */
+static void wait_for_evicted_crumbs(const bsg_crumb_ring *ring, uint64_t claim,
+                                    uint64_t start, uint32_t length) {
+  const uint64_t offset = start % BUGSNAG_CRUMB_BYTES;
+  for (uint64_t lap = 1; lap < BUGSNAG_CRUMBS_MAX && lap <= claim; lap++) {
+    const uint64_t older = claim - lap;
+    const int slot = (int)(older % BUGSNAG_CRUMBS_MAX);
+    const uint64_t older_offset =
+        __atomic_load_n(&ring->start[slot], __ATOMIC_RELAXED) %
+        BUGSNAG_CRUMB_BYTES;
+    const uint32_t older_length =
+        __atomic_load_n(&ring->length[slot], __ATOMIC_RELAXED);
+    if (older_offset + older_length <= offset ||
+        older_offset >= offset + length) {
+      continue;
+    }
+    while (__atomic_load_n(&ring->published[slot], __ATOMIC_ACQUIRE) ==
+           ((older + 1) | BSG_CRUMB_SLOT_BUSY)) {
+      sched_yield();
+    }
+  }
+}
+
+void *bsg_event_claim_breadcrumb(bugsnag_event *event, uint32_t length,
+                                 uint64_t *out_ticket) {
+  bsg_crumb_ring *ring = &event->crumb_ring;
+  if (length < sizeof(bsg_crumb_record) || length > BUGSNAG_CRUMB_BYTES) {
+    return NULL;
+  }
+  uint64_t claim = __atomic_load_n(&ring->claimed, __ATOMIC_RELAXED);
+  do {
+    if (claim & BSG_CRUMB_RING_FROZEN) {
+      return NULL;
+    }
+  } while (!__atomic_compare_exchange_n(&ring->claimed, &claim, claim + 1, true,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+  const uint64_t ticket = claim + 1;
+  const int slot = (int)(claim % BUGSNAG_CRUMBS_MAX);
+  if (claim >= BUGSNAG_CRUMBS_MAX) {
+    bsg_health_count(BSG_HEALTH_BREADCRUMBS_OVERWRITTEN);
+  }
+  const bool has_slot = acquire_crumb_slot(ring, slot, ticket);
+
+  // every claim takes its turn, even if it has been dropped, as later claims
+  // wait for it
+  while (__atomic_load_n(&ring->reserved_claims, __ATOMIC_ACQUIRE) != claim) {
+    sched_yield();
+  }
+  uint64_t start = 0;
+  const bool reserved =
+      has_slot && reserve_crumb_bytes(ring, claim, length, &start);
+  __atomic_store_n(&ring->reserved_claims, ticket, __ATOMIC_RELEASE);
+  if (!reserved) {
+    bsg_health_count(BSG_HEALTH_BREADCRUMBS_DROPPED);
+    // a slot which is still marked busy is closed by the freeze
+    return NULL;
+  }
+
+  wait_for_evicted_crumbs(ring, claim, start, length);
+  *out_ticket = ticket;
+  return &event->crumb_data[start % BUGSNAG_CRUMB_BYTES];
+}
+
+void bsg_event_publish_breadcrumb(bugsnag_event *event, uint64_t ticket) {
+  const int slot = (int)((ticket - 1) % BUGSNAG_CRUMBS_MAX);
+  uint64_t busy = ticket | BSG_CRUMB_SLOT_BUSY;
+  // this fails if the ring was frozen and the slot closed while it was
+  // written, in which case the breadcrumb is left out
+  __atomic_compare_exchange_n(&event->crumb_ring.published[slot], &busy, ticket,
+                              false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  update_crumb_bounds(event, ticket);
+}
+
+static size_t crumb_value_size(const bsg_metadata_value *value,
+                               const bugsnag_metadata *metadata) {
+  const size_t name_size =
+      1 +
+      strnlen(bsg_metadata_value_name(metadata, value), BSG_METADATA_NAME_MAX) +
+      1;
+  switch (value->type) {
+  case BSG_METADATA_BOOL_VALUE:
+    return name_size + sizeof(bool);
+  case BSG_METADATA_NUMBER_VALUE:
+    return name_size + sizeof(double);
+  case BSG_METADATA_CHAR_VALUE:
+    return name_size +
+           strnlen(value->char_value, sizeof(value->char_value) - 1) + 1;
+  default:
+    return 0;
+  }
+}
+
 void bugsnag_event_add_breadcrumb(bugsnag_event *event,
-                                  bugsnag_breadcrumb *crumb) {
-  int crumb_index;
-  if (event->crumb_count < BUGSNAG_CRUMBS_MAX) {
-    crumb_index = event->crumb_count;
-    event->crumb_count++;
-  } else {
-    crumb_index = event->crumb_first_index;
-    event->crumb_first_index =
-        (event->crumb_first_index + 1) % BUGSNAG_CRUMBS_MAX;
+                                  const bugsnag_breadcrumb *crumb) {
+  const bugsnag_metadata *metadata = &crumb->metadata;
+  const int value_count = metadata->value_count < BUGSNAG_METADATA_MAX
+                              ? metadata->value_count
+                              : BUGSNAG_METADATA_MAX;
+  size_t values_size = 0;
+  for (int i = 0; i < value_count; i++) {
+    values_size += crumb_value_size(&metadata->values[i], metadata);
+  }
+
+  const uint32_t length = bsg_crumb_record_size(crumb->name, values_size);
+  uint64_t ticket;
+  void *record = bsg_event_claim_breadcrumb(event, length, &ticket);
+  if (record == NULL) {
+    return;
+  }
+  bsg_crumb_record_init(record, length, crumb->name, crumb->timestamp_ms,
+                        crumb->type);
+  for (int i = 0; i < value_count; i++) {
+    const bsg_metadata_value *src = &metadata->values[i];
+    bsg_metadata_arena_value value = {
+        .name = bsg_metadata_value_name(metadata, src),
+        .type = src->type,
+        .bool_value = src->bool_value,
+        .char_value = src->char_value,
+        .double_value = src->double_value,
+    };
+    bsg_crumb_record_add_value(record, length, &value);
+  }
+  bsg_event_publish_breadcrumb(event, ticket);
+}
+
+bool bsg_event_add_breadcrumb_record(bugsnag_event *event, const void *record,
+                                     uint32_t length) {
+  bsg_breadcrumb_view crumb;
+  if (!crumb_record_read(record, length, &crumb) || crumb.length != length) {
+    return false;
+  }
+  uint64_t ticket;
+  void *dest = bsg_event_claim_breadcrumb(event, length, &ticket);
+  if (dest != NULL) {
+    memcpy(dest, record, length);
+    bsg_event_publish_breadcrumb(event, ticket);
+  }
+  return true;
+}
+
+bool bsg_event_add_breadcrumb_record_v14(bugsnag_event *event,
+                                         const void *record, uint32_t length) {
+  const char *src = record;
+  bsg_crumb_record_v14 header;
+  if (length < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, record, sizeof(header));
+  const uint32_t values =
+      sizeof(header) + header.name_length + 1 + header.timestamp_length + 1;
+  if (header.length != length || header.length < values ||
+      src[sizeof(header) + header.name_length] != '\0' ||
+      src[values - 1] != '\0') {
+    return false;
+  }
+  // the values are stored the same way, so are checked and copied as they are
+  uint32_t offset = values;
+  bsg_metadata_arena_value value;
+  for (int i = 0; i < header.value_count; i++) {
+    if (!crumb_record_next_value(src, length, &offset, &value)) {
+      return false;
+    }
+  }
+  if (offset != length) {
+    return false;
+  }
+
+  const char *name = &src[sizeof(header)];
+  const uint32_t values_length = length - values;
+  const uint32_t record_length = bsg_crumb_record_size(name, values_length);
+  uint64_t ticket;
+  char *dest = bsg_event_claim_breadcrumb(event, record_length, &ticket);
+  if (dest == NULL) {
+    return true;
+  }
+  bsg_crumb_record_init(
+      dest, record_length, name,
+      bsg_crumb_timestamp_parse(&src[sizeof(header) + header.name_length + 1]),
+      (bugsnag_breadcrumb_type)header.type);
+  bsg_crumb_record converted;
+  crumb_record_header(dest, &converted);
+  memcpy(&dest[converted.length], &src[values], values_length);
+  converted.length += values_length;
+  converted.value_count = header.value_count;
+  memcpy(dest, &converted, sizeof(converted));
+  bsg_event_publish_breadcrumb(event, ticket);
+  return true;
+}
+
+bool bsg_event_add_packed_breadcrumbs(bugsnag_event *event, const void *packed,
+                                      size_t length) {
+  const uint8_t *pos = packed;
+  const uint8_t *end = pos + length;
+  while (pos < end) {
+    const uint8_t type = *pos++;
+    const char *name_bytes;
+    size_t name_length;
+    int64_t timestamp_ms;
+    uint32_t metadata_length;
+    if (!read_packed_string(&pos, end, &name_bytes, &name_length) ||
+        (size_t)(end - pos) < sizeof(timestamp_ms) + sizeof(metadata_length)) {
+      return false;
+    }
+    memcpy(&timestamp_ms, pos, sizeof(timestamp_ms));
+    pos += sizeof(timestamp_ms);
+    memcpy(&metadata_length, pos, sizeof(metadata_length));
+    pos += sizeof(metadata_length);
+    if ((size_t)(end - pos) < metadata_length) {
+      return false;
+    }
+    const uint8_t *metadata = pos;
+    pos += metadata_length;
+
+    // the packed strings are not terminated
+    char name[BSG_CRUMB_NAME_MAX + 1];
+    if (name_length > BSG_CRUMB_NAME_MAX) {
+      name_length = BSG_CRUMB_NAME_MAX;
+    }
+    memcpy(name, name_bytes, name_length);
+    name[name_length] = '\0';
+
+    const uint32_t record_length = bsg_crumb_record_size(name, metadata_length);
+    uint64_t ticket;
+    void *record = bsg_event_claim_breadcrumb(event, record_length, &ticket);
+    if (record == NULL) {
+      continue;
+    }
+    bsg_crumb_record_init(record, record_length, name, timestamp_ms,
+                          type <= BSG_CRUMB_USER ? (bugsnag_breadcrumb_type)type
+                                                 : BSG_CRUMB_MANUAL);
+    const bool complete = bsg_crumb_record_add_packed(
+        record, record_length, metadata, metadata_length);
+    bsg_event_publish_breadcrumb(event, ticket);
+    if (!complete) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Reads the fields of a state snapshot in order. Once a field overruns the
+ * snapshot the reader fails, and each later field reads as 0 or empty.
+ */
+typedef struct {
+  const uint8_t *pos;
+  const uint8_t *end;
+  bool ok;
+} bsg_snapshot_reader;
+
+static void snapshot_read(bsg_snapshot_reader *reader, void *dest,
+                          size_t size) {
+  if (!reader->ok || (size_t)(reader->end - reader->pos) < size) {
+    reader->ok = false;
+    memset(dest, 0, size);
+    return;
+  }
+  memcpy(dest, reader->pos, size);
+  reader->pos += size;
+}
+
+static bool snapshot_read_bool(bsg_snapshot_reader *reader) {
+  uint8_t value;
+  snapshot_read(reader, &value, sizeof(value));
+  return value != 0;
+}
+
+static int32_t snapshot_read_int32(bsg_snapshot_reader *reader) {
+  int32_t value;
+  snapshot_read(reader, &value, sizeof(value));
+  return value;
+}
+
+static int64_t snapshot_read_int64(bsg_snapshot_reader *reader) {
+  int64_t value;
+  snapshot_read(reader, &value, sizeof(value));
+  return value;
+}
+
+static double snapshot_read_double(bsg_snapshot_reader *reader) {
+  double value;
+  snapshot_read(reader, &value, sizeof(value));
+  return value;
+}
+
+/**
+ * Copy a string into dest, truncating it to dest_size - 1 bytes
+ */
+static void snapshot_read_string(bsg_snapshot_reader *reader, char *dest,
+                                 size_t dest_size) {
+  const char *value;
+  size_t length;
+  if (!reader->ok ||
+      !read_packed_string(&reader->pos, reader->end, &value, &length)) {
+    reader->ok = false;
+    dest[0] = '\0';
+    return;
+  }
+  if (length >= dest_size) {
+    length = dest_size - 1;
   }
-  memcpy(&event->breadcrumbs[crumb_index], crumb, sizeof(bugsnag_breadcrumb));
+  memcpy(dest, value, length);
+  dest[length] = '\0';
+}
+
+static void snapshot_read_app(bsg_snapshot_reader *reader,
+                              bugsnag_event *event) {
+  bsg_app_info *app = &event->app;
+  snapshot_read_string(reader, app->binary_arch, sizeof(app->binary_arch));
+  snapshot_read_string(reader, app->build_uuid, sizeof(app->build_uuid));
+  snapshot_read_string(reader, app->id, sizeof(app->id));
+  snapshot_read_string(reader, app->release_stage, sizeof(app->release_stage));
+  snapshot_read_string(reader, app->type, sizeof(app->type));
+  snapshot_read_string(reader, app->version, sizeof(app->version));
+  app->duration_ms_offset = snapshot_read_int64(reader);
+  app->duration_in_foreground_ms_offset = (time_t)snapshot_read_int64(reader);
+  app->version_code = snapshot_read_int64(reader);
+  app->in_foreground = snapshot_read_bool(reader);
+  app->is_launching = true;
+
+  char name[64];
+  char process_name[64];
+  snapshot_read_string(reader, name, sizeof(name));
+  snapshot_read_string(reader, process_name, sizeof(process_name));
+  const double memory_limit = snapshot_read_double(reader);
+  const bool restricted = snapshot_read_bool(reader);
+  if (!reader->ok) {
+    return;
+  }
+  bugsnag_event_add_metadata_string(event, "app", "name", name);
+  if (restricted) {
+    bugsnag_event_add_metadata_bool(event, "app", "backgroundWorkRestricted",
+                                    restricted);
+  }
+  bugsnag_event_add_metadata_string(event, "app", "processName", process_name);
+  bugsnag_event_add_metadata_double(event, "app", "memoryLimit", memory_limit);
+}
+
+static void snapshot_read_device(bsg_snapshot_reader *reader,
+                                 bugsnag_event *event) {
+  bsg_device_info *device = &event->device;
+  const int32_t abi_count = snapshot_read_int32(reader);
+  const int abi_capacity = sizeof(device->cpu_abi) / sizeof(device->cpu_abi[0]);
+  device->cpu_abi_count = 0;
+  for (int32_t i = 0; i < abi_count && reader->ok; i++) {
+    // ABIs past the capacity are still read, to reach the fields after them
+    char abi[sizeof(device->cpu_abi[0].value)];
+    snapshot_read_string(reader, abi, sizeof(abi));
+    if (reader->ok && device->cpu_abi_count < abi_capacity) {
+      memcpy(device->cpu_abi[device->cpu_abi_count++].value, abi, sizeof(abi));
+    }
+  }
+  snapshot_read_string(reader, device->id, sizeof(device->id));
+  snapshot_read_string(reader, device->locale, sizeof(device->locale));
+  snapshot_read_string(reader, device->manufacturer,
+                       sizeof(device->manufacturer));
+  snapshot_read_string(reader, device->model, sizeof(device->model));
+  snapshot_read_string(reader, device->orientation,
+                       sizeof(device->orientation));
+  snapshot_read_string(reader, device->os_version, sizeof(device->os_version));
+  snapshot_read_string(reader, device->os_build, sizeof(device->os_build));
+  device->api_level = snapshot_read_int32(reader);
+  device->total_memory = snapshot_read_int64(reader);
+  device->jailbroken = snapshot_read_bool(reader);
+
+  char brand[64];
+  char location_status[32];
+  char network_access[64];
+  char screen_resolution[32];
+  snapshot_read_string(reader, brand, sizeof(brand));
+  const double dpi = snapshot_read_double(reader);
+  const bool emulator = snapshot_read_bool(reader);
+  snapshot_read_string(reader, location_status, sizeof(location_status));
+  snapshot_read_string(reader, network_access, sizeof(network_access));
+  const double screen_density = snapshot_read_double(reader);
+  snapshot_read_string(reader, screen_resolution, sizeof(screen_resolution));
+  if (!reader->ok) {
+    return;
+  }
+  bugsnag_event_add_metadata_string(event, "device", "brand", brand);
+  bugsnag_event_add_metadata_double(event, "device", "dpi", dpi);
+  bugsnag_event_add_metadata_bool(event, "device", "emulator", emulator);
+  bugsnag_event_add_metadata_string(event, "device", "locationStatus",
+                                    location_status);
+  bugsnag_event_add_metadata_string(event, "device", "networkAccess",
+                                    network_access);
+  bugsnag_event_add_metadata_double(event, "device", "screenDensity",
+                                    screen_density);
+  bugsnag_event_add_metadata_string(event, "device", "screenResolution",
+                                    screen_resolution);
+}
+
+bool bsg_event_apply_state_snapshot(bugsnag_event *event, const void *snapshot,
+                                    size_t length) {
+  bsg_snapshot_reader reader = {
+      .pos = snapshot,
+      .end = (const uint8_t *)snapshot + length,
+      .ok = true,
+  };
+  uint8_t version;
+  snapshot_read(&reader, &version, sizeof(version));
+  if (!reader.ok || version != BSG_STATE_SNAPSHOT_VERSION) {
+    return false;
+  }
+  snapshot_read_string(&reader, event->context, sizeof(event->context));
+  snapshot_read_app(&reader, event);
+  snapshot_read_device(&reader, event);
+  snapshot_read_string(&reader, event->user.id, sizeof(event->user.id));
+  snapshot_read_string(&reader, event->user.name, sizeof(event->user.name));
+  snapshot_read_string(&reader, event->user.email, sizeof(event->user.email));
+  return reader.ok && reader.pos == reader.end;
 }
 
 void bugsnag_event_clear_breadcrumbs(bugsnag_event *event) {
+  memset(&event->crumb_ring, 0, sizeof(bsg_crumb_ring));
   event->crumb_count = 0;
   event->crumb_first_index = 0;
 }
 
+/**
+ * Whether the record in a slot has been overwritten by later records, given
+ * the number of bytes reserved
+ */
+static bool crumb_is_evicted(const bsg_crumb_ring *ring, int slot,
+                             uint64_t reserved) {
+  return reserved - __atomic_load_n(&ring->start[slot], __ATOMIC_RELAXED) >
+         BUGSNAG_CRUMB_BYTES;
+}
+
+void bsg_event_freeze_breadcrumbs(bugsnag_event *event) {
+  bsg_crumb_ring *ring = &event->crumb_ring;
+  const uint64_t claimed =
+      __atomic_fetch_or(&ring->claimed, BSG_CRUMB_RING_FROZEN,
+                        __ATOMIC_SEQ_CST) &
+      ~BSG_CRUMB_RING_FROZEN;
+  const uint64_t reserved =
+      __atomic_fetch_or(&ring->reserved, BSG_CRUMB_RING_FROZEN,
+                        __ATOMIC_SEQ_CST) &
+      ~BSG_CRUMB_RING_FROZEN;
+  if (claimed == 0) {
+    // nothing was added through the ring, so the bounds are left as they are
+    return;
+  }
+
+  const uint64_t count =
+      claimed < BUGSNAG_CRUMBS_MAX ? claimed : BUGSNAG_CRUMBS_MAX;
+  for (uint64_t claim = claimed - count; claim < claimed; claim++) {
+    uint64_t *state = &ring->published[claim % BUGSNAG_CRUMBS_MAX];
+    uint64_t current = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+    // anything other than this breadcrumb, complete, is closed to writers
+    while (current != claim + 1 && current != BSG_CRUMB_SLOT_CLOSED &&
+           !__atomic_compare_exchange_n(state, &current, BSG_CRUMB_SLOT_CLOSED,
+                                        false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+    }
+  }
+
+  // records are reserved in the order they were claimed, so those which have
+  // been overwritten are always the oldest
+  uint64_t oldest = claimed - count;
+  while (oldest < claimed) {
+    const int slot = (int)(oldest % BUGSNAG_CRUMBS_MAX);
+    if (__atomic_load_n(&ring->published[slot], __ATOMIC_ACQUIRE) ==
+            oldest + 1 &&
+        !crumb_is_evicted(ring, slot, reserved)) {
+      break;
+    }
+    oldest++;
+  }
+  event->crumb_count = (int)(claimed - oldest);
+  event->crumb_first_index = (int)(oldest % BUGSNAG_CRUMBS_MAX);
+}
+
+bool bsg_event_get_breadcrumb(const bugsnag_event *event, int slot,
+                              bsg_breadcrumb_view *crumb) {
+  const bsg_crumb_ring *ring = &event->crumb_ring;
+  if (slot < 0 || slot >= BUGSNAG_CRUMBS_MAX) {
+    return false;
+  }
+  const uint64_t state =
+      __atomic_load_n(&ring->published[slot], __ATOMIC_ACQUIRE);
+  const uint64_t reserved =
+      __atomic_load_n(&ring->reserved, __ATOMIC_ACQUIRE) &
+      ~BSG_CRUMB_RING_FROZEN;
+  if (state == 0 || (state & BSG_CRUMB_SLOT_BUSY) != 0 ||
+      crumb_is_evicted(ring, slot, reserved)) {
+    return false;
+  }
+  const uint64_t start = __atomic_load_n(&ring->start[slot], __ATOMIC_RELAXED);
+  uint32_t length = __atomic_load_n(&ring->length[slot], __ATOMIC_RELAXED);
+  const uint64_t offset = start % BUGSNAG_CRUMB_BYTES;
+  if (length > BUGSNAG_CRUMB_BYTES - offset) {
+    length = (uint32_t)(BUGSNAG_CRUMB_BYTES - offset);
+  }
+  return crumb_record_read(&event->crumb_data[offset], length, crumb);
+}
+
 bool bugsnag_event_has_session(const bugsnag_event *event) {
   return bsg_strlen(event->session_id) > 0;
 }
@@ -3,7 +3,9 @@
 
 #include "../assets/include/event.h"
 #include "bsg_unwind.h"
+#include "utils/health_counters.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 #ifndef BUGSNAG_METADATA_MAX
 /**
@@ -26,15 +28,50 @@
 #endif
 #ifndef BUGSNAG_THREADS_MAX
 /**
- * Maximum number of threads recorded for an event. Configures a default if not
- * defined.
+ * Number of threads reserved for an event when no limit is configured.
+ * Configures a default if not defined.
  */
 #define BUGSNAG_THREADS_MAX 255
 #endif
+#ifndef BUGSNAG_THREADS_LIMIT
+/**
+ * The most threads which can be reserved for an event, or read from a report.
+ * Configures a default if not defined.
+ */
+#define BUGSNAG_THREADS_LIMIT 4096
+#endif
+#ifndef BUGSNAG_FRAME_MODULES_MAX
+/**
+ * Maximum number of shared objects recorded for the frames of a crash whose
+ * symbolication is deferred. Configures a default if not defined.
+ */
+#define BUGSNAG_FRAME_MODULES_MAX 32
+#endif
+#if BUGSNAG_METADATA_MAX < 1 || BUGSNAG_CRUMBS_MAX < 1 ||                      \
+    BUGSNAG_THREADS_MAX < 1 || BUGSNAG_FRAMES_MAX < 1
+#error The capacities of the event must be at least 1
+#endif
+#if BUGSNAG_THREADS_MAX > BUGSNAG_THREADS_LIMIT
+#error BUGSNAG_THREADS_MAX is larger than BUGSNAG_THREADS_LIMIT
+#endif
+/**
+ * Maximum length of a build ID recorded for a shared object
+ */
+#define BSG_BUILD_ID_MAX 32
+/**
+ * The module index of a frame which is not in a recorded shared object
+ */
+#define BSG_NO_FRAME_MODULE 0xff
 /**
  * Version of the bugsnag_event struct. Serialized to report header.
  */
-#define BUGSNAG_EVENT_VERSION 8
+#define BUGSNAG_EVENT_VERSION 15
+
+/**
+ * The layout of the state snapshot read by bsg_event_apply_state_snapshot(),
+ * which must match NativeStateSnapshot.VERSION
+ */
+#define BSG_STATE_SNAPSHOT_VERSION 1
 
 #ifdef __cplusplus
 extern "C" {
@@ -92,6 +129,18 @@ typedef struct {
   int64_t total_memory;
 } bsg_device_info;
 
+/**
+ * The capacities which the event arrays were configured with when a report
+ * was written, which bound the counts of each section in the file. A report
+ * written with larger capacities is truncated to those of the reader.
+ */
+typedef struct {
+  uint32_t metadata_max;
+  uint32_t crumbs_max;
+  uint32_t threads_max;
+  uint32_t frames_max;
+} bsg_event_layout;
+
 /**
  * Report versioning information, serialized to disk first in a report file,
  * including system info for potential debugging
@@ -109,20 +158,47 @@ typedef struct {
    * The value of device.runtimeVersions.osBuild
    */
   char os_build[64];
+  /**
+   * The capacities of the writer, from version 12. Earlier versions end the
+   * header before it, and were always written with the default capacities.
+   */
+  bsg_event_layout layout;
 } bsg_report_header;
 
+/**
+ * Fill in the capacities this library was built with
+ */
+void bsg_event_layout_init(bsg_event_layout *layout);
+
+#ifndef BUGSNAG_METADATA_NAMES_SIZE
+/**
+ * Bytes available in each metadata store for its section and key names, which
+ * are stored once however many values share them. Configures a default if not
+ * defined.
+ */
+#define BUGSNAG_METADATA_NAMES_SIZE 2048
+#endif
+#if BUGSNAG_METADATA_NAMES_SIZE > UINT16_MAX
+#error BUGSNAG_METADATA_NAMES_SIZE is too large for a metadata name offset
+#endif
+/**
+ * The longest section or key name stored in metadata, names which are longer
+ * are truncated
+ */
+#define BSG_METADATA_NAME_MAX 31
+
 /**
  * A single value in metadata
  */
 typedef struct {
   /**
-   * The key identifying this metadata entry
+   * The offset in bugsnag_metadata.names of the key identifying this entry
    */
-  char name[32];
+  uint16_t name;
   /**
-   * The metadata tab
+   * The offset in bugsnag_metadata.names of the metadata tab
    */
-  char section[32];
+  uint16_t section;
   /**
    * The value type from bool, char, number
    */
@@ -146,8 +222,76 @@ typedef struct {
   /** The number of values in use */
   int value_count;
   bsg_metadata_value values[BUGSNAG_METADATA_MAX];
+  /**
+   * The number of bytes of names in use. Offset 0 is always the empty name,
+   * so a zeroed struct has no names.
+   */
+  uint16_t names_length;
+  /**
+   * The distinct section and key names used by values, each terminated by
+   * '\0' and referenced by its offset
+   */
+  char names[BUGSNAG_METADATA_NAMES_SIZE];
 } bugsnag_metadata;
 
+#ifndef BUGSNAG_METADATA_ARENA_SIZE
+/**
+ * Bytes reserved at install for event metadata which does not fit in
+ * bugsnag_metadata, such as strings longer than char_value. Configures a
+ * default if not defined.
+ */
+#define BUGSNAG_METADATA_ARENA_SIZE (16 * 1024)
+#endif
+
+/**
+ * A buffer of variable length metadata records, holding the values which do
+ * not fit in bugsnag_metadata. A value is only ever present in one of the two.
+ * The buffer is allocated up front, so values can be added from a signal
+ * handler.
+ */
+typedef struct {
+  char *data;
+  /** The size of data, which is 0 if no buffer was reserved */
+  uint32_t capacity;
+  /** The number of bytes of records in use */
+  uint32_t length;
+} bsg_metadata_arena;
+
+/**
+ * A metadata value read from a bsg_metadata_arena or a breadcrumb record. The
+ * strings point into the buffer they were read from, so are only valid until
+ * it is next changed.
+ */
+typedef struct {
+  const char *section;
+  const char *name;
+  bugsnag_metadata_type type;
+  bool bool_value;
+  const char *char_value;
+  double double_value;
+} bsg_metadata_arena_value;
+
+/**
+ * The number of slots in a metadata index, which leaves at least half of them
+ * empty so that probe sequences stay short
+ */
+#define BSG_METADATA_INDEX_SIZE (BUGSNAG_METADATA_MAX * 2)
+#if BUGSNAG_METADATA_MAX >= UINT16_MAX
+#error BUGSNAG_METADATA_MAX is too large for the metadata index
+#endif
+
+/**
+ * An open-addressing hash index over the section and name of the values in
+ * bugsnag_metadata. It is a plain fixed-size array, so it is copied along with
+ * the event and is never written to disk.
+ */
+typedef struct {
+  /**
+   * The position in bugsnag_metadata.values plus one, or 0 for an empty slot
+   */
+  uint16_t slots[BSG_METADATA_INDEX_SIZE];
+} bsg_metadata_index;
+
 /** a Bugsnag exception */
 typedef struct {
   /** The exception name or stringified code */
@@ -168,9 +312,14 @@ typedef struct {
   bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX];
 } bsg_error;
 
+/**
+ * A breadcrumb as it is added to an event, which stores it more compactly as a
+ * variable length record
+ */
 typedef struct {
   char name[64];
-  char timestamp[37];
+  /** When the breadcrumb was left, in milliseconds since the epoch */
+  int64_t timestamp_ms;
   bugsnag_breadcrumb_type type;
 
   /**
@@ -179,6 +328,80 @@ typedef struct {
   bugsnag_metadata metadata;
 } bugsnag_breadcrumb;
 
+#ifndef BUGSNAG_CRUMB_BYTES
+/**
+ * Bytes available for breadcrumb records in an event. The oldest breadcrumbs
+ * are evicted once they are used up, even if there are fewer than
+ * BUGSNAG_CRUMBS_MAX. Configures a default if not defined.
+ */
+#define BUGSNAG_CRUMB_BYTES (32 * 1024)
+#endif
+#if BUGSNAG_METADATA_MAX > UINT8_MAX
+#error BUGSNAG_METADATA_MAX is too large for a breadcrumb record
+#endif
+
+/**
+ * The state of the breadcrumb ring, which lets threads add breadcrumbs
+ * concurrently without a lock. Every field is only accessed atomically.
+ */
+typedef struct {
+  /**
+   * The number of breadcrumbs ever claimed, where the breadcrumb claimed as n
+   * is stored in slot n % BUGSNAG_CRUMBS_MAX. The top bit is set once the
+   * ring has been frozen.
+   */
+  uint64_t claimed;
+  /**
+   * The number of bytes ever reserved in crumb_data, where a record reserved
+   * at n is stored at n % BUGSNAG_CRUMB_BYTES. The top bit is set once the
+   * ring has been frozen.
+   */
+  uint64_t reserved;
+  /**
+   * The number of claims which have reserved their bytes. Claims take turns
+   * to do so, which keeps the records in the order they were claimed.
+   */
+  uint64_t reserved_claims;
+  /**
+   * The oldest claim whose record has not been overwritten by later ones
+   */
+  uint64_t oldest;
+  /**
+   * One more than the claim of the breadcrumb published in each slot, or 0 if
+   * none has been. The top bit is set while a slot is being written.
+   */
+  uint64_t published[BUGSNAG_CRUMBS_MAX];
+  /**
+   * Where the record in each slot was reserved, in the same terms as reserved
+   */
+  uint64_t start[BUGSNAG_CRUMBS_MAX];
+  /**
+   * The number of bytes reserved for the record in each slot
+   */
+  uint32_t length[BUGSNAG_CRUMBS_MAX];
+} bsg_crumb_ring;
+
+/**
+ * A breadcrumb read from the ring of an event. The strings point into the
+ * ring, so are only valid until the breadcrumb is evicted.
+ */
+typedef struct {
+  const char *name;
+  int64_t timestamp_ms;
+  bugsnag_breadcrumb_type type;
+  /**
+   * The whole record, as it is written to disk
+   */
+  const char *record;
+  uint32_t length;
+  /**
+   * The offset in record of the next value returned by
+   * bsg_breadcrumb_next_value()
+   */
+  uint32_t next_value;
+  int values_remaining;
+} bsg_breadcrumb_view;
+
 typedef struct {
   char name[64];
   char version[16];
@@ -202,21 +425,164 @@ typedef struct {
   char *variant;
 } bsg_feature_flag;
 
+/**
+ * A shared object which contained frames of a crash, recorded so that the
+ * frames can be symbolicated once the event is read back
+ */
+typedef struct {
+  /** Where it was loaded in the process which crashed */
+  uintptr_t start;
+  uint32_t build_id_length;
+  uint8_t build_id[BSG_BUILD_ID_MAX];
+  char path[256];
+} bsg_frame_module;
+
+typedef struct {
+  /**
+   * The number of modules recorded, which is 0 unless symbolication of the
+   * stacktrace was deferred
+   */
+  int count;
+  bsg_frame_module modules[BUGSNAG_FRAME_MODULES_MAX];
+  /**
+   * The index in modules of each frame in the stacktrace, or
+   * BSG_NO_FRAME_MODULE if the frame was symbolicated when it was captured
+   */
+  uint8_t frame_modules[BUGSNAG_FRAMES_MAX];
+} bsg_frame_module_table;
+
+/**
+ * The phases of a crash handler, which are timed separately
+ */
+typedef enum {
+  /** bsg_populate_event_as() */
+  BSG_HANDLER_PHASE_POPULATE,
+  BSG_HANDLER_PHASE_UNWIND,
+  /** bsg_capture_thread_states() */
+  BSG_HANDLER_PHASE_THREADS,
+  /** bsg_run_on_error() */
+  BSG_HANDLER_PHASE_ON_ERROR,
+  /** Writing the event to the report, up to the handler timing itself */
+  BSG_HANDLER_PHASE_WRITE,
+  BSG_HANDLER_PHASE_COUNT,
+} bsg_handler_phase;
+
+/**
+ * Monotonic timestamps taken by a crash handler, which are kept in the report
+ * to show how long handling took. All are 0 for events which were not
+ * captured by a crash handler.
+ */
+typedef struct {
+  /** When the handler was entered */
+  uint64_t started_ns;
+  /** When the rest of the event had been written to the report */
+  uint64_t serialized_ns;
+  /** When the last phase ended */
+  uint64_t phase_ended_ns;
+  /**
+   * The time taken by each bsg_handler_phase, measured from the end of the
+   * phase before it
+   */
+  uint64_t phase_ns[BSG_HANDLER_PHASE_COUNT];
+} bsg_handler_timing;
+
+/**
+ * The cheaper fallbacks taken by a crash handler which ran out of time, see
+ * bsg_environment.crash_deadline_ns, and the state it was missing
+ */
+typedef enum {
+  /** The stack was not unwound, leaving the frame of the crash address */
+  BSG_HANDLER_FALLBACK_PC_ONLY = 1 << 0,
+  /** Threads were not captured, or their capture was interrupted */
+  BSG_HANDLER_FALLBACK_THREADS_SKIPPED = 1 << 1,
+  /** The on_error callback was not run, or was interrupted */
+  BSG_HANDLER_FALLBACK_ON_ERROR_SKIPPED = 1 << 2,
+  /**
+   * The crash happened before the install-time state was populated, so only
+   * the fields set natively or by the bridge since install are present
+   */
+  BSG_HANDLER_FALLBACK_STATE_PENDING = 1 << 3,
+  /**
+   * The report was cut short while it was written, and is missing the
+   * sections after the last one which was written in full
+   */
+  BSG_HANDLER_FALLBACK_REPORT_TRUNCATED = 1 << 4,
+} bsg_handler_fallback;
+
+/**
+ * The fields which are written after install are grouped by who writes them,
+ * each group starting on its own cache line: the metadata written by the
+ * NativeBridge setters, the breadcrumb ring which any thread leaving a
+ * breadcrumb writes without a lock, and the feature flags. The other fields
+ * are only written at install or while a crash is handled. Reports are written
+ * and read a field at a time, so the order here is not part of the report
+ * format.
+ */
 typedef struct {
   bsg_notifier notifier;
   bsg_app_info app;
   bsg_device_info device;
   bugsnag_user user;
   bsg_error error;
-  bugsnag_metadata metadata;
 
-  int crumb_count;
+  bugsnag_metadata metadata __bsg_cache_aligned;
+  /**
+   * Locates metadata values by section and name. Maintained by the
+   * bugsnag_event_*_metadata functions, and rebuilt by
+   * bsg_event_index_metadata() when values are written directly.
+   */
+  bsg_metadata_index metadata_index;
+  /**
+   * Metadata values which did not fit in metadata. The buffer is reserved by
+   * bsg_metadata_arena_reserve() and serialized separately to the rest of the
+   * struct.
+   */
+  bsg_metadata_arena metadata_arena;
+
+  int crumb_count __bsg_cache_aligned;
   // Breadcrumbs are a ring; the first index moves as the
   // structure is filled and replaced.
   int crumb_first_index;
-  bugsnag_breadcrumb breadcrumbs[BUGSNAG_CRUMBS_MAX];
+  /**
+   * Locates the record of the breadcrumb in each slot, and tracks which hold
+   * complete breadcrumbs while they are added. Never written to disk.
+   */
+  bsg_crumb_ring crumb_ring;
+  /**
+   * Variable length breadcrumb records, read with bsg_event_get_breadcrumb()
+   */
+  char crumb_data[BUGSNAG_CRUMB_BYTES];
+
+  /**
+   * The number of feature flags currently specified.
+   */
+  size_t feature_flag_count __bsg_cache_aligned;
+
+  /**
+   * Pointer to the current feature flags. This is dynamically allocated and
+   * serialized/deserialized separately to the rest of the struct.
+   */
+  bsg_feature_flag *feature_flags;
 
-  char context[64];
+  /**
+   * Holds the names and variants of the feature flags set in bulk by
+   * bsg_set_feature_flags(), which are released together rather than
+   * individually. NULL if none are.
+   */
+  char *feature_flag_strings;
+  size_t feature_flag_strings_size;
+
+  /**
+   * The feature flags encoded as bsg_write_feature_flags() writes them: the
+   * count, then each length prefixed name followed by whether it has a variant
+   * and the variant. Kept up to date by the functions in featureflags.h, so
+   * that a crash handler can write it in one go. NULL if it has not been
+   * encoded, in which case the flags are written one at a time.
+   */
+  char *feature_flags_encoded;
+  size_t feature_flags_encoded_size;
+
+  char context[64] __bsg_cache_aligned;
   bugsnag_severity severity;
 
   char session_id[33];
@@ -228,37 +594,221 @@ typedef struct {
   char api_key[64];
 
   int thread_count;
-  bsg_thread threads[BUGSNAG_THREADS_MAX];
+  /**
+   * The captured threads. The buffer is reserved by bsg_event_reserve_threads()
+   * and serialized separately to the rest of the struct.
+   */
+  bsg_thread *threads;
+  /** The size of threads, which is 0 if no buffer was reserved */
+  int thread_capacity;
+  /**
+   * Whether thread capture stopped at its budget before every thread was read
+   */
+  bool threads_truncated;
 
   /**
-   * The number of feature flags currently specified.
+   * The shared objects containing frames of the stacktrace, when frames are
+   * only partly filled in by a crash handler, see bsg_record_frame_modules()
    */
-  size_t feature_flag_count;
+  bsg_frame_module_table frame_modules;
 
   /**
-   * Pointer to the current feature flags. This is dynamically allocated and
-   * serialized/deserialized separately to the rest of the struct.
+   * How long each phase of the crash handler took, see
+   * bsg_start_handler_timing()
    */
-  bsg_feature_flag *feature_flags;
+  bsg_handler_timing handler_timing;
+  /**
+   * The bsg_handler_fallback flags of each fallback taken by the crash handler
+   */
+  uint8_t handler_fallbacks;
+
+  /**
+   * The health counters of the process which wrote the event, copied as it
+   * is written to a report
+   */
+  bsg_health_counters health_counters;
 } bugsnag_event;
 
+/**
+ * Add a copy of a breadcrumb, replacing the oldest if the ring is full. Safe
+ * to call from several threads at once.
+ */
 void bugsnag_event_add_breadcrumb(bugsnag_event *event,
-                                  bugsnag_breadcrumb *crumb);
+                                  const bugsnag_breadcrumb *crumb);
+/**
+ * Add a breadcrumb record, such as one read back from a file. Returns false if
+ * the record is malformed.
+ */
+bool bsg_event_add_breadcrumb_record(bugsnag_event *event, const void *record,
+                                     uint32_t length);
+/**
+ * Add a breadcrumb record written by v11 to v14, which held its timestamp as a
+ * string, converting it to the current layout. Returns false if the record is
+ * malformed.
+ */
+bool bsg_event_add_breadcrumb_record_v14(bugsnag_event *event,
+                                         const void *record, uint32_t length);
+/**
+ * Add a batch of packed breadcrumbs, oldest first. Each is a
+ * bugsnag_breadcrumb_type byte, a uint32 length and the bytes of its name, an
+ * int64 timestamp in milliseconds since the epoch, and a uint32 length and its
+ * packed metadata, all in native byte order,
+ * as read by bsg_crumb_record_add_packed(). Returns false if the batch is
+ * malformed, in which case only the breadcrumbs before that point are added.
+ */
+bool bsg_event_add_packed_breadcrumbs(bugsnag_event *event, const void *packed,
+                                      size_t length);
+/**
+ * Clears the breadcrumbs. Unlike adding a breadcrumb this must not race with
+ * other changes to them.
+ */
 void bugsnag_event_clear_breadcrumbs(bugsnag_event *event);
+
+/**
+ * Claim the next slot in the breadcrumb ring and length bytes for its record,
+ * so that the record can be filled in place rather than copied. Returns NULL
+ * if the breadcrumb should be dropped, such as once the ring has been frozen.
+ * Otherwise the record must be started with bsg_crumb_record_init() and then
+ * passed to bsg_event_publish_breadcrumb().
+ */
+void *bsg_event_claim_breadcrumb(bugsnag_event *event, uint32_t length,
+                                 uint64_t *out_ticket);
+void bsg_event_publish_breadcrumb(bugsnag_event *event, uint64_t ticket);
+
+/**
+ * Stop breadcrumbs from being added and settle crumb_count and
+ * crumb_first_index on the most recent claims. Slots which were still being
+ * written are closed, so that crash-time serialization sees a consistent set
+ * of breadcrumbs however other threads are interrupted. Async-safe.
+ */
+void bsg_event_freeze_breadcrumbs(bugsnag_event *event);
+
+/**
+ * Read the breadcrumb in a slot of the ring. Returns false if it is being
+ * written, was closed by bsg_event_freeze_breadcrumbs() or has been evicted.
+ */
+bool bsg_event_get_breadcrumb(const bugsnag_event *event, int slot,
+                              bsg_breadcrumb_view *crumb);
+/**
+ * Read the next metadata value of a breadcrumb, returning false once there
+ * are no more. The section of every value is "metaData".
+ */
+bool bsg_breadcrumb_next_value(bsg_breadcrumb_view *crumb,
+                               bsg_metadata_arena_value *value);
+
+/**
+ * Parse a breadcrumb timestamp string into milliseconds since the epoch. The
+ * string is either "t" followed by the milliseconds, or an ISO 8601 date such
+ * as "2018-10-08T12:07:15.563Z" with a "Z" or numeric zone offset. Returns 0 if
+ * it cannot be parsed.
+ */
+int64_t bsg_crumb_timestamp_parse(const char *timestamp);
+
+/**
+ * The number of bytes needed for a breadcrumb record with the given name and
+ * metadata of packed_length bytes as passed to bsg_crumb_record_add_packed()
+ */
+uint32_t bsg_crumb_record_size(const char *name, size_t packed_length);
+/**
+ * Start a breadcrumb record in a buffer of capacity bytes, which must be at
+ * least bsg_crumb_record_size() with no metadata
+ */
+void bsg_crumb_record_init(void *record, uint32_t capacity, const char *name,
+                           int64_t timestamp_ms, bugsnag_breadcrumb_type type);
+/**
+ * Add a value to the metadata of a breadcrumb record, ignoring its section.
+ * Returns false if there was no room for it.
+ */
+bool bsg_crumb_record_add_value(void *record, uint32_t capacity,
+                                const bsg_metadata_arena_value *value);
+/**
+ * Add the values from a buffer of packed metadata to a breadcrumb record. Each
+ * value is a bugsnag_metadata_type byte, a uint32 length and the bytes of its
+ * name, then a bool byte, a double, or a uint32 length and the bytes of a
+ * string, all in native byte order. The packed values may be stored at the end
+ * of the record itself, as they are never overwritten before they are read.
+ * Returns false if the buffer is malformed, in which case only the values
+ * before that point are added.
+ */
+bool bsg_crumb_record_add_packed(void *record, uint32_t capacity,
+                                 const void *packed, size_t length);
+
+/**
+ * Fill the context, app, device and user of an event from a state snapshot
+ * packed by NativeStateSnapshot.java, and add the app and device metadata it
+ * holds. Returns false if the snapshot is of another version or malformed, in
+ * which case the event is only partly filled and should be populated another
+ * way.
+ */
+bool bsg_event_apply_state_snapshot(bugsnag_event *event, const void *snapshot,
+                                    size_t length);
+
 void bugsnag_event_start_session(bugsnag_event *event, const char *session_id,
                                  const char *started_at, int handled_count,
                                  int unhandled_count);
 bool bugsnag_event_has_session(const bugsnag_event *event);
 
-void bsg_add_metadata_value_double(bugsnag_metadata *metadata,
+/**
+ * Add a value to metadata. If an index is given, any existing value with the
+ * same section and name is replaced in place and the index is kept up to date.
+ * Without an index the value is always appended. Returns false if there was
+ * no room for the value.
+ */
+bool bsg_add_metadata_value_double(bugsnag_metadata *metadata,
+                                   bsg_metadata_index *index,
                                    const char *section, const char *name,
                                    double value);
-void bsg_add_metadata_value_str(bugsnag_metadata *metadata, const char *section,
+bool bsg_add_metadata_value_str(bugsnag_metadata *metadata,
+                                bsg_metadata_index *index, const char *section,
                                 const char *name, const char *value);
-void bsg_add_metadata_value_bool(bugsnag_metadata *metadata,
+bool bsg_add_metadata_value_bool(bugsnag_metadata *metadata,
+                                 bsg_metadata_index *index,
                                  const char *section, const char *name,
                                  bool value);
 
+/**
+ * The section or name of a metadata value, which is the empty string if the
+ * value refers outside of the names in use
+ */
+const char *bsg_metadata_value_section(const bugsnag_metadata *metadata,
+                                       const bsg_metadata_value *value);
+const char *bsg_metadata_value_name(const bugsnag_metadata *metadata,
+                                    const bsg_metadata_value *value);
+
+/**
+ * Rebuild the metadata index of an event from its metadata values, such as
+ * after they have been read from a file. Where a section and name are repeated
+ * the last value is indexed.
+ */
+void bsg_event_index_metadata(bugsnag_event *event);
+
+/**
+ * Allocate the buffer of a metadata arena, returning false if it could not be
+ * allocated. An arena without a buffer holds no values.
+ */
+bool bsg_metadata_arena_reserve(bsg_metadata_arena *arena, uint32_t capacity);
+void bsg_metadata_arena_free(bsg_metadata_arena *arena);
+
+/**
+ * Allocate an event aligned for its cache line groups, which malloc() does not
+ * guarantee. The event is not zeroed, and is released with free().
+ */
+bugsnag_event *bsg_event_alloc(void);
+
+/**
+ * Allocate room for capacity threads, returning false if it could not be
+ * allocated. An event without a buffer holds no threads.
+ */
+bool bsg_event_reserve_threads(bugsnag_event *event, int capacity);
+void bsg_event_free_threads(bugsnag_event *event);
+
+/**
+ * Read the record at *offset in an arena and advance offset to the next one.
+ * Returns false once there are no more records, or if the record is malformed.
+ */
+bool bsg_metadata_arena_next(const bsg_metadata_arena *arena, uint32_t *offset,
+                             bsg_metadata_arena_value *value);
+
 /*********************************
  * (end) NDK-SPECIFIC BITS
  *********************************/
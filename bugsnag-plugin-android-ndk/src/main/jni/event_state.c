@@ -0,0 +1,192 @@
+#include "event_state.h"
+
+#include <string.h>
+
+#include "utils/string.h"
+
+/**
+ * The number of times a crash handler reads the state again if writers
+ * overtake it, after which a possibly torn copy is used rather than waiting
+ */
+#define BSG_EVENT_STATE_READ_ATTEMPTS 8
+
+/**
+ * The layout of session_counts: each count uses 31 bits, and saturates rather
+ * than overflowing into the next
+ */
+#define BSG_SESSION_COUNT_MAX 0x7fffffffULL
+#define BSG_SESSION_UNHANDLED_SHIFT 31
+#define BSG_SESSION_SLOT (1ULL << 62)
+#define BSG_SESSION_ACTIVE (1ULL << 63)
+
+static uint64_t pack_session_counts(bool active, int slot, int handled_count,
+                                    int unhandled_count) {
+  uint64_t handled = handled_count > 0 ? (uint64_t)handled_count : 0;
+  uint64_t unhandled = unhandled_count > 0 ? (uint64_t)unhandled_count : 0;
+  if (!active) {
+    return slot ? BSG_SESSION_SLOT : 0;
+  }
+  return BSG_SESSION_ACTIVE | (slot ? BSG_SESSION_SLOT : 0) |
+         ((unhandled & BSG_SESSION_COUNT_MAX) << BSG_SESSION_UNHANDLED_SHIFT) |
+         (handled & BSG_SESSION_COUNT_MAX);
+}
+
+static int session_slot(uint64_t counts) {
+  return (counts & BSG_SESSION_SLOT) ? 1 : 0;
+}
+
+static void copy_state_from_event(bsg_event_state *state,
+                                  const bugsnag_event *event) {
+  state->app = event->app;
+  state->device = event->device;
+  state->user = event->user;
+  memcpy(state->context, event->context, sizeof(state->context));
+}
+
+static void copy_state_to_event(const bsg_event_state *state,
+                                bugsnag_event *event) {
+  event->app = state->app;
+  event->device = state->device;
+  event->user = state->user;
+  memcpy(event->context, state->context, sizeof(event->context));
+}
+
+void bsg_event_state_init(bsg_event_state_buffer *buffer,
+                          const bugsnag_event *event,
+                          time_t foreground_start_time) {
+  memset(buffer, 0, sizeof(bsg_event_state_buffer));
+  copy_state_from_event(&buffer->copies[0], event);
+  buffer->copies[0].foreground_start_time = foreground_start_time;
+
+  bsg_session_info *session = &buffer->sessions[0];
+  memcpy(session->id, event->session_id, sizeof(session->id));
+  memcpy(session->start, event->session_start, sizeof(session->start));
+  buffer->session_counts =
+      pack_session_counts(bsg_strlen(event->session_id) > 0, 0,
+                          event->handled_events, event->unhandled_events);
+}
+
+const bsg_event_state *
+bsg_event_state_current(const bsg_event_state_buffer *buffer) {
+  const uint32_t sequence =
+      __atomic_load_n(&buffer->sequence, __ATOMIC_ACQUIRE);
+  return &buffer->copies[(sequence / 2) % 2];
+}
+
+bsg_event_state *bsg_event_state_begin_update(bsg_event_state_buffer *buffer) {
+  const uint32_t sequence =
+      __atomic_load_n(&buffer->sequence, __ATOMIC_RELAXED);
+  bsg_event_state *current = &buffer->copies[(sequence / 2) % 2];
+  bsg_event_state *spare = &buffer->copies[(sequence / 2 + 1) % 2];
+  // mark the spare copy as being written before it is changed
+  __atomic_store_n(&buffer->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  *spare = *current;
+  return spare;
+}
+
+void bsg_event_state_publish(bsg_event_state_buffer *buffer) {
+  const uint32_t sequence =
+      __atomic_load_n(&buffer->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&buffer->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+void bsg_event_state_set_session(bsg_event_state_buffer *buffer,
+                                 const char *session_id, const char *started_at,
+                                 int handled_count, int unhandled_count) {
+  const uint32_t changes =
+      __atomic_load_n(&buffer->session_changes, __ATOMIC_RELAXED);
+  const uint64_t counts =
+      __atomic_load_n(&buffer->session_counts, __ATOMIC_RELAXED);
+  const int spare_slot = 1 - session_slot(counts);
+  bsg_session_info *spare = &buffer->sessions[spare_slot];
+
+  // mark the spare slot as being written before it is changed
+  __atomic_store_n(&buffer->session_changes, changes + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memset(spare, 0, sizeof(bsg_session_info));
+  if (session_id != NULL) {
+    bsg_strncpy(spare->id, session_id, sizeof(spare->id));
+    bsg_strncpy(spare->start, started_at, sizeof(spare->start));
+  }
+
+  // events counted from here on belong to the new session
+  __atomic_store_n(&buffer->session_counts,
+                   pack_session_counts(session_id != NULL, spare_slot,
+                                       handled_count, unhandled_count),
+                   __ATOMIC_RELEASE);
+  __atomic_store_n(&buffer->session_changes, changes + 2, __ATOMIC_RELEASE);
+}
+
+bool bsg_event_state_count_event(bsg_event_state_buffer *buffer,
+                                 bool unhandled) {
+  const int shift = unhandled ? BSG_SESSION_UNHANDLED_SHIFT : 0;
+  uint64_t counts = __atomic_load_n(&buffer->session_counts, __ATOMIC_RELAXED);
+  uint64_t next;
+  do {
+    if ((counts & BSG_SESSION_ACTIVE) == 0) {
+      return false;
+    }
+    if (((counts >> shift) & BSG_SESSION_COUNT_MAX) == BSG_SESSION_COUNT_MAX) {
+      return true;
+    }
+    next = counts + (1ULL << shift);
+  } while (!__atomic_compare_exchange_n(&buffer->session_counts, &counts, next,
+                                        true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED));
+  return true;
+}
+
+static void apply_session(const bsg_event_state_buffer *buffer,
+                          bugsnag_event *event) {
+  for (int attempt = 0; attempt < BSG_EVENT_STATE_READ_ATTEMPTS; attempt++) {
+    const uint32_t changes =
+        __atomic_load_n(&buffer->session_changes, __ATOMIC_ACQUIRE);
+    const uint64_t counts =
+        __atomic_load_n(&buffer->session_counts, __ATOMIC_ACQUIRE);
+    const bsg_session_info *session = &buffer->sessions[session_slot(counts)];
+    if (counts & BSG_SESSION_ACTIVE) {
+      memcpy(event->session_id, session->id, sizeof(event->session_id));
+      memcpy(event->session_start, session->start,
+             sizeof(event->session_start));
+    } else {
+      memset(event->session_id, 0, sizeof(event->session_id));
+      memset(event->session_start, 0, sizeof(event->session_start));
+    }
+    event->handled_events = (int)(counts & BSG_SESSION_COUNT_MAX);
+    event->unhandled_events =
+        (int)((counts >> BSG_SESSION_UNHANDLED_SHIFT) & BSG_SESSION_COUNT_MAX);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    // as for the event state, the slot read is only rewritten by the change
+    // after the one which was in progress or next to start when it was read
+    const uint32_t latest =
+        __atomic_load_n(&buffer->session_changes, __ATOMIC_RELAXED);
+    if (latest - changes <= (changes % 2 == 0 ? 2u : 1u)) {
+      break;
+    }
+  }
+}
+
+time_t bsg_event_state_apply(const bsg_event_state_buffer *buffer,
+                             bugsnag_event *event) {
+  time_t foreground_start_time = 0;
+  for (int attempt = 0; attempt < BSG_EVENT_STATE_READ_ATTEMPTS; attempt++) {
+    const uint32_t sequence =
+        __atomic_load_n(&buffer->sequence, __ATOMIC_ACQUIRE);
+    const bsg_event_state *state = &buffer->copies[(sequence / 2) % 2];
+    copy_state_to_event(state, event);
+    foreground_start_time = state->foreground_start_time;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    // the copy read is only rewritten by the update after the one which was
+    // in progress or next to start when it was read
+    const uint32_t latest =
+        __atomic_load_n(&buffer->sequence, __ATOMIC_RELAXED);
+    if (latest - sequence <= (sequence % 2 == 0 ? 2u : 1u)) {
+      break;
+    }
+  }
+  apply_session(buffer, event);
+  return foreground_start_time;
+}
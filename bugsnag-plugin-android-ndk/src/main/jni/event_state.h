@@ -0,0 +1,116 @@
+#ifndef BUGSNAG_ANDROID_EVENT_STATE_H
+#define BUGSNAG_ANDROID_EVENT_STATE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "event.h"
+#include "utils/build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The parts of the next event which the NativeBridge setters change while the
+ * app runs, such as the orientation, context and user
+ */
+typedef struct {
+  bsg_app_info app;
+  bsg_device_info device;
+  bugsnag_user user;
+  char context[64];
+  /**
+   * Time when last re-entering foreground, or 0 while in the background
+   */
+  time_t foreground_start_time;
+} bsg_event_state;
+
+typedef struct {
+  char id[33];
+  char start[33];
+} bsg_session_info;
+
+/**
+ * A double buffered bsg_event_state. Writers fill the spare copy and then
+ * publish it, so that a crash handler can always take the last complete copy
+ * without waiting, even if it interrupted a writer.
+ */
+typedef struct {
+  /**
+   * Odd while a writer is filling the spare copy. copies[(sequence / 2) % 2]
+   * is the last copy published.
+   */
+  uint32_t sequence;
+  bsg_event_state copies[2];
+
+  /**
+   * Whether a session is active, which slot of sessions it is in, and its
+   * handled and unhandled event counts, packed so that events can be counted
+   * and the session swapped without a lock. Any thread reporting an event
+   * writes this, so it starts a cache line of its own, away from the copies
+   * which the setters write.
+   */
+  uint64_t session_counts __bsg_cache_aligned;
+  /**
+   * Odd while a session is being started or paused, which fills the spare slot
+   * of sessions and then switches session_counts to it
+   */
+  uint32_t session_changes;
+  bsg_session_info sessions[2];
+} bsg_event_state_buffer;
+
+/**
+ * Take the initial state from an event, which must not yet be visible to a
+ * crash handler
+ */
+void bsg_event_state_init(bsg_event_state_buffer *buffer,
+                          const bugsnag_event *event,
+                          time_t foreground_start_time);
+
+/**
+ * The last copy published. Writers must hold their lock while reading it.
+ */
+const bsg_event_state *
+bsg_event_state_current(const bsg_event_state_buffer *buffer);
+
+/**
+ * Start a change to the state, returning the spare copy filled with the
+ * current state. Only one writer may do so at a time, and must finish with
+ * bsg_event_state_publish().
+ */
+bsg_event_state *bsg_event_state_begin_update(bsg_event_state_buffer *buffer);
+
+/**
+ * Make the copy returned by bsg_event_state_begin_update() current
+ */
+void bsg_event_state_publish(bsg_event_state_buffer *buffer);
+
+/**
+ * Start a session with existing event counts, or pause the current session if
+ * session_id is NULL. Only one caller may change the session at a time.
+ */
+void bsg_event_state_set_session(bsg_event_state_buffer *buffer,
+                                 const char *session_id, const char *started_at,
+                                 int handled_count, int unhandled_count);
+
+/**
+ * Count a handled or unhandled event in the current session without taking a
+ * lock. Returns false if there is no session.
+ */
+bool bsg_event_state_count_event(bsg_event_state_buffer *buffer,
+                                 bool unhandled) __asyncsafe;
+
+/**
+ * Copy the last complete state and session into an event, returning its
+ * foreground start time. Never blocks, as writers do not touch the copy being
+ * read unless they complete an update and start another meanwhile, in which
+ * case it is read again a limited number of times.
+ */
+time_t bsg_event_state_apply(const bsg_event_state_buffer *buffer,
+                             bugsnag_event *event) __asyncsafe;
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,172 @@
+#include "event_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bugsnag_ndk.h"
+#include "utils/crash_info.h"
+#include "utils/serializer/json_writer.h"
+#include "utils/string.h"
+#include "trace_common.h"
+
+typedef struct {
+  char *directory;
+  char *staging_directory;
+} bsg_event_store_dirs;
+
+/**
+ * The current directories, or NULL if events are not stored. Replaced
+ * directories are never freed, as an error may be being stored in them.
+ */
+static bsg_event_store_dirs *store_dirs = NULL;
+
+bool bsg_event_store_set_directory(const char *directory,
+                                   const char *staging_directory) {
+  if (directory == NULL || staging_directory == NULL) {
+    __atomic_store_n(&store_dirs, NULL, __ATOMIC_RELEASE);
+    return true;
+  }
+  bsg_event_store_dirs *dirs = calloc(1, sizeof(bsg_event_store_dirs));
+  if (dirs == NULL) {
+    return false;
+  }
+  dirs->directory = strdup(directory);
+  dirs->staging_directory = strdup(staging_directory);
+  if (dirs->directory == NULL || dirs->staging_directory == NULL) {
+    free(dirs->directory);
+    free(dirs->staging_directory);
+    free(dirs);
+    return false;
+  }
+  __atomic_store_n(&store_dirs, dirs, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool bsg_event_store_is_enabled(void) {
+  return __atomic_load_n(&store_dirs, __ATOMIC_ACQUIRE) != NULL;
+}
+
+static void random_uuid(char *uuid, size_t size) {
+  uint8_t bytes[16];
+  arc4random_buf(bytes, sizeof(bytes));
+  // version 4, variant 1
+  bytes[6] = (bytes[6] & 0x0f) | 0x40;
+  bytes[8] = (bytes[8] & 0x3f) | 0x80;
+  snprintf(uuid, size,
+           "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-"
+           "%02x%02x%02x%02x%02x%02x",
+           bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5],
+           bytes[6], bytes[7], bytes[8], bytes[9], bytes[10], bytes[11],
+           bytes[12], bytes[13], bytes[14], bytes[15]);
+}
+
+static void fill_error(bugsnag_event *event, const char *name,
+                       const char *message, bugsnag_severity severity,
+                       const bugsnag_stackframe *stacktrace,
+                       ssize_t frame_count) {
+  event->error.errorClass[0] = '\0';
+  event->error.errorMessage[0] = '\0';
+  bsg_strncpy(event->error.errorClass, name, sizeof(event->error.errorClass));
+  bsg_strncpy(event->error.errorMessage, message,
+              sizeof(event->error.errorMessage));
+  if (frame_count < 0) {
+    frame_count = 0;
+  } else if (frame_count > BUGSNAG_FRAMES_MAX) {
+    frame_count = BUGSNAG_FRAMES_MAX;
+  }
+  memcpy(event->error.stacktrace, stacktrace,
+         (size_t)frame_count * sizeof(bugsnag_stackframe));
+  event->error.frame_count = frame_count;
+  event->severity = severity;
+  event->unhandled = false;
+  bsg_increment_unhandled_count(event);
+}
+
+static bool write_payload(const char *path, const char *payload,
+                          size_t length) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    return false;
+  }
+  size_t written = 0;
+  while (written < length) {
+    const ssize_t result = write(fd, payload + written, length - written);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      break;
+    }
+    written += (size_t)result;
+  }
+  close(fd);
+  return written == length;
+}
+
+bool bsg_event_store_write(const char *name, const char *message,
+                           bugsnag_severity severity,
+                           const bugsnag_stackframe *stacktrace,
+                           ssize_t frame_count, int occurrences,
+                           int64_t window_ms, char *path, size_t path_size) {
+  const bsg_event_store_dirs *dirs =
+      __atomic_load_n(&store_dirs, __ATOMIC_ACQUIRE);
+  if (dirs == NULL) {
+    return false;
+  }
+  bugsnag_event *event = bsg_copy_next_event();
+  if (event == NULL) {
+    return false;
+  }
+  bool stored = false;
+  char *payload = NULL;
+  bsg_trace_begin("bugsnag:store-handled");
+
+  fill_error(event, name, message, severity, stacktrace, frame_count);
+  if (occurrences > 0) {
+    bugsnag_event_add_metadata_double(event, "aggregation", "occurrences",
+                                      (double)occurrences);
+    bugsnag_event_add_metadata_double(event, "aggregation", "windowMillis",
+                                      (double)window_ms);
+  }
+  payload = bsg_event_to_json_stream(event);
+  if (payload == NULL) {
+    goto exit;
+  }
+
+  // named as EventFilenameInfo encodes them, with the C error type
+  char uuid[37];
+  random_uuid(uuid, sizeof(uuid));
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  const long long timestamp_ms =
+      (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+  char staging_path[BSG_EVENT_STORE_PATH_MAX];
+  if (snprintf(staging_path, sizeof(staging_path), "%s/%s.handled",
+               dirs->staging_directory, uuid) >= (int)sizeof(staging_path) ||
+      snprintf(path, path_size, "%s/%lld_%s_c_%s_.json", dirs->directory,
+               timestamp_ms, event->api_key, uuid) >= (int)path_size) {
+    goto exit;
+  }
+  if (!write_payload(staging_path, payload, bsg_strlen(payload))) {
+    BUGSNAG_LOG("Failed to write handled event: %s", strerror(errno));
+    remove(staging_path);
+    goto exit;
+  }
+  // the store is only ever shown complete payloads
+  if (rename(staging_path, path) != 0) {
+    remove(staging_path);
+    goto exit;
+  }
+  stored = true;
+
+exit:
+  bsg_trace_end();
+  free(payload);
+  bsg_free_event_copy(event);
+  return stored;
+}
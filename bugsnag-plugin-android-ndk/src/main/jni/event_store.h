@@ -0,0 +1,57 @@
+/**
+ * Writes handled errors reported from native code straight to the JVM event
+ * store as JSON payloads, so that the JVM only has to be told where the file
+ * is, rather than building a Throwable and its stack frames and serializing
+ * the event again itself.
+ */
+#ifndef BUGSNAG_EVENT_STORE_H
+#define BUGSNAG_EVENT_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The longest path of a stored event, including the NUL */
+#define BSG_EVENT_STORE_PATH_MAX 512
+
+/**
+ * Set the directory of the event store, and the directory payloads are
+ * written to before they are moved into the store, which must be on the same
+ * file system so that the store never holds a partly written payload. A NULL
+ * directory stops handled errors being stored. Returns false if the
+ * directories could not be kept.
+ */
+bool bsg_event_store_set_directory(const char *directory,
+                                   const char *staging_directory);
+
+/**
+ * Whether handled errors are written to the event store
+ */
+bool bsg_event_store_is_enabled(void);
+
+/**
+ * Write a handled error with a symbolicated stacktrace to the event store,
+ * filling in a copy of the next event. Occurrences after the first within an
+ * aggregation window are added to its metadata if there were any. The path of
+ * the stored payload is copied to path.
+ *
+ * @return false if the error was not stored, in which case it should be
+ *         reported through the JVM instead
+ */
+bool bsg_event_store_write(const char *name, const char *message,
+                           bugsnag_severity severity,
+                           const bugsnag_stackframe *stacktrace,
+                           ssize_t frame_count, int occurrences,
+                           int64_t window_ms, char *path, size_t path_size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
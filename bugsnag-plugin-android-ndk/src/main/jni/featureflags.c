@@ -1,3 +1,5 @@
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "bugsnag_ndk.h"
@@ -21,8 +23,166 @@ extern "C" {
  * keys will always be in a known order.
  *
  * We resize the array using 'realloc' and 'memmove' to try and keep the
- * overhead reasonable.
+ * overhead reasonable. Batches of flags are instead sorted and merged into a
+ * new array in one pass, with all of their strings copied into one slab
+ * (event->feature_flag_strings), which is only released when the next batch
+ * replaces it or every flag is cleared.
+ *
+ * The flags are also kept encoded in event->feature_flags_encoded, in the same
+ * layout as bsg_write_feature_flags() in event_writer.c. Setting or clearing a
+ * single flag splices its entry into the encoding; if that cannot be done the
+ * encoding is dropped and rebuilt on the next change.
+ */
+
+/**
+ * The length prefix of a packed variant for a flag with no variant
  */
+#define BSG_PACKED_NO_VARIANT UINT32_MAX
+
+static bool is_slab_string(const bugsnag_event *event, const char *str) {
+  return event->feature_flag_strings != NULL &&
+         str >= event->feature_flag_strings &&
+         str < event->feature_flag_strings + event->feature_flag_strings_size;
+}
+
+static void release_flag_string(const bugsnag_event *event, char *str) {
+  if (!is_slab_string(event, str)) {
+    free(str);
+  }
+}
+
+static size_t encoded_flag_size(const char *name, const char *variant) {
+  size_t size = sizeof(uint32_t) + bsg_strlen(name) + 1;
+  if (variant) {
+    size += sizeof(uint32_t) + bsg_strlen(variant);
+  }
+  return size;
+}
+
+static char *encode_string(char *out, const char *str) {
+  const uint32_t length = bsg_strlen(str);
+  memcpy(out, &length, sizeof(length));
+  memcpy(out + sizeof(length), str, length);
+  return out + sizeof(length) + length;
+}
+
+static char *encode_flag(char *out, const bsg_feature_flag *flag) {
+  out = encode_string(out, flag->name);
+  *out++ = flag->variant ? 1 : 0;
+  if (flag->variant) {
+    out = encode_string(out, flag->variant);
+  }
+  return out;
+}
+
+static void encode_flag_count(bugsnag_event *event) {
+  const uint32_t count = event->feature_flag_count;
+  memcpy(event->feature_flags_encoded, &count, sizeof(count));
+}
+
+static void drop_encoded_flags(bugsnag_event *event) {
+  free(event->feature_flags_encoded);
+  event->feature_flags_encoded = NULL;
+  event->feature_flags_encoded_size = 0;
+}
+
+/**
+ * Set while memory is low, when the flags are written one at a time rather
+ * than keeping an encoded copy
+ */
+static bool encoding_suspended = false;
+
+/**
+ * Encode all of the flags from scratch
+ */
+static void encode_all_flags(bugsnag_event *event) {
+  if (encoding_suspended) {
+    drop_encoded_flags(event);
+    return;
+  }
+  size_t size = sizeof(uint32_t);
+  for (size_t index = 0; index < event->feature_flag_count; index++) {
+    const bsg_feature_flag *flag = &event->feature_flags[index];
+    size += encoded_flag_size(flag->name, flag->variant);
+  }
+
+  char *encoded = malloc(size);
+  drop_encoded_flags(event);
+  if (encoded == NULL) {
+    return;
+  }
+  event->feature_flags_encoded = encoded;
+  event->feature_flags_encoded_size = size;
+  encode_flag_count(event);
+
+  char *out = encoded + sizeof(uint32_t);
+  for (size_t index = 0; index < event->feature_flag_count; index++) {
+    out = encode_flag(out, &event->feature_flags[index]);
+  }
+}
+
+/**
+ * Find the offset of the flag at the given index in the encoding, stepping
+ * over the entries before it by their length prefixes
+ */
+static size_t encoded_flag_offset(const bugsnag_event *event, size_t index) {
+  const char *encoded = event->feature_flags_encoded;
+  size_t offset = sizeof(uint32_t);
+  uint32_t length;
+  for (size_t current = 0; current < index; current++) {
+    memcpy(&length, encoded + offset, sizeof(length));
+    offset += sizeof(length) + length;
+    if (encoded[offset++]) {
+      memcpy(&length, encoded + offset, sizeof(length));
+      offset += sizeof(length) + length;
+    }
+  }
+  return offset;
+}
+
+/**
+ * Replace the old_size bytes encoding the flag at index with the encoding of
+ * its current value, after the flag has been set or cleared in the array. The
+ * entry is removed if the flag was cleared.
+ */
+static void splice_encoded_flag(bugsnag_event *event, size_t index,
+                                size_t old_size, bool cleared) {
+  if (event->feature_flags_encoded == NULL) {
+    encode_all_flags(event);
+    return;
+  }
+
+  const bsg_feature_flag *flag = cleared ? NULL : &event->feature_flags[index];
+  const size_t new_size =
+      flag ? encoded_flag_size(flag->name, flag->variant) : 0;
+  const size_t offset = encoded_flag_offset(event, index);
+  const size_t tail_offset = offset + old_size;
+  const size_t tail_size = event->feature_flags_encoded_size - tail_offset;
+  const size_t size = event->feature_flags_encoded_size - old_size + new_size;
+
+  char *encoded = event->feature_flags_encoded;
+  if (new_size < old_size) {
+    // shrink after moving the tail, so it is not cut off
+    memmove(encoded + offset + new_size, encoded + tail_offset, tail_size);
+  }
+  if (new_size != old_size) {
+    encoded = realloc(encoded, size);
+    if (encoded == NULL) {
+      drop_encoded_flags(event);
+      return;
+    }
+  }
+  if (new_size > old_size) {
+    memmove(encoded + offset + new_size, encoded + tail_offset, tail_size);
+  }
+  if (flag) {
+    encode_flag(encoded + offset, flag);
+  }
+
+  event->feature_flags_encoded = encoded;
+  event->feature_flags_encoded_size = size;
+  encode_flag_count(event);
+}
 
 static int feature_flag_index(const bugsnag_event *env, const char *name) {
   // simple binary search for a feature-flag by name
@@ -70,9 +230,10 @@ void bsg_set_feature_flag(bugsnag_event *event, const char *name,
   if (expected_index >= 0) {
     // feature flag already exists, so we overwrite the variant
     bsg_feature_flag *flag = &event->feature_flags[expected_index];
+    const size_t old_size = encoded_flag_size(flag->name, flag->variant);
 
     // make sure we release the existing variant, if one exists
-    free(flag->variant);
+    release_flag_string(event, flag->variant);
 
     if (variant) {
       // make a copy of the variant, so that the JVM can have it's memory back
@@ -80,6 +241,7 @@ void bsg_set_feature_flag(bugsnag_event *event, const char *name,
     } else {
       flag->variant = NULL;
     }
+    splice_encoded_flag(event, expected_index, old_size, false);
   } else {
     int new_flag_index = -expected_index - 1;
 
@@ -104,6 +266,7 @@ void bsg_set_feature_flag(bugsnag_event *event, const char *name,
 
     event->feature_flags = new_flags;
     event->feature_flag_count = event->feature_flag_count + 1;
+    splice_encoded_flag(event, new_flag_index, 0, false);
   }
 }
 
@@ -116,10 +279,11 @@ void bsg_clear_feature_flag(bugsnag_event *event, const char *name) {
   }
 
   bsg_feature_flag *flag = &event->feature_flags[flag_index];
+  const size_t old_size = encoded_flag_size(flag->name, flag->variant);
 
   // release the memory held for name and possibly the variant
-  free(flag->name);
-  free(flag->variant);
+  release_flag_string(event, flag->name);
+  release_flag_string(event, flag->variant);
 
   // pack the array elements down to fill in the "gap"
   // we don't resize the array down by one, that gets handled when elements are
@@ -130,18 +294,255 @@ void bsg_clear_feature_flag(bugsnag_event *event, const char *name) {
 
   // mark the array as having one-less flag
   event->feature_flag_count = event->feature_flag_count - 1;
+  splice_encoded_flag(event, flag_index, old_size, true);
 }
 
 void bsg_free_feature_flags(bugsnag_event *event) {
   for (int index = 0; index < event->feature_flag_count; index++) {
-    free(event->feature_flags[index].name);
-    free(event->feature_flags[index].variant);
+    release_flag_string(event, event->feature_flags[index].name);
+    release_flag_string(event, event->feature_flags[index].variant);
   }
 
   free(event->feature_flags);
+  free(event->feature_flag_strings);
 
   event->feature_flags = NULL;
   event->feature_flag_count = 0;
+  event->feature_flag_strings = NULL;
+  event->feature_flag_strings_size = 0;
+  drop_encoded_flags(event);
+}
+
+typedef struct {
+  const char *name;
+  const char *variant;
+  /** The position in the batch, so that the last of duplicate names wins */
+  size_t order;
+} bsg_batched_flag;
+
+static int compare_batched_flags(const void *a, const void *b) {
+  const bsg_batched_flag *flag_a = a;
+  const bsg_batched_flag *flag_b = b;
+  int cmp = strcmp(flag_a->name, flag_b->name);
+  if (cmp != 0) {
+    return cmp;
+  }
+  return flag_a->order < flag_b->order ? -1 : 1;
+}
+
+/**
+ * Copy a string into the slab if there is one, or otherwise only count its
+ * size
+ */
+static char *slab_copy(const char *str, char *slab, size_t *slab_used) {
+  if (str == NULL) {
+    return NULL;
+  }
+  const size_t size = bsg_strlen(str) + 1;
+  char *copy = NULL;
+  if (slab != NULL) {
+    copy = slab + *slab_used;
+    memcpy(copy, str, size);
+  }
+  *slab_used += size;
+  return copy;
+}
+
+/**
+ * Merge the sorted existing flags with the sorted, de-duplicated batch,
+ * returning the number of flags in the result. If out is NULL, the result is
+ * only counted along with the slab size it needs.
+ */
+static size_t merge_flags(const bugsnag_event *event,
+                          const bsg_batched_flag *batch, size_t batch_count,
+                          bsg_feature_flag *out, char *slab,
+                          size_t *slab_used) {
+  size_t existing_index = 0;
+  size_t batch_index = 0;
+  size_t count = 0;
+
+  while (existing_index < event->feature_flag_count ||
+         batch_index < batch_count) {
+    const char *name;
+    const char *variant;
+    int cmp;
+    if (existing_index == event->feature_flag_count) {
+      cmp = 1;
+    } else if (batch_index == batch_count) {
+      cmp = -1;
+    } else {
+      cmp = strcmp(event->feature_flags[existing_index].name,
+                   batch[batch_index].name);
+    }
+
+    if (cmp < 0) {
+      name = event->feature_flags[existing_index].name;
+      variant = event->feature_flags[existing_index].variant;
+      existing_index++;
+    } else {
+      // the batch overwrites the variant of an existing flag
+      name = batch[batch_index].name;
+      variant = batch[batch_index].variant;
+      batch_index++;
+      if (cmp == 0) {
+        existing_index++;
+      }
+    }
+
+    char *name_copy = slab_copy(name, slab, slab_used);
+    char *variant_copy = slab_copy(variant, slab, slab_used);
+    if (out != NULL) {
+      out[count].name = name_copy;
+      out[count].variant = variant_copy;
+    }
+    count++;
+  }
+  return count;
+}
+
+bool bsg_set_feature_flags(bugsnag_event *event, const bsg_feature_flag *flags,
+                           size_t count) {
+  if (count == 0) {
+    return true;
+  }
+
+  bool result = false;
+  bsg_batched_flag *batch = calloc(count, sizeof(bsg_batched_flag));
+  bsg_feature_flag *merged = NULL;
+  char *slab = NULL;
+  if (batch == NULL) {
+    goto exit;
+  }
+
+  for (size_t index = 0; index < count; index++) {
+    batch[index].name = flags[index].name;
+    batch[index].variant = flags[index].variant;
+    batch[index].order = index;
+  }
+  qsort(batch, count, sizeof(bsg_batched_flag), compare_batched_flags);
+
+  // keep only the last flag set with each name
+  size_t batch_count = 0;
+  for (size_t index = 0; index < count; index++) {
+    if (batch_count > 0 &&
+        strcmp(batch[batch_count - 1].name, batch[index].name) == 0) {
+      batch[batch_count - 1] = batch[index];
+    } else {
+      batch[batch_count++] = batch[index];
+    }
+  }
+
+  size_t slab_size = 0;
+  const size_t merged_count =
+      merge_flags(event, batch, batch_count, NULL, NULL, &slab_size);
+  merged = calloc(merged_count, sizeof(bsg_feature_flag));
+  slab = malloc(slab_size);
+  if (merged == NULL || slab == NULL) {
+    goto exit;
+  }
+  size_t slab_used = 0;
+  merge_flags(event, batch, batch_count, merged, slab, &slab_used);
+
+  // the existing strings were all copied, so can now be released
+  bsg_free_feature_flags(event);
+  event->feature_flags = merged;
+  event->feature_flag_count = merged_count;
+  event->feature_flag_strings = slab;
+  event->feature_flag_strings_size = slab_size;
+  encode_all_flags(event);
+  merged = NULL;
+  slab = NULL;
+  result = true;
+
+exit:
+  free(batch);
+  free(merged);
+  free(slab);
+  return result;
+}
+
+/**
+ * Read the length of the next packed string, returning false if it does not
+ * fit in the buffer
+ */
+static bool read_packed_length(const char *packed, size_t length, size_t pos,
+                               bool optional, uint32_t *out_length) {
+  if (length - pos < sizeof(uint32_t)) {
+    return false;
+  }
+  memcpy(out_length, packed + pos, sizeof(uint32_t));
+  if (optional && *out_length == BSG_PACKED_NO_VARIANT) {
+    return true;
+  }
+  return *out_length <= length - pos - sizeof(uint32_t);
+}
+
+/**
+ * Move a packed string back over its length prefix and terminate it, so that
+ * it can be used in place. The output never overtakes the input, as each
+ * string only grows by the terminator while losing its 4 byte prefix.
+ */
+static char *unpack_string(char *packed, size_t *pos, size_t *out_pos,
+                           uint32_t string_length) {
+  char *str = packed + *out_pos;
+  memmove(str, packed + *pos + sizeof(uint32_t), string_length);
+  str[string_length] = '\0';
+  *pos += sizeof(uint32_t) + string_length;
+  *out_pos += string_length + 1;
+  return str;
+}
+
+bool bsg_set_packed_feature_flags(bugsnag_event *event, void *packed,
+                                  size_t length) {
+  char *bytes = packed;
+  uint32_t string_length;
+  size_t count = 0;
+
+  // check the whole batch before decoding it in place
+  for (size_t pos = 0; pos < length; count++) {
+    if (!read_packed_length(bytes, length, pos, false, &string_length)) {
+      return false;
+    }
+    pos += sizeof(uint32_t) + string_length;
+    if (!read_packed_length(bytes, length, pos, true, &string_length)) {
+      return false;
+    }
+    pos += sizeof(uint32_t);
+    if (string_length != BSG_PACKED_NO_VARIANT) {
+      pos += string_length;
+    }
+  }
+
+  bsg_feature_flag *flags = calloc(count, sizeof(bsg_feature_flag));
+  if (flags == NULL) {
+    return count == 0;
+  }
+  size_t pos = 0;
+  size_t out_pos = 0;
+  for (size_t index = 0; index < count; index++) {
+    read_packed_length(bytes, length, pos, false, &string_length);
+    flags[index].name = unpack_string(bytes, &pos, &out_pos, string_length);
+    read_packed_length(bytes, length, pos, true, &string_length);
+    if (string_length == BSG_PACKED_NO_VARIANT) {
+      pos += sizeof(uint32_t);
+    } else {
+      flags[index].variant =
+          unpack_string(bytes, &pos, &out_pos, string_length);
+    }
+  }
+
+  bool result = bsg_set_feature_flags(event, flags, count);
+  free(flags);
+  return result;
+}
+
+void bsg_feature_flags_set_low_memory(bugsnag_event *event, bool low_memory) {
+  encoding_suspended = low_memory;
+  if (low_memory) {
+    drop_encoded_flags(event);
+  } else if (event->feature_flags_encoded == NULL) {
+    encode_all_flags(event);
+  }
 }
 
 #ifdef __cplusplus
@@ -3,6 +3,10 @@
 
 #include "bugsnag_ndk.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * Set a feature flag in the given `bugsnag_event` with an optional variant.
  * This function will overwrite any existing feature flag with the specified
@@ -16,6 +20,33 @@
 void bsg_set_feature_flag(bugsnag_event *event, const char *name,
                           const char *variant);
 
+/**
+ * Set a batch of feature flags in the given `bugsnag_event`, as if each were
+ * set in turn with `bsg_set_feature_flag`. The batch is sorted once and merged
+ * with the existing flags, and the strings of all of the flags are copied into
+ * a single allocation.
+ *
+ * @param event the environment to populate with the given feature flags
+ * @param flags the names (may not be NULL) and optional variants to set, which
+ *              are copied
+ * @param count the number of flags
+ * @return false if memory could not be allocated, leaving the flags unchanged
+ */
+bool bsg_set_feature_flags(bugsnag_event *event, const bsg_feature_flag *flags,
+                           size_t count);
+
+/**
+ * Set a batch of feature flags passed from NativeBridge.addFeatureFlags. Each
+ * is packed as a uint32 length and the bytes of its name, followed by a uint32
+ * length and the bytes of its variant, or UINT32_MAX if it has none. The
+ * packed buffer is used as scratch space while it is decoded.
+ *
+ * @return false if the batch is malformed or memory could not be allocated, in
+ *         which case no flags are set
+ */
+bool bsg_set_packed_feature_flags(bugsnag_event *event, void *packed,
+                                  size_t length);
+
 /**
  * Release a specified feature flag from the given `bugsnag_event` if it
  * exists. If the flag does not exist this is a no-op and the `bugsnag_event`
@@ -37,4 +68,16 @@ void bsg_clear_feature_flag(bugsnag_event *event, const char *name);
  */
 void bsg_free_feature_flags(bugsnag_event *event);
 
+/**
+ * Drop the encoded copy of the feature flags while memory is low, which a
+ * crash handler then does without by writing the flags one at a time, and
+ * encode them again once memory recovers. Must be called with the same lock
+ * held as the other feature flag functions.
+ */
+void bsg_feature_flags_set_low_memory(bugsnag_event *event, bool low_memory);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // BUGSNAG_ANDROID_FEATUREFLAGS_H
@@ -1,13 +1,18 @@
 #include "cpp_handler.h"
+#include "cpp_throw_sites.h"
 #include <cxxabi.h>
 #include <exception>
 #include <pthread.h>
 #include <stdexcept>
 #include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "../utils/crash_info.h"
+#include "../utils/event_filter.h"
 #include "../utils/serializer.h"
 #include "../utils/string.h"
+#include "../utils/thread_context.h"
 #include "../utils/threads.h"
 /**
  * Previously installed termination handler
@@ -90,20 +95,64 @@ void bsg_handle_cpp_terminate() {
     return;
 
   bsg_global_env->handling_crash = true;
+  std::type_info *tinfo = __cxxabiv1::__cxa_current_exception_type();
+  // the throw site is gone by now, so only the class can be matched
+  if (bsg_event_filter_drops(tinfo != NULL ? tinfo->name() : NULL, 0, 0)) {
+    unlink(bsg_global_env->next_event_path);
+    bsg_global_env->crash_handled = true;
+    bsg_handler_uninstall_cpp();
+    if (bsg_global_terminate_previous != NULL) {
+      bsg_global_terminate_previous();
+    }
+    return;
+  }
+  bsg_start_handler_timing(&bsg_global_env->next_event);
   bsg_populate_event_as(bsg_global_env);
+  bsg_thread_context_apply((pid_t)syscall(SYS_gettid),
+                           &bsg_global_env->next_event);
+  bsg_end_handler_phase(&bsg_global_env->next_event,
+                        BSG_HANDLER_PHASE_POPULATE);
   bsg_global_env->next_event.unhandled = true;
-  bsg_global_env->next_event.error.frame_count =
-      bsg_unwind_stack(bsg_global_env->unwind_style,
-                       bsg_global_env->next_event.error.stacktrace, NULL, NULL);
+  // the stack is reported from where the exception was thrown if that was
+  // recorded, as by now it only holds the frames of std::terminate()
+  const size_t max_frames = bsg_stack_depth_limit(BSG_CAPTURE_CPP_TERMINATE);
+  uintptr_t throw_frames[BSG_THROW_FRAMES_MAX];
+  const ssize_t throw_frame_count = bsg_cpp_throw_site_frames(throw_frames);
+  if (throw_frame_count > 0) {
+    bsg_global_env->next_event.error.frame_count = bsg_stack_from_pcs(
+        throw_frames,
+        (size_t)throw_frame_count < max_frames ? throw_frame_count
+                                               : (ssize_t)max_frames,
+        bsg_global_env->next_event.error.stacktrace,
+        bsg_global_env->defer_symbolication
+            ? &bsg_global_env->next_event.frame_modules
+            : NULL);
+  } else if (bsg_global_env->defer_symbolication) {
+    bsg_global_env->next_event.error.frame_count = bsg_unwind_stack_deferred(
+        bsg_global_env->unwind_style,
+        bsg_global_env->next_event.error.stacktrace, max_frames,
+        &bsg_global_env->next_event.frame_modules, NULL, NULL);
+  } else {
+    bsg_global_env->next_event.error.frame_count =
+        bsg_unwind_stack(bsg_global_env->unwind_style,
+                         bsg_global_env->next_event.error.stacktrace,
+                         max_frames, NULL, NULL);
+  }
+  bsg_end_handler_phase(&bsg_global_env->next_event, BSG_HANDLER_PHASE_UNWIND);
 
   if (bsg_global_env->send_threads != SEND_THREADS_NEVER) {
     bsg_global_env->next_event.thread_count = bsg_capture_thread_states(
-        bsg_global_env->next_event.threads, BUGSNAG_THREADS_MAX);
+        bsg_global_env->task_dir_fd, bsg_global_env->next_event.threads,
+        bsg_global_env->thread_capture_max_count,
+        bsg_global_env->thread_capture_max_ns,
+        &bsg_global_env->next_event.threads_truncated);
   } else {
     bsg_global_env->next_event.thread_count = 0;
+    bsg_global_env->next_event.threads_truncated = false;
   }
+  bsg_end_handler_phase(&bsg_global_env->next_event,
+                        BSG_HANDLER_PHASE_THREADS);
 
-  std::type_info *tinfo = __cxxabiv1::__cxa_current_exception_type();
   if (tinfo != NULL) {
     bsg_strncpy(bsg_global_env->next_event.error.errorClass,
                 (char *)tinfo->name(),
@@ -115,8 +164,12 @@ void bsg_handle_cpp_terminate() {
   bsg_strncpy(bsg_global_env->next_event.error.errorMessage, (char *)message,
               message_length);
 
-  if (bsg_run_on_error()) {
+  const bool should_report = bsg_run_on_error();
+  bsg_end_handler_phase(&bsg_global_env->next_event,
+                        BSG_HANDLER_PHASE_ON_ERROR);
+  if (should_report) {
     bsg_increment_unhandled_count(&bsg_global_env->next_event);
+    bsg_event_freeze_breadcrumbs(&bsg_global_env->next_event);
     bsg_serialize_event_to_file(bsg_global_env);
     bsg_serialize_last_run_info_to_file(bsg_global_env);
   }
@@ -0,0 +1,100 @@
+#include "cpp_throw_sites.h"
+
+#include <string.h>
+
+bsg_throw_site *bsg_throw_ring_add(bsg_throw_ring *ring,
+                                   const void *exception) {
+  bsg_throw_site *site = &ring->sites[ring->next_site];
+  ring->next_site = (ring->next_site + 1) % BSG_THROW_SITES_MAX;
+  site->exception = exception;
+  site->frame_count = 0;
+  return site;
+}
+
+ssize_t bsg_throw_ring_find(const bsg_throw_ring *ring, const void *exception,
+                            uintptr_t *frames) {
+  for (unsigned i = 1; i <= BSG_THROW_SITES_MAX; i++) {
+    const bsg_throw_site *site =
+        &ring->sites[(ring->next_site + BSG_THROW_SITES_MAX - i) %
+                     BSG_THROW_SITES_MAX];
+    if (site->exception == exception) {
+      memcpy(frames, site->frames, sizeof(uintptr_t) * site->frame_count);
+      return site->frame_count;
+    }
+  }
+  return 0;
+}
+
+#if BSG_CAPTURE_THROW_SITES
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <typeinfo>
+
+#include "../utils/logger.h"
+#include "../utils/stack_unwinder_simple.h"
+
+// declared here rather than through cxxabi.h, which declares __cxa_throw
+// with a destructor type that varies between runtimes
+extern "C" void *__cxa_current_primary_exception() throw();
+extern "C" void __cxa_decrement_exception_refcount(void *exception) throw();
+
+namespace {
+
+/** Zero-initialized, so costs nothing until a thread first throws */
+thread_local bsg_throw_ring throw_ring;
+
+typedef void (*bsg_cxa_throw)(void *, std::type_info *, void (*)(void *));
+
+bsg_cxa_throw next_cxa_throw(void) {
+  static bsg_cxa_throw next = nullptr;
+  bsg_cxa_throw found = __atomic_load_n(&next, __ATOMIC_ACQUIRE);
+  if (found == nullptr) {
+    found = (bsg_cxa_throw)dlsym(RTLD_NEXT, "__cxa_throw");
+    __atomic_store_n(&next, found, __ATOMIC_RELEASE);
+  }
+  return found;
+}
+
+void record_throw(const void *exception, const void *frame) {
+  bsg_throw_ring *ring = &throw_ring;
+  if (!ring->bounds_known) {
+    // looking up the main thread's stack reads its maps, so is done once
+    ring->bounds_known = true;
+    if (!bsg_current_stack_bounds(&ring->stack_low, &ring->stack_high)) {
+      ring->stack_low = ring->stack_high = 0;
+    }
+  }
+  bsg_throw_site *site = bsg_throw_ring_add(ring, exception);
+  site->frame_count =
+      bsg_walk_frame_records(frame, ring->stack_low, ring->stack_high,
+                             site->frames, BSG_THROW_FRAMES_MAX);
+}
+
+} // namespace
+
+extern "C" __attribute__((visibility("default"), noreturn)) void
+__cxa_throw(void *thrown_exception, std::type_info *tinfo,
+            void (*dest)(void *)) {
+  record_throw(thrown_exception, __builtin_frame_address(0));
+  bsg_cxa_throw next = next_cxa_throw();
+  if (next == nullptr) {
+    BUGSNAG_LOG("Could not find __cxa_throw to throw with");
+    abort();
+  }
+  next(thrown_exception, tinfo, dest);
+  __builtin_unreachable();
+}
+
+ssize_t bsg_cpp_throw_site_frames(uintptr_t *frames) {
+  void *exception = __cxa_current_primary_exception();
+  if (exception == nullptr) {
+    return 0;
+  }
+  const ssize_t frame_count =
+      bsg_throw_ring_find(&throw_ring, exception, frames);
+  __cxa_decrement_exception_refcount(exception);
+  return frame_count;
+}
+#else
+ssize_t bsg_cpp_throw_site_frames(uintptr_t *frames) { return 0; }
+#endif
@@ -0,0 +1,77 @@
+#ifndef BUGSNAG_CPP_THROW_SITES_H
+#define BUGSNAG_CPP_THROW_SITES_H
+/**
+ * Records where C++ exceptions are thrown, so that an exception which reaches
+ * the terminate handler is reported with the stack it was thrown from rather
+ * than that of std::terminate(). Only built with BSG_CAPTURE_THROW_SITES, which
+ * interposes __cxa_throw for the libraries which resolve it through the
+ * dynamic linker after this one, such as those linked against bugsnag-ndk and
+ * the shared C++ runtime. A throw from a library with a static C++ runtime is
+ * not seen, and its exceptions are unwound from the terminate handler as
+ * before.
+ *
+ * Each thread keeps a ring of its last few throws, holding the return
+ * addresses of the frame records above the throw, so every throw pays only
+ * for a short frame pointer walk.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of throws each thread keeps */
+#define BSG_THROW_SITES_MAX 4
+
+/** The most frames recorded for each throw */
+#define BSG_THROW_FRAMES_MAX 16
+
+/** A throw, and the return addresses of the frames above it */
+typedef struct {
+  const void *exception;
+  ssize_t frame_count;
+  uintptr_t frames[BSG_THROW_FRAMES_MAX];
+} bsg_throw_site;
+
+/** The last few throws of a thread */
+typedef struct {
+  /** Whether the stack bounds have been looked up, on the first throw */
+  bool bounds_known;
+  uintptr_t stack_low;
+  uintptr_t stack_high;
+  /** The slot of the oldest throw, which the next throw replaces */
+  unsigned next_site;
+  bsg_throw_site sites[BSG_THROW_SITES_MAX];
+} bsg_throw_ring;
+
+/**
+ * Take the slot of the oldest throw in ring for a throw of exception, for the
+ * caller to fill in its frames
+ */
+bsg_throw_site *bsg_throw_ring_add(bsg_throw_ring *ring, const void *exception);
+
+/**
+ * Copy the frames of the latest throw of exception in ring into frames, which
+ * must hold BSG_THROW_FRAMES_MAX. The latest throw is searched for first, as
+ * the memory of an exception may be reused by a later one.
+ *
+ * @return the number of frames, or 0 if the throw is not in the ring
+ */
+ssize_t bsg_throw_ring_find(const bsg_throw_ring *ring, const void *exception,
+                            uintptr_t *frames);
+
+/**
+ * Copy the frames recorded when the exception currently being handled was
+ * thrown into frames, which must hold BSG_THROW_FRAMES_MAX. Only throws from
+ * the calling thread are found.
+ *
+ * @return the number of frames, or 0 if the throw was not recorded
+ */
+ssize_t bsg_cpp_throw_site_frames(uintptr_t *frames);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -9,11 +9,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
+#include "../utils/crash_helper.h"
 #include "../utils/crash_info.h"
+#include "../utils/crash_signatures.h"
+#include "../utils/crash_watchdog.h"
+#include "../utils/event_filter.h"
 #include "../utils/serializer.h"
+#include "../utils/stack_unwinder_simple.h"
 #include "../utils/string.h"
+#include "../utils/thread_context.h"
 #include "../utils/threads.h"
 #define BSG_HANDLED_SIGNAL_COUNT 6
 
@@ -163,35 +170,149 @@ void bsg_invoke_previous_signal_handler(int signum, siginfo_t *info,
   }
 }
 
-void bsg_handle_signal(int signum, siginfo_t *info,
-                       void *user_context) __asyncsafe {
-  if (bsg_global_env == NULL) {
-    return;
+/*
+ * The shares of crash_deadline_ns, in eighths, by which each stage of the
+ * signal handler must end. The rest is left for writing the report.
+ */
+#define BSG_UNWIND_DEADLINE_EIGHTHS 4
+#define BSG_THREADS_DEADLINE_EIGHTHS 6
+#define BSG_ON_ERROR_DEADLINE_EIGHTHS 7
+
+/**
+ * How long the crashing thread waits on the crash helper without a crash
+ * deadline, after which the signal is passed on regardless
+ */
+#define BSG_CRASH_HELPER_TIMEOUT_NS 2000000000ULL
+
+/**
+ * When a stage of the handler must end, or 0 if there is no crash deadline
+ */
+static uint64_t stage_deadline(uint64_t eighths) {
+  const uint64_t budget = bsg_global_env->crash_deadline_ns;
+  if (budget == 0) {
+    return 0;
   }
-  if (bsg_global_env->handling_crash) {
-    if (bsg_global_env->crash_handled) {
-      // The C++ handler default action is to raise a fatal signal once
-      // handling is complete. The report is already generated so at this
-      // point, the handler only needs to be uninstalled.
-      bsg_handler_uninstall_signal();
-      bsg_invoke_previous_signal_handler(signum, info, user_context);
+  return bsg_global_env->next_event.handler_timing.started_ns +
+         budget / 8 * eighths;
+}
+
+static void unwind_crash_stack(siginfo_t *info, void *user_context) {
+  bugsnag_event *event = &bsg_global_env->next_event;
+  const size_t max_frames = bsg_stack_depth_limit(BSG_CAPTURE_SIGNAL);
+  if (sigsetjmp(bsg_crash_watchdog_jump, 1) == 0) {
+    bsg_crash_watchdog_arm(stage_deadline(BSG_UNWIND_DEADLINE_EIGHTHS));
+    if (bsg_global_env->defer_symbolication) {
+      event->error.frame_count = bsg_unwind_stack_deferred(
+          bsg_global_env->signal_unwind_style, event->error.stacktrace,
+          max_frames, &event->frame_modules, info, user_context);
+    } else {
+      event->error.frame_count = bsg_unwind_stack(
+          bsg_global_env->signal_unwind_style, event->error.stacktrace,
+          max_frames, info, user_context);
     }
+    bsg_crash_watchdog_disarm();
+  } else {
+    // the abandoned unwinder may hold the linker lock, so the crash address
+    // is left to be symbolicated on delivery where possible
+    event->handler_fallbacks |= BSG_HANDLER_FALLBACK_PC_ONLY;
+    event->error.frame_count = bsg_unwind_stack_deferred(
+        BSG_CUSTOM_UNWIND, event->error.stacktrace, max_frames,
+        &event->frame_modules, info, user_context);
+  }
+}
+
+static void capture_crash_threads(void) {
+  bugsnag_event *event = &bsg_global_env->next_event;
+  event->thread_count = 0;
+  event->threads_truncated = false;
+  if (bsg_global_env->send_threads == SEND_THREADS_NEVER) {
     return;
   }
 
-  bsg_global_env->handling_crash = true;
-  bsg_global_env->next_event.unhandled = true;
-  bsg_populate_event_as(bsg_global_env);
-  bsg_global_env->next_event.error.frame_count = bsg_unwind_stack(
-      bsg_global_env->signal_unwind_style,
-      bsg_global_env->next_event.error.stacktrace, info, user_context);
+  const uint64_t deadline = stage_deadline(BSG_THREADS_DEADLINE_EIGHTHS);
+  uint64_t max_ns = bsg_global_env->thread_capture_max_ns;
+  if (deadline != 0) {
+    const uint64_t remaining = bsg_crash_watchdog_remaining_ns(deadline);
+    if (remaining == 0) {
+      event->threads_truncated = true;
+      event->handler_fallbacks |= BSG_HANDLER_FALLBACK_THREADS_SKIPPED;
+      return;
+    }
+    if (max_ns == 0 || remaining < max_ns) {
+      max_ns = remaining;
+    }
+  }
 
-  if (bsg_global_env->send_threads != SEND_THREADS_NEVER) {
-    bsg_global_env->next_event.thread_count = bsg_capture_thread_states(
-        bsg_global_env->next_event.threads, BUGSNAG_THREADS_MAX);
+  if (sigsetjmp(bsg_crash_watchdog_jump, 1) == 0) {
+    // the budget usually ends the capture first, leaving the watchdog for a
+    // read which stalls
+    bsg_crash_watchdog_arm(deadline);
+    event->thread_count = bsg_capture_thread_states(
+        bsg_global_env->task_dir_fd, event->threads,
+        bsg_global_env->thread_capture_max_count, max_ns,
+        &event->threads_truncated);
+    bsg_crash_watchdog_disarm();
   } else {
-    bsg_global_env->next_event.thread_count = 0;
+    event->thread_count = 0;
+    event->threads_truncated = true;
+    event->handler_fallbacks |= BSG_HANDLER_FALLBACK_THREADS_SKIPPED;
+  }
+}
+
+/**
+ * Run the on_error callback if there is time for it. The event is reported
+ * if the callback is skipped or interrupted.
+ */
+static bool run_crash_on_error(void) {
+  bugsnag_event *event = &bsg_global_env->next_event;
+  const uint64_t deadline = stage_deadline(BSG_ON_ERROR_DEADLINE_EIGHTHS);
+  if (!bsg_crash_watchdog_expired(deadline) &&
+      sigsetjmp(bsg_crash_watchdog_jump, 1) == 0) {
+    bsg_crash_watchdog_arm(deadline);
+    const bool should_report = bsg_run_on_error();
+    bsg_crash_watchdog_disarm();
+    return should_report;
+  }
+  event->handler_fallbacks |= BSG_HANDLER_FALLBACK_ON_ERROR_SKIPPED;
+  return true;
+}
+
+/**
+ * Whether the stack was unwound before the crash was handed to the helper
+ */
+static bool bsg_crash_stack_unwound = false;
+
+/**
+ * Write the report unless the same crash already has a report waiting to be
+ * delivered, in which case only the count of its repeats is bumped
+ */
+static void write_event_unless_repeat(int signum) {
+  const uint64_t signature =
+      bsg_crash_signature(&bsg_global_env->next_event, signum);
+  if (bsg_crash_signatures_count_repeat(signature)) {
+    // the prepared file would be discarded unread on the next launch anyway
+    unlink(bsg_global_env->next_event_path);
+    return;
+  }
+  if (bsg_serialize_event_to_file(bsg_global_env)) {
+    bsg_crash_signatures_add(signature, bsg_global_env->next_event_path);
   }
+}
+
+/**
+ * Write the report of a fatal signal after the event has been populated,
+ * either on the crashing thread or on the crash helper
+ */
+static void write_crash_report(int signum, siginfo_t *info,
+                               void *user_context) {
+  if (!bsg_crash_stack_unwound) {
+    unwind_crash_stack(info, user_context);
+  }
+  bsg_end_handler_phase(&bsg_global_env->next_event, BSG_HANDLER_PHASE_UNWIND);
+
+  capture_crash_threads();
+  bsg_end_handler_phase(&bsg_global_env->next_event,
+                        BSG_HANDLER_PHASE_THREADS);
 
   for (int i = 0; i < BSG_HANDLED_SIGNAL_COUNT; i++) {
     const int signal = bsg_native_signals[i];
@@ -205,11 +326,92 @@ void bsg_handle_signal(int signum, siginfo_t *info,
       break;
     }
   }
-  if (bsg_run_on_error()) {
+  const bool should_report = run_crash_on_error();
+  bsg_end_handler_phase(&bsg_global_env->next_event,
+                        BSG_HANDLER_PHASE_ON_ERROR);
+  if (should_report) {
     bsg_increment_unhandled_count(&bsg_global_env->next_event);
-    bsg_serialize_event_to_file(bsg_global_env);
+    bsg_event_freeze_breadcrumbs(&bsg_global_env->next_event);
+    write_event_unless_repeat(signum);
     bsg_serialize_last_run_info_to_file(bsg_global_env);
   }
+}
+
+/**
+ * How long the crashing thread waits on the helper: until the crash deadline
+ * if there is one
+ */
+static uint64_t crash_helper_timeout(void) {
+  const uint64_t deadline = stage_deadline(8);
+  if (deadline == 0) {
+    return BSG_CRASH_HELPER_TIMEOUT_NS;
+  }
+  return bsg_crash_watchdog_remaining_ns(deadline);
+}
+
+/**
+ * The error class reported for a handled signal, or NULL if it is not one
+ */
+static const char *signal_name(int signum) {
+  for (int i = 0; i < BSG_HANDLED_SIGNAL_COUNT; i++) {
+    if (bsg_native_signals[i] == signum) {
+      return bsg_native_signal_names[i];
+    }
+  }
+  return NULL;
+}
+
+bool bsg_handler_set_crash_helper(bool enabled) {
+  if (!enabled) {
+    bsg_crash_helper_stop();
+    return true;
+  }
+  return bsg_crash_helper_start(write_crash_report);
+}
+
+void bsg_handle_signal(int signum, siginfo_t *info,
+                       void *user_context) __asyncsafe {
+  if (bsg_global_env == NULL) {
+    return;
+  }
+  if (bsg_global_env->handling_crash) {
+    if (bsg_global_env->crash_handled) {
+      // The C++ handler default action is to raise a fatal signal once
+      // handling is complete. The report is already generated so at this
+      // point, the handler only needs to be uninstalled.
+      bsg_handler_uninstall_signal();
+      bsg_invoke_previous_signal_handler(signum, info, user_context);
+    }
+    return;
+  }
+
+  bsg_global_env->handling_crash = true;
+  if (bsg_event_filter_drops(signal_name(signum), signum,
+                             bsg_context_pc(info, user_context))) {
+    // nothing is captured, and the prepared file is left unwritten
+    unlink(bsg_global_env->next_event_path);
+    bsg_handler_uninstall_signal();
+    bsg_invoke_previous_signal_handler(signum, info, user_context);
+    return;
+  }
+  bsg_start_handler_timing(&bsg_global_env->next_event);
+  bsg_global_env->next_event.unhandled = true;
+  bsg_populate_event_as(bsg_global_env);
+  // only the crashing thread can be found here, before any hand off
+  bsg_thread_context_apply((pid_t)syscall(SYS_gettid),
+                           &bsg_global_env->next_event);
+  bsg_end_handler_phase(&bsg_global_env->next_event,
+                        BSG_HANDLER_PHASE_POPULATE);
+  // unwinders which walk the current thread cannot run on the helper
+  bsg_crash_stack_unwound =
+      bsg_global_env->signal_unwind_style == BSG_LIBUNWIND;
+  if (bsg_crash_stack_unwound) {
+    unwind_crash_stack(info, user_context);
+  }
+  if (!bsg_crash_helper_hand_off(signum, info, user_context,
+                                 crash_helper_timeout())) {
+    write_crash_report(signum, info, user_context);
+  }
   bsg_handler_uninstall_signal();
   bsg_invoke_previous_signal_handler(signum, info, user_context);
 }
\ No newline at end of file
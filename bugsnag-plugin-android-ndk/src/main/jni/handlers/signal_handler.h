@@ -18,6 +18,8 @@
  * * sigaction(2), sigaltstack(2)
  */
 
+#include <signal.h>
+
 #include "../utils/build.h"
 #include "bugsnag_ndk.h"
 
@@ -37,6 +39,19 @@ bool bsg_handler_install_signal(bsg_environment *env);
  */
 void bsg_handler_uninstall_signal(void) __asyncsafe;
 
+/**
+ * Write the reports of fatal signals from a helper thread started now, rather
+ * than on the crashing thread, which waits for the helper. Returns false if
+ * the helper could not be started. The helper stays parked once disabled.
+ */
+bool bsg_handler_set_crash_helper(bool enabled);
+
+/**
+ * The alternate stack used to handle signals, which is empty until
+ * bsg_handler_install_signal() has succeeded
+ */
+extern stack_t bsg_global_signal_stack;
+
 #ifdef __cplusplus
 }
 #endif
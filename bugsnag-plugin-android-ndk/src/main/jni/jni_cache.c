@@ -3,52 +3,18 @@
 //
 
 #include "jni_cache.h"
+#include "jni_common_cache.h"
 #include "safejni.h"
 #include "utils/logger.h"
-#include <pthread.h>
-
-#define JNI_VERSION JNI_VERSION_1_6
 
 static bsg_jni_cache_t jni_cache;
 bsg_jni_cache_t *const bsg_jni_cache = &jni_cache;
 
-static pthread_key_t jni_cleanup_key;
-
-static void detach_java_env(void *env) {
-  if (bsg_jni_cache->initialized && env != NULL) {
-    (*bsg_jni_cache->jvm)->DetachCurrentThread(bsg_jni_cache->jvm);
-  }
-}
-
 JNIEnv *bsg_jni_cache_get_env() {
   if (!bsg_jni_cache->initialized) {
     return NULL;
   }
-
-  JNIEnv *env = NULL;
-  switch ((*bsg_jni_cache->jvm)
-              ->GetEnv(bsg_jni_cache->jvm, (void **)&env, JNI_VERSION)) {
-  case JNI_OK:
-    return env;
-  case JNI_EDETACHED:
-    if ((*bsg_jni_cache->jvm)
-            ->AttachCurrentThread(bsg_jni_cache->jvm, &env, NULL) != JNI_OK) {
-      BUGSNAG_LOG("Could not attach thread to JVM");
-      return NULL;
-    }
-    if (env == NULL) {
-      BUGSNAG_LOG("AttachCurrentThread filled a NULL JNIEnv");
-      return NULL;
-    }
-
-    // attach a destructor to detach the env before the thread terminates
-    pthread_setspecific(jni_cleanup_key, env);
-
-    return env;
-  default:
-    BUGSNAG_LOG("Could not get JNIEnv");
-    return NULL;
-  }
+  return bsg_jni_common_get_env();
 }
 
 // All classes must be cached as global refs
@@ -96,11 +62,11 @@ bool bsg_jni_cache_init(JNIEnv *env) {
     return true;
   }
 
-  (*env)->GetJavaVM(env, &bsg_jni_cache->jvm);
-  if (bsg_jni_cache->jvm == NULL) {
-    BUGSNAG_LOG("JNI Cache Init Error: Could not get global JavaVM");
+  // the VM, and the platform classes shared with the ANR plugin
+  if (!bsg_jni_common_cache_init(env)) {
     goto failed;
   }
+  bsg_jni_cache->jvm = bsg_jni_common_cache->jvm;
 
   CACHE_CLASS(Boolean, "java/lang/Boolean");
   CACHE_METHOD(Boolean, Boolean_booleanValue, "booleanValue", "()Z");
@@ -142,14 +108,28 @@ bool bsg_jni_cache_init(JNIEnv *env) {
                       "getMetadata", "()Ljava/util/Map;");
   CACHE_STATIC_METHOD(NativeInterface, NativeInterface_getContext, "getContext",
                       "()Ljava/lang/String;");
+  CACHE_STATIC_METHOD(NativeInterface, NativeInterface_getStateSnapshot,
+                      "getStateSnapshot", "()[B");
   CACHE_STATIC_METHOD(
       NativeInterface, NativeInterface_notify, "notify",
       "([B[BLcom/bugsnag/android/Severity;[Ljava/lang/StackTraceElement;)V");
+  CACHE_STATIC_METHOD(NativeInterface, NativeInterface_notifyAggregated,
+                      "notifyAggregated",
+                      "([B[BLcom/bugsnag/android/Severity;[Ljava/lang/"
+                      "StackTraceElement;IJ)V");
   CACHE_STATIC_METHOD(NativeInterface, NativeInterface_deliverReport,
                       "deliverReport", "([B[BLjava/lang/String;Z)V");
+  CACHE_STATIC_METHOD(NativeInterface, NativeInterface_deliverReportBuffer,
+                      "deliverReport",
+                      "([BLjava/nio/ByteBuffer;Ljava/lang/String;Z)V");
+  CACHE_STATIC_METHOD(NativeInterface, NativeInterface_deliverStoredEvent,
+                      "deliverStoredEvent",
+                      "(Ljava/lang/String;Ljava/lang/String;)V");
   CACHE_STATIC_METHOD(NativeInterface, NativeInterface_leaveBreadcrumb,
                       "leaveBreadcrumb",
                       "([BLcom/bugsnag/android/BreadcrumbType;)V");
+  CACHE_STATIC_METHOD(NativeInterface, NativeInterface_leaveNativeBreadcrumbs,
+                      "leaveNativeBreadcrumbs", "([B)V");
 
   CACHE_CLASS(StackTraceElement, "java/lang/StackTraceElement");
   CACHE_METHOD(StackTraceElement, StackTraceElement_constructor, "<init>",
@@ -159,8 +139,6 @@ bool bsg_jni_cache_init(JNIEnv *env) {
 
   CACHE_CLASS(BreadcrumbType, "com/bugsnag/android/BreadcrumbType");
 
-  pthread_key_create(&jni_cleanup_key, detach_java_env);
-
   bsg_jni_cache->initialized = true;
   return true;
 
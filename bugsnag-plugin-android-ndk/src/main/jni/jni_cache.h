@@ -49,9 +49,14 @@ typedef struct {
   jmethodID NativeInterface_setUser;
   jmethodID NativeInterface_getMetadata;
   jmethodID NativeInterface_getContext;
+  jmethodID NativeInterface_getStateSnapshot;
   jmethodID NativeInterface_notify;
+  jmethodID NativeInterface_notifyAggregated;
   jmethodID NativeInterface_leaveBreadcrumb;
+  jmethodID NativeInterface_leaveNativeBreadcrumbs;
   jmethodID NativeInterface_deliverReport;
+  jmethodID NativeInterface_deliverReportBuffer;
+  jmethodID NativeInterface_deliverStoredEvent;
 
   jclass StackTraceElement;
   jmethodID StackTraceElement_constructor;
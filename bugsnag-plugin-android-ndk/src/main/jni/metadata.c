@@ -1,6 +1,8 @@
 #include "metadata.h"
 #include "jni_cache.h"
 #include "safejni.h"
+#include "trace_common.h"
+#include "utils/logger.h"
 #include "utils/string.h"
 #include <malloc.h>
 #include <string.h>
@@ -336,232 +338,73 @@ static void populate_context(JNIEnv *env, bugsnag_event *event) {
   bsg_safe_delete_local_ref(env, _context);
 }
 
-static void populate_metadata_value(JNIEnv *env, bugsnag_metadata *dst,
-                                    const char *section, const char *name,
-                                    jobject _value) {
-  if (!bsg_jni_cache->initialized) {
-    return;
-  }
-
-  if (bsg_safe_is_instance_of(env, _value, bsg_jni_cache->number)) {
-    // add a double metadata value
-    double value = bsg_safe_call_double_method(
-        env, _value, bsg_jni_cache->number_double_value);
-    bsg_add_metadata_value_double(dst, section, name, value);
-  } else if (bsg_safe_is_instance_of(env, _value, bsg_jni_cache->Boolean)) {
-    // add a boolean metadata value
-    bool value = bsg_safe_call_boolean_method(
-        env, _value, bsg_jni_cache->Boolean_booleanValue);
-    bsg_add_metadata_value_bool(dst, section, name, value);
-  } else if (bsg_safe_is_instance_of(env, _value, bsg_jni_cache->String)) {
-    const char *value = bsg_safe_get_string_utf_chars(env, _value);
-    if (value != NULL) {
-      bsg_add_metadata_value_str(dst, section, name, value);
-    }
-  }
-}
-
-static void populate_metadata_obj(JNIEnv *env, bugsnag_metadata *dst,
-                                  jobject section, jobject section_keylist,
-                                  int index) {
-  jstring section_key = NULL;
-  const char *name = NULL;
-  jobject _value = NULL;
-
-  if (!bsg_jni_cache->initialized) {
-    goto exit;
-  }
-
-  section_key = bsg_safe_call_object_method(
-      env, section_keylist, bsg_jni_cache->ArrayList_get, (jint)index);
-  if (section_key == NULL) {
-    goto exit;
-  }
-
-  _value = bsg_safe_call_object_method(env, section, bsg_jni_cache->Map_get,
-                                       section_key);
-  name = bsg_safe_get_string_utf_chars(env, section_key);
-  if (name == NULL) {
-    goto exit;
-  }
-
-  populate_metadata_value(env, dst, section, name, _value);
-
-exit:
-  bsg_safe_release_string_utf_chars(env, section_key, name);
-  bsg_safe_delete_local_ref(env, section_key);
-  bsg_safe_delete_local_ref(env, _value);
-}
-
-static void populate_metadata_section(JNIEnv *env, bugsnag_metadata *dst,
-                                      jobject metadata, jobject keylist,
-                                      int i) {
-  jstring _key = NULL;
-  const char *section = NULL;
-  jobject _section = NULL;
-  jobject section_keyset = NULL;
-  jobject section_keylist = NULL;
-
-  if (!bsg_jni_cache->initialized) {
-    goto exit;
-  }
-
-  _key = bsg_safe_call_object_method(env, keylist, bsg_jni_cache->ArrayList_get,
-                                     (jint)i);
-  if (_key == NULL) {
-    goto exit;
-  }
-  section = bsg_safe_get_string_utf_chars(env, _key);
-  if (section == NULL) {
-    goto exit;
-  }
-  _section =
-      bsg_safe_call_object_method(env, metadata, bsg_jni_cache->Map_get, _key);
-  if (_section == NULL) {
-    goto exit;
-  }
-  jint section_size =
-      bsg_safe_call_int_method(env, _section, bsg_jni_cache->Map_size);
-  if (section_size == -1) {
-    goto exit;
-  }
-  section_keyset =
-      bsg_safe_call_object_method(env, _section, bsg_jni_cache->Map_keySet);
-  if (section_keyset == NULL) {
-    goto exit;
-  }
-
-  section_keylist =
-      bsg_safe_new_object(env, bsg_jni_cache->ArrayList,
-                          bsg_jni_cache->ArrayList_constructor, section_keyset);
-  if (section_keylist == NULL) {
-    goto exit;
-  }
-  for (int j = 0; j < section_size; j++) {
-    populate_metadata_obj(env, dst, _section, section_keylist, j);
-  }
-  goto exit;
-
-exit:
-  bsg_safe_release_string_utf_chars(env, _key, section);
-  bsg_safe_delete_local_ref(env, _key);
-  bsg_safe_delete_local_ref(env, _section);
-  bsg_safe_delete_local_ref(env, section_keyset);
-  bsg_safe_delete_local_ref(env, section_keylist);
-}
-
 // Internal API
 
-void bsg_populate_metadata(JNIEnv *env, bugsnag_metadata *dst,
-                           jobject metadata) {
-  jobject _metadata = NULL;
-  jobject keyset = NULL;
-  jobject keylist = NULL;
-
-  if (!bsg_jni_cache->initialized) {
-    goto exit;
-  }
-
-  if (metadata == NULL) {
-    _metadata = bsg_safe_call_static_object_method(
-        env, bsg_jni_cache->NativeInterface,
-        bsg_jni_cache->NativeInterface_getMetadata);
-    metadata = _metadata;
-  }
-
-  if (metadata == NULL) {
-    dst->value_count = 0;
-    goto exit;
-  }
-
-  int size = bsg_safe_call_int_method(env, metadata, bsg_jni_cache->Map_size);
-  if (size == -1) {
-    goto exit;
-  }
-
-  // create a list of metadata keys
-  keyset = bsg_safe_call_static_object_method(env, metadata,
-                                              bsg_jni_cache->Map_keySet);
-  if (keyset == NULL) {
-    goto exit;
-  }
-  keylist = bsg_safe_new_object(env, bsg_jni_cache->ArrayList,
-                                bsg_jni_cache->ArrayList_constructor, keyset);
-  if (keylist == NULL) {
-    goto exit;
+void bsg_populate_crumb_metadata(JNIEnv *env, void *record, uint32_t capacity,
+                                 jbyteArray metadata, jsize length) {
+  if (length <= 0 || (uint32_t)length > capacity) {
+    return;
   }
 
-  for (int i = 0; i < size; i++) {
-    populate_metadata_section(env, dst, metadata, keylist, i);
+  // copy the whole buffer in one call, rather than walking the map in Java,
+  // to the end of the record where it is decoded in place
+  jbyte *packed = (jbyte *)record + (capacity - (uint32_t)length);
+  if (bsg_safe_get_byte_array_region(env, metadata, 0, length, packed) &&
+      !bsg_crumb_record_add_packed(record, capacity, packed, (size_t)length)) {
+    BUGSNAG_LOG("Malformed breadcrumb metadata");
   }
-
-exit:
-  bsg_safe_delete_local_ref(env, _metadata);
-  bsg_safe_delete_local_ref(env, keyset);
-  bsg_safe_delete_local_ref(env, keylist);
 }
 
-void bsg_populate_crumb_metadata(JNIEnv *env, bugsnag_breadcrumb *crumb,
-                                 jobject metadata) {
-  jobject keyset = NULL;
-  jobject keylist = NULL;
-
-  if (metadata == NULL) {
-    goto exit;
-  }
-  if (!bsg_jni_cache->initialized) {
-    goto exit;
-  }
-
-  // get size of metadata map
-  jint map_size =
-      bsg_safe_call_int_method(env, metadata, bsg_jni_cache->Map_size);
-  if (map_size == -1) {
+/**
+ * Fill the event from NativeInterface.getStateSnapshot(), returning false if
+ * the snapshot could not be read
+ */
+static bool populate_from_snapshot(JNIEnv *env, bugsnag_event *event) {
+  bool populated = false;
+  jbyte *snapshot = NULL;
+  jbyteArray _snapshot = bsg_safe_call_static_object_method(
+      env, bsg_jni_cache->NativeInterface,
+      bsg_jni_cache->NativeInterface_getStateSnapshot);
+  if (_snapshot == NULL) {
     goto exit;
   }
-
-  // create a list of metadata keys
-  keyset =
-      bsg_safe_call_object_method(env, metadata, bsg_jni_cache->Map_keySet);
-  if (keyset == NULL) {
+  const jsize length = bsg_safe_get_array_length(env, _snapshot);
+  if (length <= 0) {
     goto exit;
   }
-  keylist = bsg_safe_new_object(env, bsg_jni_cache->ArrayList,
-                                bsg_jni_cache->ArrayList_constructor, keyset);
-  if (keylist == NULL) {
+  snapshot = malloc((size_t)length);
+  if (snapshot == NULL ||
+      !bsg_safe_get_byte_array_region(env, _snapshot, 0, length, snapshot)) {
     goto exit;
   }
-
-  for (int i = 0; i < map_size; i++) {
-    jstring _key = bsg_safe_call_object_method(
-        env, keylist, bsg_jni_cache->ArrayList_get, (jint)i);
-    jobject _value = bsg_safe_call_object_method(env, metadata,
-                                                 bsg_jni_cache->Map_get, _key);
-
-    if (_key != NULL && _value != NULL) {
-      const char *key = bsg_safe_get_string_utf_chars(env, _key);
-      if (key != NULL) {
-        populate_metadata_value(env, &crumb->metadata, "metaData", key, _value);
-        bsg_safe_release_string_utf_chars(env, _key, key);
-      }
-    }
-    bsg_safe_delete_local_ref(env, _key);
-    bsg_safe_delete_local_ref(env, _value);
+  populated = bsg_event_apply_state_snapshot(event, snapshot, (size_t)length);
+  if (populated) {
+    bsg_strncpy(event->device.os_name, bsg_os_name(),
+                sizeof(event->device.os_name));
+  } else {
+    BUGSNAG_LOG("Malformed state snapshot, reading the state maps instead");
   }
 
 exit:
-  bsg_safe_delete_local_ref(env, keyset);
-  bsg_safe_delete_local_ref(env, keylist);
+  free(snapshot);
+  bsg_safe_delete_local_ref(env, _snapshot);
+  return populated;
 }
 
 void bsg_populate_event(JNIEnv *env, bugsnag_event *event) {
   if (!bsg_jni_cache->initialized) {
     return;
   }
-  populate_context(env, event);
-  populate_app_data(env, event);
-  populate_device_data(env, event);
-  populate_user_data(env, event);
+  bsg_trace_begin("bugsnag:populateEvent");
+  if (!populate_from_snapshot(env, event)) {
+    bsg_trace_begin("bugsnag:populateFromMaps");
+    populate_context(env, event);
+    populate_app_data(env, event);
+    populate_device_data(env, event);
+    populate_user_data(env, event);
+    bsg_trace_end();
+  }
+  bsg_trace_end();
 }
 
 const char *bsg_os_name() { return "android"; }
@@ -11,18 +11,12 @@
  */
 void bsg_populate_event(JNIEnv *env, bugsnag_event *event);
 /**
- * Load custom metadata from NativeInterface into a native metadata struct,
- * optionally from an object. If metadata is not provided, load from
- * NativeInterface
+ * Decode length bytes of metadata packed by PackedMetadata.kt into a
+ * breadcrumb record, which must have been sized for them by
+ * bsg_crumb_record_size()
  */
-void bsg_populate_metadata(JNIEnv *env, bugsnag_metadata *dst,
-                           jobject metadata);
-
-/**
- * Parse as java.util.Map<String, String> to populate crumb metadata
- */
-void bsg_populate_crumb_metadata(JNIEnv *env, bugsnag_breadcrumb *crumb,
-                                 jobject metadata);
+void bsg_populate_crumb_metadata(JNIEnv *env, void *record, uint32_t capacity,
+                                 jbyteArray metadata, jsize length);
 
 const char *bsg_os_name();
 
@@ -0,0 +1,263 @@
+#include "notify_aggregator.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "bugsnag_ndk.h"
+#include "jni_cache.h"
+#include "time_common.h"
+#include "utils/module_index.h"
+#include "utils/stack_unwinder.h"
+#include "utils/string.h"
+
+/*
+ * Each distinct error with an open window holds an entry, which keeps the
+ * details of its first repeat to report once the window closes. The flusher
+ * copies the entries of closed windows out under aggregates_lock and reports
+ * them without it, so that errors can still be counted meanwhile.
+ */
+
+static pthread_mutex_t aggregates_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t aggregates_changed = PTHREAD_COND_INITIALIZER;
+
+static int64_t window_ms = 0;
+static bool flusher_started = false;
+
+static bsg_notify_aggregate aggregates[BSG_NOTIFY_AGGREGATES_MAX];
+/** The closed windows being reported, only accessed by the flusher */
+static bsg_notify_aggregate flush_batch[BSG_NOTIFY_AGGREGATES_MAX];
+
+static int64_t monotonic_ms(void) {
+  return (int64_t)(bsg_monotonic_time_ns() / 1000000);
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t length) {
+  const uint8_t *pos = bytes;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= pos[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t aggregate_key(const char *name,
+                              const bugsnag_stackframe *stacktrace,
+                              ssize_t frame_count) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  if (name != NULL) {
+    hash = hash_bytes(hash, name, bsg_strlen(name));
+  }
+  for (ssize_t i = 0; i < frame_count && i < BSG_NOTIFY_AGGREGATE_FRAMES;
+       i++) {
+    hash = hash_bytes(hash, &stacktrace[i].frame_address,
+                      sizeof(stacktrace[i].frame_address));
+  }
+  return hash;
+}
+
+static void report_aggregate(JNIEnv *env, const bsg_notify_aggregate *entry,
+                             int64_t window) {
+  bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX];
+  memset(stacktrace, 0, sizeof(stacktrace));
+  for (ssize_t i = 0; i < entry->frame_count; i++) {
+    stacktrace[i].frame_address = entry->frames[i];
+  }
+  // pick up any libraries loaded since the last error, while it is safe to
+  bsg_module_index_refresh();
+  bsg_insert_fileinfo(entry->frame_count, stacktrace);
+  bsg_notify_aggregated(env, entry->has_name ? entry->name : NULL,
+                        entry->has_message ? entry->message : NULL,
+                        entry->severity, stacktrace, entry->frame_count,
+                        entry->repeats, window);
+}
+
+/**
+ * Wait until the earliest window closes, or the entries change. Must be called
+ * with aggregates_lock held.
+ */
+static void wait_for_closed_window(void) {
+  int64_t earliest_end_ms = INT64_MAX;
+  for (int i = 0; i < BSG_NOTIFY_AGGREGATES_MAX; i++) {
+    if (aggregates[i].used && aggregates[i].window_end_ms < earliest_end_ms) {
+      earliest_end_ms = aggregates[i].window_end_ms;
+    }
+  }
+  if (earliest_end_ms == INT64_MAX) {
+    pthread_cond_wait(&aggregates_changed, &aggregates_lock);
+    return;
+  }
+  const int64_t wait_ms = earliest_end_ms - monotonic_ms();
+  if (wait_ms <= 0) {
+    return;
+  }
+  // the condition waits on the realtime clock
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += wait_ms / 1000;
+  deadline.tv_nsec += (long)(wait_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_cond_timedwait(&aggregates_changed, &aggregates_lock, &deadline);
+}
+
+/**
+ * Must be called with aggregates_lock held
+ */
+static int take_closed(int64_t now_ms, bsg_notify_aggregate *batch) {
+  int batch_count = 0;
+  for (int i = 0; i < BSG_NOTIFY_AGGREGATES_MAX; i++) {
+    bsg_notify_aggregate *entry = &aggregates[i];
+    if (!entry->used || entry->window_end_ms > now_ms) {
+      continue;
+    }
+    // a window without repeats has nothing more to report
+    if (entry->repeats > 0) {
+      memcpy(&batch[batch_count++], entry, sizeof(*entry));
+    }
+    entry->used = false;
+  }
+  return batch_count;
+}
+
+int bsg_notify_aggregator_take_closed(int64_t now_ms,
+                                      bsg_notify_aggregate *batch) {
+  pthread_mutex_lock(&aggregates_lock);
+  const int batch_count = take_closed(now_ms, batch);
+  pthread_mutex_unlock(&aggregates_lock);
+  return batch_count;
+}
+
+static void *run_flusher(void *unused) {
+  JNIEnv *env = bsg_jni_cache_get_env();
+  if (env == NULL) {
+    return NULL;
+  }
+  for (;;) {
+    pthread_mutex_lock(&aggregates_lock);
+    wait_for_closed_window();
+    const int64_t window = window_ms;
+    const int batch_count = take_closed(monotonic_ms(), flush_batch);
+    pthread_mutex_unlock(&aggregates_lock);
+
+    for (int i = 0; i < batch_count; i++) {
+      report_aggregate(env, &flush_batch[i], window);
+    }
+  }
+  return NULL;
+}
+
+static bool start_flusher(void) {
+  if (flusher_started) {
+    return true;
+  }
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  const int result = pthread_create(&thread, &attr, run_flusher, NULL);
+  pthread_attr_destroy(&attr);
+  if (result != 0) {
+    BUGSNAG_LOG("Failed to start the notify aggregator: %s", strerror(result));
+    return false;
+  }
+  pthread_setname_np(thread, "bsg-notify-agg");
+  flusher_started = true;
+  return true;
+}
+
+bool bsg_notify_aggregator_set_window(int64_t window) {
+  pthread_mutex_lock(&aggregates_lock);
+  const bool started = window <= 0 || start_flusher();
+  __atomic_store_n(&window_ms, started && window > 0 ? window : 0,
+                   __ATOMIC_RELEASE);
+  if (window <= 0) {
+    // close every window, so that the flusher reports what has been counted
+    for (int i = 0; i < BSG_NOTIFY_AGGREGATES_MAX; i++) {
+      aggregates[i].window_end_ms = 0;
+    }
+    pthread_cond_signal(&aggregates_changed);
+  }
+  pthread_mutex_unlock(&aggregates_lock);
+  return started;
+}
+
+bool bsg_notify_aggregator_is_enabled(void) {
+  return __atomic_load_n(&window_ms, __ATOMIC_ACQUIRE) > 0;
+}
+
+/**
+ * Keep the details of the first repeat in a window, to report once it closes
+ */
+static void record_repeat(bsg_notify_aggregate *entry, const char *name,
+                          const char *message, bugsnag_severity severity,
+                          const bugsnag_stackframe *stacktrace,
+                          ssize_t frame_count) {
+  entry->has_name = name != NULL;
+  entry->has_message = message != NULL;
+  entry->name[0] = '\0';
+  entry->message[0] = '\0';
+  bsg_strncpy(entry->name, name, sizeof(entry->name));
+  bsg_strncpy(entry->message, message, sizeof(entry->message));
+  entry->severity = severity;
+  if (frame_count < 0) {
+    frame_count = 0;
+  } else if (frame_count > BUGSNAG_FRAMES_MAX) {
+    frame_count = BUGSNAG_FRAMES_MAX;
+  }
+  entry->frame_count = frame_count;
+  for (ssize_t i = 0; i < frame_count; i++) {
+    entry->frames[i] = stacktrace[i].frame_address;
+  }
+}
+
+bool bsg_notify_aggregator_add(const char *name, const char *message,
+                               bugsnag_severity severity,
+                               const bugsnag_stackframe *stacktrace,
+                               ssize_t frame_count) {
+  const int64_t window = __atomic_load_n(&window_ms, __ATOMIC_ACQUIRE);
+  if (window <= 0) {
+    return false;
+  }
+  const uint64_t key = aggregate_key(name, stacktrace, frame_count);
+  bool coalesced = false;
+  pthread_mutex_lock(&aggregates_lock);
+  const int64_t now_ms = monotonic_ms();
+  bsg_notify_aggregate *free_entry = NULL;
+  for (int i = 0; i < BSG_NOTIFY_AGGREGATES_MAX; i++) {
+    bsg_notify_aggregate *entry = &aggregates[i];
+    if (!entry->used) {
+      if (free_entry == NULL) {
+        free_entry = entry;
+      }
+      continue;
+    }
+    if (entry->key != key) {
+      continue;
+    }
+    // a closed window is left for the flusher, and this error reported now
+    if (entry->window_end_ms > now_ms) {
+      if (entry->repeats == 0) {
+        record_repeat(entry, name, message, severity, stacktrace, frame_count);
+      }
+      entry->repeats++;
+      coalesced = true;
+    }
+    goto exit;
+  }
+  if (free_entry != NULL) {
+    free_entry->used = true;
+    free_entry->key = key;
+    free_entry->window_end_ms = now_ms + window;
+    free_entry->repeats = 0;
+    pthread_cond_signal(&aggregates_changed);
+  }
+
+exit:
+  pthread_mutex_unlock(&aggregates_lock);
+  return coalesced;
+}
@@ -0,0 +1,83 @@
+/**
+ * Coalesces storms of handled errors reported from native code. The first
+ * occurrence of an error, keyed on its name and the top frames of its stack,
+ * is reported as it happens and opens a window, within which repeats are only
+ * counted. A flusher thread reports a single error carrying the count once
+ * the window closes.
+ */
+#ifndef BUGSNAG_NOTIFY_AGGREGATOR_H
+#define BUGSNAG_NOTIFY_AGGREGATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of frames from the top of the stack hashed into a key */
+#define BSG_NOTIFY_AGGREGATE_FRAMES 8
+
+/**
+ * The most distinct errors with an open window, after which further errors
+ * are reported as they happen
+ */
+#define BSG_NOTIFY_AGGREGATES_MAX 16
+
+/** A distinct error with an open window, and its first repeat in it */
+typedef struct {
+  bool used;
+  uint64_t key;
+  /** When the window closes, in milliseconds on the monotonic clock */
+  int64_t window_end_ms;
+  int repeats;
+  bool has_name;
+  bool has_message;
+  bugsnag_severity severity;
+  ssize_t frame_count;
+  char name[256];
+  char message[1024];
+  uintptr_t frames[BUGSNAG_FRAMES_MAX];
+} bsg_notify_aggregate;
+
+/**
+ * Set the length of the window in which repeats of an error are coalesced,
+ * starting the flusher thread the first time it is set. A window of 0 or less
+ * disables aggregation, and flushes any counted repeats. Returns false if the
+ * flusher could not be started.
+ */
+bool bsg_notify_aggregator_set_window(int64_t window_ms);
+
+/**
+ * Whether bsg_notify_aggregator_add() may coalesce errors, so that callers
+ * can leave symbolicating a stack until it is known to be reported
+ */
+bool bsg_notify_aggregator_is_enabled(void);
+
+/**
+ * Count an error whose stacktrace has at least its frame addresses filled in.
+ * Returns false if the error should be reported now, because it is the first
+ * occurrence in a window or aggregation is disabled, and true if it has been
+ * coalesced into the count of an earlier error.
+ */
+bool bsg_notify_aggregator_add(const char *name, const char *message,
+                               bugsnag_severity severity,
+                               const bugsnag_stackframe *stacktrace,
+                               ssize_t frame_count);
+
+/**
+ * Close the windows which end by now_ms, in milliseconds on the monotonic
+ * clock, copying the entries which counted repeats into batch, which must
+ * have room for BSG_NOTIFY_AGGREGATES_MAX of them. Returns the number copied.
+ * The flusher reports each of these as a single error.
+ */
+int bsg_notify_aggregator_take_closed(int64_t now_ms,
+                                      bsg_notify_aggregate *batch);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
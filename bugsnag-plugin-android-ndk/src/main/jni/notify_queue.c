@@ -0,0 +1,174 @@
+#include "notify_queue.h"
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "bugsnag_ndk.h"
+#include "jni_cache.h"
+#include "utils/module_index.h"
+#include "utils/stack_unwinder.h"
+#include "utils/string.h"
+
+/*
+ * The queue is a ring of slots which each carry a sequence number, so that
+ * callers claim a slot by advancing the tail with a compare and swap and then
+ * publish it by bumping its sequence, without taking a lock. A slot at
+ * position n is free to fill when its sequence is n, and holds an error to
+ * report when it is n + 1. The single worker waits on a counter as a futex,
+ * which callers bump after publishing.
+ */
+
+static bsg_notify_queue notify_queue;
+static int notify_queue_signal = 0;
+
+static pthread_once_t notify_worker_once = PTHREAD_ONCE_INIT;
+static bool notify_worker_started = false;
+
+static void report_queued(JNIEnv *env, const bsg_queued_notify *queued) {
+  bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX];
+  memset(stacktrace, 0, sizeof(stacktrace));
+  for (ssize_t i = 0; i < queued->frame_count; i++) {
+    stacktrace[i].frame_address = queued->frames[i];
+  }
+  // pick up any libraries loaded since the last error, while it is safe to
+  bsg_module_index_refresh();
+  bsg_insert_fileinfo(queued->frame_count, stacktrace);
+  bsg_notify_stacktrace(env, queued->has_name ? queued->name : NULL,
+                        queued->has_message ? queued->message : NULL,
+                        queued->severity, stacktrace, queued->frame_count);
+}
+
+static void *run_notify_worker(void *unused) {
+  JNIEnv *env = bsg_jni_cache_get_env();
+  if (env == NULL) {
+    return NULL;
+  }
+  for (;;) {
+    const int signal = __atomic_load_n(&notify_queue_signal, __ATOMIC_ACQUIRE);
+    const bsg_queued_notify *queued = bsg_notify_queue_peek(&notify_queue);
+    if (queued == NULL) {
+      syscall(SYS_futex, &notify_queue_signal, FUTEX_WAIT_PRIVATE, signal,
+              NULL, NULL, 0);
+      continue;
+    }
+    report_queued(env, queued);
+    bsg_notify_queue_release(&notify_queue);
+  }
+  return NULL;
+}
+
+static void start_notify_worker(void) {
+  bsg_notify_queue_init(&notify_queue);
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  const int result = pthread_create(&thread, &attr, run_notify_worker, NULL);
+  pthread_attr_destroy(&attr);
+  if (result != 0) {
+    BUGSNAG_LOG("Failed to start the notify worker: %s", strerror(result));
+    return;
+  }
+  pthread_setname_np(thread, "bsg-notify");
+  __atomic_store_n(&notify_worker_started, true, __ATOMIC_RELEASE);
+}
+
+void bsg_notify_queue_init(bsg_notify_queue *queue) {
+  for (size_t i = 0; i < BSG_NOTIFY_QUEUE_SIZE; i++) {
+    queue->slots[i].sequence = i;
+  }
+  queue->tail = 0;
+  queue->head = 0;
+}
+
+/**
+ * Claim the slot at the tail of the queue, or return NULL if it is full
+ */
+static bsg_queued_notify *claim_slot(bsg_notify_queue *queue,
+                                     size_t *position) {
+  size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  for (;;) {
+    bsg_queued_notify *slot = &queue->slots[tail % BSG_NOTIFY_QUEUE_SIZE];
+    const size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    const intptr_t lag = (intptr_t)(sequence - tail);
+    if (lag == 0) {
+      // a failed exchange reloads tail with the position another caller took
+      if (__atomic_compare_exchange_n(&queue->tail, &tail, tail + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *position = tail;
+        return slot;
+      }
+    } else if (lag < 0) {
+      // the worker has not yet reported the error from the previous lap
+      return NULL;
+    } else {
+      tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+bool bsg_notify_queue_push(bsg_notify_queue *queue, const char *name,
+                           const char *message, bugsnag_severity severity,
+                           const bugsnag_stackframe *stacktrace,
+                           ssize_t frame_count) {
+  size_t position;
+  bsg_queued_notify *slot = claim_slot(queue, &position);
+  if (slot == NULL) {
+    return false;
+  }
+
+  slot->has_name = name != NULL;
+  slot->has_message = message != NULL;
+  slot->name[0] = '\0';
+  slot->message[0] = '\0';
+  bsg_strncpy(slot->name, name, sizeof(slot->name));
+  bsg_strncpy(slot->message, message, sizeof(slot->message));
+  slot->severity = severity;
+  if (frame_count < 0) {
+    frame_count = 0;
+  } else if (frame_count > BUGSNAG_FRAMES_MAX) {
+    frame_count = BUGSNAG_FRAMES_MAX;
+  }
+  slot->frame_count = frame_count;
+  for (ssize_t i = 0; i < frame_count; i++) {
+    slot->frames[i] = stacktrace[i].frame_address;
+  }
+  __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+const bsg_queued_notify *bsg_notify_queue_peek(bsg_notify_queue *queue) {
+  const bsg_queued_notify *slot =
+      &queue->slots[queue->head % BSG_NOTIFY_QUEUE_SIZE];
+  if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != queue->head + 1) {
+    return NULL;
+  }
+  return slot;
+}
+
+void bsg_notify_queue_release(bsg_notify_queue *queue) {
+  bsg_queued_notify *slot = &queue->slots[queue->head % BSG_NOTIFY_QUEUE_SIZE];
+  // free the slot for the caller which reaches it on the next lap
+  __atomic_store_n(&slot->sequence, queue->head + BSG_NOTIFY_QUEUE_SIZE,
+                   __ATOMIC_RELEASE);
+  queue->head++;
+}
+
+bool bsg_notify_queue_add(const char *name, const char *message,
+                          bugsnag_severity severity,
+                          const bugsnag_stackframe *stacktrace,
+                          ssize_t frame_count) {
+  pthread_once(&notify_worker_once, start_notify_worker);
+  if (!__atomic_load_n(&notify_worker_started, __ATOMIC_ACQUIRE) ||
+      !bsg_notify_queue_push(&notify_queue, name, message, severity,
+                             stacktrace, frame_count)) {
+    return false;
+  }
+  __atomic_add_fetch(&notify_queue_signal, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &notify_queue_signal, FUTEX_WAKE_PRIVATE, 1, NULL, NULL,
+          0);
+  return true;
+}
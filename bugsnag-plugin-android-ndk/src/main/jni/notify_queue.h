@@ -0,0 +1,87 @@
+/**
+ * A bounded queue of handled errors reported by bugsnag_notify_async(), which
+ * callers add to without locking. A worker thread attached to the JVM
+ * symbolicates each stack and reports it as bugsnag_notify_env() would.
+ */
+#ifndef BUGSNAG_NOTIFY_QUEUE_H
+#define BUGSNAG_NOTIFY_QUEUE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The most errors waiting to be reported, after which errors are dropped */
+#define BSG_NOTIFY_QUEUE_SIZE 8
+
+/** The longest name and message kept for a queued error, including the NUL */
+#define BSG_NOTIFY_NAME_MAX 256
+#define BSG_NOTIFY_MESSAGE_MAX 1024
+
+/** An error waiting to be reported, with the frame addresses of its stack */
+typedef struct {
+  size_t sequence;
+  bool has_name;
+  bool has_message;
+  bugsnag_severity severity;
+  ssize_t frame_count;
+  char name[BSG_NOTIFY_NAME_MAX];
+  char message[BSG_NOTIFY_MESSAGE_MAX];
+  uintptr_t frames[BUGSNAG_FRAMES_MAX];
+} bsg_queued_notify;
+
+/**
+ * A ring of errors, which any thread may push to without locking and a single
+ * thread takes from
+ */
+typedef struct {
+  bsg_queued_notify slots[BSG_NOTIFY_QUEUE_SIZE];
+  size_t tail;
+  /** Only accessed by the thread taking errors */
+  size_t head;
+} bsg_notify_queue;
+
+/**
+ * Queue an error whose stacktrace has only its frame addresses filled in,
+ * starting the worker thread if it is not yet running. Longer names and
+ * messages are truncated. Does not block, and is safe to call from any thread
+ * apart from a signal handler.
+ *
+ * @return false if the error was dropped, because the queue is full or the
+ *         worker could not be started
+ */
+bool bsg_notify_queue_add(const char *name, const char *message,
+                          bugsnag_severity severity,
+                          const bugsnag_stackframe *stacktrace,
+                          ssize_t frame_count);
+
+/** Empty a queue, before it is first used */
+void bsg_notify_queue_init(bsg_notify_queue *queue);
+
+/**
+ * Copy an error into the next free slot of a queue. Does not block.
+ *
+ * @return false if the error was dropped, because the queue is full
+ */
+bool bsg_notify_queue_push(bsg_notify_queue *queue, const char *name,
+                           const char *message, bugsnag_severity severity,
+                           const bugsnag_stackframe *stacktrace,
+                           ssize_t frame_count);
+
+/**
+ * The error at the head of a queue, which stays queued until it is released,
+ * or NULL if the queue is empty
+ */
+const bsg_queued_notify *bsg_notify_queue_peek(bsg_notify_queue *queue);
+
+/** Remove the error at the head of a queue, freeing its slot */
+void bsg_notify_queue_release(bsg_notify_queue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
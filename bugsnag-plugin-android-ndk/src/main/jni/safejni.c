@@ -6,49 +6,27 @@
 #include <string.h>
 #include <utils/string.h>
 
-bool bsg_check_and_clear_exc(JNIEnv *env) {
-  if (env == NULL) {
+bool bsg_safe_register_natives(JNIEnv *env, jclass clz,
+                               const JNINativeMethod *methods, jint count) {
+  if (env == NULL || clz == NULL || methods == NULL) {
     return false;
   }
-  if ((*env)->ExceptionCheck(env)) {
-    BUGSNAG_LOG("BUG: JNI Native->Java call threw an exception:");
-
-    // Print a trace to stderr so that we can debug it
-    (*env)->ExceptionDescribe(env);
-
-    // Trigger more accurate dalvik trace (this will also crash the app).
-
-    // Code review check: THIS MUST BE COMMENTED OUT IN CHECKED IN CODE!
-    //(*env)->FindClass(env, NULL);
-
-    // Clear the exception so that we don't crash.
-    (*env)->ExceptionClear(env);
-    return true;
-  }
-  return false;
-}
-
-jclass bsg_safe_find_class(JNIEnv *env, const char *clz_name) {
-  if (env == NULL || clz_name == NULL) {
-    return NULL;
-  }
-  jclass clz = (*env)->FindClass(env, clz_name);
+  jint result = (*env)->RegisterNatives(env, clz, methods, count);
   if (bsg_check_and_clear_exc(env)) {
-    return NULL;
+    return false;
   }
-  return clz;
+  return result == JNI_OK;
 }
 
-jmethodID bsg_safe_get_method_id(JNIEnv *env, jclass clz, const char *name,
-                                 const char *sig) {
-  if (env == NULL || clz == NULL || name == NULL || sig == NULL) {
-    return NULL;
+bool bsg_safe_unregister_natives(JNIEnv *env, jclass clz) {
+  if (env == NULL || clz == NULL) {
+    return false;
   }
-  jmethodID methodId = (*env)->GetMethodID(env, clz, name, sig);
+  jint result = (*env)->UnregisterNatives(env, clz);
   if (bsg_check_and_clear_exc(env)) {
-    return NULL;
+    return false;
   }
-  return methodId;
+  return result == JNI_OK;
 }
 
 jmethodID bsg_safe_get_static_method_id(JNIEnv *env, jclass clz,
@@ -63,17 +41,6 @@ jmethodID bsg_safe_get_static_method_id(JNIEnv *env, jclass clz,
   return methodId;
 }
 
-jstring bsg_safe_new_string_utf(JNIEnv *env, const char *str) {
-  if (env == NULL || str == NULL) {
-    return NULL;
-  }
-  jstring jstr = (*env)->NewStringUTF(env, str);
-  if (bsg_check_and_clear_exc(env)) {
-    return NULL;
-  }
-  return jstr;
-}
-
 jboolean bsg_safe_call_boolean_method(JNIEnv *env, jobject _value,
                                       jmethodID method) {
   if (env == NULL || _value == NULL || method == NULL) {
@@ -164,44 +131,6 @@ void bsg_safe_set_object_array_element(JNIEnv *env, jobjectArray array,
   bsg_check_and_clear_exc(env);
 }
 
-jfieldID bsg_safe_get_static_field_id(JNIEnv *env, jclass clz, const char *name,
-                                      const char *sig) {
-  if (env == NULL || clz == NULL || name == NULL || sig == NULL) {
-    return NULL;
-  }
-  jfieldID field_id = (*env)->GetStaticFieldID(env, clz, name, sig);
-  if (bsg_check_and_clear_exc(env)) {
-    return NULL;
-  }
-  return field_id;
-}
-
-jobject bsg_safe_get_static_object_field(JNIEnv *env, jclass clz,
-                                         jfieldID field) {
-  if (env == NULL || clz == NULL || field == NULL) {
-    return NULL;
-  }
-  jobject obj = (*env)->GetStaticObjectField(env, clz, field);
-  if (bsg_check_and_clear_exc(env)) {
-    return NULL;
-  }
-  return obj;
-}
-
-jobject bsg_safe_new_object(JNIEnv *env, jclass clz, jmethodID method, ...) {
-  if (env == NULL || clz == NULL || method == NULL) {
-    return NULL;
-  }
-  va_list args;
-  va_start(args, method);
-  jobject obj = (*env)->NewObjectV(env, clz, method, args);
-  va_end(args);
-  if (bsg_check_and_clear_exc(env)) {
-    return NULL;
-  }
-  return obj;
-}
-
 jobject bsg_safe_call_object_method(JNIEnv *env, jobject _value,
                                     jmethodID method, ...) {
   if (env == NULL || _value == NULL || method == NULL) {
@@ -244,11 +173,19 @@ jobject bsg_safe_call_static_object_method(JNIEnv *env, jclass clz,
   return obj;
 }
 
-void bsg_safe_delete_local_ref(JNIEnv *env, jobject obj) {
-  if (env == NULL || obj == NULL) {
-    return;
+jint bsg_safe_call_static_int_method(JNIEnv *env, jclass clz, jmethodID method,
+                                     ...) {
+  if (env == NULL || clz == NULL || method == NULL) {
+    return 0;
+  }
+  va_list args;
+  va_start(args, method);
+  jint value = (*env)->CallStaticIntMethodV(env, clz, method, args);
+  va_end(args);
+  if (bsg_check_and_clear_exc(env)) {
+    return 0;
   }
-  (*env)->DeleteLocalRef(env, obj);
+  return value;
 }
 
 const char *bsg_safe_get_string_utf_chars(JNIEnv *env, jstring string) {
@@ -258,6 +195,84 @@ const char *bsg_safe_get_string_utf_chars(JNIEnv *env, jstring string) {
   return (*env)->GetStringUTFChars(env, string, NULL);
 }
 
+/**
+ * The bytes taken by a UTF-16 code unit in modified UTF-8, which encodes NUL
+ * in two bytes and each half of a surrogate pair separately
+ */
+static size_t modified_utf8_size(jchar c) {
+  if (c != 0 && c < 0x80) {
+    return 1;
+  }
+  return c < 0x800 ? 2 : 3;
+}
+
+static bool is_high_surrogate(jchar c) { return c >= 0xd800 && c <= 0xdbff; }
+
+/**
+ * Count the characters at the start of a string which fit in max_bytes of
+ * modified UTF-8, without splitting a surrogate pair. Returns -1 if the
+ * string could not be read.
+ */
+static jsize count_utf_prefix(JNIEnv *env, jstring string, jsize length,
+                              size_t max_bytes, size_t *out_bytes) {
+  jchar chars[64];
+  size_t bytes = 0;
+  jsize count = 0;
+  while (count < length) {
+    jsize chunk = length - count;
+    if (chunk > (jsize)(sizeof(chars) / sizeof(chars[0]))) {
+      chunk = (jsize)(sizeof(chars) / sizeof(chars[0]));
+    }
+    (*env)->GetStringRegion(env, string, count, chunk, chars);
+    if (bsg_check_and_clear_exc(env)) {
+      return -1;
+    }
+    for (jsize i = 0; i < chunk; i++) {
+      const size_t size = modified_utf8_size(chars[i]);
+      // a high surrogate is only kept with room for the low surrogate
+      const size_t needed = is_high_surrogate(chars[i]) ? size * 2 : size;
+      if (bytes + needed > max_bytes) {
+        *out_bytes = bytes;
+        return count;
+      }
+      bytes += size;
+      count++;
+    }
+  }
+  *out_bytes = bytes;
+  return count;
+}
+
+bool bsg_safe_copy_string_utf(JNIEnv *env, jstring string, char *dest,
+                              size_t dest_size) {
+  if (dest == NULL || dest_size == 0) {
+    return false;
+  }
+  dest[0] = '\0';
+  if (env == NULL || string == NULL) {
+    return false;
+  }
+  const jsize length = (*env)->GetStringLength(env, string);
+  size_t bytes = (size_t)(*env)->GetStringUTFLength(env, string);
+  if (bsg_check_and_clear_exc(env)) {
+    return false;
+  }
+  jsize count = length;
+  if (bytes >= dest_size) {
+    count = count_utf_prefix(env, string, length, dest_size - 1, &bytes);
+    if (count < 0) {
+      return false;
+    }
+  }
+  (*env)->GetStringUTFRegion(env, string, 0, count, dest);
+  if (bsg_check_and_clear_exc(env)) {
+    dest[0] = '\0';
+    return false;
+  }
+  dest[bytes] = '\0';
+  return true;
+}
+
 void bsg_safe_release_string_utf_chars(JNIEnv *env, jstring string,
                                        const char *utf) {
   if (env == NULL || string == NULL || utf == NULL) {
@@ -280,6 +295,18 @@ void bsg_safe_release_byte_array_elements(JNIEnv *env, jbyteArray array,
   (*env)->ReleaseByteArrayElements(env, array, elems, JNI_COMMIT);
 }
 
+jobject bsg_safe_new_direct_byte_buffer(JNIEnv *env, void *address,
+                                        jlong capacity) {
+  if (env == NULL || address == NULL) {
+    return NULL;
+  }
+  jobject buffer = (*env)->NewDirectByteBuffer(env, address, capacity);
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  return buffer;
+}
+
 jsize bsg_safe_get_array_length(JNIEnv *env, jarray array) {
   if (env == NULL || array == NULL) {
     return -1;
@@ -287,6 +314,15 @@ jsize bsg_safe_get_array_length(JNIEnv *env, jarray array) {
   return (*env)->GetArrayLength(env, array);
 }
 
+bool bsg_safe_get_byte_array_region(JNIEnv *env, jbyteArray array, jsize start,
+                                    jsize length, jbyte *buf) {
+  if (env == NULL || array == NULL || buf == NULL) {
+    return false;
+  }
+  (*env)->GetByteArrayRegion(env, array, start, length, buf);
+  return !bsg_check_and_clear_exc(env);
+}
+
 jboolean bsg_safe_is_instance_of(JNIEnv *env, jobject object, jclass clz) {
   if (env == NULL || clz == NULL) {
     return false;
@@ -298,16 +334,41 @@ jbyteArray bsg_byte_ary_from_string(JNIEnv *env, const char *text) {
   if (env == NULL || text == NULL) {
     return NULL;
   }
-  size_t text_length = bsg_strlen(text);
-  jbyteArray jtext = (*env)->NewByteArray(env, text_length);
+  return bsg_byte_ary_from_bytes(env, text, bsg_strlen(text));
+}
+
+jbyteArray bsg_byte_ary_from_bytes(JNIEnv *env, const char *bytes,
+                                   size_t length) {
+  if (env == NULL || bytes == NULL) {
+    return NULL;
+  }
+  jbyteArray jbytes = (*env)->NewByteArray(env, length);
+
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  (*env)->SetByteArrayRegion(env, jbytes, 0, length, (jbyte *)bytes);
+
+  if (bsg_check_and_clear_exc(env)) {
+    return NULL;
+  }
+  return jbytes;
+}
+
+jlongArray bsg_long_ary_from_longs(JNIEnv *env, const jlong *values,
+                                   size_t length) {
+  if (env == NULL || values == NULL) {
+    return NULL;
+  }
+  jlongArray jvalues = (*env)->NewLongArray(env, length);
 
   if (bsg_check_and_clear_exc(env)) {
     return NULL;
   }
-  (*env)->SetByteArrayRegion(env, jtext, 0, text_length, (jbyte *)text);
+  (*env)->SetLongArrayRegion(env, jvalues, 0, length, values);
 
   if (bsg_check_and_clear_exc(env)) {
     return NULL;
   }
-  return jtext;
+  return jvalues;
 }
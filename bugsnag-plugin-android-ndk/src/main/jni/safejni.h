@@ -2,6 +2,10 @@
 #define BUGSNAG_SAFEJNI_H
 
 #include <jni.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "safejni_common.h"
 
 /**
  * This provides safe JNI calls by wrapping functions and calling
@@ -10,26 +14,25 @@
  *
  * For an overview of the methods decorated here, please see
  * https://docs.oracle.com/en/java/javase/11/docs/specs/jni/functions.html
+ *
+ * The wrappers shared with the ANR plugin are declared in safejni_common.h.
  */
 
 /**
- * A safe wrapper for the JNI's FindClass. This method checks if an exception is
- * pending and if so clears it so that execution can continue.
- * The caller is responsible for handling the invalid return value of NULL.
+ * A safe wrapper for the JNI's RegisterNatives, which registers all of the
+ * methods or none of them.
  *
- * @return the class, or NULL if the class could not be found.
+ * @return true if the methods were registered
  */
-jclass bsg_safe_find_class(JNIEnv *env, const char *clz_name);
+bool bsg_safe_register_natives(JNIEnv *env, jclass clz,
+                               const JNINativeMethod *methods, jint count);
 
 /**
- * A safe wrapper for the JNI's GetMethodID. This method checks if an exception
- * is pending and if so clears it so that execution can continue.
- * The caller is responsible for handling the invalid return value of NULL.
+ * A safe wrapper for the JNI's UnregisterNatives.
  *
- * @return the method ID, or NULL if the method could not be found.
+ * @return true if the methods were unregistered
  */
-jmethodID bsg_safe_get_method_id(JNIEnv *env, jclass clz, const char *name,
-                                 const char *sig);
+bool bsg_safe_unregister_natives(JNIEnv *env, jclass clz);
 
 /**
  * A safe wrapper for the JNI's GetStaticMethodID. This method checks if an
@@ -40,15 +43,6 @@ jmethodID bsg_safe_get_method_id(JNIEnv *env, jclass clz, const char *name,
  */
 jmethodID bsg_safe_get_static_method_id(JNIEnv *env, jclass clz,
                                         const char *name, const char *sig);
-/**
- * A safe wrapper for the JNI's NewStringUtf. This method checks if an
- * exception is pending and if so clears it so that execution can continue.
- * The caller is responsible for handling the invalid return value of NULL.
- *
- * @return the java string or NULL if it could not be created
- */
-jstring bsg_safe_new_string_utf(JNIEnv *env, const char *str);
-
 /**
  * A safe wrapper for the JNI's CallBooleanMethod. This method checks if an
  * exception is pending and if so clears it so that execution can continue.
@@ -110,28 +104,6 @@ jobject bsg_safe_get_object_array_element(JNIEnv *env, jobjectArray array,
 void bsg_safe_set_object_array_element(JNIEnv *env, jobjectArray array,
                                        jsize size, jobject object);
 
-/**
- * A safe wrapper for the JNI's GetStaticFieldId. This method checks if an
- * exception is pending and if so clears it so that execution can continue.
- */
-jfieldID bsg_safe_get_static_field_id(JNIEnv *env, jclass clz, const char *name,
-                                      const char *sig);
-
-/**
- * A safe wrapper for the JNI's GetStaticObjectField. This method checks if an
- * exception is pending and if so clears it so that execution can continue.
- * The caller is responsible for handling the invalid return value of NULL.
- */
-jobject bsg_safe_get_static_object_field(JNIEnv *env, jclass clz,
-                                         jfieldID field);
-
-/**
- * A safe wrapper for the JNI's NewObject. This method checks if an
- * exception is pending and if so clears it so that execution can continue.
- * The caller is responsible for handling the invalid return value of NULL.
- */
-jobject bsg_safe_new_object(JNIEnv *env, jclass clz, jmethodID method, ...);
-
 /**
  * A safe wrapper for the JNI's CallObjectMethod. This method checks if an
  * exception is pending and if so clears it so that execution can continue.
@@ -156,10 +128,12 @@ jobject bsg_safe_call_static_object_method(JNIEnv *env, jclass clz,
                                            jmethodID method, ...);
 
 /**
- * A safe wrapper for the JNI's DeleteLocalRef. This method checks if the env
- * is NULL and no-ops if so.
+ * A safe wrapper for the JNI's CallStaticIntMethod. This method checks if an
+ * exception is pending and if so clears it so that execution can continue.
+ * The caller is responsible for handling the invalid return value of 0.
  */
-void bsg_safe_delete_local_ref(JNIEnv *env, jobject obj);
+jint bsg_safe_call_static_int_method(JNIEnv *env, jclass clz, jmethodID method,
+                                     ...);
 
 /**
  * A safe wrapper for the JNI's GetStringUTFChars. This method checks if the
@@ -168,6 +142,18 @@ void bsg_safe_delete_local_ref(JNIEnv *env, jobject obj);
  */
 const char *bsg_safe_get_string_utf_chars(JNIEnv *env, jstring string);
 
+/**
+ * Copy a string into dest as the modified UTF-8 which GetStringUTFChars would
+ * return, without the runtime allocating a copy. A string which does not fit
+ * is truncated at the last whole character that does, and dest is always
+ * terminated.
+ *
+ * @return true if the string was copied, or false if it is NULL or could not
+ * be read, in which case dest is left empty
+ */
+bool bsg_safe_copy_string_utf(JNIEnv *env, jstring string, char *dest,
+                              size_t dest_size);
+
 /**
  * A safe wrapper for the JNI's ReleaseStringUTFChars. This method checks if the
  * parameters are NULL and no-ops if so.
@@ -185,6 +171,18 @@ void bsg_safe_release_string_utf_chars(JNIEnv *env, jstring string,
 void bsg_safe_release_byte_array_elements(JNIEnv *env, jbyteArray array,
                                           jbyte *elems);
 
+/**
+ * A safe wrapper for the JNI's NewDirectByteBuffer. This method checks if an
+ * exception is pending and if so clears it so that execution can continue.
+ * The caller is responsible for handling the invalid return value of NULL,
+ * which is also returned if the VM does not support direct buffer access.
+ *
+ * The buffer does not take ownership of the memory, which must remain valid
+ * until the buffer is no longer used by the Java side.
+ */
+jobject bsg_safe_new_direct_byte_buffer(JNIEnv *env, void *address,
+                                        jlong capacity);
+
 /**
  * A safe wrapper for the JNI's GetArrayLength. This method checks if the
  * parameters are NULL and no-ops if so. The caller is responsible for handling
@@ -192,6 +190,14 @@ void bsg_safe_release_byte_array_elements(JNIEnv *env, jbyteArray array,
  */
 jsize bsg_safe_get_array_length(JNIEnv *env, jarray array);
 
+/**
+ * A safe wrapper for the JNI's GetByteArrayRegion. This method checks if an
+ * exception is pending and if so clears it so that execution can continue.
+ * Returns false if the region could not be copied.
+ */
+bool bsg_safe_get_byte_array_region(JNIEnv *env, jbyteArray array, jsize start,
+                                    jsize length, jbyte *buf);
+
 /**
  * A safe wrapper for the JNI's IsInstanceOf. This method checks if the
  * parameters are NULL and returns false if so.
@@ -203,4 +209,16 @@ jboolean bsg_safe_is_instance_of(JNIEnv *env, jobject object, jclass clz);
  */
 jbyteArray bsg_byte_ary_from_string(JNIEnv *env, const char *text);
 
+/**
+ * Constructs a byte array from a buffer of the given length.
+ */
+jbyteArray bsg_byte_ary_from_bytes(JNIEnv *env, const char *bytes,
+                                   size_t length);
+
+/**
+ * Constructs a long array from a buffer of the given length.
+ */
+jlongArray bsg_long_ary_from_longs(JNIEnv *env, const jlong *values,
+                                   size_t length);
+
 #endif
@@ -5,4 +5,12 @@
 #else
 #define __asyncsafe
 #endif
+
+/**
+ * The cache line size of the ARM and x86 cores Android runs on. Fields written
+ * by different threads are kept this far apart so that their writes do not
+ * invalidate each other's cache lines.
+ */
+#define BSG_CACHE_LINE_SIZE 64
+#define __bsg_cache_aligned __attribute__((aligned(BSG_CACHE_LINE_SIZE)))
 #endif // BUGSNAG_ANDROID_BUILD_H
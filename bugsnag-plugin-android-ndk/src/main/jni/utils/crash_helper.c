@@ -0,0 +1,155 @@
+#include "crash_helper.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "time_common.h"
+
+/*
+ * A crash is passed to the helper through a single state word, which both
+ * threads wait on with futexes as those are safe to use in a signal handler.
+ * The helper claims a pending crash before running its job, and the crashing
+ * thread reclaims it if the helper is too slow to, so the report is only ever
+ * written by one of them.
+ */
+
+typedef enum {
+  BSG_CRASH_HELPER_IDLE,
+  /** A crash has been handed off, and not yet taken */
+  BSG_CRASH_HELPER_PENDING,
+  /** The helper is running its job */
+  BSG_CRASH_HELPER_CLAIMED,
+  BSG_CRASH_HELPER_DONE,
+  /** The crashing thread took back the crash before the helper claimed it */
+  BSG_CRASH_HELPER_RECLAIMED,
+} bsg_crash_helper_state;
+
+static pthread_mutex_t bsg_crash_helper_config = PTHREAD_MUTEX_INITIALIZER;
+static bsg_crash_helper_job bsg_crash_helper_run = NULL;
+static bool bsg_crash_helper_active = false;
+static int bsg_crash_helper_state_word = BSG_CRASH_HELPER_IDLE;
+
+static int bsg_crash_signum;
+static siginfo_t *bsg_crash_info;
+static void *bsg_crash_user_context;
+
+static int load_state(void) {
+  return __atomic_load_n(&bsg_crash_helper_state_word, __ATOMIC_ACQUIRE);
+}
+
+static bool change_state(int expected, int desired) {
+  return __atomic_compare_exchange_n(&bsg_crash_helper_state_word, &expected,
+                                     desired, false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE);
+}
+
+static void wake_state_waiters(void) {
+  syscall(SYS_futex, &bsg_crash_helper_state_word, FUTEX_WAKE_PRIVATE, INT_MAX,
+          NULL, NULL, 0);
+}
+
+/**
+ * Wait until the state is no longer current or deadline_ns passes, with a
+ * deadline of 0 waiting indefinitely
+ */
+static void wait_for_state_change(int current, uint64_t deadline_ns) {
+  struct timespec timeout;
+  struct timespec *timeout_ptr = NULL;
+  if (deadline_ns != 0) {
+    const uint64_t now = bsg_monotonic_time_ns();
+    if (now >= deadline_ns) {
+      return;
+    }
+    const uint64_t remaining = deadline_ns - now;
+    timeout.tv_sec = (time_t)(remaining / 1000000000);
+    timeout.tv_nsec = (long)(remaining % 1000000000);
+    timeout_ptr = &timeout;
+  }
+  syscall(SYS_futex, &bsg_crash_helper_state_word, FUTEX_WAIT_PRIVATE,
+          current, timeout_ptr, NULL, 0);
+}
+
+static void *run_crash_helper(void *unused) {
+  for (;;) {
+    const int state = load_state();
+    if (state != BSG_CRASH_HELPER_PENDING) {
+      wait_for_state_change(state, 0);
+      continue;
+    }
+    if (!change_state(BSG_CRASH_HELPER_PENDING, BSG_CRASH_HELPER_CLAIMED)) {
+      continue;
+    }
+    bsg_crash_helper_run(bsg_crash_signum, bsg_crash_info,
+                         bsg_crash_user_context);
+    __atomic_store_n(&bsg_crash_helper_state_word, BSG_CRASH_HELPER_DONE,
+                     __ATOMIC_RELEASE);
+    wake_state_waiters();
+  }
+  return NULL;
+}
+
+bool bsg_crash_helper_start(bsg_crash_helper_job job) {
+  pthread_mutex_lock(&bsg_crash_helper_config);
+  bool started = bsg_crash_helper_run != NULL;
+  if (!started) {
+    bsg_crash_helper_run = job;
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    const int result = pthread_create(&thread, &attr, run_crash_helper, NULL);
+    pthread_attr_destroy(&attr);
+    if (result == 0) {
+      pthread_setname_np(thread, "bsg-crash-helper");
+      started = true;
+    } else {
+      BUGSNAG_LOG("Failed to start the crash helper: %s", strerror(result));
+      bsg_crash_helper_run = NULL;
+    }
+  }
+  __atomic_store_n(&bsg_crash_helper_active, started, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&bsg_crash_helper_config);
+  return started;
+}
+
+void bsg_crash_helper_stop(void) {
+  __atomic_store_n(&bsg_crash_helper_active, false, __ATOMIC_RELEASE);
+}
+
+bool bsg_crash_helper_hand_off(int signum, siginfo_t *info, void *user_context,
+                               uint64_t timeout_ns) {
+  if (!__atomic_load_n(&bsg_crash_helper_active, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  bsg_crash_signum = signum;
+  bsg_crash_info = info;
+  bsg_crash_user_context = user_context;
+  const uint64_t handed_off_ns = bsg_monotonic_time_ns();
+  if (!change_state(BSG_CRASH_HELPER_IDLE, BSG_CRASH_HELPER_PENDING)) {
+    return false;
+  }
+  wake_state_waiters();
+
+  const uint64_t pickup_deadline = handed_off_ns + BSG_CRASH_HELPER_PICKUP_NS;
+  while (load_state() == BSG_CRASH_HELPER_PENDING &&
+         bsg_monotonic_time_ns() < pickup_deadline) {
+    wait_for_state_change(BSG_CRASH_HELPER_PENDING, pickup_deadline);
+  }
+  if (change_state(BSG_CRASH_HELPER_PENDING, BSG_CRASH_HELPER_RECLAIMED)) {
+    return false;
+  }
+
+  const uint64_t done_deadline = handed_off_ns + timeout_ns;
+  int state;
+  while ((state = load_state()) == BSG_CRASH_HELPER_CLAIMED &&
+         bsg_monotonic_time_ns() < done_deadline) {
+    wait_for_state_change(state, done_deadline);
+  }
+  return true;
+}
@@ -0,0 +1,57 @@
+/**
+ * A thread started ahead of a crash which writes the report for the crashing
+ * thread, so that the unwind, symbolication and file I/O run on a healthy
+ * stack while the crashing thread only waits
+ */
+#ifndef BUGSNAG_CRASH_HELPER_H
+#define BUGSNAG_CRASH_HELPER_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * How long the crashing thread waits for the helper to take a crash before
+ * handling it itself
+ */
+#define BSG_CRASH_HELPER_PICKUP_NS 100000000
+
+/**
+ * Handles a crash on the helper thread. info and user_context belong to the
+ * crashing thread, which is stopped until the job returns.
+ */
+typedef void (*bsg_crash_helper_job)(int signum, siginfo_t *info,
+                                     void *user_context);
+
+/**
+ * Start the helper thread, which runs job for each crash handed to it, and
+ * begin handing crashes off. Returns false if the thread cannot be started.
+ * The thread is started once, and stays parked while the helper is disabled.
+ */
+bool bsg_crash_helper_start(bsg_crash_helper_job job);
+
+/**
+ * Stop handing crashes off, leaving the helper thread parked
+ */
+void bsg_crash_helper_stop(void);
+
+/**
+ * Hand a crash to the helper thread and wait up to timeout_ns for its job to
+ * finish. Returns false if the helper is not running or did not take the
+ * crash within BSG_CRASH_HELPER_PICKUP_NS, in which case the caller must
+ * handle it. Once the helper has taken a crash this returns true, even if
+ * the job overran timeout_ns.
+ */
+bool bsg_crash_helper_hand_off(int signum, siginfo_t *info, void *user_context,
+                               uint64_t timeout_ns) __asyncsafe;
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_CRASH_HELPER_H
@@ -1,23 +1,38 @@
 #include "crash_info.h"
+#include <string.h>
 #include <time.h>
 
+#include "time_common.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void bsg_populate_event_as(bsg_environment *env) {
-  static time_t now;
+  if (!__atomic_load_n(&env->state_populated, __ATOMIC_ACQUIRE)) {
+    env->next_event.handler_fallbacks |= BSG_HANDLER_FALLBACK_STATE_PENDING;
+  }
+  bsg_populate_event_state(env, &env->next_event);
+}
 
-  env->next_event.device.time = time(&now);
+void bsg_populate_event_state(bsg_environment *env, bugsnag_event *event) {
+  // not static, as copies of the next event may be populated concurrently
+  time_t now;
+
+  // take the last complete copy of the state, which a setter interrupted by
+  // the crash cannot have torn
+  const time_t foreground_start_time =
+      bsg_event_state_apply(&env->event_state, event);
+  event->device.time = time(&now);
   // Convert to milliseconds:
-  env->next_event.app.duration =
-      env->next_event.app.duration_ms_offset + ((now - env->start_time) * 1000);
-  if (env->next_event.app.in_foreground && env->foreground_start_time > 0) {
-    env->next_event.app.duration_in_foreground =
-        env->next_event.app.duration_in_foreground_ms_offset +
-        ((now - env->foreground_start_time) * 1000);
+  event->app.duration =
+      event->app.duration_ms_offset + ((now - env->start_time) * 1000);
+  if (event->app.in_foreground && foreground_start_time > 0) {
+    event->app.duration_in_foreground =
+        event->app.duration_in_foreground_ms_offset +
+        ((now - foreground_start_time) * 1000);
   } else {
-    env->next_event.app.duration_in_foreground = 0;
+    event->app.duration_in_foreground = 0;
   }
 }
 
@@ -29,6 +44,24 @@ void bsg_increment_unhandled_count(bugsnag_event *ptr) {
   }
 }
 
+void bsg_start_handler_timing(bugsnag_event *event) {
+  bsg_handler_timing *timing = &event->handler_timing;
+  memset(timing, 0, sizeof(bsg_handler_timing));
+  timing->started_ns = bsg_monotonic_time_ns();
+  timing->phase_ended_ns = timing->started_ns;
+  event->handler_fallbacks = 0;
+}
+
+void bsg_end_handler_phase(bugsnag_event *event, bsg_handler_phase phase) {
+  bsg_handler_timing *timing = &event->handler_timing;
+  if (timing->started_ns == 0 || phase >= BSG_HANDLER_PHASE_COUNT) {
+    return;
+  }
+  const uint64_t now = bsg_monotonic_time_ns();
+  timing->phase_ns[phase] = now - timing->phase_ended_ns;
+  timing->phase_ended_ns = now;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,10 +15,33 @@ extern "C" {
 void bsg_populate_event_as(bsg_environment *env) __asyncsafe;
 
 /**
- * Increment the handled/unhandled count on the bugsnag event.
+ * Fill in the app, device, user and context of an event from the event state
+ * of the environment, along with the time and durations. Used by
+ * bsg_populate_event_as(), and for copies of the next event.
+ */
+void bsg_populate_event_state(bsg_environment *env,
+                              bugsnag_event *event) __asyncsafe;
+
+/**
+ * Increment the handled/unhandled count on the bugsnag event. This only
+ * changes the crash handler's copy of the counts, taken from the event state
+ * by bsg_populate_event_as().
  */
 void bsg_increment_unhandled_count(bugsnag_event *ptr);
 
+/**
+ * Record when a crash handler was entered, starting its first phase. The
+ * timing of each phase follows the event into the report.
+ */
+void bsg_start_handler_timing(bugsnag_event *event) __asyncsafe;
+
+/**
+ * Record the end of a phase of a crash handler, which began when the phase
+ * before it ended. Does nothing unless bsg_start_handler_timing() was called.
+ */
+void bsg_end_handler_phase(bugsnag_event *event,
+                           bsg_handler_phase phase) __asyncsafe;
+
 #ifdef __cplusplus
 }
 #endif
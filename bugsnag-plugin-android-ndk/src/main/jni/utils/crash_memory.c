@@ -0,0 +1,69 @@
+#include "crash_memory.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../handlers/signal_handler.h"
+#include "logger.h"
+
+static const char *const bsg_crash_memory_names[] = {
+    "signal stack", "environment", "event file", "threads", "metadata arena",
+};
+
+static void prepare_region(void *start, size_t size, bool lock,
+                           bsg_crash_memory_footprint *footprint) {
+  memset(footprint, 0, sizeof(bsg_crash_memory_footprint));
+  if (start == NULL || size == 0) {
+    return;
+  }
+
+  const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+  const uintptr_t first_page = (uintptr_t)start & ~(page_size - 1);
+  const uintptr_t end = (uintptr_t)start + size;
+  footprint->size = size;
+  for (uintptr_t page = first_page; page < end; page += page_size) {
+    // write to each page without changing it, as other threads may be using
+    // the bytes around it, so that copy-on-write pages are also faulted in
+    char *byte = (char *)(page < (uintptr_t)start ? (uintptr_t)start : page);
+    __atomic_fetch_add(byte, 0, __ATOMIC_RELAXED);
+    footprint->page_count++;
+  }
+
+  void *locked_start = (void *)first_page;
+  const size_t locked_size = end - first_page;
+  if (lock) {
+    footprint->locked = mlock(locked_start, locked_size) == 0;
+  } else {
+    munlock(locked_start, locked_size);
+  }
+}
+
+void bsg_prepare_crash_memory(
+    bsg_environment *env, bool lock,
+    bsg_crash_memory_footprint footprint[BSG_CRASH_MEMORY_REGION_COUNT]) {
+  prepare_region(bsg_global_signal_stack.ss_sp, bsg_global_signal_stack.ss_size,
+                 lock, &footprint[BSG_CRASH_MEMORY_SIGNAL_STACK]);
+  prepare_region(env, sizeof(bsg_environment), lock,
+                 &footprint[BSG_CRASH_MEMORY_ENVIRONMENT]);
+  prepare_region(env->next_event_mapping,
+                 env->next_event_mapping != NULL ? env->next_event_mapping_size
+                                                 : 0,
+                 lock, &footprint[BSG_CRASH_MEMORY_EVENT_FILE]);
+  prepare_region(env->next_event.threads,
+                 (size_t)env->next_event.thread_capacity * sizeof(bsg_thread),
+                 lock, &footprint[BSG_CRASH_MEMORY_THREADS]);
+  prepare_region(env->next_event.metadata_arena.data,
+                 env->next_event.metadata_arena.capacity, lock,
+                 &footprint[BSG_CRASH_MEMORY_METADATA_ARENA]);
+
+  for (int region = 0; region < BSG_CRASH_MEMORY_REGION_COUNT; region++) {
+    const bsg_crash_memory_footprint *item = &footprint[region];
+    if (item->size > 0) {
+      BUGSNAG_LOG("Crash memory %s: %zu bytes in %zu pages%s",
+                  bsg_crash_memory_names[region], item->size, item->page_count,
+                  item->locked ? ", locked" : "");
+    }
+  }
+}
@@ -0,0 +1,55 @@
+/**
+ * Faults in, and optionally locks, the memory which crash handlers use, so
+ * that a crash in a process under memory pressure does not wait on page
+ * faults while it is being handled
+ */
+#ifndef BUGSNAG_CRASH_MEMORY_H
+#define BUGSNAG_CRASH_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../bugsnag_ndk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The regions of memory written by crash handlers. The writers which fill the
+ * event file are kept on the signal stack.
+ */
+typedef enum {
+  BSG_CRASH_MEMORY_SIGNAL_STACK,
+  /** bsg_environment, including the event which is written on a crash */
+  BSG_CRASH_MEMORY_ENVIRONMENT,
+  /** The pre-allocated event file, see bsg_event_write_prepare() */
+  BSG_CRASH_MEMORY_EVENT_FILE,
+  BSG_CRASH_MEMORY_THREADS,
+  BSG_CRASH_MEMORY_METADATA_ARENA,
+  BSG_CRASH_MEMORY_REGION_COUNT
+} bsg_crash_memory_region;
+
+typedef struct {
+  /** The bytes in the region, which is 0 if it is not in use */
+  size_t size;
+  /** The pages spanned by the region, each of which has been faulted in */
+  size_t page_count;
+  /** Whether the pages were locked into memory */
+  bool locked;
+} bsg_crash_memory_footprint;
+
+/**
+ * Fault in every page of each region used by crash handlers in env, filling
+ * footprint with the size of each. If lock is true the pages are also locked
+ * with mlock(), which can fail once RLIMIT_MEMLOCK is reached; otherwise any
+ * pages locked before are unlocked.
+ */
+void bsg_prepare_crash_memory(
+    bsg_environment *env, bool lock,
+    bsg_crash_memory_footprint footprint[BSG_CRASH_MEMORY_REGION_COUNT]);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_CRASH_MEMORY_H
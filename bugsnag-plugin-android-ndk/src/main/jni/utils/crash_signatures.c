@@ -0,0 +1,202 @@
+#include "crash_signatures.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "string.h"
+
+/*
+ * The table is a file mapped shared, so that crash handlers update it with
+ * plain memory writes and the kernel persists them after the process dies.
+ * An entry is claimed by clearing its signature, filled in and then published
+ * by storing the signature, and a signature of 0 marks an unused entry. A
+ * repeat is only counted while the report of the first crash still exists, so
+ * that a crash seen again after its report was delivered is reported afresh.
+ */
+
+#define BSG_CRASH_SIGNATURES_MAGIC 0x62736773
+#define BSG_CRASH_SIGNATURES_VERSION 1
+
+typedef struct {
+  uint64_t signature;
+  uint32_t repeats;
+  char report_path[384];
+} bsg_crash_signature_entry;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t next_entry;
+  bsg_crash_signature_entry entries[BSG_CRASH_SIGNATURES_MAX];
+} bsg_crash_signature_table;
+
+static bsg_crash_signature_table *active_table = NULL;
+static bsg_crash_signature_table *mapped_table = NULL;
+
+/**
+ * The path of the table for a report, beside its directory like the unwinder
+ * calibration, so that it is not mistaken for a pending report
+ */
+static bool table_path(const char *report_path, char *path, size_t size) {
+  bsg_strncpy(path, report_path, size);
+  char *separator = strrchr(path, '/');
+  if (separator == NULL ||
+      (size_t)(separator - path) + sizeof("-signatures") > size) {
+    return false;
+  }
+  strcpy(separator, "-signatures");
+  return true;
+}
+
+/**
+ * Map the table at path, resetting it if it was written by another version,
+ * or return NULL if it cannot be opened
+ */
+static bsg_crash_signature_table *map_table(const char *path, bool create) {
+  const int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0);
+  int fd = open(path, flags, 0600);
+  if (fd < 0) {
+    return NULL;
+  }
+  bsg_crash_signature_table *table = NULL;
+  if (ftruncate(fd, sizeof(bsg_crash_signature_table)) != 0) {
+    goto exit;
+  }
+  void *mapping = mmap(NULL, sizeof(bsg_crash_signature_table),
+                       PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    goto exit;
+  }
+  table = mapping;
+  // also faults in the page, so that crash handlers do not wait on it
+  if (table->magic != BSG_CRASH_SIGNATURES_MAGIC ||
+      table->version != BSG_CRASH_SIGNATURES_VERSION) {
+    memset(table, 0, sizeof(bsg_crash_signature_table));
+    table->magic = BSG_CRASH_SIGNATURES_MAGIC;
+    table->version = BSG_CRASH_SIGNATURES_VERSION;
+  }
+
+exit:
+  // the mapping holds its own reference to the file
+  close(fd);
+  return table;
+}
+
+bool bsg_crash_signatures_enable(const char *report_path) {
+  if (mapped_table == NULL) {
+    char path[sizeof(((bsg_crash_signature_entry *)0)->report_path) + 16];
+    if (!table_path(report_path, path, sizeof(path))) {
+      return false;
+    }
+    mapped_table = map_table(path, true);
+    if (mapped_table == NULL) {
+      BUGSNAG_LOG("Failed to map the crash signature table at %s", path);
+      return false;
+    }
+  }
+  __atomic_store_n(&active_table, mapped_table, __ATOMIC_RELEASE);
+  return true;
+}
+
+void bsg_crash_signatures_disable(void) {
+  __atomic_store_n(&active_table, NULL, __ATOMIC_RELEASE);
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t length) {
+  const uint8_t *pos = bytes;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= pos[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+uint64_t bsg_crash_signature(const bugsnag_event *event, int signum) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = hash_bytes(hash, &signum, sizeof(signum));
+  const bsg_frame_module_table *modules = &event->frame_modules;
+  const ssize_t frame_count =
+      event->error.frame_count < BSG_CRASH_SIGNATURE_FRAMES
+          ? event->error.frame_count
+          : BSG_CRASH_SIGNATURE_FRAMES;
+  for (ssize_t i = 0; i < frame_count; i++) {
+    const bugsnag_stackframe *frame = &event->error.stacktrace[i];
+    const int index = modules->frame_modules[i];
+    uintptr_t address;
+    const char *file;
+    // load addresses differ between launches, so only offsets are hashed
+    if (modules->count > 0 && index != BSG_NO_FRAME_MODULE &&
+        index < modules->count) {
+      address = frame->frame_address - modules->modules[index].start;
+      file = modules->modules[index].path;
+    } else {
+      address = frame->frame_address - frame->load_address;
+      file = frame->filename;
+    }
+    hash = hash_bytes(hash, &address, sizeof(address));
+    hash = hash_bytes(hash, file, bsg_strlen(file));
+  }
+  // 0 marks an unused entry
+  return hash == 0 ? 1 : hash;
+}
+
+bool bsg_crash_signatures_count_repeat(uint64_t signature) {
+  bsg_crash_signature_table *table =
+      __atomic_load_n(&active_table, __ATOMIC_ACQUIRE);
+  if (table == NULL) {
+    return false;
+  }
+  for (int i = 0; i < BSG_CRASH_SIGNATURES_MAX; i++) {
+    bsg_crash_signature_entry *entry = &table->entries[i];
+    if (__atomic_load_n(&entry->signature, __ATOMIC_ACQUIRE) == signature &&
+        access(entry->report_path, F_OK) == 0) {
+      __atomic_add_fetch(&entry->repeats, 1, __ATOMIC_RELEASE);
+      return true;
+    }
+  }
+  return false;
+}
+
+void bsg_crash_signatures_add(uint64_t signature, const char *report_path) {
+  bsg_crash_signature_table *table =
+      __atomic_load_n(&active_table, __ATOMIC_ACQUIRE);
+  if (table == NULL) {
+    return;
+  }
+  const uint32_t index =
+      __atomic_fetch_add(&table->next_entry, 1, __ATOMIC_RELAXED) %
+      BSG_CRASH_SIGNATURES_MAX;
+  bsg_crash_signature_entry *entry = &table->entries[index];
+  __atomic_store_n(&entry->signature, 0, __ATOMIC_RELEASE);
+  bsg_strncpy(entry->report_path, report_path, sizeof(entry->report_path));
+  __atomic_store_n(&entry->repeats, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->signature, signature, __ATOMIC_RELEASE);
+}
+
+uint32_t bsg_crash_signatures_take_repeats(const char *report_path) {
+  char path[sizeof(((bsg_crash_signature_entry *)0)->report_path) + 16];
+  if (!table_path(report_path, path, sizeof(path))) {
+    return 0;
+  }
+  // reports are delivered whether or not de-duplication is enabled this launch
+  bsg_crash_signature_table *table = map_table(path, false);
+  if (table == NULL) {
+    return 0;
+  }
+  uint32_t repeats = 0;
+  for (int i = 0; i < BSG_CRASH_SIGNATURES_MAX; i++) {
+    bsg_crash_signature_entry *entry = &table->entries[i];
+    if (__atomic_load_n(&entry->signature, __ATOMIC_ACQUIRE) != 0 &&
+        strcmp(entry->report_path, report_path) == 0) {
+      __atomic_store_n(&entry->signature, 0, __ATOMIC_RELEASE);
+      repeats = __atomic_exchange_n(&entry->repeats, 0, __ATOMIC_ACQ_REL);
+      break;
+    }
+  }
+  munmap(table, sizeof(bsg_crash_signature_table));
+  return repeats;
+}
@@ -0,0 +1,69 @@
+/**
+ * A small table of the signatures of recent native crashes, kept beside the
+ * report directory, so that an app which crash-loops writes one report and
+ * counts the repeats of that crash against it rather than writing a report
+ * on every launch
+ */
+#ifndef BUGSNAG_CRASH_SIGNATURES_H
+#define BUGSNAG_CRASH_SIGNATURES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../event.h"
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of frames from the top of the stack hashed into a signature */
+#define BSG_CRASH_SIGNATURE_FRAMES 8
+
+/** The number of signatures kept, after which the oldest is replaced */
+#define BSG_CRASH_SIGNATURES_MAX 8
+
+/**
+ * Map the table for the report directory containing report_path, creating it
+ * if needed, so that crash handlers can look up and record signatures.
+ * Returns false if the table could not be mapped.
+ */
+bool bsg_crash_signatures_enable(const char *report_path);
+
+/**
+ * Stop crash handlers using the table. The mapping is kept, as a handler may
+ * be reading it.
+ */
+void bsg_crash_signatures_disable(void);
+
+/**
+ * Hash the signal and the relative addresses and files of the top frames of
+ * the stacktrace, which are the same each time a crash repeats
+ */
+uint64_t bsg_crash_signature(const bugsnag_event *event,
+                             int signum) __asyncsafe;
+
+/**
+ * Count another occurrence of the crash if its signature is in the table and
+ * the report written for it has not been delivered yet. Returns false if the
+ * crash should be reported, including when the table is disabled.
+ */
+bool bsg_crash_signatures_count_repeat(uint64_t signature) __asyncsafe;
+
+/**
+ * Record the signature of a crash which has been written to report_path,
+ * replacing the oldest entry once the table is full
+ */
+void bsg_crash_signatures_add(uint64_t signature,
+                              const char *report_path) __asyncsafe;
+
+/**
+ * Remove the entry for the report at report_path, if there is one, returning
+ * the number of times its crash repeated while it was waiting for delivery
+ */
+uint32_t bsg_crash_signatures_take_repeats(const char *report_path);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,128 @@
+#include "crash_watchdog.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "signal_common.h"
+#include "time_common.h"
+
+/*
+ * The watchdog is a POSIX timer which signals the thread handling a crash
+ * directly, so that it is interrupted even if the rest of the process is
+ * stalled. Timers are created and set with raw system calls, which unlike
+ * some of the libc wrappers are safe to use in a signal handler.
+ */
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+sigjmp_buf bsg_crash_watchdog_jump;
+
+/** The signal raised by the timer, or 0 if the watchdog is not installed */
+static int bsg_watchdog_signal = 0;
+/** The kernel id of the timer, once it has been created */
+static int bsg_watchdog_timer;
+/** The thread signalled by the timer, or 0 if it has not been created */
+static pid_t bsg_watchdog_timer_tid = 0;
+/** The thread in a guarded stage, or 0 when disarmed */
+static pid_t bsg_watchdog_armed_tid = 0;
+static uint64_t bsg_watchdog_deadline_ns = 0;
+
+bool bsg_crash_watchdog_expired(uint64_t deadline_ns) {
+  return deadline_ns != 0 && bsg_monotonic_time_ns() >= deadline_ns;
+}
+
+uint64_t bsg_crash_watchdog_remaining_ns(uint64_t deadline_ns) {
+  if (deadline_ns == 0) {
+    return 0;
+  }
+  const uint64_t now = bsg_monotonic_time_ns();
+  return now < deadline_ns ? deadline_ns - now : 0;
+}
+
+static void handle_watchdog_signal(int signum, siginfo_t *info,
+                                   void *user_context) {
+  const pid_t tid = __atomic_load_n(&bsg_watchdog_armed_tid, __ATOMIC_ACQUIRE);
+  // a signal from an earlier stage may arrive after it has been disarmed, or
+  // for a later stage which still has time left
+  if (tid == 0 || tid != (pid_t)syscall(SYS_gettid) ||
+      !bsg_crash_watchdog_expired(bsg_watchdog_deadline_ns)) {
+    return;
+  }
+  __atomic_store_n(&bsg_watchdog_armed_tid, 0, __ATOMIC_RELEASE);
+  siglongjmp(bsg_crash_watchdog_jump, 1);
+}
+
+bool bsg_crash_watchdog_install(void) {
+  static pthread_mutex_t bsg_watchdog_config = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_lock(&bsg_watchdog_config);
+  if (bsg_watchdog_signal != 0) {
+    pthread_mutex_unlock(&bsg_watchdog_config);
+    return true;
+  }
+
+  bsg_watchdog_signal = bsg_claim_rt_signal(handle_watchdog_signal);
+  pthread_mutex_unlock(&bsg_watchdog_config);
+
+  if (bsg_watchdog_signal == 0) {
+    BUGSNAG_LOG("No signal is available for the crash watchdog");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Create a timer which signals tid, replacing any timer for another thread
+ */
+static bool prepare_timer(pid_t tid) {
+  if (bsg_watchdog_timer_tid == tid) {
+    return true;
+  }
+  if (bsg_watchdog_timer_tid != 0) {
+    syscall(SYS_timer_delete, bsg_watchdog_timer);
+    bsg_watchdog_timer_tid = 0;
+  }
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = bsg_watchdog_signal;
+  event.sigev_notify_thread_id = tid;
+  if (syscall(SYS_timer_create, CLOCK_MONOTONIC, &event, &bsg_watchdog_timer) !=
+      0) {
+    return false;
+  }
+  bsg_watchdog_timer_tid = tid;
+  return true;
+}
+
+static void set_timer(uint64_t deadline_ns) {
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = (time_t)(deadline_ns / 1000000000);
+  spec.it_value.tv_nsec = (long)(deadline_ns % 1000000000);
+  syscall(SYS_timer_settime, bsg_watchdog_timer, TIMER_ABSTIME, &spec, NULL);
+}
+
+void bsg_crash_watchdog_arm(uint64_t deadline_ns) {
+  const pid_t tid = (pid_t)syscall(SYS_gettid);
+  if (deadline_ns == 0 || bsg_watchdog_signal == 0 || !prepare_timer(tid)) {
+    return;
+  }
+  bsg_watchdog_deadline_ns = deadline_ns;
+  __atomic_store_n(&bsg_watchdog_armed_tid, tid, __ATOMIC_RELEASE);
+  // a deadline which has already passed fires immediately
+  set_timer(deadline_ns);
+}
+
+void bsg_crash_watchdog_disarm(void) {
+  if (__atomic_exchange_n(&bsg_watchdog_armed_tid, 0, __ATOMIC_ACQ_REL) != 0) {
+    // an it_value of 0 stops the timer
+    set_timer(0);
+  }
+}
@@ -0,0 +1,60 @@
+/**
+ * Bounds the time a crash handler spends in each of its stages, so that a
+ * stalled unwind or read of /proc is abandoned for a cheaper fallback rather
+ * than losing the report
+ */
+#ifndef BUGSNAG_CRASH_WATCHDOG_H
+#define BUGSNAG_CRASH_WATCHDOG_H
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Where a guarded stage resumes once its deadline passes. A stage is guarded
+ * by calling sigsetjmp() on this, then bsg_crash_watchdog_arm(), running the
+ * stage and calling bsg_crash_watchdog_disarm(). If the deadline passes first
+ * sigsetjmp() returns again with a non-zero value, and the stage's fallback
+ * should run instead. Anything held by the abandoned stage, such as a lock,
+ * stays held, so fallbacks must not depend on it.
+ */
+extern sigjmp_buf bsg_crash_watchdog_jump;
+
+/**
+ * Claim an unused real-time signal which interrupts guarded stages, returning
+ * false if none is available. Does nothing once installed.
+ */
+bool bsg_crash_watchdog_install(void);
+
+/**
+ * Interrupt the calling thread at deadline_ns, a CLOCK_MONOTONIC time, if it
+ * has not been disarmed by then. A deadline of 0, or a watchdog which is not
+ * installed, leaves the stage unbounded.
+ */
+void bsg_crash_watchdog_arm(uint64_t deadline_ns) __asyncsafe;
+
+/**
+ * Stop the watchdog from interrupting the stage which armed it
+ */
+void bsg_crash_watchdog_disarm(void) __asyncsafe;
+
+/**
+ * Whether deadline_ns has passed, which is never true for a deadline of 0
+ */
+bool bsg_crash_watchdog_expired(uint64_t deadline_ns) __asyncsafe;
+
+/**
+ * The time until deadline_ns, which is 0 if it has passed or is not set
+ */
+uint64_t bsg_crash_watchdog_remaining_ns(uint64_t deadline_ns) __asyncsafe;
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_CRASH_WATCHDOG_H
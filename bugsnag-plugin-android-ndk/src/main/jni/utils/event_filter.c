@@ -0,0 +1,165 @@
+#include "event_filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "module_index.h"
+#include "string.h"
+
+/**
+ * A slot of an open-addressed set of names. An empty slot has a hash of 0,
+ * which no name hashes to.
+ */
+typedef struct {
+  uint64_t hash;
+  const char *name;
+} bsg_filter_slot;
+
+typedef struct {
+  /** A power of two, or 0 if the set is empty */
+  size_t capacity;
+  bsg_filter_slot *slots;
+} bsg_filter_names;
+
+typedef struct {
+  uint64_t signal_mask;
+  bsg_filter_names error_classes;
+  bsg_filter_names modules;
+} bsg_filter_rules;
+
+/**
+ * The current rules, allocated in one block with their slots and names.
+ * Replaced rules are never freed, as a crash handler may be reading them.
+ */
+static bsg_filter_rules *bsg_rules = NULL;
+
+static uint64_t hash_name(const char *name) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char *pos = name; *pos != '\0'; pos++) {
+    hash ^= (uint8_t)*pos;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash | 1;
+}
+
+static size_t names_capacity(size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+  // at most half full, so that probes stay short
+  size_t capacity = 2;
+  while (capacity < count * 2) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+static bool names_contain(const bsg_filter_names *names, const char *name) {
+  if (names->capacity == 0 || name == NULL) {
+    return false;
+  }
+  const uint64_t hash = hash_name(name);
+  for (size_t i = hash & (names->capacity - 1);;
+       i = (i + 1) & (names->capacity - 1)) {
+    const bsg_filter_slot *slot = &names->slots[i];
+    if (slot->hash == 0) {
+      return false;
+    }
+    if (slot->hash == hash && strcmp(slot->name, name) == 0) {
+      return true;
+    }
+  }
+}
+
+/**
+ * Copy names into the block after the slots, returning where the next names
+ * can be copied to
+ */
+static char *add_names(bsg_filter_names *names, const char *const *list,
+                       size_t count, char *strings) {
+  for (size_t i = 0; i < count; i++) {
+    const char *name = list[i];
+    if (name == NULL || names_contain(names, name)) {
+      continue;
+    }
+    const size_t length = strlen(name) + 1;
+    memcpy(strings, name, length);
+    const uint64_t hash = hash_name(name);
+    size_t index = hash & (names->capacity - 1);
+    while (names->slots[index].hash != 0) {
+      index = (index + 1) & (names->capacity - 1);
+    }
+    names->slots[index].hash = hash;
+    names->slots[index].name = strings;
+    strings += length;
+  }
+  return strings;
+}
+
+static size_t names_length(const char *const *list, size_t count) {
+  size_t length = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (list[i] != NULL) {
+      length += strlen(list[i]) + 1;
+    }
+  }
+  return length;
+}
+
+bool bsg_event_filter_set(const char *const *error_classes, size_t class_count,
+                          const char *const *modules, size_t module_count,
+                          uint64_t signal_mask) {
+  const size_t class_capacity = names_capacity(class_count);
+  const size_t module_capacity = names_capacity(module_count);
+  bsg_filter_rules *rules =
+      calloc(1, sizeof(bsg_filter_rules) +
+                    (class_capacity + module_capacity) *
+                        sizeof(bsg_filter_slot) +
+                    names_length(error_classes, class_count) +
+                    names_length(modules, module_count));
+  if (rules == NULL) {
+    return false;
+  }
+  rules->signal_mask = signal_mask;
+  rules->error_classes.capacity = class_capacity;
+  rules->error_classes.slots = (bsg_filter_slot *)(rules + 1);
+  rules->modules.capacity = module_capacity;
+  rules->modules.slots = rules->error_classes.slots + class_capacity;
+  char *strings = (char *)(rules->modules.slots + module_capacity);
+  strings = add_names(&rules->error_classes, error_classes, class_count,
+                      strings);
+  add_names(&rules->modules, modules, module_count, strings);
+
+  __atomic_store_n(&bsg_rules, rules, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool module_matches(const bsg_filter_names *modules, uintptr_t pc) {
+  // a stale index could name a library which has since been unloaded
+  if (modules->capacity == 0 || pc == 0 || !bsg_module_index_current()) {
+    return false;
+  }
+  const bsg_module *module = bsg_module_index_find(pc);
+  if (module == NULL || module->path == NULL) {
+    return false;
+  }
+  const char *separator = strrchr(module->path, '/');
+  const char *file_name = separator != NULL ? separator + 1 : module->path;
+  return names_contain(modules, file_name) ||
+         names_contain(modules, module->path);
+}
+
+bool bsg_event_filter_drops(const char *error_class, int signum,
+                            uintptr_t pc) {
+  const bsg_filter_rules *rules =
+      __atomic_load_n(&bsg_rules, __ATOMIC_ACQUIRE);
+  if (rules == NULL) {
+    return false;
+  }
+  if (signum > 0 && signum < 64 && (rules->signal_mask >> signum) & 1) {
+    return true;
+  }
+  return names_contain(&rules->error_classes, error_class) ||
+         module_matches(&rules->modules, pc);
+}
@@ -0,0 +1,41 @@
+/**
+ * Rules for native crashes which should not be reported, set from
+ * configuration and checked by the crash handlers before anything else is
+ * done, so that a dropped crash costs no unwinding, thread capture or disk
+ * I/O. Unlike an on_error callback, no user code runs on the crash path.
+ */
+#ifndef BUGSNAG_EVENT_FILTER_H
+#define BUGSNAG_EVENT_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Replace the rules: crashes are dropped if their error class is one of
+ * error_classes, if the crash address is in a library whose file name or path
+ * is one of modules, or if they were raised by a signal whose bit is set in
+ * signal_mask. The names are copied. Returns false if the rules could not be
+ * allocated, in which case the earlier rules are kept.
+ */
+bool bsg_event_filter_set(const char *const *error_classes, size_t class_count,
+                          const char *const *modules, size_t module_count,
+                          uint64_t signal_mask);
+
+/**
+ * Whether a crash matches a rule. error_class may be NULL, and signum and pc
+ * 0 when they are not known.
+ */
+bool bsg_event_filter_drops(const char *error_class, int signum,
+                            uintptr_t pc) __asyncsafe;
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_EVENT_FILTER_H
@@ -0,0 +1,210 @@
+#include "event_template.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "string.h"
+
+/*
+ * The template is only valid for the build which wrote it, so is keyed on
+ * the path and identity of the loaded library, which change whenever the app
+ * is installed or updated, and on the fingerprint of the OS build. Fields
+ * which the Java layer may change while the app runs are left out, and are
+ * read when the state is populated as usual.
+ */
+
+#define BSG_EVENT_TEMPLATE_MAGIC 0x62736574
+#define BSG_EVENT_TEMPLATE_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t event_version;
+  uint32_t size;
+  uint64_t build_key;
+  bsg_notifier notifier;
+  bsg_app_info app;
+  bsg_device_info device;
+} bsg_event_template;
+
+static bool template_path(const char *report_path, char *path, size_t size) {
+  static const char suffix[] = "-event.template";
+  bsg_strncpy(path, report_path, size);
+  char *separator = strrchr(path, '/');
+  if (separator == NULL ||
+      (size_t)(separator - path) + sizeof(suffix) > size) {
+    return false;
+  }
+  strcpy(separator, suffix);
+  return true;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t length) {
+  const uint8_t *pos = bytes;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= pos[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t current_build_key(void) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  Dl_info info;
+  if (dladdr((void *)current_build_key, &info) != 0 &&
+      info.dli_fname != NULL) {
+    char path[512];
+    bsg_strncpy(path, info.dli_fname, sizeof(path));
+    hash = hash_bytes(hash, path, bsg_strlen(path));
+    // a library loaded straight from the APK is identified by the APK
+    char *entry = strstr(path, "!/");
+    if (entry != NULL) {
+      *entry = '\0';
+    }
+    struct stat st;
+    if (stat(path, &st) == 0) {
+      hash = hash_bytes(hash, &st.st_ino, sizeof(st.st_ino));
+      hash = hash_bytes(hash, &st.st_size, sizeof(st.st_size));
+      hash = hash_bytes(hash, &st.st_mtime, sizeof(st.st_mtime));
+    }
+  }
+  char fingerprint[PROP_VALUE_MAX] = "";
+  __system_property_get("ro.build.fingerprint", fingerprint);
+  return hash_bytes(hash, fingerprint, bsg_strlen(fingerprint));
+}
+
+static bool is_valid_template(const bsg_event_template *template,
+                              uint64_t build_key) {
+  return template->magic == BSG_EVENT_TEMPLATE_MAGIC &&
+         template->version == BSG_EVENT_TEMPLATE_VERSION &&
+         template->event_version == BUGSNAG_EVENT_VERSION &&
+         template->size == sizeof(bsg_event_template) &&
+         template->build_key == build_key;
+}
+
+/**
+ * Copy the fields which stay the same for the life of a build on a device
+ */
+static void copy_static_fields(bsg_notifier *notifier, bsg_app_info *app,
+                               bsg_device_info *device,
+                               const bsg_notifier *src_notifier,
+                               const bsg_app_info *src_app,
+                               const bsg_device_info *src_device) {
+  *notifier = *src_notifier;
+
+  bsg_strncpy(app->id, src_app->id, sizeof(app->id));
+  bsg_strncpy(app->release_stage, src_app->release_stage,
+              sizeof(app->release_stage));
+  bsg_strncpy(app->type, src_app->type, sizeof(app->type));
+  bsg_strncpy(app->version, src_app->version, sizeof(app->version));
+  app->version_code = src_app->version_code;
+  bsg_strncpy(app->build_uuid, src_app->build_uuid, sizeof(app->build_uuid));
+  bsg_strncpy(app->binary_arch, src_app->binary_arch,
+              sizeof(app->binary_arch));
+
+  device->api_level = src_device->api_level;
+  device->cpu_abi_count = src_device->cpu_abi_count;
+  memcpy(device->cpu_abi, src_device->cpu_abi, sizeof(device->cpu_abi));
+  bsg_strncpy(device->id, src_device->id, sizeof(device->id));
+  device->jailbroken = src_device->jailbroken;
+  bsg_strncpy(device->locale, src_device->locale, sizeof(device->locale));
+  bsg_strncpy(device->manufacturer, src_device->manufacturer,
+              sizeof(device->manufacturer));
+  bsg_strncpy(device->model, src_device->model, sizeof(device->model));
+  bsg_strncpy(device->os_build, src_device->os_build,
+              sizeof(device->os_build));
+  bsg_strncpy(device->os_version, src_device->os_version,
+              sizeof(device->os_version));
+  bsg_strncpy(device->os_name, src_device->os_name,
+              sizeof(device->os_name));
+  device->total_memory = src_device->total_memory;
+}
+
+/**
+ * Map the template at path read-only, returning MAP_FAILED if it is missing
+ * or does not apply to this build
+ */
+static const bsg_event_template *map_template(const char *path,
+                                              uint64_t build_key) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return MAP_FAILED;
+  }
+  const bsg_event_template *template = MAP_FAILED;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size == (off_t)sizeof(bsg_event_template)) {
+    template = mmap(NULL, sizeof(bsg_event_template), PROT_READ, MAP_PRIVATE,
+                    fd, 0);
+  }
+  close(fd);
+  if (template != MAP_FAILED && !is_valid_template(template, build_key)) {
+    munmap((void *)template, sizeof(bsg_event_template));
+    template = MAP_FAILED;
+  }
+  return template;
+}
+
+bool bsg_event_template_apply(const char *report_path, bugsnag_event *event) {
+  char path[512];
+  if (!template_path(report_path, path, sizeof(path))) {
+    return false;
+  }
+  const bsg_event_template *template = map_template(path, current_build_key());
+  if (template == MAP_FAILED) {
+    return false;
+  }
+  copy_static_fields(&event->notifier, &event->app, &event->device,
+                     &template->notifier, &template->app, &template->device);
+  munmap((void *)template, sizeof(bsg_event_template));
+  return true;
+}
+
+bool bsg_event_template_publish(const char *report_path,
+                                const bugsnag_event *event) {
+  char path[512];
+  if (!template_path(report_path, path, sizeof(path))) {
+    return false;
+  }
+  const uint64_t build_key = current_build_key();
+  const bsg_event_template *existing = map_template(path, build_key);
+  if (existing != MAP_FAILED) {
+    munmap((void *)existing, sizeof(bsg_event_template));
+    return true;
+  }
+
+  bsg_event_template template;
+  memset(&template, 0, sizeof(template));
+  template.magic = BSG_EVENT_TEMPLATE_MAGIC;
+  template.version = BSG_EVENT_TEMPLATE_VERSION;
+  template.event_version = BUGSNAG_EVENT_VERSION;
+  template.size = sizeof(bsg_event_template);
+  template.build_key = build_key;
+  copy_static_fields(&template.notifier, &template.app, &template.device,
+                     &event->notifier, &event->app, &event->device);
+
+  // written aside and renamed into place, so that other processes only ever
+  // map a complete template
+  char temp_path[sizeof(path) + 16];
+  snprintf(temp_path, sizeof(temp_path), "%s.%d", path, (int)getpid());
+  int fd = open(temp_path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  const bool written =
+      write(fd, &template, sizeof(template)) == (ssize_t)sizeof(template);
+  close(fd);
+  if (!written || rename(temp_path, path) != 0) {
+    BUGSNAG_LOG("Failed to write the event template at %s", path);
+    unlink(temp_path);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,42 @@
+/**
+ * A template of the static part of the event, the notifier and the app and
+ * device fields which do not change while a build runs on a device, written
+ * once to a file beside the report directory. The other processes of the app
+ * map it read-only to fill their event at install, sharing its pages through
+ * the page cache, rather than each reading the same fields over JNI before
+ * their crash handlers report anything useful.
+ */
+#ifndef BUGSNAG_EVENT_TEMPLATE_H
+#define BUGSNAG_EVENT_TEMPLATE_H
+
+#include <stdbool.h>
+
+#include "../event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Fill the static app, device and notifier fields of event from the template
+ * beside the report directory containing report_path. A template written by a
+ * different build of the library or app, or before an OS update, is ignored.
+ *
+ * @return false if there was no template which applies, leaving event as it was
+ */
+bool bsg_event_template_apply(const char *report_path, bugsnag_event *event);
+
+/**
+ * Write the static fields of a populated event as the template beside the
+ * report directory containing report_path, replacing any template which does
+ * not apply to this build.
+ *
+ * @return false if the template could not be written
+ */
+bool bsg_event_template_publish(const char *report_path,
+                                const bugsnag_event *event);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
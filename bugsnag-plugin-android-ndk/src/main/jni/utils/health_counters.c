@@ -0,0 +1,27 @@
+#include "health_counters.h"
+
+static bsg_health_counters bsg_health;
+
+const char *const bsg_health_counter_names[BSG_HEALTH_COUNTER_COUNT] = {
+    [BSG_HEALTH_METADATA_SPILLED] = "metadataSpilled",
+    [BSG_HEALTH_METADATA_DROPPED] = "metadataDropped",
+    [BSG_HEALTH_BREADCRUMBS_OVERWRITTEN] = "breadcrumbsOverwritten",
+    [BSG_HEALTH_BREADCRUMBS_DROPPED] = "breadcrumbsDropped",
+    [BSG_HEALTH_THREADS_OVER_CAPACITY] = "threadsOverCapacity",
+    [BSG_HEALTH_THREADS_OVER_BUDGET] = "threadsOverBudget",
+    [BSG_HEALTH_MAPS_PARSE_FAILED] = "mapsParseFailed",
+    [BSG_HEALTH_UNWIND_SINGLE_FRAME] = "unwindSingleFrame",
+    [BSG_HEALTH_UNWIND_FRAMES_LIMITED] = "unwindFramesLimited",
+};
+
+void bsg_health_count(bsg_health_counter counter) {
+  __atomic_add_fetch(&bsg_health.counts[counter], 1, __ATOMIC_RELAXED);
+}
+
+void bsg_health_read(bsg_health_counters *dest, bool reset) {
+  for (int i = 0; i < BSG_HEALTH_COUNTER_COUNT; i++) {
+    dest->counts[i] =
+        reset ? __atomic_exchange_n(&bsg_health.counts[i], 0, __ATOMIC_RELAXED)
+              : __atomic_load_n(&bsg_health.counts[i], __ATOMIC_RELAXED);
+  }
+}
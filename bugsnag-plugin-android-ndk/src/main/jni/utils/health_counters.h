@@ -0,0 +1,63 @@
+/**
+ * Counts of the things which the native layer gives up on without failing,
+ * such as values which do not fit in a fixed capacity or stacks which could
+ * only be partly unwound. They are kept for the life of the process, written
+ * into each crash report and read through NativeBridge.getHealthCounters(), so
+ * that capacities can be sized and unwinders compared.
+ */
+#ifndef BUGSNAG_HEALTH_COUNTERS_H
+#define BUGSNAG_HEALTH_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  /** Metadata values which did not fit in the event and went to the arena */
+  BSG_HEALTH_METADATA_SPILLED,
+  /** Metadata values which fit in neither the event nor the arena */
+  BSG_HEALTH_METADATA_DROPPED,
+  /** Breadcrumbs which replaced the oldest in a full ring */
+  BSG_HEALTH_BREADCRUMBS_OVERWRITTEN,
+  /** Breadcrumbs which could not be added, as they were too large */
+  BSG_HEALTH_BREADCRUMBS_DROPPED,
+  /** Thread captures which stopped at the thread capacity */
+  BSG_HEALTH_THREADS_OVER_CAPACITY,
+  /** Thread captures which stopped at their time budget */
+  BSG_HEALTH_THREADS_OVER_BUDGET,
+  /** Unwinds which could not parse /proc/self/maps and kept only the pc */
+  BSG_HEALTH_MAPS_PARSE_FAILED,
+  /** Unwinds which found no more than the frame of the pc */
+  BSG_HEALTH_UNWIND_SINGLE_FRAME,
+  /** Unwinds which stopped at the depth limit of their capture path */
+  BSG_HEALTH_UNWIND_FRAMES_LIMITED,
+  BSG_HEALTH_COUNTER_COUNT
+} bsg_health_counter;
+
+typedef struct {
+  uint32_t counts[BSG_HEALTH_COUNTER_COUNT];
+} bsg_health_counters;
+
+/**
+ * The name each counter is reported with, in the order of bsg_health_counter
+ */
+extern const char *const bsg_health_counter_names[BSG_HEALTH_COUNTER_COUNT];
+
+/** Add one to a counter */
+void bsg_health_count(bsg_health_counter counter) __asyncsafe;
+
+/**
+ * Copy the counters into dest, optionally resetting them. Counters are read
+ * one at a time, so may be slightly inconsistent while they are counted.
+ */
+void bsg_health_read(bsg_health_counters *dest, bool reset) __asyncsafe;
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_HEALTH_COUNTERS_H
@@ -0,0 +1,123 @@
+#include "lock_stats.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "time_common.h"
+
+static bool bsg_lock_stats_enabled = false;
+static bsg_lock_site_stats bsg_lock_stats[BSG_LOCK_SITE_COUNT];
+
+/**
+ * When recording last started or was reset, and when it last stopped
+ */
+static uint64_t bsg_lock_stats_started_at = 0;
+static uint64_t bsg_lock_stats_stopped_at = 0;
+
+static int histogram_bucket(uint64_t duration_ns) {
+  uint64_t micros = duration_ns / 1000;
+  int bucket = 0;
+  while (micros > 0 && bucket < BSG_LOCK_STATS_BUCKETS - 1) {
+    micros >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static void record_duration(uint64_t *total, uint64_t *max,
+                            uint64_t *histogram, uint64_t duration_ns) {
+  __atomic_fetch_add(total, duration_ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&histogram[histogram_bucket(duration_ns)], 1,
+                     __ATOMIC_RELAXED);
+  uint64_t current = __atomic_load_n(max, __ATOMIC_RELAXED);
+  while (current < duration_ns &&
+         !__atomic_compare_exchange_n(max, &current, duration_ns, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+void bsg_instrumented_lock(bsg_instrumented_mutex *lock, bsg_lock_site site) {
+  if (!__atomic_load_n(&bsg_lock_stats_enabled, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&lock->mutex);
+    lock->acquired_at = 0;
+    return;
+  }
+
+  bsg_lock_site_stats *stats = &bsg_lock_stats[site];
+  const uint64_t requested_at = bsg_monotonic_time_ns();
+  if (pthread_mutex_trylock(&lock->mutex) == EBUSY) {
+    __atomic_fetch_add(&stats->contended_calls, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&lock->mutex);
+  }
+  const uint64_t acquired_at = bsg_monotonic_time_ns();
+  __atomic_fetch_add(&stats->calls, 1, __ATOMIC_RELAXED);
+  record_duration(&stats->total_wait_ns, &stats->max_wait_ns,
+                  stats->wait_histogram, acquired_at - requested_at);
+  lock->acquired_at = acquired_at;
+  lock->holder_site = site;
+}
+
+void bsg_instrumented_unlock(bsg_instrumented_mutex *lock) {
+  const uint64_t acquired_at = lock->acquired_at;
+  const bsg_lock_site site = lock->holder_site;
+  if (acquired_at != 0) {
+    bsg_lock_site_stats *stats = &bsg_lock_stats[site];
+    record_duration(&stats->total_hold_ns, &stats->max_hold_ns,
+                    stats->hold_histogram, bsg_monotonic_time_ns() - acquired_at);
+  }
+  pthread_mutex_unlock(&lock->mutex);
+}
+
+void bsg_lock_stats_set_enabled(bool enabled) {
+  if (enabled == __atomic_load_n(&bsg_lock_stats_enabled, __ATOMIC_RELAXED)) {
+    return;
+  }
+  if (enabled) {
+    __atomic_store_n(&bsg_lock_stats_started_at, bsg_monotonic_time_ns(),
+                     __ATOMIC_RELAXED);
+  } else {
+    __atomic_store_n(&bsg_lock_stats_stopped_at, bsg_monotonic_time_ns(),
+                     __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&bsg_lock_stats_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+static uint64_t read_value(uint64_t *value, bool reset) {
+  return reset ? __atomic_exchange_n(value, 0, __ATOMIC_RELAXED)
+               : __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+uint64_t bsg_lock_stats_read(bsg_lock_site_stats *stats, bool reset) {
+  for (int site = 0; site < BSG_LOCK_SITE_COUNT; site++) {
+    bsg_lock_site_stats *source = &bsg_lock_stats[site];
+    bsg_lock_site_stats *dest = &stats[site];
+    dest->calls = read_value(&source->calls, reset);
+    dest->contended_calls = read_value(&source->contended_calls, reset);
+    dest->total_wait_ns = read_value(&source->total_wait_ns, reset);
+    dest->max_wait_ns = read_value(&source->max_wait_ns, reset);
+    dest->total_hold_ns = read_value(&source->total_hold_ns, reset);
+    dest->max_hold_ns = read_value(&source->max_hold_ns, reset);
+    for (int bucket = 0; bucket < BSG_LOCK_STATS_BUCKETS; bucket++) {
+      dest->wait_histogram[bucket] =
+          read_value(&source->wait_histogram[bucket], reset);
+      dest->hold_histogram[bucket] =
+          read_value(&source->hold_histogram[bucket], reset);
+    }
+  }
+
+  const uint64_t now = bsg_monotonic_time_ns();
+  const uint64_t started_at =
+      __atomic_load_n(&bsg_lock_stats_started_at, __ATOMIC_RELAXED);
+  if (started_at == 0) {
+    // never enabled
+    return 0;
+  }
+  const uint64_t ended_at =
+      __atomic_load_n(&bsg_lock_stats_enabled, __ATOMIC_RELAXED)
+          ? now
+          : __atomic_load_n(&bsg_lock_stats_stopped_at, __ATOMIC_RELAXED);
+  if (reset) {
+    __atomic_store_n(&bsg_lock_stats_started_at, now, __ATOMIC_RELAXED);
+  }
+  return ended_at > started_at ? ended_at - started_at : 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * Optional contention and latency statistics for the locks taken by the
+ * NativeBridge setters
+ */
+#ifndef BUGSNAG_LOCK_STATS_H
+#define BUGSNAG_LOCK_STATS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The callers which take a lock, reported separately
+ */
+typedef enum {
+  /** Adding, clearing and removing metadata */
+  BSG_LOCK_SITE_METADATA,
+  /** Adding and clearing feature flags */
+  BSG_LOCK_SITE_FEATURE_FLAGS,
+  /** Updating the app, device, user and context in the event state */
+  BSG_LOCK_SITE_APP_STATE,
+  /** Starting and pausing sessions */
+  BSG_LOCK_SITE_SESSION,
+  BSG_LOCK_SITE_COUNT
+} bsg_lock_site;
+
+/**
+ * The number of buckets in each histogram. The first counts durations under
+ * 1us, and each bucket after spans twice the range of the one before, so that
+ * the last counts durations of 8.192ms or more.
+ */
+#define BSG_LOCK_STATS_BUCKETS 15
+
+typedef struct {
+  /** The number of times the lock was taken */
+  uint64_t calls;
+  /** The number of times it was already held by another caller */
+  uint64_t contended_calls;
+  uint64_t total_wait_ns;
+  uint64_t max_wait_ns;
+  uint64_t total_hold_ns;
+  uint64_t max_hold_ns;
+  uint64_t wait_histogram[BSG_LOCK_STATS_BUCKETS];
+  uint64_t hold_histogram[BSG_LOCK_STATS_BUCKETS];
+} bsg_lock_site_stats;
+
+/**
+ * A mutex which records how long callers wait for it and hold it while
+ * statistics are enabled
+ */
+typedef struct {
+  pthread_mutex_t mutex;
+  /** Set by the holder: when it acquired the mutex, or 0 if not recorded */
+  uint64_t acquired_at;
+  bsg_lock_site holder_site;
+} bsg_instrumented_mutex;
+
+#define BSG_INSTRUMENTED_MUTEX_INITIALIZER                                     \
+  { .mutex = PTHREAD_MUTEX_INITIALIZER }
+
+void bsg_instrumented_lock(bsg_instrumented_mutex *lock, bsg_lock_site site);
+void bsg_instrumented_unlock(bsg_instrumented_mutex *lock);
+
+/**
+ * Start or stop recording statistics. Statistics are not recorded by default,
+ * when taking a lock costs one extra atomic load.
+ */
+void bsg_lock_stats_set_enabled(bool enabled);
+
+/**
+ * Copy the statistics for each site into stats, which holds
+ * BSG_LOCK_SITE_COUNT, optionally resetting them. Returns the time in
+ * nanoseconds over which they were recorded, so that call rates can be found.
+ * Values are read one at a time, so may be slightly inconsistent while locks
+ * are being taken.
+ */
+uint64_t bsg_lock_stats_read(bsg_lock_site_stats *stats, bool reset);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_LOCK_STATS_H
@@ -0,0 +1,412 @@
+#include "module_index.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "string.h"
+#include "symbol_cache.h"
+
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID 3
+#endif
+
+typedef struct {
+  bsg_loaded_objects objects;
+  size_t count;
+  bsg_module modules[];
+} bsg_module_list;
+
+/**
+ * The current index, sorted by start address. Replaced lists are never freed,
+ * as a crash handler may be reading them.
+ */
+static bsg_module_list *bsg_modules = NULL;
+
+static int add_loaded_object(struct dl_phdr_info *info, size_t size,
+                             void *data) {
+  bsg_loaded_objects *objects = data;
+  objects->count++;
+  objects->address_sum += info->dlpi_addr;
+  return 0;
+}
+
+bsg_loaded_objects bsg_get_loaded_objects(void) {
+  bsg_loaded_objects objects = {0, 0};
+  dl_iterate_phdr(add_loaded_object, &objects);
+  return objects;
+}
+
+bool bsg_loaded_objects_equal(bsg_loaded_objects a, bsg_loaded_objects b) {
+  return a.count == b.count && a.address_sum == b.address_sum;
+}
+
+/**
+ * Dynamic section addresses are relocated by some loaders but not others, such
+ * as the Android linker
+ */
+static uintptr_t dynamic_address(ElfW(Addr) address, uintptr_t load_bias) {
+  return address < load_bias ? load_bias + address : address;
+}
+
+/**
+ * The number of symbols in a GNU hash table is not stored, so is found from
+ * the end of the chain of the last bucket
+ */
+static size_t gnu_hash_symbol_count(const uint32_t *table) {
+  const uint32_t bucket_count = table[0];
+  const uint32_t symbol_offset = table[1];
+  const uint32_t bloom_size = table[2];
+  const uint32_t *buckets =
+      (const uint32_t *)((const ElfW(Addr) *)(table + 4) + bloom_size);
+  const uint32_t *chains = buckets + bucket_count;
+
+  uint32_t last = 0;
+  for (uint32_t bucket = 0; bucket < bucket_count; bucket++) {
+    if (buckets[bucket] > last) {
+      last = buckets[bucket];
+    }
+  }
+  if (last < symbol_offset) {
+    return symbol_offset;
+  }
+  while ((chains[last - symbol_offset] & 1) == 0) {
+    last++;
+  }
+  return last + 1;
+}
+
+static void read_dynamic_symbols(bsg_module *module, const ElfW(Dyn) * dyn) {
+  const uint32_t *hash = NULL;
+  const uint32_t *gnu_hash = NULL;
+  for (; dyn->d_tag != DT_NULL; dyn++) {
+    switch (dyn->d_tag) {
+    case DT_SYMTAB:
+      module->symbols = (const ElfW(Sym) *)dynamic_address(dyn->d_un.d_ptr,
+                                                            module->load_bias);
+      break;
+    case DT_STRTAB:
+      module->strings =
+          (const char *)dynamic_address(dyn->d_un.d_ptr, module->load_bias);
+      break;
+    case DT_STRSZ:
+      module->strings_size = dyn->d_un.d_val;
+      break;
+    case DT_HASH:
+      hash = (const uint32_t *)dynamic_address(dyn->d_un.d_ptr,
+                                               module->load_bias);
+      break;
+    case DT_GNU_HASH:
+      gnu_hash = (const uint32_t *)dynamic_address(dyn->d_un.d_ptr,
+                                                   module->load_bias);
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (module->symbols == NULL || module->strings == NULL) {
+    module->symbols = NULL;
+  } else if (hash != NULL) {
+    // the number of chains is the number of symbols
+    module->symbol_count = hash[1];
+  } else if (gnu_hash != NULL) {
+    module->symbol_count = gnu_hash_symbol_count(gnu_hash);
+  }
+}
+
+static size_t note_align(size_t size) { return (size + 3) & ~(size_t)3; }
+
+static void read_build_id(bsg_module *module, const uint8_t *notes,
+                          size_t size) {
+  size_t pos = 0;
+  while (pos + sizeof(ElfW(Nhdr)) <= size) {
+    const ElfW(Nhdr) *note = (const ElfW(Nhdr) *)(notes + pos);
+    const size_t name_pos = pos + sizeof(ElfW(Nhdr));
+    const size_t desc_pos = name_pos + note_align(note->n_namesz);
+    const size_t next_pos = desc_pos + note_align(note->n_descsz);
+    if (next_pos > size) {
+      return;
+    }
+    if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+        memcmp(notes + name_pos, "GNU", 4) == 0) {
+      module->build_id_length = note->n_descsz < BSG_BUILD_ID_MAX
+                                    ? note->n_descsz
+                                    : BSG_BUILD_ID_MAX;
+      memcpy(module->build_id, notes + desc_pos, module->build_id_length);
+      return;
+    }
+    pos = next_pos;
+  }
+}
+
+typedef struct {
+  bsg_loaded_objects objects;
+  bsg_module *modules;
+  size_t count;
+  size_t capacity;
+} bsg_module_builder;
+
+static int add_module(struct dl_phdr_info *info, size_t size, void *data) {
+  bsg_module_builder *builder = data;
+  add_loaded_object(info, size, &builder->objects);
+
+  bsg_module module = {.load_bias = info->dlpi_addr};
+  const ElfW(Dyn) *dynamic = NULL;
+  bool loaded = false;
+
+  for (ElfW(Half) index = 0; index < info->dlpi_phnum; index++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[index];
+    if (phdr->p_type == PT_LOAD) {
+      const uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+      const uintptr_t end = start + phdr->p_memsz;
+      if (!loaded || start < module.start) {
+        module.start = start;
+      }
+      if (!loaded || end > module.end) {
+        module.end = end;
+      }
+      loaded = true;
+    } else if (phdr->p_type == PT_DYNAMIC) {
+      dynamic = (const ElfW(Dyn) *)(info->dlpi_addr + phdr->p_vaddr);
+    } else if (phdr->p_type == PT_NOTE && module.build_id_length == 0) {
+      read_build_id(&module,
+                    (const uint8_t *)(info->dlpi_addr + phdr->p_vaddr),
+                    phdr->p_memsz);
+    }
+  }
+  if (!loaded) {
+    return 0;
+  }
+  if (dynamic != NULL) {
+    read_dynamic_symbols(&module, dynamic);
+  }
+
+  if (builder->count == builder->capacity) {
+    const size_t capacity = builder->capacity ? builder->capacity * 2 : 64;
+    bsg_module *modules =
+        realloc(builder->modules, capacity * sizeof(bsg_module));
+    if (modules == NULL) {
+      return 1;
+    }
+    builder->modules = modules;
+    builder->capacity = capacity;
+  }
+  module.path = strdup(info->dlpi_name ? info->dlpi_name : "");
+  builder->modules[builder->count++] = module;
+  return 0;
+}
+
+static int compare_modules(const void *a, const void *b) {
+  const bsg_module *module_a = a;
+  const bsg_module *module_b = b;
+  if (module_a->start == module_b->start) {
+    return 0;
+  }
+  return module_a->start < module_b->start ? -1 : 1;
+}
+
+void bsg_module_index_refresh(void) {
+  static pthread_mutex_t bsg_module_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_lock(&bsg_module_index_mutex);
+
+  bsg_module_builder builder = {{0, 0}, NULL, 0, 0};
+  bsg_module_list *list = NULL;
+  if (bsg_modules != NULL &&
+      bsg_loaded_objects_equal(bsg_modules->objects,
+                               bsg_get_loaded_objects())) {
+    goto exit;
+  }
+
+  // on failure the index is left as it was, so is not used unless current
+  if (dl_iterate_phdr(add_module, &builder) != 0 || builder.count == 0) {
+    goto exit;
+  }
+  qsort(builder.modules, builder.count, sizeof(bsg_module), compare_modules);
+
+  list = malloc(sizeof(bsg_module_list) + builder.count * sizeof(bsg_module));
+  if (list == NULL) {
+    goto exit;
+  }
+  list->objects = builder.objects;
+  list->count = builder.count;
+  memcpy(list->modules, builder.modules, builder.count * sizeof(bsg_module));
+  __atomic_store_n(&bsg_modules, list, __ATOMIC_RELEASE);
+
+exit:
+  if (list == NULL) {
+    for (size_t index = 0; index < builder.count; index++) {
+      free(builder.modules[index].path);
+    }
+  }
+  free(builder.modules);
+  pthread_mutex_unlock(&bsg_module_index_mutex);
+}
+
+bool bsg_module_index_current(void) {
+  const bsg_module_list *list = __atomic_load_n(&bsg_modules, __ATOMIC_ACQUIRE);
+  return list != NULL &&
+         bsg_loaded_objects_equal(list->objects, bsg_get_loaded_objects());
+}
+
+const bsg_module *bsg_module_index_find(uintptr_t address) {
+  const bsg_module_list *list = __atomic_load_n(&bsg_modules, __ATOMIC_ACQUIRE);
+  if (list == NULL) {
+    return NULL;
+  }
+
+  // find the last module starting at or before the address
+  size_t low = 0;
+  size_t high = list->count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (list->modules[mid].start <= address) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low == 0) {
+    return NULL;
+  }
+  const bsg_module *module = &list->modules[low - 1];
+  return address < module->end ? module : NULL;
+}
+
+bool bsg_module_find_symbol(const bsg_module *module, uintptr_t address,
+                            const char **out_name,
+                            uintptr_t *out_symbol_address) {
+  if (module->symbols == NULL) {
+    return false;
+  }
+  const uintptr_t offset = address - module->load_bias;
+  for (size_t index = 0; index < module->symbol_count; index++) {
+    const ElfW(Sym) *symbol = &module->symbols[index];
+    if (symbol->st_shndx != SHN_UNDEF && offset >= symbol->st_value &&
+        offset < symbol->st_value + symbol->st_size &&
+        symbol->st_name < module->strings_size) {
+      *out_name = module->strings + symbol->st_name;
+      *out_symbol_address = module->load_bias + symbol->st_value;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool bsg_record_frame_modules(bsg_frame_module_table *table,
+                              const uintptr_t *frames, ssize_t frame_count) {
+  if (!bsg_module_index_current()) {
+    return false;
+  }
+
+  table->count = 0;
+  for (ssize_t i = 0; i < frame_count; i++) {
+    table->frame_modules[i] = BSG_NO_FRAME_MODULE;
+    const bsg_module *module = bsg_module_index_find(frames[i]);
+    if (module == NULL) {
+      continue;
+    }
+
+    // stacks rarely span more than a few modules, so a linear search is fine
+    int index = 0;
+    while (index < table->count &&
+           table->modules[index].start != module->start) {
+      index++;
+    }
+    if (index == table->count) {
+      if (index == BUGSNAG_FRAME_MODULES_MAX) {
+        continue;
+      }
+      bsg_frame_module *recorded = &table->modules[index];
+      recorded->start = module->start;
+      recorded->build_id_length = module->build_id_length;
+      memcpy(recorded->build_id, module->build_id, module->build_id_length);
+      bsg_strncpy(recorded->path, module->path ? module->path : "",
+                  sizeof(recorded->path));
+      table->count++;
+    }
+    table->frame_modules[i] = (uint8_t)index;
+  }
+  return true;
+}
+
+/**
+ * Find the module in this process which is the same build of a module
+ * recorded by another. Modules without build IDs are matched by path alone.
+ */
+static const bsg_module *find_loaded_module(const bsg_frame_module *recorded) {
+  const bsg_module_list *list = __atomic_load_n(&bsg_modules, __ATOMIC_ACQUIRE);
+  if (list == NULL) {
+    return NULL;
+  }
+  for (size_t index = 0; index < list->count; index++) {
+    const bsg_module *module = &list->modules[index];
+    if (module->path != NULL && strcmp(module->path, recorded->path) == 0) {
+      const bool same_build =
+          module->build_id_length == recorded->build_id_length &&
+          memcmp(module->build_id, recorded->build_id,
+                 recorded->build_id_length) == 0;
+      return same_build ? module : NULL;
+    }
+  }
+  return NULL;
+}
+
+void bsg_resolve_frame_modules(const bsg_frame_module_table *table,
+                               bugsnag_stackframe *stacktrace,
+                               ssize_t frame_count) {
+  const int count = table->count < BUGSNAG_FRAME_MODULES_MAX
+                        ? table->count
+                        : BUGSNAG_FRAME_MODULES_MAX;
+  if (count <= 0) {
+    return;
+  }
+
+  bsg_module_index_refresh();
+  const bsg_module *loaded[BUGSNAG_FRAME_MODULES_MAX];
+  for (int index = 0; index < count; index++) {
+    loaded[index] = find_loaded_module(&table->modules[index]);
+  }
+
+  for (ssize_t i = 0; i < frame_count; i++) {
+    const int index = table->frame_modules[i];
+    if (index >= count) {
+      continue;
+    }
+    bugsnag_stackframe *frame = &stacktrace[i];
+    const bsg_frame_module *recorded = &table->modules[index];
+    frame->load_address = recorded->start;
+    frame->line_number = frame->frame_address - recorded->start;
+    bsg_strncpy(frame->filename, recorded->path, sizeof(frame->filename));
+
+    uint64_t symbol_offset;
+    if (bsg_symbol_cache_lookup(recorded->build_id, recorded->build_id_length,
+                                frame->line_number, frame->method,
+                                sizeof(frame->method), &symbol_offset)) {
+      if (bsg_strlen(frame->method) > 0) {
+        frame->symbol_address = recorded->start + symbol_offset;
+      }
+      continue;
+    }
+
+    // look the symbol up at the same offset in this process's copy
+    const bsg_module *module = loaded[index];
+    if (module == NULL) {
+      continue;
+    }
+    const char *symbol_name;
+    uintptr_t symbol_address;
+    if (bsg_module_find_symbol(module, module->start + frame->line_number,
+                               &symbol_name, &symbol_address)) {
+      symbol_offset = symbol_address - module->start;
+      frame->symbol_address = recorded->start + symbol_offset;
+      bsg_strncpy(frame->method, symbol_name, sizeof(frame->method));
+    } else {
+      symbol_name = "";
+      symbol_offset = 0;
+    }
+    bsg_symbol_cache_add(recorded->build_id, recorded->build_id_length,
+                         frame->line_number, symbol_name, symbol_offset);
+  }
+  bsg_symbol_cache_save();
+}
@@ -0,0 +1,105 @@
+#ifndef BUGSNAG_MODULE_INDEX_H
+#define BUGSNAG_MODULE_INDEX_H
+
+#include <link.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../event.h"
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A summary of the loaded shared objects, which changes when libraries are
+ * loaded or unloaded
+ */
+typedef struct {
+  size_t count;
+  uintptr_t address_sum;
+} bsg_loaded_objects;
+
+/**
+ * Summarise the currently loaded shared objects. This walks the list of loaded
+ * objects under the linker lock, which is much cheaper than parsing
+ * /proc/self/maps or calling dladdr() for each of a number of addresses.
+ */
+bsg_loaded_objects bsg_get_loaded_objects(void);
+
+bool bsg_loaded_objects_equal(bsg_loaded_objects a, bsg_loaded_objects b);
+
+/**
+ * The address range and dynamic symbol table of a loaded shared object
+ */
+typedef struct {
+  /** The lowest address of its loaded segments */
+  uintptr_t start;
+  /** The end of its highest loaded segment */
+  uintptr_t end;
+  /** The difference between its addresses in memory and in the ELF file */
+  uintptr_t load_bias;
+  char *path;
+  const ElfW(Sym) * symbols;
+  size_t symbol_count;
+  const char *strings;
+  size_t strings_size;
+  /** The contents of its GNU build ID note, if it has one */
+  uint8_t build_id[BSG_BUILD_ID_MAX];
+  size_t build_id_length;
+} bsg_module;
+
+/**
+ * Index the loaded shared objects, if they have changed since they were last
+ * indexed. Must not be called from a signal handler.
+ */
+void bsg_module_index_refresh(void);
+
+/**
+ * Whether the index matches the objects which are loaded now. Objects loaded
+ * or unloaded since it was refreshed may leave ranges and symbol tables in the
+ * index which are no longer mapped, so it must only be used if this is true.
+ */
+bool bsg_module_index_current(void);
+
+/**
+ * Find the loaded object which contains an address, by a binary search over
+ * the indexed ranges. Returns NULL if the address is not in any object.
+ */
+const bsg_module *bsg_module_index_find(uintptr_t address) __asyncsafe;
+
+/**
+ * Find the dynamic symbol of a module containing an address, as dladdr()
+ * would. Returns false if there is none.
+ */
+bool bsg_module_find_symbol(const bsg_module *module, uintptr_t address,
+                            const char **out_name,
+                            uintptr_t *out_symbol_address) __asyncsafe;
+
+/**
+ * Record the indexed module containing each frame without symbolicating it,
+ * for bsg_resolve_frame_modules() to complete later. Returns false if the
+ * index is not current, in which case nothing is recorded. Frames outside any
+ * module, or in modules beyond BUGSNAG_FRAME_MODULES_MAX, are marked
+ * BSG_NO_FRAME_MODULE and must be symbolicated by the caller.
+ */
+bool bsg_record_frame_modules(bsg_frame_module_table *table,
+                              const uintptr_t *frames,
+                              ssize_t frame_count) __asyncsafe;
+
+/**
+ * Fill in the file, load address and relative address of the frames recorded
+ * by bsg_record_frame_modules(), and their symbols if they are in the symbol
+ * cache or the same build of their module is loaded in this process. Must not
+ * be called from a signal handler.
+ */
+void bsg_resolve_frame_modules(const bsg_frame_module_table *table,
+                               bugsnag_stackframe *stacktrace,
+                               ssize_t frame_count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_MODULE_INDEX_H
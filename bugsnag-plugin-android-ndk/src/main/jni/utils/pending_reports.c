@@ -0,0 +1,288 @@
+#include "pending_reports.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "../event.h"
+#include "../featureflags.h"
+#include "crash_signatures.h"
+#include "health_counters.h"
+#include "logger.h"
+#include "module_index.h"
+#include "serializer.h"
+#include "serializer/json_writer.h"
+#include "string.h"
+#include "trace_common.h"
+
+typedef struct {
+  bsg_pending_report report;
+  bool done;
+} bsg_pending_job;
+
+typedef struct {
+  const char *const *paths;
+  size_t count;
+  bsg_pending_job *jobs;
+
+  pthread_mutex_t lock;
+  pthread_cond_t job_done;
+  /**
+   * The index of the next job which nobody has claimed yet
+   */
+  size_t next_job;
+} bsg_pending_queue;
+
+/**
+ * Replace the payload with its gzip-compressed equivalent. The uncompressed
+ * payload is kept if compression fails or does not reduce its size.
+ */
+static void compress_payload(bsg_pending_report *report) {
+  z_stream stream = {0};
+  // a window of 15 bits plus 16 requests a gzip header and trailer
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return;
+  }
+
+  uLong capacity = deflateBound(&stream, (uLong)report->payload_length);
+  Bytef *compressed = malloc(capacity);
+  if (compressed == NULL) {
+    goto exit;
+  }
+  stream.next_in = (Bytef *)report->payload;
+  stream.avail_in = (uInt)report->payload_length;
+  stream.next_out = compressed;
+  stream.avail_out = (uInt)capacity;
+
+  if (deflate(&stream, Z_FINISH) != Z_STREAM_END ||
+      stream.total_out >= report->payload_length) {
+    free(compressed);
+    goto exit;
+  }
+
+  free(report->payload);
+  report->payload = (char *)compressed;
+  report->payload_length = stream.total_out;
+  report->is_gzip = true;
+
+exit:
+  deflateEnd(&stream);
+}
+
+static const char *const bsg_handler_phase_names[BSG_HANDLER_PHASE_COUNT] = {
+    [BSG_HANDLER_PHASE_POPULATE] = "populateNs",
+    [BSG_HANDLER_PHASE_UNWIND] = "unwindNs",
+    [BSG_HANDLER_PHASE_THREADS] = "threadsNs",
+    [BSG_HANDLER_PHASE_ON_ERROR] = "onErrorNs",
+    [BSG_HANDLER_PHASE_WRITE] = "writeNs",
+};
+
+/**
+ * Add how long the crash handler took to write the event, and each phase of
+ * it, to the 'crashHandler' metadata section
+ */
+static void add_handler_timing(bugsnag_event *event) {
+  const bsg_handler_timing *timing = &event->handler_timing;
+  if (timing->started_ns == 0 || timing->serialized_ns < timing->started_ns) {
+    return;
+  }
+  bugsnag_event_add_metadata_double(
+      event, "crashHandler", "latencyNs",
+      (double)(timing->serialized_ns - timing->started_ns));
+  for (int phase = 0; phase < BSG_HANDLER_PHASE_COUNT; phase++) {
+    bugsnag_event_add_metadata_double(event, "crashHandler",
+                                      bsg_handler_phase_names[phase],
+                                      (double)timing->phase_ns[phase]);
+  }
+}
+
+static const struct {
+  bsg_handler_fallback flag;
+  const char *name;
+} bsg_handler_fallback_names[] = {
+    {BSG_HANDLER_FALLBACK_PC_ONLY, "unwindFallback"},
+    {BSG_HANDLER_FALLBACK_THREADS_SKIPPED, "threadsSkipped"},
+    {BSG_HANDLER_FALLBACK_ON_ERROR_SKIPPED, "onErrorSkipped"},
+    {BSG_HANDLER_FALLBACK_STATE_PENDING, "statePending"},
+    {BSG_HANDLER_FALLBACK_REPORT_TRUNCATED, "reportTruncated"},
+};
+
+/**
+ * Add each fallback the crash handler took, or state it was missing, to the
+ * 'crashHandler' metadata section
+ */
+static void add_handler_fallbacks(bugsnag_event *event) {
+  const size_t count = sizeof(bsg_handler_fallback_names) /
+                       sizeof(bsg_handler_fallback_names[0]);
+  for (size_t i = 0; i < count; i++) {
+    if (event->handler_fallbacks & bsg_handler_fallback_names[i].flag) {
+      bugsnag_event_add_metadata_bool(
+          event, "crashHandler", bsg_handler_fallback_names[i].name, true);
+    }
+  }
+}
+
+/**
+ * Add the health counters of the process which crashed to the 'ndkHealth'
+ * metadata section
+ */
+static void add_health_counters(bugsnag_event *event) {
+  for (int i = 0; i < BSG_HEALTH_COUNTER_COUNT; i++) {
+    bugsnag_event_add_metadata_double(
+        event, "ndkHealth", bsg_health_counter_names[i],
+        (double)event->health_counters.counts[i]);
+  }
+}
+
+static void prepare_report(const char *path, bsg_pending_report *report,
+                           bsg_json_fragment_cache *cache) {
+  bsg_trace_begin("bugsnag:deserialize");
+  bugsnag_event *event = bsg_deserialize_event_from_file((char *)path);
+  bsg_trace_end();
+
+  // remove persisted NDK struct early - this reduces the chance of crash loops
+  // in delivery.
+  remove(path);
+
+  if (event == NULL) {
+    BUGSNAG_LOG("Failed to read event at file: %s", path);
+    return;
+  }
+
+  // frames left unsymbolicated by the crash handler are completed here, where
+  // there is time to
+  bsg_resolve_frame_modules(&event->frame_modules, event->error.stacktrace,
+                            event->error.frame_count);
+  add_handler_timing(event);
+  if (event->threads_truncated) {
+    bugsnag_event_add_metadata_bool(event, "crashHandler", "threadsTruncated",
+                                    true);
+  }
+  add_handler_fallbacks(event);
+  add_health_counters(event);
+  const uint32_t repeats = bsg_crash_signatures_take_repeats(path);
+  if (repeats > 0) {
+    bugsnag_event_add_metadata_double(event, "crashHandler", "repeatCount",
+                                      (double)repeats);
+  }
+
+  bsg_trace_begin("bugsnag:serialize");
+  report->payload = bsg_event_to_json_stream_cached(event, cache);
+  if (report->payload == NULL) {
+    BUGSNAG_LOG("Failed to serialize event as JSON: %s", path);
+  } else {
+    report->payload_length = bsg_strlen(report->payload);
+#if BSG_PENDING_REPORT_COMPRESSION
+    compress_payload(report);
+#endif
+  }
+  bsg_trace_end();
+  bsg_strncpy(report->release_stage, event->app.release_stage,
+              sizeof(report->release_stage));
+  bsg_strncpy(report->api_key, event->api_key, sizeof(report->api_key));
+  report->is_launching = event->app.is_launching;
+
+  bsg_free_feature_flags(event);
+  bsg_metadata_arena_free(&event->metadata_arena);
+  bsg_event_free_threads(event);
+  free(event);
+}
+
+/**
+ * Claim and prepare the next unclaimed job, returning false if there are none
+ * left. Must be called with the queue unlocked.
+ */
+static bool run_next_job(bsg_pending_queue *queue,
+                         bsg_json_fragment_cache *cache) {
+  pthread_mutex_lock(&queue->lock);
+  size_t index = queue->next_job;
+  if (index < queue->count) {
+    queue->next_job++;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  if (index >= queue->count) {
+    return false;
+  }
+
+  prepare_report(queue->paths[index], &queue->jobs[index].report, cache);
+
+  pthread_mutex_lock(&queue->lock);
+  queue->jobs[index].done = true;
+  pthread_cond_broadcast(&queue->job_done);
+  pthread_mutex_unlock(&queue->lock);
+  return true;
+}
+
+static void *pending_report_worker(void *arg) {
+  bsg_pending_queue *queue = arg;
+  // reports from the same installation share most of their app and device
+  // fields, so each thread keeps the fragments it last encoded
+  bsg_json_fragment_cache *cache = bsg_json_fragment_cache_new();
+  while (run_next_job(queue, cache)) {
+  }
+  bsg_json_fragment_cache_free(cache);
+  return NULL;
+}
+
+void bsg_prepare_pending_reports(const char *const *paths, size_t count,
+                                 bsg_pending_report_callback callback,
+                                 void *context) {
+  if (count == 0) {
+    return;
+  }
+
+  bsg_pending_queue queue = {.paths = paths, .count = count, .next_job = 0};
+  queue.jobs = calloc(count, sizeof(bsg_pending_job));
+  if (queue.jobs == NULL) {
+    return;
+  }
+  pthread_mutex_init(&queue.lock, NULL);
+  pthread_cond_init(&queue.job_done, NULL);
+
+  // the calling thread takes a share of the work, so a single report never
+  // needs a worker
+  bsg_json_fragment_cache *cache = bsg_json_fragment_cache_new();
+  pthread_t workers[BSG_PENDING_REPORT_WORKERS_MAX];
+  size_t worker_count = 0;
+  while (worker_count < BSG_PENDING_REPORT_WORKERS_MAX &&
+         worker_count < count - 1) {
+    if (pthread_create(&workers[worker_count], NULL, pending_report_worker,
+                       &queue) != 0) {
+      // any remaining work is picked up by the calling thread
+      break;
+    }
+    worker_count++;
+  }
+
+  for (size_t index = 0; index < count; index++) {
+    bsg_pending_job *job = &queue.jobs[index];
+
+    pthread_mutex_lock(&queue.lock);
+    while (!job->done) {
+      if (queue.next_job < queue.count) {
+        // rather than idling, prepare an unclaimed report
+        pthread_mutex_unlock(&queue.lock);
+        run_next_job(&queue, cache);
+        pthread_mutex_lock(&queue.lock);
+      } else {
+        pthread_cond_wait(&queue.job_done, &queue.lock);
+      }
+    }
+    pthread_mutex_unlock(&queue.lock);
+
+    callback(paths[index], &job->report, context);
+    free(job->report.payload);
+    job->report.payload = NULL;
+  }
+
+  for (size_t index = 0; index < worker_count; index++) {
+    pthread_join(workers[index], NULL);
+  }
+  bsg_json_fragment_cache_free(cache);
+  pthread_cond_destroy(&queue.job_done);
+  pthread_mutex_destroy(&queue.lock);
+  free(queue.jobs);
+}
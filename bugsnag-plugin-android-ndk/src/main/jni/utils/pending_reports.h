@@ -0,0 +1,73 @@
+/**
+ * Reading and encoding of stored reports ahead of delivery
+ */
+#ifndef BUGSNAG_PENDING_REPORTS_H
+#define BUGSNAG_PENDING_REPORTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The maximum number of worker threads used to prepare pending reports, in
+ * addition to the calling thread
+ */
+#ifndef BSG_PENDING_REPORT_WORKERS_MAX
+#define BSG_PENDING_REPORT_WORKERS_MAX 3
+#endif
+
+/**
+ * Whether payloads are gzip-compressed after they are encoded as JSON. Stored
+ * payloads are recognised by their gzip header, so this may be changed freely
+ * between releases.
+ */
+#ifndef BSG_PENDING_REPORT_COMPRESSION
+#define BSG_PENDING_REPORT_COMPRESSION 1
+#endif
+
+/**
+ * A stored report which has been read and encoded as JSON
+ */
+typedef struct {
+  /**
+   * The JSON payload, or NULL if the report could not be read. This is not
+   * terminated and may be gzip-compressed, see payload_length and is_gzip.
+   */
+  char *payload;
+  size_t payload_length;
+  bool is_gzip;
+  char release_stage[64];
+  char api_key[64];
+  bool is_launching;
+} bsg_pending_report;
+
+/**
+ * Called once a report is ready for delivery. The report and its payload are
+ * released once the callback returns.
+ */
+typedef void (*bsg_pending_report_callback)(const char *path,
+                                            bsg_pending_report *report,
+                                            void *context);
+
+/**
+ * Read and encode the reports at the given paths, removing each file once it
+ * has been read. The work is spread over the calling thread and up to
+ * BSG_PENDING_REPORT_WORKERS_MAX worker threads, while the callback is always
+ * invoked on the calling thread, once per path and in the order given.
+ *
+ * @param paths    the report files to prepare
+ * @param count    the number of paths
+ * @param callback invoked for each report as it becomes ready
+ * @param context  passed through to the callback
+ */
+void bsg_prepare_pending_reports(const char *const *paths, size_t count,
+                                 bsg_pending_report_callback callback,
+                                 void *context);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,228 @@
+#include "report_index.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crash_signatures.h"
+#include "logger.h"
+#include "string.h"
+
+/*
+ * The index is a file mapped shared like the crash signature table, so that
+ * crash handlers record reports with plain memory writes. A record is claimed
+ * by clearing its signature, filled in and then published by storing the
+ * signature, and a signature of 0 marks an unused record. Records are keyed on
+ * the file name of the report, as every report is in the same directory.
+ */
+
+#define BSG_REPORT_INDEX_MAGIC 0x62737269
+#define BSG_REPORT_INDEX_VERSION 1
+
+typedef struct {
+  uint64_t signature;
+  /** When the report was written, in seconds since the epoch */
+  int64_t timestamp;
+  uint32_t size;
+  bool is_launching;
+  char name[64];
+} bsg_report_index_record;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t next_record;
+  bsg_report_index_record records[BSG_REPORT_INDEX_MAX];
+} bsg_report_index;
+
+static bsg_report_index *active_index = NULL;
+
+/**
+ * The path of the index for a report, beside its directory, so that it is not
+ * mistaken for a pending report
+ */
+static bool index_path(const char *report_path, char *path, size_t size) {
+  bsg_strncpy(path, report_path, size);
+  char *separator = strrchr(path, '/');
+  if (separator == NULL ||
+      (size_t)(separator - path) + sizeof("-reports.index") > size) {
+    return false;
+  }
+  strcpy(separator, "-reports.index");
+  return true;
+}
+
+static const char *report_name(const char *report_path) {
+  const char *separator = strrchr(report_path, '/');
+  return separator != NULL ? separator + 1 : report_path;
+}
+
+/**
+ * Map the index at path, resetting it if it was written by another version,
+ * or return NULL if it cannot be opened
+ */
+static bsg_report_index *map_index(const char *path, bool create) {
+  const int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0);
+  int fd = open(path, flags, 0600);
+  if (fd < 0) {
+    return NULL;
+  }
+  bsg_report_index *index = NULL;
+  if (ftruncate(fd, sizeof(bsg_report_index)) != 0) {
+    goto exit;
+  }
+  void *mapping = mmap(NULL, sizeof(bsg_report_index), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    goto exit;
+  }
+  index = mapping;
+  // also faults in the pages, so that crash handlers do not wait on them
+  if (index->magic != BSG_REPORT_INDEX_MAGIC ||
+      index->version != BSG_REPORT_INDEX_VERSION) {
+    memset(index, 0, sizeof(bsg_report_index));
+    index->magic = BSG_REPORT_INDEX_MAGIC;
+    index->version = BSG_REPORT_INDEX_VERSION;
+  }
+
+exit:
+  // the mapping holds its own reference to the file
+  close(fd);
+  return index;
+}
+
+bool bsg_report_index_enable(const char *report_path) {
+  if (active_index != NULL) {
+    return true;
+  }
+  char path[512];
+  if (!index_path(report_path, path, sizeof(path))) {
+    return false;
+  }
+  bsg_report_index *index = map_index(path, true);
+  if (index == NULL) {
+    BUGSNAG_LOG("Failed to map the report index at %s", path);
+    return false;
+  }
+  __atomic_store_n(&active_index, index, __ATOMIC_RELEASE);
+  return true;
+}
+
+void bsg_report_index_add(const char *report_path,
+                          const bugsnag_event *event) {
+  bsg_report_index *index = __atomic_load_n(&active_index, __ATOMIC_ACQUIRE);
+  if (index == NULL) {
+    return;
+  }
+  struct stat st;
+  const uint32_t size = stat(report_path, &st) == 0 ? (uint32_t)st.st_size : 0;
+  const uint64_t signature = bsg_crash_signature(event, 0);
+
+  const uint32_t slot =
+      __atomic_fetch_add(&index->next_record, 1, __ATOMIC_RELAXED) %
+      BSG_REPORT_INDEX_MAX;
+  bsg_report_index_record *record = &index->records[slot];
+  __atomic_store_n(&record->signature, 0, __ATOMIC_RELEASE);
+  record->timestamp =
+      event->device.time > 0 ? (int64_t)event->device.time : time(NULL);
+  record->size = size;
+  record->is_launching = event->app.is_launching;
+  bsg_strncpy(record->name, report_name(report_path), sizeof(record->name));
+  __atomic_store_n(&record->signature, signature, __ATOMIC_RELEASE);
+}
+
+typedef struct {
+  char *path;
+  size_t position;
+  bool indexed;
+  bool is_launching;
+  int64_t timestamp;
+} bsg_indexed_report;
+
+static int compare_reports(const void *a, const void *b) {
+  const bsg_indexed_report *left = a;
+  const bsg_indexed_report *right = b;
+  if (left->indexed != right->indexed) {
+    return left->indexed ? -1 : 1;
+  }
+  if (left->indexed) {
+    if (left->is_launching != right->is_launching) {
+      return left->is_launching ? -1 : 1;
+    }
+    if (left->timestamp != right->timestamp) {
+      return left->timestamp > right->timestamp ? -1 : 1;
+    }
+  }
+  return left->position < right->position ? -1 : 1;
+}
+
+/**
+ * Look up the record of each report, removing it from the index
+ */
+static void take_records(bsg_report_index *index, bsg_indexed_report *reports,
+                         size_t count) {
+  for (int i = 0; i < BSG_REPORT_INDEX_MAX; i++) {
+    bsg_report_index_record *record = &index->records[i];
+    if (__atomic_load_n(&record->signature, __ATOMIC_ACQUIRE) == 0) {
+      continue;
+    }
+    for (size_t j = 0; j < count; j++) {
+      if (strcmp(record->name, report_name(reports[j].path)) == 0) {
+        reports[j].indexed = true;
+        reports[j].is_launching = record->is_launching;
+        reports[j].timestamp = record->timestamp;
+        __atomic_store_n(&record->signature, 0, __ATOMIC_RELEASE);
+        break;
+      }
+    }
+  }
+}
+
+size_t bsg_report_index_order(char **paths, size_t count, size_t max_reports) {
+  if (count == 0) {
+    return 0;
+  }
+  bsg_indexed_report *reports = calloc(count, sizeof(bsg_indexed_report));
+  if (reports == NULL) {
+    return count;
+  }
+  for (size_t i = 0; i < count; i++) {
+    reports[i].path = paths[i];
+    reports[i].position = i;
+  }
+
+  // reports of a previous launch are ordered whether or not this one indexes
+  bsg_report_index *index = __atomic_load_n(&active_index, __ATOMIC_ACQUIRE);
+  bsg_report_index *mapped = NULL;
+  if (index == NULL) {
+    char path[512];
+    if (index_path(paths[0], path, sizeof(path))) {
+      index = mapped = map_index(path, false);
+    }
+  }
+  if (index != NULL) {
+    take_records(index, reports, count);
+  }
+  if (mapped != NULL) {
+    munmap(mapped, sizeof(bsg_report_index));
+  }
+
+  qsort(reports, count, sizeof(bsg_indexed_report), compare_reports);
+  for (size_t i = 0; i < count; i++) {
+    paths[i] = reports[i].path;
+  }
+  free(reports);
+
+  if (max_reports == 0 || count <= max_reports) {
+    return count;
+  }
+  for (size_t i = max_reports; i < count; i++) {
+    BUGSNAG_LOG("Discarding report over the backlog limit: %s", paths[i]);
+    unlink(paths[i]);
+  }
+  return max_reports;
+}
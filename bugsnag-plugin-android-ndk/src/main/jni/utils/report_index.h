@@ -0,0 +1,52 @@
+/**
+ * An index of the reports written to the report directory, kept beside it,
+ * with a fixed-size record per report of what delivery needs to order and cap
+ * the backlog: when it was written, whether the app was launching, its size
+ * and the signature of its stack. Pending reports are then ordered without
+ * reading each one, launch crashes and the newest reports first.
+ */
+#ifndef BUGSNAG_REPORT_INDEX_H
+#define BUGSNAG_REPORT_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../event.h"
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of records kept, after which the oldest is replaced */
+#define BSG_REPORT_INDEX_MAX 64
+
+/**
+ * Map the index for the report directory containing report_path, creating it
+ * if needed, so that reports written from then on are recorded in it. Returns
+ * false if the index could not be mapped.
+ */
+bool bsg_report_index_enable(const char *report_path);
+
+/**
+ * Record the report of event which has just been written to report_path,
+ * replacing the oldest record once the index is full
+ */
+void bsg_report_index_add(const char *report_path,
+                          const bugsnag_event *event) __asyncsafe;
+
+/**
+ * Sort the paths of pending reports for delivery, launch crashes first and
+ * then newest first, with any reports missing from the index after those in
+ * it in their original order. If max_reports is more than 0, the reports
+ * beyond it are deleted unread. The records of every path passed are removed
+ * from the index, as pending reports are removed once read.
+ *
+ * @return the number of paths left to deliver, which are at the start of paths
+ */
+size_t bsg_report_index_order(char **paths, size_t count, size_t max_reports);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,4 +1,5 @@
 #include "serializer.h"
+#include "report_index.h"
 #include "serializer/event_reader.h"
 #include "serializer/event_writer.h"
 #include "serializer/json_writer.h"
@@ -7,8 +8,20 @@ bool bsg_serialize_last_run_info_to_file(bsg_environment *env) {
   return bsg_lastrun_write(env);
 }
 
+bool bsg_serialize_prepare_event_file(bsg_environment *env) {
+  return bsg_event_write_prepare(env);
+}
+
+bool bsg_serialize_prepare_last_run_info_file(bsg_environment *env) {
+  return bsg_lastrun_write_prepare(env);
+}
+
 bool bsg_serialize_event_to_file(bsg_environment *env) {
-  return bsg_event_write(env);
+  if (!bsg_event_write(env)) {
+    return false;
+  }
+  bsg_report_index_add(env->next_event_path, &env->next_event);
+  return true;
 }
 
 bugsnag_event *bsg_deserialize_event_from_file(char *filepath) {
@@ -16,5 +29,5 @@ bugsnag_event *bsg_deserialize_event_from_file(char *filepath) {
 }
 
 char *bsg_serialize_event_to_json_string(bugsnag_event *event) {
-  return bsg_event_to_json(event);
+  return bsg_event_to_json_stream(event);
 }
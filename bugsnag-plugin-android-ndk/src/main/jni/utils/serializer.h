@@ -8,8 +8,20 @@ extern "C" {
 
 char *bsg_serialize_event_to_json_string(bugsnag_event *event);
 
+/**
+ * Pre-allocates the file at env->next_event_path so that
+ * bsg_serialize_event_to_file() only has to copy the event into memory.
+ */
+bool bsg_serialize_prepare_event_file(bsg_environment *env);
+
 bool bsg_serialize_event_to_file(bsg_environment *env) __asyncsafe;
 
+/**
+ * Opens the file at env->last_run_info_path so that
+ * bsg_serialize_last_run_info_to_file() rewrites it without opening it.
+ */
+bool bsg_serialize_prepare_last_run_info_file(bsg_environment *env);
+
 /**
  * Serializes the LastRunInfo to the file. This persists information about
  * why the current launch crashed, for use on future launch.
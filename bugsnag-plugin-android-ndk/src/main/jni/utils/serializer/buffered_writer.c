@@ -111,6 +111,49 @@ static bool bsg_buffered_writer_close(bsg_buffered_writer *writer) {
   return true;
 }
 
+static bool bsg_mapped_writer_write(struct bsg_buffered_writer *writer,
+                                    const void *data, size_t length) {
+  const char *bytes = data;
+  if (writer->pos < writer->mapping_size) {
+    size_t mapped_length = writer->mapping_size - writer->pos;
+    if (mapped_length > length) {
+      mapped_length = length;
+    }
+    memcpy(writer->mapping + writer->pos, bytes, mapped_length);
+    writer->pos += mapped_length;
+    bytes += mapped_length;
+    length -= mapped_length;
+
+    if (length == 0) {
+      return true;
+    }
+    // the mapping is full, so spill the rest into the file after it
+    if (lseek(writer->fd, writer->pos, SEEK_SET) < 0) {
+      return false;
+    }
+  }
+
+  if (!bsg_flush_impl(writer->fd, bytes, length)) {
+    return false;
+  }
+  writer->pos += length;
+  return true;
+}
+
+static bool bsg_mapped_writer_flush(struct bsg_buffered_writer *writer) {
+  // writes go straight into the mapping or the file
+  return true;
+}
+
+static bool bsg_mapped_writer_close(bsg_buffered_writer *writer) {
+  // drop any of the pre-allocated space which was not used
+  bool result = ftruncate(writer->fd, writer->pos) == 0;
+  if (close(writer->fd) < 0) {
+    return false;
+  }
+  return result;
+}
+
 bool bsg_buffered_writer_open(struct bsg_buffered_writer *writer,
                               const char *path) {
   int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
@@ -118,8 +161,24 @@ bool bsg_buffered_writer_open(struct bsg_buffered_writer *writer,
     goto fail;
   }
 
+  return bsg_buffered_writer_open_fd(writer, fd);
+
+fail:
+  if (fd > 0) {
+    close(fd);
+  }
+  return false;
+}
+
+bool bsg_buffered_writer_open_fd(struct bsg_buffered_writer *writer, int fd) {
+  if (fd < 0) {
+    return false;
+  }
+
   writer->fd = fd;
   writer->pos = 0;
+  writer->mapping = NULL;
+  writer->mapping_size = 0;
   writer->write = bsg_buffered_writer_write;
   writer->write_string = bsg_buffered_write_string;
   writer->write_byte = bsg_buffered_write_byte;
@@ -127,10 +186,23 @@ bool bsg_buffered_writer_open(struct bsg_buffered_writer *writer,
   writer->dispose = bsg_buffered_writer_close;
 
   return true;
-
-fail:
-  if (fd > 0) {
-    close(fd);
+}
+bool bsg_buffered_writer_open_mapped(struct bsg_buffered_writer *writer,
+                                     int fd, void *mapping,
+                                     size_t mapping_size) {
+  if (fd < 0 || mapping == NULL) {
+    return false;
   }
-  return false;
-}
\ No newline at end of file
+
+  writer->fd = fd;
+  writer->pos = 0;
+  writer->mapping = mapping;
+  writer->mapping_size = mapping_size;
+  writer->write = bsg_mapped_writer_write;
+  writer->write_string = bsg_buffered_write_string;
+  writer->write_byte = bsg_buffered_write_byte;
+  writer->flush = bsg_mapped_writer_flush;
+  writer->dispose = bsg_mapped_writer_close;
+
+  return true;
+}
@@ -12,10 +12,20 @@
 
 #define BSG_BUFFER_SIZE 128
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct bsg_buffered_writer {
   int fd;
   size_t pos;
   char buffer[BSG_BUFFER_SIZE];
+  /**
+   * Memory mapped region of the file, when opened with
+   * bsg_buffered_writer_open_mapped()
+   */
+  char *mapping;
+  size_t mapping_size;
 
   /**
    * Write to this writer. If the internal buffer size is exceeded, it will
@@ -83,4 +93,40 @@ typedef struct bsg_buffered_writer {
 bool bsg_buffered_writer_open(struct bsg_buffered_writer *writer,
                               const char *path);
 
-#endif
\ No newline at end of file
+/**
+ * Create a new buffered writer around an already open file descriptor. Data is
+ * written from the current file offset, and the descriptor is closed when the
+ * writer is disposed.
+ *
+ * Note: This method is async-safe.
+ *
+ * @param writer The writer to initialize.
+ * @param fd The file descriptor to write to.
+ * @return True on success.
+ */
+bool bsg_buffered_writer_open_fd(struct bsg_buffered_writer *writer, int fd);
+
+/**
+ * Create a new writer which copies data directly into a shared memory mapping
+ * of the start of a file instead of buffering it. Any data which does not fit
+ * in the mapping is written to the file after the mapped region. When the
+ * writer is disposed the file is truncated to the length written, and the file
+ * descriptor is closed.
+ *
+ * Note: This method is async-safe.
+ *
+ * @param writer The writer to initialize.
+ * @param fd The file descriptor of the mapped file.
+ * @param mapping The start of the shared mapping of the file.
+ * @param mapping_size The size of the mapping in bytes.
+ * @return True on success.
+ */
+bool bsg_buffered_writer_open_mapped(struct bsg_buffered_writer *writer,
+                                     int fd, void *mapping,
+                                     size_t mapping_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,534 +3,1193 @@
 
 #include "../../event.h"
 #include "../string.h"
+#include "section_checksum.h"
 
 #include <fcntl.h>
 #include <malloc.h>
+#include <stddef.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-const int BSG_MIGRATOR_CURRENT_VERSION = 8;
+const int BSG_MIGRATOR_CURRENT_VERSION = 15;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 // Symbols exported for unit test access
-void migrate_app_v1(bugsnag_report_v2 *report_v2, bugsnag_report_v3 *event);
 void migrate_app_v2(bugsnag_report_v4 *report_v4, bugsnag_event *event);
-void migrate_device_v1(bugsnag_report_v2 *report_v2, bugsnag_report_v3 *event);
 #ifdef __cplusplus
 }
 #endif
 
 /**
- * the *_read() functions take a file descriptor and read a payload in the
- * {version} format. This allocates an instance of the return value type.
+ * A read-only cursor over part of a mapped event file
  */
+typedef struct {
+  const char *data;
+  size_t length;
+  size_t pos;
+  /** The capacities the file was written with */
+  const bsg_event_layout *layout;
+  /** Whether each section is framed with a checksum, since version 14 */
+  bool checksummed;
+} bsg_event_section;
+
+/** The capacities of every report written before version 12 */
+static const bsg_event_layout legacy_layout = {
+    .metadata_max = V1_BUGSNAG_METADATA_MAX,
+    .crumbs_max = V3_BUGSNAG_CRUMBS_MAX,
+    .threads_max = V1_BUGSNAG_THREADS_MAX,
+    .frames_max = V1_BUGSNAG_FRAMES_MAX,
+};
+
+static bool read_v9(bsg_event_section *file, bugsnag_event *event);
+static bool read_v10(bsg_event_section *file, bugsnag_event *event);
+static bool read_v11(bsg_event_section *file, bugsnag_event *event);
+static bool read_v13(bsg_event_section *file, bugsnag_event *event);
+static bool read_v15(bsg_event_section *file, bugsnag_event *event);
+static bool migrate_legacy(int version, bsg_event_section *file,
+                           bugsnag_event *event);
+
+static bool read_feature_flags(bsg_event_section *section,
+                               bsg_feature_flag **out_feature_flags,
+                               size_t *out_feature_flag_count);
+static void migrate_metadata_value_v1(const bsg_metadata_value_v1 *value,
+                                      bugsnag_metadata *metadata);
 
-bugsnag_report_v1 *bsg_report_v1_read(int fd);
-bugsnag_report_v2 *bsg_report_v2_read(int fd);
-bugsnag_report_v3 *bsg_report_v3_read(int fd);
-bugsnag_report_v4 *bsg_report_v4_read(int fd);
-bugsnag_report_v5 *bsg_report_v5_read(int fd);
-bugsnag_report_v6 *bsg_report_v6_read(int fd);
-bugsnag_report_v7 *bsg_report_v7_read(int fd);
-bugsnag_event *bsg_report_v8_read(int fd);
+/**
+ * Returns a pointer to the next length bytes of the section, or NULL if the
+ * section is too short
+ */
+static const void *section_view(bsg_event_section *section, size_t length) {
+  if (length > section->length - section->pos) {
+    return NULL;
+  }
+  const void *view = section->data + section->pos;
+  section->pos += length;
+  return view;
+}
+
+static bool section_read(bsg_event_section *section, void *dest,
+                         size_t length) {
+  const void *src = section_view(section, length);
+  if (src == NULL) {
+    return false;
+  }
+  memcpy(dest, src, length);
+  return true;
+}
 
 /**
- * the map_*() functions convert a structure of an older format into the latest.
- * This frees the parameter provided to the function once conversion is
- * complete.
+ * Reads a length-prefixed section from the file without copying it, checking
+ * it against its checksum if the file has them
  */
+static bool read_section(bsg_event_section *file,
+                         bsg_event_section *section) {
+  uint32_t length;
+  uint32_t checksum;
+  if (!section_read(file, &length, sizeof(length)) ||
+      (file->checksummed &&
+       !section_read(file, &checksum, sizeof(checksum)))) {
+    return false;
+  }
+  section->data = section_view(file, length);
+  section->length = length;
+  section->pos = 0;
+  section->layout = file->layout;
+  section->checksummed = file->checksummed;
+  if (section->data == NULL) {
+    return false;
+  }
+  return !file->checksummed ||
+         bsg_section_checksum(BSG_SECTION_CHECKSUM_INIT, section->data,
+                              length) == checksum;
+}
 
-bugsnag_event *bsg_map_v7_to_report(bugsnag_report_v7 *report_v7);
-bugsnag_event *bsg_map_v6_to_report(bugsnag_report_v6 *report_v6);
-bugsnag_event *bsg_map_v5_to_report(bugsnag_report_v5 *report_v5);
-bugsnag_event *bsg_map_v4_to_report(bugsnag_report_v4 *report_v4);
-bugsnag_event *bsg_map_v3_to_report(bugsnag_report_v3 *report_v3);
-bugsnag_event *bsg_map_v2_to_report(bugsnag_report_v2 *report_v2);
-bugsnag_event *bsg_map_v1_to_report(bugsnag_report_v1 *report_v1);
-
-void migrate_breadcrumb_v1(bugsnag_report_v2 *report_v2,
-                           bugsnag_report_v3 *event);
-void migrate_breadcrumb_v2(bugsnag_report_v5 *report_v5, bugsnag_event *event);
-
-void migrate_device_v2(bsg_device_info *output, bsg_device_info_v2 *input);
-void migrate_app_v3(bsg_app_info *output, bsg_app_info_v3 *input);
-
-void bsg_read_feature_flags(int fd, bsg_feature_flag **out_feature_flags,
-                            size_t *out_feature_flag_count);
-
-bsg_report_header *bsg_report_header_read(int fd) {
-  bsg_report_header *header = calloc(1, sizeof(bsg_report_header));
-  ssize_t len = read(fd, header, sizeof(bsg_report_header));
-  if (len != sizeof(bsg_report_header)) {
-    free(header);
-    return NULL;
+static bool read_event(bsg_event_section *file, bugsnag_event *event) {
+  // headers before version 12 end where the layout starts
+  bsg_report_header header;
+  if (!section_read(file, &header, offsetof(bsg_report_header, layout))) {
+    return false;
+  }
+  file->layout = &legacy_layout;
+  if (header.version >= 12) {
+    if (!section_read(file, &header.layout, sizeof(header.layout))) {
+      return false;
+    }
+    file->layout = &header.layout;
   }
 
-  return header;
+  // v15 only changes the breadcrumb records of v14
+  if (header.version == BSG_MIGRATOR_CURRENT_VERSION) {
+    file->checksummed = true;
+    return read_v15(file, event);
+  }
+  // v14 only adds checksums to the sections of v13
+  if (header.version == 14 || header.version == 13) {
+    file->checksummed = header.version >= 14;
+    return read_v13(file, event);
+  }
+  // v12 only adds the layout to the header
+  if (header.version == 12 || header.version == 11) {
+    return read_v11(file, event);
+  }
+  if (header.version == 10) {
+    return read_v10(file, event);
+  }
+  if (header.version == 9) {
+    return read_v9(file, event);
+  }
+  return migrate_legacy(header.version, file, event);
 }
 
-bugsnag_event *bsg_read_event(char *filepath) {
+bool bsg_read_event_into(char *filepath, bugsnag_event *event) {
+  memset(event, 0, sizeof(bugsnag_event));
+
   int fildes = open(filepath, O_RDONLY);
   if (fildes == -1) {
-    return NULL;
+    return false;
   }
 
-  bsg_report_header *header = bsg_report_header_read(fildes);
-  if (header == NULL) {
-    return NULL;
+  struct stat file_stat;
+  if (fstat(fildes, &file_stat) != 0 || file_stat.st_size <= 0) {
+    close(fildes);
+    return false;
   }
 
-  int version = header->version;
-  free(header);
-  bugsnag_event *event = NULL;
-
-  switch (version) {
-  case 1:
-    return bsg_map_v1_to_report(bsg_report_v1_read(fildes));
-  case 2:
-    return bsg_map_v2_to_report(bsg_report_v2_read(fildes));
-  case 3:
-    return bsg_map_v3_to_report(bsg_report_v3_read(fildes));
-  case 4:
-    return bsg_map_v4_to_report(bsg_report_v4_read(fildes));
-  case 5:
-    return bsg_map_v5_to_report(bsg_report_v5_read(fildes));
-  case 6:
-    return bsg_map_v6_to_report(bsg_report_v6_read(fildes));
-  case 7:
-    return bsg_map_v7_to_report(bsg_report_v7_read(fildes));
-  case BSG_MIGRATOR_CURRENT_VERSION:
-    return bsg_report_v8_read(fildes);
-  default:
-    return NULL;
+  size_t length = (size_t)file_stat.st_size;
+  void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fildes, 0);
+  // the mapping remains valid once the descriptor is closed
+  close(fildes);
+  if (mapping == MAP_FAILED) {
+    return false;
   }
-}
 
-bugsnag_report_v1 *bsg_report_v1_read(int fd) {
-  size_t event_size = sizeof(bugsnag_report_v1);
-  bugsnag_report_v1 *event = calloc(1, event_size);
+  bsg_event_section file = {
+      .data = mapping, .length = length, .pos = 0, .layout = &legacy_layout};
+  bool result = read_event(&file, event);
+  munmap(mapping, length);
 
-  ssize_t len = read(fd, event, event_size);
-  if (len != event_size) {
+  if (result) {
+    // the index is not stored, as it can be derived from the values
+    bsg_event_index_metadata(event);
+  } else {
+    bsg_event_free_threads(event);
+    memset(event, 0, sizeof(bugsnag_event));
+  }
+  return result;
+}
+
+bugsnag_event *bsg_read_event(char *filepath) {
+  // bsg_read_event_into() zeroes the event
+  bugsnag_event *event = bsg_event_alloc();
+  if (event == NULL) {
+    return NULL;
+  }
+  if (!bsg_read_event_into(filepath, event)) {
     free(event);
     return NULL;
   }
   return event;
 }
 
-bugsnag_report_v2 *bsg_report_v2_read(int fd) {
-  size_t event_size = sizeof(bugsnag_report_v2);
-  bugsnag_report_v2 *event = calloc(1, event_size);
+static bool section_read_count(bsg_event_section *section, int max,
+                               int *out_count) {
+  uint32_t count;
+  if (!section_read(section, &count, sizeof(count)) || count > (uint32_t)max) {
+    return false;
+  }
+  *out_count = (int)count;
+  return true;
+}
 
-  ssize_t len = read(fd, event, event_size);
-  if (len != event_size) {
-    free(event);
-    return NULL;
+/**
+ * Reads the count of an array which the writer bounded by writer_max, which
+ * may be larger than the capacity of the array in this build. The count kept
+ * is truncated to capacity, and out_skipped set to the number of elements
+ * which will not fit.
+ */
+static bool section_read_capped_count(bsg_event_section *section,
+                                      uint32_t writer_max, int capacity,
+                                      int *out_count, int *out_skipped) {
+  uint32_t count;
+  if (!section_read(section, &count, sizeof(count)) || count > writer_max) {
+    return false;
   }
-  return event;
+  const int kept = count > (uint32_t)capacity ? capacity : (int)count;
+  *out_count = kept;
+  *out_skipped = (int)(count - (uint32_t)kept);
+  return true;
 }
 
-bugsnag_report_v3 *bsg_report_v3_read(int fd) {
-  size_t event_size = sizeof(bugsnag_report_v3);
-  bugsnag_report_v3 *event = calloc(1, event_size);
+static bool section_read_metadata(bsg_event_section *section,
+                                  bugsnag_metadata *metadata) {
+  int names_length;
+  int skipped;
+  if (!section_read_capped_count(section, section->layout->metadata_max,
+                                 BUGSNAG_METADATA_MAX, &metadata->value_count,
+                                 &skipped) ||
+      !section_read(section, metadata->values,
+                    metadata->value_count * sizeof(bsg_metadata_value)) ||
+      section_view(section, skipped * sizeof(bsg_metadata_value)) == NULL ||
+      !section_read_count(section, BUGSNAG_METADATA_NAMES_SIZE,
+                          &names_length) ||
+      !section_read(section, metadata->names, names_length)) {
+    return false;
+  }
+  if (names_length > 0) {
+    // keep every name terminated, whatever the file contains
+    metadata->names[0] = '\0';
+    metadata->names[names_length - 1] = '\0';
+  }
+  metadata->names_length = (uint16_t)names_length;
+  return true;
+}
 
-  ssize_t len = read(fd, event, event_size);
-  if (len != event_size) {
-    free(event);
-    return NULL;
+/**
+ * Reads metadata written by v9, where each value carried its own names
+ */
+static bool section_read_metadata_v9(bsg_event_section *section,
+                                     bugsnag_metadata *metadata) {
+  int value_count;
+  if (!section_read_count(section, (int)section->layout->metadata_max,
+                          &value_count)) {
+    return false;
   }
-  return event;
+  for (int i = 0; i < value_count; i++) {
+    const bsg_metadata_value_v1 *value =
+        section_view(section, sizeof(bsg_metadata_value_v1));
+    if (value == NULL) {
+      return false;
+    }
+    migrate_metadata_value_v1(value, metadata);
+  }
+  return true;
 }
 
-bugsnag_report_v4 *bsg_report_v4_read(int fd) {
-  size_t event_size = sizeof(bugsnag_report_v4);
-  bugsnag_report_v4 *event = calloc(1, event_size);
+typedef bool (*bsg_metadata_reader)(bsg_event_section *section,
+                                    bugsnag_metadata *metadata);
+
+static bool read_core_section(bsg_event_section *section,
+                              bugsnag_event *event) {
+  return section_read(section, &event->notifier, sizeof(event->notifier)) &&
+         section_read(section, &event->app, sizeof(event->app)) &&
+         section_read(section, &event->device, sizeof(event->device)) &&
+         section_read(section, &event->user, sizeof(event->user)) &&
+         section_read(section, event->context, sizeof(event->context)) &&
+         section_read(section, &event->severity, sizeof(event->severity)) &&
+         section_read(section, event->session_id, sizeof(event->session_id)) &&
+         section_read(section, event->session_start,
+                      sizeof(event->session_start)) &&
+         section_read(section, &event->handled_events,
+                      sizeof(event->handled_events)) &&
+         section_read(section, &event->unhandled_events,
+                      sizeof(event->unhandled_events)) &&
+         section_read(section, event->grouping_hash,
+                      sizeof(event->grouping_hash)) &&
+         section_read(section, &event->unhandled, sizeof(event->unhandled)) &&
+         section_read(section, event->api_key, sizeof(event->api_key));
+}
 
-  ssize_t len = read(fd, event, event_size);
-  if (len != event_size) {
-    free(event);
-    return NULL;
+static bool read_error_section(bsg_event_section *section,
+                               bugsnag_event *event) {
+  bsg_error *error = &event->error;
+  int frame_count;
+  int skipped;
+  if (!section_read(section, error->errorClass, sizeof(error->errorClass)) ||
+      !section_read(section, error->errorMessage,
+                    sizeof(error->errorMessage)) ||
+      !section_read(section, error->type, sizeof(error->type)) ||
+      !section_read_capped_count(section, section->layout->frames_max,
+                                 BUGSNAG_FRAMES_MAX, &frame_count, &skipped)) {
+    return false;
   }
-  return event;
+  // the frames are ordered from the top of the stack, so only the outermost
+  // are lost when they do not fit
+  error->frame_count = frame_count;
+  return section_read(section, error->stacktrace,
+                      frame_count * sizeof(bugsnag_stackframe)) &&
+         section_view(section, skipped * sizeof(bugsnag_stackframe)) != NULL;
 }
 
-bugsnag_report_v5 *bsg_report_v5_read(int fd) {
-  size_t event_size = sizeof(bugsnag_report_v5);
-  bugsnag_report_v5 *event = calloc(1, event_size);
+typedef void (*bsg_frame_entry_reader)(bugsnag_stackframe *frame,
+                                       uintptr_t address, const char *name,
+                                       uint32_t name_length);
 
-  ssize_t len = read(fd, event, event_size);
-  if (len != event_size) {
-    free(event);
-    return NULL;
+static void copy_frame_string(char *dest, size_t size, const char *name,
+                              uint32_t name_length) {
+  const size_t length = name_length < size ? name_length : size - 1;
+  memcpy(dest, name, length);
+  dest[length] = '\0';
+}
+
+static void read_module_entry(bugsnag_stackframe *frame, uintptr_t address,
+                              const char *name, uint32_t name_length) {
+  frame->load_address = address;
+  copy_frame_string(frame->filename, sizeof(frame->filename), name,
+                    name_length);
+}
+
+static void read_symbol_entry(bugsnag_stackframe *frame, uintptr_t address,
+                              const char *name, uint32_t name_length) {
+  frame->symbol_address = address;
+  copy_frame_string(frame->method, sizeof(frame->method), name, name_length);
+}
+
+static bool section_view_frame_entry(bsg_event_section *section,
+                                     uintptr_t *address, const char **name,
+                                     uint32_t *name_length) {
+  return section_read(section, address, sizeof(*address)) &&
+         section_read(section, name_length, sizeof(*name_length)) &&
+         (*name = section_view(section, *name_length)) != NULL;
+}
+
+/**
+ * Reads a module or symbol table and the uint16 entry of each frame written
+ * after it. The entries are walked once to find the indices, then again to
+ * apply each to its frames, so that nothing needs to be allocated.
+ */
+static bool read_frame_table(bsg_event_section *section,
+                             bugsnag_stackframe *stacktrace, int frame_count,
+                             int written_count, bsg_frame_entry_reader apply) {
+  int entry_count;
+  if (!section_read_count(section, written_count, &entry_count)) {
+    return false;
   }
-  return event;
+  bsg_event_section entries = *section;
+  uintptr_t address;
+  const char *name;
+  uint32_t name_length;
+  for (int i = 0; i < entry_count; i++) {
+    if (!section_view_frame_entry(section, &address, &name, &name_length)) {
+      return false;
+    }
+  }
+  const uint8_t *indices =
+      section_view(section, written_count * sizeof(uint16_t));
+  if (indices == NULL) {
+    return false;
+  }
+  for (int entry = 0; entry < entry_count; entry++) {
+    section_view_frame_entry(&entries, &address, &name, &name_length);
+    for (int i = 0; i < frame_count; i++) {
+      uint16_t index;
+      memcpy(&index, indices + i * sizeof(index), sizeof(index));
+      if (index == entry) {
+        apply(&stacktrace[i], address, name, name_length);
+      }
+    }
+  }
+  return true;
 }
 
-bugsnag_report_v6 *bsg_report_v6_read(int fd) {
-  size_t event_size = sizeof(bugsnag_report_v6);
-  bugsnag_report_v6 *event = calloc(1, event_size);
+static bool read_frame_column(bsg_event_section *section, void *dest,
+                              size_t dest_stride, size_t width,
+                              int frame_count, int written_count) {
+  const uint8_t *column = section_view(section, written_count * width);
+  if (column == NULL) {
+    return false;
+  }
+  for (int i = 0; i < frame_count; i++) {
+    memcpy((uint8_t *)dest + i * dest_stride, column + i * width, width);
+  }
+  return true;
+}
 
-  ssize_t len = read(fd, event, event_size);
-  if (len != event_size) {
-    free(event);
-    return NULL;
+/**
+ * Reads the error written by v13, whose frames are split into columns and
+ * tables of their modules and symbols
+ */
+static bool read_error_section_v13(bsg_event_section *section,
+                                   bugsnag_event *event) {
+  bsg_error *error = &event->error;
+  int frame_count;
+  int skipped;
+  if (!section_read(section, error->errorClass, sizeof(error->errorClass)) ||
+      !section_read(section, error->errorMessage,
+                    sizeof(error->errorMessage)) ||
+      !section_read(section, error->type, sizeof(error->type)) ||
+      !section_read_capped_count(section, section->layout->frames_max,
+                                 BUGSNAG_FRAMES_MAX, &frame_count, &skipped)) {
+    return false;
   }
-  return event;
+  const int written_count = frame_count + skipped;
+  bugsnag_stackframe *stacktrace = error->stacktrace;
+  error->frame_count = frame_count;
+  return read_frame_column(section, &stacktrace[0].frame_address,
+                           sizeof(bugsnag_stackframe),
+                           sizeof(stacktrace[0].frame_address), frame_count,
+                           written_count) &&
+         read_frame_column(section, &stacktrace[0].line_number,
+                           sizeof(bugsnag_stackframe),
+                           sizeof(stacktrace[0].line_number), frame_count,
+                           written_count) &&
+         read_frame_table(section, stacktrace, frame_count, written_count,
+                          read_module_entry) &&
+         read_frame_table(section, stacktrace, frame_count, written_count,
+                          read_symbol_entry);
+}
+
+static bool read_metadata_section(bsg_event_section *section,
+                                  bugsnag_event *event) {
+  return section_read_metadata(section, &event->metadata);
 }
 
-bugsnag_report_v7 *bsg_report_v7_read(int fd) {
-  size_t event_size = sizeof(bugsnag_report_v7);
-  bugsnag_report_v7 *event = calloc(1, event_size);
+static bool read_metadata_section_v9(bsg_event_section *section,
+                                     bugsnag_event *event) {
+  return section_read_metadata_v9(section, &event->metadata);
+}
 
-  ssize_t len = read(fd, event, event_size);
-  if (len != event_size) {
-    free(event);
-    return NULL;
+typedef bool (*bsg_crumb_record_reader)(bugsnag_event *event,
+                                        const void *record, uint32_t length);
+
+static bool read_crumb_records(bsg_event_section *section,
+                               bugsnag_event *event,
+                               bsg_crumb_record_reader add_record) {
+  int crumb_count;
+  // the ring keeps the newest breadcrumbs when there are more than fit
+  if (!section_read_count(section, (int)section->layout->crumbs_max,
+                          &crumb_count)) {
+    return false;
   }
-  return event;
+
+  for (int i = 0; i < crumb_count; i++) {
+    // each record starts with its length
+    uint32_t length;
+    if (!section_read(section, &length, sizeof(length)) ||
+        length < sizeof(length)) {
+      return false;
+    }
+    section->pos -= sizeof(length);
+    const void *record = section_view(section, length);
+    if (record == NULL || !add_record(event, record, length)) {
+      return false;
+    }
+  }
+  return true;
 }
 
-bugsnag_event *bsg_report_v8_read(int fd) {
-  size_t event_size = sizeof(bugsnag_event);
-  bugsnag_event *event = calloc(1, event_size);
+static bool read_breadcrumbs_section(bsg_event_section *section,
+                                     bugsnag_event *event) {
+  return read_crumb_records(section, event, bsg_event_add_breadcrumb_record);
+}
 
-  ssize_t len = read(fd, event, event_size);
-  if (len != event_size) {
-    free(event);
-    return NULL;
+/**
+ * Reads the records written by v11 to v14, which held timestamp strings
+ */
+static bool read_breadcrumbs_section_v14(bsg_event_section *section,
+                                         bugsnag_event *event) {
+  return read_crumb_records(section, event,
+                            bsg_event_add_breadcrumb_record_v14);
+}
+
+/**
+ * Reads breadcrumbs written by v9 and v10, which were stored at a fixed size
+ */
+static bool read_fixed_breadcrumbs(bsg_event_section *section,
+                                   bugsnag_event *event,
+                                   bsg_metadata_reader read_metadata) {
+  int crumb_count;
+  if (!section_read_count(section, (int)section->layout->crumbs_max,
+                          &crumb_count)) {
+    return false;
+  }
+  bugsnag_breadcrumb *crumb = malloc(sizeof(bugsnag_breadcrumb));
+  if (crumb == NULL) {
+    return false;
+  }
+
+  bool result = true;
+  for (int i = 0; i < crumb_count && result; i++) {
+    memset(crumb, 0, sizeof(bugsnag_breadcrumb));
+    char timestamp[37];
+    result = section_read(section, crumb->name, sizeof(crumb->name)) &&
+             section_read(section, timestamp, sizeof(timestamp)) &&
+             section_read(section, &crumb->type, sizeof(crumb->type)) &&
+             read_metadata(section, &crumb->metadata);
+    if (result) {
+      timestamp[sizeof(timestamp) - 1] = '\0';
+      crumb->timestamp_ms = bsg_crumb_timestamp_parse(timestamp);
+      bugsnag_event_add_breadcrumb(event, crumb);
+    }
+  }
+  free(crumb);
+  return result;
+}
+
+static bool read_breadcrumbs_section_v10(bsg_event_section *section,
+                                         bugsnag_event *event) {
+  return read_fixed_breadcrumbs(section, event, section_read_metadata);
+}
+
+static bool read_breadcrumbs_section_v9(bsg_event_section *section,
+                                        bugsnag_event *event) {
+  return read_fixed_breadcrumbs(section, event, section_read_metadata_v9);
+}
+
+static bool read_threads_section(bsg_event_section *section,
+                                 bugsnag_event *event) {
+  int thread_count;
+  if (!section_read_count(section, BUGSNAG_THREADS_LIMIT, &thread_count) ||
+      !bsg_event_reserve_threads(event, thread_count) ||
+      (thread_count > 0 &&
+       !section_read(section, event->threads,
+                     thread_count * sizeof(bsg_thread)))) {
+    return false;
+  }
+  event->thread_count = thread_count;
+  // older files end the section before the truncated flag
+  uint8_t truncated;
+  event->threads_truncated =
+      section_read(section, &truncated, sizeof(truncated)) && truncated;
+  return true;
+}
+
+typedef bool (*bsg_section_reader)(bsg_event_section *section,
+                                   bugsnag_event *event);
+
+static bool read_event_section(bsg_event_section *file, bugsnag_event *event,
+                               bsg_section_reader read_payload) {
+  bsg_event_section section;
+  return read_section(file, &section) && read_payload(&section, event);
+}
+
+/**
+ * Read the metadata arena which follows the feature flags, if there is one
+ */
+static void read_metadata_arena(bsg_event_section *file,
+                                bsg_metadata_arena *arena) {
+  bsg_event_section section;
+  uint32_t length;
+  if (!read_section(file, &section) ||
+      !section_read(&section, &length, sizeof(length)) || length == 0) {
+    return;
+  }
+  const void *records = section_view(&section, length);
+  if (records == NULL || !bsg_metadata_arena_reserve(arena, length)) {
+    return;
+  }
+  // the records are checked as they are read back
+  memcpy(arena->data, records, length);
+  arena->length = length;
+}
+
+/**
+ * Read the modules recorded for deferred symbolication, which are absent from
+ * events written before they were added
+ */
+static void read_frame_modules(bsg_event_section *file, bugsnag_event *event) {
+  bsg_frame_module_table *table = &event->frame_modules;
+  bsg_event_section section;
+  int count;
+  if (!read_section(file, &section) ||
+      !section_read_count(&section, BUGSNAG_FRAME_MODULES_MAX, &count) ||
+      count == 0) {
+    return;
+  }
+  if (section_read(&section, table->modules,
+                   count * sizeof(bsg_frame_module)) &&
+      section_read(&section, table->frame_modules, event->error.frame_count)) {
+    table->count = count;
+  }
+}
+
+/**
+ * Read the timing recorded by the crash handler, which is absent from events
+ * written before it was added
+ */
+static void read_handler_timing(bsg_event_section *file,
+                                bugsnag_event *event) {
+  bsg_event_section section;
+  bsg_handler_timing timing;
+  if (read_section(file, &section) &&
+      section_read(&section, &timing, sizeof(timing))) {
+    event->handler_timing = timing;
+    // older files end the section before the fallbacks
+    uint8_t fallbacks;
+    if (section_read(&section, &fallbacks, sizeof(fallbacks))) {
+      event->handler_fallbacks = fallbacks;
+    }
+  }
+}
+
+/**
+ * Read the health counters, which are absent from events written before they
+ * were added. Counters added since the event was written are left at 0.
+ */
+static bool read_health_counters(bsg_event_section *file,
+                                 bugsnag_event *event) {
+  bsg_event_section section;
+  uint8_t count;
+  if (!read_section(file, &section) ||
+      !section_read(&section, &count, sizeof(count))) {
+    return false;
+  }
+  if (count > BSG_HEALTH_COUNTER_COUNT) {
+    count = BSG_HEALTH_COUNTER_COUNT;
+  }
+  return section_read(&section, event->health_counters.counts,
+                      count * sizeof(event->health_counters.counts[0]));
+}
+
+/**
+ * Keep an event whose writer stopped partway, if its sections are
+ * checksummed. Every section before the one which failed was written in full,
+ * so only those after it are missing.
+ */
+static bool read_truncated(bsg_event_section *file, bugsnag_event *event) {
+  if (!file->checksummed) {
+    return false;
+  }
+  event->handler_fallbacks |= BSG_HANDLER_FALLBACK_REPORT_TRUNCATED;
+  return true;
+}
+
+/**
+ * v9 to v15 only differ in how the error, metadata and breadcrumbs are stored,
+ * which are read by the given section readers. Sections added since v9 are
+ * read if present, and a file from v14 on which ends early is still reported.
+ */
+static bool read_sections(bsg_event_section *file, bugsnag_event *event,
+                          bsg_section_reader read_error,
+                          bsg_section_reader read_metadata,
+                          bsg_section_reader read_breadcrumbs) {
+  bsg_event_section feature_flags;
+  // there is nothing worth reporting without the error
+  if (!read_event_section(file, event, read_core_section) ||
+      !read_event_section(file, event, read_error)) {
+    return false;
+  }
+  if (!read_event_section(file, event, read_metadata) ||
+      !read_event_section(file, event, read_breadcrumbs) ||
+      !read_event_section(file, event, read_threads_section) ||
+      !read_section(file, &feature_flags)) {
+    return read_truncated(file, event);
   }
 
   // read the feature flags, if possible
-  bsg_read_feature_flags(fd, &event->feature_flags, &event->feature_flag_count);
+  read_feature_flags(&feature_flags, &event->feature_flags,
+                     &event->feature_flag_count);
+  read_metadata_arena(file, &event->metadata_arena);
+  read_frame_modules(file, event);
+  read_handler_timing(file, event);
+  // the last section, so any missing before it are missing here too
+  if (!read_health_counters(file, event)) {
+    read_truncated(file, event);
+  }
+  return true;
+}
 
-  return event;
+static bool read_v9(bsg_event_section *file, bugsnag_event *event) {
+  return read_sections(file, event, read_error_section,
+                       read_metadata_section_v9, read_breadcrumbs_section_v9);
 }
 
-bugsnag_event *bsg_map_v6_to_report(bugsnag_report_v6 *report_v6) {
-  if (report_v6 == NULL) {
-    return NULL;
+static bool read_v10(bsg_event_section *file, bugsnag_event *event) {
+  return read_sections(file, event, read_error_section, read_metadata_section,
+                       read_breadcrumbs_section_v10);
+}
+
+static bool read_v11(bsg_event_section *file, bugsnag_event *event) {
+  return read_sections(file, event, read_error_section, read_metadata_section,
+                       read_breadcrumbs_section_v14);
+}
+
+static bool read_v13(bsg_event_section *file, bugsnag_event *event) {
+  return read_sections(file, event, read_error_section_v13,
+                       read_metadata_section, read_breadcrumbs_section_v14);
+}
+
+static bool read_v15(bsg_event_section *file, bugsnag_event *event) {
+  return read_sections(file, event, read_error_section_v13,
+                       read_metadata_section, read_breadcrumbs_section);
+}
+
+/*
+ * Legacy migration
+ *
+ * Every older format is a dump of one of the structs in migrate.h. Rather than
+ * converting it one version at a time, each layout is described by a table of
+ * the fields it shares with bugsnag_event, which are copied straight from the
+ * mapped file into the event. Anything which cannot be copied field by field
+ * (legacy fields moved to metadata, breadcrumb rings of another size) is
+ * handled by a per-layout function afterwards.
+ */
+
+typedef enum {
+  /** Identical types, copied as they are */
+  BSG_FIELD_BYTES,
+  /** char arrays, which may differ in length */
+  BSG_FIELD_STRING,
+  /** Signed integers, which may differ in width */
+  BSG_FIELD_INTEGER,
+  /** bugsnag_metadata_v1, which is converted to bugsnag_metadata */
+  BSG_FIELD_METADATA,
+  /**
+   * bugsnag_breadcrumb_v2 rings, which are added to the breadcrumbs of the
+   * event using the crumb_count and crumb_first_index migrated before them
+   */
+  BSG_FIELD_BREADCRUMBS,
+  /**
+   * Fixed arrays of bsg_thread, which are copied into the threads reserved for
+   * the event using the thread_count migrated before them
+   */
+  BSG_FIELD_THREADS,
+} bsg_field_kind;
+
+typedef struct {
+  bsg_field_kind kind;
+  size_t event_offset;
+  size_t event_size;
+  size_t report_offset;
+  size_t report_size;
+} bsg_field_mapping;
+
+typedef struct {
+  size_t report_size;
+  const bsg_field_mapping *fields;
+  size_t field_count;
+  /** Migrates anything not covered by fields, may be NULL */
+  void (*migrate)(const void *report, bugsnag_event *event);
+  /** Whether the feature flags are appended to the file after the struct */
+  bool has_feature_flags;
+} bsg_legacy_layout;
+
+#define BSG_FIELD_SIZE(layout, field) sizeof(((layout *)0)->field)
+#define BSG_FIELD(kind, layout, report_field, event_field)                     \
+  {                                                                            \
+    kind, offsetof(bugsnag_event, event_field),                                \
+        BSG_FIELD_SIZE(bugsnag_event, event_field),                            \
+        offsetof(layout, report_field), BSG_FIELD_SIZE(layout, report_field)   \
+  }
+#define BSG_BYTES(layout, field)                                               \
+  BSG_FIELD(BSG_FIELD_BYTES, layout, field, field)
+#define BSG_STRING(layout, field)                                              \
+  BSG_FIELD(BSG_FIELD_STRING, layout, field, field)
+#define BSG_INTEGER(layout, field)                                             \
+  BSG_FIELD(BSG_FIELD_INTEGER, layout, field, field)
+#define BSG_METADATA(layout, field)                                            \
+  BSG_FIELD(BSG_FIELD_METADATA, layout, field, field)
+#define BSG_BREADCRUMBS(layout, field)                                         \
+  BSG_FIELD(BSG_FIELD_BREADCRUMBS, layout, field, crumb_ring)
+#define BSG_THREADS(layout, field)                                             \
+  BSG_FIELD(BSG_FIELD_THREADS, layout, field, threads)
+
+#define BSG_APP_V2_FIELDS(layout)                                              \
+  BSG_STRING(layout, app.id),                                                  \
+      BSG_STRING(layout, app.release_stage),                                   \
+      BSG_STRING(layout, app.type),                                            \
+      BSG_STRING(layout, app.version),                                         \
+      BSG_STRING(layout, app.active_screen),                                   \
+      BSG_STRING(layout, app.build_uuid),                                      \
+      BSG_STRING(layout, app.binary_arch),                                     \
+      BSG_INTEGER(layout, app.version_code),                                   \
+      BSG_INTEGER(layout, app.duration),                                       \
+      BSG_INTEGER(layout, app.duration_in_foreground),                         \
+      BSG_INTEGER(layout, app.duration_ms_offset),                             \
+      BSG_INTEGER(layout, app.duration_in_foreground_ms_offset),               \
+      BSG_BYTES(layout, app.in_foreground)
+
+#define BSG_APP_V1_FIELDS(layout)                                              \
+  BSG_STRING(layout, app.id),                                                  \
+      BSG_STRING(layout, app.release_stage),                                   \
+      BSG_STRING(layout, app.type),                                            \
+      BSG_STRING(layout, app.version),                                         \
+      BSG_STRING(layout, app.active_screen),                                   \
+      BSG_STRING(layout, app.build_uuid),                                      \
+      BSG_FIELD(BSG_FIELD_STRING, layout, app.binaryArch, app.binary_arch),    \
+      BSG_INTEGER(layout, app.version_code),                                   \
+      BSG_INTEGER(layout, app.duration),                                       \
+      BSG_INTEGER(layout, app.duration_in_foreground),                         \
+      BSG_INTEGER(layout, app.duration_ms_offset),                             \
+      BSG_INTEGER(layout, app.duration_in_foreground_ms_offset),               \
+      BSG_BYTES(layout, app.in_foreground)
+
+#define BSG_APP_V3_FIELDS(layout)                                              \
+  BSG_APP_V2_FIELDS(layout),                                                   \
+      BSG_BYTES(layout, app.is_launching)
+
+#define BSG_DEVICE_V1_FIELDS(layout)                                           \
+  BSG_INTEGER(layout, device.api_level),                                       \
+      BSG_INTEGER(layout, device.cpu_abi_count),                               \
+      BSG_BYTES(layout, device.cpu_abi),                                       \
+      BSG_STRING(layout, device.orientation),                                  \
+      BSG_INTEGER(layout, device.time),                                        \
+      BSG_STRING(layout, device.id),                                           \
+      BSG_BYTES(layout, device.jailbroken),                                    \
+      BSG_STRING(layout, device.locale),                                       \
+      BSG_STRING(layout, device.manufacturer),                                 \
+      BSG_STRING(layout, device.model),                                        \
+      BSG_STRING(layout, device.os_build),                                     \
+      BSG_STRING(layout, device.os_version),                                   \
+      BSG_INTEGER(layout, device.total_memory)
+
+#define BSG_DEVICE_V2_FIELDS(layout)                                           \
+  BSG_DEVICE_V1_FIELDS(layout),                                                \
+      BSG_STRING(layout, device.os_name)
+
+#define BSG_EXCEPTION_FIELDS(layout)                                           \
+  BSG_FIELD(BSG_FIELD_STRING, layout, exception.name, error.errorClass),       \
+      BSG_FIELD(BSG_FIELD_STRING,                                              \
+                layout, exception.message, error.errorMessage),                \
+      BSG_FIELD(BSG_FIELD_STRING, layout, exception.type, error.type),         \
+      BSG_FIELD(BSG_FIELD_INTEGER,                                             \
+                layout, exception.frame_count, error.frame_count),             \
+      BSG_FIELD(BSG_FIELD_BYTES,                                               \
+                layout, exception.stacktrace, error.stacktrace)
+
+#define BSG_ERROR_FIELDS(layout)                                               \
+  BSG_STRING(layout, error.errorClass),                                        \
+      BSG_STRING(layout, error.errorMessage),                                  \
+      BSG_STRING(layout, error.type),                                          \
+      BSG_INTEGER(layout, error.frame_count),                                  \
+      BSG_BYTES(layout, error.stacktrace)
+
+#define BSG_CRUMB_FIELDS(layout)                                               \
+  BSG_INTEGER(layout, crumb_count),                                            \
+      BSG_INTEGER(layout, crumb_first_index),                                  \
+      BSG_BREADCRUMBS(layout, breadcrumbs)
+
+#define BSG_SESSION_FIELDS(layout)                                             \
+  BSG_STRING(layout, context),                                                 \
+      BSG_BYTES(layout, severity),                                             \
+      BSG_STRING(layout, session_id),                                          \
+      BSG_STRING(layout, session_start),                                       \
+      BSG_INTEGER(layout, handled_events)
+
+#define BSG_EVENT_FIELDS(layout)                                               \
+  BSG_BYTES(layout, notifier),                                                 \
+      BSG_BYTES(layout, user),                                                 \
+      BSG_ERROR_FIELDS(layout),                                                \
+      BSG_METADATA(layout, metadata),                                          \
+      BSG_SESSION_FIELDS(layout),                                              \
+      BSG_INTEGER(layout, unhandled_events),                                   \
+      BSG_STRING(layout, grouping_hash),                                       \
+      BSG_BYTES(layout, unhandled)
+
+static const bsg_field_mapping report_v1_fields[] = {
+    BSG_BYTES(bugsnag_report_v1, notifier),
+    BSG_APP_V1_FIELDS(bugsnag_report_v1),
+    BSG_DEVICE_V1_FIELDS(bugsnag_report_v1),
+    BSG_BYTES(bugsnag_report_v1, user),
+    BSG_EXCEPTION_FIELDS(bugsnag_report_v1),
+    BSG_METADATA(bugsnag_report_v1, metadata),
+    BSG_SESSION_FIELDS(bugsnag_report_v1),
+};
+
+static const bsg_field_mapping report_v2_fields[] = {
+    BSG_BYTES(bugsnag_report_v2, notifier),
+    BSG_APP_V1_FIELDS(bugsnag_report_v2),
+    BSG_DEVICE_V1_FIELDS(bugsnag_report_v2),
+    BSG_BYTES(bugsnag_report_v2, user),
+    BSG_EXCEPTION_FIELDS(bugsnag_report_v2),
+    BSG_METADATA(bugsnag_report_v2, metadata),
+    BSG_SESSION_FIELDS(bugsnag_report_v2),
+    BSG_INTEGER(bugsnag_report_v2, unhandled_events),
+};
+
+static const bsg_field_mapping report_v3_fields[] = {
+    BSG_APP_V2_FIELDS(bugsnag_report_v3),
+    BSG_DEVICE_V2_FIELDS(bugsnag_report_v3),
+    BSG_CRUMB_FIELDS(bugsnag_report_v3),
+    BSG_EVENT_FIELDS(bugsnag_report_v3),
+};
+
+static const bsg_field_mapping report_v4_fields[] = {
+    BSG_APP_V2_FIELDS(bugsnag_report_v4),
+    BSG_DEVICE_V2_FIELDS(bugsnag_report_v4),
+    BSG_CRUMB_FIELDS(bugsnag_report_v4),
+    BSG_EVENT_FIELDS(bugsnag_report_v4),
+    BSG_STRING(bugsnag_report_v4, api_key),
+};
+
+static const bsg_field_mapping report_v5_fields[] = {
+    BSG_APP_V3_FIELDS(bugsnag_report_v5),
+    BSG_DEVICE_V2_FIELDS(bugsnag_report_v5),
+    BSG_EVENT_FIELDS(bugsnag_report_v5),
+    BSG_STRING(bugsnag_report_v5, api_key),
+};
+
+static const bsg_field_mapping report_v6_fields[] = {
+    BSG_APP_V3_FIELDS(bugsnag_report_v6),
+    BSG_DEVICE_V2_FIELDS(bugsnag_report_v6),
+    BSG_CRUMB_FIELDS(bugsnag_report_v6),
+    BSG_EVENT_FIELDS(bugsnag_report_v6),
+    BSG_STRING(bugsnag_report_v6, api_key),
+};
+
+static const bsg_field_mapping report_v7_fields[] = {
+    BSG_APP_V3_FIELDS(bugsnag_report_v7),
+    BSG_DEVICE_V2_FIELDS(bugsnag_report_v7),
+    BSG_CRUMB_FIELDS(bugsnag_report_v7),
+    BSG_EVENT_FIELDS(bugsnag_report_v7),
+    BSG_STRING(bugsnag_report_v7, api_key),
+    BSG_INTEGER(bugsnag_report_v7, thread_count),
+    BSG_THREADS(bugsnag_report_v7, threads),
+};
+
+static const bsg_field_mapping report_v8_fields[] = {
+    BSG_BYTES(bugsnag_report_v8, app),
+    BSG_BYTES(bugsnag_report_v8, device),
+    BSG_CRUMB_FIELDS(bugsnag_report_v8),
+    BSG_EVENT_FIELDS(bugsnag_report_v8),
+    BSG_STRING(bugsnag_report_v8, api_key),
+    BSG_INTEGER(bugsnag_report_v8, thread_count),
+    BSG_THREADS(bugsnag_report_v8, threads),
+};
+
+static const bsg_field_mapping app_v2_fields[] = {
+    BSG_APP_V2_FIELDS(bugsnag_report_v4),
+};
+
+static int64_t read_integer(const char *src, size_t size) {
+  switch (size) {
+  case sizeof(int8_t): {
+    int8_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+  }
+  case sizeof(int16_t): {
+    int16_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+  }
+  case sizeof(int32_t): {
+    int32_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+  }
+  default: {
+    int64_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
   }
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
-
-  if (event != NULL) {
-    event->notifier = report_v6->notifier;
-    event->metadata = report_v6->metadata;
-    migrate_app_v3(&event->app, &report_v6->app);
-    migrate_device_v2(&event->device, &report_v6->device);
-    event->user = report_v6->user;
-    event->error = report_v6->error;
-    event->crumb_count = report_v6->crumb_count;
-    event->crumb_first_index = report_v6->crumb_first_index;
-    memcpy(&event->breadcrumbs, report_v6->breadcrumbs,
-           sizeof(report_v6->breadcrumbs));
-    memcpy(&event->context, report_v6->context, sizeof(report_v6->context));
-    event->severity = report_v6->severity;
-    memcpy(&event->session_id, report_v6->session_id,
-           sizeof(report_v6->session_id));
-    memcpy(&event->session_start, report_v6->session_start,
-           sizeof(report_v6->session_start));
-    event->handled_events = report_v6->handled_events;
-    event->unhandled_events = report_v6->unhandled_events;
-    memcpy(&event->grouping_hash, report_v6->grouping_hash,
-           sizeof(report_v6->grouping_hash));
-    event->unhandled = report_v6->unhandled;
-    memcpy(&event->api_key, report_v6->api_key, sizeof(report_v6->api_key));
-
-    free(report_v6);
   }
-  return event;
 }
 
-bugsnag_event *bsg_map_v7_to_report(bugsnag_report_v7 *report_v7) {
-  if (report_v7 == NULL) {
-    return NULL;
+static void write_integer(char *dst, size_t size, int64_t value) {
+  switch (size) {
+  case sizeof(int8_t): {
+    int8_t narrow = (int8_t)value;
+    memcpy(dst, &narrow, sizeof(narrow));
+    break;
   }
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
-
-  if (event != NULL) {
-    event->notifier = report_v7->notifier;
-    event->metadata = report_v7->metadata;
-    migrate_app_v3(&event->app, &report_v7->app);
-    migrate_device_v2(&event->device, &report_v7->device);
-    event->user = report_v7->user;
-    event->error = report_v7->error;
-    event->crumb_count = report_v7->crumb_count;
-    event->crumb_first_index = report_v7->crumb_first_index;
-    memcpy(&event->breadcrumbs, report_v7->breadcrumbs,
-           sizeof(report_v7->breadcrumbs));
-    memcpy(&event->context, report_v7->context, sizeof(report_v7->context));
-    event->severity = report_v7->severity;
-    memcpy(&event->session_id, report_v7->session_id,
-           sizeof(report_v7->session_id));
-    memcpy(&event->session_start, report_v7->session_start,
-           sizeof(report_v7->session_start));
-    event->handled_events = report_v7->handled_events;
-    event->unhandled_events = report_v7->unhandled_events;
-    memcpy(&event->grouping_hash, report_v7->grouping_hash,
-           sizeof(report_v7->grouping_hash));
-    event->unhandled = report_v7->unhandled;
-    memcpy(&event->api_key, report_v7->api_key, sizeof(report_v7->api_key));
-    event->thread_count = report_v7->thread_count;
-    memcpy(&event->threads, report_v7->threads, sizeof(report_v7->threads));
-
-    free(report_v7);
+  case sizeof(int16_t): {
+    int16_t narrow = (int16_t)value;
+    memcpy(dst, &narrow, sizeof(narrow));
+    break;
+  }
+  case sizeof(int32_t): {
+    int32_t narrow = (int32_t)value;
+    memcpy(dst, &narrow, sizeof(narrow));
+    break;
+  }
+  default:
+    memcpy(dst, &value, sizeof(value));
+    break;
   }
-  return event;
 }
 
-bugsnag_event *bsg_map_v5_to_report(bugsnag_report_v5 *report_v5) {
-  if (report_v5 == NULL) {
-    return NULL;
+static void add_metadata_string(bugsnag_metadata *meta, const char *section,
+                                const char *name, const char *value,
+                                size_t value_size) {
+  char char_value[sizeof(((bsg_metadata_value *)0)->char_value)];
+  size_t length = strnlen(value, value_size);
+  if (length >= sizeof(char_value)) {
+    length = sizeof(char_value) - 1;
   }
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
-
-  if (event != NULL) {
-    event->notifier = report_v5->notifier;
-    event->metadata = report_v5->metadata;
-    migrate_app_v3(&event->app, &report_v5->app);
-    migrate_device_v2(&event->device, &report_v5->device);
-    bsg_strcpy(event->context, report_v5->context);
-    event->user = report_v5->user;
-    event->error = report_v5->error;
-    event->severity = report_v5->severity;
-    bsg_strncpy(event->session_id, report_v5->session_id,
-                sizeof(report_v5->session_id));
-    bsg_strncpy(event->session_start, report_v5->session_start,
-                sizeof(report_v5->session_start));
-    event->handled_events = report_v5->handled_events;
-    event->unhandled_events = report_v5->unhandled_events;
-    bsg_strncpy(event->grouping_hash, report_v5->grouping_hash,
-                sizeof(report_v5->grouping_hash));
-    event->unhandled = report_v5->unhandled;
-    bsg_strncpy(event->api_key, report_v5->api_key, sizeof(report_v5->api_key));
-
-    migrate_breadcrumb_v2(report_v5, event);
-    free(report_v5);
+  memcpy(char_value, value, length);
+  char_value[length] = '\0';
+  bsg_add_metadata_value_str(meta, NULL, section, name, char_value);
+}
+
+static void add_metadata_double(bugsnag_metadata *meta, const char *section,
+                                const char *name, double value) {
+  bsg_add_metadata_value_double(meta, NULL, section, name, value);
+}
+
+static void add_metadata_bool(bugsnag_metadata *meta, const char *section,
+                              const char *name, bool value) {
+  bsg_add_metadata_value_bool(meta, NULL, section, name, value);
+}
+
+/**
+ * Copies a string from a legacy report, where it may fill the whole array
+ * without a terminator. dst must be one byte longer than src.
+ */
+static void copy_legacy_string(char *dst, const char *src, size_t src_size) {
+  size_t length = strnlen(src, src_size);
+  memcpy(dst, src, length);
+  dst[length] = '\0';
+}
+
+static void migrate_metadata_value_v1(const bsg_metadata_value_v1 *value,
+                                      bugsnag_metadata *metadata) {
+  char section[sizeof(value->section) + 1];
+  char name[sizeof(value->name) + 1];
+  copy_legacy_string(section, value->section, sizeof(value->section));
+  copy_legacy_string(name, value->name, sizeof(value->name));
+
+  switch (value->type) {
+  case BSG_METADATA_CHAR_VALUE:
+    add_metadata_string(metadata, section, name, value->char_value,
+                        sizeof(value->char_value));
+    break;
+  case BSG_METADATA_NUMBER_VALUE:
+    add_metadata_double(metadata, section, name, value->double_value);
+    break;
+  case BSG_METADATA_BOOL_VALUE:
+    add_metadata_bool(metadata, section, name, value->bool_value);
+    break;
+  default:
+    // cleared values are dropped
+    break;
   }
-  return event;
 }
 
-bugsnag_event *bsg_map_v4_to_report(bugsnag_report_v4 *report_v4) {
-  if (report_v4 == NULL) {
-    return NULL;
+static void migrate_metadata_v1(const bugsnag_metadata_v1 *src,
+                                bugsnag_metadata *dst) {
+  int value_count = src->value_count;
+  if (value_count < 0) {
+    value_count = 0;
+  } else if (value_count > V1_BUGSNAG_METADATA_MAX) {
+    value_count = V1_BUGSNAG_METADATA_MAX;
   }
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
-
-  if (event != NULL) {
-    event->notifier = report_v4->notifier;
-    event->metadata = report_v4->metadata;
-    migrate_device_v2(&event->device, &report_v4->device);
-    event->user = report_v4->user;
-    event->error = report_v4->error;
-    event->crumb_count = report_v4->crumb_count;
-    event->crumb_first_index = report_v4->crumb_first_index;
-    memcpy(event->breadcrumbs, report_v4->breadcrumbs,
-           sizeof(report_v4->breadcrumbs));
-    event->severity = report_v4->severity;
-    bsg_strncpy(event->context, report_v4->context, sizeof(report_v4->context));
-    bsg_strncpy(event->session_id, report_v4->session_id,
-                sizeof(report_v4->session_id));
-    bsg_strncpy(event->session_start, report_v4->session_start,
-                sizeof(report_v4->session_start));
-    event->handled_events = report_v4->handled_events;
-    event->unhandled_events = report_v4->unhandled_events;
-    bsg_strncpy(event->grouping_hash, report_v4->grouping_hash,
-                sizeof(report_v4->grouping_hash));
-    event->unhandled = report_v4->unhandled;
-    bsg_strncpy(event->api_key, report_v4->api_key, sizeof(report_v4->api_key));
-    migrate_app_v2(report_v4, event);
-    free(report_v4);
+  for (int i = 0; i < value_count; i++) {
+    migrate_metadata_value_v1(&src->values[i], dst);
   }
-  return event;
 }
 
-bugsnag_event *bsg_map_v3_to_report(bugsnag_report_v3 *report_v3) {
-  if (report_v3 == NULL) {
-    return NULL;
+static void migrate_crumb_v2(const bugsnag_breadcrumb_v2 *src,
+                             bugsnag_breadcrumb *dst) {
+  memcpy(dst->name, src->name, sizeof(dst->name));
+  char timestamp[sizeof(src->timestamp) + 1];
+  bsg_strncpy(timestamp, src->timestamp, sizeof(timestamp));
+  dst->timestamp_ms = bsg_crumb_timestamp_parse(timestamp);
+  dst->type = src->type;
+  migrate_metadata_v1(&src->metadata, &dst->metadata);
+}
+
+/**
+ * Add the breadcrumbs from a legacy ring of bugsnag_breadcrumb_v2, oldest
+ * first
+ */
+static void migrate_crumb_ring_v2(const bugsnag_breadcrumb_v2 *crumbs,
+                                  int capacity, int crumb_count,
+                                  int crumb_first_index, bugsnag_event *event) {
+  bugsnag_event_clear_breadcrumbs(event);
+  if (crumb_count < 0 || crumb_count > capacity) {
+    return;
   }
-  bugsnag_report_v4 *event = calloc(1, sizeof(bugsnag_event));
-
-  if (event != NULL) {
-    event->notifier = report_v3->notifier;
-    event->app = report_v3->app;
-    event->device = report_v3->device;
-    event->user = report_v3->user;
-    event->error = report_v3->error;
-    event->metadata = report_v3->metadata;
-    event->crumb_count = report_v3->crumb_count;
-    event->crumb_first_index = report_v3->crumb_first_index;
-    memcpy(event->breadcrumbs, report_v3->breadcrumbs,
-           sizeof(report_v3->breadcrumbs));
-    event->severity = report_v3->severity;
-    strcpy(event->session_id, report_v3->session_id);
-    strcpy(event->session_start, report_v3->session_start);
-    event->handled_events = report_v3->handled_events;
-    event->unhandled_events = report_v3->unhandled_events;
-    strcpy(event->grouping_hash, report_v3->grouping_hash);
-    event->unhandled = report_v3->unhandled;
-
-    // set a default value for the api key
-    strcpy(event->api_key, "");
-    free(report_v3);
-  }
-  return bsg_map_v4_to_report(event);
-}
-
-bugsnag_event *bsg_map_v2_to_report(bugsnag_report_v2 *report_v2) {
-  if (report_v2 == NULL) {
-    return NULL;
+  bugsnag_breadcrumb *crumb = malloc(sizeof(bugsnag_breadcrumb));
+  if (crumb == NULL) {
+    return;
   }
-  bugsnag_report_v3 *event = calloc(1, sizeof(bugsnag_report_v3));
-
-  if (event != NULL) {
-    // assign metadata first as old app/device fields are migrated there
-    event->metadata = report_v2->metadata;
-    migrate_app_v1(report_v2, event);
-    migrate_device_v1(report_v2, event);
-    event->user = report_v2->user;
-    migrate_breadcrumb_v1(report_v2, event);
-
-    strcpy(event->context, report_v2->context);
-    event->severity = report_v2->severity;
-    strcpy(event->session_id, report_v2->session_id);
-    strcpy(event->session_start, report_v2->session_start);
-    event->handled_events = report_v2->handled_events;
-    event->unhandled_events = report_v2->unhandled_events;
-
-    // migrate changed notifier fields
-    strcpy(event->notifier.version, report_v2->notifier.version);
-    strcpy(event->notifier.name, report_v2->notifier.name);
-    strcpy(event->notifier.url, report_v2->notifier.url);
-
-    // migrate changed error fields
-    strcpy(event->error.errorClass, report_v2->exception.name);
-    strcpy(event->error.errorMessage, report_v2->exception.message);
-    strcpy(event->error.type, report_v2->exception.type);
-    event->error.frame_count = report_v2->exception.frame_count;
-    size_t error_size = sizeof(bugsnag_stackframe) * BUGSNAG_FRAMES_MAX;
-    memcpy(&event->error.stacktrace, report_v2->exception.stacktrace,
-           error_size);
-
-    // Fatal C errors are always true by default, previously this was hardcoded
-    // and not a field on the struct
-    event->unhandled = true;
-    free(report_v2);
-  }
-  return bsg_map_v3_to_report(event);
-}
-
-static void add_metadata_string(bugsnag_metadata *meta, char *section,
-                                char *name, char *value) {
-  if (meta->value_count < BUGSNAG_METADATA_MAX) {
-    bsg_metadata_value *item = &meta->values[meta->value_count];
-    strncpy(item->section, section, sizeof(item->section));
-    strncpy(item->name, name, sizeof(item->name));
-    strncpy(item->char_value, value, sizeof(item->char_value));
-    item->type = BSG_METADATA_CHAR_VALUE;
-    meta->value_count++;
-  }
-}
-
-static void add_metadata_double(bugsnag_metadata *meta, char *section,
-                                char *name, double value) {
-  if (meta->value_count < BUGSNAG_METADATA_MAX) {
-    bsg_metadata_value *item = &meta->values[meta->value_count];
-    strncpy(item->section, section, sizeof(item->section));
-    strncpy(item->name, name, sizeof(item->name));
-    item->type = BSG_METADATA_NUMBER_VALUE;
-    item->double_value = value;
-    meta->value_count++;
-  }
-}
-
-static void add_metadata_bool(bugsnag_metadata *meta, char *section, char *name,
-                              bool value) {
-  if (meta->value_count < BUGSNAG_METADATA_MAX) {
-    bsg_metadata_value *item = &meta->values[meta->value_count];
-    strncpy(item->section, section, sizeof(item->section));
-    strncpy(item->name, name, sizeof(item->name));
-    item->type = BSG_METADATA_BOOL_VALUE;
-    item->bool_value = value;
-    meta->value_count++;
-  }
-}
-
-void migrate_device_v1(bugsnag_report_v2 *report_v2, bugsnag_report_v3 *event) {
+
+  // rationalize order of breadcrumbs while copying over to new struct
+  for (int i = 0; i < crumb_count; i++) {
+    int old_index = (i + crumb_first_index) % capacity;
+    if (old_index < 0) {
+      old_index += capacity;
+    }
+    memset(crumb, 0, sizeof(bugsnag_breadcrumb));
+    migrate_crumb_v2(&crumbs[old_index], crumb);
+    bugsnag_event_add_breadcrumb(event, crumb);
+  }
+  free(crumb);
+}
+
+static void migrate_threads(const bsg_thread *threads, int capacity,
+                            bugsnag_event *event) {
+  const int thread_count = event->thread_count;
+  if (thread_count <= 0 || thread_count > capacity ||
+      !bsg_event_reserve_threads(event, thread_count)) {
+    event->thread_count = 0;
+    return;
+  }
+  memcpy(event->threads, threads, thread_count * sizeof(bsg_thread));
+  event->thread_count = thread_count;
+}
+
+static void migrate_fields(const bsg_field_mapping *fields, size_t field_count,
+                           const void *report, bugsnag_event *event) {
+  for (size_t i = 0; i < field_count; i++) {
+    const bsg_field_mapping *field = &fields[i];
+    const char *src = (const char *)report + field->report_offset;
+    char *dst = (char *)event + field->event_offset;
+
+    switch (field->kind) {
+    case BSG_FIELD_BYTES:
+      memcpy(dst, src,
+             field->report_size < field->event_size ? field->report_size
+                                                    : field->event_size);
+      break;
+    case BSG_FIELD_STRING: {
+      size_t length = strnlen(src, field->report_size);
+      if (length >= field->event_size) {
+        length = field->event_size - 1;
+      }
+      memcpy(dst, src, length);
+      dst[length] = '\0';
+      break;
+    }
+    case BSG_FIELD_INTEGER:
+      write_integer(dst, field->event_size,
+                    read_integer(src, field->report_size));
+      break;
+    case BSG_FIELD_METADATA:
+      migrate_metadata_v1((const bugsnag_metadata_v1 *)src,
+                          (bugsnag_metadata *)dst);
+      break;
+    case BSG_FIELD_BREADCRUMBS:
+      migrate_crumb_ring_v2(
+          (const bugsnag_breadcrumb_v2 *)src,
+          (int)(field->report_size / sizeof(bugsnag_breadcrumb_v2)),
+          event->crumb_count, event->crumb_first_index, event);
+      break;
+    case BSG_FIELD_THREADS:
+      migrate_threads((const bsg_thread *)src,
+                      (int)(field->report_size / sizeof(bsg_thread)), event);
+      break;
+    }
+  }
+}
+
+#define BSG_ADD_METADATA_STRING(meta, section, name, value)                    \
+  add_metadata_string(meta, section, name, value, sizeof(value))
+
+static void migrate_app_metadata_v1(const bsg_app_info_v1 *app,
+                                    bugsnag_event *event) {
+  // migrate legacy fields to metadata
+  BSG_ADD_METADATA_STRING(&event->metadata, "app", "packageName",
+                          app->package_name);
+  BSG_ADD_METADATA_STRING(&event->metadata, "app", "versionName",
+                          app->version_name);
+  BSG_ADD_METADATA_STRING(&event->metadata, "app", "name", app->name);
+}
+
+static void migrate_device_metadata_v1(const bsg_device_info_v1 *device,
+                                       bugsnag_event *event) {
   bsg_strcpy(event->device.os_name,
              "android"); // os_name was not a field in v2
-  event->device.api_level = report_v2->device.api_level;
-  event->device.cpu_abi_count = report_v2->device.cpu_abi_count;
-  event->device.time = report_v2->device.time;
-  event->device.jailbroken = report_v2->device.jailbroken;
-  event->device.total_memory = report_v2->device.total_memory;
-
-  for (int k = 0; k < report_v2->device.cpu_abi_count &&
-                  k < sizeof(report_v2->device.cpu_abi);
-       k++) {
-    bsg_strcpy(event->device.cpu_abi[k].value,
-               report_v2->device.cpu_abi[k].value);
-    event->device.cpu_abi_count++;
-  }
-
-  bsg_strcpy(event->device.orientation, report_v2->device.orientation);
-  bsg_strcpy(event->device.id, report_v2->device.id);
-  bsg_strcpy(event->device.locale, report_v2->device.locale);
-  bsg_strcpy(event->device.manufacturer, report_v2->device.manufacturer);
-  bsg_strcpy(event->device.model, report_v2->device.model);
-  bsg_strcpy(event->device.os_build, report_v2->device.os_build);
-  bsg_strcpy(event->device.os_version, report_v2->device.os_version);
 
   // migrate legacy fields to metadata
-  add_metadata_bool(&event->metadata, "device", "emulator",
-                    report_v2->device.emulator);
-  add_metadata_double(&event->metadata, "device", "dpi", report_v2->device.dpi);
+  add_metadata_bool(&event->metadata, "device", "emulator", device->emulator);
+  add_metadata_double(&event->metadata, "device", "dpi", device->dpi);
   add_metadata_double(&event->metadata, "device", "screenDensity",
-                      report_v2->device.screen_density);
+                      device->screen_density);
   add_metadata_double(&event->metadata, "device", "batteryLevel",
-                      report_v2->device.battery_level);
-  add_metadata_string(&event->metadata, "device", "locationStatus",
-                      report_v2->device.location_status);
-  add_metadata_string(&event->metadata, "device", "brand",
-                      report_v2->device.brand);
-  add_metadata_string(&event->metadata, "device", "networkAccess",
-                      report_v2->device.network_access);
-  add_metadata_string(&event->metadata, "device", "screenResolution",
-                      report_v2->device.screen_resolution);
-}
-
-void migrate_device_v2(bsg_device_info *output, bsg_device_info_v2 *input) {
-  output->api_level = input->api_level;
-  output->cpu_abi_count = input->cpu_abi_count;
-  memcpy(&output->cpu_abi, input->cpu_abi, sizeof(input->cpu_abi));
-  memcpy(&output->orientation, input->orientation, sizeof(input->orientation));
-  output->time = input->time;
-  memcpy(&output->id, input->id, sizeof(input->id));
-  output->jailbroken = input->jailbroken;
-  memcpy(&output->locale, input->locale, sizeof(input->locale));
-  memcpy(&output->manufacturer, input->manufacturer,
-         sizeof(input->manufacturer));
-  memcpy(&output->model, input->model, sizeof(input->model));
-  memcpy(&output->os_build, input->os_build, sizeof(input->os_build));
-  memcpy(&output->os_version, input->os_version, sizeof(input->os_version));
-  memcpy(&output->os_name, input->os_name, sizeof(input->os_name));
-  output->total_memory = input->total_memory;
-}
-
-void bugsnag_report_v3_add_breadcrumb(bugsnag_report_v3 *event,
-                                      bugsnag_breadcrumb *crumb) {
-  int crumb_index;
-  if (event->crumb_count < V2_BUGSNAG_CRUMBS_MAX) {
-    crumb_index = event->crumb_count;
-    event->crumb_count++;
-  } else {
-    crumb_index = event->crumb_first_index;
-    event->crumb_first_index =
-        (event->crumb_first_index + 1) % V2_BUGSNAG_CRUMBS_MAX;
-  }
-  memcpy(&event->breadcrumbs[crumb_index], crumb, sizeof(bugsnag_breadcrumb));
+                      device->battery_level);
+  BSG_ADD_METADATA_STRING(&event->metadata, "device", "locationStatus",
+                          device->location_status);
+  BSG_ADD_METADATA_STRING(&event->metadata, "device", "brand", device->brand);
+  BSG_ADD_METADATA_STRING(&event->metadata, "device", "networkAccess",
+                          device->network_access);
+  BSG_ADD_METADATA_STRING(&event->metadata, "device", "screenResolution",
+                          device->screen_resolution);
 }
 
 int bsg_calculate_total_crumbs(int old_count) {
@@ -546,220 +1205,231 @@ int bsg_calculate_v1_crumb_index(int crumb_pos, int first_index) {
   return (crumb_pos + first_index) % V1_BUGSNAG_CRUMBS_MAX;
 }
 
-void migrate_breadcrumb_v1(bugsnag_report_v2 *report_v2,
-                           bugsnag_report_v3 *event) {
-  event->crumb_count = 0;
-  event->crumb_first_index = 0;
+/**
+ * v1 and v2 breadcrumbs were kept in a ring of 30 with fixed-size string
+ * metadata. They are converted into a ring of V2_BUGSNAG_CRUMBS_MAX, as v3 did.
+ */
+static void migrate_breadcrumb_v1(const bugsnag_breadcrumb_v1 *breadcrumbs,
+                                  int crumb_count, int crumb_first_index,
+                                  bugsnag_event *event) {
+  bugsnag_breadcrumb *new_crumb = malloc(sizeof(bugsnag_breadcrumb));
+  if (new_crumb == NULL) {
+    return;
+  }
 
   // previously breadcrumbs had 30 elements, now they have 25.
   // if more than 25 breadcrumbs were collected in the legacy report,
   // offset them accordingly by moving the start position by count -
   // BUGSNAG_CRUMBS_MAX.
-  int new_crumb_total = bsg_calculate_total_crumbs(report_v2->crumb_count);
-  int k = bsg_calculate_v1_start_index(report_v2->crumb_count);
+  int new_crumb_total = bsg_calculate_total_crumbs(crumb_count);
+  int k = bsg_calculate_v1_start_index(crumb_count);
+  // only the most recent V2_BUGSNAG_CRUMBS_MAX were kept by v3
+  if (new_crumb_total - k > V2_BUGSNAG_CRUMBS_MAX) {
+    k = new_crumb_total - V2_BUGSNAG_CRUMBS_MAX;
+  }
 
   for (; k < new_crumb_total; k++) {
-    int crumb_index =
-        bsg_calculate_v1_crumb_index(k, report_v2->crumb_first_index);
-    bugsnag_breadcrumb_v1 *old_crumb = &report_v2->breadcrumbs[crumb_index];
-    bugsnag_breadcrumb *new_crumb = calloc(1, sizeof(bugsnag_breadcrumb));
+    int crumb_index = bsg_calculate_v1_crumb_index(k, crumb_first_index);
+    const bugsnag_breadcrumb_v1 *old_crumb = &breadcrumbs[crumb_index];
+    memset(new_crumb, 0, sizeof(bugsnag_breadcrumb));
 
     // copy old crumb fields to new
     new_crumb->type = old_crumb->type;
     bsg_strncpy(new_crumb->name, old_crumb->name, sizeof(new_crumb->name));
-    bsg_strncpy(new_crumb->timestamp, old_crumb->timestamp,
-                sizeof(new_crumb->timestamp));
+    char timestamp[sizeof(old_crumb->timestamp) + 1];
+    bsg_strncpy(timestamp, old_crumb->timestamp, sizeof(timestamp));
+    new_crumb->timestamp_ms = bsg_crumb_timestamp_parse(timestamp);
 
     for (int j = 0; j < 8; j++) {
-      bsg_char_metadata_pair pair = old_crumb->metadata[j];
-
-      if (strlen(pair.value) > 0 && strlen(pair.key) > 0) {
-        bsg_add_metadata_value_str(&new_crumb->metadata, "metaData", pair.key,
-                                   pair.value);
+      const bsg_char_metadata_pair *pair = &old_crumb->metadata[j];
+
+      if (strnlen(pair->value, sizeof(pair->value)) > 0 &&
+          strnlen(pair->key, sizeof(pair->key)) > 0) {
+        char key[sizeof(pair->key) + 1];
+        char value[sizeof(pair->value) + 1];
+        bsg_strncpy(key, pair->key, sizeof(key));
+        bsg_strncpy(value, pair->value, sizeof(value));
+        bsg_add_metadata_value_str(&new_crumb->metadata, NULL, "metaData",
+                                   key, value);
       }
     }
-
-    // add crumb to event by copying memory
-    bugsnag_report_v3_add_breadcrumb(event, new_crumb);
-    free(new_crumb);
+    bugsnag_event_add_breadcrumb(event, new_crumb);
   }
+  free(new_crumb);
 }
 
-void migrate_breadcrumb_v2(bugsnag_report_v5 *report_v5, bugsnag_event *event) {
-  int old_first_index = report_v5->crumb_first_index;
-  event->crumb_count = report_v5->crumb_count;
-  event->crumb_first_index = 0; // sort crumbs while copying across
+static void migrate_breadcrumb_v2(const bugsnag_report_v5 *report_v5,
+                                  bugsnag_event *event) {
+  migrate_crumb_ring_v2(report_v5->breadcrumbs, V2_BUGSNAG_CRUMBS_MAX,
+                        report_v5->crumb_count, report_v5->crumb_first_index,
+                        event);
+}
 
-  // rationalize order of breadcrumbs while copying over to new struct
-  for (int new_index = 0; new_index < event->crumb_count; new_index++) {
-    int old_index = (new_index + old_first_index) % V2_BUGSNAG_CRUMBS_MAX;
-    bugsnag_breadcrumb crumb = report_v5->breadcrumbs[old_index];
-    memcpy(&event->breadcrumbs[new_index], &crumb, sizeof(bugsnag_breadcrumb));
-  }
+static void migrate_report_v1(const void *report, bugsnag_event *event) {
+  const bugsnag_report_v1 *report_v1 = report;
+  migrate_app_metadata_v1(&report_v1->app, event);
+  migrate_device_metadata_v1(&report_v1->device, event);
+  migrate_breadcrumb_v1(report_v1->breadcrumbs, report_v1->crumb_count,
+                        report_v1->crumb_first_index, event);
+  event->unhandled_events = 1;
+
+  // Fatal C errors are always true by default, previously this was hardcoded
+  // and not a field on the struct
+  event->unhandled = true;
 }
 
-bugsnag_event *bsg_map_v1_to_report(bugsnag_report_v1 *report_v1) {
-  if (report_v1 == NULL) {
-    return NULL;
+static void migrate_report_v2(const void *report, bugsnag_event *event) {
+  const bugsnag_report_v2 *report_v2 = report;
+  // metadata was assigned first, as old app/device fields are migrated there
+  migrate_app_metadata_v1(&report_v2->app, event);
+  migrate_device_metadata_v1(&report_v2->device, event);
+  migrate_breadcrumb_v1(report_v2->breadcrumbs, report_v2->crumb_count,
+                        report_v2->crumb_first_index, event);
+
+  // Fatal C errors are always true by default, previously this was hardcoded
+  // and not a field on the struct
+  event->unhandled = true;
+}
+
+static void migrate_report_v5(const void *report, bugsnag_event *event) {
+  migrate_breadcrumb_v2(report, event);
+}
+
+#define BSG_LEGACY_LAYOUT(type, fields, migrate, has_feature_flags)            \
+  {                                                                            \
+    sizeof(type), fields, sizeof(fields) / sizeof(fields[0]), migrate,         \
+        has_feature_flags                                                      \
   }
-  size_t report_size = sizeof(bugsnag_report_v2);
-  bugsnag_report_v2 *event_v2 = calloc(1, report_size);
-
-  if (event_v2 != NULL) {
-    event_v2->notifier = report_v1->notifier;
-    event_v2->app = report_v1->app;
-    event_v2->device = report_v1->device;
-    event_v2->user = report_v1->user;
-    event_v2->exception = report_v1->exception;
-    event_v2->metadata = report_v1->metadata;
-    event_v2->crumb_count = report_v1->crumb_count;
-    event_v2->crumb_first_index = report_v1->crumb_first_index;
-
-    size_t breadcrumb_size =
-        sizeof(bugsnag_breadcrumb_v1) * V1_BUGSNAG_CRUMBS_MAX;
-    memcpy(&event_v2->breadcrumbs, report_v1->breadcrumbs, breadcrumb_size);
-
-    strcpy(event_v2->context, report_v1->context);
-    event_v2->severity = report_v1->severity;
-    strcpy(event_v2->session_id, report_v1->session_id);
-    strcpy(event_v2->session_start, report_v1->session_start);
-    event_v2->handled_events = report_v1->handled_events;
-    event_v2->unhandled_events = 1;
-
-    free(report_v1);
-  }
-  return bsg_map_v2_to_report(event_v2);
-}
-
-void migrate_app_v1(bugsnag_report_v2 *report_v2, bugsnag_report_v3 *event) {
-  bsg_strcpy(event->app.id, report_v2->app.id);
-  bsg_strcpy(event->app.release_stage, report_v2->app.release_stage);
-  bsg_strcpy(event->app.type, report_v2->app.type);
-  bsg_strcpy(event->app.version, report_v2->app.version);
-  bsg_strcpy(event->app.active_screen, report_v2->app.active_screen);
-  bsg_strcpy(event->app.build_uuid, report_v2->app.build_uuid);
-  bsg_strcpy(event->app.binary_arch, report_v2->app.binaryArch);
-  event->app.version_code = report_v2->app.version_code;
-  event->app.duration = report_v2->app.duration;
-  event->app.duration_in_foreground = report_v2->app.duration_in_foreground;
-  event->app.duration_ms_offset = report_v2->app.duration_ms_offset;
-  event->app.duration_in_foreground_ms_offset =
-      report_v2->app.duration_in_foreground_ms_offset;
-  event->app.in_foreground = report_v2->app.in_foreground;
 
-  // migrate legacy fields to metadata
-  add_metadata_string(&event->metadata, "app", "packageName",
-                      report_v2->app.package_name);
-  add_metadata_string(&event->metadata, "app", "versionName",
-                      report_v2->app.version_name);
-  add_metadata_string(&event->metadata, "app", "name", report_v2->app.name);
+/**
+ * Legacy layouts, indexed by the version in the report header. The api key
+ * (v1-v3), app.is_launching (v1-v4) and threads (v1-v6) were not recorded and
+ * are left zeroed.
+ */
+static const bsg_legacy_layout legacy_layouts[] = {
+    [1] = BSG_LEGACY_LAYOUT(bugsnag_report_v1, report_v1_fields,
+                            migrate_report_v1, false),
+    [2] = BSG_LEGACY_LAYOUT(bugsnag_report_v2, report_v2_fields,
+                            migrate_report_v2, false),
+    [3] = BSG_LEGACY_LAYOUT(bugsnag_report_v3, report_v3_fields, NULL, false),
+    [4] = BSG_LEGACY_LAYOUT(bugsnag_report_v4, report_v4_fields, NULL, false),
+    [5] = BSG_LEGACY_LAYOUT(bugsnag_report_v5, report_v5_fields,
+                            migrate_report_v5, false),
+    [6] = BSG_LEGACY_LAYOUT(bugsnag_report_v6, report_v6_fields, NULL, false),
+    [7] = BSG_LEGACY_LAYOUT(bugsnag_report_v7, report_v7_fields, NULL, false),
+    [8] = BSG_LEGACY_LAYOUT(bugsnag_report_v8, report_v8_fields, NULL, true),
+};
+
+static bool migrate_legacy(int version, bsg_event_section *file,
+                           bugsnag_event *event) {
+  if (version < 1 ||
+      version >= (int)(sizeof(legacy_layouts) / sizeof(legacy_layouts[0]))) {
+    return false;
+  }
+  const bsg_legacy_layout *layout = &legacy_layouts[version];
+
+  // the struct is used in place, straight from the mapped file
+  const void *report = section_view(file, layout->report_size);
+  if (report == NULL) {
+    return false;
+  }
+
+  migrate_fields(layout->fields, layout->field_count, report, event);
+  // legacy stacktraces may hold more frames than this build
+  if (event->error.frame_count < 0) {
+    event->error.frame_count = 0;
+  } else if (event->error.frame_count > BUGSNAG_FRAMES_MAX) {
+    event->error.frame_count = BUGSNAG_FRAMES_MAX;
+  }
+  if (layout->migrate != NULL) {
+    layout->migrate(report, event);
+  }
+  if (layout->has_feature_flags) {
+    // read the feature flags, if possible
+    read_feature_flags(file, &event->feature_flags, &event->feature_flag_count);
+  }
+  return true;
 }
 
 void migrate_app_v2(bugsnag_report_v4 *report_v4, bugsnag_event *event) {
-  bsg_strncpy(event->app.id, report_v4->app.id, sizeof(event->app.id));
-  bsg_strncpy(event->app.release_stage, report_v4->app.release_stage,
-              sizeof(event->app.release_stage));
-  bsg_strncpy(event->app.type, report_v4->app.type, sizeof(event->app.type));
-  bsg_strncpy(event->app.version, report_v4->app.version,
-              sizeof(event->app.version));
-  bsg_strncpy(event->app.active_screen, report_v4->app.active_screen,
-              sizeof(event->app.active_screen));
-  bsg_strncpy(event->app.build_uuid, report_v4->app.build_uuid,
-              sizeof(event->app.build_uuid));
-  bsg_strncpy(event->app.binary_arch, report_v4->app.binary_arch,
-              sizeof(event->app.binary_arch));
-  event->app.version_code = report_v4->app.version_code;
-  event->app.duration = report_v4->app.duration;
-  event->app.duration_in_foreground = report_v4->app.duration_in_foreground;
-  event->app.duration_ms_offset = report_v4->app.duration_ms_offset;
-  event->app.duration_in_foreground_ms_offset =
-      report_v4->app.duration_in_foreground_ms_offset;
-  event->app.in_foreground = report_v4->app.in_foreground;
+  size_t field_count = sizeof(app_v2_fields) / sizeof(app_v2_fields[0]);
+  migrate_fields(app_v2_fields, field_count, report_v4, event);
 
   // no info available, set to sensible default
   event->app.is_launching = false;
 }
 
-void migrate_app_v3(bsg_app_info *output, bsg_app_info_v3 *input) {
-  memcpy(&output->id, input->id, sizeof(input->id));
-  memcpy(&output->release_stage, input->release_stage,
-         sizeof(input->release_stage));
-  memcpy(&output->type, input->type, sizeof(input->type));
-  memcpy(&output->version, input->version, sizeof(input->version));
-  memcpy(&output->active_screen, input->active_screen,
-         sizeof(input->active_screen));
-  output->version_code = input->version_code;
-  memcpy(&output->build_uuid, input->build_uuid, sizeof(input->build_uuid));
-  output->duration = input->duration;
-  output->duration_in_foreground = input->duration_in_foreground;
-  output->duration_ms_offset = input->duration_ms_offset;
-  output->duration_in_foreground_ms_offset =
-      input->duration_in_foreground_ms_offset;
-  output->in_foreground = input->in_foreground;
-  output->is_launching = input->is_launching;
-  memcpy(&output->binary_arch, input->binary_arch, sizeof(input->binary_arch));
-}
-
-static char *read_string(int fd) {
-  ssize_t len;
+static char *read_string(bsg_event_section *section) {
   uint32_t string_length;
-  len = read(fd, &string_length, sizeof(string_length));
-
-  if (len != sizeof(string_length)) {
+  if (!section_read(section, &string_length, sizeof(string_length))) {
     return NULL;
   }
 
-  // allocate enough space, zero filler, and with a trailing '\0' terminator
-  char *string_buffer = calloc(1, (string_length + 1));
-  if (!string_buffer) {
+  const char *value = section_view(section, string_length);
+  if (value == NULL) {
     return NULL;
   }
 
-  len = read(fd, string_buffer, string_length);
-  if (len != string_length) {
-    free(string_buffer);
+  // allocate enough space with a trailing '\0' terminator
+  char *string_buffer = malloc(string_length + 1);
+  if (!string_buffer) {
     return NULL;
   }
+  memcpy(string_buffer, value, string_length);
+  string_buffer[string_length] = '\0';
 
   return string_buffer;
 }
 
-int read_byte(int fd) {
+static int read_byte(bsg_event_section *section) {
   char value;
-  if (read(fd, &value, 1) != 1) {
+  if (!section_read(section, &value, 1)) {
     return -1;
   }
 
   return value;
 }
 
-void bsg_read_feature_flags(int fd, bsg_feature_flag **out_feature_flags,
-                            size_t *out_feature_flag_count) {
-
-  ssize_t len;
+static bool read_feature_flags(bsg_event_section *section,
+                               bsg_feature_flag **out_feature_flags,
+                               size_t *out_feature_flag_count) {
+  bsg_feature_flag *flags = NULL;
   uint32_t feature_flag_count = 0;
-  len = read(fd, &feature_flag_count, sizeof(feature_flag_count));
-  if (len != sizeof(feature_flag_count)) {
+  if (!section_read(section, &feature_flag_count,
+                    sizeof(feature_flag_count))) {
     goto feature_flags_error;
   }
 
-  bsg_feature_flag *flags =
-      calloc(feature_flag_count, sizeof(bsg_feature_flag));
+  // each flag takes at least a name length and a variant marker, so a count
+  // beyond that is a corrupt file rather than a reason to allocate
+  size_t min_flag_size = sizeof(uint32_t) + 1;
+  if (feature_flag_count > (section->length - section->pos) / min_flag_size) {
+    feature_flag_count = 0;
+    goto feature_flags_error;
+  }
+
+  flags = calloc(feature_flag_count, sizeof(bsg_feature_flag));
+  if (flags == NULL && feature_flag_count > 0) {
+    feature_flag_count = 0;
+    goto feature_flags_error;
+  }
   for (uint32_t index = 0; index < feature_flag_count; index++) {
-    char *name = read_string(fd);
+    char *name = read_string(section);
     if (!name) {
       goto feature_flags_error;
     }
 
-    int variant_exists = read_byte(fd);
+    int variant_exists = read_byte(section);
     if (variant_exists < 0) {
+      free(name);
       goto feature_flags_error;
     }
 
     char *variant = NULL;
     if (variant_exists) {
-      variant = read_string(fd);
+      variant = read_string(section);
       if (!variant) {
+        free(name);
         goto feature_flags_error;
       }
     }
@@ -771,7 +1441,7 @@ void bsg_read_feature_flags(int fd, bsg_feature_flag **out_feature_flags,
   *out_feature_flag_count = feature_flag_count;
   *out_feature_flags = flags;
 
-  return;
+  return true;
 
 feature_flags_error:
   // something wrong - we release all allocated memory
@@ -790,4 +1460,5 @@ feature_flags_error:
   // clear the out fields to indicate no feature-flags are availables
   *out_feature_flag_count = 0;
   *out_feature_flags = NULL;
+  return false;
 }
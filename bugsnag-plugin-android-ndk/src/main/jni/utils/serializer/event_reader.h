@@ -16,3 +16,18 @@ extern const int BSG_MIGRATOR_CURRENT_VERSION;
  * @return An allocated event or NULL if no event could be read
  */
 bugsnag_event *bsg_read_event(char *filepath);
+
+/**
+ * Read an event from a file path into a caller-supplied event, converting from
+ * older formats if needed.
+ *
+ * The file is mapped rather than read, and older formats are migrated straight
+ * from the mapping, so the only allocations made are for the feature flags
+ * (which are then owned by the event).
+ *
+ * @param filepath  A full path to a file
+ * @param event     The event to populate, which is zeroed first
+ *
+ * @return true if the event was read, otherwise the event is left zeroed
+ */
+bool bsg_read_event_into(char *filepath, bugsnag_event *event);
@@ -1,47 +1,525 @@
 #include "event_writer.h"
 
 #include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include "../crash_info.h"
+#include "../health_counters.h"
 #include "../string.h"
 #include "buffered_writer.h"
+#include "section_checksum.h"
+#include "vectored_writer.h"
 
 bool bsg_write_feature_flags(bugsnag_event *event, bsg_buffered_writer *writer);
 
 bool bsg_report_header_write(bsg_report_header *header, int fd) {
-  ssize_t len = write(fd, header, sizeof(bsg_report_header));
+  // headers before version 12 end where the layout starts
+  const ssize_t size = header->version >= 12
+                           ? (ssize_t)sizeof(bsg_report_header)
+                           : (ssize_t)offsetof(bsg_report_header, layout);
+  ssize_t len = write(fd, header, size);
 
-  return len == sizeof(bsg_report_header);
+  return len == size;
 }
 
-bool bsg_event_write(bsg_environment *env) {
+/**
+ * The size of the pre-allocated region at the start of the crash file. This is
+ * large enough to hold any event with the threads reserved for it, other than
+ * its feature flags, which are appended after this region if they do not fit.
+ */
+static size_t mapped_event_size(const bugsnag_event *event) {
+  return sizeof(bsg_report_header) + sizeof(bugsnag_event) +
+         (size_t)event->thread_capacity * sizeof(bsg_thread);
+}
+
+bool bsg_event_write_prepare(bsg_environment *env) {
+  int fd =
+      open(env->next_event_path, O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+
+  const size_t mapping_size = mapped_event_size(&env->next_event);
+  if (ftruncate(fd, mapping_size) != 0) {
+    goto fail;
+  }
+
+  void *mapping =
+      mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    goto fail;
+  }
+
+  // fault in every page now rather than in the signal handler. The header is
+  // left zeroed (an invalid version) until a crash starts writing, so an
+  // unused file is discarded on the next launch. The header is written first,
+  // and a partly written file is kept only if its checksummed core and error
+  // sections were written in full.
+  memset(mapping, 0, mapping_size);
+
+  env->next_event_fd = fd;
+  env->next_event_mapping = mapping;
+  env->next_event_mapping_size = mapping_size;
+  return true;
+
+fail:
+  close(fd);
+  remove(env->next_event_path);
+  return false;
+}
+
+/*
+ * Version 11 events are written as a series of sections, each prefixed with its
+ * length as a uint32, and since version 14 also with the Adler-32 checksum of
+ * its payload, so that the sections written before a crash in the writer can
+ * still be read. Only the used portion of each fixed size array is written,
+ * preceded by a uint32 count:
+ *
+ * 1. core: notifier, app, device, user, context, severity, session and
+ *    grouping hash fields, unhandled flag, api key
+ * 2. error: class, message, type, frame count, then the frames split into
+ *    columns (since version 13, whole frames before): the frame address of
+ *    each frame, the line number of each frame, the module table (load
+ *    address + file name per entry) and the uint16 module index of each
+ *    frame, then the symbol table (symbol address + method per entry) and the
+ *    uint16 symbol index of each frame. Frames in the same module or function
+ *    share an entry, see index_frame_tables
+ * 3. metadata: value count + values, then the length of the names they refer
+ *    to + names
+ * 4. breadcrumbs: crumb count + crumb records (oldest first), each starting
+ *    with its length as a uint32, see bsg_event_add_breadcrumb_record
+ * 5. threads: thread count + threads, then whether the list was truncated
+ * 6. feature flags: see bsg_write_feature_flags
+ * 7. metadata arena: the length of the records in use + records
+ * 8. frame modules: module count + modules, then the module index of each
+ *    frame if there are any modules
+ * 9. handler timing: bsg_handler_timing, then the handler fallback flags
+ * 10. health counters: the uint8 counter count + counters
+ */
+
+/**
+ * Sizes and checksums a section without writing it anywhere
+ */
+typedef struct {
+  bsg_buffered_writer base;
+  uint32_t checksum;
+} bsg_counting_writer;
+
+static bool bsg_count_write(bsg_buffered_writer *writer, const void *data,
+                            size_t length) {
+  bsg_counting_writer *counter = (bsg_counting_writer *)writer;
+  counter->checksum = bsg_section_checksum(counter->checksum, data, length);
+  writer->pos += length;
+  return true;
+}
+
+static bool bsg_count_write_byte(bsg_buffered_writer *writer,
+                                 const uint8_t byte) {
+  return bsg_count_write(writer, &byte, 1);
+}
+
+static bool bsg_count_write_string(bsg_buffered_writer *writer,
+                                   const char *string) {
+  // the same bytes as the real writers, the length and then the characters
+  const uint32_t length = bsg_strlen(string);
+  return bsg_count_write(writer, &length, sizeof(length)) &&
+         bsg_count_write(writer, string, length);
+}
+
+static bool write_count(bsg_buffered_writer *writer, int count) {
+  const uint32_t value = count;
+  return writer->write(writer, &value, sizeof(value));
+}
+
+static int clamp_count(int count, int max) {
+  return count < 0 ? 0 : (count > max ? max : count);
+}
+
+static bool write_metadata(bsg_buffered_writer *writer,
+                           bugsnag_metadata *metadata) {
+  const int count = clamp_count(metadata->value_count, BUGSNAG_METADATA_MAX);
+  const int names_length =
+      clamp_count(metadata->names_length, BUGSNAG_METADATA_NAMES_SIZE);
+  return write_count(writer, count) &&
+         writer->write(writer, metadata->values,
+                       count * sizeof(bsg_metadata_value)) &&
+         write_count(writer, names_length) &&
+         writer->write(writer, metadata->names, names_length);
+}
+
+static bool write_core_section(bugsnag_event *event,
+                               bsg_buffered_writer *writer) {
+  return writer->write(writer, &event->notifier, sizeof(event->notifier)) &&
+         writer->write(writer, &event->app, sizeof(event->app)) &&
+         writer->write(writer, &event->device, sizeof(event->device)) &&
+         writer->write(writer, &event->user, sizeof(event->user)) &&
+         writer->write(writer, event->context, sizeof(event->context)) &&
+         writer->write(writer, &event->severity, sizeof(event->severity)) &&
+         writer->write(writer, event->session_id, sizeof(event->session_id)) &&
+         writer->write(writer, event->session_start,
+                       sizeof(event->session_start)) &&
+         writer->write(writer, &event->handled_events,
+                       sizeof(event->handled_events)) &&
+         writer->write(writer, &event->unhandled_events,
+                       sizeof(event->unhandled_events)) &&
+         writer->write(writer, event->grouping_hash,
+                       sizeof(event->grouping_hash)) &&
+         writer->write(writer, &event->unhandled, sizeof(event->unhandled)) &&
+         writer->write(writer, event->api_key, sizeof(event->api_key));
+}
+
+#if BUGSNAG_FRAMES_MAX > UINT16_MAX
+#error BUGSNAG_FRAMES_MAX is too large for the frame table indices
+#endif
+
+/**
+ * The entry in the module and symbol tables of each frame
+ */
+typedef struct {
+  int module_count;
+  int symbol_count;
+  uint16_t modules[BUGSNAG_FRAMES_MAX];
+  uint16_t symbols[BUGSNAG_FRAMES_MAX];
+} bsg_frame_tables;
+
+static bool same_module(const bugsnag_stackframe *a,
+                        const bugsnag_stackframe *b) {
+  return a->load_address == b->load_address &&
+         strncmp(a->filename, b->filename, sizeof(a->filename)) == 0;
+}
+
+static bool same_symbol(const bugsnag_stackframe *a,
+                        const bugsnag_stackframe *b) {
+  return a->symbol_address == b->symbol_address &&
+         strncmp(a->method, b->method, sizeof(a->method)) == 0;
+}
+
+/**
+ * Assign each frame the table entries of the first frame in the same module
+ * and function, numbering the entries in order of their first frame. Stacks
+ * rarely span more than a few modules, and recursion repeats functions, so
+ * the tables are much smaller than the frames.
+ */
+static void index_frame_tables(const bugsnag_stackframe *stacktrace,
+                               int frame_count, bsg_frame_tables *tables) {
+  tables->module_count = 0;
+  tables->symbol_count = 0;
+  for (int i = 0; i < frame_count; i++) {
+    int module = tables->module_count;
+    int symbol = tables->symbol_count;
+    for (int j = 0; j < i && (module == tables->module_count ||
+                              symbol == tables->symbol_count);
+         j++) {
+      if (module == tables->module_count &&
+          same_module(&stacktrace[i], &stacktrace[j])) {
+        module = tables->modules[j];
+      }
+      if (symbol == tables->symbol_count &&
+          same_symbol(&stacktrace[i], &stacktrace[j])) {
+        symbol = tables->symbols[j];
+      }
+    }
+    if (module == tables->module_count) {
+      tables->module_count++;
+    }
+    if (symbol == tables->symbol_count) {
+      tables->symbol_count++;
+    }
+    tables->modules[i] = (uint16_t)module;
+    tables->symbols[i] = (uint16_t)symbol;
+  }
+}
+
+static bool write_frame_string(bsg_buffered_writer *writer, const char *string,
+                               size_t size) {
+  const size_t length = strnlen(string, size);
+  return write_count(writer, (int)length) &&
+         writer->write(writer, string, length);
+}
+
+/**
+ * Write the module or symbol table, with the entry of each frame as a uint16.
+ * Each entry is taken from the first frame which refers to it.
+ */
+static bool write_frame_table(bsg_buffered_writer *writer,
+                              const bugsnag_stackframe *stacktrace,
+                              int frame_count, const uint16_t *indices,
+                              int entry_count, bool symbols) {
+  if (!write_count(writer, entry_count)) {
+    return false;
+  }
+  int next_entry = 0;
+  for (int i = 0; i < frame_count && next_entry < entry_count; i++) {
+    if (indices[i] != next_entry) {
+      continue;
+    }
+    const bugsnag_stackframe *frame = &stacktrace[i];
+    const bool written =
+        symbols
+            ? writer->write(writer, &frame->symbol_address,
+                            sizeof(frame->symbol_address)) &&
+                  write_frame_string(writer, frame->method,
+                                     sizeof(frame->method))
+            : writer->write(writer, &frame->load_address,
+                            sizeof(frame->load_address)) &&
+                  write_frame_string(writer, frame->filename,
+                                     sizeof(frame->filename));
+    if (!written) {
+      return false;
+    }
+    next_entry++;
+  }
+  // the indices are copied one at a time, as they are not kept after this
+  for (int i = 0; i < frame_count; i++) {
+    if (!writer->write(writer, &indices[i], sizeof(indices[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool write_error_section(bugsnag_event *event,
+                                bsg_buffered_writer *writer) {
+  bsg_error *error = &event->error;
+  const int frame_count = clamp_count(error->frame_count, BUGSNAG_FRAMES_MAX);
+  if (!writer->write(writer, error->errorClass, sizeof(error->errorClass)) ||
+      !writer->write(writer, error->errorMessage,
+                     sizeof(error->errorMessage)) ||
+      !writer->write(writer, error->type, sizeof(error->type)) ||
+      !write_count(writer, frame_count)) {
+    return false;
+  }
+  const bugsnag_stackframe *stacktrace = error->stacktrace;
+  for (int i = 0; i < frame_count; i++) {
+    if (!writer->write(writer, &stacktrace[i].frame_address,
+                       sizeof(stacktrace[i].frame_address))) {
+      return false;
+    }
+  }
+  for (int i = 0; i < frame_count; i++) {
+    if (!writer->write(writer, &stacktrace[i].line_number,
+                       sizeof(stacktrace[i].line_number))) {
+      return false;
+    }
+  }
+  bsg_frame_tables tables;
+  index_frame_tables(stacktrace, frame_count, &tables);
+  return write_frame_table(writer, stacktrace, frame_count, tables.modules,
+                           tables.module_count, false) &&
+         write_frame_table(writer, stacktrace, frame_count, tables.symbols,
+                           tables.symbol_count, true);
+}
+
+static bool write_metadata_section(bugsnag_event *event,
+                                   bsg_buffered_writer *writer) {
+  return write_metadata(writer, &event->metadata);
+}
+
+static bool write_breadcrumbs_section(bugsnag_event *event,
+                                      bsg_buffered_writer *writer) {
+  const int crumb_count = clamp_count(event->crumb_count, BUGSNAG_CRUMBS_MAX);
+  bsg_breadcrumb_view crumb;
+  // breadcrumbs which were still being added when the ring was frozen are
+  // left out
+  int published_count = 0;
+  for (int i = 0; i < crumb_count; i++) {
+    int index = (event->crumb_first_index + i) % BUGSNAG_CRUMBS_MAX;
+    if (bsg_event_get_breadcrumb(event, index, &crumb)) {
+      published_count++;
+    }
+  }
+  if (!write_count(writer, published_count)) {
+    return false;
+  }
+
+  for (int i = 0; i < crumb_count; i++) {
+    int index = (event->crumb_first_index + i) % BUGSNAG_CRUMBS_MAX;
+    if (bsg_event_get_breadcrumb(event, index, &crumb) &&
+        !writer->write(writer, crumb.record, crumb.length)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool write_threads_section(bugsnag_event *event,
+                                  bsg_buffered_writer *writer) {
+  const int thread_count =
+      event->threads == NULL
+          ? 0
+          : clamp_count(event->thread_count, event->thread_capacity);
+  const uint8_t truncated = event->threads_truncated;
+  return write_count(writer, thread_count) &&
+         (thread_count == 0 ||
+          writer->write(writer, event->threads,
+                        thread_count * sizeof(bsg_thread))) &&
+         writer->write(writer, &truncated, sizeof(truncated));
+}
+
+static bool write_metadata_arena_section(bugsnag_event *event,
+                                         bsg_buffered_writer *writer) {
+  const bsg_metadata_arena *arena = &event->metadata_arena;
+  const uint32_t length =
+      arena->data == NULL
+          ? 0
+          : (arena->length < arena->capacity ? arena->length
+                                             : arena->capacity);
+  return writer->write(writer, &length, sizeof(length)) &&
+         (length == 0 || writer->write(writer, arena->data, length));
+}
+
+static bool write_frame_modules_section(bugsnag_event *event,
+                                        bsg_buffered_writer *writer) {
+  const bsg_frame_module_table *table = &event->frame_modules;
+  const int count = clamp_count(table->count, BUGSNAG_FRAME_MODULES_MAX);
+  const int frame_count =
+      clamp_count(event->error.frame_count, BUGSNAG_FRAMES_MAX);
+  return write_count(writer, count) &&
+         (count == 0 ||
+          (writer->write(writer, table->modules,
+                         count * sizeof(bsg_frame_module)) &&
+           writer->write(writer, table->frame_modules, frame_count)));
+}
+
+static bool write_handler_timing_section(bugsnag_event *event,
+                                         bsg_buffered_writer *writer) {
+  return writer->write(writer, &event->handler_timing,
+                       sizeof(event->handler_timing)) &&
+         writer->write(writer, &event->handler_fallbacks,
+                       sizeof(event->handler_fallbacks));
+}
+
+static bool write_health_counters_section(bugsnag_event *event,
+                                          bsg_buffered_writer *writer) {
+  const uint8_t count = BSG_HEALTH_COUNTER_COUNT;
+  return writer->write(writer, &count, sizeof(count)) &&
+         writer->write(writer, &event->health_counters,
+                       sizeof(event->health_counters));
+}
+
+typedef bool (*bsg_section_writer)(bugsnag_event *event,
+                                   bsg_buffered_writer *writer);
+
+static bool write_section(bugsnag_event *event, bsg_buffered_writer *writer,
+                          bsg_section_writer write_payload) {
+  // size the section by writing it to a writer which only counts bytes
+  bsg_counting_writer counter = {
+      .base =
+          {
+              .fd = -1,
+              .pos = 0,
+              .write = bsg_count_write,
+              .write_byte = bsg_count_write_byte,
+              .write_string = bsg_count_write_string,
+          },
+      .checksum = BSG_SECTION_CHECKSUM_INIT,
+  };
+  write_payload(event, &counter.base);
+
+  // written together, as the frame is only useful whole
+  const uint32_t frame[2] = {(uint32_t)counter.base.pos, counter.checksum};
+  return writer->write(writer, frame, sizeof(frame)) &&
+         write_payload(event, writer);
+}
+
+/**
+ * Write the handler timing as the last section, so that it covers the time
+ * taken to write the rest of the event
+ */
+static bool write_handler_timing(bugsnag_event *event,
+                                 bsg_buffered_writer *writer) {
+  bsg_handler_timing *timing = &event->handler_timing;
+  if (timing->started_ns != 0) {
+    bsg_end_handler_phase(event, BSG_HANDLER_PHASE_WRITE);
+    timing->serialized_ns = timing->phase_ended_ns;
+  }
+  return write_section(event, writer, write_handler_timing_section);
+}
+
+static bool write_event(bugsnag_event *event, bsg_buffered_writer *writer) {
+  return write_section(event, writer, write_core_section) &&
+         write_section(event, writer, write_error_section) &&
+         write_section(event, writer, write_metadata_section) &&
+         write_section(event, writer, write_breadcrumbs_section) &&
+         write_section(event, writer, write_threads_section) &&
+         write_section(event, writer, bsg_write_feature_flags) &&
+         write_section(event, writer, write_metadata_arena_section) &&
+         write_section(event, writer, write_frame_modules_section) &&
+         write_handler_timing(event, writer) &&
+         write_section(event, writer, write_health_counters_section);
+}
+
+static bool bsg_event_write_mapped(bsg_environment *env) {
   bsg_buffered_writer writer;
-  if (!bsg_buffered_writer_open(&writer, env->next_event_path)) {
+  if (!bsg_buffered_writer_open_mapped(&writer, env->next_event_fd,
+                                       env->next_event_mapping,
+                                       env->next_event_mapping_size)) {
     return false;
   }
 
+  // the header goes first, as the sections after it are checksummed and those
+  // written in full are read back even if the rest of the event is not
+  bool result =
+      writer.write(&writer, &env->report_header, sizeof(bsg_report_header)) &&
+      write_event(&env->next_event, &writer);
+  writer.dispose(&writer);
+  return result;
+}
+
+bool bsg_event_write(bsg_environment *env) {
+  // the reader needs the capacities this build sized the event with
+  bsg_event_layout_init(&env->report_header.layout);
+  bsg_health_read(&env->next_event.health_counters, false);
+  if (env->next_event_mapping != NULL) {
+    return bsg_event_write_mapped(env);
+  }
+
+  bsg_vectored_writer vectored_writer;
+  if (!bsg_vectored_writer_open(&vectored_writer, env->next_event_path)) {
+    return false;
+  }
+  bsg_buffered_writer *writer = &vectored_writer.base;
+
   bool result =
       // write header - determines format version, etc
-      bsg_report_header_write(&env->report_header, writer.fd) &&
+      writer->write(writer, &env->report_header, sizeof(bsg_report_header)) &&
       // add cached event info
-      writer.write(&writer, &env->next_event, sizeof(bugsnag_event)) &&
-      // append feature flags after event structure
-      bsg_write_feature_flags(&env->next_event, &writer);
+      write_event(&env->next_event, writer);
 
-  writer.dispose(&writer);
+  writer->dispose(writer);
   return result;
 }
 
+bool bsg_lastrun_write_prepare(bsg_environment *env) {
+  // not truncated, as the info of the previous run may not have been read yet
+  int fd = open(env->last_run_info_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  env->last_run_info_fd = fd;
+  env->last_run_info_open = true;
+  return true;
+}
+
 bool bsg_lastrun_write(bsg_environment *env) {
-  char *path = env->last_run_info_path;
-  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  const size_t size = bsg_strlen(env->next_last_run_info);
+  if (env->last_run_info_open) {
+    // rewritten in place, dropping whatever was longer than the new info
+    return pwrite(env->last_run_info_fd, env->next_last_run_info, size, 0) ==
+               (ssize_t)size &&
+           ftruncate(env->last_run_info_fd, (off_t)size) == 0;
+  }
+
+  int fd = open(env->last_run_info_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
   if (fd == -1) {
     return false;
   }
-
-  int size = bsg_strlen(env->next_last_run_info);
   ssize_t len = write(fd, env->next_last_run_info, size);
-  return len == size;
+  close(fd);
+  return len == (ssize_t)size;
 }
 
 static bool write_feature_flag(bsg_buffered_writer *writer,
@@ -69,6 +547,12 @@ static bool write_feature_flag(bsg_buffered_writer *writer,
 
 bool bsg_write_feature_flags(bugsnag_event *event,
                              bsg_buffered_writer *writer) {
+  if (event->feature_flags_encoded != NULL) {
+    // kept in this layout as the flags change
+    return writer->write(writer, event->feature_flags_encoded,
+                         event->feature_flags_encoded_size);
+  }
+
   const uint32_t feature_flag_count = event->feature_flag_count;
   if (!writer->write(writer, &feature_flag_count, sizeof(feature_flag_count))) {
     return false;
@@ -4,6 +4,29 @@
 #pragma once
 #include "../../bugsnag_ndk.h"
 
+/**
+ * Create, size and map the file at env->next_event_path so that
+ * bsg_event_write() can copy the event into place without opening the file at
+ * crash time. If this fails, bsg_event_write() falls back to opening and
+ * writing the file when called.
+ *
+ * Note: This function is NOT async-safe.
+ *
+ * @return true if the file was mapped
+ */
+bool bsg_event_write_prepare(bsg_environment *env);
+
 bool bsg_event_write(bsg_environment *env) __asyncsafe;
 
+/**
+ * Open env->last_run_info_path for bsg_lastrun_write(), creating it if needed
+ * but leaving its contents for the Java layer to read. If this fails,
+ * bsg_lastrun_write() falls back to opening the file when called.
+ *
+ * Note: This function is NOT async-safe.
+ *
+ * @return true if the file was opened
+ */
+bool bsg_lastrun_write_prepare(bsg_environment *env);
+
 bool bsg_lastrun_write(bsg_environment *env) __asyncsafe;
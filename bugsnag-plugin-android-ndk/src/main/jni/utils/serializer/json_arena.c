@@ -0,0 +1,106 @@
+#include "json_arena.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <parson/parson.h>
+
+/** Allocations are aligned for any type parson stores */
+#define BSG_JSON_ARENA_ALIGN 16
+
+typedef struct bsg_json_arena_chunk {
+  struct bsg_json_arena_chunk *next;
+  size_t size;
+  size_t used;
+  _Alignas(BSG_JSON_ARENA_ALIGN) char data[];
+} bsg_json_arena_chunk;
+
+/** The chunks of the calling thread's arena, newest first */
+static __thread bsg_json_arena_chunk *arena_chunks;
+static __thread size_t arena_used;
+
+static pthread_once_t arena_install_once = PTHREAD_ONCE_INIT;
+
+static bsg_json_arena_chunk *arena_chunk_new(size_t size,
+                                             bsg_json_arena_chunk *next) {
+  bsg_json_arena_chunk *chunk = malloc(sizeof(bsg_json_arena_chunk) + size);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->next = next;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+static void *arena_malloc(size_t size) {
+  bsg_json_arena_chunk *chunk = arena_chunks;
+  if (chunk == NULL) {
+    return malloc(size);
+  }
+  const size_t aligned =
+      (size + BSG_JSON_ARENA_ALIGN - 1) & ~(size_t)(BSG_JSON_ARENA_ALIGN - 1);
+  if (aligned > chunk->size - chunk->used) {
+    // the estimate fell short, so grow by at least as much again
+    chunk = arena_chunk_new(aligned > chunk->size ? aligned : chunk->size,
+                            chunk);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    arena_chunks = chunk;
+  }
+  void *ptr = chunk->data + chunk->used;
+  chunk->used += aligned;
+  arena_used += aligned;
+  return ptr;
+}
+
+static void arena_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  for (bsg_json_arena_chunk *chunk = arena_chunks; chunk != NULL;
+       chunk = chunk->next) {
+    if ((char *)ptr >= chunk->data && (char *)ptr < chunk->data + chunk->size) {
+      return;
+    }
+  }
+  free(ptr);
+}
+
+static void arena_install(void) {
+  json_set_allocation_functions(arena_malloc, arena_free);
+}
+
+size_t bsg_json_arena_size(const bugsnag_event *event) {
+  // measured from the trees of generated events, with room to spare. Pages of
+  // a large chunk which are never touched are never committed.
+  return 16384 + (size_t)event->error.frame_count * 896 +
+         (size_t)event->crumb_count * 1536 +
+         (size_t)event->thread_count * 384 +
+         (size_t)event->metadata.value_count * 256 +
+         event->metadata_arena.length * 2 + event->feature_flag_count * 256;
+}
+
+bool bsg_json_arena_begin(size_t size) {
+  pthread_once(&arena_install_once, arena_install);
+  if (arena_chunks != NULL) {
+    return false;
+  }
+  arena_chunks = arena_chunk_new(size, NULL);
+  arena_used = 0;
+  return arena_chunks != NULL;
+}
+
+void bsg_json_arena_end(void) {
+  bsg_json_arena_chunk *chunk = arena_chunks;
+  arena_chunks = NULL;
+  while (chunk != NULL) {
+    bsg_json_arena_chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+}
+
+size_t bsg_json_arena_used(void) { return arena_used; }
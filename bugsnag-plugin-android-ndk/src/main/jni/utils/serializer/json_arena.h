@@ -0,0 +1,53 @@
+/**
+ * A bump allocator for the parson trees built by bsg_event_to_json().
+ *
+ * Parson allocates every value, object, array and string separately. While an
+ * arena is active on a thread, parson's allocations on that thread are carved
+ * out of a few large chunks instead, and its frees of them do nothing. The
+ * chunks are all released when the arena ends. Allocations on other threads,
+ * and frees of memory from outside the arena, go to malloc() and free() as
+ * before.
+ */
+#ifndef BUGSNAG_JSON_ARENA_H
+#define BUGSNAG_JSON_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../../event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * An estimate of the memory parson needs to build the tree of an event, from
+ * the number of frames, breadcrumbs, threads and metadata values it holds
+ */
+size_t bsg_json_arena_size(const bugsnag_event *event);
+
+/**
+ * Start an arena on the calling thread with a first chunk of size bytes. When
+ * it fills, further chunks are allocated as needed.
+ *
+ * @return false if the chunk could not be allocated or an arena is already
+ *         active, in which case parson allocates from the heap as usual
+ */
+bool bsg_json_arena_begin(size_t size);
+
+/**
+ * Release every chunk of the calling thread's arena. Nothing parson allocated
+ * while it was active may be used afterwards.
+ */
+void bsg_json_arena_end(void);
+
+/**
+ * The bytes handed out by the calling thread's arena so far (exposed for
+ * testing)
+ */
+size_t bsg_json_arena_used(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
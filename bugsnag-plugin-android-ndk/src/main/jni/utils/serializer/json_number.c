@@ -0,0 +1,79 @@
+#include "json_number.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Doubles represent every integer of smaller magnitude exactly */
+#define BSG_JSON_EXACT_INTEGER_MAX 9007199254740992.0
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static size_t format_unsigned(uint64_t value, char *buf) {
+  char digits[20];
+  char *pos = digits + sizeof(digits);
+  while (value >= 100) {
+    pos -= 2;
+    memcpy(pos, &digit_pairs[(value % 100) * 2], 2);
+    value /= 100;
+  }
+  if (value >= 10) {
+    pos -= 2;
+    memcpy(pos, &digit_pairs[value * 2], 2);
+  } else {
+    *--pos = (char)('0' + value);
+  }
+  const size_t length = digits + sizeof(digits) - pos;
+  memcpy(buf, pos, length);
+  buf[length] = '\0';
+  return length;
+}
+
+size_t bsg_json_format_number(double value, char *buf) {
+  // -0 is left to snprintf, which keeps its sign
+  if (value == floor(value) && fabs(value) < BSG_JSON_EXACT_INTEGER_MAX &&
+      !(value == 0 && signbit(value))) {
+    if (value < 0) {
+      buf[0] = '-';
+      return 1 + format_unsigned((uint64_t)-value, buf + 1);
+    }
+    return format_unsigned((uint64_t)value, buf);
+  }
+  // 17 significant digits always round-trip, so only 15 and 16 need checking
+  int length = 0;
+  for (int precision = 15; precision < 17; precision++) {
+    length = snprintf(buf, BSG_JSON_NUMBER_MAX + 1, "%.*g", precision, value);
+    if (length > 0 && strtod(buf, NULL) == value) {
+      return (size_t)length;
+    }
+  }
+  length = snprintf(buf, BSG_JSON_NUMBER_MAX + 1, "%.17g", value);
+  return length > 0 ? (size_t)length : 0;
+}
+
+size_t bsg_json_format_hex(uint64_t value, char *buf) {
+  char digits[16];
+  char *pos = digits + sizeof(digits);
+  do {
+    *--pos = hex_digits[value & 0xf];
+    value >>= 4;
+  } while (value != 0);
+  const size_t length = digits + sizeof(digits) - pos;
+  buf[0] = '0';
+  buf[1] = 'x';
+  memcpy(buf + 2, pos, length);
+  buf[length + 2] = '\0';
+  return length + 2;
+}
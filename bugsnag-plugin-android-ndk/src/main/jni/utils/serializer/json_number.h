@@ -0,0 +1,44 @@
+/**
+ * Number formatting for the JSON serializers, avoiding snprintf() for the
+ * integers which make up almost every number in a report.
+ */
+#ifndef BUGSNAG_JSON_NUMBER_H
+#define BUGSNAG_JSON_NUMBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The most characters bsg_json_format_number() or bsg_json_format_hex()
+ * writes, excluding the terminator
+ */
+#define BSG_JSON_NUMBER_MAX 32
+
+/**
+ * Format a number as the shortest decimal string which parses back to the
+ * same double. Integers below 2^53 are written digit pair by digit pair from
+ * a table. Other values try increasing precisions until one round-trips.
+ *
+ * @param value the number to format
+ * @param buf   a buffer of at least BSG_JSON_NUMBER_MAX + 1 bytes
+ * @return the length of the terminated string written to buf
+ */
+size_t bsg_json_format_number(double value, char *buf);
+
+/**
+ * Format a value as lowercase hex with a "0x" prefix, as "0x%lx" would
+ *
+ * @param value the value to format
+ * @param buf   a buffer of at least BSG_JSON_NUMBER_MAX + 1 bytes
+ * @return the length of the terminated string written to buf
+ */
+size_t bsg_json_format_hex(uint64_t value, char *buf);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,5 +1,7 @@
 #include "json_writer.h"
 
+#include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -8,6 +10,9 @@
 #include <parson/parson.h>
 
 #include "../logger.h"
+#include "../string.h"
+#include "json_arena.h"
+#include "json_number.h"
 
 const char *bsg_crumb_type_string(bugsnag_breadcrumb_type type) {
   switch (type) {
@@ -52,6 +57,14 @@ void bsg_serialize_grouping_hash(const bugsnag_event *event,
   }
 }
 
+/**
+ * Whether an event is a handled error reported from native code, rather than
+ * a crash. Only crash handlers record handler timing.
+ */
+static bool is_handled_error(const bugsnag_event *event) {
+  return !event->unhandled && event->handler_timing.started_ns == 0;
+}
+
 void bsg_serialize_severity_reason(const bugsnag_event *event,
                                    JSON_Object *event_obj) {
   // FUTURE(dm): severityReason/unhandled attributes are currently
@@ -61,6 +74,13 @@ void bsg_serialize_severity_reason(const bugsnag_event *event,
                          bsg_severity_string(event->severity));
   bool unhandled = event->unhandled;
   json_object_dotset_boolean(event_obj, "unhandled", unhandled);
+  if (is_handled_error(event)) {
+    json_object_dotset_boolean(event_obj, "severityReason.unhandledOverridden",
+                               false);
+    json_object_dotset_string(event_obj, "severityReason.type",
+                              "handledException");
+    return;
+  }
 
   // unhandled == false always means that the state has been overridden by the
   // user, as this codepath is only executed for unhandled native errors
@@ -125,8 +145,10 @@ void bsg_serialize_device(const bsg_device_info device,
   json_object_dotset_boolean(event_obj, "device.jailbroken", device.jailbroken);
 
   char report_time[sizeof "2018-10-08T12:07:09Z"];
-  if (device.time > 0) {
-    strftime(report_time, sizeof report_time, "%FT%TZ", gmtime(&device.time));
+  struct tm report_tm;
+  // events may be serialized on several threads at once, so use gmtime_r
+  if (device.time > 0 && gmtime_r(&device.time, &report_tm) != NULL &&
+      strftime(report_time, sizeof report_time, "%FT%TZ", &report_tm) > 0) {
     json_object_dotset_string(event_obj, "device.time", report_time);
   }
 }
@@ -142,15 +164,21 @@ void bsg_serialize_custom_metadata(const bugsnag_metadata metadata,
 
     switch (value.type) {
     case BSG_METADATA_BOOL_VALUE:
-      sprintf(format, "metaData.%s.%s", value.section, value.name);
+      sprintf(format, "metaData.%s.%s",
+              bsg_metadata_value_section(&metadata, &value),
+              bsg_metadata_value_name(&metadata, &value));
       json_object_dotset_boolean(event_obj, format, value.bool_value);
       break;
     case BSG_METADATA_CHAR_VALUE:
-      sprintf(format, "metaData.%s.%s", value.section, value.name);
+      sprintf(format, "metaData.%s.%s",
+              bsg_metadata_value_section(&metadata, &value),
+              bsg_metadata_value_name(&metadata, &value));
       json_object_dotset_string(event_obj, format, value.char_value);
       break;
     case BSG_METADATA_NUMBER_VALUE:
-      sprintf(format, "metaData.%s.%s", value.section, value.name);
+      sprintf(format, "metaData.%s.%s",
+              bsg_metadata_value_section(&metadata, &value),
+              bsg_metadata_value_name(&metadata, &value));
       json_object_dotset_number(event_obj, format, value.double_value);
       break;
     default:
@@ -160,11 +188,35 @@ void bsg_serialize_custom_metadata(const bugsnag_metadata metadata,
   }
 }
 
-void bsg_serialize_breadcrumb_metadata(const bugsnag_metadata metadata,
+void bsg_serialize_metadata_arena(const bsg_metadata_arena *arena,
+                                  JSON_Object *event_obj) {
+  char format[256];
+  uint32_t offset = 0;
+  bsg_metadata_arena_value value;
+  while (bsg_metadata_arena_next(arena, &offset, &value)) {
+    snprintf(format, sizeof(format), "metaData.%s.%s", value.section,
+             value.name);
+    switch (value.type) {
+    case BSG_METADATA_BOOL_VALUE:
+      json_object_dotset_boolean(event_obj, format, value.bool_value);
+      break;
+    case BSG_METADATA_CHAR_VALUE:
+      json_object_dotset_string(event_obj, format, value.char_value);
+      break;
+    case BSG_METADATA_NUMBER_VALUE:
+      json_object_dotset_number(event_obj, format, value.double_value);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+void bsg_serialize_breadcrumb_metadata(bsg_breadcrumb_view *crumb,
                                        JSON_Object *event_obj) {
-  for (int i = 0; i < metadata.value_count; i++) {
+  bsg_metadata_arena_value value;
+  while (bsg_breadcrumb_next_value(crumb, &value)) {
     char *format = calloc(1, sizeof(char) * 256);
-    bsg_metadata_value value = metadata.values[i];
 
     switch (value.type) {
     case BSG_METADATA_BOOL_VALUE:
@@ -242,10 +294,9 @@ void bsg_serialize_stackframe(bugsnag_stackframe *stackframe, bool is_pc,
     json_object_set_string(frame, "file", (*stackframe).filename);
   }
   if (strlen((*stackframe).method) == 0) {
-    char *frame_address = calloc(1, sizeof(char) * 32);
-    sprintf(frame_address, "0x%lx", (unsigned long)(*stackframe).frame_address);
+    char frame_address[BSG_JSON_NUMBER_MAX + 1];
+    bsg_json_format_hex((*stackframe).frame_address, frame_address);
     json_object_set_string(frame, "method", frame_address);
-    free(frame_address);
   } else {
     json_object_set_string(frame, "method", (*stackframe).method);
   }
@@ -253,85 +304,50 @@ void bsg_serialize_stackframe(bugsnag_stackframe *stackframe, bool is_pc,
   json_array_append_value(stacktrace, frame_val);
 }
 
-#if defined(__i386__) || defined(__arm__)
-#define TIMESTAMP_T long long
-#define TIMESTAMP_DECODE atoll
-#define TIMESTAMP_MILLIS_FORMAT "%s.%03lldZ"
-#elif defined(__x86_64__) || defined(__aarch64__)
-#define TIMESTAMP_T long
-#define TIMESTAMP_DECODE atol
-#define TIMESTAMP_MILLIS_FORMAT "%s.%03ldZ"
-#endif
 /**
- * Convert a string representing the number of milliseconds since the epoch
- * into the date format "yyyy-MM-ddTHH:mm:ss.SSSZ". Safe for all dates earlier
- * than 2038.
+ * Format a breadcrumb timestamp in milliseconds since the epoch in the date
+ * format "yyyy-MM-ddTHH:mm:ss.SSSZ", or as a plain number of milliseconds if
+ * it cannot be represented as a date.
  *
- * @param source the timestamp string, should be something like: 1636710533109
- * @param dest   a buffer large enough to hold the 24 characters required in the
- *               date format
- *
- * @return true if the conversion succeeded
+ * @param timestamp_ms the timestamp, such as 1636710533109
+ * @param dest         a buffer of at least BSG_JSON_NUMBER_MAX + 1 bytes
  */
-static bool timestamp_to_iso8601_millis(const char *source, char *dest) {
-  TIMESTAMP_T timestamp = TIMESTAMP_DECODE(source);
-  if (timestamp) {
-    time_t seconds = timestamp / 1000;
-    TIMESTAMP_T milliseconds = timestamp - (seconds * 1000LL);
-    if (milliseconds > 1000) { // round to nearest second
-      seconds++;
-      milliseconds -= 1000;
-    }
-    struct tm timer;
-    // gmtime(3) can fail if "the year does not fit into an integer". Hopefully
-    // nobody is running this code by then.
-    if (gmtime_r(&seconds, &timer)) {
-      char buffer[26];
-      strftime(buffer, 26, "%Y-%m-%dT%H:%M:%S", &timer);
-      sprintf(dest, TIMESTAMP_MILLIS_FORMAT, buffer, milliseconds);
-      return true;
-    } else {
-      BUGSNAG_LOG("Hello, people of the far future! Please use your time "
-                  "machine to file a bug in the year 2021.");
-    }
+static void format_crumb_timestamp(int64_t timestamp_ms, char *dest) {
+  time_t seconds = (time_t)(timestamp_ms / 1000);
+  int milliseconds = (int)(timestamp_ms % 1000);
+  if (milliseconds < 0) {
+    seconds--;
+    milliseconds += 1000;
+  }
+  struct tm timer;
+  char buffer[26];
+  // gmtime(3) can fail if "the year does not fit into an integer"
+  if (gmtime_r(&seconds, &timer) != NULL &&
+      strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &timer) > 0) {
+    sprintf(dest, "%s.%03dZ", buffer, milliseconds);
+  } else {
+    bsg_json_format_number((double)timestamp_ms, dest);
   }
-  return false;
 }
-#undef TIMESTAMP_T
-#undef TIMESTAMP_DECODE
-#undef TIMESTAMP_MILLIS_FORMAT
 
 void bsg_serialize_breadcrumbs(const bugsnag_event *event, JSON_Array *crumbs) {
-  if (event->crumb_count > 0) {
-    int current_index = event->crumb_first_index;
-    while (json_array_get_count(crumbs) < event->crumb_count) {
-      JSON_Value *crumb_val = json_value_init_object();
-      JSON_Object *crumb = json_value_get_object(crumb_val);
-      json_array_append_value(crumbs, crumb_val);
-
-      bugsnag_breadcrumb breadcrumb = event->breadcrumbs[current_index];
-      json_object_set_string(crumb, "name", breadcrumb.name);
-      // check whether to decode milliseconds into ISO8601 date format
-      if (breadcrumb.timestamp[0] == 't') {
-        char *unix_timestamp_str = breadcrumb.timestamp + 1;
-        char buffer[32];
-        if (timestamp_to_iso8601_millis(unix_timestamp_str, buffer)) {
-          json_object_set_string(crumb, "timestamp", buffer);
-        } else {
-          // at least we tried.
-          json_object_set_string(crumb, "timestamp", unix_timestamp_str);
-        }
-      } else {
-        json_object_set_string(crumb, "timestamp", breadcrumb.timestamp);
-      }
-      json_object_set_string(crumb, "type",
-                             bsg_crumb_type_string(breadcrumb.type));
-      bsg_serialize_breadcrumb_metadata(breadcrumb.metadata, crumb);
-      current_index++;
-      if (current_index == BUGSNAG_CRUMBS_MAX) {
-        current_index = 0;
-      }
+  for (int i = 0; i < event->crumb_count && i < BUGSNAG_CRUMBS_MAX; i++) {
+    bsg_breadcrumb_view breadcrumb;
+    int index = (event->crumb_first_index + i) % BUGSNAG_CRUMBS_MAX;
+    if (!bsg_event_get_breadcrumb(event, index, &breadcrumb)) {
+      continue;
     }
+    JSON_Value *crumb_val = json_value_init_object();
+    JSON_Object *crumb = json_value_get_object(crumb_val);
+    json_array_append_value(crumbs, crumb_val);
+
+    json_object_set_string(crumb, "name", breadcrumb.name);
+    char timestamp[BSG_JSON_NUMBER_MAX + 1];
+    format_crumb_timestamp(breadcrumb.timestamp_ms, timestamp);
+    json_object_set_string(crumb, "timestamp", timestamp);
+    json_object_set_string(crumb, "type",
+                           bsg_crumb_type_string(breadcrumb.type));
+    bsg_serialize_breadcrumb_metadata(&breadcrumb, crumb);
   }
 }
 
@@ -373,7 +389,22 @@ void bsg_serialize_feature_flags(const bugsnag_event *event,
   }
 }
 
+static int json_serialize_number(double value, char *buf) {
+  char number[BSG_JSON_NUMBER_MAX + 1];
+  return (int)bsg_json_format_number(value, buf != NULL ? buf : number);
+}
+
+static pthread_once_t json_number_format_once = PTHREAD_ONCE_INIT;
+
+static void json_install_number_format(void) {
+  json_set_number_serialization_function(json_serialize_number);
+}
+
 char *bsg_event_to_json(bugsnag_event *event) {
+  // numbers are written the same way as by bsg_event_to_json_stream()
+  pthread_once(&json_number_format_once, json_install_number_format);
+  // the whole tree is released with the arena, rather than value by value
+  const bool has_arena = bsg_json_arena_begin(bsg_json_arena_size(event));
   JSON_Value *event_val = json_value_init_object();
   JSON_Object *event_obj = json_value_get_object(event_val);
   JSON_Value *crumbs_val = json_value_init_array();
@@ -395,6 +426,7 @@ char *bsg_event_to_json(bugsnag_event *event) {
   json_object_set_value(event_obj, "featureFlags", feature_flags_val);
   json_array_append_value(exceptions, ex_val);
   char *serialized_string = NULL;
+  size_t size = 0;
   {
     bsg_serialize_context(event, event_obj);
     bsg_serialize_grouping_hash(event, event_obj);
@@ -404,6 +436,7 @@ char *bsg_event_to_json(bugsnag_event *event) {
     bsg_serialize_device(event->device, event_obj);
     bsg_serialize_device_metadata(event->device, event_obj);
     bsg_serialize_custom_metadata(event->metadata, event_obj);
+    bsg_serialize_metadata_arena(&event->metadata_arena, event_obj);
     bsg_serialize_user(event->user, event_obj);
     bsg_serialize_session(event, event_obj);
     bsg_serialize_error(event->error, exception, stacktrace);
@@ -411,8 +444,989 @@ char *bsg_event_to_json(bugsnag_event *event) {
     bsg_serialize_threads(event, threads);
     bsg_serialize_feature_flags(event, feature_flags);
 
-    serialized_string = json_serialize_to_string(event_val);
+    // into a heap buffer, rather than one from the arena
+    serialized_string = json_serialize_into_buffer(event_val, NULL, &size);
     json_value_free(event_val);
   }
+  if (has_arena) {
+    bsg_json_arena_end();
+  }
   return serialized_string;
 }
+
+/*
+ * Streaming serialization
+ *
+ * bsg_event_to_json_stream() produces the same output as bsg_event_to_json()
+ * in a single pass into one growable buffer, without building a parson tree.
+ * To do so it follows the rules parson uses when building the tree: keys are
+ * written in the order they are first set, a key which is set again keeps its
+ * first position but takes the last value, nested objects only exist once a
+ * value has been set inside them, and strings which are not valid UTF-8 (or
+ * numbers which are not finite) are never set.
+ */
+
+#define BSG_JSON_STREAM_INITIAL_CAPACITY 16384
+
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+  bool failed;
+} bsg_json_stream;
+
+/**
+ * The start of a nested object, which is removed again if nothing is written
+ * to it
+ */
+typedef struct {
+  size_t start;
+  bool parent_had_fields;
+  bool has_fields;
+} bsg_json_object_mark;
+
+static bool json_stream_reserve(bsg_json_stream *stream, size_t length) {
+  if (stream->failed) {
+    return false;
+  }
+  // leave space for the trailing '\0'
+  size_t required = stream->length + length + 1;
+  if (required <= stream->capacity) {
+    return true;
+  }
+  size_t capacity = stream->capacity > 0 ? stream->capacity
+                                         : BSG_JSON_STREAM_INITIAL_CAPACITY;
+  while (capacity < required) {
+    capacity *= 2;
+  }
+  char *data = realloc(stream->data, capacity);
+  if (data == NULL) {
+    stream->failed = true;
+    return false;
+  }
+  stream->data = data;
+  stream->capacity = capacity;
+  return true;
+}
+
+static void json_stream_append(bsg_json_stream *stream, const char *data,
+                               size_t length) {
+  if (length > 0 && json_stream_reserve(stream, length)) {
+    memcpy(stream->data + stream->length, data, length);
+    stream->length += length;
+  }
+}
+
+static void json_stream_append_str(bsg_json_stream *stream, const char *str) {
+  json_stream_append(stream, str, strlen(str));
+}
+
+static int json_utf8_sequence_length(unsigned char c) {
+  if (c == 0xC0 || c == 0xC1 || c > 0xF4 || (c & 0xC0) == 0x80) {
+    return 0;
+  } else if ((c & 0x80) == 0) {
+    return 1;
+  } else if ((c & 0xE0) == 0xC0) {
+    return 2;
+  } else if ((c & 0xF0) == 0xE0) {
+    return 3;
+  } else if ((c & 0xF8) == 0xF0) {
+    return 4;
+  }
+  return 0;
+}
+
+/**
+ * Matches the validation parson applies before accepting a string value
+ */
+static bool json_is_valid_utf8(const char *string) {
+  const unsigned char *s = (const unsigned char *)string;
+  while (*s) {
+    int len = json_utf8_sequence_length(s[0]);
+    unsigned int cp;
+    if (len == 0) {
+      return false;
+    }
+    for (int i = 1; i < len; i++) {
+      if ((s[i] & 0xC0) != 0x80) {
+        return false;
+      }
+    }
+    switch (len) {
+    case 1:
+      cp = s[0];
+      break;
+    case 2:
+      cp = ((s[0] & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+      break;
+    case 3:
+      cp = ((s[0] & 0xFu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+      break;
+    default:
+      cp = ((s[0] & 0x7u) << 18) | ((s[1] & 0x3Fu) << 12) |
+           ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+      break;
+    }
+    // overlong encodings, invalid code points and surrogate halves
+    if ((cp < 0x80 && len > 1) || (cp < 0x800 && len > 2) ||
+        (cp < 0x10000 && len > 3) || cp > 0x10FFFF ||
+        (cp >= 0xD800 && cp <= 0xDFFF)) {
+      return false;
+    }
+    s += len;
+  }
+  return true;
+}
+
+static void json_stream_append_string(bsg_json_stream *stream,
+                                      const char *string) {
+  json_stream_append(stream, "\"", 1);
+  const size_t length = strlen(string);
+  size_t pos = 0;
+  while (pos < length) {
+    // copy the run which needs no escaping, found 16 bytes at a time
+    const size_t run = json_string_unescaped_length(string + pos, length - pos);
+    json_stream_append(stream, string + pos, run);
+    pos += run;
+    if (pos == length) {
+      break;
+    }
+    const unsigned char c = (unsigned char)string[pos++];
+    const char *escape = NULL;
+    char unicode[8];
+    switch (c) {
+    case '\"':
+      escape = "\\\"";
+      break;
+    case '\\':
+      escape = "\\\\";
+      break;
+    case '/':
+      escape = "\\/";
+      break;
+    case '\b':
+      escape = "\\b";
+      break;
+    case '\f':
+      escape = "\\f";
+      break;
+    case '\n':
+      escape = "\\n";
+      break;
+    case '\r':
+      escape = "\\r";
+      break;
+    case '\t':
+      escape = "\\t";
+      break;
+    default:
+      snprintf(unicode, sizeof(unicode), "\\u%04x", c);
+      escape = unicode;
+      break;
+    }
+    json_stream_append_str(stream, escape);
+  }
+  json_stream_append(stream, "\"", 1);
+}
+
+static void json_stream_append_number(bsg_json_stream *stream, double value) {
+  char buffer[BSG_JSON_NUMBER_MAX + 1];
+  const size_t length = bsg_json_format_number(value, buffer);
+  if (length > 0) {
+    json_stream_append(stream, buffer, length);
+  }
+}
+
+static void json_stream_key(bsg_json_stream *stream, bool *has_fields,
+                            const char *key) {
+  if (*has_fields) {
+    json_stream_append(stream, ",", 1);
+  }
+  *has_fields = true;
+  json_stream_append_string(stream, key);
+  json_stream_append(stream, ":", 1);
+}
+
+static void json_stream_string_field(bsg_json_stream *stream, bool *has_fields,
+                                     const char *key, const char *value) {
+  if (value == NULL || !json_is_valid_utf8(value)) {
+    return;
+  }
+  json_stream_key(stream, has_fields, key);
+  json_stream_append_string(stream, value);
+}
+
+static void json_stream_number_field(bsg_json_stream *stream, bool *has_fields,
+                                     const char *key, double value) {
+  if (isnan(value) || isinf(value)) {
+    return;
+  }
+  json_stream_key(stream, has_fields, key);
+  json_stream_append_number(stream, value);
+}
+
+static void json_stream_bool_field(bsg_json_stream *stream, bool *has_fields,
+                                   const char *key, bool value) {
+  json_stream_key(stream, has_fields, key);
+  json_stream_append_str(stream, value ? "true" : "false");
+}
+
+static void json_stream_begin_object(bsg_json_stream *stream,
+                                     bool *parent_has_fields, const char *key,
+                                     bsg_json_object_mark *mark) {
+  mark->start = stream->length;
+  mark->parent_had_fields = *parent_has_fields;
+  mark->has_fields = false;
+  json_stream_key(stream, parent_has_fields, key);
+  json_stream_append(stream, "{", 1);
+}
+
+static void json_stream_end_object(bsg_json_stream *stream,
+                                   bool *parent_has_fields,
+                                   bsg_json_object_mark *mark) {
+  if (!mark->has_fields) {
+    // nothing was set, so the object would never have been created
+    stream->length = mark->start;
+    *parent_has_fields = mark->parent_had_fields;
+    return;
+  }
+  json_stream_append(stream, "}", 1);
+}
+
+/**
+ * A metadata value along with its section and name, from either the fixed
+ * metadata store or the arena
+ */
+typedef struct {
+  const char *section;
+  const char *name;
+  bugsnag_metadata_type type;
+  bool bool_value;
+  const char *char_value;
+  double double_value;
+} bsg_json_metadata_entry;
+
+static bool json_metadata_entry_is_set(const bsg_json_metadata_entry *entry) {
+  switch (entry->type) {
+  case BSG_METADATA_BOOL_VALUE:
+    return true;
+  case BSG_METADATA_CHAR_VALUE:
+    return json_is_valid_utf8(entry->char_value);
+  case BSG_METADATA_NUMBER_VALUE:
+    return !isnan(entry->double_value) && !isinf(entry->double_value);
+  default:
+    return false;
+  }
+}
+
+static void json_stream_metadata_value(bsg_json_stream *stream,
+                                       bool *has_fields,
+                                       const bsg_json_metadata_entry *entry) {
+  switch (entry->type) {
+  case BSG_METADATA_BOOL_VALUE:
+    json_stream_bool_field(stream, has_fields, entry->name, entry->bool_value);
+    break;
+  case BSG_METADATA_CHAR_VALUE:
+    json_stream_string_field(stream, has_fields, entry->name,
+                             entry->char_value);
+    break;
+  case BSG_METADATA_NUMBER_VALUE:
+    json_stream_number_field(stream, has_fields, entry->name,
+                             entry->double_value);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Write each distinct metadata key once, in the position of its first value
+ * but with its last value. If section is non-NULL only values in that section
+ * are written, otherwise values are keyed by name alone.
+ */
+static void json_stream_metadata_fields(bsg_json_stream *stream,
+                                        bool *has_fields,
+                                        const bsg_json_metadata_entry *entries,
+                                        int count, bool *done,
+                                        const char *section) {
+  for (int i = 0; i < count; i++) {
+    if (done[i] || (section != NULL && strcmp(entries[i].section, section))) {
+      continue;
+    }
+    int last = i;
+    for (int j = i + 1; j < count; j++) {
+      if (!done[j] && strcmp(entries[j].name, entries[i].name) == 0 &&
+          (section == NULL || strcmp(entries[j].section, section) == 0)) {
+        done[j] = true;
+        last = j;
+      }
+    }
+    done[i] = true;
+    json_stream_metadata_value(stream, has_fields, &entries[last]);
+  }
+}
+
+/**
+ * Collect the metadata values which would be set, returning their count
+ */
+static int json_collect_metadata(const bugsnag_metadata *metadata,
+                                 bsg_json_metadata_entry *entries, int count) {
+  int value_count = metadata->value_count;
+  if (value_count > BUGSNAG_METADATA_MAX) {
+    value_count = BUGSNAG_METADATA_MAX;
+  }
+  for (int i = 0; i < value_count; i++) {
+    const bsg_metadata_value *value = &metadata->values[i];
+    bsg_json_metadata_entry *entry = &entries[count];
+    entry->section = bsg_metadata_value_section(metadata, value);
+    entry->name = bsg_metadata_value_name(metadata, value);
+    entry->type = value->type;
+    entry->bool_value = value->bool_value;
+    entry->char_value = value->char_value;
+    entry->double_value = value->double_value;
+    if (json_metadata_entry_is_set(entry)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static int json_count_metadata_arena(const bsg_metadata_arena *arena) {
+  int count = 0;
+  uint32_t offset = 0;
+  bsg_metadata_arena_value value;
+  while (bsg_metadata_arena_next(arena, &offset, &value)) {
+    count++;
+  }
+  return count;
+}
+
+static int json_collect_metadata_arena(const bsg_metadata_arena *arena,
+                                       bsg_json_metadata_entry *entries,
+                                       int count) {
+  uint32_t offset = 0;
+  bsg_metadata_arena_value value;
+  while (bsg_metadata_arena_next(arena, &offset, &value)) {
+    bsg_json_metadata_entry *entry = &entries[count];
+    entry->section = value.section;
+    entry->name = value.name;
+    entry->type = value.type;
+    entry->bool_value = value.bool_value;
+    entry->char_value = value.char_value;
+    entry->double_value = value.double_value;
+    if (json_metadata_entry_is_set(entry)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static void json_stream_custom_metadata(bsg_json_stream *stream,
+                                        bool *has_fields,
+                                        const bsg_app_info *app,
+                                        const bugsnag_metadata *metadata,
+                                        const bsg_metadata_arena *arena,
+                                        bool include_active_screen) {
+  const int capacity =
+      BUGSNAG_METADATA_MAX + 1 + json_count_metadata_arena(arena);
+  bsg_json_metadata_entry *entries =
+      calloc(capacity, sizeof(bsg_json_metadata_entry));
+  bool *done = calloc(capacity, sizeof(bool));
+  char active_screen[sizeof(((bsg_metadata_value *)0)->char_value)];
+  int count = 0;
+  if (entries == NULL || done == NULL) {
+    stream->failed = true;
+    goto exit;
+  }
+
+  if (include_active_screen) {
+    bsg_strncpy(active_screen, (char *)app->active_screen,
+                sizeof(active_screen));
+    entries[count].section = "app";
+    entries[count].name = "activeScreen";
+    entries[count].type = BSG_METADATA_CHAR_VALUE;
+    entries[count].char_value = active_screen;
+    count++;
+  }
+  count = json_collect_metadata(metadata, entries, count);
+  count = json_collect_metadata_arena(arena, entries, count);
+  if (count == 0) {
+    goto exit;
+  }
+
+  bsg_json_object_mark metadata_mark;
+  json_stream_begin_object(stream, has_fields, "metaData", &metadata_mark);
+  for (int i = 0; i < count; i++) {
+    if (done[i]) {
+      continue;
+    }
+    bsg_json_object_mark section_mark;
+    json_stream_begin_object(stream, &metadata_mark.has_fields,
+                             entries[i].section, &section_mark);
+    json_stream_metadata_fields(stream, &section_mark.has_fields, entries,
+                                count, done, entries[i].section);
+    json_stream_end_object(stream, &metadata_mark.has_fields, &section_mark);
+  }
+  json_stream_end_object(stream, has_fields, &metadata_mark);
+
+exit:
+  free(entries);
+  free(done);
+}
+
+static void json_stream_breadcrumb_metadata(bsg_json_stream *stream,
+                                            bool *has_fields,
+                                            bsg_breadcrumb_view *crumb) {
+  bsg_json_metadata_entry entries[BUGSNAG_METADATA_MAX];
+  bool done[BUGSNAG_METADATA_MAX] = {false};
+  int count = 0;
+  bsg_metadata_arena_value value;
+  while (count < BUGSNAG_METADATA_MAX &&
+         bsg_breadcrumb_next_value(crumb, &value)) {
+    bsg_json_metadata_entry *entry = &entries[count];
+    entry->section = value.section;
+    entry->name = value.name;
+    entry->type = value.type;
+    entry->bool_value = value.bool_value;
+    entry->char_value = value.char_value;
+    entry->double_value = value.double_value;
+    if (json_metadata_entry_is_set(entry)) {
+      count++;
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+
+  bsg_json_object_mark mark;
+  json_stream_begin_object(stream, has_fields, "metaData", &mark);
+  json_stream_metadata_fields(stream, &mark.has_fields, entries, count, done,
+                              NULL);
+  json_stream_end_object(stream, has_fields, &mark);
+}
+
+static void json_stream_stackframe(bsg_json_stream *stream,
+                                   const bugsnag_stackframe *stackframe,
+                                   bool is_pc) {
+  bool has_fields = false;
+  json_stream_append(stream, "{", 1);
+  json_stream_number_field(stream, &has_fields, "frameAddress",
+                           stackframe->frame_address);
+  json_stream_number_field(stream, &has_fields, "symbolAddress",
+                           stackframe->symbol_address);
+  json_stream_number_field(stream, &has_fields, "loadAddress",
+                           stackframe->load_address);
+  json_stream_number_field(stream, &has_fields, "lineNumber",
+                           stackframe->line_number);
+  if (is_pc) {
+    json_stream_bool_field(stream, &has_fields, "isPC", true);
+  }
+  if (strlen(stackframe->filename) > 0) {
+    json_stream_string_field(stream, &has_fields, "file", stackframe->filename);
+  }
+  if (strlen(stackframe->method) == 0) {
+    char frame_address[BSG_JSON_NUMBER_MAX + 1];
+    bsg_json_format_hex(stackframe->frame_address, frame_address);
+    json_stream_string_field(stream, &has_fields, "method", frame_address);
+  } else {
+    json_stream_string_field(stream, &has_fields, "method", stackframe->method);
+  }
+  json_stream_append(stream, "}", 1);
+}
+
+static void json_stream_exceptions(bsg_json_stream *stream, bool *has_fields,
+                                   const bsg_error *error) {
+  bool exception_has_fields = false;
+  json_stream_key(stream, has_fields, "exceptions");
+  json_stream_append_str(stream, "[{");
+
+  json_stream_key(stream, &exception_has_fields, "stacktrace");
+  json_stream_append(stream, "[", 1);
+  ssize_t frame_count = error->frame_count;
+  if (frame_count > BUGSNAG_FRAMES_MAX) {
+    frame_count = BUGSNAG_FRAMES_MAX;
+  }
+  for (ssize_t i = 0; i < frame_count; i++) {
+    if (i > 0) {
+      json_stream_append(stream, ",", 1);
+    }
+    // the initial frame is the program counter, see bsg_serialize_error
+    json_stream_stackframe(stream, &error->stacktrace[i], i == 0);
+  }
+  json_stream_append(stream, "]", 1);
+
+  json_stream_string_field(stream, &exception_has_fields, "errorClass",
+                           error->errorClass);
+  json_stream_string_field(stream, &exception_has_fields, "message",
+                           error->errorMessage);
+  json_stream_string_field(stream, &exception_has_fields, "type", "c");
+  json_stream_append_str(stream, "}]");
+}
+
+static void json_stream_breadcrumbs(bsg_json_stream *stream, bool *has_fields,
+                                    const bugsnag_event *event) {
+  json_stream_key(stream, has_fields, "breadcrumbs");
+  json_stream_append(stream, "[", 1);
+  bool crumb_written = false;
+  for (int i = 0; i < event->crumb_count && i < BUGSNAG_CRUMBS_MAX; i++) {
+    bsg_breadcrumb_view breadcrumb;
+    int index = (event->crumb_first_index + i) % BUGSNAG_CRUMBS_MAX;
+    if (!bsg_event_get_breadcrumb(event, index, &breadcrumb)) {
+      continue;
+    }
+    bool crumb_has_fields = false;
+    if (crumb_written) {
+      json_stream_append(stream, ",", 1);
+    }
+    crumb_written = true;
+    json_stream_append(stream, "{", 1);
+    json_stream_string_field(stream, &crumb_has_fields, "name",
+                             breadcrumb.name);
+    char timestamp[BSG_JSON_NUMBER_MAX + 1];
+    format_crumb_timestamp(breadcrumb.timestamp_ms, timestamp);
+    json_stream_string_field(stream, &crumb_has_fields, "timestamp",
+                             timestamp);
+    json_stream_string_field(stream, &crumb_has_fields, "type",
+                             bsg_crumb_type_string(breadcrumb.type));
+    json_stream_breadcrumb_metadata(stream, &crumb_has_fields, &breadcrumb);
+    json_stream_append(stream, "}", 1);
+  }
+  json_stream_append(stream, "]", 1);
+}
+
+static void json_stream_threads(bsg_json_stream *stream, bool *has_fields,
+                                const bugsnag_event *event) {
+  json_stream_key(stream, has_fields, "threads");
+  json_stream_append(stream, "[", 1);
+  for (int index = 0; index < event->thread_count; index++) {
+    const bsg_thread *thread = &event->threads[index];
+    bool thread_has_fields = false;
+    if (index > 0) {
+      json_stream_append(stream, ",", 1);
+    }
+    json_stream_append(stream, "{", 1);
+    json_stream_number_field(stream, &thread_has_fields, "id",
+                             (double)thread->id);
+    json_stream_string_field(stream, &thread_has_fields, "name", thread->name);
+    json_stream_string_field(stream, &thread_has_fields, "state",
+                             thread->state);
+    json_stream_string_field(stream, &thread_has_fields, "type", "c");
+    json_stream_append(stream, "}", 1);
+  }
+  json_stream_append(stream, "]", 1);
+}
+
+static void json_stream_feature_flags(bsg_json_stream *stream,
+                                      bool *has_fields,
+                                      const bugsnag_event *event) {
+  json_stream_key(stream, has_fields, "featureFlags");
+  json_stream_append(stream, "[", 1);
+  for (size_t index = 0; index < event->feature_flag_count; index++) {
+    const bsg_feature_flag *flag = &event->feature_flags[index];
+    bool flag_has_fields = false;
+    if (index > 0) {
+      json_stream_append(stream, ",", 1);
+    }
+    json_stream_append(stream, "{", 1);
+    json_stream_string_field(stream, &flag_has_fields, "featureFlag",
+                             flag->name);
+    json_stream_string_field(stream, &flag_has_fields, "variant",
+                             flag->variant);
+    json_stream_append(stream, "}", 1);
+  }
+  json_stream_append(stream, "]", 1);
+}
+
+static void json_stream_severity_reason(bsg_json_stream *stream,
+                                        bool *has_fields,
+                                        const bugsnag_event *event) {
+  json_stream_string_field(stream, has_fields, "severity",
+                           bsg_severity_string(event->severity));
+  json_stream_bool_field(stream, has_fields, "unhandled", event->unhandled);
+
+  bsg_json_object_mark reason, attributes;
+  json_stream_begin_object(stream, has_fields, "severityReason", &reason);
+  if (is_handled_error(event)) {
+    json_stream_bool_field(stream, &reason.has_fields, "unhandledOverridden",
+                           false);
+    json_stream_string_field(stream, &reason.has_fields, "type",
+                             "handledException");
+    json_stream_end_object(stream, has_fields, &reason);
+    return;
+  }
+  json_stream_bool_field(stream, &reason.has_fields, "unhandledOverridden",
+                         !event->unhandled);
+  json_stream_string_field(stream, &reason.has_fields, "type", "signal");
+  json_stream_begin_object(stream, &reason.has_fields, "attributes",
+                           &attributes);
+  json_stream_string_field(stream, &attributes.has_fields, "signalType",
+                           event->error.errorClass);
+  json_stream_end_object(stream, &reason.has_fields, &attributes);
+  json_stream_end_object(stream, has_fields, &reason);
+}
+
+/**
+ * A run of encoded fields, stored without a leading separator
+ */
+typedef struct {
+  char *json;
+  size_t length;
+  bool valid;
+} bsg_json_fragment;
+
+struct bsg_json_fragment_cache {
+  /**
+   * The app and device values which the fragments were last encoded from
+   */
+  bsg_app_info app;
+  bsg_device_info device;
+  bsg_json_fragment app_identity;
+  bsg_json_fragment device_identity;
+  bsg_json_fragment device_platform;
+};
+
+typedef void (*bsg_json_fragment_encoder)(bsg_json_stream *stream,
+                                          bool *has_fields,
+                                          const void *source);
+
+static void json_fragment_store(bsg_json_fragment *fragment, const char *json,
+                                size_t length) {
+  fragment->valid = false;
+  char *copy = realloc(fragment->json, length + 1);
+  if (copy == NULL) {
+    return;
+  }
+  memcpy(copy, json, length);
+  fragment->json = copy;
+  fragment->length = length;
+  fragment->valid = true;
+}
+
+/**
+ * Write a run of fields, either by splicing in a previously encoded fragment
+ * when reuse is true, or by encoding them and keeping a copy in the fragment.
+ * A NULL fragment disables caching.
+ */
+static void json_stream_fragment(bsg_json_stream *stream, bool *has_fields,
+                                 bsg_json_fragment *fragment, bool reuse,
+                                 bsg_json_fragment_encoder encode,
+                                 const void *source) {
+  if (fragment != NULL && reuse && fragment->valid) {
+    if (fragment->length > 0) {
+      if (*has_fields) {
+        json_stream_append(stream, ",", 1);
+      }
+      json_stream_append(stream, fragment->json, fragment->length);
+      *has_fields = true;
+    }
+    return;
+  }
+
+  // the separator is written up-front and removed if nothing follows it
+  size_t separator = stream->length;
+  if (*has_fields) {
+    json_stream_append(stream, ",", 1);
+  }
+  size_t start = stream->length;
+  bool fragment_has_fields = false;
+  encode(stream, &fragment_has_fields, source);
+  if (stream->failed) {
+    return;
+  }
+  if (fragment_has_fields) {
+    *has_fields = true;
+  } else {
+    stream->length = separator;
+    start = separator;
+  }
+  if (fragment != NULL) {
+    json_fragment_store(fragment, stream->data + start, stream->length - start);
+  }
+}
+
+static bool json_same_app_identity(const bsg_app_info *a,
+                                   const bsg_app_info *b) {
+  return strcmp(a->version, b->version) == 0 && strcmp(a->id, b->id) == 0 &&
+         strcmp(a->type, b->type) == 0 &&
+         strcmp(a->release_stage, b->release_stage) == 0 &&
+         a->version_code == b->version_code &&
+         strcmp(a->build_uuid, b->build_uuid) == 0 &&
+         strcmp(a->binary_arch, b->binary_arch) == 0;
+}
+
+static bool json_same_device_identity(const bsg_device_info *a,
+                                      const bsg_device_info *b) {
+  return strcmp(a->os_name, b->os_name) == 0 && strcmp(a->id, b->id) == 0 &&
+         strcmp(a->locale, b->locale) == 0 &&
+         strcmp(a->os_version, b->os_version) == 0 &&
+         strcmp(a->manufacturer, b->manufacturer) == 0 &&
+         strcmp(a->model, b->model) == 0;
+}
+
+static bool json_same_device_platform(const bsg_device_info *a,
+                                      const bsg_device_info *b) {
+  if (a->api_level != b->api_level || strcmp(a->os_build, b->os_build) != 0 ||
+      a->cpu_abi_count != b->cpu_abi_count ||
+      a->total_memory != b->total_memory || a->jailbroken != b->jailbroken) {
+    return false;
+  }
+  int abi_max = sizeof(a->cpu_abi) / sizeof(bsg_cpu_abi);
+  for (int i = 0; i < a->cpu_abi_count && i < abi_max; i++) {
+    if (strcmp(a->cpu_abi[i].value, b->cpu_abi[i].value) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void json_stream_app_identity(bsg_json_stream *stream, bool *has_fields,
+                                     const void *source) {
+  const bsg_app_info *app = source;
+  json_stream_string_field(stream, has_fields, "version", app->version);
+  json_stream_string_field(stream, has_fields, "id", app->id);
+  json_stream_string_field(stream, has_fields, "type", app->type);
+  json_stream_string_field(stream, has_fields, "releaseStage",
+                           app->release_stage);
+  json_stream_number_field(stream, has_fields, "versionCode",
+                           app->version_code);
+  if (strlen(app->build_uuid) > 0) {
+    json_stream_string_field(stream, has_fields, "buildUUID",
+                             app->build_uuid);
+  }
+  json_stream_string_field(stream, has_fields, "binaryArch",
+                           app->binary_arch);
+}
+
+static void json_stream_app(bsg_json_stream *stream, bool *has_fields,
+                            const bsg_app_info *app,
+                            bsg_json_fragment_cache *cache) {
+  bsg_json_object_mark mark;
+  json_stream_begin_object(stream, has_fields, "app", &mark);
+  bool reuse = cache != NULL && json_same_app_identity(&cache->app, app);
+  json_stream_fragment(stream, &mark.has_fields,
+                       cache != NULL ? &cache->app_identity : NULL, reuse,
+                       json_stream_app_identity, app);
+  if (cache != NULL && !reuse) {
+    cache->app = *app;
+  }
+  json_stream_number_field(stream, &mark.has_fields, "duration",
+                           app->duration);
+  json_stream_number_field(stream, &mark.has_fields, "durationInForeground",
+                           app->duration_in_foreground);
+  json_stream_bool_field(stream, &mark.has_fields, "inForeground",
+                         app->in_foreground);
+  json_stream_bool_field(stream, &mark.has_fields, "isLaunching",
+                         app->is_launching);
+  json_stream_end_object(stream, has_fields, &mark);
+}
+
+static void json_stream_device_identity(bsg_json_stream *stream,
+                                        bool *has_fields, const void *source) {
+  const bsg_device_info *device = source;
+  json_stream_string_field(stream, has_fields, "osName", device->os_name);
+  json_stream_string_field(stream, has_fields, "id", device->id);
+  json_stream_string_field(stream, has_fields, "locale", device->locale);
+  json_stream_string_field(stream, has_fields, "osVersion",
+                           device->os_version);
+  json_stream_string_field(stream, has_fields, "manufacturer",
+                           device->manufacturer);
+  json_stream_string_field(stream, has_fields, "model", device->model);
+}
+
+static void json_stream_device_platform(bsg_json_stream *stream,
+                                        bool *has_fields, const void *source) {
+  const bsg_device_info *device = source;
+  bsg_json_object_mark runtime_versions;
+  json_stream_begin_object(stream, has_fields, "runtimeVersions",
+                           &runtime_versions);
+  char android_api_level[sizeof "1234"];
+  snprintf(android_api_level, 4, "%d", device->api_level);
+  json_stream_string_field(stream, &runtime_versions.has_fields,
+                           "androidApiLevel", android_api_level);
+  json_stream_string_field(stream, &runtime_versions.has_fields, "osBuild",
+                           device->os_build);
+  json_stream_end_object(stream, has_fields, &runtime_versions);
+
+  json_stream_key(stream, has_fields, "cpuAbi");
+  json_stream_append(stream, "[", 1);
+  int cpu_abi_count = device->cpu_abi_count;
+  if (cpu_abi_count > (int)(sizeof(device->cpu_abi) / sizeof(bsg_cpu_abi))) {
+    cpu_abi_count = sizeof(device->cpu_abi) / sizeof(bsg_cpu_abi);
+  }
+  bool abi_written = false;
+  for (int i = 0; i < cpu_abi_count; i++) {
+    if (json_is_valid_utf8(device->cpu_abi[i].value)) {
+      if (abi_written) {
+        json_stream_append(stream, ",", 1);
+      }
+      json_stream_append_string(stream, device->cpu_abi[i].value);
+      abi_written = true;
+    }
+  }
+  json_stream_append(stream, "]", 1);
+
+  json_stream_number_field(stream, has_fields, "totalMemory",
+                           device->total_memory);
+  json_stream_bool_field(stream, has_fields, "jailbroken", device->jailbroken);
+}
+
+static void json_stream_device(bsg_json_stream *stream, bool *has_fields,
+                               const bsg_device_info *device,
+                               bsg_json_fragment_cache *cache) {
+  bsg_json_object_mark mark;
+  json_stream_begin_object(stream, has_fields, "device", &mark);
+  bool reuse_identity =
+      cache != NULL && json_same_device_identity(&cache->device, device);
+  json_stream_fragment(stream, &mark.has_fields,
+                       cache != NULL ? &cache->device_identity : NULL,
+                       reuse_identity, json_stream_device_identity, device);
+  json_stream_string_field(stream, &mark.has_fields, "orientation",
+                           device->orientation);
+  bool reuse_platform =
+      cache != NULL && json_same_device_platform(&cache->device, device);
+  json_stream_fragment(stream, &mark.has_fields,
+                       cache != NULL ? &cache->device_platform : NULL,
+                       reuse_platform, json_stream_device_platform, device);
+  if (cache != NULL && !(reuse_identity && reuse_platform)) {
+    cache->device = *device;
+  }
+
+  char report_time[sizeof "2018-10-08T12:07:09Z"];
+  struct tm report_tm;
+  if (device->time > 0 && gmtime_r(&device->time, &report_tm) != NULL &&
+      strftime(report_time, sizeof report_time, "%FT%TZ", &report_tm) > 0) {
+    json_stream_string_field(stream, &mark.has_fields, "time", report_time);
+  }
+  json_stream_end_object(stream, has_fields, &mark);
+}
+
+static void json_stream_user(bsg_json_stream *stream, bool *has_fields,
+                             const bugsnag_user *user) {
+  bsg_json_object_mark mark;
+  json_stream_begin_object(stream, has_fields, "user", &mark);
+  if (strlen(user->name) > 0)
+    json_stream_string_field(stream, &mark.has_fields, "name", user->name);
+  if (strlen(user->email) > 0)
+    json_stream_string_field(stream, &mark.has_fields, "email", user->email);
+  if (strlen(user->id) > 0)
+    json_stream_string_field(stream, &mark.has_fields, "id", user->id);
+  json_stream_end_object(stream, has_fields, &mark);
+}
+
+static void json_stream_session(bsg_json_stream *stream, bool *has_fields,
+                                bugsnag_event *event) {
+  if (!bugsnag_event_has_session(event)) {
+    return;
+  }
+  bsg_json_object_mark mark, events;
+  json_stream_begin_object(stream, has_fields, "session", &mark);
+  json_stream_string_field(stream, &mark.has_fields, "startedAt",
+                           event->session_start);
+  json_stream_string_field(stream, &mark.has_fields, "id", event->session_id);
+  json_stream_begin_object(stream, &mark.has_fields, "events", &events);
+  json_stream_number_field(stream, &events.has_fields, "handled",
+                           event->handled_events);
+  json_stream_number_field(stream, &events.has_fields, "unhandled",
+                           event->unhandled_events);
+  json_stream_end_object(stream, &mark.has_fields, &events);
+  json_stream_end_object(stream, has_fields, &mark);
+}
+
+/**
+ * Metadata keys containing '.' are split into nested objects by parson. This
+ * is rare enough that those events are left to the DOM serializer.
+ */
+static bool json_stream_has_nested_metadata(const bugsnag_event *event) {
+  for (int i = 0; i < event->metadata.value_count && i < BUGSNAG_METADATA_MAX;
+       i++) {
+    const bsg_metadata_value *value = &event->metadata.values[i];
+    if (strchr(bsg_metadata_value_section(&event->metadata, value), '.') !=
+            NULL ||
+        strchr(bsg_metadata_value_name(&event->metadata, value), '.') != NULL) {
+      return true;
+    }
+  }
+  uint32_t offset = 0;
+  bsg_metadata_arena_value value;
+  while (bsg_metadata_arena_next(&event->metadata_arena, &offset, &value)) {
+    if (strchr(value.section, '.') != NULL || strchr(value.name, '.') != NULL) {
+      return true;
+    }
+  }
+  for (int i = 0; i < BUGSNAG_CRUMBS_MAX; i++) {
+    bsg_breadcrumb_view crumb;
+    if (!bsg_event_get_breadcrumb(event, i, &crumb)) {
+      continue;
+    }
+    while (bsg_breadcrumb_next_value(&crumb, &value)) {
+      if (strchr(value.name, '.') != NULL) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bsg_json_fragment_cache *bsg_json_fragment_cache_new(void) {
+  return calloc(1, sizeof(bsg_json_fragment_cache));
+}
+
+void bsg_json_fragment_cache_free(bsg_json_fragment_cache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  free(cache->app_identity.json);
+  free(cache->device_identity.json);
+  free(cache->device_platform.json);
+  free(cache);
+}
+
+char *bsg_event_to_json_stream(bugsnag_event *event) {
+  return bsg_event_to_json_stream_cached(event, NULL);
+}
+
+char *bsg_event_to_json_stream_cached(bugsnag_event *event,
+                                      bsg_json_fragment_cache *cache) {
+  if (json_stream_has_nested_metadata(event)) {
+    return bsg_event_to_json(event);
+  }
+
+  bsg_json_stream stream = {0};
+  bool has_fields = false;
+  // app.activeScreen is the first metadata value set, if it can be set at all
+  bool has_active_screen = json_is_valid_utf8(event->app.active_screen);
+
+  json_stream_append(&stream, "{", 1);
+  json_stream_exceptions(&stream, &has_fields, &event->error);
+  json_stream_breadcrumbs(&stream, &has_fields, event);
+  json_stream_threads(&stream, &has_fields, event);
+  json_stream_feature_flags(&stream, &has_fields, event);
+  json_stream_string_field(&stream, &has_fields, "context", event->context);
+  if (strlen(event->grouping_hash) > 0) {
+    json_stream_string_field(&stream, &has_fields, "groupingHash",
+                             event->grouping_hash);
+  }
+  json_stream_severity_reason(&stream, &has_fields, event);
+  json_stream_app(&stream, &has_fields, &event->app, cache);
+  if (has_active_screen) {
+    json_stream_custom_metadata(&stream, &has_fields, &event->app,
+                                &event->metadata, &event->metadata_arena,
+                                true);
+  }
+  json_stream_device(&stream, &has_fields, &event->device, cache);
+  if (!has_active_screen) {
+    json_stream_custom_metadata(&stream, &has_fields, &event->app,
+                                &event->metadata, &event->metadata_arena,
+                                false);
+  }
+  json_stream_user(&stream, &has_fields, &event->user);
+  json_stream_session(&stream, &has_fields, event);
+  json_stream_append(&stream, "}", 1);
+
+  if (stream.failed) {
+    free(stream.data);
+    return NULL;
+  }
+  stream.data[stream.length] = '\0';
+  return stream.data;
+}
@@ -5,6 +5,42 @@
 
 char *bsg_event_to_json(bugsnag_event *event);
 
+/**
+ * Serialize an event to JSON in a single pass, without building a parson
+ * object tree. The output is identical to that of bsg_event_to_json().
+ *
+ * @param event the event to serialize
+ * @return an allocated JSON string, or NULL on failure
+ */
+char *bsg_event_to_json_stream(bugsnag_event *event);
+
+/**
+ * Encoded app and device fields which rarely change between events, so that a
+ * series of events from the same installation only encodes them once. A cache
+ * must only be used by one thread at a time.
+ */
+typedef struct bsg_json_fragment_cache bsg_json_fragment_cache;
+
+/**
+ * Create an empty fragment cache
+ *
+ * @return the cache, or NULL if it could not be allocated
+ */
+bsg_json_fragment_cache *bsg_json_fragment_cache_new(void);
+
+void bsg_json_fragment_cache_free(bsg_json_fragment_cache *cache);
+
+/**
+ * Serialize an event using bsg_event_to_json_stream(), reusing the fragments
+ * in the cache where the event's values match those they were encoded from.
+ *
+ * @param event the event to serialize
+ * @param cache the fragment cache, or NULL to encode every field
+ * @return an allocated JSON string, or NULL on failure
+ */
+char *bsg_event_to_json_stream_cached(bugsnag_event *event,
+                                      bsg_json_fragment_cache *cache);
+
 /** Serialization components (exposed for testing) */
 
 void bsg_serialize_context(const bugsnag_event *event, JSON_Object *event_obj);
@@ -17,6 +53,8 @@ void bsg_serialize_device_metadata(const bsg_device_info device,
                                    JSON_Object *event_obj);
 void bsg_serialize_custom_metadata(const bugsnag_metadata metadata,
                                    JSON_Object *event_obj);
+void bsg_serialize_metadata_arena(const bsg_metadata_arena *arena,
+                                  JSON_Object *event_obj);
 void bsg_serialize_user(const bugsnag_user user, JSON_Object *event_obj);
 void bsg_serialize_session(bugsnag_event *event, JSON_Object *event_obj);
 /**
@@ -11,6 +11,26 @@
 #define V2_BUGSNAG_CRUMBS_MAX 25
 #endif
 
+#ifndef V1_BUGSNAG_THREADS_MAX
+#define V1_BUGSNAG_THREADS_MAX 255
+#endif
+
+/*
+ * The capacities of every report written before version 12, which were fixed
+ * at these defaults whatever the current build is configured with
+ */
+#ifndef V1_BUGSNAG_FRAMES_MAX
+#define V1_BUGSNAG_FRAMES_MAX 192
+#endif
+
+#ifndef V1_BUGSNAG_METADATA_MAX
+#define V1_BUGSNAG_METADATA_MAX 128
+#endif
+
+#ifndef V3_BUGSNAG_CRUMBS_MAX
+#define V3_BUGSNAG_CRUMBS_MAX 50
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,9 +43,10 @@ extern "C" {
  * original structs whenever a field is added or changed.
  *
  * The bsg_report_header indicates what version was serialized to disk. Knowing
- * this information, it is possible to migrate old payloads by first serializing
- * them into an old struct, and then mapping them into the latest version of
- * bugsnag_event.
+ * this information, it is possible to migrate old payloads by viewing them as
+ * an old struct, and then mapping them into the latest version of
+ * bugsnag_event. Each struct here has a matching field table in
+ * event_reader.c, which must be kept in sync with it.
  */
 
 typedef struct {
@@ -45,15 +66,24 @@ typedef struct {
 
   /**
    * The number of frames used in the stacktrace. Must be less than
-   * BUGSNAG_FRAMES_MAX.
+   * V1_BUGSNAG_FRAMES_MAX.
    */
   ssize_t frame_count;
   /**
    * An ordered list of stack frames from the oldest to the most recent
    */
-  bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX];
+  bugsnag_stackframe stacktrace[V1_BUGSNAG_FRAMES_MAX];
 } bsg_exception;
 
+/** bsg_error as it was written before version 9 */
+typedef struct {
+  char errorClass[64];
+  char errorMessage[256];
+  char type[32];
+  ssize_t frame_count;
+  bugsnag_stackframe stacktrace[V1_BUGSNAG_FRAMES_MAX];
+} bsg_error_v1;
+
 typedef struct {
   char key[64];
   char value[64];
@@ -70,6 +100,30 @@ typedef struct {
   bsg_char_metadata_pair metadata[8];
 } bugsnag_breadcrumb_v1;
 
+/**
+ * A metadata value which carries its own section and name
+ */
+typedef struct {
+  char name[32];
+  char section[32];
+  bugsnag_metadata_type type;
+  bool bool_value;
+  char char_value[64];
+  double double_value;
+} bsg_metadata_value_v1;
+
+typedef struct {
+  int value_count;
+  bsg_metadata_value_v1 values[V1_BUGSNAG_METADATA_MAX];
+} bugsnag_metadata_v1;
+
+typedef struct {
+  char name[64];
+  char timestamp[37];
+  bugsnag_breadcrumb_type type;
+  bugsnag_metadata_v1 metadata;
+} bugsnag_breadcrumb_v2;
+
 typedef struct {
   char name[64];
   char id[64];
@@ -171,7 +225,7 @@ typedef struct {
   bsg_device_info_v1 device;
   bugsnag_user user;
   bsg_exception exception;
-  bugsnag_metadata metadata;
+  bugsnag_metadata_v1 metadata;
 
   int crumb_count;
   // Breadcrumbs are a ring; the first index moves as the
@@ -193,7 +247,7 @@ typedef struct {
   bsg_device_info_v1 device;
   bugsnag_user user;
   bsg_exception exception;
-  bugsnag_metadata metadata;
+  bugsnag_metadata_v1 metadata;
 
   int crumb_count;
   // Breadcrumbs are a ring; the first index moves as the
@@ -215,14 +269,14 @@ typedef struct {
   bsg_app_info_v2 app;
   bsg_device_info_v2 device;
   bugsnag_user user;
-  bsg_error error;
-  bugsnag_metadata metadata;
+  bsg_error_v1 error;
+  bugsnag_metadata_v1 metadata;
 
   int crumb_count;
   // Breadcrumbs are a ring; the first index moves as the
   // structure is filled and replaced.
   int crumb_first_index;
-  bugsnag_breadcrumb breadcrumbs[V2_BUGSNAG_CRUMBS_MAX];
+  bugsnag_breadcrumb_v2 breadcrumbs[V2_BUGSNAG_CRUMBS_MAX];
 
   char context[64];
   bugsnag_severity severity;
@@ -240,14 +294,14 @@ typedef struct {
   bsg_app_info_v2 app;
   bsg_device_info_v2 device;
   bugsnag_user user;
-  bsg_error error;
-  bugsnag_metadata metadata;
+  bsg_error_v1 error;
+  bugsnag_metadata_v1 metadata;
 
   int crumb_count;
   // Breadcrumbs are a ring; the first index moves as the
   // structure is filled and replaced.
   int crumb_first_index;
-  bugsnag_breadcrumb breadcrumbs[V2_BUGSNAG_CRUMBS_MAX];
+  bugsnag_breadcrumb_v2 breadcrumbs[V2_BUGSNAG_CRUMBS_MAX];
 
   char context[64];
   bugsnag_severity severity;
@@ -266,14 +320,14 @@ typedef struct {
   bsg_app_info_v3 app;
   bsg_device_info_v2 device;
   bugsnag_user user;
-  bsg_error error;
-  bugsnag_metadata metadata;
+  bsg_error_v1 error;
+  bugsnag_metadata_v1 metadata;
 
   int crumb_count;
   // Breadcrumbs are a ring; the first index moves as the
   // structure is filled and replaced.
   int crumb_first_index;
-  bugsnag_breadcrumb breadcrumbs[V2_BUGSNAG_CRUMBS_MAX];
+  bugsnag_breadcrumb_v2 breadcrumbs[V2_BUGSNAG_CRUMBS_MAX];
 
   char context[64];
   bugsnag_severity severity;
@@ -292,14 +346,14 @@ typedef struct {
   bsg_app_info_v3 app;
   bsg_device_info_v2 device;
   bugsnag_user user;
-  bsg_error error;
-  bugsnag_metadata metadata;
+  bsg_error_v1 error;
+  bugsnag_metadata_v1 metadata;
 
   int crumb_count;
   // Breadcrumbs are a ring; the first index moves as the
   // structure is filled and replaced.
   int crumb_first_index;
-  bugsnag_breadcrumb breadcrumbs[BUGSNAG_CRUMBS_MAX];
+  bugsnag_breadcrumb_v2 breadcrumbs[V3_BUGSNAG_CRUMBS_MAX];
 
   char context[64];
   bugsnag_severity severity;
@@ -318,14 +372,14 @@ typedef struct {
   bsg_app_info_v3 app;
   bsg_device_info_v2 device;
   bugsnag_user user;
-  bsg_error error;
-  bugsnag_metadata metadata;
+  bsg_error_v1 error;
+  bugsnag_metadata_v1 metadata;
 
   int crumb_count;
   // Breadcrumbs are a ring; the first index moves as the
   // structure is filled and replaced.
   int crumb_first_index;
-  bugsnag_breadcrumb breadcrumbs[BUGSNAG_CRUMBS_MAX];
+  bugsnag_breadcrumb_v2 breadcrumbs[V3_BUGSNAG_CRUMBS_MAX];
 
   char context[64];
   bugsnag_severity severity;
@@ -339,9 +393,42 @@ typedef struct {
   char api_key[64];
 
   int thread_count;
-  bsg_thread threads[BUGSNAG_THREADS_MAX];
+  bsg_thread threads[V1_BUGSNAG_THREADS_MAX];
 } bugsnag_report_v7;
 
+typedef struct {
+  bsg_notifier notifier;
+  bsg_app_info app;
+  bsg_device_info device;
+  bugsnag_user user;
+  bsg_error_v1 error;
+  bugsnag_metadata_v1 metadata;
+
+  int crumb_count;
+  // Breadcrumbs are a ring; the first index moves as the
+  // structure is filled and replaced.
+  int crumb_first_index;
+  bugsnag_breadcrumb_v2 breadcrumbs[V3_BUGSNAG_CRUMBS_MAX];
+
+  char context[64];
+  bugsnag_severity severity;
+
+  char session_id[33];
+  char session_start[33];
+  int handled_events;
+  int unhandled_events;
+  char grouping_hash[64];
+  bool unhandled;
+  char api_key[64];
+
+  int thread_count;
+  bsg_thread threads[V1_BUGSNAG_THREADS_MAX];
+
+  size_t feature_flag_count;
+  // the feature flags are appended to the file after the struct
+  bsg_feature_flag *feature_flags;
+} bugsnag_report_v8;
+
 #ifdef __cplusplus
 }
 #endif
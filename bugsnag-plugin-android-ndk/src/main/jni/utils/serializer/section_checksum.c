@@ -0,0 +1,27 @@
+#include "section_checksum.h"
+
+#define ADLER_MOD 65521
+
+/**
+ * The most bytes which can be summed before the sums must be reduced, as in
+ * zlib, so that the modulo is only taken once per block
+ */
+#define ADLER_BLOCK 5552
+
+uint32_t bsg_section_checksum(uint32_t checksum, const void *data,
+                              size_t length) {
+  const uint8_t *pos = data;
+  uint32_t a = checksum & 0xffff;
+  uint32_t b = checksum >> 16;
+  while (length > 0) {
+    size_t block = length < ADLER_BLOCK ? length : ADLER_BLOCK;
+    length -= block;
+    while (block-- > 0) {
+      a += *pos++;
+      b += a;
+    }
+    a %= ADLER_MOD;
+    b %= ADLER_MOD;
+  }
+  return (b << 16) | a;
+}
@@ -0,0 +1,34 @@
+/**
+ * The checksum which frames each section of a report, so that a reader can
+ * tell the sections which were written in full from those cut short by a
+ * process which died while writing them.
+ */
+#ifndef BUGSNAG_SECTION_CHECKSUM_H
+#define BUGSNAG_SECTION_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The checksum of no data. It is not 0, so that a section left zero-filled in
+ * a pre-allocated file never matches.
+ */
+#define BSG_SECTION_CHECKSUM_INIT 1
+
+/**
+ * Add data to a running Adler-32 checksum, starting from
+ * BSG_SECTION_CHECKSUM_INIT. Data may be added in pieces of any size.
+ */
+uint32_t bsg_section_checksum(uint32_t checksum, const void *data,
+                              size_t length) __asyncsafe;
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_SECTION_CHECKSUM_H
@@ -0,0 +1,135 @@
+#include "vectored_writer.h"
+
+#include "../string.h"
+
+#include <fcntl.h>
+#include <memory.h>
+#include <unistd.h>
+
+static bool bsg_writev_impl(const int fd, struct iovec *iov, int iov_count) {
+  // Try a few times, then give up.
+  // writev() will write less bytes on signal interruption, disk full, or
+  // resource limit.
+  for (int i = 0; i < 10 && iov_count > 0; i++) {
+    ssize_t written_count = writev(fd, iov, iov_count);
+    if (written_count < 0) {
+      return false;
+    }
+
+    // skip over everything which has been written
+    while (iov_count > 0 && (size_t)written_count >= iov->iov_len) {
+      written_count -= iov->iov_len;
+      iov++;
+      iov_count--;
+    }
+    if (iov_count > 0) {
+      iov->iov_base = (char *)iov->iov_base + written_count;
+      iov->iov_len -= written_count;
+    }
+  }
+
+  return iov_count == 0;
+}
+
+static bool bsg_vectored_writer_flush(bsg_buffered_writer *base) {
+  bsg_vectored_writer *writer = (bsg_vectored_writer *)base;
+  bool result = bsg_writev_impl(base->fd, writer->iov, writer->iov_count);
+  writer->iov_count = 0;
+  writer->scratch_pos = 0;
+  return result;
+}
+
+static bool bsg_vectored_writer_append(bsg_vectored_writer *writer,
+                                       const void *data, size_t length) {
+  if (writer->iov_count > 0) {
+    // extend the last iovec if this data follows on directly from it
+    struct iovec *last = &writer->iov[writer->iov_count - 1];
+    if ((char *)last->iov_base + last->iov_len == data) {
+      last->iov_len += length;
+      return true;
+    }
+  }
+
+  if (writer->iov_count == BSG_VECTOR_IOV_MAX) {
+    return false;
+  }
+  writer->iov[writer->iov_count].iov_base = (void *)data;
+  writer->iov[writer->iov_count].iov_len = length;
+  writer->iov_count++;
+  return true;
+}
+
+static bool bsg_vectored_writer_write(bsg_buffered_writer *base,
+                                      const void *data, size_t length) {
+  bsg_vectored_writer *writer = (bsg_vectored_writer *)base;
+  if (length == 0) {
+    return true;
+  }
+
+  if (length <= BSG_VECTOR_COPY_MAX) {
+    // small values are often on the caller's stack, so take a copy
+    if (length > BSG_VECTOR_SCRATCH_SIZE - writer->scratch_pos ||
+        writer->iov_count == BSG_VECTOR_IOV_MAX) {
+      if (!base->flush(base)) {
+        return false;
+      }
+    }
+
+    char *copy = writer->scratch + writer->scratch_pos;
+    memcpy(copy, data, length);
+    writer->scratch_pos += length;
+    return bsg_vectored_writer_append(writer, copy, length);
+  }
+
+  // the plan is full, so write it out and start another
+  if (writer->iov_count == BSG_VECTOR_IOV_MAX && !base->flush(base)) {
+    return false;
+  }
+  return bsg_vectored_writer_append(writer, data, length);
+}
+
+static bool bsg_vectored_write_string(bsg_buffered_writer *writer,
+                                      const char *s) {
+  // prefix with the string length uint32
+  const uint32_t length = bsg_strlen(s);
+  if (!writer->write(writer, &length, sizeof(length))) {
+    return false;
+  }
+
+  // then write the string data without trailing '\0'
+  return writer->write(writer, s, length);
+}
+
+static bool bsg_vectored_write_byte(bsg_buffered_writer *writer,
+                                    const uint8_t value) {
+  return writer->write(writer, &value, 1);
+}
+
+static bool bsg_vectored_writer_close(bsg_buffered_writer *writer) {
+  bool result = writer->flush(writer);
+  if (close(writer->fd) < 0) {
+    return false;
+  }
+  return result;
+}
+
+bool bsg_vectored_writer_open(bsg_vectored_writer *writer, const char *path) {
+  int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+  if (fd < 0) {
+    return false;
+  }
+
+  writer->base.fd = fd;
+  writer->base.pos = 0;
+  writer->base.mapping = NULL;
+  writer->base.mapping_size = 0;
+  writer->base.write = bsg_vectored_writer_write;
+  writer->base.write_string = bsg_vectored_write_string;
+  writer->base.write_byte = bsg_vectored_write_byte;
+  writer->base.flush = bsg_vectored_writer_flush;
+  writer->base.dispose = bsg_vectored_writer_close;
+  writer->iov_count = 0;
+  writer->scratch_pos = 0;
+
+  return true;
+}
@@ -0,0 +1,71 @@
+/**
+ * Async-safe vectored writer.
+ *
+ * This writer queues up data as a list of iovecs and writes them to disk with
+ * as few writev() calls as possible, instead of copying everything through a
+ * small buffer. It exposes the same interface as bsg_buffered_writer, and can
+ * be used anywhere one is expected via its base member.
+ */
+#ifndef BUGSNAG_VECTORED_WRITER_H
+#define BUGSNAG_VECTORED_WRITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "buffered_writer.h"
+
+/**
+ * The maximum number of pending iovecs before the writer must flush
+ */
+#define BSG_VECTOR_IOV_MAX 128
+
+/**
+ * Space for copies of small values (lengths, counts, flags) which cannot be
+ * referenced in place
+ */
+#define BSG_VECTOR_SCRATCH_SIZE 1024
+
+/**
+ * Writes of at most this many bytes are copied into the scratch space. Larger
+ * writes are referenced in place.
+ */
+#define BSG_VECTOR_COPY_MAX 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  /**
+   * The writer interface. Pass a pointer to this member to anything which
+   * expects a bsg_buffered_writer.
+   */
+  bsg_buffered_writer base;
+
+  struct iovec iov[BSG_VECTOR_IOV_MAX];
+  int iov_count;
+
+  char scratch[BSG_VECTOR_SCRATCH_SIZE];
+  size_t scratch_pos;
+} bsg_vectored_writer;
+
+/**
+ * Create a new vectored writer.
+ *
+ * Writes larger than BSG_VECTOR_COPY_MAX are not copied. The data passed to
+ * them must remain valid until the writer has been flushed or disposed.
+ *
+ * Note: This method is async-safe.
+ *
+ * @param writer The writer to initialize.
+ * @param path The path of the file to write to.
+ * @return True on success. Check errno on error.
+ */
+bool bsg_vectored_writer_open(bsg_vectored_writer *writer, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
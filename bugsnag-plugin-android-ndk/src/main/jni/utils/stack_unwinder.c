@@ -1,4 +1,6 @@
 #include "stack_unwinder.h"
+#include "health_counters.h"
+#include "module_index.h"
 #include "stack_unwinder_libcorkscrew.h"
 #include "stack_unwinder_libunwind.h"
 #include "stack_unwinder_libunwindstack.h"
@@ -7,6 +9,7 @@
 #include <asm/siginfo.h>
 #include <dlfcn.h>
 #include <event.h>
+#include <pthread.h>
 #include <ucontext.h>
 
 #define BSG_LIBUNWIND_LEVEL 21
@@ -15,18 +18,18 @@
 #define BSG_LIBCORKSCREW_MIN_LEVEL 16
 #define BSG_LIBCORKSCREW_MAX_LEVEL 19
 
+/** The frame limit of each capture path, 0 for BUGSNAG_FRAMES_MAX */
+static size_t bsg_stack_depth_limits[BSG_CAPTURE_PATH_COUNT];
+
 void bsg_set_unwind_types(int apiLevel, bool is32bit, bsg_unwinder *signal_type,
                           bsg_unwinder *other_type) {
 #if defined(__arm__)
   if (apiLevel >= BSG_LIBUNWIND_LEVEL_ARM32 && is32bit &&
       bsg_configure_libunwind(is32bit)) {
-    if (apiLevel >= BSG_LIBUNWIND_LEVEL) {
-      *signal_type = BSG_LIBUNWIND;
-    } else if (bsg_configure_libcorkscrew()) {
-      *signal_type = BSG_LIBCORKSCREW;
-    } else {
-      *signal_type = BSG_CUSTOM_UNWIND;
-    }
+    // libcorkscrew is loaded by bsg_prepare_unwinders(), and until then the
+    // signal handler falls back to custom unwinding
+    *signal_type = apiLevel >= BSG_LIBUNWIND_LEVEL ? BSG_LIBUNWIND
+                                                   : BSG_LIBCORKSCREW;
     *other_type = BSG_LIBUNWIND;
     return;
   }
@@ -39,12 +42,60 @@ void bsg_set_unwind_types(int apiLevel, bool is32bit, bsg_unwinder *signal_type,
     *signal_type = BSG_CUSTOM_UNWIND;
     *other_type = BSG_CUSTOM_UNWIND;
   }
+#if BSG_UNWIND_WITH_FRAME_POINTERS &&                                          \
+    (defined(__aarch64__) || defined(__x86_64__))
+  *other_type = BSG_FRAME_POINTER_UNWIND;
+#endif
+}
+
+void bsg_set_stack_depth_limit(bsg_capture_path path, size_t max_frames) {
+  if (path < BSG_CAPTURE_PATH_COUNT) {
+    __atomic_store_n(&bsg_stack_depth_limits[path], max_frames,
+                     __ATOMIC_RELAXED);
+  }
+}
+
+size_t bsg_stack_depth_limit(bsg_capture_path path) {
+  const size_t limit =
+      path < BSG_CAPTURE_PATH_COUNT
+          ? __atomic_load_n(&bsg_stack_depth_limits[path], __ATOMIC_RELAXED)
+          : 0;
+  return limit == 0 || limit > BUGSNAG_FRAMES_MAX ? BUGSNAG_FRAMES_MAX : limit;
+}
+
+/**
+ * Fill in a frame from the module index, returning false if its module is not
+ * indexed
+ */
+static bool insert_indexed_fileinfo(bugsnag_stackframe *frame) {
+  const bsg_module *module = bsg_module_index_find(frame->frame_address);
+  if (module == NULL) {
+    return false;
+  }
+  frame->load_address = module->start;
+  frame->line_number = frame->frame_address - frame->load_address;
+  if (module->path != NULL) {
+    bsg_strncpy(frame->filename, module->path, sizeof(frame->filename));
+  }
+  const char *symbol_name;
+  uintptr_t symbol_address;
+  if (bsg_module_find_symbol(module, frame->frame_address, &symbol_name,
+                             &symbol_address)) {
+    frame->symbol_address = symbol_address;
+    bsg_strncpy(frame->method, symbol_name, sizeof(frame->method));
+  }
+  return true;
 }
 
 void bsg_insert_fileinfo(ssize_t frame_count,
                          bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX]) {
   static Dl_info info;
+  // checked once, rather than taking the linker lock in dladdr for each frame
+  const bool use_index = bsg_module_index_current();
   for (int i = 0; i < frame_count; ++i) {
+    if (use_index && insert_indexed_fileinfo(&stacktrace[i])) {
+      continue;
+    }
     if (dladdr((void *)stacktrace[i].frame_address, &info) != 0) {
       stacktrace[i].load_address = (uintptr_t)info.dli_fbase;
       stacktrace[i].symbol_address = (uintptr_t)info.dli_saddr;
@@ -62,22 +113,139 @@ void bsg_insert_fileinfo(ssize_t frame_count,
   }
 }
 
-ssize_t bsg_unwind_stack(bsg_unwinder unwind_style,
-                         bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
-                         siginfo_t *info, void *user_context) {
+static void prepare_unwinder(bsg_unwinder unwind_style) {
+  switch (unwind_style) {
+  case BSG_LIBCORKSCREW:
+    bsg_configure_libcorkscrew();
+    break;
+  case BSG_LIBUNWINDSTACK:
+    bsg_libunwindstack_cache_maps();
+    break;
+  default:
+    break;
+  }
+}
+
+void bsg_prepare_unwinders(bsg_unwinder signal_unwind_style,
+                           bsg_unwinder unwind_style) {
+  static pthread_mutex_t bsg_prepare_mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_lock(&bsg_prepare_mutex);
+  prepare_unwinder(signal_unwind_style);
+  prepare_unwinder(unwind_style);
+  pthread_mutex_unlock(&bsg_prepare_mutex);
+}
+
+void bsg_warm_signal_unwinder(bsg_unwinder signal_unwind_style,
+                              bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+                              ssize_t frame_count) {
+  // the first stack unwound outside of a signal handler loads the signal
+  // unwinder, if it has not been prepared already
+  bsg_prepare_unwinders(signal_unwind_style, signal_unwind_style);
+  if (signal_unwind_style == BSG_LIBUNWINDSTACK) {
+    bsg_libunwindstack_warm_elf_cache(stacktrace, frame_count);
+  }
+}
+
+ssize_t bsg_unwind_stack_pcs(bsg_unwinder unwind_style,
+                             uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                             size_t max_frames, siginfo_t *info,
+                             void *user_context) {
+  if (max_frames > BUGSNAG_FRAMES_MAX) {
+    max_frames = BUGSNAG_FRAMES_MAX;
+  }
+  // every backend stops at max_frames itself, so a deep stack is not walked
+  // any further than is kept
   ssize_t frame_count = 0;
   if (unwind_style == BSG_LIBUNWINDSTACK) {
-    frame_count =
-        bsg_unwind_stack_libunwindstack(stacktrace, info, user_context);
+    frame_count = bsg_unwind_stack_libunwindstack(frames, max_frames, info,
+                                                  user_context);
   } else if (unwind_style == BSG_LIBUNWIND) {
-    frame_count = bsg_unwind_stack_libunwind(stacktrace, info, user_context);
-  } else if (unwind_style == BSG_LIBCORKSCREW) {
-    frame_count = bsg_unwind_stack_libcorkscrew(stacktrace, info, user_context);
+    frame_count =
+        bsg_unwind_stack_libunwind(frames, max_frames, info, user_context);
+  } else if (unwind_style == BSG_LIBCORKSCREW &&
+             bsg_libcorkscrew_configured()) {
+    frame_count =
+        bsg_unwind_stack_libcorkscrew(frames, max_frames, info, user_context);
+  } else if (unwind_style == BSG_FRAME_POINTER_UNWIND) {
+    frame_count =
+        bsg_unwind_stack_frame_pointer(frames, max_frames, info, user_context);
   } else {
-    frame_count = bsg_unwind_stack_simple(stacktrace, info, user_context);
+    frame_count =
+        bsg_unwind_stack_simple(frames, max_frames, info, user_context);
+  }
+  if (frame_count <= 1) {
+    bsg_health_count(BSG_HEALTH_UNWIND_SINGLE_FRAME);
+  } else if ((size_t)frame_count >= max_frames) {
+    bsg_health_count(BSG_HEALTH_UNWIND_FRAMES_LIMITED);
   }
+  return frame_count;
+}
+
+static void set_frame_addresses(bugsnag_stackframe *stacktrace,
+                                const uintptr_t *frames, ssize_t frame_count) {
+  for (ssize_t i = 0; i < frame_count; i++) {
+    stacktrace[i].frame_address = frames[i];
+  }
+}
+
+ssize_t
+bsg_unwind_stack_frames(bsg_unwinder unwind_style,
+                        bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+                        size_t max_frames, siginfo_t *info,
+                        void *user_context) {
+  uintptr_t frames[BUGSNAG_FRAMES_MAX];
+  const ssize_t frame_count = bsg_unwind_stack_pcs(unwind_style, frames,
+                                                   max_frames, info,
+                                                   user_context);
+  set_frame_addresses(stacktrace, frames, frame_count);
+  return frame_count;
+}
+
+ssize_t bsg_unwind_stack(bsg_unwinder unwind_style,
+                         bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+                         size_t max_frames, siginfo_t *info,
+                         void *user_context) {
+  ssize_t frame_count = bsg_unwind_stack_frames(unwind_style, stacktrace,
+                                                max_frames, info, user_context);
   bsg_insert_fileinfo(frame_count,
                       stacktrace); // none of this is safe ¯\_(ツ)_/¯
 
   return frame_count;
 }
+
+ssize_t bsg_unwind_stack_deferred(
+    bsg_unwinder unwind_style,
+    bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX], size_t max_frames,
+    bsg_frame_module_table *modules, siginfo_t *info, void *user_context) {
+  uintptr_t frames[BUGSNAG_FRAMES_MAX];
+  const ssize_t frame_count = bsg_unwind_stack_pcs(unwind_style, frames,
+                                                   max_frames, info,
+                                                   user_context);
+  return bsg_stack_from_pcs(frames, frame_count, stacktrace, modules);
+}
+
+ssize_t bsg_stack_from_pcs(const uintptr_t *frames, ssize_t frame_count,
+                           bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+                           bsg_frame_module_table *modules) {
+  if (frame_count > BUGSNAG_FRAMES_MAX) {
+    frame_count = BUGSNAG_FRAMES_MAX;
+  }
+  set_frame_addresses(stacktrace, frames, frame_count);
+  if (modules == NULL) {
+    bsg_insert_fileinfo(frame_count, stacktrace);
+    return frame_count;
+  }
+  if (!bsg_record_frame_modules(modules, frames, frame_count)) {
+    modules->count = 0;
+    bsg_insert_fileinfo(frame_count, stacktrace);
+    return frame_count;
+  }
+
+  // modules which did not fit in the table are looked up now instead
+  for (ssize_t i = 0; i < frame_count; i++) {
+    if (modules->frame_modules[i] == BSG_NO_FRAME_MODULE) {
+      insert_indexed_fileinfo(&stacktrace[i]);
+    }
+  }
+  return frame_count;
+}
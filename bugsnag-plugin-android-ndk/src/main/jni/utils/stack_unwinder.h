@@ -14,8 +14,36 @@ typedef enum {
   BSG_LIBUNWINDSTACK,
   BSG_LIBCORKSCREW,
   BSG_CUSTOM_UNWIND,
+  /** Walks frame pointers, see bsg_unwind_stack_frame_pointer() */
+  BSG_FRAME_POINTER_UNWIND,
 } bsg_unwinder;
 
+/**
+ * The paths through which a stack is captured, each of which has its own
+ * limit on the number of frames unwound, see bsg_set_stack_depth_limit()
+ */
+typedef enum {
+  /** Native crashes caught by the signal handler */
+  BSG_CAPTURE_SIGNAL,
+  /** Uncaught C++ exceptions reaching the terminate handler */
+  BSG_CAPTURE_CPP_TERMINATE,
+  /** The main thread's stack when an ANR is detected */
+  BSG_CAPTURE_ANR,
+  /** Handled errors passed to bugsnag_notify() and its variants */
+  BSG_CAPTURE_NOTIFY,
+  BSG_CAPTURE_PATH_COUNT
+} bsg_capture_path;
+
+#ifndef BSG_UNWIND_WITH_FRAME_POINTERS
+/**
+ * Whether stacks unwound outside a signal handler, such as for
+ * bugsnag_notify(), are walked using frame pointers rather than with
+ * libunwind. This is much quicker, but loses frames unless all of the app's
+ * native code keeps frame pointers. Only supported on arm64 and x86_64.
+ */
+#define BSG_UNWIND_WITH_FRAME_POINTERS 0
+#endif
+
 /**
  * Based on the current environment, determine what unwinding library to use.
  *
@@ -23,20 +51,109 @@ typedef enum {
  * Android API level 16-19: libunwind, unless in a signal handler. Then
  * libcorkscrew.
  * Everything else: custom unwinding logic
+ *
+ * Nothing is loaded here, see bsg_prepare_unwinders().
  */
 void bsg_set_unwind_types(int apiLevel, bool is32bit, bsg_unwinder *signal_type,
                           bsg_unwinder *other_type);
 
+/**
+ * Limit the frames unwound for a capture path, so that deep recursion stops
+ * unwinding there rather than at BUGSNAG_FRAMES_MAX. A max_frames of 0 or more
+ * than BUGSNAG_FRAMES_MAX restores the full depth. Set at install, before the
+ * handlers which read it are armed.
+ */
+void bsg_set_stack_depth_limit(bsg_capture_path path, size_t max_frames);
+
+/**
+ * The most frames unwound for a capture path, at most BUGSNAG_FRAMES_MAX
+ */
+size_t bsg_stack_depth_limit(bsg_capture_path path) __asyncsafe;
+
 /**
  * Unwind the stack using the preferred tool/style. If info and a user
  * context pointer are provided, the exception stack will be walked. Otherwise,
  * the current stack will be walked instead. The results will populate the
- * stacktrace
+ * stacktrace, stopping after max_frames, which is clamped to
+ * BUGSNAG_FRAMES_MAX.
  * @return the number of frames
  */
 ssize_t bsg_unwind_stack(bsg_unwinder unwind_style,
                          bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
-                         siginfo_t *info, void *user_context) __asyncsafe;
+                         size_t max_frames, siginfo_t *info,
+                         void *user_context) __asyncsafe;
+
+/**
+ * Unwind the stack as bsg_unwind_stack() does into a dense array of program
+ * counters, leaving everything else about the frames to be looked up later.
+ * Each unwinder fills this, so that its loop only writes a word per frame.
+ * @return the number of frames
+ */
+ssize_t bsg_unwind_stack_pcs(bsg_unwinder unwind_style,
+                             uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                             size_t max_frames, siginfo_t *info,
+                             void *user_context) __asyncsafe;
+
+/**
+ * Unwind the stack as bsg_unwind_stack() does, but only fill in the frame
+ * addresses
+ * @return the number of frames
+ */
+ssize_t
+bsg_unwind_stack_frames(bsg_unwinder unwind_style,
+                        bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+                        size_t max_frames, siginfo_t *info,
+                        void *user_context) __asyncsafe;
+
+/**
+ * Unwind the stack as bsg_unwind_stack() does, but only record the frame
+ * addresses and the modules containing them, which is quicker and leaves the
+ * frames to be completed by bsg_resolve_frame_modules() once the event is read
+ * back. Frames are filled in as usual if the module index is out of date.
+ * @return the number of frames
+ */
+ssize_t bsg_unwind_stack_deferred(
+    bsg_unwinder unwind_style,
+    bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX], size_t max_frames,
+    bsg_frame_module_table *modules, siginfo_t *info,
+    void *user_context) __asyncsafe;
+
+/**
+ * Fill a stacktrace from program counters captured earlier, such as at the
+ * site of a C++ throw. Modules are recorded to symbolicate the frames later as
+ * bsg_unwind_stack_deferred() does, unless modules is NULL, in which case the
+ * frames are filled in now as bsg_unwind_stack() does.
+ * @return the number of frames
+ */
+ssize_t bsg_stack_from_pcs(const uintptr_t *frames, ssize_t frame_count,
+                           bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+                           bsg_frame_module_table *modules) __asyncsafe;
+
+/**
+ * Fill in the file, load address and symbol of frames which only have their
+ * frame address, such as those from bsg_unwind_stack_frames()
+ */
+void bsg_insert_fileinfo(ssize_t frame_count,
+                         bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX]);
+
+/**
+ * Load the backends of the given unwinders, such as libcorkscrew and the
+ * cached maps of libunwindstack, which bsg_set_unwind_types() leaves until
+ * they are first needed. Until then a signal handler falls back to custom
+ * unwinding in place of libcorkscrew, and parses the maps for each crash.
+ * Does nothing for backends which are already loaded. Must not be called from
+ * a signal handler.
+ */
+void bsg_prepare_unwinders(bsg_unwinder signal_unwind_style,
+                           bsg_unwinder unwind_style);
+/**
+ * Prepare the signal unwinder to unwind through the frames of a stack unwound
+ * outside of a signal handler, such as for a handled error. Must not be called
+ * from a signal handler.
+ */
+void bsg_warm_signal_unwinder(bsg_unwinder signal_unwind_style,
+                              bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+                              ssize_t frame_count);
 
 #ifdef __cplusplus
 }
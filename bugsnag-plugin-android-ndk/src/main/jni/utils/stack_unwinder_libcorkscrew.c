@@ -5,8 +5,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-#include "string.h"
-
 typedef struct {
   uintptr_t absolute_pc;
   uintptr_t stack_top;
@@ -36,7 +34,8 @@ struct bsg_unwind_config {
 static struct bsg_unwind_config *bsg_global_unwind_cfg;
 
 bool bsg_libcorkscrew_configured() {
-  return bsg_global_unwind_cfg->cork_unwind_backtrace_signal_arch != NULL &&
+  return __atomic_load_n(&bsg_global_unwind_cfg, __ATOMIC_ACQUIRE) != NULL &&
+         bsg_global_unwind_cfg->cork_unwind_backtrace_signal_arch != NULL &&
          bsg_global_unwind_cfg->cork_unwind_backtrace_thread != NULL &&
          bsg_global_unwind_cfg->cork_acquire_my_map_info_list != NULL &&
          bsg_global_unwind_cfg->cork_release_my_map_info_list != NULL &&
@@ -45,31 +44,39 @@ bool bsg_libcorkscrew_configured() {
 }
 
 bool bsg_configure_libcorkscrew(void) {
-  bsg_global_unwind_cfg = calloc(1, sizeof(struct bsg_unwind_config));
+  if (bsg_global_unwind_cfg != NULL) {
+    return bsg_libcorkscrew_configured();
+  }
+  struct bsg_unwind_config *config =
+      calloc(1, sizeof(struct bsg_unwind_config));
+  if (config == NULL) {
+    return false;
+  }
   void *libcorkscrew = dlopen("libcorkscrew.so", RTLD_LAZY | RTLD_LOCAL);
   if (libcorkscrew != NULL) {
-    bsg_global_unwind_cfg->cork_unwind_backtrace_signal_arch =
+    config->cork_unwind_backtrace_signal_arch =
         dlsym(libcorkscrew, "unwind_backtrace_signal_arch");
-    bsg_global_unwind_cfg->cork_acquire_my_map_info_list =
+    config->cork_acquire_my_map_info_list =
         dlsym(libcorkscrew, "acquire_my_map_info_list");
-    bsg_global_unwind_cfg->cork_release_my_map_info_list =
+    config->cork_release_my_map_info_list =
         dlsym(libcorkscrew, "release_my_map_info_list");
-    bsg_global_unwind_cfg->cork_get_backtrace_symbols =
+    config->cork_get_backtrace_symbols =
         dlsym(libcorkscrew, "get_backtrace_symbols");
-    bsg_global_unwind_cfg->cork_free_backtrace_symbols =
+    config->cork_free_backtrace_symbols =
         dlsym(libcorkscrew, "free_backtrace_symbols");
-    bsg_global_unwind_cfg->cork_unwind_backtrace_thread =
+    config->cork_unwind_backtrace_thread =
         dlsym(libcorkscrew, "unwind_backtrace_thread");
   }
 
+  // published once complete, as a signal handler may check it at any time
+  __atomic_store_n(&bsg_global_unwind_cfg, config, __ATOMIC_RELEASE);
   return bsg_libcorkscrew_configured();
 }
 
-ssize_t
-bsg_unwind_stack_libcorkscrew(bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
-                              siginfo_t *info, void *user_context) {
-  backtrace_frame_t frames[BUGSNAG_FRAMES_MAX];
-  backtrace_symbol_t symbols[BUGSNAG_FRAMES_MAX];
+ssize_t bsg_unwind_stack_libcorkscrew(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                      size_t max_frames, siginfo_t *info,
+                                      void *user_context) {
+  backtrace_frame_t backtrace[BUGSNAG_FRAMES_MAX];
   map_info_t *(*acquire_my_map_info_list)(void) =
       bsg_global_unwind_cfg->cork_acquire_my_map_info_list;
   ssize_t (*unwind_backtrace_signal_arch)(
@@ -80,45 +87,29 @@ bsg_unwind_stack_libcorkscrew(bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
       bsg_global_unwind_cfg->cork_unwind_backtrace_thread;
   void (*release_my_map_info_list)(map_info_t *) =
       bsg_global_unwind_cfg->cork_release_my_map_info_list;
-  void (*get_backtrace_symbols)(const backtrace_frame_t *, size_t,
-                                backtrace_symbol_t *) =
-      bsg_global_unwind_cfg->cork_get_backtrace_symbols;
-  void (*free_backtrace_symbols)(backtrace_symbol_t *, size_t) =
-      bsg_global_unwind_cfg->cork_free_backtrace_symbols;
 
   ssize_t size;
   if (user_context != NULL) {
     map_info_t *const info_list = acquire_my_map_info_list();
-    size = unwind_backtrace_signal_arch(info, user_context, info_list, frames,
-                                        0, (size_t)BUGSNAG_FRAMES_MAX);
+    size = unwind_backtrace_signal_arch(info, user_context, info_list,
+                                        backtrace, 0, max_frames);
     release_my_map_info_list(info_list);
   } else {
-    size = unwind_backtrace_thread(getpid(), frames, 0,
-                                   (size_t)BUGSNAG_FRAMES_MAX);
+    size = unwind_backtrace_thread(getpid(), backtrace, 0, max_frames);
   }
 
-  get_backtrace_symbols(frames, (size_t)size, symbols);
+  // symbols are looked up afterwards, along with the file of each frame
   int frame_count = 0;
   for (int i = 0; i < size; i++) {
-    backtrace_frame_t backtrace_frame = frames[i];
-    backtrace_symbol_t backtrace_symbol = symbols[i];
-
-    if ((void *)backtrace_frame.absolute_pc == NULL) {
+    const uintptr_t pc = backtrace[i].absolute_pc;
+    if ((void *)pc == NULL) {
       continue; // nobody's home
     }
-    if (frame_count > 0 && backtrace_frame.absolute_pc ==
-                               stacktrace[frame_count - 1].frame_address) {
+    if (frame_count > 0 && pc == frames[frame_count - 1]) {
       continue; // already seen this
     }
-    if (backtrace_symbol.symbol_name != NULL) {
-      bsg_strncpy(stacktrace[frame_count].method, backtrace_symbol.symbol_name,
-                  sizeof(stacktrace[frame_count].method));
-    }
-
-    stacktrace[frame_count].frame_address = backtrace_frame.absolute_pc;
-    frame_count++;
+    frames[frame_count++] = pc;
   }
-  free_backtrace_symbols(symbols, (size_t)size);
 
   return frame_count;
 }
@@ -4,9 +4,18 @@
 #include "../event.h"
 #include <signal.h>
 
+/**
+ * Load libcorkscrew, returning whether it was found. Only loads it once, so
+ * must not be called from more than one thread at a time.
+ */
 bool bsg_configure_libcorkscrew(void);
 
-ssize_t
-bsg_unwind_stack_libcorkscrew(bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
-                              siginfo_t *info, void *user_context);
+/**
+ * Whether bsg_configure_libcorkscrew() has been called and found libcorkscrew
+ */
+bool bsg_libcorkscrew_configured(void);
+
+ssize_t bsg_unwind_stack_libcorkscrew(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                      size_t max_frames, siginfo_t *info,
+                                      void *user_context);
 #endif
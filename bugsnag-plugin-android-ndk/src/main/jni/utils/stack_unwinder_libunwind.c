@@ -1,7 +1,6 @@
 #include "stack_unwinder_libunwind.h"
 #include "build.h"
 #include <event.h>
-#include <malloc.h>
 #include <unwind.h>
 
 #if defined(__arm__)
@@ -10,14 +9,13 @@
 
 typedef struct {
   size_t frame_count;
-  uintptr_t frame_addresses[BUGSNAG_FRAMES_MAX];
+  size_t max_frames;
+  uintptr_t *frame_addresses;
 } bsg_libunwind_state;
 
-bsg_libunwind_state *bsg_global_libunwind_state;
 bool bsg_libunwind_global_is32bit = false;
 
 bool bsg_configure_libunwind(bool is32bit) {
-  bsg_global_libunwind_state = calloc(1, sizeof(bsg_libunwind_state));
   bsg_libunwind_global_is32bit = is32bit;
   return true;
 }
@@ -28,7 +26,7 @@ bsg_libunwind_callback(struct _Unwind_Context *context, void *arg) __asyncsafe {
 
   uintptr_t ip = _Unwind_GetIP(context);
 
-  if (state->frame_count >= BUGSNAG_FRAMES_MAX) {
+  if (state->frame_count >= state->max_frames) {
     return _URC_END_OF_STACK;
   } else if (state->frame_count > 0 && (void *)ip == NULL) { // nobody's home
     return _URC_NO_REASON;
@@ -40,16 +38,19 @@ bsg_libunwind_callback(struct _Unwind_Context *context, void *arg) __asyncsafe {
 }
 
 #if defined(__arm__)
-ssize_t bsg_unwind_stack_libunwind_arm32(
-    bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX], siginfo_t *info,
-    void *user_context) __asyncsafe {
+ssize_t bsg_unwind_stack_libunwind_arm32(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                         size_t max_frames, siginfo_t *info,
+                                         void *user_context) __asyncsafe {
   unw_cursor_t cursor;
   unw_context_t uc;
-  int index = 0;
+  size_t index = 0;
 
   unw_getcontext(&uc);
   unw_init_local(&cursor, &uc);
   // Initialize cursor state with register data, if any
+  if (max_frames == 0) {
+    return 0;
+  }
   if (user_context != NULL) {
     /**
      * Set the registers and initial frame to the values from the signal
@@ -81,36 +82,32 @@ ssize_t bsg_unwind_stack_libunwind_arm32(
     unw_set_reg(&cursor, UNW_REG_IP, signal_mcontext->arm_pc);
     unw_set_reg(&cursor, UNW_REG_SP, signal_mcontext->arm_sp);
     // Manually insert first frame to avoid being skipped in step()
-    stacktrace[index++].frame_address = signal_mcontext->arm_pc;
+    frames[index++] = signal_mcontext->arm_pc;
   }
 
-  while (unw_step(&cursor) > 0 && index < BUGSNAG_FRAMES_MAX) {
+  while (index < max_frames && unw_step(&cursor) > 0) {
     unw_word_t ip = 0;
     unw_get_reg(&cursor, UNW_REG_IP, &ip);
-    stacktrace[index++].frame_address = ip;
+    frames[index++] = ip;
   }
 
   return index;
 }
 #endif
-ssize_t
-bsg_unwind_stack_libunwind(bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
-                           siginfo_t *info, void *user_context) {
+ssize_t bsg_unwind_stack_libunwind(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                   size_t max_frames, siginfo_t *info,
+                                   void *user_context) {
 #if defined(__arm__)
   if (bsg_libunwind_global_is32bit) { // avoid this code path if a 64-bit device
                                       // is running 32-bit
-    return bsg_unwind_stack_libunwind_arm32(stacktrace, info, user_context);
+    return bsg_unwind_stack_libunwind_arm32(frames, max_frames, info,
+                                            user_context);
   }
 #endif
-  if (bsg_global_libunwind_state == NULL) {
-    return 0;
-  }
-  bsg_global_libunwind_state->frame_count = 0;
+  // the callback appends straight to the caller's frames
+  bsg_libunwind_state state = {
+      .frame_count = 0, .max_frames = max_frames, .frame_addresses = frames};
   // The return value of _Unwind_Backtrace sits on a throne of lies
-  _Unwind_Backtrace(bsg_libunwind_callback, bsg_global_libunwind_state);
-  for (int i = 0; i < bsg_global_libunwind_state->frame_count; ++i) {
-    stacktrace[i].frame_address =
-        bsg_global_libunwind_state->frame_addresses[i];
-  }
-  return bsg_global_libunwind_state->frame_count;
+  _Unwind_Backtrace(bsg_libunwind_callback, &state);
+  return state.frame_count;
 }
@@ -6,8 +6,8 @@
 
 bool bsg_configure_libunwind(bool is32bit);
 
-ssize_t
-bsg_unwind_stack_libunwind(bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
-                           siginfo_t *info, void *user_context);
+ssize_t bsg_unwind_stack_libunwind(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                   size_t max_frames, siginfo_t *info,
+                                   void *user_context);
 
 #endif
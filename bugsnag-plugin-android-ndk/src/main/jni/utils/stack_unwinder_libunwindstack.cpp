@@ -1,5 +1,8 @@
 #include "stack_unwinder_libunwindstack.h"
+#include "health_counters.h"
+#include "module_index.h"
 #include "string.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <ucontext.h>
 #include <unwindstack/Elf.h>
@@ -8,10 +11,64 @@
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
 
-ssize_t bsg_unwind_stack_libunwindstack(
-    bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX], siginfo_t *info,
-    void *user_context) {
-  if (user_context == NULL) {
+/**
+ * Maps parsed by bsg_libunwindstack_cache_maps(), along with the objects
+ * which were loaded at the time. Never freed, as a crash handler may be using
+ * them.
+ */
+static unwindstack::LocalMaps *bsg_cached_maps = nullptr;
+static bsg_loaded_objects bsg_cached_objects;
+
+void bsg_libunwindstack_cache_maps(void) {
+  if (bsg_cached_maps != nullptr) {
+    return;
+  }
+  const bsg_loaded_objects objects = bsg_get_loaded_objects();
+  unwindstack::LocalMaps *maps = new unwindstack::LocalMaps;
+  if (!maps->Parse()) {
+    delete maps;
+    return;
+  }
+  bsg_cached_objects = objects;
+  bsg_cached_maps = maps;
+}
+
+/**
+ * Whether the cached maps are still current. Walking the loaded objects is
+ * much cheaper than parsing /proc/self/maps again.
+ */
+static bool bsg_cached_maps_current() {
+  if (bsg_cached_maps == nullptr) {
+    return false;
+  }
+  return bsg_loaded_objects_equal(bsg_get_loaded_objects(),
+                                  bsg_cached_objects);
+}
+
+void bsg_libunwindstack_warm_elf_cache(
+    const bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+    ssize_t frame_count) {
+  static pthread_mutex_t bsg_warm_elf_mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_lock(&bsg_warm_elf_mutex);
+  if (bsg_cached_maps_current()) {
+    const std::shared_ptr<unwindstack::Memory> memory(
+        new unwindstack::MemoryLocal);
+    for (ssize_t i = 0; i < frame_count; i++) {
+      unwindstack::MapInfo *const map_info =
+          bsg_cached_maps->Find(stacktrace[i].frame_address);
+      if (map_info) {
+        // kept by the map info, where the signal handler finds it
+        map_info->GetElf(memory, false);
+      }
+    }
+  }
+  pthread_mutex_unlock(&bsg_warm_elf_mutex);
+}
+
+ssize_t bsg_unwind_stack_libunwindstack(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                        size_t max_frames, siginfo_t *info,
+                                        void *user_context) {
+  if (user_context == NULL || max_frames == 0) {
     return 0; // only handle unwinding from signals
   }
 
@@ -22,20 +79,36 @@ ssize_t bsg_unwind_stack_libunwindstack(
                                             user_context));
 
   std::string unw_function_name;
-  unwindstack::LocalMaps maps;
+  unwindstack::LocalMaps fresh_maps;
+  unwindstack::Maps *maps = bsg_cached_maps;
+  bool parsed_fresh_maps = false;
 
-  if (!maps.Parse()) {
-    stacktrace[0].frame_address = regs->pc(); // only known frame
-    return 1;
+  if (!bsg_cached_maps_current()) {
+    parsed_fresh_maps = true;
+    if (!fresh_maps.Parse()) {
+      bsg_health_count(BSG_HEALTH_MAPS_PARSE_FAILED);
+      frames[0] = regs->pc(); // only known frame
+      return 1;
+    }
+    maps = &fresh_maps;
   }
 
   const std::shared_ptr<unwindstack::Memory> memory(
       new unwindstack::MemoryLocal);
 
   int frame_count = 0;
-  for (int i = 0; i < BUGSNAG_FRAMES_MAX; i++) {
-    stacktrace[frame_count++].frame_address = regs->pc();
-    unwindstack::MapInfo *const map_info = maps.Find(regs->pc());
+  for (size_t i = 0; i < max_frames; i++) {
+    frames[frame_count++] = regs->pc();
+    unwindstack::MapInfo *map_info = maps->Find(regs->pc());
+    if (!map_info && !parsed_fresh_maps) {
+      // the frame may be in memory mapped since the cache was built, such as
+      // by a JIT
+      parsed_fresh_maps = true;
+      if (fresh_maps.Parse()) {
+        maps = &fresh_maps;
+        map_info = maps->Find(regs->pc());
+      }
+    }
     if (!map_info) {
       break;
     }
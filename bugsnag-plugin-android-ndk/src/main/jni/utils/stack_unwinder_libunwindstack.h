@@ -5,10 +5,30 @@
 #include <signal.h>
 
 #ifdef __cplusplus
-extern "C"
+extern "C" {
+#endif
+
+ssize_t bsg_unwind_stack_libunwindstack(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                        size_t max_frames, siginfo_t *info,
+                                        void *user_context);
+
+/**
+ * Parse the memory maps of the process ahead of a crash, so that unwinding
+ * only parses them again if libraries have been loaded or unloaded since, or
+ * a frame is outside of the cached maps.
+ */
+void bsg_libunwindstack_cache_maps(void);
+
+/**
+ * Load the ELF files and unwind tables for the frames of a stack unwound
+ * outside of a signal handler into the cached maps, so that a crash through
+ * the same libraries does not need to load them
+ */
+void bsg_libunwindstack_warm_elf_cache(
+    const bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
+    ssize_t frame_count);
+
+#ifdef __cplusplus
+}
 #endif
-    ssize_t
-    bsg_unwind_stack_libunwindstack(
-        bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX], siginfo_t *info,
-        void *user_context);
 #endif
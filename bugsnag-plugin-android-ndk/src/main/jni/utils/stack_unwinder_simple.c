@@ -1,31 +1,140 @@
 #include "stack_unwinder_simple.h"
 #include "string.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <ucontext.h>
 
-ssize_t
-bsg_unwind_stack_simple(bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
-                        siginfo_t *info, void *user_context) {
-  if (user_context != NULL) {
-    // program counter / instruction pointer
-    uintptr_t ip = 0;
-    ucontext_t *ctx = (ucontext_t *)user_context;
+uintptr_t bsg_context_pc(siginfo_t *info, void *user_context) {
+  if (user_context == NULL) {
+    return 0;
+  }
+  // program counter / instruction pointer
+  ucontext_t *ctx = (ucontext_t *)user_context;
 #if defined(__i386__)
-    ip = (uintptr_t)ctx->uc_mcontext.gregs[REG_EIP];
+  return (uintptr_t)ctx->uc_mcontext.gregs[REG_EIP];
 #elif defined(__x86_64__)
-    ip = (uintptr_t)ctx->uc_mcontext.gregs[REG_RIP];
+  return (uintptr_t)ctx->uc_mcontext.gregs[REG_RIP];
 #elif defined(__arm__)
-    ip = (uintptr_t)ctx->uc_mcontext.arm_ip;
+  return (uintptr_t)ctx->uc_mcontext.arm_ip;
 #elif defined(__aarch64__)
-    ip = (uintptr_t)ctx->uc_mcontext.regs[15];
+  return (uintptr_t)ctx->uc_mcontext.regs[15];
+#else
+  return (uintptr_t)info->si_addr;
+#endif
+}
+
+ssize_t bsg_unwind_stack_simple(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                size_t max_frames, siginfo_t *info,
+                                void *user_context) {
+  const uintptr_t ip = bsg_context_pc(info, user_context);
+  if (ip != 0 && max_frames > 0) {
+    frames[0] = ip;
+    return 1;
+  }
+  return 0;
+}
+
+#if defined(__aarch64__) || defined(__x86_64__)
+/**
+ * The record a function prologue pushes when built with frame pointers, which
+ * the frame pointer register then points to
+ */
+typedef struct bsg_frame_record {
+  const struct bsg_frame_record *next;
+  uintptr_t return_address;
+} bsg_frame_record;
+
+bool bsg_current_stack_bounds(uintptr_t *low, uintptr_t *high) {
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+    return false;
+  }
+  void *base = NULL;
+  size_t size = 0;
+  const bool found = pthread_attr_getstack(&attr, &base, &size) == 0;
+  pthread_attr_destroy(&attr);
+  *low = (uintptr_t)base;
+  *high = (uintptr_t)base + size;
+  return found && size > 0;
+}
+
+static uintptr_t strip_return_address(uintptr_t address) {
+#if defined(__aarch64__)
+  // remove any pointer authentication code from the unused upper bits
+  return address & 0x0000ffffffffffffULL;
 #else
-    ip = (uintptr_t)info->si_addr;
+  return address;
 #endif
-    if (ip != 0) {
-      stacktrace[0].frame_address = ip;
-      return 1;
+}
+
+ssize_t bsg_walk_frame_records(const void *start, uintptr_t low,
+                               uintptr_t high, uintptr_t *frames,
+                               ssize_t max_frames) {
+  const bsg_frame_record *record = start;
+  ssize_t frame_count = 0;
+  while (frame_count < max_frames) {
+    const uintptr_t address = (uintptr_t)record;
+    if (address < low || address > high - sizeof(bsg_frame_record) ||
+        address % sizeof(uintptr_t) != 0) {
+      break;
+    }
+    const uintptr_t return_address =
+        strip_return_address(record->return_address);
+    if (return_address == 0) {
+      break;
     }
+    frames[frame_count++] = return_address;
+
+    // callers' records are always further up the stack
+    if ((uintptr_t)record->next <= address) {
+      break;
+    }
+    record = record->next;
+  }
+  return frame_count;
+}
+
+ssize_t bsg_unwind_stack_frame_pointer(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                       size_t max_frames, siginfo_t *info,
+                                       void *user_context) {
+  uintptr_t low, high;
+  if (max_frames == 0 || !bsg_current_stack_bounds(&low, &high)) {
+    return bsg_unwind_stack_simple(frames, max_frames, info, user_context);
+  }
+
+  ssize_t frame_count = 0;
+  const bsg_frame_record *record;
+  if (user_context != NULL) {
+    ucontext_t *ctx = (ucontext_t *)user_context;
+#if defined(__aarch64__)
+    frames[frame_count++] = (uintptr_t)ctx->uc_mcontext.pc;
+    record = (const bsg_frame_record *)ctx->uc_mcontext.regs[29];
+#else
+    frames[frame_count++] = (uintptr_t)ctx->uc_mcontext.gregs[REG_RIP];
+    record = (const bsg_frame_record *)ctx->uc_mcontext.gregs[REG_RBP];
+#endif
+  } else {
+    record = __builtin_frame_address(0);
   }
 
+  return frame_count + bsg_walk_frame_records(record, low, high,
+                                              frames + frame_count,
+                                              max_frames - frame_count);
+}
+#else
+bool bsg_current_stack_bounds(uintptr_t *low, uintptr_t *high) {
+  return false;
+}
+
+ssize_t bsg_walk_frame_records(const void *start, uintptr_t low,
+                               uintptr_t high, uintptr_t *frames,
+                               ssize_t max_frames) {
   return 0;
 }
+
+ssize_t bsg_unwind_stack_frame_pointer(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                       size_t max_frames, siginfo_t *info,
+                                       void *user_context) {
+  return bsg_unwind_stack_simple(frames, max_frames, info, user_context);
+}
+#endif
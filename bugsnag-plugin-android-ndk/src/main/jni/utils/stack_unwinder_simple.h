@@ -4,7 +4,51 @@
 #include "../event.h"
 #include <signal.h>
 
-ssize_t
-bsg_unwind_stack_simple(bugsnag_stackframe stacktrace[BUGSNAG_FRAMES_MAX],
-                        siginfo_t *info, void *user_context);
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ssize_t bsg_unwind_stack_simple(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                size_t max_frames, siginfo_t *info,
+                                void *user_context);
+
+/**
+ * The program counter of a signal's user context, or 0 if there is none
+ */
+uintptr_t bsg_context_pc(siginfo_t *info, void *user_context);
+
+/**
+ * Unwind by following the chain of frame records pushed by functions built
+ * with frame pointers, starting from the user context if there is one or the
+ * caller otherwise. Each record must lie above the last within the current
+ * thread's stack, so a missing frame pointer ends the walk rather than reading
+ * outside the stack. Finding the bounds of the main thread's stack is not
+ * async-signal-safe, so this must not be used from a signal handler.
+ * Falls back to bsg_unwind_stack_simple() on other architectures.
+ */
+ssize_t bsg_unwind_stack_frame_pointer(uintptr_t frames[BUGSNAG_FRAMES_MAX],
+                                       size_t max_frames, siginfo_t *info,
+                                       void *user_context);
+
+/**
+ * Find the bounds of the current thread's stack, which is not
+ * async-signal-safe for the main thread. Returns false on architectures
+ * without frame pointer unwinding, or if the bounds are not known.
+ */
+bool bsg_current_stack_bounds(uintptr_t *low, uintptr_t *high);
+
+/**
+ * Record the return addresses of up to max_frames frame records from start,
+ * the frame address of a function built with frame pointers, stopping at the
+ * first record outside of the stack bounds given. Only reads memory, so is
+ * cheap enough to call for every C++ throw.
+ * @return the number of frames, 0 on other architectures
+ */
+ssize_t bsg_walk_frame_records(const void *start, uintptr_t low,
+                               uintptr_t high, uintptr_t *frames,
+                               ssize_t max_frames);
+
+#ifdef __cplusplus
+}
+#endif
 #endif
@@ -0,0 +1,226 @@
+#include "state_journal.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crash_info.h"
+#include "logger.h"
+#include "serializer.h"
+#include "string.h"
+
+/*
+ * The journal holds a header and then the environment, which is only read
+ * back by the same build of the library, so is checked against the event
+ * version, a revision of the environment layout and the size of the struct.
+ * On each launch the journal of the previous run is renamed aside, unless a
+ * crash handler ran in it, and a fresh one is mapped in its place.
+ */
+
+#define BSG_STATE_JOURNAL_MAGIC 0x62736a6e
+/**
+ * The event version and the revision of the bsg_environment layout, which is
+ * bumped when its fields are rearranged without changing its size
+ */
+#define BSG_STATE_JOURNAL_VERSION ((BUGSNAG_EVENT_VERSION << 8) | 2)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t env_size;
+  bsg_environment env;
+} bsg_state_journal;
+
+/**
+ * The path beside the report directory containing report_path with suffix
+ * appended, so that the journal is not mistaken for a pending report
+ */
+static bool journal_path(const char *report_path, const char *suffix,
+                         char *path, size_t size) {
+  bsg_strncpy(path, report_path, size);
+  char *separator = strrchr(path, '/');
+  if (separator == NULL ||
+      (size_t)(separator - path) + bsg_strlen(suffix) + 1 > size) {
+    return false;
+  }
+  strcpy(separator, suffix);
+  return true;
+}
+
+static bool is_valid_journal(const bsg_state_journal *journal) {
+  return journal->magic == BSG_STATE_JOURNAL_MAGIC &&
+         journal->version == BSG_STATE_JOURNAL_VERSION &&
+         journal->env_size == sizeof(bsg_environment);
+}
+
+/**
+ * Keep the journal at path for the next launch to report, if its run did not
+ * handle a crash, and otherwise remove it
+ */
+static void keep_last_run(const char *path, const char *last_run_path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  bool keep = false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(bsg_state_journal)) {
+    const bsg_state_journal *journal = mmap(NULL, sizeof(bsg_state_journal),
+                                            PROT_READ, MAP_PRIVATE, fd, 0);
+    if (journal != MAP_FAILED) {
+      // the state is only worth reporting once it has been populated
+      keep = is_valid_journal(journal) && !journal->env.handling_crash &&
+             journal->env.state_populated;
+      munmap((void *)journal, sizeof(bsg_state_journal));
+    }
+  }
+  close(fd);
+  if (keep) {
+    rename(path, last_run_path);
+  } else {
+    unlink(path);
+  }
+}
+
+bsg_environment *bsg_state_journal_map(const char *report_path) {
+  char path[sizeof(((bsg_environment *)0)->next_event_path)];
+  char last_run_path[sizeof(path)];
+  if (!journal_path(report_path, "-journal", path, sizeof(path)) ||
+      !journal_path(report_path, "-journal.last", last_run_path,
+                    sizeof(last_run_path))) {
+    return NULL;
+  }
+  keep_last_run(path, last_run_path);
+
+  int fd = open(path, O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return NULL;
+  }
+  bsg_state_journal *journal = NULL;
+  if (ftruncate(fd, sizeof(bsg_state_journal)) != 0) {
+    goto exit;
+  }
+  void *mapping = mmap(NULL, sizeof(bsg_state_journal), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    goto exit;
+  }
+  journal = mapping;
+  // fault in every page now rather than in setters or the signal handler
+  memset(journal, 0, sizeof(bsg_state_journal));
+  journal->magic = BSG_STATE_JOURNAL_MAGIC;
+  journal->version = BSG_STATE_JOURNAL_VERSION;
+  journal->env_size = sizeof(bsg_environment);
+
+exit:
+  // the mapping holds its own reference to the file
+  close(fd);
+  if (journal == NULL) {
+    BUGSNAG_LOG("Failed to map the state journal at %s", path);
+    unlink(path);
+    return NULL;
+  }
+  return &journal->env;
+}
+
+/**
+ * Clear everything the previous process held outside of the environment,
+ * which its pointers and descriptors no longer refer to
+ */
+static void detach_last_run(bsg_environment *env) {
+  env->next_event_mapping = NULL;
+  env->next_event_mapping_size = 0;
+  env->next_event_fd = -1;
+  env->last_run_info_fd = -1;
+  env->last_run_info_open = false;
+  env->task_dir_fd = -1;
+  env->on_error = NULL;
+
+  bugsnag_event *event = &env->next_event;
+  event->threads = NULL;
+  event->thread_count = 0;
+  event->thread_capacity = 0;
+  event->threads_truncated = false;
+  event->feature_flags = NULL;
+  event->feature_flag_count = 0;
+  event->feature_flag_strings = NULL;
+  event->feature_flag_strings_size = 0;
+  event->feature_flags_encoded = NULL;
+  event->feature_flags_encoded_size = 0;
+  memset(&event->metadata_arena, 0, sizeof(event->metadata_arena));
+  memset(&event->frame_modules, 0, sizeof(event->frame_modules));
+  event->error.frame_count = 0;
+}
+
+/**
+ * Fill in the state and times of the event as a crash handler would, as of
+ * when the journal was last written
+ */
+static void populate_last_run(bsg_environment *env, time_t ended) {
+  bugsnag_event *event = &env->next_event;
+  const time_t foreground_start_time =
+      bsg_event_state_apply(&env->event_state, event);
+  event->device.time = ended;
+  event->app.duration =
+      event->app.duration_ms_offset + ((ended - env->start_time) * 1000);
+  if (event->app.in_foreground && foreground_start_time > 0) {
+    event->app.duration_in_foreground =
+        event->app.duration_in_foreground_ms_offset +
+        ((ended - foreground_start_time) * 1000);
+  } else {
+    event->app.duration_in_foreground = 0;
+  }
+}
+
+bool bsg_state_journal_write_last_run(const char *report_path,
+                                      const char *error_class,
+                                      const char *message) {
+  char last_run_path[sizeof(((bsg_environment *)0)->next_event_path)];
+  if (!journal_path(report_path, "-journal.last", last_run_path,
+                    sizeof(last_run_path))) {
+    return false;
+  }
+  int fd = open(last_run_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool result = false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(bsg_state_journal)) {
+    goto exit;
+  }
+  // a private mapping, so that the state can be completed without changing
+  // the file
+  bsg_state_journal *journal = mmap(NULL, sizeof(bsg_state_journal),
+                                    PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (journal == MAP_FAILED) {
+    goto exit;
+  }
+  if (is_valid_journal(journal)) {
+    bsg_environment *env = &journal->env;
+    detach_last_run(env);
+    // the kernel updates the modification time as it writes the mapping back
+    populate_last_run(env, st.st_mtime);
+    bugsnag_event *event = &env->next_event;
+    event->unhandled = true;
+    event->severity = BSG_SEVERITY_ERR;
+    bsg_strncpy(event->error.errorClass, error_class,
+                sizeof(event->error.errorClass));
+    bsg_strncpy(event->error.errorMessage, message,
+                sizeof(event->error.errorMessage));
+    bsg_increment_unhandled_count(event);
+    bsg_event_freeze_breadcrumbs(event);
+    bsg_strncpy(env->next_event_path, report_path,
+                sizeof(env->next_event_path));
+    result = bsg_serialize_event_to_file(env);
+  }
+  munmap(journal, sizeof(bsg_state_journal));
+
+exit:
+  close(fd);
+  unlink(last_run_path);
+  return result;
+}
@@ -0,0 +1,43 @@
+/**
+ * A journal of the native state, which keeps the whole bsg_environment in a
+ * file mapped shared rather than on the heap. Setters update it at memory
+ * speed, and the kernel persists the last state however the process ends, so
+ * that the breadcrumbs, context and metadata of a process which was killed
+ * without a crash being handled can be reported on the next launch.
+ */
+#ifndef BUGSNAG_STATE_JOURNAL_H
+#define BUGSNAG_STATE_JOURNAL_H
+
+#include <stdbool.h>
+
+#include "../bugsnag_ndk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Map a zeroed environment in the journal beside the report directory
+ * containing report_path, first keeping the journal of the previous run if it
+ * ended without handling a crash. Returns NULL if the journal cannot be
+ * mapped, in which case the environment should be allocated on the heap.
+ */
+bsg_environment *bsg_state_journal_map(const char *report_path);
+
+/**
+ * Write the state kept from the previous run as an unhandled event to
+ * report_path, which must be in the same report directory as the journal,
+ * with the error class and message given. The feature flags, threads and
+ * metadata which did not fit in the event struct are not reported, as they
+ * were held on the heap. The kept state is removed either way.
+ *
+ * @return false if there was no state kept, or it could not be written
+ */
+bool bsg_state_journal_write_last_run(const char *report_path,
+                                      const char *error_class,
+                                      const char *message);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,24 +1,101 @@
 #include "string.h"
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 // Anything more than this and we shouldn't even be sending or using it.
 const size_t STRING_MAX_LENGTH = 1024 * 1024 * 10;
 
+/*
+ * The libc string functions are not guaranteed to be async-safe, so strings
+ * are scanned here a word at a time instead. Once the source is aligned, each
+ * load is a whole aligned word. An aligned load never crosses a page boundary,
+ * so reading the bytes after a terminator in the same word cannot fault, even
+ * though they are outside the string.
+ */
+
+#define BSG_WORD_SIZE sizeof(uintptr_t)
+#define BSG_WORD_ONES ((uintptr_t)-1 / 0xff)
+#define BSG_WORD_HIGHS (BSG_WORD_ONES * 0x80)
+
+#if defined(__SANITIZE_ADDRESS__)
+#define BSG_NO_SANITIZE_ADDRESS __attribute__((no_sanitize("address")))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define BSG_NO_SANITIZE_ADDRESS __attribute__((no_sanitize("address")))
+#endif
+#endif
+#ifndef BSG_NO_SANITIZE_ADDRESS
+#define BSG_NO_SANITIZE_ADDRESS
+#endif
+
+static inline bool word_has_zero(uintptr_t word) {
+  return ((word - BSG_WORD_ONES) & ~word & BSG_WORD_HIGHS) != 0;
+}
+
+static inline bool is_word_aligned(const char *pos) {
+  return ((uintptr_t)pos & (BSG_WORD_SIZE - 1)) == 0;
+}
+
+BSG_NO_SANITIZE_ADDRESS
+static size_t string_length(const char *str, size_t max) {
+  const char *pos = str;
+  size_t remaining = max;
+  for (; remaining > 0 && !is_word_aligned(pos); pos++, remaining--) {
+    if (*pos == '\0') {
+      return pos - str;
+    }
+  }
+  for (; remaining >= BSG_WORD_SIZE;
+       pos += BSG_WORD_SIZE, remaining -= BSG_WORD_SIZE) {
+    uintptr_t word;
+    memcpy(&word, pos, BSG_WORD_SIZE);
+    if (word_has_zero(word)) {
+      break;
+    }
+  }
+  for (; remaining > 0 && *pos != '\0'; pos++, remaining--) {
+  }
+  return pos - str;
+}
+
 void bsg_strcpy(char *dst, const char *src) { bsg_strncpy(dst, src, INT_MAX); }
 
 size_t bsg_strlen(const char *str) {
   if (str == NULL) {
     return 0;
   }
-  return strnlen(str, STRING_MAX_LENGTH);
+  return string_length(str, STRING_MAX_LENGTH);
 }
 
+BSG_NO_SANITIZE_ADDRESS
 void bsg_strncpy(char *dst, const char *src, size_t dst_size) {
   if (src == NULL || dst == NULL || dst_size == 0) {
     return;
   }
-  dst[0] = '\0';
-  strncat(dst, src, dst_size - 1);
+  size_t remaining = dst_size - 1;
+  for (; remaining > 0 && !is_word_aligned(src); remaining--) {
+    if (*src == '\0') {
+      goto exit;
+    }
+    *dst++ = *src++;
+  }
+  // whole words are copied until one holds the terminator
+  for (; remaining >= BSG_WORD_SIZE; remaining -= BSG_WORD_SIZE) {
+    uintptr_t word;
+    memcpy(&word, src, BSG_WORD_SIZE);
+    if (word_has_zero(word)) {
+      break;
+    }
+    memcpy(dst, &word, BSG_WORD_SIZE);
+    dst += BSG_WORD_SIZE;
+    src += BSG_WORD_SIZE;
+  }
+  for (; remaining > 0 && *src != '\0'; remaining--) {
+    *dst++ = *src++;
+  }
+
+exit:
+  *dst = '\0';
 }
@@ -0,0 +1,30 @@
+#include "string_ids.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static char *bsg_string_ids[BSG_STRING_ID_COUNT];
+
+bool bsg_string_id_set(int id, const char *value) {
+  if (id < 0 || id >= BSG_STRING_ID_COUNT || value == NULL) {
+    return false;
+  }
+  char *copy = strdup(value);
+  if (copy == NULL) {
+    return false;
+  }
+  char *expected = NULL;
+  if (!__atomic_compare_exchange_n(&bsg_string_ids[id], &expected, copy, false,
+                                   __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    free(copy);
+    return false;
+  }
+  return true;
+}
+
+const char *bsg_string_id_get(int id) {
+  if (id < 0 || id >= BSG_STRING_ID_COUNT) {
+    return NULL;
+  }
+  return __atomic_load_n(&bsg_string_ids[id], __ATOMIC_ACQUIRE);
+}
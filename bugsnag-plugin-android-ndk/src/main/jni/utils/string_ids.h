@@ -0,0 +1,34 @@
+/**
+ * Strings registered once under small integer ids, so that frequent updates
+ * from the JVM can pass the id of a string rather than the string itself
+ */
+#ifndef BUGSNAG_STRING_IDS_H
+#define BUGSNAG_STRING_IDS_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The number of ids available. Strings past this are passed as strings.
+ */
+#define BSG_STRING_ID_COUNT 256
+
+/**
+ * Register a copy of value under id. Each id can only be registered once, so
+ * that the strings returned by bsg_string_id_get() are never freed. Returns
+ * false if the id is out of range or already registered.
+ */
+bool bsg_string_id_set(int id, const char *value);
+
+/**
+ * The string registered under id, or NULL if there is none
+ */
+const char *bsg_string_id_get(int id);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_STRING_IDS_H
@@ -0,0 +1,214 @@
+#include "symbol_cache.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../event.h"
+#include "string.h"
+
+#define BSG_SYMBOL_CACHE_MAGIC 0x42534743
+#define BSG_SYMBOL_CACHE_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  /** The app build which was running when the symbols were found */
+  char build_uuid[64];
+  uint32_t count;
+  /** The entry to replace next once the cache is full */
+  uint32_t next;
+} bsg_symbol_cache_header;
+
+typedef struct {
+  uint64_t relative_pc;
+  uint64_t symbol_offset;
+  uint32_t build_id_length;
+  uint8_t build_id[BSG_BUILD_ID_MAX];
+  char name[256];
+} bsg_symbol_cache_entry;
+
+static struct {
+  pthread_mutex_t mutex;
+  char path[400];
+  char build_uuid[64];
+  bool loaded;
+  bool changed;
+  bsg_symbol_cache_header header;
+  bsg_symbol_cache_entry *entries;
+} bsg_symbol_cache = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+void bsg_symbol_cache_init(const char *path, const char *build_uuid) {
+  pthread_mutex_lock(&bsg_symbol_cache.mutex);
+  bsg_strncpy(bsg_symbol_cache.path, path, sizeof(bsg_symbol_cache.path));
+  bsg_strncpy(bsg_symbol_cache.build_uuid, build_uuid,
+              sizeof(bsg_symbol_cache.build_uuid));
+  bsg_symbol_cache.loaded = false;
+  bsg_symbol_cache.changed = false;
+  pthread_mutex_unlock(&bsg_symbol_cache.mutex);
+}
+
+static bool read_fully(int fd, void *data, size_t length) {
+  return read(fd, data, length) == (ssize_t)length;
+}
+
+static void read_entries(bsg_symbol_cache_header *header,
+                         bsg_symbol_cache_entry *entries) {
+  int fd = open(bsg_symbol_cache.path, O_RDONLY);
+  if (fd == -1) {
+    return;
+  }
+  bsg_symbol_cache_header stored;
+  if (read_fully(fd, &stored, sizeof(stored)) &&
+      stored.magic == BSG_SYMBOL_CACHE_MAGIC &&
+      stored.version == BSG_SYMBOL_CACHE_VERSION &&
+      stored.count <= BSG_SYMBOL_CACHE_MAX &&
+      stored.next < BSG_SYMBOL_CACHE_MAX &&
+      strncmp(stored.build_uuid, bsg_symbol_cache.build_uuid,
+              sizeof(stored.build_uuid)) == 0 &&
+      read_fully(fd, entries, stored.count * sizeof(bsg_symbol_cache_entry))) {
+    *header = stored;
+  }
+  close(fd);
+}
+
+/**
+ * Read the cache from disk if it has not been yet. Entries from another build
+ * of the app are dropped, as its libraries may have been updated since.
+ */
+static bool load_cache(void) {
+  if (bsg_symbol_cache.loaded) {
+    return bsg_symbol_cache.entries != NULL;
+  }
+  if (bsg_strlen(bsg_symbol_cache.path) == 0) {
+    return false;
+  }
+  bsg_symbol_cache.loaded = true;
+  if (bsg_symbol_cache.entries == NULL) {
+    bsg_symbol_cache.entries =
+        calloc(BSG_SYMBOL_CACHE_MAX, sizeof(bsg_symbol_cache_entry));
+    if (bsg_symbol_cache.entries == NULL) {
+      return false;
+    }
+  }
+
+  bsg_symbol_cache_header *header = &bsg_symbol_cache.header;
+  memset(header, 0, sizeof(bsg_symbol_cache_header));
+  header->magic = BSG_SYMBOL_CACHE_MAGIC;
+  header->version = BSG_SYMBOL_CACHE_VERSION;
+  bsg_strncpy(header->build_uuid, bsg_symbol_cache.build_uuid,
+              sizeof(header->build_uuid));
+  read_entries(header, bsg_symbol_cache.entries);
+  return true;
+}
+
+static bsg_symbol_cache_entry *find_entry(const uint8_t *build_id,
+                                          size_t build_id_length,
+                                          uint64_t relative_pc) {
+  for (uint32_t index = 0; index < bsg_symbol_cache.header.count; index++) {
+    bsg_symbol_cache_entry *entry = &bsg_symbol_cache.entries[index];
+    if (entry->relative_pc == relative_pc &&
+        entry->build_id_length == build_id_length &&
+        memcmp(entry->build_id, build_id, build_id_length) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+bool bsg_symbol_cache_lookup(const uint8_t *build_id, size_t build_id_length,
+                             uint64_t relative_pc, char *out_name,
+                             size_t name_size, uint64_t *out_symbol_offset) {
+  if (build_id_length == 0 || build_id_length > BSG_BUILD_ID_MAX) {
+    return false;
+  }
+  bool found = false;
+  pthread_mutex_lock(&bsg_symbol_cache.mutex);
+  if (load_cache()) {
+    const bsg_symbol_cache_entry *entry =
+        find_entry(build_id, build_id_length, relative_pc);
+    if (entry != NULL) {
+      bsg_strncpy(out_name, entry->name, name_size);
+      *out_symbol_offset = entry->symbol_offset;
+      found = true;
+    }
+  }
+  pthread_mutex_unlock(&bsg_symbol_cache.mutex);
+  return found;
+}
+
+void bsg_symbol_cache_add(const uint8_t *build_id, size_t build_id_length,
+                          uint64_t relative_pc, const char *name,
+                          uint64_t symbol_offset) {
+  if (build_id_length == 0 || build_id_length > BSG_BUILD_ID_MAX) {
+    return;
+  }
+  pthread_mutex_lock(&bsg_symbol_cache.mutex);
+  if (!load_cache() || find_entry(build_id, build_id_length, relative_pc)) {
+    goto exit;
+  }
+
+  bsg_symbol_cache_header *header = &bsg_symbol_cache.header;
+  bsg_symbol_cache_entry *entry;
+  if (header->count < BSG_SYMBOL_CACHE_MAX) {
+    entry = &bsg_symbol_cache.entries[header->count++];
+  } else {
+    entry = &bsg_symbol_cache.entries[header->next];
+    header->next = (header->next + 1) % BSG_SYMBOL_CACHE_MAX;
+  }
+  memset(entry, 0, sizeof(bsg_symbol_cache_entry));
+  entry->relative_pc = relative_pc;
+  entry->symbol_offset = symbol_offset;
+  entry->build_id_length = (uint32_t)build_id_length;
+  memcpy(entry->build_id, build_id, build_id_length);
+  bsg_strncpy(entry->name, name, sizeof(entry->name));
+  bsg_symbol_cache.changed = true;
+
+exit:
+  pthread_mutex_unlock(&bsg_symbol_cache.mutex);
+}
+
+void bsg_symbol_cache_save(void) {
+  char temp_path[sizeof(bsg_symbol_cache.path) + 4];
+  pthread_mutex_lock(&bsg_symbol_cache.mutex);
+  if (!bsg_symbol_cache.changed) {
+    goto exit;
+  }
+
+  // replace the file in one step, so that it is never read half written
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", bsg_symbol_cache.path);
+  int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) {
+    goto exit;
+  }
+  const bsg_symbol_cache_header *header = &bsg_symbol_cache.header;
+  const size_t entries_size = header->count * sizeof(bsg_symbol_cache_entry);
+  const bool written =
+      write(fd, header, sizeof(bsg_symbol_cache_header)) ==
+          sizeof(bsg_symbol_cache_header) &&
+      write(fd, bsg_symbol_cache.entries, entries_size) ==
+          (ssize_t)entries_size;
+  close(fd);
+  if (written && rename(temp_path, bsg_symbol_cache.path) == 0) {
+    bsg_symbol_cache.changed = false;
+  } else {
+    remove(temp_path);
+  }
+
+exit:
+  pthread_mutex_unlock(&bsg_symbol_cache.mutex);
+}
+
+void bsg_symbol_cache_release(void) {
+  bsg_symbol_cache_save();
+  pthread_mutex_lock(&bsg_symbol_cache.mutex);
+  // symbols which could not be saved are looked up again when needed
+  free(bsg_symbol_cache.entries);
+  bsg_symbol_cache.entries = NULL;
+  bsg_symbol_cache.loaded = false;
+  bsg_symbol_cache.changed = false;
+  pthread_mutex_unlock(&bsg_symbol_cache.mutex);
+}
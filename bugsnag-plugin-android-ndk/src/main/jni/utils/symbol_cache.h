@@ -0,0 +1,58 @@
+/**
+ * A small cache on disk of the symbols found for frames of deferred crash
+ * stacktraces, so that reports from the same build do not repeat the lookups
+ */
+#ifndef BUGSNAG_SYMBOL_CACHE_H
+#define BUGSNAG_SYMBOL_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The number of symbols kept, after which the oldest are replaced
+ */
+#define BSG_SYMBOL_CACHE_MAX 256
+
+/**
+ * Use the cache stored at path, discarding any entries recorded while another
+ * build of the app was running. The file is only read once it is needed.
+ */
+void bsg_symbol_cache_init(const char *path, const char *build_uuid);
+
+/**
+ * Find the symbol recorded for a relative address in the module with a build
+ * ID, copying its name into out_name. An empty name means the module has no
+ * symbol for the address. Returns false if the address is not cached.
+ */
+bool bsg_symbol_cache_lookup(const uint8_t *build_id, size_t build_id_length,
+                             uint64_t relative_pc, char *out_name,
+                             size_t name_size, uint64_t *out_symbol_offset);
+
+/**
+ * Record the symbol found for a relative address, or an empty name if there is
+ * none
+ */
+void bsg_symbol_cache_add(const uint8_t *build_id, size_t build_id_length,
+                          uint64_t relative_pc, const char *name,
+                          uint64_t symbol_offset);
+
+/**
+ * Write the cache back to disk, if symbols were added since it was read
+ */
+void bsg_symbol_cache_save(void);
+
+/**
+ * Write the cache back to disk and release its memory, such as when memory is
+ * low. It is read again the next time a symbol is looked up.
+ */
+void bsg_symbol_cache_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_SYMBOL_CACHE_H
@@ -0,0 +1,211 @@
+#include "thread_context.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "string.h"
+#include "threads.h"
+
+/*
+ * Each thread claims a slot the first time it sets context, and releases it
+ * when it exits. Only the owning thread writes a slot, so writers take no
+ * lock. Instead each write is bracketed by a sequence count which is odd while
+ * the slot is changing, and crash handlers copy a slot until they see the
+ * same even count before and after.
+ */
+
+typedef struct {
+  char name[32];
+  char value[64];
+} bsg_thread_context_value;
+
+typedef struct {
+  /** The thread owning the slot, or 0 if it is free */
+  pid_t tid;
+  uint32_t sequence;
+  char operation[sizeof(((bugsnag_event *)0)->context)];
+  int value_count;
+  bsg_thread_context_value values[BSG_THREAD_CONTEXT_VALUES_MAX];
+} bsg_thread_context;
+
+/** How many times a crash handler retries a slot which is being written */
+#define BSG_THREAD_CONTEXT_READ_ATTEMPTS 3
+
+static bsg_thread_context context_slots[BSG_THREAD_CONTEXT_SLOTS];
+
+static __thread bsg_thread_context *current_context;
+
+static pthread_key_t context_release_key;
+static pthread_once_t context_key_once = PTHREAD_ONCE_INIT;
+
+static void release_context(void *slot) {
+  bsg_thread_context *context = slot;
+  __atomic_store_n(&context->tid, 0, __ATOMIC_RELEASE);
+}
+
+static void create_release_key(void) {
+  pthread_key_create(&context_release_key, release_context);
+}
+
+/**
+ * The slot of the calling thread, claimed if it has none yet
+ */
+static bsg_thread_context *claim_context(void) {
+  if (current_context != NULL) {
+    return current_context;
+  }
+  pthread_once(&context_key_once, create_release_key);
+  const pid_t tid = (pid_t)syscall(SYS_gettid);
+  for (int i = 0; i < BSG_THREAD_CONTEXT_SLOTS; i++) {
+    bsg_thread_context *slot = &context_slots[i];
+    pid_t expected = 0;
+    if (__atomic_compare_exchange_n(&slot->tid, &expected, tid, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      current_context = slot;
+      break;
+    }
+  }
+  if (current_context == NULL) {
+    return NULL;
+  }
+  // a slot keeps the last writes of the thread which owned it before
+  bsg_thread_context_clear();
+  pthread_setspecific(context_release_key, current_context);
+  return current_context;
+}
+
+static void begin_write(bsg_thread_context *context) {
+  __atomic_store_n(&context->sequence, context->sequence + 1,
+                   __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_write(bsg_thread_context *context) {
+  __atomic_store_n(&context->sequence, context->sequence + 1,
+                   __ATOMIC_RELEASE);
+}
+
+void bsg_thread_context_set_operation(const char *operation) {
+  bsg_thread_context *context = claim_context();
+  if (context == NULL) {
+    return;
+  }
+  begin_write(context);
+  context->operation[0] = '\0';
+  bsg_strncpy(context->operation, operation, sizeof(context->operation));
+  end_write(context);
+}
+
+static int find_value(const bsg_thread_context *context, const char *name) {
+  for (int i = 0; i < context->value_count; i++) {
+    if (strcmp(context->values[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool bsg_thread_context_set_value(const char *name, const char *value) {
+  if (name == NULL) {
+    return false;
+  }
+  bsg_thread_context *context = claim_context();
+  if (context == NULL) {
+    return false;
+  }
+  int index = find_value(context, name);
+  if (value == NULL) {
+    if (index >= 0) {
+      begin_write(context);
+      context->value_count--;
+      context->values[index] = context->values[context->value_count];
+      end_write(context);
+    }
+    return true;
+  }
+  if (index < 0 && context->value_count == BSG_THREAD_CONTEXT_VALUES_MAX) {
+    return false;
+  }
+  begin_write(context);
+  if (index < 0) {
+    index = context->value_count++;
+    bsg_strncpy(context->values[index].name, name,
+                sizeof(context->values[index].name));
+  }
+  bsg_strncpy(context->values[index].value, value,
+              sizeof(context->values[index].value));
+  end_write(context);
+  return true;
+}
+
+void bsg_thread_context_clear(void) {
+  bsg_thread_context *context = current_context;
+  if (context == NULL) {
+    return;
+  }
+  begin_write(context);
+  context->operation[0] = '\0';
+  context->value_count = 0;
+  end_write(context);
+}
+
+/**
+ * Copy a slot, retrying while it is being written. The crashing thread may
+ * have been interrupted in the middle of a write to its own slot, in which
+ * case the last attempt is kept and its strings terminated.
+ */
+static bool copy_context(const bsg_thread_context *slot, pid_t tid,
+                         bsg_thread_context *copy) {
+  for (int attempt = 0; attempt < BSG_THREAD_CONTEXT_READ_ATTEMPTS;
+       attempt++) {
+    const uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    memcpy(copy, slot, sizeof(*copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const uint32_t after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    if (before == after && (before & 1) == 0) {
+      break;
+    }
+  }
+  if (copy->tid != tid) {
+    return false;
+  }
+  copy->operation[sizeof(copy->operation) - 1] = '\0';
+  if (copy->value_count < 0 ||
+      copy->value_count > BSG_THREAD_CONTEXT_VALUES_MAX) {
+    copy->value_count = 0;
+  }
+  for (int i = 0; i < copy->value_count; i++) {
+    bsg_thread_context_value *value = &copy->values[i];
+    value->name[sizeof(value->name) - 1] = '\0';
+    value->value[sizeof(value->value) - 1] = '\0';
+  }
+  return true;
+}
+
+bool bsg_thread_context_apply(pid_t tid, bugsnag_event *event) {
+  if (tid <= 0) {
+    return false;
+  }
+  for (int i = 0; i < BSG_THREAD_CONTEXT_SLOTS; i++) {
+    const bsg_thread_context *slot = &context_slots[i];
+    if (__atomic_load_n(&slot->tid, __ATOMIC_ACQUIRE) != tid) {
+      continue;
+    }
+    static bsg_thread_context copy;
+    if (!copy_context(slot, tid, &copy)) {
+      return false;
+    }
+    if (copy.operation[0] != '\0') {
+      bsg_strncpy(event->context, copy.operation, sizeof(event->context));
+    }
+    for (int j = 0; j < copy.value_count; j++) {
+      bugsnag_event_add_metadata_string(event, BSG_THREAD_CONTEXT_SECTION,
+                                        copy.values[j].name,
+                                        copy.values[j].value);
+    }
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,60 @@
+/**
+ * Context kept per thread: the operation a thread is performing and a few
+ * metadata values of its own. Each thread writes only its own slot, without
+ * taking a lock, and a crash handler merges the slot of the crashing thread
+ * into the report.
+ */
+#ifndef BUGSNAG_THREAD_CONTEXT_H
+#define BUGSNAG_THREAD_CONTEXT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "../event.h"
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The number of threads which can hold context at once. Threads past this
+ * have their context ignored.
+ */
+#define BSG_THREAD_CONTEXT_SLOTS 64
+
+/** The metadata values each thread can hold */
+#define BSG_THREAD_CONTEXT_VALUES_MAX 8
+
+/** The metadata section the values of the crashing thread are added to */
+#define BSG_THREAD_CONTEXT_SECTION "thread"
+
+/**
+ * Set the operation the calling thread is performing, which replaces the
+ * context of a report if the thread crashes. NULL clears it.
+ */
+void bsg_thread_context_set_operation(const char *operation);
+
+/**
+ * Set a metadata value of the calling thread, replacing any with the same
+ * name. NULL clears the value. Returns false if the thread has no free slot
+ * or value.
+ */
+bool bsg_thread_context_set_value(const char *name, const char *value);
+
+/**
+ * Clear the operation and values of the calling thread
+ */
+void bsg_thread_context_clear(void);
+
+/**
+ * Merge the context of a thread into an event: its operation replaces the
+ * event context, and its values are added to BSG_THREAD_CONTEXT_SECTION.
+ * Returns false if the thread has no context.
+ */
+bool bsg_thread_context_apply(pid_t tid, bugsnag_event *event) __asyncsafe;
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_THREAD_CONTEXT_H
@@ -0,0 +1,157 @@
+#include "thread_registry.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "string.h"
+#include "threads.h"
+
+/*
+ * The registry is an open-addressed hash table of thread ids. Registrations
+ * take a lock, while crash handlers read it without one: each slot's name is
+ * written before its id is published, and a removed thread leaves a marker so
+ * that the threads after it in the same chain are still found.
+ */
+
+#define SLOT_EMPTY 0
+#define SLOT_REMOVED (-1)
+
+typedef struct {
+  pid_t tid;
+  char name[sizeof(((bsg_thread *)0)->name)];
+} bsg_thread_slot;
+
+static pthread_mutex_t bsg_thread_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bsg_thread_slot bsg_thread_slots[BSG_THREAD_REGISTRY_SIZE];
+static bool bsg_thread_registry_active = false;
+
+static size_t slot_for_tid(pid_t tid) {
+  return (size_t)tid % BSG_THREAD_REGISTRY_SIZE;
+}
+
+static pid_t load_tid(const bsg_thread_slot *slot) {
+  return __atomic_load_n(&slot->tid, __ATOMIC_ACQUIRE);
+}
+
+static void store_tid(bsg_thread_slot *slot, pid_t tid) {
+  __atomic_store_n(&slot->tid, tid, __ATOMIC_RELEASE);
+}
+
+/**
+ * Find the slot holding tid, or where it would be added. Returns NULL if it
+ * is not registered and the table is full.
+ */
+static bsg_thread_slot *find_slot(pid_t tid, bool *out_found) {
+  bsg_thread_slot *free_slot = NULL;
+  const size_t first = slot_for_tid(tid);
+  *out_found = false;
+  for (size_t i = 0; i < BSG_THREAD_REGISTRY_SIZE; i++) {
+    bsg_thread_slot *slot =
+        &bsg_thread_slots[(first + i) % BSG_THREAD_REGISTRY_SIZE];
+    const pid_t slot_tid = load_tid(slot);
+    if (slot_tid == tid) {
+      *out_found = true;
+      return slot;
+    }
+    if (slot_tid == SLOT_REMOVED && free_slot == NULL) {
+      free_slot = slot;
+    } else if (slot_tid == SLOT_EMPTY) {
+      return free_slot != NULL ? free_slot : slot;
+    }
+  }
+  return free_slot;
+}
+
+static void add_locked(pid_t tid, const char *name) {
+  bool found;
+  bsg_thread_slot *slot = find_slot(tid, &found);
+  if (slot == NULL) {
+    return;
+  }
+  bsg_strncpy(slot->name, name, sizeof(slot->name));
+  if (!found) {
+    store_tid(slot, tid);
+  }
+}
+
+/**
+ * Replace the registry contents with the threads in /proc/self/task
+ */
+static void refill_locked(void) {
+  for (size_t i = 0; i < BSG_THREAD_REGISTRY_SIZE; i++) {
+    store_tid(&bsg_thread_slots[i], SLOT_EMPTY);
+  }
+  bsg_thread *threads = calloc(BSG_THREAD_REGISTRY_SIZE, sizeof(bsg_thread));
+  if (threads == NULL) {
+    return;
+  }
+  bool truncated;
+  const size_t count = bsg_capture_thread_states(
+      -1, threads, BSG_THREAD_REGISTRY_SIZE, 0, &truncated);
+  for (size_t i = 0; i < count; i++) {
+    add_locked(threads[i].id, threads[i].name);
+  }
+  free(threads);
+}
+
+void bsg_thread_registry_set_enabled(bool enabled) {
+  pthread_mutex_lock(&bsg_thread_registry_mutex);
+  // the table is refilled while crash handlers read the stat files instead
+  __atomic_store_n(&bsg_thread_registry_active, false, __ATOMIC_RELEASE);
+  if (enabled) {
+    refill_locked();
+    __atomic_store_n(&bsg_thread_registry_active, true, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&bsg_thread_registry_mutex);
+}
+
+bool bsg_thread_registry_enabled(void) {
+  return __atomic_load_n(&bsg_thread_registry_active, __ATOMIC_ACQUIRE);
+}
+
+void bsg_thread_registry_add(pid_t tid, const char *name) {
+  if (tid <= 0 || name == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&bsg_thread_registry_mutex);
+  add_locked(tid, name);
+  pthread_mutex_unlock(&bsg_thread_registry_mutex);
+}
+
+void bsg_thread_registry_remove(pid_t tid) {
+  if (tid <= 0) {
+    return;
+  }
+  pthread_mutex_lock(&bsg_thread_registry_mutex);
+  bool found;
+  bsg_thread_slot *slot = find_slot(tid, &found);
+  if (found) {
+    store_tid(slot, SLOT_REMOVED);
+  }
+  pthread_mutex_unlock(&bsg_thread_registry_mutex);
+}
+
+bool bsg_thread_registry_find(pid_t tid, bsg_thread *dest) {
+  if (tid <= 0 || !bsg_thread_registry_enabled()) {
+    return false;
+  }
+  const size_t first = slot_for_tid(tid);
+  for (size_t i = 0; i < BSG_THREAD_REGISTRY_SIZE; i++) {
+    const bsg_thread_slot *slot =
+        &bsg_thread_slots[(first + i) % BSG_THREAD_REGISTRY_SIZE];
+    const pid_t slot_tid = load_tid(slot);
+    if (slot_tid == SLOT_EMPTY) {
+      return false;
+    }
+    if (slot_tid == tid) {
+      dest->id = tid;
+      // a thread renamed while this is read still has a terminated name
+      memcpy(dest->name, slot->name, sizeof(dest->name));
+      dest->name[sizeof(dest->name) - 1] = '\0';
+      bsg_strncpy(dest->state, BSG_THREAD_REGISTRY_STATE, sizeof(dest->state));
+      return true;
+    }
+  }
+  return false;
+}
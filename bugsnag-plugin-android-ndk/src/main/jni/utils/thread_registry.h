@@ -0,0 +1,60 @@
+/**
+ * An optional table of the live threads and their names, kept up to date as
+ * threads start and stop so that crash handlers can copy it rather than read
+ * each thread's stat file
+ */
+#ifndef BUGSNAG_THREAD_REGISTRY_H
+#define BUGSNAG_THREAD_REGISTRY_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "../event.h"
+#include "build.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The number of slots in the registry. Threads past this are still found by
+ * reading their stat files.
+ */
+#define BSG_THREAD_REGISTRY_SIZE 512
+
+/**
+ * The state reported for registered threads, which is not tracked
+ */
+#define BSG_THREAD_REGISTRY_STATE "unknown"
+
+/**
+ * Start or stop using the registry. When it is enabled it is filled from
+ * /proc/self/task, after which registrations keep it up to date.
+ */
+void bsg_thread_registry_set_enabled(bool enabled);
+
+/**
+ * Whether crash handlers should look threads up in the registry
+ */
+bool bsg_thread_registry_enabled(void) __asyncsafe;
+
+/**
+ * Record that a thread has started, or has been renamed
+ */
+void bsg_thread_registry_add(pid_t tid, const char *name);
+
+/**
+ * Record that a thread has stopped
+ */
+void bsg_thread_registry_remove(pid_t tid);
+
+/**
+ * Copy a registered thread into dest. Returns false if tid is not registered,
+ * in which case its stat file must be read instead.
+ */
+bool bsg_thread_registry_find(pid_t tid, bsg_thread *dest) __asyncsafe;
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_THREAD_REGISTRY_H
@@ -3,8 +3,11 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#include "health_counters.h"
 #include "string.h"
+#include "thread_registry.h"
 #include "threads.h"
+#include "time_common.h"
 
 /*
  * We read thread states by scanning the tid list in `/proc/self/task`. Each
@@ -14,23 +17,25 @@
  * This behaviour needs to be async / signal-safe, which blocks us from using
  * many of the standard libc filesystem functions. To work-around this we resort
  * to Linux syscalls for the directory listing.
+ *
+ * When the thread registry is enabled, registered threads are copied from it
+ * and only the threads it has not seen have their stat file read.
  */
 
-#define TASK_STAT_PATH_PREFIX "/proc/self/task/"
-// we don't want the null-terminator in the length
-#define TASK_STAT_PATH_PREFIX_LEN (sizeof(TASK_STAT_PATH_PREFIX) - 1)
+#define TASK_DIR_PATH "/proc/self/task"
 #define TASK_STAT_PATH_SUFFIX "/stat"
 
-// in theory we could optimise this - since all paths have a common prefix
+/**
+ * The path of a stat file relative to /proc/self/task, which is opened with
+ * openat() to avoid looking up the full path of every thread
+ */
 static void path_for_tid_stat(char *dest, const char *tid) {
   size_t tidlen = bsg_strlen(tid);
-  size_t remaining = MAX_STAT_PATH_LENGTH;
-  bsg_strncpy(dest, TASK_STAT_PATH_PREFIX, remaining);
-  remaining -= TASK_STAT_PATH_PREFIX_LEN;
-  bsg_strncpy(&dest[TASK_STAT_PATH_PREFIX_LEN], tid, remaining);
-  remaining -= tidlen;
-  bsg_strncpy(&dest[TASK_STAT_PATH_PREFIX_LEN + tidlen], TASK_STAT_PATH_SUFFIX,
-              remaining);
+  bsg_strncpy(dest, tid, MAX_STAT_PATH_LENGTH);
+  if (tidlen < MAX_STAT_PATH_LENGTH) {
+    bsg_strncpy(&dest[tidlen], TASK_STAT_PATH_SUFFIX,
+                MAX_STAT_PATH_LENGTH - tidlen);
+  }
 }
 
 /**
@@ -141,12 +146,8 @@ end:
  * Reads the /stat file fields we are looking for (TID, Name, State) into `dest`
  * with a signal-safe approach.
  */
-static bool read_thread_state(bsg_thread *dest, const char *tid) {
-  // we filter out anything not numeric
-  if (tid[0] < '0' || tid[0] > '9') {
-    return false;
-  }
-
+static bool read_thread_state(bsg_thread *dest, int task_dir_fd,
+                              const char *tid) {
   char filename[MAX_STAT_PATH_LENGTH];
   path_for_tid_stat(filename, tid);
   // the content buffer for the stat file data, in the format:
@@ -155,46 +156,78 @@ static bool read_thread_state(bsg_thread *dest, const char *tid) {
   // {name}   = thread name char[16]
   // {status} = single character
   char content_buffer[64];
-  int stat_fd = open(filename, O_RDONLY);
+  int stat_fd = openat(task_dir_fd, filename, O_RDONLY);
 
-  if (stat_fd == 0) {
+  if (stat_fd < 0) {
     return false;
   }
 
-  size_t len = read(stat_fd, content_buffer, sizeof(content_buffer));
-  bool parse_success = parse_stat_content(dest, content_buffer, len);
+  ssize_t len = read(stat_fd, content_buffer, sizeof(content_buffer));
+  bool parse_success =
+      len > 0 && parse_stat_content(dest, content_buffer, (size_t)len);
   close(stat_fd);
   return parse_success;
 }
 
-size_t bsg_capture_thread_states(bsg_thread *threads, size_t max_threads) {
+int bsg_open_task_dir(void) {
+  return open(TASK_DIR_PATH, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+size_t bsg_capture_thread_states(int task_dir_fd, bsg_thread *threads,
+                                 size_t max_threads, uint64_t max_ns,
+                                 bool *out_truncated) {
   size_t total_thread_count = 0;
   struct dirent64 *entry;
   char buffer[1024];
   int available, offset;
+  *out_truncated = false;
 
-  int task_dir_fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY);
-  if (task_dir_fd == 0) {
+  // the directory is read from the start, however often it is captured
+  const bool owns_task_dir = task_dir_fd < 0;
+  if (owns_task_dir) {
+    task_dir_fd = bsg_open_task_dir();
+  } else if (lseek(task_dir_fd, 0, SEEK_SET) != 0) {
+    return 0;
+  }
+  if (task_dir_fd < 0) {
     return 0;
   }
 
-  while (total_thread_count < max_threads) {
+  const uint64_t started_ns = max_ns > 0 ? bsg_monotonic_time_ns() : 0;
+  while (!*out_truncated) {
     available = syscall(SYS_getdents64, task_dir_fd, buffer, sizeof(buffer));
     if (available <= 0) {
       break;
     }
 
-    for (offset = 0; offset < available && total_thread_count < max_threads;) {
+    for (offset = 0; offset < available; offset += entry->d_reclen) {
       entry = (struct dirent64 *)(buffer + offset);
-      if (read_thread_state(&threads[total_thread_count], entry->d_name)) {
+      // we filter out anything not numeric, such as "." and ".."
+      if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+        continue;
+      }
+      // there is another thread, which is over budget
+      if (total_thread_count >= max_threads) {
+        bsg_health_count(BSG_HEALTH_THREADS_OVER_CAPACITY);
+        *out_truncated = true;
+        break;
+      }
+      if (max_ns > 0 && bsg_monotonic_time_ns() - started_ns > max_ns) {
+        bsg_health_count(BSG_HEALTH_THREADS_OVER_BUDGET);
+        *out_truncated = true;
+        break;
+      }
+      bsg_thread *thread = &threads[total_thread_count];
+      if (bsg_thread_registry_find(atoi(entry->d_name), thread) ||
+          read_thread_state(thread, task_dir_fd, entry->d_name)) {
         total_thread_count += 1;
       }
-
-      offset += entry->d_reclen;
     }
   }
 
-  close(task_dir_fd);
+  if (owns_task_dir) {
+    close(task_dir_fd);
+  }
 
   return total_thread_count;
 }
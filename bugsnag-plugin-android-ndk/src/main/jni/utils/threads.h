@@ -10,8 +10,21 @@ extern "C" {
 
 #define MAX_STAT_PATH_LENGTH 64
 
-size_t bsg_capture_thread_states(bsg_thread *threads,
-                                 size_t max_threads) __asyncsafe;
+/**
+ * Open /proc/self/task ahead of a crash, so that thread states can be read
+ * relative to it. Returns -1 if it could not be opened.
+ */
+int bsg_open_task_dir(void);
+
+/**
+ * Read the state of up to max_threads threads into threads, relative to the
+ * task_dir_fd from bsg_open_task_dir(). If task_dir_fd is -1 the directory is
+ * opened for the call. Capture also stops once max_ns has passed, unless it
+ * is 0. out_truncated is set if any threads were left out.
+ */
+size_t bsg_capture_thread_states(int task_dir_fd, bsg_thread *threads,
+                                 size_t max_threads, uint64_t max_ns,
+                                 bool *out_truncated) __asyncsafe;
 
 #ifdef __cplusplus
 }
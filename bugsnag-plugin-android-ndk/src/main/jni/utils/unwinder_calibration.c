@@ -0,0 +1,266 @@
+#include "unwinder_calibration.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "stack_unwinder_libcorkscrew.h"
+#include "string.h"
+#include "time_common.h"
+
+/**
+ * The depth of the synthetic stack, enough to show that an unwinder keeps
+ * going through repeated frames
+ */
+#define BSG_CALIBRATION_DEPTH 8
+/**
+ * The number of times each unwinder is timed, keeping the quickest so that
+ * a preempted run does not count against it
+ */
+#define BSG_CALIBRATION_RUNS 16
+/**
+ * The number of callers of the synthetic stack which must also match
+ */
+#define BSG_CALIBRATION_CALLERS 2
+
+#define BSG_CALIBRATION_MAGIC 0x42534755
+
+typedef struct {
+  uint32_t magic;
+  char app_version[32];
+  int64_t version_code;
+  int32_t unwind_style;
+} bsg_calibration_record;
+
+typedef struct {
+  bsg_unwinder style;
+  uintptr_t *frames;
+  ssize_t frame_count;
+  uintptr_t recursion_return;
+  uint64_t fastest_ns;
+} bsg_calibration_probe;
+
+static ssize_t index_after_run(const uintptr_t *frames,
+                               ssize_t frame_count, uintptr_t address,
+                               int run_length) {
+  int run = 0;
+  for (ssize_t i = 0; i < frame_count; i++) {
+    if (frames[i] == address) {
+      run++;
+    } else if (run >= run_length) {
+      return i;
+    } else {
+      run = 0;
+    }
+  }
+  return -1;
+}
+
+bool bsg_unwinder_frames_agree(const uintptr_t *expected,
+                               ssize_t expected_count, const uintptr_t *frames,
+                               ssize_t frame_count, uintptr_t recursion_return,
+                               int recursion_depth) {
+  const ssize_t expected_callers = index_after_run(
+      expected, expected_count, recursion_return, recursion_depth);
+  const ssize_t callers =
+      index_after_run(frames, frame_count, recursion_return, recursion_depth);
+  if (expected_callers < 0 || callers < 0) {
+    return false;
+  }
+  for (int i = 0; i < BSG_CALIBRATION_CALLERS; i++) {
+    if (expected_callers + i >= expected_count) {
+      break;
+    }
+    if (callers + i >= frame_count ||
+        frames[callers + i] != expected[expected_callers + i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static __attribute__((noinline)) void
+unwind_synthetic_stack(bsg_calibration_probe *probe, int depth) {
+  if (depth > 0) {
+    unwind_synthetic_stack(probe, depth - 1);
+    __asm__ volatile("" ::: "memory"); // not a tail call
+    return;
+  }
+
+  // each deeper frame returns to the recursive call above
+  probe->recursion_return = (uintptr_t)__builtin_return_address(0);
+  probe->fastest_ns = UINT64_MAX;
+  for (int run = 0; run < BSG_CALIBRATION_RUNS; run++) {
+    const uint64_t started_at = bsg_monotonic_time_ns();
+    probe->frame_count =
+        bsg_unwind_stack_pcs(probe->style, probe->frames, BUGSNAG_FRAMES_MAX,
+                             NULL, NULL);
+    const uint64_t elapsed = bsg_monotonic_time_ns() - started_at;
+    if (elapsed < probe->fastest_ns) {
+      probe->fastest_ns = elapsed;
+    }
+  }
+}
+
+static bool probe_unwinder(bsg_unwinder style, bsg_calibration_probe *probe) {
+  probe->style = style;
+  probe->frame_count = 0;
+  memset(probe->frames, 0, BUGSNAG_FRAMES_MAX * sizeof(uintptr_t));
+  unwind_synthetic_stack(probe, BSG_CALIBRATION_DEPTH);
+  return probe->frame_count > 0;
+}
+
+/**
+ * Unwinders which work without a signal context, and so can be compared on a
+ * synthetic stack. libcorkscrew is only usable once it has been configured.
+ * Frame pointers are only walked if the app opted in, as the synthetic stack
+ * cannot show whether its own libraries keep them.
+ */
+static bool can_unwind_current_stack(bsg_unwinder style) {
+  switch (style) {
+  case BSG_LIBUNWIND:
+    return true;
+#if BSG_UNWIND_WITH_FRAME_POINTERS &&                                          \
+    (defined(__aarch64__) || defined(__x86_64__))
+  case BSG_FRAME_POINTER_UNWIND:
+    return true;
+#endif
+  case BSG_LIBCORKSCREW:
+    return bsg_libcorkscrew_configured();
+  default:
+    return false;
+  }
+}
+
+bsg_unwinder bsg_calibrate_unwinder(bsg_unwinder default_style) {
+  static const bsg_unwinder candidates[] = {
+    BSG_LIBUNWIND,
+#if BSG_UNWIND_WITH_FRAME_POINTERS &&                                          \
+    (defined(__aarch64__) || defined(__x86_64__))
+    BSG_FRAME_POINTER_UNWIND,
+#endif
+    BSG_LIBCORKSCREW,
+  };
+  bsg_unwinder fastest_style = default_style;
+  uintptr_t *expected = calloc(BUGSNAG_FRAMES_MAX, sizeof(uintptr_t));
+  uintptr_t *frames = calloc(BUGSNAG_FRAMES_MAX, sizeof(uintptr_t));
+  if (expected == NULL || frames == NULL ||
+      !can_unwind_current_stack(default_style)) {
+    goto exit;
+  }
+
+  bsg_calibration_probe reference = {.frames = expected};
+  if (!probe_unwinder(default_style, &reference) ||
+      !bsg_unwinder_frames_agree(expected, reference.frame_count, expected,
+                                 reference.frame_count,
+                                 reference.recursion_return,
+                                 BSG_CALIBRATION_DEPTH)) {
+    goto exit;
+  }
+
+  uint64_t fastest_ns = reference.fastest_ns;
+  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    const bsg_unwinder style = candidates[i];
+    if (style == default_style || !can_unwind_current_stack(style)) {
+      continue;
+    }
+    bsg_calibration_probe probe = {.frames = frames};
+    if (probe_unwinder(style, &probe) && probe.fastest_ns < fastest_ns &&
+        bsg_unwinder_frames_agree(expected, reference.frame_count, frames,
+                                  probe.frame_count, probe.recursion_return,
+                                  BSG_CALIBRATION_DEPTH)) {
+      fastest_style = style;
+      fastest_ns = probe.fastest_ns;
+    }
+  }
+
+exit:
+  free(expected);
+  free(frames);
+  return fastest_style;
+}
+
+typedef struct {
+  char path[400];
+  bsg_calibration_record record;
+  bsg_unwinder *unwind_style;
+} bsg_calibration_job;
+
+static bool read_record(const char *path, bsg_calibration_record *record) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  const bool found = read(fd, record, sizeof(bsg_calibration_record)) ==
+                         sizeof(bsg_calibration_record) &&
+                     record->magic == BSG_CALIBRATION_MAGIC;
+  close(fd);
+  return found;
+}
+
+static void write_record(const char *path,
+                         const bsg_calibration_record *record) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) {
+    return;
+  }
+  if (write(fd, record, sizeof(bsg_calibration_record)) !=
+      sizeof(bsg_calibration_record)) {
+    close(fd);
+    remove(path);
+    return;
+  }
+  close(fd);
+}
+
+static void *calibrate_unwinder(void *arg) {
+  bsg_calibration_job *job = arg;
+  bsg_calibration_record stored;
+  if (read_record(job->path, &stored) &&
+      stored.version_code == job->record.version_code &&
+      strncmp(stored.app_version, job->record.app_version,
+              sizeof(stored.app_version)) == 0) {
+    job->record.unwind_style = stored.unwind_style;
+  } else {
+    const bsg_unwinder default_style =
+        __atomic_load_n(job->unwind_style, __ATOMIC_RELAXED);
+    job->record.unwind_style = bsg_calibrate_unwinder(default_style);
+    write_record(job->path, &job->record);
+  }
+
+  if (can_unwind_current_stack((bsg_unwinder)job->record.unwind_style)) {
+    __atomic_store_n(job->unwind_style,
+                     (bsg_unwinder)job->record.unwind_style, __ATOMIC_RELAXED);
+  }
+  free(job);
+  return NULL;
+}
+
+void bsg_start_unwinder_calibration(const char *path, const char *app_version,
+                                    int64_t version_code,
+                                    bsg_unwinder *unwind_style) {
+  bsg_calibration_job *job = calloc(1, sizeof(bsg_calibration_job));
+  if (job == NULL) {
+    return;
+  }
+  bsg_strncpy(job->path, path, sizeof(job->path));
+  job->record.magic = BSG_CALIBRATION_MAGIC;
+  bsg_strncpy(job->record.app_version, app_version,
+              sizeof(job->record.app_version));
+  job->record.version_code = version_code;
+  job->unwind_style = unwind_style;
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&thread, &attr, calibrate_unwinder, job) != 0) {
+    BUGSNAG_LOG("Could not start unwinder calibration");
+    free(job);
+  }
+  pthread_attr_destroy(&attr);
+}
@@ -0,0 +1,46 @@
+/**
+ * Chooses the quickest unwinder which unwinds a synthetic stack correctly, for
+ * devices where the default is unusually slow
+ */
+#ifndef BUGSNAG_UNWINDER_CALIBRATION_H
+#define BUGSNAG_UNWINDER_CALIBRATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "stack_unwinder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Whether an unwinder found the same frames as the default unwinder through a
+ * synthetic stack: a run of recursion_depth frames returning to
+ * recursion_return, followed by the same callers.
+ */
+bool bsg_unwinder_frames_agree(const uintptr_t *expected,
+                               ssize_t expected_count, const uintptr_t *frames,
+                               ssize_t frame_count, uintptr_t recursion_return,
+                               int recursion_depth);
+
+/**
+ * Time each unwinder which can unwind the current stack on a synthetic stack,
+ * returning the quickest which agrees with default_style. Returns
+ * default_style if it cannot unwind the synthetic stack itself.
+ */
+bsg_unwinder bsg_calibrate_unwinder(bsg_unwinder default_style);
+
+/**
+ * On a background thread, replace *unwind_style with the result of
+ * bsg_calibrate_unwinder(). The result is stored at path and reused while the
+ * app version is unchanged, so that calibration only runs once per version.
+ */
+void bsg_start_unwinder_calibration(const char *path, const char *app_version,
+                                    int64_t version_code,
+                                    bsg_unwinder *unwind_style);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUGSNAG_UNWINDER_CALIBRATION_H
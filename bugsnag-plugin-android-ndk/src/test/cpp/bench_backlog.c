@@ -0,0 +1,570 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android/log.h>
+#include <jni.h>
+
+#include <bugsnag_ndk.h>
+#include <featureflags.h>
+#include <utils/pending_reports.h>
+#include <utils/serializer/event_reader.h>
+#include <utils/serializer/event_writer.h>
+#include <utils/serializer/json_writer.h>
+#include <utils/serializer/migrate.h>
+#include <utils/string.h>
+
+#include "test_alloc.h"
+
+#define BENCH_LOG(fmt, ...)                                                    \
+  __android_log_print(ANDROID_LOG_INFO, "BugsnagNDKBench", fmt, ##__VA_ARGS__)
+
+#define BENCH_REPORT_SIZE 4096
+
+/** The most frames, metadata values and feature flags in a generated report */
+#define BENCH_FRAMES_MAX 60
+#define BENCH_METADATA_MAX 120
+#define BENCH_FEATURE_FLAGS_MAX 100
+
+/**
+ * The formats of the corpus, each legacy version and then the current one,
+ * which generated reports take in turn
+ */
+static const int bench_versions[] = {1, 2, 3, 4, 5, 6, 7, 8,
+                                     BUGSNAG_EVENT_VERSION};
+#define BENCH_VERSION_COUNT                                                    \
+  (sizeof(bench_versions) / sizeof(bench_versions[0]))
+
+bool bsg_report_header_write(bsg_report_header *header, int fd);
+
+static uint64_t monotonic_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * A small LCG, so that the corpus is the same on every run
+ */
+static uint32_t next_random(uint32_t *seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 16) & 0x7fff;
+}
+
+static int random_between(uint32_t *seed, int low, int high) {
+  return low + (int)(next_random(seed) % (uint32_t)(high - low + 1));
+}
+
+/*
+ * Field fill shared by every format. Each report varies in the length of its
+ * stack, breadcrumbs and metadata, as the reports of a real backlog do.
+ */
+
+static const char *const bench_activities[] = {
+    "MainActivity", "SettingsActivity", "CameraActivity", "GalleryActivity"};
+
+static ssize_t fill_frames(bugsnag_stackframe *frames, int capacity,
+                           uint32_t *seed) {
+  int count = random_between(seed, 5, BENCH_FRAMES_MAX);
+  if (count > capacity) {
+    count = capacity;
+  }
+  for (int i = 0; i < count; i++) {
+    bugsnag_stackframe *frame = &frames[i];
+    const int library = random_between(seed, 0, 5);
+    frame->load_address = 0x7d2c400000 + library * 0x200000;
+    frame->frame_address =
+        frame->load_address + (uintptr_t)random_between(seed, 0x1000, 0x7ffff);
+    frame->symbol_address = frame->frame_address - 0x20;
+    snprintf(frame->filename, sizeof(frame->filename),
+             "/data/app/com.example.PhotoSnapPlus-1/lib/arm64/libgame_%d.so",
+             library);
+    snprintf(frame->method, sizeof(frame->method),
+             "_ZN4game6engine5Scene6updateEPNS_5ActorEi%d",
+             random_between(seed, 0, 999));
+  }
+  return count;
+}
+
+static void fill_metadata_v1(bugsnag_metadata_v1 *metadata, uint32_t *seed) {
+  int count = random_between(seed, 10, BENCH_METADATA_MAX);
+  if (count > V1_BUGSNAG_METADATA_MAX) {
+    count = V1_BUGSNAG_METADATA_MAX;
+  }
+  for (int i = 0; i < count; i++) {
+    bsg_metadata_value_v1 *value = &metadata->values[i];
+    snprintf(value->section, sizeof(value->section), "section_%d", i % 6);
+    snprintf(value->name, sizeof(value->name), "key_%03d", i);
+    switch (i % 3) {
+    case 0:
+      value->type = BSG_METADATA_CHAR_VALUE;
+      bsg_strncpy(value->char_value, "a value of a typical length for metadata",
+                  sizeof(value->char_value));
+      break;
+    case 1:
+      value->type = BSG_METADATA_NUMBER_VALUE;
+      value->double_value = i * 1.5;
+      break;
+    default:
+      value->type = BSG_METADATA_BOOL_VALUE;
+      value->bool_value = i % 2;
+      break;
+    }
+  }
+  metadata->value_count = count;
+}
+
+static int fill_crumbs_v1(bugsnag_breadcrumb_v1 *crumbs, uint32_t *seed) {
+  const int count = random_between(seed, 0, V1_BUGSNAG_CRUMBS_MAX);
+  for (int i = 0; i < count; i++) {
+    bugsnag_breadcrumb_v1 *crumb = &crumbs[i];
+    crumb->type = BSG_CRUMB_STATE;
+    snprintf(crumb->name, sizeof(crumb->name), "Activity resumed %d", i);
+    bsg_strncpy(crumb->timestamp, "2019-03-19T12:58:19+00:00",
+                sizeof(crumb->timestamp));
+    bsg_strncpy(crumb->metadata[0].key, "activity",
+                sizeof(crumb->metadata[0].key));
+    bsg_strncpy(crumb->metadata[0].value,
+                bench_activities[i % 4], sizeof(crumb->metadata[0].value));
+  }
+  return count;
+}
+
+static int fill_crumbs_v2(bugsnag_breadcrumb_v2 *crumbs, int capacity,
+                          uint32_t *seed) {
+  const int count = random_between(seed, 0, capacity);
+  for (int i = 0; i < count; i++) {
+    bugsnag_breadcrumb_v2 *crumb = &crumbs[i];
+    crumb->type = BSG_CRUMB_STATE;
+    snprintf(crumb->name, sizeof(crumb->name), "Activity resumed %d", i);
+    bsg_strncpy(crumb->timestamp, "2022-06-01T12:00:00.000Z",
+                sizeof(crumb->timestamp));
+    bsg_metadata_value_v1 *value = &crumb->metadata.values[0];
+    bsg_strncpy(value->section, "metaData", sizeof(value->section));
+    bsg_strncpy(value->name, "activity", sizeof(value->name));
+    value->type = BSG_METADATA_CHAR_VALUE;
+    bsg_strncpy(value->char_value, bench_activities[i % 4],
+                sizeof(value->char_value));
+    crumb->metadata.value_count = 1;
+  }
+  return count;
+}
+
+#define BENCH_FILL_COMMON(report, seed)                                        \
+  do {                                                                         \
+    bsg_strncpy(report->app.id, "com.example.PhotoSnapPlus",                   \
+                sizeof(report->app.id));                                       \
+    bsg_strncpy(report->app.release_stage, "production",                       \
+                sizeof(report->app.release_stage));                            \
+    snprintf(report->app.version, sizeof(report->app.version), "2.0.%d",       \
+             random_between(seed, 40, 60));                                    \
+    bsg_strncpy(report->app.build_uuid, "1234-9876-adfe",                      \
+                sizeof(report->app.build_uuid));                               \
+    report->app.duration = random_between(seed, 100, 30000);                   \
+    report->app.in_foreground = random_between(seed, 0, 1);                    \
+    bsg_strncpy(report->device.manufacturer, "Google",                         \
+                sizeof(report->device.manufacturer));                          \
+    bsg_strncpy(report->device.model, "Pixel 6",                               \
+                sizeof(report->device.model));                                 \
+    bsg_strncpy(report->device.os_version, "13",                               \
+                sizeof(report->device.os_version));                            \
+    report->device.api_level = random_between(seed, 21, 33);                   \
+    report->device.time = 1650000000 + random_between(seed, 0, 30000);         \
+    bsg_strncpy(report->user.id, "4523", sizeof(report->user.id));             \
+    bsg_strncpy(report->context, bench_activities[random_between(seed, 0, 3)], \
+                sizeof(report->context));                                      \
+    report->severity = BSG_SEVERITY_ERR;                                       \
+    bsg_strncpy(report->session_id, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",        \
+                sizeof(report->session_id));                                   \
+    report->handled_events = random_between(seed, 0, 5);                       \
+  } while (0)
+
+static void *legacy_report_v1(uint32_t *seed) {
+  bugsnag_report_v1 *report = calloc(1, sizeof(*report));
+  if (report != NULL) {
+    BENCH_FILL_COMMON(report, seed);
+    fill_metadata_v1(&report->metadata, seed);
+    bsg_strncpy(report->exception.name, "SIGSEGV",
+                sizeof(report->exception.name));
+    bsg_strncpy(report->exception.message, "Segmentation violation",
+                sizeof(report->exception.message));
+    report->exception.frame_count = fill_frames(
+        report->exception.stacktrace, V1_BUGSNAG_FRAMES_MAX, seed);
+    report->crumb_count = fill_crumbs_v1(report->breadcrumbs, seed);
+  }
+  return report;
+}
+
+static void *legacy_report_v2(uint32_t *seed) {
+  bugsnag_report_v2 *report = calloc(1, sizeof(*report));
+  if (report != NULL) {
+    BENCH_FILL_COMMON(report, seed);
+    fill_metadata_v1(&report->metadata, seed);
+    bsg_strncpy(report->exception.name, "SIGSEGV",
+                sizeof(report->exception.name));
+    bsg_strncpy(report->exception.message, "Segmentation violation",
+                sizeof(report->exception.message));
+    report->exception.frame_count = fill_frames(
+        report->exception.stacktrace, V1_BUGSNAG_FRAMES_MAX, seed);
+    report->crumb_count = fill_crumbs_v1(report->breadcrumbs, seed);
+    report->unhandled_events = 1;
+  }
+  return report;
+}
+
+#define BENCH_LEGACY_REPORT(v, crumbs_max)                                     \
+  static void *legacy_report_v##v(uint32_t *seed) {                            \
+    bugsnag_report_v##v *report = calloc(1, sizeof(*report));                  \
+    if (report != NULL) {                                                      \
+      BENCH_FILL_COMMON(report, seed);                                         \
+      fill_metadata_v1(&report->metadata, seed);                               \
+      bsg_strncpy(report->error.errorClass, "SIGSEGV",                         \
+                  sizeof(report->error.errorClass));                           \
+      bsg_strncpy(report->error.errorMessage, "Segmentation violation",        \
+                  sizeof(report->error.errorMessage));                         \
+      bsg_strncpy(report->error.type, "c", sizeof(report->error.type));        \
+      report->error.frame_count =                                              \
+          fill_frames(report->error.stacktrace, V1_BUGSNAG_FRAMES_MAX, seed);  \
+      report->crumb_count =                                                    \
+          fill_crumbs_v2(report->breadcrumbs, crumbs_max, seed);               \
+      report->unhandled_events = 1;                                            \
+      report->unhandled = true;                                                \
+    }                                                                          \
+    return report;                                                             \
+  }
+
+BENCH_LEGACY_REPORT(3, V2_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_REPORT(4, V2_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_REPORT(5, V2_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_REPORT(6, V3_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_REPORT(7, V3_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_REPORT(8, V3_BUGSNAG_CRUMBS_MAX)
+
+typedef struct {
+  size_t size;
+  void *(*create)(uint32_t *seed);
+} bench_legacy_format;
+
+static const bench_legacy_format bench_legacy_formats[] = {
+    [1] = {sizeof(bugsnag_report_v1), legacy_report_v1},
+    [2] = {sizeof(bugsnag_report_v2), legacy_report_v2},
+    [3] = {sizeof(bugsnag_report_v3), legacy_report_v3},
+    [4] = {sizeof(bugsnag_report_v4), legacy_report_v4},
+    [5] = {sizeof(bugsnag_report_v5), legacy_report_v5},
+    [6] = {sizeof(bugsnag_report_v6), legacy_report_v6},
+    [7] = {sizeof(bugsnag_report_v7), legacy_report_v7},
+    [8] = {sizeof(bugsnag_report_v8), legacy_report_v8},
+};
+
+static bool write_legacy_report(int version, const char *path,
+                                uint32_t *seed) {
+  const bench_legacy_format *format = &bench_legacy_formats[version];
+  void *report = format->create(seed);
+  if (report == NULL) {
+    return false;
+  }
+  bool written = false;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd != -1) {
+    bsg_report_header header = {version, 0, {0}};
+    written = bsg_report_header_write(&header, fd) &&
+              write(fd, report, format->size) == (ssize_t)format->size;
+    close(fd);
+  }
+  free(report);
+  return written;
+}
+
+static void fill_current_event(bugsnag_event *event, uint32_t *seed) {
+  bsg_strncpy(event->api_key, "5d1e5fbd39a74caa1200142706a90b20",
+              sizeof(event->api_key));
+  BENCH_FILL_COMMON(event, seed);
+  event->app.is_launching = random_between(seed, 0, 4) == 0;
+  event->unhandled = true;
+  event->unhandled_events = 1;
+  bsg_strncpy(event->error.errorClass, "SIGSEGV",
+              sizeof(event->error.errorClass));
+  bsg_strncpy(event->error.errorMessage, "Segmentation violation",
+              sizeof(event->error.errorMessage));
+  bsg_strncpy(event->error.type, "c", sizeof(event->error.type));
+  event->error.frame_count =
+      fill_frames(event->error.stacktrace, BUGSNAG_FRAMES_MAX, seed);
+
+  char section[16], name[16];
+  const int values = random_between(seed, 10, BENCH_METADATA_MAX);
+  for (int i = 0; i < values; i++) {
+    snprintf(section, sizeof(section), "section_%d", i % 6);
+    snprintf(name, sizeof(name), "key_%03d", i);
+    bsg_add_metadata_value_str(&event->metadata, NULL, section, name,
+                               "a value of a typical length for metadata");
+  }
+  bsg_event_index_metadata(event);
+
+  bugsnag_breadcrumb *crumb = calloc(1, sizeof(bugsnag_breadcrumb));
+  if (crumb != NULL) {
+    const int crumbs = random_between(seed, 0, BUGSNAG_CRUMBS_MAX);
+    for (int i = 0; i < crumbs; i++) {
+      memset(crumb, 0, sizeof(bugsnag_breadcrumb));
+      crumb->type = BSG_CRUMB_STATE;
+      snprintf(crumb->name, sizeof(crumb->name), "Activity resumed %d", i);
+      crumb->timestamp_ms = 1654084800000;
+      bugsnag_event_add_breadcrumb(event, crumb);
+    }
+    free(crumb);
+  }
+
+  char flag[32];
+  const int flags = random_between(seed, 0, BENCH_FEATURE_FLAGS_MAX);
+  for (int i = 0; i < flags; i++) {
+    snprintf(flag, sizeof(flag), "experiment_%03d", i);
+    bsg_set_feature_flag(event, flag, i % 2 ? "treatment" : NULL);
+  }
+}
+
+static bool write_current_report(const char *path, uint32_t *seed) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  if (env == NULL) {
+    return false;
+  }
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  bsg_strncpy(env->next_event_path, path, sizeof(env->next_event_path));
+  fill_current_event(&env->next_event, seed);
+  const bool written = bsg_event_write(env);
+  bsg_free_feature_flags(&env->next_event);
+  bsg_metadata_arena_free(&env->next_event.metadata_arena);
+  free(env);
+  return written;
+}
+
+/**
+ * Write count reports to dir, taking each format of the corpus in turn
+ * @return the number of reports written
+ */
+static size_t generate_corpus(const char *dir, size_t count) {
+  char path[512];
+  size_t written = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint32_t seed = (uint32_t)i;
+    const int version = bench_versions[i % BENCH_VERSION_COUNT];
+    snprintf(path, sizeof(path), "%s/%06zu-v%d.crash", dir, i, version);
+    const bool ok = version == BUGSNAG_EVENT_VERSION
+                        ? write_current_report(path, &seed)
+                        : write_legacy_report(version, path, &seed);
+    if (ok) {
+      written++;
+    }
+  }
+  return written;
+}
+
+/**
+ * List the reports in dir, returning NULL if there are none
+ */
+static char **list_reports(const char *dir, size_t *count) {
+  *count = 0;
+  DIR *stream = opendir(dir);
+  if (stream == NULL) {
+    return NULL;
+  }
+  size_t capacity = 256;
+  char **paths = calloc(capacity, sizeof(char *));
+  struct dirent *entry;
+  while (paths != NULL && (entry = readdir(stream)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    if (*count == capacity) {
+      capacity *= 2;
+      char **grown = realloc(paths, capacity * sizeof(char *));
+      if (grown == NULL) {
+        break;
+      }
+      paths = grown;
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    paths[*count] = strdup(path);
+    if (paths[*count] != NULL) {
+      (*count)++;
+    }
+  }
+  closedir(stream);
+  return paths;
+}
+
+static void free_reports(char **paths, size_t count) {
+  for (size_t i = 0; paths != NULL && i < count; i++) {
+    free(paths[i]);
+  }
+  free(paths);
+}
+
+static long peak_rss_kb(void) {
+  struct rusage usage;
+  return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+static int compare_ns(const void *a, const void *b) {
+  const uint64_t left = *(const uint64_t *)a;
+  const uint64_t right = *(const uint64_t *)b;
+  return left < right ? -1 : left > right;
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t count,
+                           int percent) {
+  size_t index = (count * (size_t)percent + 99) / 100;
+  return sorted[index > 0 ? index - 1 : 0];
+}
+
+/**
+ * Read, migrate and serialize each report one at a time, as a single worker
+ * delivers them, recording the latency of each
+ */
+static size_t run_serial_pass(char **paths, size_t count, char *report,
+                              size_t length) {
+  uint64_t *latencies = calloc(count, sizeof(uint64_t));
+  if (latencies == NULL) {
+    return length;
+  }
+  size_t done = 0;
+  size_t json_bytes = 0;
+  const uint64_t started_at = monotonic_time_ns();
+  for (size_t i = 0; i < count; i++) {
+    const uint64_t file_started_at = monotonic_time_ns();
+    bugsnag_event *event = bsg_read_event(paths[i]);
+    if (event == NULL) {
+      continue;
+    }
+    char *json = bsg_event_to_json_stream(event);
+    latencies[done++] = monotonic_time_ns() - file_started_at;
+    if (json != NULL) {
+      json_bytes += bsg_strlen(json);
+      free(json);
+    }
+    bsg_free_feature_flags(event);
+    bsg_metadata_arena_free(&event->metadata_arena);
+    bsg_event_free_threads(event);
+    free(event);
+  }
+  const uint64_t elapsed_ns = monotonic_time_ns() - started_at;
+
+  if (done > 0) {
+    qsort(latencies, done, sizeof(uint64_t), compare_ns);
+    const double seconds = (double)elapsed_ns / 1e9;
+    length += snprintf(
+        report + length, BENCH_REPORT_SIZE - length,
+        "serial   %6zu reports %8.0f reports/s %7.1f MB/s JSON "
+        "p50 %7llu us p90 %7llu us p99 %7llu us max %7llu us "
+        "peak RSS %ld kB\n",
+        done, (double)done / seconds, (double)json_bytes / seconds / 1e6,
+        (unsigned long long)percentile(latencies, done, 50) / 1000,
+        (unsigned long long)percentile(latencies, done, 90) / 1000,
+        (unsigned long long)percentile(latencies, done, 99) / 1000,
+        (unsigned long long)latencies[done - 1] / 1000, peak_rss_kb());
+  }
+  free(latencies);
+  return length;
+}
+
+typedef struct {
+  size_t delivered;
+  size_t payload_bytes;
+} bench_pipeline_result;
+
+static void count_pending_report(const char *path, bsg_pending_report *report,
+                                 void *context) {
+  bench_pipeline_result *result = context;
+  if (report->payload != NULL) {
+    result->delivered++;
+    result->payload_bytes += report->payload_length;
+  }
+}
+
+/**
+ * Prepare every report as deliverReportsAtPaths() does, in parallel and with
+ * compression, which removes the reports once read
+ */
+static size_t run_pipeline_pass(char **paths, size_t count, char *report,
+                                size_t length) {
+  bench_pipeline_result result = {0};
+  const uint64_t started_at = monotonic_time_ns();
+  bsg_prepare_pending_reports((const char *const *)paths, count,
+                              count_pending_report, &result);
+  const uint64_t elapsed_ns = monotonic_time_ns() - started_at;
+  const double seconds = (double)elapsed_ns / 1e9;
+  length += snprintf(report + length, BENCH_REPORT_SIZE - length,
+                     "pipeline %6zu reports %8.0f reports/s %7.1f MB/s "
+                     "payload, %llu ms total peak RSS %ld kB\n",
+                     result.delivered, (double)result.delivered / seconds,
+                     (double)result.payload_bytes / seconds / 1e6,
+                     (unsigned long long)elapsed_ns / 1000000, peak_rss_kb());
+  return length;
+}
+
+/**
+ * Deliver a backlog of the reports in dir, first one at a time to measure the
+ * latency of each and then through the parallel pipeline, writing a table of
+ * the results into report. The reports are removed by the pipeline.
+ */
+static void run_backlog_bench(const char *dir, char *report) {
+  report[0] = '\0';
+  size_t count = 0;
+  char **paths = list_reports(dir, &count);
+  if (paths == NULL || count == 0) {
+    free_reports(paths, count);
+    return;
+  }
+  size_t length = snprintf(report, BENCH_REPORT_SIZE,
+                           "backlog  %6zu reports peak RSS %ld kB\n", count,
+                           peak_rss_kb());
+  length = run_serial_pass(paths, count, report, length);
+  if (length < BENCH_REPORT_SIZE) {
+    run_pipeline_pass(paths, count, report, length);
+  }
+  free_reports(paths, count);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeBacklogBenchmark_generate(JNIEnv *env,
+                                                             jobject _this,
+                                                             jstring dir,
+                                                             jint count) {
+  const char *report_dir = (*env)->GetStringUTFChars(env, dir, NULL);
+  if (report_dir == NULL) {
+    return 0;
+  }
+  const size_t written = generate_corpus(report_dir, (size_t)count);
+  (*env)->ReleaseStringUTFChars(env, dir, report_dir);
+  return (jint)written;
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_bugsnag_android_ndk_NativeBacklogBenchmark_run(JNIEnv *env,
+                                                        jobject _this,
+                                                        jstring dir) {
+  static char report[BENCH_REPORT_SIZE];
+  const char *report_dir = (*env)->GetStringUTFChars(env, dir, NULL);
+  if (report_dir == NULL) {
+    return NULL;
+  }
+  run_backlog_bench(report_dir, report);
+  (*env)->ReleaseStringUTFChars(env, dir, report_dir);
+
+  // logged a line at a time, as logcat truncates long messages
+  char *line = report;
+  while (*line != '\0') {
+    char *end = strchr(line, '\n');
+    if (end == NULL) {
+      break;
+    }
+    BENCH_LOG("%.*s", (int)(end - line), line);
+    line = end + 1;
+  }
+  return (*env)->NewStringUTF(env, report);
+}
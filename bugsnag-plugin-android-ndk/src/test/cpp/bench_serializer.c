@@ -0,0 +1,416 @@
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android/log.h>
+#include <jni.h>
+
+#include <bugsnag_ndk.h>
+#include <featureflags.h>
+#include <utils/serializer/event_reader.h>
+#include <utils/serializer/event_writer.h>
+#include <utils/serializer/json_writer.h>
+#include <utils/serializer/migrate.h>
+#include <utils/string.h>
+
+#include "test_alloc.h"
+
+#define BENCH_LOG(fmt, ...)                                                    \
+  __android_log_print(ANDROID_LOG_INFO, "BugsnagNDKBench", fmt, ##__VA_ARGS__)
+
+/**
+ * The number of times each operation is run on the fixture
+ */
+#define BENCH_RUNS 100
+#define BENCH_REPORT_SIZE 4096
+
+#define BENCH_FEATURE_FLAGS 200
+#define BENCH_METADATA_VALUES 120
+#define BENCH_CRUMB_METADATA_VALUES 4
+#define BENCH_FRAMES 40
+
+bool bsg_report_header_write(bsg_report_header *header, int fd);
+
+typedef struct {
+  bsg_environment *env;
+  const char *path;
+} bench_fixture;
+
+typedef struct {
+  const char *name;
+  /** Runs the operation once, returning its output to be released after */
+  void *(*run)(bench_fixture *fixture, size_t *out_bytes);
+  void (*release)(void *output);
+} bench_case;
+
+typedef struct {
+  uint64_t total_ns;
+  uint64_t fastest_ns;
+  size_t bytes;
+  /** The most heap held by the output of one run */
+  long peak_bytes;
+  /** The change in allocated bytes after every output was released */
+  long retained_bytes;
+} bench_result;
+
+static uint64_t monotonic_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void fill_frames(bsg_error *error) {
+  bsg_strncpy(error->errorClass, "SIGSEGV", sizeof(error->errorClass));
+  bsg_strncpy(error->errorMessage, "Segmentation violation (invalid memory "
+                                   "reference)",
+              sizeof(error->errorMessage));
+  bsg_strncpy(error->type, "c", sizeof(error->type));
+  error->frame_count = BENCH_FRAMES;
+  for (int i = 0; i < BENCH_FRAMES; i++) {
+    bugsnag_stackframe *frame = &error->stacktrace[i];
+    frame->frame_address = 0x7d2c4e1000 + i * 0x1a4;
+    frame->load_address = 0x7d2c400000;
+    frame->symbol_address = frame->frame_address - 0x20;
+    snprintf(frame->filename, sizeof(frame->filename),
+             "/data/app/com.example.PhotoSnapPlus-1/lib/arm64/libgame_%d.so",
+             i % 4);
+    snprintf(frame->method, sizeof(frame->method),
+             "_ZN4game6engine5Scene6updateEPNS_5ActorEi%d", i);
+  }
+}
+
+static void fill_legacy_frames(bsg_error_v1 *legacy) {
+  bsg_error *error = calloc(1, sizeof(bsg_error));
+  if (error == NULL) {
+    return;
+  }
+  fill_frames(error);
+  memcpy(legacy->errorClass, error->errorClass, sizeof(legacy->errorClass));
+  memcpy(legacy->errorMessage, error->errorMessage,
+         sizeof(legacy->errorMessage));
+  memcpy(legacy->type, error->type, sizeof(legacy->type));
+  legacy->frame_count = error->frame_count;
+  memcpy(legacy->stacktrace, error->stacktrace,
+         error->frame_count * sizeof(bugsnag_stackframe));
+  free(error);
+}
+
+static void fill_metadata(bugsnag_metadata *metadata, int count) {
+  char section[16], name[16];
+  for (int i = 0; i < count; i++) {
+    snprintf(section, sizeof(section), "section_%d", i % 6);
+    snprintf(name, sizeof(name), "key_%03d", i);
+    switch (i % 3) {
+    case 0:
+      bsg_add_metadata_value_str(metadata, NULL, section, name,
+                                 "a value of a typical length for metadata");
+      break;
+    case 1:
+      bsg_add_metadata_value_double(metadata, NULL, section, name, i * 1.5);
+      break;
+    default:
+      bsg_add_metadata_value_bool(metadata, NULL, section, name, i % 2);
+      break;
+    }
+  }
+}
+
+/**
+ * Fill in an event with a full breadcrumb ring, BENCH_FEATURE_FLAGS feature
+ * flags and BENCH_METADATA_VALUES metadata values
+ */
+static void fill_event(bugsnag_event *event) {
+  bsg_strncpy(event->api_key, "5d1e5fbd39a74caa1200142706a90b20",
+              sizeof(event->api_key));
+  bsg_strncpy(event->context, "MainActivity", sizeof(event->context));
+  bsg_strncpy(event->app.id, "com.example.PhotoSnapPlus",
+              sizeof(event->app.id));
+  bsg_strncpy(event->app.release_stage, "production",
+              sizeof(event->app.release_stage));
+  bsg_strncpy(event->app.version, "2.0.52", sizeof(event->app.version));
+  bsg_strncpy(event->app.build_uuid, "1234-9876-adfe",
+              sizeof(event->app.build_uuid));
+  bsg_strncpy(event->device.manufacturer, "Google",
+              sizeof(event->device.manufacturer));
+  bsg_strncpy(event->device.model, "Pixel 6", sizeof(event->device.model));
+  bsg_strncpy(event->device.os_version, "13", sizeof(event->device.os_version));
+  event->device.api_level = 33;
+  event->unhandled = true;
+  event->severity = BSG_SEVERITY_ERR;
+  fill_frames(&event->error);
+  fill_metadata(&event->metadata, BENCH_METADATA_VALUES);
+
+  bugsnag_breadcrumb *crumb = calloc(1, sizeof(bugsnag_breadcrumb));
+  if (crumb != NULL) {
+    for (int i = 0; i < BUGSNAG_CRUMBS_MAX; i++) {
+      memset(crumb, 0, sizeof(bugsnag_breadcrumb));
+      crumb->type = BSG_CRUMB_STATE;
+      snprintf(crumb->name, sizeof(crumb->name), "Activity resumed %d", i);
+      crumb->timestamp_ms = 1654084800000;
+      fill_metadata(&crumb->metadata, BENCH_CRUMB_METADATA_VALUES);
+      bugsnag_event_add_breadcrumb(event, crumb);
+    }
+    free(crumb);
+  }
+
+  char name[32];
+  for (int i = 0; i < BENCH_FEATURE_FLAGS; i++) {
+    snprintf(name, sizeof(name), "experiment_%03d", i);
+    bsg_set_feature_flag(event, name, i % 2 ? "treatment" : NULL);
+  }
+}
+
+static void release_event(void *output) {
+  bugsnag_event *event = output;
+  if (event != NULL) {
+    bsg_free_feature_flags(event);
+    bsg_metadata_arena_free(&event->metadata_arena);
+    bsg_event_free_threads(event);
+    free(event);
+  }
+}
+
+static void release_nothing(void *output) {}
+
+static size_t file_size(const char *path) {
+  struct stat info;
+  return stat(path, &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+static void *run_to_json(bench_fixture *fixture, size_t *out_bytes) {
+  char *json = bsg_event_to_json(&fixture->env->next_event);
+  *out_bytes = json == NULL ? 0 : bsg_strlen(json);
+  return json;
+}
+
+static void *run_to_json_stream(bench_fixture *fixture, size_t *out_bytes) {
+  char *json = bsg_event_to_json_stream(&fixture->env->next_event);
+  *out_bytes = json == NULL ? 0 : bsg_strlen(json);
+  return json;
+}
+
+static void *run_write(bench_fixture *fixture, size_t *out_bytes) {
+  if (!bsg_event_write(fixture->env)) {
+    return NULL;
+  }
+  *out_bytes = file_size(fixture->path);
+  return fixture;
+}
+
+static void *run_read(bench_fixture *fixture, size_t *out_bytes) {
+  *out_bytes = file_size(fixture->path);
+  return bsg_read_event((char *)fixture->path);
+}
+
+static const bench_case bench_cases[] = {
+    {"bsg_event_to_json", run_to_json, free},
+    {"bsg_event_to_json_stream", run_to_json_stream, free},
+    {"bsg_event_write", run_write, release_nothing},
+    {"bsg_read_event", run_read, release_event},
+};
+
+static bool run_case(const bench_case *bench, bench_fixture *fixture,
+                     bench_result *result) {
+  const size_t allocated_before = mallinfo().uordblks;
+  result->fastest_ns = UINT64_MAX;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    const size_t run_allocated_before = mallinfo().uordblks;
+    const uint64_t started_at = monotonic_time_ns();
+    void *output = bench->run(fixture, &result->bytes);
+    const uint64_t elapsed = monotonic_time_ns() - started_at;
+    const long held =
+        (long)mallinfo().uordblks - (long)run_allocated_before;
+    if (output == NULL) {
+      return false;
+    }
+    bench->release(output);
+
+    result->total_ns += elapsed;
+    if (elapsed < result->fastest_ns) {
+      result->fastest_ns = elapsed;
+    }
+    if (held > result->peak_bytes) {
+      result->peak_bytes = held;
+    }
+  }
+  result->retained_bytes = (long)mallinfo().uordblks - (long)allocated_before;
+  return true;
+}
+
+/*
+ * Legacy fixtures. Versions 3 to 8 share the fields filled in here, which are
+ * enough to exercise each part of the migration; the feature flags of v8 are
+ * left out.
+ */
+
+static void fill_legacy_metadata(bugsnag_metadata_v1 *metadata, int count) {
+  for (int i = 0; i < count && i < BUGSNAG_METADATA_MAX; i++) {
+    bsg_metadata_value_v1 *value = &metadata->values[i];
+    snprintf(value->section, sizeof(value->section), "section_%d", i % 6);
+    snprintf(value->name, sizeof(value->name), "key_%03d", i);
+    value->type = BSG_METADATA_CHAR_VALUE;
+    bsg_strncpy(value->char_value, "a value of a typical length for metadata",
+                sizeof(value->char_value));
+  }
+  metadata->value_count = count;
+}
+
+static void fill_legacy_crumbs(bugsnag_breadcrumb_v2 *crumbs, int count) {
+  for (int i = 0; i < count; i++) {
+    bugsnag_breadcrumb_v2 *crumb = &crumbs[i];
+    crumb->type = BSG_CRUMB_STATE;
+    snprintf(crumb->name, sizeof(crumb->name), "Activity resumed %d", i);
+    bsg_strncpy(crumb->timestamp, "2022-06-01T12:00:00.000Z",
+                sizeof(crumb->timestamp));
+    fill_legacy_metadata(&crumb->metadata, BENCH_CRUMB_METADATA_VALUES);
+  }
+}
+
+#define BENCH_LEGACY_FIXTURE(v, crumbs_max)                                    \
+  static void *legacy_fixture_v##v(void) {                                     \
+    bugsnag_report_v##v *report = calloc(1, sizeof(*report));                  \
+    if (report == NULL) {                                                      \
+      return NULL;                                                             \
+    }                                                                          \
+    bsg_strncpy(report->app.id, "com.example.PhotoSnapPlus",                   \
+                sizeof(report->app.id));                                       \
+    bsg_strncpy(report->app.version, "2.0.52", sizeof(report->app.version));   \
+    bsg_strncpy(report->device.model, "Pixel 6",                               \
+                sizeof(report->device.model));                                 \
+    bsg_strncpy(report->context, "MainActivity", sizeof(report->context));     \
+    fill_legacy_frames(&report->error);                                        \
+    fill_legacy_metadata(&report->metadata, BENCH_METADATA_VALUES);            \
+    fill_legacy_crumbs(report->breadcrumbs, crumbs_max);                       \
+    report->crumb_count = crumbs_max;                                          \
+    return report;                                                             \
+  }
+
+BENCH_LEGACY_FIXTURE(3, V2_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_FIXTURE(4, V2_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_FIXTURE(5, V2_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_FIXTURE(6, V3_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_FIXTURE(7, V3_BUGSNAG_CRUMBS_MAX)
+BENCH_LEGACY_FIXTURE(8, V3_BUGSNAG_CRUMBS_MAX)
+
+typedef struct {
+  int version;
+  size_t size;
+  void *(*create)(void);
+} bench_legacy_fixture;
+
+static const bench_legacy_fixture bench_legacy_fixtures[] = {
+    {3, sizeof(bugsnag_report_v3), legacy_fixture_v3},
+    {4, sizeof(bugsnag_report_v4), legacy_fixture_v4},
+    {5, sizeof(bugsnag_report_v5), legacy_fixture_v5},
+    {6, sizeof(bugsnag_report_v6), legacy_fixture_v6},
+    {7, sizeof(bugsnag_report_v7), legacy_fixture_v7},
+    {8, sizeof(bugsnag_report_v8), legacy_fixture_v8},
+};
+
+static bool write_legacy_fixture(const bench_legacy_fixture *legacy,
+                                 const char *path) {
+  void *report = legacy->create();
+  if (report == NULL) {
+    return false;
+  }
+  bool written = false;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd != -1) {
+    bsg_report_header header = {legacy->version, 0, {0}};
+    written = bsg_report_header_write(&header, fd) &&
+              write(fd, report, legacy->size) == (ssize_t)legacy->size;
+    close(fd);
+  }
+  free(report);
+  return written;
+}
+
+static size_t append_result(char *report, size_t length, const char *name,
+                            const bench_result *result) {
+  const uint64_t mean_ns = result->total_ns / BENCH_RUNS;
+  const double events_per_sec = mean_ns == 0 ? 0 : 1e9 / (double)mean_ns;
+  const int written = snprintf(
+      report + length, BENCH_REPORT_SIZE - length,
+      "%-26s mean %9llu ns fastest %9llu ns %8.0f events/s %7.1f MB/s "
+      "%7zu bytes peak %8ld bytes retained %ld bytes\n",
+      name, (unsigned long long)mean_ns,
+      (unsigned long long)result->fastest_ns, events_per_sec,
+      events_per_sec * (double)result->bytes / 1e6, result->bytes,
+      result->peak_bytes, result->retained_bytes);
+  if (written < 0 || (size_t)written >= BENCH_REPORT_SIZE - length) {
+    return BENCH_REPORT_SIZE - 1;
+  }
+  return length + written;
+}
+
+/**
+ * Time serializing, writing and reading a full event, and reading each legacy
+ * format, writing a table of the results into report. The event files are
+ * written to path.
+ */
+static void run_serializer_bench(const char *path, char *report) {
+  size_t length = 0;
+  report[0] = '\0';
+  bsg_environment *env = bsg_test_environment_calloc();
+  if (env == NULL) {
+    return;
+  }
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  bsg_strncpy(env->next_event_path, path, sizeof(env->next_event_path));
+  fill_event(&env->next_event);
+  bench_fixture fixture = {.env = env, .path = path};
+
+  // the cases run in order, so that bsg_read_event reads the written event
+  for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_case); i++) {
+    bench_result result = {0};
+    if (run_case(&bench_cases[i], &fixture, &result)) {
+      length = append_result(report, length, bench_cases[i].name, &result);
+    }
+  }
+
+  char name[32];
+  const bench_case read_legacy = {name, run_read, release_event};
+  for (size_t i = 0;
+       i < sizeof(bench_legacy_fixtures) / sizeof(bench_legacy_fixture); i++) {
+    const bench_legacy_fixture *legacy = &bench_legacy_fixtures[i];
+    bench_result result = {0};
+    snprintf(name, sizeof(name), "bsg_read_event v%d", legacy->version);
+    if (write_legacy_fixture(legacy, path) &&
+        run_case(&read_legacy, &fixture, &result)) {
+      length = append_result(report, length, name, &result);
+    }
+  }
+  bsg_free_feature_flags(&env->next_event);
+  free(env);
+  remove(path);
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_bugsnag_android_ndk_NativeSerializerBenchmark_run(JNIEnv *env,
+                                                           jobject _this,
+                                                           jstring path) {
+  static char report[BENCH_REPORT_SIZE];
+  const char *event_path = (*env)->GetStringUTFChars(env, path, NULL);
+  if (event_path == NULL) {
+    return NULL;
+  }
+  run_serializer_bench(event_path, report);
+  (*env)->ReleaseStringUTFChars(env, path, event_path);
+
+  // logged a line at a time, as logcat truncates long messages
+  char *line = report;
+  while (*line != '\0') {
+    char *end = strchr(line, '\n');
+    if (end == NULL) {
+      break;
+    }
+    BENCH_LOG("%.*s", (int)(end - line), line);
+    line = end + 1;
+  }
+  return (*env)->NewStringUTF(env, report);
+}
@@ -0,0 +1,176 @@
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <android/log.h>
+#include <jni.h>
+
+#include <utils/module_index.h>
+#include <utils/stack_unwinder.h>
+#include <utils/stack_unwinder_libcorkscrew.h>
+
+#define BENCH_LOG(fmt, ...)                                                    \
+  __android_log_print(ANDROID_LOG_INFO, "BugsnagNDKBench", fmt, ##__VA_ARGS__)
+
+/**
+ * The number of times each combination is unwound
+ */
+#define BENCH_RUNS 50
+#define BENCH_REPORT_SIZE 8192
+
+typedef struct {
+  bsg_unwinder style;
+  const char *name;
+} bench_unwinder;
+
+static const bench_unwinder bench_unwinders[] = {
+    {BSG_LIBUNWIND, "libunwind"},
+    {BSG_LIBUNWINDSTACK, "libunwindstack"},
+    {BSG_LIBCORKSCREW, "libcorkscrew"},
+    {BSG_CUSTOM_UNWIND, "simple"},
+    {BSG_FRAME_POINTER_UNWIND, "frame pointer"},
+};
+
+static const int bench_depths[] = {10, 50, BUGSNAG_FRAMES_MAX};
+
+typedef struct {
+  bsg_unwinder style;
+  bool use_context;
+  uint64_t total_ns;
+  uint64_t fastest_ns;
+  ssize_t frame_count;
+  /** The change in allocated bytes, showing memory kept by the unwinder */
+  long retained_bytes;
+} bench_result;
+
+static bugsnag_stackframe bench_frames[BUGSNAG_FRAMES_MAX];
+
+/** The run in progress, read by the signal handler */
+static bench_result *bench_current;
+
+static uint64_t monotonic_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void unwind_repeatedly(bench_result *result, siginfo_t *info,
+                              void *user_context) {
+  const size_t allocated_before = mallinfo().uordblks;
+  result->fastest_ns = UINT64_MAX;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    memset(bench_frames, 0, sizeof(bench_frames));
+    const uint64_t started_at = monotonic_time_ns();
+    result->frame_count =
+        bsg_unwind_stack(result->style, bench_frames, BUGSNAG_FRAMES_MAX,
+                         info, user_context);
+    const uint64_t elapsed = monotonic_time_ns() - started_at;
+    result->total_ns += elapsed;
+    if (elapsed < result->fastest_ns) {
+      result->fastest_ns = elapsed;
+    }
+  }
+  result->retained_bytes = (long)mallinfo().uordblks - (long)allocated_before;
+}
+
+static void bench_signal_handler(int signum, siginfo_t *info,
+                                 void *user_context) {
+  unwind_repeatedly(bench_current, info, user_context);
+}
+
+static __attribute__((noinline)) void run_at_depth(bench_result *result,
+                                                   int depth) {
+  if (depth > 1) {
+    run_at_depth(result, depth - 1);
+    __asm__ volatile("" ::: "memory"); // not a tail call
+    return;
+  }
+  if (result->use_context) {
+    bench_current = result;
+    raise(SIGUSR2);
+  } else {
+    unwind_repeatedly(result, NULL, NULL);
+  }
+}
+
+static bool can_run(bsg_unwinder style) {
+  // libcorkscrew is called without checking that it was found
+  return style != BSG_LIBCORKSCREW || bsg_libcorkscrew_configured();
+}
+
+static size_t append_result(char *report, size_t length, const char *name,
+                            int depth, const bench_result *result) {
+  const int written = snprintf(
+      report + length, BENCH_REPORT_SIZE - length,
+      "%-14s depth %3d %-10s mean %8llu ns fastest %8llu ns frames %3zd "
+      "retained %ld bytes\n",
+      name, depth, result->use_context ? "signal" : "no signal",
+      (unsigned long long)(result->total_ns / BENCH_RUNS),
+      (unsigned long long)result->fastest_ns, result->frame_count,
+      result->retained_bytes);
+  if (written < 0 || (size_t)written >= BENCH_REPORT_SIZE - length) {
+    return BENCH_REPORT_SIZE - 1;
+  }
+  return length + written;
+}
+
+/**
+ * Time bsg_unwind_stack() for every unwinder at each depth, both when
+ * unwinding the current stack and from a signal context, writing a table of
+ * the results into report
+ */
+static void run_unwinder_bench(int api_level, char *report) {
+  bsg_unwinder signal_style, other_style;
+  bsg_set_unwind_types(api_level, sizeof(void *) == 4, &signal_style,
+                       &other_style);
+  bsg_configure_libcorkscrew();
+  bsg_module_index_refresh();
+
+  struct sigaction action = {0}, previous;
+  action.sa_sigaction = bench_signal_handler;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR2, &action, &previous);
+
+  size_t length = 0;
+  report[0] = '\0';
+  for (size_t i = 0; i < sizeof(bench_unwinders) / sizeof(bench_unwinder);
+       i++) {
+    const bench_unwinder *unwinder = &bench_unwinders[i];
+    if (!can_run(unwinder->style)) {
+      continue;
+    }
+    for (size_t d = 0; d < sizeof(bench_depths) / sizeof(int); d++) {
+      for (int use_context = 0; use_context <= 1; use_context++) {
+        bench_result result = {.style = unwinder->style,
+                               .use_context = use_context};
+        run_at_depth(&result, bench_depths[d]);
+        length = append_result(report, length, unwinder->name,
+                               bench_depths[d], &result);
+      }
+    }
+  }
+  sigaction(SIGUSR2, &previous, NULL);
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_bugsnag_android_ndk_NativeUnwinderBenchmark_run(JNIEnv *env,
+                                                         jobject _this,
+                                                         jint api_level) {
+  static char report[BENCH_REPORT_SIZE];
+  run_unwinder_bench(api_level, report);
+
+  // logged a line at a time, as logcat truncates long messages
+  char *line = report;
+  while (*line != '\0') {
+    char *end = strchr(line, '\n');
+    if (end == NULL) {
+      break;
+    }
+    BENCH_LOG("%.*s", (int)(end - line), line);
+    line = end + 1;
+  }
+  return (*env)->NewStringUTF(env, report);
+}
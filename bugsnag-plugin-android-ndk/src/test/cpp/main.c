@@ -9,6 +9,7 @@
 #include <parson/parson.h>
 
 #include "test_serializer.h"
+#include "test_alloc.h"
 #include <utils/serializer/json_writer.h>
 
 SUITE(suite_string_utils);
@@ -20,6 +21,20 @@ SUITE(suite_event_device_mutators);
 SUITE(suite_struct_to_file);
 SUITE(suite_struct_migration);
 SUITE(suite_feature_flags);
+SUITE(suite_crash_watchdog);
+SUITE(suite_crash_helper);
+SUITE(suite_thread_registry);
+SUITE(suite_event_filter);
+SUITE(suite_thread_context);
+SUITE(suite_symbol_cache);
+SUITE(suite_event_template);
+SUITE(suite_report_index);
+SUITE(suite_string_ids);
+SUITE(suite_crash_signatures);
+SUITE(suite_notify_aggregator);
+SUITE(suite_notify_queue);
+SUITE(suite_state_journal);
+SUITE(suite_throw_ring);
 
 GREATEST_MAIN_DEFS();
 
@@ -96,9 +111,93 @@ Java_com_bugsnag_android_ndk_NativeFeatureFlagsTest_run(JNIEnv *env, jobject thi
     return run_test_suite(suite_feature_flags);
 }
 
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeCrashWatchdogTest_run(JNIEnv *env,
+                                                         jobject thiz) {
+    return run_test_suite(suite_crash_watchdog);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeCrashHelperTest_run(JNIEnv *env,
+                                                       jobject thiz) {
+    return run_test_suite(suite_crash_helper);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeThreadRegistryTest_run(JNIEnv *env,
+                                                          jobject thiz) {
+    return run_test_suite(suite_thread_registry);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeEventFilterTest_run(JNIEnv *env,
+                                                       jobject thiz) {
+    return run_test_suite(suite_event_filter);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeThreadContextTest_run(JNIEnv *env,
+                                                         jobject thiz) {
+    return run_test_suite(suite_thread_context);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeSymbolCacheTest_run(JNIEnv *env,
+                                                       jobject thiz) {
+    return run_test_suite(suite_symbol_cache);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeEventTemplateTest_run(JNIEnv *env,
+                                                         jobject thiz) {
+    return run_test_suite(suite_event_template);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeReportIndexTest_run(JNIEnv *env,
+                                                       jobject thiz) {
+    return run_test_suite(suite_report_index);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeStringIdsTest_run(JNIEnv *env,
+                                                     jobject thiz) {
+    return run_test_suite(suite_string_ids);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeCrashSignaturesTest_run(JNIEnv *env,
+                                                           jobject thiz) {
+    return run_test_suite(suite_crash_signatures);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeNotifyAggregatorTest_run(JNIEnv *env,
+                                                            jobject thiz) {
+    return run_test_suite(suite_notify_aggregator);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeNotifyQueueTest_run(JNIEnv *env,
+                                                       jobject thiz) {
+    return run_test_suite(suite_notify_queue);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeStateJournalTest_run(JNIEnv *env,
+                                                        jobject thiz) {
+    return run_test_suite(suite_state_journal);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_bugsnag_android_ndk_NativeThrowRingTest_run(JNIEnv *env,
+                                                     jobject thiz) {
+    return run_test_suite(suite_throw_ring);
+}
+
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_UserSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadUserTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *event_obj = json_value_get_object(event_val);
@@ -109,7 +208,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_UserSerializationTest_run
 
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_AppSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadAppTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *event_obj = json_value_get_object(event_val);
@@ -120,7 +219,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_AppSerializationTest_run(
 
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_AppMetadataSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadAppMetadataTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *event_obj = json_value_get_object(event_val);
@@ -131,7 +230,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_AppMetadataSerializationT
 
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_DeviceSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadDeviceTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *event_obj = json_value_get_object(event_val);
@@ -151,7 +250,7 @@ TEST test_custom_meta_data_serialization(test_case *test_case) {
 
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_CustomMetadataSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadCustomMetadataTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *event_obj = json_value_get_object(event_val);
@@ -162,7 +261,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_CustomMetadataSerializati
 
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_ContextSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadContextTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *event_obj = json_value_get_object(event_val);
@@ -173,7 +272,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_ContextSerializationTest_
 
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_SeverityReasonSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadSeverityReasonTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *event_obj = json_value_get_object(event_val);
@@ -184,7 +283,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_SeverityReasonSerializati
 
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_SessionSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadSessionTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *event_obj = json_value_get_object(event_val);
@@ -196,7 +295,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_SessionSerializationTest_
 JNIEXPORT jstring JNICALL
 Java_com_bugsnag_android_ndk_BreadcrumbStateSerializationTest_run(JNIEnv *env,
                                                                   jobject thiz) {
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+  bugsnag_event *event = bsg_test_event_calloc();
   loadBreadcrumbsTestCase(event);
   JSON_Value *eventVal = json_value_init_array();
   JSON_Array *eventAry = json_value_get_array(eventVal);
@@ -217,7 +316,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_StackframeSerializationTe
 
 JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_ExceptionSerializationTest_run(
         JNIEnv *env, jobject _this) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadExceptionTestCase(event);
     JSON_Value *event_val = json_value_init_object();
     JSON_Object *exception = json_value_get_object(event_val);
@@ -232,7 +331,7 @@ JNIEXPORT jstring JNICALL Java_com_bugsnag_android_ndk_ExceptionSerializationTes
 
 JNIEXPORT jstring JNICALL
 Java_com_bugsnag_android_ndk_ThreadSerializationTest_run(JNIEnv *env, jobject thiz) {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     loadThreadTestCase(event);
     JSON_Value *threads_val = json_value_init_array();
     JSON_Array *threads_array = json_value_get_array(threads_val);
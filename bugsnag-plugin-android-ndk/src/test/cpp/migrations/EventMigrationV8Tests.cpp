@@ -3,9 +3,21 @@
 #include <parson/parson.h>
 
 #include "utils.hpp"
+#include "../test_alloc.h"
+
+#include <featureflags.h>
+#include <utils/serializer/buffered_writer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+bool bsg_write_feature_flags(bugsnag_event *event, bsg_buffered_writer *writer);
+#ifdef __cplusplus
+}
+#endif
 
 static void *create_payload_info_event() {
-  auto event = (bugsnag_event *)calloc(1, sizeof(bugsnag_event));
+  auto event = (bugsnag_report_v8 *)calloc(1, sizeof(bugsnag_report_v8));
 
   strcpy(event->api_key, "5d1e5fbd39a74caa1200142706a90b20");
   strcpy(event->notifier.name, "Test Library");
@@ -19,7 +31,7 @@ static void *create_payload_info_event() {
  * Create a new event in v8 format
  */
 static void *create_full_event() {
-  auto event = (bugsnag_event *)calloc(1, sizeof(bugsnag_event));
+  auto event = (bugsnag_report_v8 *)calloc(1, sizeof(bugsnag_report_v8));
 
   strcpy(event->context,
          "00000000000m0r3.61ee9e6e099d3dd7448f740d395768da6b2df55d5.m4g1c");
@@ -102,10 +114,31 @@ static void *create_full_event() {
 
   // metadata
   strcpy(event->app.active_screen, "Menu");
-  bugsnag_event_add_metadata_bool(event, "metrics", "experimentX", false);
-  bugsnag_event_add_metadata_string(event, "metrics", "subject", "percy");
-  bugsnag_event_add_metadata_string(event, "app", "weather", "rain");
-  bugsnag_event_add_metadata_double(event, "metrics", "counter", 47.5);
+  event->metadata.value_count = 4;
+  event->metadata.values[0] = {
+    .name = {"experimentX"},
+    .section = {"metrics"},
+    .type = BSG_METADATA_BOOL_VALUE,
+    .bool_value = false,
+  };
+  event->metadata.values[1] = {
+    .name = {"subject"},
+    .section = {"metrics"},
+    .type = BSG_METADATA_CHAR_VALUE,
+    .char_value = {"percy"},
+  };
+  event->metadata.values[2] = {
+    .name = {"weather"},
+    .section = {"app"},
+    .type = BSG_METADATA_CHAR_VALUE,
+    .char_value = {"rain"},
+  };
+  event->metadata.values[3] = {
+    .name = {"counter"},
+    .section = {"metrics"},
+    .type = BSG_METADATA_NUMBER_VALUE,
+    .double_value = 47.5,
+  };
 
   // session info
   event->handled_events = 5;
@@ -131,21 +164,25 @@ static void *create_full_event() {
 
 static const char *write_event_v8(JNIEnv *env, jstring temp_file,
                                   void *(event_generator)()) {
-  auto event_ctx = (bsg_environment *)calloc(1, sizeof(bsg_environment));
-  event_ctx->report_header.version = 8;
   const char *path = (*env).GetStringUTFChars(temp_file, nullptr);
-  sprintf(event_ctx->next_event_path, "%s", path);
 
   // (old format) event struct -> file on disk
-  void *old_event = event_generator();
-  memcpy(&event_ctx->next_event, old_event, sizeof(bugsnag_event));
-  free(old_event);
-  // FUTURE(df): whenever migration v9 rolls around, the v8 version of
-  // bsg_serialize_event_to_file() function should be moved into this file to
-  // preserve the migration test behavior. The good news is—if this doesn't
-  // happen—the test will probably start failing loudly.
-  bsg_serialize_event_to_file(event_ctx);
-  free(event_ctx);
+  auto report = (bugsnag_report_v8 *)event_generator();
+  // the feature flags are written the same way as the current event's
+  auto flags = bsg_test_event_calloc();
+  flags->feature_flag_count = report->feature_flag_count;
+  flags->feature_flags = report->feature_flags;
+  bsg_buffered_writer writer;
+  if (bsg_buffered_writer_open(&writer, path)) {
+    bsg_report_header header = {8, 0, {0}};
+    bsg_report_header_write(&header, writer.fd);
+    writer.write(&writer, report, sizeof(bugsnag_report_v8));
+    bsg_write_feature_flags(flags, &writer);
+    writer.dispose(&writer);
+  }
+  bsg_free_feature_flags(flags);
+  free(flags);
+  free(report);
   return path;
 }
 
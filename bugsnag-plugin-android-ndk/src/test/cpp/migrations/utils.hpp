@@ -51,15 +51,20 @@ static bool write_struct_to_file(void *event, int version, size_t expected_lengt
   return actual_length == expected_length;
 }
 
-static void insert_crumb(bugsnag_breadcrumb *array, int index, const char *name,
-                  bugsnag_breadcrumb_type type, long long timestamp,
-                  const char *meta_str) {
-  auto crumb = bugsnag_breadcrumb{.type = type};
+static void insert_crumb(bugsnag_breadcrumb_v2 *array, int index,
+                         const char *name, bugsnag_breadcrumb_type type,
+                         long long timestamp, const char *meta_str) {
+  auto crumb = bugsnag_breadcrumb_v2{.type = type};
   strcpy(crumb.name, name);
   sprintf(crumb.timestamp, "t%llu", timestamp);
-  bsg_add_metadata_value_str(&crumb.metadata, "metadata", "message", meta_str);
-
-  memcpy(&(array[index]), &crumb, sizeof(bugsnag_breadcrumb));
+  crumb.metadata.value_count = 1;
+  auto value = &crumb.metadata.values[0];
+  strcpy(value->section, "metadata");
+  strcpy(value->name, "message");
+  value->type = BSG_METADATA_CHAR_VALUE;
+  strncpy(value->char_value, meta_str, sizeof(value->char_value) - 1);
+
+  memcpy(&(array[index]), &crumb, sizeof(bugsnag_breadcrumb_v2));
 }
 
 /**
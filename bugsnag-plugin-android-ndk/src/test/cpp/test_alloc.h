@@ -0,0 +1,37 @@
+#ifndef BUGSNAG_TEST_ALLOC_H
+#define BUGSNAG_TEST_ALLOC_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <bugsnag_ndk.h>
+#include <event.h>
+
+/**
+ * Allocate a zeroed event, aligned for its cache line groups as
+ * bsg_event_alloc() aligns it, which calloc() does not guarantee. Released
+ * with free().
+ */
+static inline bugsnag_event *bsg_test_event_calloc(void) {
+  bugsnag_event *event = bsg_event_alloc();
+  if (event != NULL) {
+    memset(event, 0, sizeof(bugsnag_event));
+  }
+  return event;
+}
+
+/**
+ * Allocate a zeroed environment, aligned as install() aligns it. Released
+ * with free().
+ */
+static inline bsg_environment *bsg_test_environment_calloc(void) {
+  void *env = NULL;
+  if (posix_memalign(&env, BSG_CACHE_LINE_SIZE, sizeof(bsg_environment)) !=
+      0) {
+    return NULL;
+  }
+  memset(env, 0, sizeof(bsg_environment));
+  return (bsg_environment *)env;
+}
+
+#endif
@@ -1,37 +1,52 @@
 #include <event.h>
 #include <greatest/greatest.h>
+#include <pthread.h>
 #include <time.h>
 #include <utils/serializer/json_writer.h>
+#include "test_alloc.h"
 
 bugsnag_breadcrumb *init_breadcrumb(const char *name, char *message, bugsnag_breadcrumb_type type) {
   bugsnag_breadcrumb *crumb = calloc(1, sizeof(bugsnag_breadcrumb));
   crumb->type = type;
   strcpy(crumb->name, name);
-  strcpy(crumb->timestamp, "2018-08-29T21:41:39Z");
-  bsg_add_metadata_value_str(&crumb->metadata, "metaData", "message", message);
+  crumb->timestamp_ms = 1535578899000;
+  bsg_add_metadata_value_str(&crumb->metadata, NULL, "metaData", "message", message);
+  return crumb;
+}
+
+bsg_breadcrumb_view get_breadcrumb(const bugsnag_event *event, int slot) {
+  bsg_breadcrumb_view crumb = {.name = ""};
+  bsg_event_get_breadcrumb(event, slot, &crumb);
   return crumb;
 }
 
 TEST test_add_breadcrumb(void) {
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+  bugsnag_event *event = bsg_test_event_calloc();
+  bsg_breadcrumb_view view;
+  bsg_metadata_arena_value value;
   bugsnag_breadcrumb *crumb = init_breadcrumb("stroll", "this is a drill.", BSG_CRUMB_USER);
   bugsnag_event_add_breadcrumb(event, crumb);
   ASSERT_EQ(1, event->crumb_count);
   ASSERT_EQ(0, event->crumb_first_index);
-  ASSERT(strcmp("stroll", event->breadcrumbs[0].name) == 0);
-  ASSERT(strcmp("message", event->breadcrumbs[0].metadata.values[0].name) == 0);
-  ASSERT(strcmp("this is a drill.", event->breadcrumbs[0].metadata.values[0].char_value) == 0);
+  ASSERT(bsg_event_get_breadcrumb(event, 0, &view));
+  ASSERT_STR_EQ("stroll", view.name);
+  ASSERT_EQ(1535578899000, view.timestamp_ms);
+  ASSERT_EQ(BSG_CRUMB_USER, view.type);
+  ASSERT(bsg_breadcrumb_next_value(&view, &value));
+  ASSERT_STR_EQ("message", value.name);
+  ASSERT_STR_EQ("this is a drill.", value.char_value);
+  ASSERT_FALSE(bsg_breadcrumb_next_value(&view, &value));
   free(crumb);
   bugsnag_breadcrumb *crumb2 = init_breadcrumb("walking...", "this is not a drill.", BSG_CRUMB_USER);
   bugsnag_event_add_breadcrumb(event, crumb2);
   ASSERT_EQ(2, event->crumb_count);
   ASSERT_EQ(0, event->crumb_first_index);
-  ASSERT(strcmp("stroll", event->breadcrumbs[0].name) == 0);
-  ASSERT(strcmp("message", event->breadcrumbs[0].metadata.values[0].name) == 0);
-  ASSERT(strcmp("this is a drill.", event->breadcrumbs[0].metadata.values[0].char_value) == 0);
-  ASSERT(strcmp("walking...", event->breadcrumbs[1].name) == 0);
-  ASSERT(strcmp("message", event->breadcrumbs[1].metadata.values[0].name) == 0);
-  ASSERT(strcmp("this is not a drill.", event->breadcrumbs[1].metadata.values[0].char_value) == 0);
+  ASSERT_STR_EQ("stroll", get_breadcrumb(event, 0).name);
+  ASSERT(bsg_event_get_breadcrumb(event, 1, &view));
+  ASSERT_STR_EQ("walking...", view.name);
+  ASSERT(bsg_breadcrumb_next_value(&view, &value));
+  ASSERT_STR_EQ("message", value.name);
+  ASSERT_STR_EQ("this is not a drill.", value.char_value);
 
   free(event);
   free(crumb2);
@@ -39,7 +54,7 @@ TEST test_add_breadcrumb(void) {
 }
 
 TEST test_add_breadcrumbs_over_max(void) {
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+  bugsnag_event *event = bsg_test_event_calloc();
   int breadcrumb_count = 64;
 
   for (int i=0; i < breadcrumb_count; i++) {
@@ -56,15 +71,365 @@ TEST test_add_breadcrumbs_over_max(void) {
   ASSERT_EQ(BUGSNAG_CRUMBS_MAX, event->crumb_count);
   ASSERT_EQ(14, event->crumb_first_index);
 
-  ASSERT_STR_EQ("crumb: 50", event->breadcrumbs[0].name);
-  ASSERT_STR_EQ("crumb: 51", event->breadcrumbs[1].name);
-  ASSERT_STR_EQ("crumb: 52", event->breadcrumbs[2].name);
-  ASSERT_STR_EQ("crumb: 53", event->breadcrumbs[3].name);
+  ASSERT_STR_EQ("crumb: 50", get_breadcrumb(event, 0).name);
+  ASSERT_STR_EQ("crumb: 51", get_breadcrumb(event, 1).name);
+  ASSERT_STR_EQ("crumb: 52", get_breadcrumb(event, 2).name);
+  ASSERT_STR_EQ("crumb: 53", get_breadcrumb(event, 3).name);
+
+  ASSERT_STR_EQ("crumb: 63", get_breadcrumb(event, 13).name);
+  ASSERT_STR_EQ("crumb: 14", get_breadcrumb(event, 14).name);
+  ASSERT_STR_EQ("crumb: 15", get_breadcrumb(event, 15).name);
+  ASSERT_STR_EQ("crumb: 16", get_breadcrumb(event, 16).name);
+  free(event);
+  PASS();
+}
+
+TEST test_add_breadcrumbs_over_bytes(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+  bugsnag_breadcrumb *crumb = init_breadcrumb("bulky", "", BSG_CRUMB_LOG);
+  char value[64];
+  memset(value, 'x', sizeof(value) - 1);
+  value[sizeof(value) - 1] = '\0';
+  for (int i = 0; i < 16; i++) {
+    char name[16];
+    sprintf(name, "value%d", i);
+    bsg_add_metadata_value_str(&crumb->metadata, NULL, "metaData", name, value);
+  }
+
+  // records of over 1KB fill the ring in fewer than BUGSNAG_CRUMBS_MAX
+  int added = BUGSNAG_CRUMBS_MAX - 1;
+  for (int i = 0; i < added; i++) {
+    sprintf(crumb->name, "bulky %d", i);
+    bugsnag_event_add_breadcrumb(event, crumb);
+  }
+  ASSERT(event->crumb_count < added);
+  ASSERT_EQ(added - event->crumb_count, event->crumb_first_index);
+
+  // only the newest remain, complete and in order
+  for (int i = 0; i < event->crumb_count; i++) {
+    char name[16];
+    sprintf(name, "bulky %d", event->crumb_first_index + i);
+    bsg_breadcrumb_view view = get_breadcrumb(event, event->crumb_first_index + i);
+    ASSERT_STR_EQ(name, view.name);
+    ASSERT_EQ(17, view.values_remaining);
+  }
+  for (int i = 0; i < event->crumb_first_index; i++) {
+    bsg_breadcrumb_view view;
+    ASSERT_FALSE(bsg_event_get_breadcrumb(event, i, &view));
+  }
+
+  bsg_event_freeze_breadcrumbs(event);
+  ASSERT(event->crumb_count < added);
+  ASSERT_STR_EQ("bulky 48", get_breadcrumb(event, added - 1).name);
+  free(crumb);
+  free(event);
+  PASS();
+}
+
+#define CONCURRENT_CRUMB_THREADS 4
+#define CONCURRENT_CRUMB_COUNT 500
+
+typedef struct {
+  bugsnag_event *event;
+  int thread;
+} concurrent_crumb_writer;
+
+static void *add_concurrent_crumbs(void *arg) {
+  concurrent_crumb_writer *writer = arg;
+  for (int i = 0; i < CONCURRENT_CRUMB_COUNT; i++) {
+    char name[32];
+    sprintf(name, "%d:%d", writer->thread, i);
+    bsg_metadata_arena_value value = {
+        .name = "index",
+        .type = BSG_METADATA_NUMBER_VALUE,
+        .double_value = i,
+    };
+    // vary the size of the records so that they wrap unevenly
+    uint32_t length = bsg_crumb_record_size(name, 1 + 6 + sizeof(double)) + (i % 7) * 100;
+    uint64_t ticket;
+    void *record = bsg_event_claim_breadcrumb(writer->event, length, &ticket);
+    if (record != NULL) {
+      bsg_crumb_record_init(record, length, name, 0, BSG_CRUMB_LOG);
+      bsg_crumb_record_add_value(record, length, &value);
+      bsg_event_publish_breadcrumb(writer->event, ticket);
+    }
+  }
+  return NULL;
+}
+
+TEST test_add_breadcrumbs_concurrently(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+  pthread_t threads[CONCURRENT_CRUMB_THREADS];
+  concurrent_crumb_writer writers[CONCURRENT_CRUMB_THREADS];
+  for (int i = 0; i < CONCURRENT_CRUMB_THREADS; i++) {
+    writers[i].event = event;
+    writers[i].thread = i;
+    pthread_create(&threads[i], NULL, add_concurrent_crumbs, &writers[i]);
+  }
+  for (int i = 0; i < CONCURRENT_CRUMB_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  bsg_event_freeze_breadcrumbs(event);
+  ASSERT(event->crumb_count > 0);
+  ASSERT(event->crumb_count <= BUGSNAG_CRUMBS_MAX);
+
+  // each thread's breadcrumbs are complete and in the order it added them
+  int last_index[CONCURRENT_CRUMB_THREADS] = {-1, -1, -1, -1};
+  int published = 0;
+  for (int i = 0; i < event->crumb_count; i++) {
+    int slot = (event->crumb_first_index + i) % BUGSNAG_CRUMBS_MAX;
+    bsg_breadcrumb_view view;
+    bsg_metadata_arena_value value;
+    if (!bsg_event_get_breadcrumb(event, slot, &view)) {
+      continue;
+    }
+    int thread, index;
+    ASSERT_EQ(2, sscanf(view.name, "%d:%d", &thread, &index));
+    ASSERT(bsg_breadcrumb_next_value(&view, &value));
+    ASSERT_EQ((double)index, value.double_value);
+    ASSERT(index > last_index[thread]);
+    last_index[thread] = index;
+    published++;
+  }
+  ASSERT_EQ(event->crumb_count, published);
+  free(event);
+  PASS();
+}
+
+TEST test_freeze_breadcrumbs(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+  bsg_breadcrumb_view view;
+  bugsnag_breadcrumb *crumb = init_breadcrumb("first", "complete", BSG_CRUMB_USER);
+  bugsnag_event_add_breadcrumb(event, crumb);
+
+  // a breadcrumb interrupted part way through is left out
+  uint64_t ticket;
+  uint32_t length = bsg_crumb_record_size("partial", 0);
+  void *partial = bsg_event_claim_breadcrumb(event, length, &ticket);
+  ASSERT(partial != NULL);
+  bsg_crumb_record_init(partial, length, "partial", 0, BSG_CRUMB_USER);
+  bsg_event_freeze_breadcrumbs(event);
+  bsg_event_publish_breadcrumb(event, ticket);
+  ASSERT_EQ(2, event->crumb_count);
+  ASSERT(bsg_event_get_breadcrumb(event, 0, &view));
+  ASSERT_FALSE(bsg_event_get_breadcrumb(event, 1, &view));
+
+  // and nothing more can be added
+  bugsnag_event_add_breadcrumb(event, crumb);
+  ASSERT_EQ(NULL, bsg_event_claim_breadcrumb(event, length, &ticket));
+  ASSERT_EQ(2, event->crumb_count);
+  free(crumb);
+  free(event);
+  PASS();
+}
+
+static size_t pack_metadata_name(uint8_t *dest, uint8_t type, const char *name) {
+  uint32_t length = strlen(name);
+  dest[0] = type;
+  memcpy(dest + 1, &length, sizeof(length));
+  memcpy(dest + 1 + sizeof(length), name, length);
+  return 1 + sizeof(length) + length;
+}
+
+static size_t pack_test_metadata(uint8_t *packed) {
+  size_t length = 0;
+  double number = 4.5;
+  uint32_t value_length = strlen("done");
+
+  length += pack_metadata_name(packed + length, BSG_METADATA_BOOL_VALUE, "flag");
+  packed[length++] = 1;
+  length += pack_metadata_name(packed + length, BSG_METADATA_NUMBER_VALUE, "count");
+  memcpy(packed + length, &number, sizeof(number));
+  length += sizeof(number);
+  length += pack_metadata_name(packed + length, BSG_METADATA_CHAR_VALUE, "state");
+  memcpy(packed + length, &value_length, sizeof(value_length));
+  length += sizeof(value_length);
+  memcpy(packed + length, "done", value_length);
+  length += value_length;
+  return length;
+}
+
+TEST test_add_packed_metadata(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+  bsg_breadcrumb_view view;
+  bsg_metadata_arena_value value;
+  uint8_t packed[256];
+  size_t length = pack_test_metadata(packed);
+
+  // the packed values are decoded in place from the end of the record
+  uint8_t record[512];
+  uint32_t capacity = bsg_crumb_record_size("packed", length);
+  ASSERT(capacity <= sizeof(record));
+  bsg_crumb_record_init(record, capacity, "packed", 0, BSG_CRUMB_STATE);
+  memcpy(record + capacity - length, packed, length);
+  ASSERT(bsg_crumb_record_add_packed(record, capacity, record + capacity - length, length));
+  uint32_t record_length;
+  memcpy(&record_length, record, sizeof(record_length));
+  ASSERT(record_length < capacity);
+  ASSERT(bsg_event_add_breadcrumb_record(event, record, record_length));
+
+  ASSERT(bsg_event_get_breadcrumb(event, 0, &view));
+  ASSERT_STR_EQ("packed", view.name);
+  ASSERT_EQ(BSG_CRUMB_STATE, view.type);
+  ASSERT_EQ(3, view.values_remaining);
+  ASSERT(bsg_breadcrumb_next_value(&view, &value));
+  ASSERT_STR_EQ("flag", value.name);
+  ASSERT(value.bool_value);
+  ASSERT(bsg_breadcrumb_next_value(&view, &value));
+  ASSERT_EQ(4.5, value.double_value);
+  ASSERT(bsg_breadcrumb_next_value(&view, &value));
+  ASSERT_STR_EQ("state", value.name);
+  ASSERT_STR_EQ("done", value.char_value);
+
+  // a truncated buffer keeps the values which were complete
+  bsg_crumb_record_init(record, capacity, "packed", 0, BSG_CRUMB_STATE);
+  memcpy(record + capacity - length, packed, length);
+  ASSERT_FALSE(bsg_crumb_record_add_packed(record, capacity, record + capacity - length, length - 1));
+  memcpy(&record_length, record, sizeof(record_length));
+  bugsnag_event_clear_breadcrumbs(event);
+  ASSERT(bsg_event_add_breadcrumb_record(event, record, record_length));
+  ASSERT_EQ(2, get_breadcrumb(event, 0).values_remaining);
+
+  // and records which cannot be read are refused
+  ASSERT_FALSE(bsg_event_add_breadcrumb_record(event, record, record_length - 1));
+  ASSERT_EQ(1, event->crumb_count);
+  free(event);
+  PASS();
+}
+
+static size_t pack_string(uint8_t *dest, const char *value) {
+  uint32_t length = strlen(value);
+  memcpy(dest, &length, sizeof(length));
+  memcpy(dest + sizeof(length), value, length);
+  return sizeof(length) + length;
+}
+
+static size_t pack_breadcrumb(uint8_t *dest, uint8_t type, const char *name,
+                              int64_t timestamp_ms, const uint8_t *metadata,
+                              uint32_t metadata_length) {
+  size_t length = 0;
+  dest[length++] = type;
+  length += pack_string(dest + length, name);
+  memcpy(dest + length, &timestamp_ms, sizeof(timestamp_ms));
+  length += sizeof(timestamp_ms);
+  memcpy(dest + length, &metadata_length, sizeof(metadata_length));
+  length += sizeof(metadata_length);
+  if (metadata_length > 0) {
+    memcpy(dest + length, metadata, metadata_length);
+  }
+  return length + metadata_length;
+}
+
+TEST test_add_packed_breadcrumbs(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+  bsg_breadcrumb_view view;
+  bsg_metadata_arena_value value;
+  uint8_t metadata[256];
+  uint8_t packed[1024];
+  size_t metadata_length = pack_test_metadata(metadata);
+  size_t length = 0;
+
+  length += pack_breadcrumb(packed + length, BSG_CRUMB_REQUEST, "GET /", 1, metadata, metadata_length);
+  length += pack_breadcrumb(packed + length, BSG_CRUMB_NAVIGATION, "MainActivity", 2, NULL, 0);
+  // unknown types are stored as manual breadcrumbs
+  length += pack_breadcrumb(packed + length, 99, "odd", 3, NULL, 0);
+  ASSERT(bsg_event_add_packed_breadcrumbs(event, packed, length));
+  ASSERT_EQ(3, event->crumb_count);
+
+  ASSERT(bsg_event_get_breadcrumb(event, 0, &view));
+  ASSERT_STR_EQ("GET /", view.name);
+  ASSERT_EQ(1, view.timestamp_ms);
+  ASSERT_EQ(BSG_CRUMB_REQUEST, view.type);
+  ASSERT_EQ(3, view.values_remaining);
+  ASSERT(bsg_breadcrumb_next_value(&view, &value));
+  ASSERT_STR_EQ("flag", value.name);
+  ASSERT_EQ(BSG_CRUMB_NAVIGATION, get_breadcrumb(event, 1).type);
+  ASSERT_EQ(0, get_breadcrumb(event, 1).values_remaining);
+  ASSERT_EQ(BSG_CRUMB_MANUAL, get_breadcrumb(event, 2).type);
+
+  // a truncated batch keeps the breadcrumbs which were complete
+  bugsnag_event_clear_breadcrumbs(event);
+  ASSERT_FALSE(bsg_event_add_packed_breadcrumbs(event, packed, length - 1));
+  ASSERT_EQ(2, event->crumb_count);
+  ASSERT_STR_EQ("MainActivity", get_breadcrumb(event, 1).name);
+  free(event);
+  PASS();
+}
+
+TEST test_crumb_timestamp_parse(void) {
+  ASSERT_EQ(1539000435563, bsg_crumb_timestamp_parse("t1539000435563"));
+  ASSERT_EQ(1539000429000, bsg_crumb_timestamp_parse("2018-10-08T12:07:09Z"));
+  ASSERT_EQ(1539000435563,
+            bsg_crumb_timestamp_parse("2018-10-08T12:07:15.563Z"));
+  ASSERT_EQ(1539000435560,
+            bsg_crumb_timestamp_parse("2018-10-08T12:07:15.56Z"));
+  ASSERT_EQ(1553000299000,
+            bsg_crumb_timestamp_parse("2019-03-19T12:58:19+00:00"));
+  ASSERT_EQ(1553000299000,
+            bsg_crumb_timestamp_parse("2019-03-19T13:58:19+01:00"));
+  ASSERT_EQ(1553000299000,
+            bsg_crumb_timestamp_parse("2019-03-19T07:28:19-0530"));
+  ASSERT_EQ(0, bsg_crumb_timestamp_parse(""));
+  ASSERT_EQ(0, bsg_crumb_timestamp_parse("2019-03-19"));
+  ASSERT_EQ(0, bsg_crumb_timestamp_parse("2019-03-19T12:58:19"));
+  PASS();
+}
+
+/**
+ * Write a breadcrumb record in the layout of v11 to v14, taking its values
+ * from a current record
+ */
+static uint32_t write_record_v14(char *dest, const char *name,
+                                 const char *timestamp,
+                                 const bsg_metadata_arena_value *value) {
+  char current[256];
+  bsg_crumb_record_init(current, sizeof(current), name, 0, BSG_CRUMB_LOG);
+  uint32_t values_offset;
+  memcpy(&values_offset, current, sizeof(values_offset));
+  bsg_crumb_record_add_value(current, sizeof(current), value);
+  uint32_t current_length;
+  memcpy(&current_length, current, sizeof(current_length));
+  const uint32_t values_length = current_length - values_offset;
+
+  const uint8_t name_length = strlen(name);
+  const uint8_t timestamp_length = strlen(timestamp);
+  const uint32_t length =
+      8 + name_length + 1 + timestamp_length + 1 + values_length;
+  memcpy(dest, &length, sizeof(length));
+  dest[4] = BSG_CRUMB_LOG;
+  dest[5] = name_length;
+  dest[6] = timestamp_length;
+  dest[7] = 1;
+  strcpy(&dest[8], name);
+  strcpy(&dest[8 + name_length + 1], timestamp);
+  memcpy(&dest[length - values_length], &current[values_offset], values_length);
+  return length;
+}
+
+TEST test_add_breadcrumb_record_v14(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+  bsg_breadcrumb_view view;
+  bsg_metadata_arena_value value = {
+      .name = "level", .type = BSG_METADATA_CHAR_VALUE, .char_value = "info"};
+  char record[256];
+  uint32_t length =
+      write_record_v14(record, "logged", "2018-10-08T12:07:09Z", &value);
+  ASSERT(bsg_event_add_breadcrumb_record_v14(event, record, length));
+  length = write_record_v14(record, "later", "t1539000435563", &value);
+  ASSERT(bsg_event_add_breadcrumb_record_v14(event, record, length));
+  // records which were cut short are rejected
+  ASSERT_FALSE(bsg_event_add_breadcrumb_record_v14(event, record, length - 1));
+  ASSERT_EQ(2, event->crumb_count);
 
-  ASSERT_STR_EQ("crumb: 63", event->breadcrumbs[13].name);
-  ASSERT_STR_EQ("crumb: 14", event->breadcrumbs[14].name);
-  ASSERT_STR_EQ("crumb: 15", event->breadcrumbs[15].name);
-  ASSERT_STR_EQ("crumb: 16", event->breadcrumbs[16].name);
+  ASSERT(bsg_event_get_breadcrumb(event, 0, &view));
+  ASSERT_STR_EQ("logged", view.name);
+  ASSERT_EQ(1539000429000, view.timestamp_ms);
+  ASSERT_EQ(BSG_CRUMB_LOG, view.type);
+  ASSERT(bsg_breadcrumb_next_value(&view, &value));
+  ASSERT_STR_EQ("level", value.name);
+  ASSERT_STR_EQ("info", value.char_value);
+  ASSERT_FALSE(bsg_breadcrumb_next_value(&view, &value));
+  ASSERT_EQ(1539000435563, get_breadcrumb(event, 1).timestamp_ms);
   free(event);
   PASS();
 }
@@ -116,6 +481,13 @@ TEST test_bsg_calculate_crumb_index(void) {
 SUITE(suite_breadcrumbs) {
   RUN_TEST(test_add_breadcrumb);
   RUN_TEST(test_add_breadcrumbs_over_max);
+  RUN_TEST(test_add_breadcrumbs_over_bytes);
+  RUN_TEST(test_add_breadcrumbs_concurrently);
+  RUN_TEST(test_freeze_breadcrumbs);
+  RUN_TEST(test_add_packed_metadata);
+  RUN_TEST(test_add_packed_breadcrumbs);
+  RUN_TEST(test_crumb_timestamp_parse);
+  RUN_TEST(test_add_breadcrumb_record_v14);
   RUN_TEST(test_bsg_calculate_total_crumbs);
   RUN_TEST(test_bsg_calculate_start_index);
   RUN_TEST(test_bsg_calculate_crumb_index);
@@ -1,11 +1,18 @@
 #include <greatest/greatest.h>
 #include <event.h>
+#include <event_state.h>
+#include <utils/lock_stats.h>
+#include <utils/module_index.h>
+#include <utils/stack_unwinder.h>
+#include <utils/stack_unwinder_simple.h>
+#include <utils/unwinder_calibration.h>
 #include <utils/string.h>
 #include "../../main/assets/include/bugsnag.h"
 #include <event.h>
+#include "test_alloc.h"
 
 bugsnag_event *init_event() {
-    bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+    bugsnag_event *event = bsg_test_event_calloc();
     bsg_strncpy(event->api_key, "5d1e5fbd39a74caa1200142706a90b20", sizeof(event->api_key));
     bsg_strncpy(event->context, "Foo", sizeof(event->context));
     bsg_strncpy(event->user.id, "123", sizeof(event->user.id));
@@ -364,6 +371,144 @@ TEST test_event_metadata(void) {
     PASS();
 }
 
+TEST test_event_metadata_index(void) {
+    bugsnag_event *event = init_event();
+    char name[32];
+
+    // setting a key again replaces its value rather than using another slot
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 100; i++) {
+            sprintf(name, "key%d", i);
+            bugsnag_event_add_metadata_double(event, i % 2 ? "odd" : "even", name, i + round);
+        }
+    }
+    ASSERT_EQ(100, event->metadata.value_count);
+    ASSERT_EQ(52.0, bugsnag_event_get_metadata_double(event, "even", "key50"));
+    ASSERT_EQ(BSG_METADATA_NONE_VALUE, bugsnag_event_has_metadata(event, "odd", "key50"));
+
+    // clearing moves the last value, which must remain reachable
+    for (int i = 0; i < 100; i += 3) {
+        sprintf(name, "key%d", i);
+        bugsnag_event_clear_metadata(event, i % 2 ? "odd" : "even", name);
+    }
+    bugsnag_event_clear_metadata_section(event, "odd");
+    for (int i = 0; i < 100; i++) {
+        sprintf(name, "key%d", i);
+        bool present = i % 3 != 0 && i % 2 == 0;
+        ASSERT_EQ(present ? 2.0 + i : 0.0, bugsnag_event_get_metadata_double(event, "even", name));
+        ASSERT_EQ(BSG_METADATA_NONE_VALUE, bugsnag_event_has_metadata(event, "odd", name));
+    }
+
+    // an index rebuilt from the values finds the same entries
+    memset(&event->metadata_index, 0, sizeof(bsg_metadata_index));
+    bsg_event_index_metadata(event);
+    ASSERT_EQ(6.0, bugsnag_event_get_metadata_double(event, "even", "key4"));
+    ASSERT_EQ(0.0, bugsnag_event_get_metadata_double(event, "even", "key6"));
+
+    // keys are matched as stored, after truncation
+    bugsnag_event_add_metadata_string(event, "long", "a_name_which_does_not_fit_in_32_bytes", "one");
+    bugsnag_event_add_metadata_string(event, "long", "a_name_which_does_not_fit_in_32_bytes", "two");
+    ASSERT_STR_EQ("two", bugsnag_event_get_metadata_string(event, "long", "a_name_which_does_not_fit_in_32_bytes"));
+    free(event);
+    PASS();
+}
+
+TEST test_event_metadata_names(void) {
+    bugsnag_event *event = init_event();
+    bugsnag_metadata *metadata = &event->metadata;
+    char name[32];
+
+    // sections and names are stored once, however many values use them
+    bugsnag_event_add_metadata_string(event, "shared", "key", "one");
+    bugsnag_event_add_metadata_bool(event, "shared", "other", true);
+    bugsnag_breadcrumb *crumb = calloc(1, sizeof(bugsnag_breadcrumb));
+    bsg_add_metadata_value_str(&crumb->metadata, NULL, "shared", "key", "a");
+    bsg_add_metadata_value_str(&crumb->metadata, NULL, "shared", "key", "b");
+    ASSERT_EQ(2, crumb->metadata.value_count);
+    ASSERT_EQ(crumb->metadata.values[0].name, crumb->metadata.values[1].name);
+    ASSERT_EQ(1 + sizeof("shared") + sizeof("key"), crumb->metadata.names_length);
+    free(crumb);
+
+    int first = metadata->value_count - 2;
+    ASSERT_EQ(metadata->values[first].section, metadata->values[first + 1].section);
+    ASSERT_STR_EQ("shared", bsg_metadata_value_section(metadata, &metadata->values[first]));
+    ASSERT_STR_EQ("other", bsg_metadata_value_name(metadata, &metadata->values[first + 1]));
+
+    // names which are no longer used are dropped once space runs out
+    for (int i = 0; i < BUGSNAG_METADATA_NAMES_SIZE; i++) {
+        sprintf(name, "churn%d", i);
+        bugsnag_event_add_metadata_double(event, "churn", name, i);
+        bugsnag_event_clear_metadata(event, "churn", name);
+    }
+    bugsnag_event_add_metadata_double(event, "churn", "last", 1);
+    ASSERT_EQ(1.0, bugsnag_event_get_metadata_double(event, "churn", "last"));
+    ASSERT_STR_EQ("one", bugsnag_event_get_metadata_string(event, "shared", "key"));
+    ASSERT(metadata->names_length <= BUGSNAG_METADATA_NAMES_SIZE);
+
+    // offsets outside of the names in use read as empty
+    bsg_metadata_value value = {.name = BUGSNAG_METADATA_NAMES_SIZE - 1};
+    ASSERT_STR_EQ("", bsg_metadata_value_name(metadata, &value));
+    free(event);
+    PASS();
+}
+
+TEST test_event_metadata_arena(void) {
+    bugsnag_event *event = init_event();
+    bsg_metadata_arena *arena = &event->metadata_arena;
+    ASSERT(bsg_metadata_arena_reserve(arena, 1024));
+    char long_value[200];
+    memset(long_value, 'x', sizeof(long_value) - 1);
+    long_value[sizeof(long_value) - 1] = '\0';
+    char name[32];
+
+    // strings which would be truncated are kept whole in the arena
+    int value_count = event->metadata.value_count;
+    bugsnag_event_add_metadata_string(event, "large", "text", long_value);
+    ASSERT_STR_EQ(long_value, bugsnag_event_get_metadata_string(event, "large", "text"));
+    ASSERT_EQ(BSG_METADATA_CHAR_VALUE, bugsnag_event_has_metadata(event, "large", "text"));
+    ASSERT_EQ(value_count, event->metadata.value_count);
+
+    // a value lives in one store at a time
+    bugsnag_event_add_metadata_string(event, "large", "text", "short");
+    ASSERT_STR_EQ("short", bugsnag_event_get_metadata_string(event, "large", "text"));
+    ASSERT_EQ(0, arena->length);
+    bugsnag_event_add_metadata_string(event, "large", "text", long_value);
+    ASSERT_EQ(value_count, event->metadata.value_count);
+
+    // values overflow into the arena once the fixed store is full
+    for (int i = event->metadata.value_count; i < BUGSNAG_METADATA_MAX; i++) {
+        sprintf(name, "fill%d", i);
+        bugsnag_event_add_metadata_bool(event, "fill", name, true);
+    }
+    bugsnag_event_add_metadata_double(event, "large", "number", 4.5);
+    bugsnag_event_add_metadata_bool(event, "large", "flag", true);
+    ASSERT_EQ(4.5, bugsnag_event_get_metadata_double(event, "large", "number"));
+    ASSERT(bugsnag_event_get_metadata_bool(event, "large", "flag"));
+
+    uint32_t offset = 0;
+    bsg_metadata_arena_value value;
+    int count = 0;
+    while (bsg_metadata_arena_next(arena, &offset, &value)) {
+        ASSERT_STR_EQ("large", value.section);
+        count++;
+    }
+    ASSERT_EQ(3, count);
+
+    bugsnag_event_clear_metadata(event, "large", "number");
+    ASSERT_EQ(BSG_METADATA_NONE_VALUE, bugsnag_event_has_metadata(event, "large", "number"));
+    ASSERT(bugsnag_event_get_metadata_bool(event, "large", "flag"));
+    bugsnag_event_clear_metadata_section(event, "large");
+    ASSERT_EQ(0, arena->length);
+
+    // without room in the arena long strings are truncated as before
+    bugsnag_event_clear_metadata_section(event, "fill");
+    bsg_metadata_arena_free(arena);
+    bugsnag_event_add_metadata_string(event, "large", "text", long_value);
+    ASSERT_EQ(63, strlen(bugsnag_event_get_metadata_string(event, "large", "text")));
+    free(event);
+    PASS();
+}
+
 TEST test_event_stacktrace(void) {
     bugsnag_event *event = init_event();
 
@@ -386,6 +531,354 @@ TEST test_event_stacktrace(void) {
     PASS();
 }
 
+TEST test_event_state_updates(void) {
+    bugsnag_event *event = init_event();
+    bsg_event_state_buffer *buffer = calloc(1, sizeof(bsg_event_state_buffer));
+    bsg_event_state_init(buffer, event, 42);
+    ASSERT_STR_EQ("Foo", bsg_event_state_current(buffer)->context);
+
+    // an update is not seen until it is published
+    bsg_event_state *state = bsg_event_state_begin_update(buffer);
+    ASSERT_STR_EQ("Bob Bobbiton", state->user.name);
+    bsg_strncpy(state->context, "Bar", sizeof(state->context));
+    ASSERT_STR_EQ("Foo", bsg_event_state_current(buffer)->context);
+    ASSERT_EQ(42, bsg_event_state_apply(buffer, event));
+    ASSERT_STR_EQ("Foo", event->context);
+
+    bsg_event_state_publish(buffer);
+    ASSERT_STR_EQ("Bar", bsg_event_state_current(buffer)->context);
+
+    // and each update starts from the last one published
+    state = bsg_event_state_begin_update(buffer);
+    ASSERT_STR_EQ("Bar", state->context);
+    state->foreground_start_time = 0;
+    bsg_strncpy(state->device.orientation, "landscape", sizeof(state->device.orientation));
+    bsg_event_state_publish(buffer);
+    ASSERT_EQ(0, bsg_event_state_apply(buffer, event));
+    ASSERT_STR_EQ("Bar", event->context);
+    ASSERT_STR_EQ("landscape", event->device.orientation);
+    ASSERT_STR_EQ("Bob Bobbiton", event->user.name);
+    free(buffer);
+    free(event);
+    PASS();
+}
+
+TEST test_event_state_sessions(void) {
+    bugsnag_event *event = init_event();
+    bsg_strncpy(event->session_id, "abc", sizeof(event->session_id));
+    event->handled_events = 2;
+    bsg_event_state_buffer *buffer = calloc(1, sizeof(bsg_event_state_buffer));
+    bsg_event_state_init(buffer, event, 0);
+
+    ASSERT(bsg_event_state_count_event(buffer, false));
+    ASSERT(bsg_event_state_count_event(buffer, true));
+    bsg_event_state_apply(buffer, event);
+    ASSERT_STR_EQ("abc", event->session_id);
+    ASSERT_EQ(3, event->handled_events);
+    ASSERT_EQ(1, event->unhandled_events);
+
+    // starting a session swaps the id and counts together
+    bsg_event_state_set_session(buffer, "def", "2018-10-08T12:07:09Z", 5, 7);
+    ASSERT(bsg_event_state_count_event(buffer, true));
+    bsg_event_state_apply(buffer, event);
+    ASSERT_STR_EQ("def", event->session_id);
+    ASSERT_STR_EQ("2018-10-08T12:07:09Z", event->session_start);
+    ASSERT_EQ(5, event->handled_events);
+    ASSERT_EQ(8, event->unhandled_events);
+
+    // nothing is counted while paused
+    bsg_event_state_set_session(buffer, NULL, NULL, 0, 0);
+    ASSERT_FALSE(bsg_event_state_count_event(buffer, false));
+    bsg_event_state_apply(buffer, event);
+    ASSERT_STR_EQ("", event->session_id);
+    ASSERT_STR_EQ("", event->session_start);
+    ASSERT_EQ(0, event->handled_events);
+    ASSERT_EQ(0, event->unhandled_events);
+
+    // a restarted session goes back to the first slot
+    bsg_event_state_set_session(buffer, "ghi", "2018-10-09T12:07:09Z", 0, 0);
+    ASSERT(bsg_event_state_count_event(buffer, false));
+    bsg_event_state_apply(buffer, event);
+    ASSERT_STR_EQ("ghi", event->session_id);
+    ASSERT_EQ(1, event->handled_events);
+    ASSERT_EQ(0, event->unhandled_events);
+    free(buffer);
+    free(event);
+    PASS();
+}
+
+TEST test_lock_stats(void) {
+    bsg_instrumented_mutex lock = BSG_INSTRUMENTED_MUTEX_INITIALIZER;
+    bsg_lock_site_stats stats[BSG_LOCK_SITE_COUNT];
+
+    // nothing is recorded until enabled
+    bsg_instrumented_lock(&lock, BSG_LOCK_SITE_METADATA);
+    bsg_instrumented_unlock(&lock);
+    ASSERT_EQ(0, bsg_lock_stats_read(stats, true));
+    ASSERT_EQ(0, stats[BSG_LOCK_SITE_METADATA].calls);
+
+    bsg_lock_stats_set_enabled(true);
+    bsg_instrumented_lock(&lock, BSG_LOCK_SITE_METADATA);
+    bsg_instrumented_unlock(&lock);
+    bsg_instrumented_lock(&lock, BSG_LOCK_SITE_SESSION);
+    bsg_instrumented_unlock(&lock);
+    bsg_instrumented_lock(&lock, BSG_LOCK_SITE_SESSION);
+    bsg_instrumented_unlock(&lock);
+    bsg_lock_stats_set_enabled(false);
+    bsg_instrumented_lock(&lock, BSG_LOCK_SITE_SESSION);
+    bsg_instrumented_unlock(&lock);
+
+    ASSERT(bsg_lock_stats_read(stats, false) > 0);
+    ASSERT_EQ(1, stats[BSG_LOCK_SITE_METADATA].calls);
+    ASSERT_EQ(2, stats[BSG_LOCK_SITE_SESSION].calls);
+    ASSERT_EQ(0, stats[BSG_LOCK_SITE_SESSION].contended_calls);
+    ASSERT_EQ(0, stats[BSG_LOCK_SITE_FEATURE_FLAGS].calls);
+    uint64_t held = 0;
+    for (int bucket = 0; bucket < BSG_LOCK_STATS_BUCKETS; bucket++) {
+        held += stats[BSG_LOCK_SITE_SESSION].hold_histogram[bucket];
+    }
+    ASSERT_EQ(2, held);
+    ASSERT(stats[BSG_LOCK_SITE_SESSION].max_hold_ns <=
+           stats[BSG_LOCK_SITE_SESSION].total_hold_ns);
+
+    // reading with reset clears the counts
+    bsg_lock_stats_read(stats, true);
+    bsg_lock_stats_read(stats, false);
+    ASSERT_EQ(0, stats[BSG_LOCK_SITE_SESSION].calls);
+    ASSERT_EQ(0, stats[BSG_LOCK_SITE_SESSION].hold_histogram[0]);
+    PASS();
+}
+
+TEST test_module_index(void) {
+    bsg_module_index_refresh();
+    ASSERT(bsg_module_index_current());
+    ASSERT_EQ(NULL, bsg_module_index_find(0));
+
+    const bsg_module *module =
+        bsg_module_index_find((uintptr_t)test_module_index);
+    ASSERT(module != NULL);
+    ASSERT(module->start <= (uintptr_t)test_module_index);
+    ASSERT(module->end > (uintptr_t)test_module_index);
+
+    // exported symbols resolve as dladdr() would
+    module = bsg_module_index_find((uintptr_t)fopen);
+    ASSERT(module != NULL);
+    const char *name = NULL;
+    uintptr_t symbol_address = 0;
+    ASSERT(bsg_module_find_symbol(module, (uintptr_t)fopen + 1, &name,
+                                  &symbol_address));
+    ASSERT_STR_EQ("fopen", name);
+    ASSERT_EQ((uintptr_t)fopen, symbol_address);
+
+    // refreshing without any change keeps the same index
+    bsg_module_index_refresh();
+    ASSERT_EQ(module, bsg_module_index_find((uintptr_t)fopen));
+    PASS();
+}
+
+static __attribute__((noinline)) ssize_t
+unwind_from_callee(uintptr_t *frames, size_t max_frames) {
+    ssize_t frame_count =
+        bsg_unwind_stack_frame_pointer(frames, max_frames, NULL, NULL);
+    __asm__ volatile("" ::: "memory"); // not a tail call
+    return frame_count;
+}
+
+static __attribute__((noinline)) ssize_t
+unwind_from_caller(uintptr_t *frames, size_t max_frames) {
+    ssize_t frame_count = unwind_from_callee(frames, max_frames);
+    __asm__ volatile("" ::: "memory");
+    return frame_count;
+}
+
+TEST test_frame_pointer_unwind(void) {
+#if defined(__aarch64__) || defined(__x86_64__)
+    uintptr_t *frames = calloc(BUGSNAG_FRAMES_MAX, sizeof(uintptr_t));
+    ssize_t frame_count = unwind_from_caller(frames, BUGSNAG_FRAMES_MAX);
+    ASSERT(frame_count >= 3);
+    ASSERT(frame_count <= BUGSNAG_FRAMES_MAX);
+
+    // each frame returns into the function which called the last
+    const uintptr_t callee = (uintptr_t)unwind_from_callee;
+    const uintptr_t caller = (uintptr_t)unwind_from_caller;
+    const uintptr_t test = (uintptr_t)test_frame_pointer_unwind;
+    ASSERT(frames[0] > callee);
+    ASSERT(frames[0] < callee + 256);
+    ASSERT(frames[1] > caller);
+    ASSERT(frames[1] < caller + 256);
+    ASSERT(frames[2] > test);
+    ASSERT(frames[2] < test + 256);
+
+    // the walk stops at the limit rather than trimming afterwards
+    memset(frames, 0, BUGSNAG_FRAMES_MAX * sizeof(uintptr_t));
+    ASSERT_EQ(2, unwind_from_caller(frames, 2));
+    ASSERT_EQ(0, frames[2]);
+    free(frames);
+#endif
+    PASS();
+}
+
+TEST test_stack_depth_limit(void) {
+    // unset limits are the full depth
+    ASSERT_EQ(BUGSNAG_FRAMES_MAX, bsg_stack_depth_limit(BSG_CAPTURE_NOTIFY));
+
+    bsg_set_stack_depth_limit(BSG_CAPTURE_NOTIFY, 16);
+    ASSERT_EQ(16, bsg_stack_depth_limit(BSG_CAPTURE_NOTIFY));
+    ASSERT_EQ(BUGSNAG_FRAMES_MAX, bsg_stack_depth_limit(BSG_CAPTURE_SIGNAL));
+
+    // limits beyond the frames an event holds are clamped
+    bsg_set_stack_depth_limit(BSG_CAPTURE_NOTIFY, BUGSNAG_FRAMES_MAX + 1);
+    ASSERT_EQ(BUGSNAG_FRAMES_MAX, bsg_stack_depth_limit(BSG_CAPTURE_NOTIFY));
+    bsg_set_stack_depth_limit(BSG_CAPTURE_NOTIFY, 0);
+    PASS();
+}
+
+TEST test_unwinder_frames_agree(void) {
+    const uintptr_t r = 0x4000;
+    const uintptr_t expected[] = {0x10, 0x20, r, r, r, 0x50, 0x60};
+
+    // frames inside the unwinder itself may differ
+    ASSERT(bsg_unwinder_frames_agree(
+        expected, 7, (uintptr_t[]){0x99, r, r, r, 0x50, 0x60}, 6, r, 3));
+
+    // stopping inside the synthetic stack
+    ASSERT_FALSE(bsg_unwinder_frames_agree(
+        expected, 7, (uintptr_t[]){0x99, r, r}, 3, r, 3));
+
+    // or finding different callers
+    ASSERT_FALSE(bsg_unwinder_frames_agree(
+        expected, 7, (uintptr_t[]){r, r, r, 0x50, 0x61}, 5, r, 3));
+
+    // or skipping a frame of it
+    ASSERT_FALSE(bsg_unwinder_frames_agree(
+        expected, 7, (uintptr_t[]){r, r, 0x50, 0x60}, 4, r, 3));
+    PASS();
+}
+
+static uint8_t *pack_snapshot_value(uint8_t *pos, const void *value,
+                                   size_t size) {
+    memcpy(pos, value, size);
+    return pos + size;
+}
+
+static uint8_t *pack_snapshot_string(uint8_t *pos, const char *value) {
+    const uint32_t length = (uint32_t)strlen(value);
+    pos = pack_snapshot_value(pos, &length, sizeof(length));
+    return pack_snapshot_value(pos, value, length);
+}
+
+static uint8_t *pack_snapshot_int64(uint8_t *pos, int64_t value) {
+    return pack_snapshot_value(pos, &value, sizeof(value));
+}
+
+static uint8_t *pack_snapshot_double(uint8_t *pos, double value) {
+    return pack_snapshot_value(pos, &value, sizeof(value));
+}
+
+static uint8_t *pack_snapshot_bool(uint8_t *pos, bool value) {
+    *pos = value ? 1 : 0;
+    return pos + 1;
+}
+
+/**
+ * Pack a snapshot laid out as NativeStateSnapshot.java writes it
+ */
+static size_t pack_test_snapshot(uint8_t *packed) {
+    uint8_t *pos = packed;
+    *pos++ = BSG_STATE_SNAPSHOT_VERSION;
+    pos = pack_snapshot_string(pos, "MainActivity");
+
+    pos = pack_snapshot_string(pos, "arm64");
+    pos = pack_snapshot_string(pos, "build-123");
+    pos = pack_snapshot_string(pos, "com.example.app");
+    pos = pack_snapshot_string(pos, "production");
+    pos = pack_snapshot_string(pos, "android");
+    pos = pack_snapshot_string(pos, "2.1.0");
+    pos = pack_snapshot_int64(pos, 3200);
+    pos = pack_snapshot_int64(pos, 1800);
+    pos = pack_snapshot_int64(pos, 42);
+    pos = pack_snapshot_bool(pos, true);
+    pos = pack_snapshot_string(pos, "Example");
+    pos = pack_snapshot_string(pos, "com.example.app:worker");
+    pos = pack_snapshot_double(pos, 268435456);
+    pos = pack_snapshot_bool(pos, false);
+
+    const int32_t abi_count = 10;
+    pos = pack_snapshot_value(pos, &abi_count, sizeof(abi_count));
+    for (int i = 0; i < abi_count; i++) {
+        pos = pack_snapshot_string(pos, i == 0 ? "arm64-v8a" : "armeabi-v7a");
+    }
+    pos = pack_snapshot_string(pos, "device-id");
+    pos = pack_snapshot_string(pos, "en_GB");
+    pos = pack_snapshot_string(pos, "Google");
+    pos = pack_snapshot_string(pos, "Pixel 7");
+    pos = pack_snapshot_string(pos, "portrait");
+    pos = pack_snapshot_string(pos, "14");
+    pos = pack_snapshot_string(pos, "UQ1A.240105.004");
+    const int32_t api_level = 34;
+    pos = pack_snapshot_value(pos, &api_level, sizeof(api_level));
+    pos = pack_snapshot_int64(pos, 8000000000);
+    pos = pack_snapshot_bool(pos, false);
+    pos = pack_snapshot_string(pos, "google");
+    pos = pack_snapshot_double(pos, 420);
+    pos = pack_snapshot_bool(pos, true);
+    pos = pack_snapshot_string(pos, "allowed");
+    pos = pack_snapshot_string(pos, "wifi");
+    pos = pack_snapshot_double(pos, 2.625);
+    pos = pack_snapshot_string(pos, "2400x1080");
+
+    pos = pack_snapshot_string(pos, "user-1");
+    pos = pack_snapshot_string(pos, "Jo Bloggs");
+    pos = pack_snapshot_string(pos, "jo@example.com");
+    return (size_t)(pos - packed);
+}
+
+TEST test_event_state_snapshot(void) {
+    uint8_t packed[1024];
+    const size_t length = pack_test_snapshot(packed);
+    bugsnag_event *event = bsg_test_event_calloc();
+    ASSERT(bsg_event_apply_state_snapshot(event, packed, length));
+
+    ASSERT_STR_EQ("MainActivity", event->context);
+    ASSERT_STR_EQ("arm64", event->app.binary_arch);
+    ASSERT_STR_EQ("com.example.app", event->app.id);
+    ASSERT_STR_EQ("2.1.0", event->app.version);
+    ASSERT_EQ(3200, event->app.duration_ms_offset);
+    ASSERT_EQ(1800, event->app.duration_in_foreground_ms_offset);
+    ASSERT_EQ(42, event->app.version_code);
+    ASSERT(event->app.in_foreground);
+    ASSERT(event->app.is_launching);
+    ASSERT_STR_EQ("com.example.app:worker",
+                  bugsnag_event_get_metadata_string(event, "app", "processName"));
+    ASSERT_EQ(268435456,
+              bugsnag_event_get_metadata_double(event, "app", "memoryLimit"));
+    ASSERT_EQ(BSG_METADATA_NONE_VALUE,
+              bugsnag_event_has_metadata(event, "app", "backgroundWorkRestricted"));
+
+    // ABIs past the capacity are dropped without losing the later fields
+    ASSERT_EQ(8, event->device.cpu_abi_count);
+    ASSERT_STR_EQ("arm64-v8a", event->device.cpu_abi[0].value);
+    ASSERT_STR_EQ("armeabi-v7a", event->device.cpu_abi[7].value);
+    ASSERT_STR_EQ("Pixel 7", event->device.model);
+    ASSERT_STR_EQ("UQ1A.240105.004", event->device.os_build);
+    ASSERT_EQ(34, event->device.api_level);
+    ASSERT_EQ(8000000000, event->device.total_memory);
+    ASSERT_EQ(true, bugsnag_event_get_metadata_bool(event, "device", "emulator"));
+    ASSERT_EQ(2.625, bugsnag_event_get_metadata_double(event, "device",
+                                                       "screenDensity"));
+    ASSERT_STR_EQ("2400x1080", bugsnag_event_get_metadata_string(
+                                   event, "device", "screenResolution"));
+    ASSERT_STR_EQ("jo@example.com", event->user.email);
+
+    // truncated or of another version
+    ASSERT_FALSE(bsg_event_apply_state_snapshot(event, packed, length - 1));
+    packed[0] = BSG_STATE_SNAPSHOT_VERSION + 1;
+    ASSERT_FALSE(bsg_event_apply_state_snapshot(event, packed, length));
+    ASSERT_FALSE(bsg_event_apply_state_snapshot(event, packed, 0));
+    free(event);
+    PASS();
+}
+
 SUITE(suite_event_mutators) {
     RUN_TEST(test_event_api_key);
     RUN_TEST(test_event_context);
@@ -397,7 +890,18 @@ SUITE(suite_event_mutators) {
     RUN_TEST(test_error_message);
     RUN_TEST(test_error_type);
     RUN_TEST(test_event_metadata);
+    RUN_TEST(test_event_metadata_index);
+    RUN_TEST(test_event_metadata_names);
+    RUN_TEST(test_event_metadata_arena);
+    RUN_TEST(test_event_state_snapshot);
     RUN_TEST(test_event_stacktrace);
+    RUN_TEST(test_event_state_updates);
+    RUN_TEST(test_event_state_sessions);
+    RUN_TEST(test_lock_stats);
+    RUN_TEST(test_module_index);
+    RUN_TEST(test_frame_pointer_unwind);
+    RUN_TEST(test_stack_depth_limit);
+    RUN_TEST(test_unwinder_frames_agree);
 }
 
 SUITE(suite_event_app_mutators) {
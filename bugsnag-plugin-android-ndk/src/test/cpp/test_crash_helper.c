@@ -0,0 +1,35 @@
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/crash_helper.h>
+
+static pid_t crash_helper_job_tid;
+static int crash_helper_job_signum;
+
+static void record_crash_helper_job(int signum, siginfo_t *info,
+                                    void *user_context) {
+  crash_helper_job_tid = (pid_t)syscall(SYS_gettid);
+  crash_helper_job_signum = signum;
+}
+
+TEST test_crash_helper(void) {
+  ASSERT_FALSE(bsg_crash_helper_hand_off(SIGSEGV, NULL, NULL, 1000000000));
+  ASSERT(bsg_crash_helper_start(record_crash_helper_job));
+  ASSERT(bsg_crash_helper_hand_off(SIGSEGV, NULL, NULL, 1000000000));
+  ASSERT_EQ(SIGSEGV, crash_helper_job_signum);
+  ASSERT(crash_helper_job_tid != 0);
+  ASSERT(crash_helper_job_tid != (pid_t)syscall(SYS_gettid));
+
+  // only one crash is handed off
+  ASSERT_FALSE(bsg_crash_helper_hand_off(SIGABRT, NULL, NULL, 1000000000));
+  ASSERT_EQ(SIGSEGV, crash_helper_job_signum);
+  bsg_crash_helper_stop();
+  PASS();
+}
+
+SUITE(suite_crash_helper) {
+  RUN_TEST(test_crash_helper);
+}
@@ -0,0 +1,102 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/crash_signatures.h>
+
+#include "test_alloc.h"
+
+#define CRASH_SIGNATURES_TEST_DIR \
+  "/data/data/com.bugsnag.android.ndk.test/cache/"
+#define CRASH_SIGNATURES_TEST_TABLE \
+  "/data/data/com.bugsnag.android.ndk.test/cache-signatures"
+
+static bugsnag_event *generate_crash(uintptr_t load_address) {
+  bugsnag_event *event = bsg_test_event_calloc();
+  event->error.frame_count = BSG_CRASH_SIGNATURE_FRAMES + 2;
+  for (int i = 0; i < event->error.frame_count; i++) {
+    bugsnag_stackframe *frame = &event->error.stacktrace[i];
+    frame->load_address = load_address;
+    frame->frame_address = load_address + 0x100 * (i + 1);
+    strcpy(frame->filename, "/data/app/lib/arm64/libcrash.so");
+  }
+  return event;
+}
+
+TEST test_crash_signature_is_stable(void) {
+  bugsnag_event *crash = generate_crash(0x7000000000);
+  bugsnag_event *repeat = generate_crash(0x7100000000);
+  const uint64_t signature = bsg_crash_signature(crash, SIGSEGV);
+  ASSERT(signature != 0);
+  ASSERT_EQ(signature, bsg_crash_signature(crash, SIGSEGV));
+
+  // the same relative addresses match after the library moves
+  ASSERT_EQ(signature, bsg_crash_signature(repeat, SIGSEGV));
+  ASSERT(signature != bsg_crash_signature(repeat, SIGABRT));
+
+  // only the top frames are hashed
+  repeat->error.stacktrace[BSG_CRASH_SIGNATURE_FRAMES].frame_address += 4;
+  ASSERT_EQ(signature, bsg_crash_signature(repeat, SIGSEGV));
+  repeat->error.stacktrace[0].frame_address += 4;
+  ASSERT(signature != bsg_crash_signature(repeat, SIGSEGV));
+  repeat->error.stacktrace[0].frame_address -= 4;
+  strcpy(repeat->error.stacktrace[1].filename, "/system/lib64/libc.so");
+  ASSERT(signature != bsg_crash_signature(repeat, SIGSEGV));
+  free(crash);
+  free(repeat);
+  PASS();
+}
+
+TEST test_crash_signatures_count_repeat(void) {
+  char *report = CRASH_SIGNATURES_TEST_DIR "signature.crash";
+  remove(CRASH_SIGNATURES_TEST_TABLE);
+  remove(report);
+  ASSERT_FALSE(bsg_crash_signatures_count_repeat(42));
+  ASSERT(bsg_crash_signatures_enable(report));
+  ASSERT_FALSE(bsg_crash_signatures_count_repeat(42));
+
+  // repeats are only counted while the first report is waiting for delivery
+  bsg_crash_signatures_add(42, report);
+  ASSERT_FALSE(bsg_crash_signatures_count_repeat(42));
+  fclose(fopen(report, "w"));
+  ASSERT(bsg_crash_signatures_count_repeat(42));
+  ASSERT(bsg_crash_signatures_count_repeat(42));
+  ASSERT_FALSE(bsg_crash_signatures_count_repeat(43));
+  remove(report);
+  ASSERT_FALSE(bsg_crash_signatures_count_repeat(42));
+
+  bsg_crash_signatures_disable();
+  fclose(fopen(report, "w"));
+  ASSERT_FALSE(bsg_crash_signatures_count_repeat(42));
+  remove(report);
+  PASS();
+}
+
+TEST test_crash_signatures_take_repeats(void) {
+  char *report = CRASH_SIGNATURES_TEST_DIR "repeated.crash";
+  fclose(fopen(report, "w"));
+  ASSERT(bsg_crash_signatures_enable(report));
+  ASSERT_EQ(0, bsg_crash_signatures_take_repeats(report));
+  bsg_crash_signatures_add(7, report);
+  ASSERT(bsg_crash_signatures_count_repeat(7));
+  ASSERT(bsg_crash_signatures_count_repeat(7));
+  ASSERT(bsg_crash_signatures_count_repeat(7));
+
+  // delivering the report resets the count, and a repeat is reported again
+  ASSERT_EQ(3, bsg_crash_signatures_take_repeats(report));
+  ASSERT_EQ(0, bsg_crash_signatures_take_repeats(report));
+  ASSERT_FALSE(bsg_crash_signatures_count_repeat(7));
+
+  bsg_crash_signatures_disable();
+  remove(report);
+  PASS();
+}
+
+SUITE(suite_crash_signatures) {
+  RUN_TEST(test_crash_signature_is_stable);
+  RUN_TEST(test_crash_signatures_count_repeat);
+  RUN_TEST(test_crash_signatures_take_repeats);
+}
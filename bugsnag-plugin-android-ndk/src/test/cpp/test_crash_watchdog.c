@@ -0,0 +1,48 @@
+#include <time.h>
+#include <unistd.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/crash_watchdog.h>
+
+static uint64_t test_monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+TEST test_crash_watchdog(void) {
+  ASSERT(bsg_crash_watchdog_install());
+  ASSERT_FALSE(bsg_crash_watchdog_expired(0));
+  ASSERT_EQ(0, bsg_crash_watchdog_remaining_ns(0));
+  ASSERT(bsg_crash_watchdog_expired(1));
+
+  // a stage which finishes in time is not interrupted
+  volatile int interrupted = 0;
+  if (sigsetjmp(bsg_crash_watchdog_jump, 1) == 0) {
+    bsg_crash_watchdog_arm(test_monotonic_ns() + 50000000);
+    bsg_crash_watchdog_disarm();
+  } else {
+    interrupted++;
+  }
+  usleep(60000);
+  ASSERT_EQ(0, interrupted);
+
+  // a stalled stage resumes at its fallback once the deadline passes
+  const uint64_t deadline = test_monotonic_ns() + 5000000;
+  if (sigsetjmp(bsg_crash_watchdog_jump, 1) == 0) {
+    bsg_crash_watchdog_arm(deadline);
+    for (;;) {
+      usleep(1000);
+    }
+  } else {
+    interrupted++;
+  }
+  ASSERT_EQ(1, interrupted);
+  ASSERT(test_monotonic_ns() >= deadline);
+  PASS();
+}
+
+SUITE(suite_crash_watchdog) {
+  RUN_TEST(test_crash_watchdog);
+}
@@ -0,0 +1,41 @@
+#include <signal.h>
+#include <string.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/event_filter.h>
+#include <utils/module_index.h>
+
+TEST test_event_filter(void) {
+  ASSERT_FALSE(bsg_event_filter_drops("SIGSEGV", SIGSEGV, 0));
+
+  const char *classes[] = {"SIGSEGV", "St13runtime_error", "SIGSEGV"};
+  ASSERT(bsg_event_filter_set(classes, 3, NULL, 0, 1ULL << SIGTRAP));
+  ASSERT(bsg_event_filter_drops("SIGSEGV", SIGSEGV, 0));
+  ASSERT(bsg_event_filter_drops("St13runtime_error", 0, 0));
+  ASSERT(bsg_event_filter_drops("SIGTRAP", SIGTRAP, 0));
+  ASSERT_FALSE(bsg_event_filter_drops("SIGSEGVX", SIGBUS, 0));
+  ASSERT_FALSE(bsg_event_filter_drops(NULL, 0, 0));
+
+  // libraries are matched on their file name or their full path
+  bsg_module_index_refresh();
+  const uintptr_t pc = (uintptr_t)&strcmp;
+  const bsg_module *module = bsg_module_index_find(pc);
+  ASSERT(module != NULL);
+  const char *file_name = strrchr(module->path, '/');
+  file_name = file_name != NULL ? file_name + 1 : module->path;
+  ASSERT(bsg_event_filter_set(NULL, 0, &file_name, 1, 0));
+  ASSERT_FALSE(bsg_event_filter_drops("SIGSEGV", SIGSEGV, 0));
+  ASSERT(bsg_event_filter_drops("SIGSEGV", SIGSEGV, pc));
+  const char *path = module->path;
+  ASSERT(bsg_event_filter_set(NULL, 0, &path, 1, 0));
+  ASSERT(bsg_event_filter_drops("SIGSEGV", SIGSEGV, pc));
+
+  ASSERT(bsg_event_filter_set(NULL, 0, NULL, 0, 0));
+  ASSERT_FALSE(bsg_event_filter_drops("SIGSEGV", SIGSEGV, pc));
+  PASS();
+}
+
+SUITE(suite_event_filter) {
+  RUN_TEST(test_event_filter);
+}
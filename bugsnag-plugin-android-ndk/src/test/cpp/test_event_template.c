@@ -0,0 +1,63 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/event_template.h>
+
+#include "test_alloc.h"
+
+#define EVENT_TEMPLATE_REPORT_FILE \
+  "/data/data/com.bugsnag.android.ndk.test/cache/foo.crash"
+
+#define EVENT_TEMPLATE_TEST_FILE \
+  "/data/data/com.bugsnag.android.ndk.test/cache-event.template"
+
+bugsnag_event *bsg_generate_event(void);
+
+TEST test_event_template(void) {
+  remove(EVENT_TEMPLATE_TEST_FILE);
+  bugsnag_event *event = bsg_test_event_calloc();
+  ASSERT_FALSE(bsg_event_template_apply(EVENT_TEMPLATE_REPORT_FILE, event));
+
+  bugsnag_event *populated = bsg_generate_event();
+  ASSERT(bsg_event_template_publish(EVENT_TEMPLATE_REPORT_FILE, populated));
+  ASSERT(bsg_event_template_apply(EVENT_TEMPLATE_REPORT_FILE, event));
+  ASSERT_STR_EQ(populated->app.version, event->app.version);
+  ASSERT_EQ(populated->app.version_code, event->app.version_code);
+  ASSERT_STR_EQ(populated->app.build_uuid, event->app.build_uuid);
+  ASSERT_STR_EQ(populated->device.model, event->device.model);
+  ASSERT_STR_EQ(populated->device.os_build, event->device.os_build);
+  ASSERT_EQ(populated->device.total_memory, event->device.total_memory);
+  ASSERT_STR_EQ(populated->notifier.version, event->notifier.version);
+
+  // the state which changes while the app runs is not shared
+  ASSERT_STR_EQ("", event->app.active_screen);
+  ASSERT_STR_EQ("", event->device.orientation);
+  ASSERT_EQ(0, event->device.time);
+
+  // a template from another build is ignored, and replaced when published
+  int fd = open(EVENT_TEMPLATE_TEST_FILE, O_WRONLY);
+  ASSERT(fd >= 0);
+  const uint64_t other_build = 1;
+  ASSERT_EQ(sizeof(other_build),
+            pwrite(fd, &other_build, sizeof(other_build), 16));
+  close(fd);
+  memset(event, 0, sizeof(bugsnag_event));
+  ASSERT_FALSE(bsg_event_template_apply(EVENT_TEMPLATE_REPORT_FILE, event));
+  ASSERT_STR_EQ("", event->app.version);
+  ASSERT(bsg_event_template_publish(EVENT_TEMPLATE_REPORT_FILE, populated));
+  ASSERT(bsg_event_template_apply(EVENT_TEMPLATE_REPORT_FILE, event));
+
+  remove(EVENT_TEMPLATE_TEST_FILE);
+  free(populated);
+  free(event);
+  PASS();
+}
+
+SUITE(suite_event_template) {
+  RUN_TEST(test_event_template);
+}
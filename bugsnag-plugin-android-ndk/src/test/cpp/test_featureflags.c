@@ -1,8 +1,55 @@
 #include <greatest/greatest.h>
 #include <featureflags.h>
+#include <stdint.h>
+#include <string.h>
+#include <utils/serializer/buffered_writer.h>
+#include "test_alloc.h"
+
+bool bsg_write_feature_flags(bugsnag_event *event, bsg_buffered_writer *writer);
+
+static bool capture_write(bsg_buffered_writer *writer, const void *data,
+                          size_t length) {
+  if (length > sizeof(writer->buffer) - writer->pos) {
+    return false;
+  }
+  memcpy(writer->buffer + writer->pos, data, length);
+  writer->pos += length;
+  return true;
+}
+
+static bool capture_write_byte(bsg_buffered_writer *writer,
+                               const uint8_t value) {
+  return capture_write(writer, &value, 1);
+}
+
+static bool capture_write_string(bsg_buffered_writer *writer, const char *s) {
+  const uint32_t length = strlen(s);
+  return capture_write(writer, &length, sizeof(length)) &&
+         capture_write(writer, s, length);
+}
+
+/**
+ * Check that the flags kept encoded match the flags written one at a time
+ */
+static enum greatest_test_res check_encoded_flags(bugsnag_event *event) {
+  static bsg_buffered_writer writer = {.write = capture_write,
+                                       .write_byte = capture_write_byte,
+                                       .write_string = capture_write_string};
+  writer.pos = 0;
+  char *encoded = event->feature_flags_encoded;
+  event->feature_flags_encoded = NULL;
+  bool written = bsg_write_feature_flags(event, &writer);
+  event->feature_flags_encoded = encoded;
+
+  ASSERT(written);
+  ASSERT(encoded != NULL);
+  ASSERT_EQ(writer.pos, event->feature_flags_encoded_size);
+  ASSERT_MEM_EQ(writer.buffer, encoded, writer.pos);
+  PASS();
+}
 
 TEST test_set_feature_flag(void) {
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+  bugsnag_event *event = bsg_test_event_calloc();
 
   bsg_set_feature_flag(event, "sample_group", "a");
   bsg_set_feature_flag(event, "demo_mode", NULL);
@@ -27,7 +74,7 @@ TEST test_set_feature_flag(void) {
 }
 
 TEST test_clear_feature_flag(void) {
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+  bugsnag_event *event = bsg_test_event_calloc();
 
   bsg_set_feature_flag(event, "sample_group", "a");
   bsg_set_feature_flag(event, "demo_mode", NULL);
@@ -51,7 +98,173 @@ TEST test_clear_feature_flag(void) {
   PASS();
 }
 
+TEST test_set_feature_flags(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+
+  bsg_set_feature_flag(event, "sample_group", "a");
+  bsg_set_feature_flag(event, "zzz", NULL);
+
+  bsg_feature_flag flags[] = {
+      {.name = "demo_mode", .variant = NULL},
+      {.name = "sample_group", .variant = "b"},
+      {.name = "demo_mode", .variant = "yes"},
+      {.name = "aaa", .variant = NULL},
+  };
+  ASSERT(bsg_set_feature_flags(event, flags, 4));
+
+  // the batch is merged in order, with the last of each name winning
+  ASSERT_EQ(4, event->feature_flag_count);
+  ASSERT_STR_EQ("aaa", event->feature_flags[0].name);
+  ASSERT_EQ(NULL, event->feature_flags[0].variant);
+  ASSERT_STR_EQ("demo_mode", event->feature_flags[1].name);
+  ASSERT_STR_EQ("yes", event->feature_flags[1].variant);
+  ASSERT_STR_EQ("sample_group", event->feature_flags[2].name);
+  ASSERT_STR_EQ("b", event->feature_flags[2].variant);
+  ASSERT_STR_EQ("zzz", event->feature_flags[3].name);
+  ASSERT_EQ(NULL, event->feature_flags[3].variant);
+
+  // flags in the slab can still be changed and cleared one at a time
+  bsg_set_feature_flag(event, "demo_mode", "no");
+  bsg_set_feature_flag(event, "mmm", "new");
+  bsg_clear_feature_flag(event, "aaa");
+  ASSERT_EQ(4, event->feature_flag_count);
+  ASSERT_STR_EQ("demo_mode", event->feature_flags[0].name);
+  ASSERT_STR_EQ("no", event->feature_flags[0].variant);
+  ASSERT_STR_EQ("mmm", event->feature_flags[1].name);
+
+  bsg_feature_flag more_flags[] = {{.name = "bbb", .variant = "1"}};
+  ASSERT(bsg_set_feature_flags(event, more_flags, 1));
+  ASSERT_EQ(5, event->feature_flag_count);
+  ASSERT_STR_EQ("bbb", event->feature_flags[0].name);
+  ASSERT_STR_EQ("no", event->feature_flags[1].variant);
+  ASSERT_STR_EQ("new", event->feature_flags[2].variant);
+
+  bsg_free_feature_flags(event);
+  ASSERT_EQ(0, event->feature_flag_count);
+  ASSERT_EQ(NULL, event->feature_flag_strings);
+  free(event);
+
+  PASS();
+}
+
+static size_t pack_flag(char *buf, const char *name, const char *variant) {
+  size_t pos = 0;
+  uint32_t length = strlen(name);
+  memcpy(buf + pos, &length, sizeof(length));
+  pos += sizeof(length);
+  memcpy(buf + pos, name, length);
+  pos += length;
+  length = variant ? strlen(variant) : UINT32_MAX;
+  memcpy(buf + pos, &length, sizeof(length));
+  pos += sizeof(length);
+  if (variant) {
+    memcpy(buf + pos, variant, length);
+    pos += length;
+  }
+  return pos;
+}
+
+TEST test_set_packed_feature_flags(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+  char packed[256];
+  size_t length = 0;
+  length += pack_flag(packed + length, "sample_group", "a");
+  length += pack_flag(packed + length, "demo_mode", NULL);
+  length += pack_flag(packed + length, "", "");
+
+  ASSERT(bsg_set_packed_feature_flags(event, packed, length));
+  ASSERT_EQ(3, event->feature_flag_count);
+  ASSERT_STR_EQ("", event->feature_flags[0].name);
+  ASSERT_STR_EQ("", event->feature_flags[0].variant);
+  ASSERT_STR_EQ("demo_mode", event->feature_flags[1].name);
+  ASSERT_EQ(NULL, event->feature_flags[1].variant);
+  ASSERT_STR_EQ("sample_group", event->feature_flags[2].name);
+  ASSERT_STR_EQ("a", event->feature_flags[2].variant);
+
+  // a truncated batch sets nothing
+  length = pack_flag(packed, "zzz", "on");
+  ASSERT_FALSE(bsg_set_packed_feature_flags(event, packed, length - 1));
+  ASSERT_EQ(3, event->feature_flag_count);
+
+  bsg_free_feature_flags(event);
+  free(event);
+
+  PASS();
+}
+
+TEST test_encoded_feature_flags(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+
+  bsg_set_feature_flag(event, "sample_group", "a");
+  CHECK_CALL(check_encoded_flags(event));
+  bsg_set_feature_flag(event, "demo_mode", NULL);
+  bsg_set_feature_flag(event, "zzz", "last");
+  CHECK_CALL(check_encoded_flags(event));
+
+  // variants which grow, shrink and are removed
+  bsg_set_feature_flag(event, "demo_mode", "a longer variant");
+  CHECK_CALL(check_encoded_flags(event));
+  bsg_set_feature_flag(event, "demo_mode", "b");
+  CHECK_CALL(check_encoded_flags(event));
+  bsg_set_feature_flag(event, "sample_group", NULL);
+  CHECK_CALL(check_encoded_flags(event));
+
+  bsg_clear_feature_flag(event, "demo_mode");
+  CHECK_CALL(check_encoded_flags(event));
+  bsg_clear_feature_flag(event, "zzz");
+  CHECK_CALL(check_encoded_flags(event));
+
+  bsg_feature_flag flags[] = {
+      {.name = "aaa", .variant = "1"},
+      {.name = "sample_group", .variant = "c"},
+  };
+  ASSERT(bsg_set_feature_flags(event, flags, 2));
+  CHECK_CALL(check_encoded_flags(event));
+  bsg_set_feature_flag(event, "bbb", NULL);
+  CHECK_CALL(check_encoded_flags(event));
+
+  bsg_clear_feature_flag(event, "aaa");
+  bsg_clear_feature_flag(event, "bbb");
+  bsg_clear_feature_flag(event, "sample_group");
+  ASSERT_EQ(0, event->feature_flag_count);
+  CHECK_CALL(check_encoded_flags(event));
+
+  bsg_free_feature_flags(event);
+  ASSERT_EQ(NULL, event->feature_flags_encoded);
+  free(event);
+
+  PASS();
+}
+
+TEST test_feature_flags_low_memory(void) {
+  bugsnag_event *event = bsg_test_event_calloc();
+
+  bsg_set_feature_flag(event, "sample_group", "a");
+  bsg_feature_flags_set_low_memory(event, true);
+  ASSERT_EQ(NULL, event->feature_flags_encoded);
+
+  // changes while memory is low are not encoded
+  bsg_set_feature_flag(event, "demo_mode", "yes");
+  bsg_clear_feature_flag(event, "sample_group");
+  ASSERT_EQ(NULL, event->feature_flags_encoded);
+  ASSERT_EQ(1, event->feature_flag_count);
+
+  bsg_feature_flags_set_low_memory(event, false);
+  CHECK_CALL(check_encoded_flags(event));
+  bsg_set_feature_flag(event, "zzz", NULL);
+  CHECK_CALL(check_encoded_flags(event));
+
+  bsg_free_feature_flags(event);
+  free(event);
+
+  PASS();
+}
+
 SUITE (suite_feature_flags) {
   RUN_TEST(test_set_feature_flag);
   RUN_TEST(test_clear_feature_flag);
+  RUN_TEST(test_set_feature_flags);
+  RUN_TEST(test_set_packed_feature_flags);
+  RUN_TEST(test_encoded_feature_flags);
+  RUN_TEST(test_feature_flags_low_memory);
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <greatest/greatest.h>
+
+#include <notify_aggregator.h>
+
+#define NOTIFY_AGGREGATOR_TEST_WINDOW_MS 60000
+
+static bugsnag_stackframe aggregated_stack[3];
+
+static void init_aggregated_stack(uintptr_t top_address) {
+  memset(aggregated_stack, 0, sizeof(aggregated_stack));
+  for (int i = 0; i < 3; i++) {
+    aggregated_stack[i].frame_address = top_address + 0x10 * i;
+  }
+}
+
+static bool add_error(const char *name, const char *message) {
+  return bsg_notify_aggregator_add(name, message, BSG_SEVERITY_WARN,
+                                   aggregated_stack, 3);
+}
+
+TEST test_notify_aggregator_window(void) {
+  bsg_notify_aggregate batch[BSG_NOTIFY_AGGREGATES_MAX];
+  ASSERT(bsg_notify_aggregator_set_window(NOTIFY_AGGREGATOR_TEST_WINDOW_MS));
+  ASSERT(bsg_notify_aggregator_is_enabled());
+  bsg_notify_aggregator_take_closed(INT64_MAX, batch);
+
+  // the first occurrence is reported, and the repeats in its window counted
+  init_aggregated_stack(0x7000);
+  ASSERT_FALSE(add_error("IOException", "first"));
+  ASSERT(add_error("IOException", "second"));
+  ASSERT(add_error("IOException", "third"));
+  // errors differing in name or stack each open a window of their own
+  ASSERT_FALSE(add_error("EOFException", "first"));
+  init_aggregated_stack(0x8000);
+  ASSERT_FALSE(add_error("IOException", "first"));
+
+  // nothing is flushed until the windows close
+  ASSERT_EQ(0, bsg_notify_aggregator_take_closed(0, batch));
+  init_aggregated_stack(0x7000);
+  ASSERT(add_error("IOException", "fourth"));
+
+  // windows without repeats have nothing more to report
+  ASSERT_EQ(1, bsg_notify_aggregator_take_closed(INT64_MAX, batch));
+  ASSERT_EQ(3, batch[0].repeats);
+  ASSERT_STR_EQ("IOException", batch[0].name);
+  ASSERT_STR_EQ("second", batch[0].message);
+  ASSERT_EQ(BSG_SEVERITY_WARN, batch[0].severity);
+  ASSERT_EQ(3, batch[0].frame_count);
+  ASSERT_EQ(0x7000, batch[0].frames[0]);
+
+  // a flushed window is closed, so the next occurrence is reported again
+  ASSERT_EQ(0, bsg_notify_aggregator_take_closed(INT64_MAX, batch));
+  ASSERT_FALSE(add_error("IOException", "fifth"));
+  bsg_notify_aggregator_take_closed(INT64_MAX, batch);
+  PASS();
+}
+
+TEST test_notify_aggregator_disabled(void) {
+  ASSERT(bsg_notify_aggregator_set_window(0));
+  ASSERT_FALSE(bsg_notify_aggregator_is_enabled());
+  init_aggregated_stack(0x9000);
+  ASSERT_FALSE(add_error("IOException", "first"));
+  ASSERT_FALSE(add_error("IOException", "second"));
+  bsg_notify_aggregate batch[BSG_NOTIFY_AGGREGATES_MAX];
+  ASSERT_EQ(0, bsg_notify_aggregator_take_closed(INT64_MAX, batch));
+  PASS();
+}
+
+SUITE(suite_notify_aggregator) {
+  RUN_TEST(test_notify_aggregator_window);
+  RUN_TEST(test_notify_aggregator_disabled);
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <greatest/greatest.h>
+
+#include <notify_queue.h>
+
+static bsg_notify_queue queue;
+
+static bool push_error(const char *message, uintptr_t frame_address) {
+  bugsnag_stackframe frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.frame_address = frame_address;
+  return bsg_notify_queue_push(&queue, "IOException", message,
+                               BSG_SEVERITY_ERR, &frame, 1);
+}
+
+TEST test_notify_queue_order(void) {
+  bsg_notify_queue_init(&queue);
+  ASSERT_EQ(NULL, bsg_notify_queue_peek(&queue));
+  ASSERT(push_error("first", 0x10));
+  ASSERT(push_error(NULL, 0x20));
+
+  const bsg_queued_notify *queued = bsg_notify_queue_peek(&queue);
+  ASSERT(queued != NULL);
+  ASSERT(queued->has_name);
+  ASSERT_STR_EQ("IOException", queued->name);
+  ASSERT(queued->has_message);
+  ASSERT_STR_EQ("first", queued->message);
+  ASSERT_EQ(BSG_SEVERITY_ERR, queued->severity);
+  ASSERT_EQ(1, queued->frame_count);
+  ASSERT_EQ(0x10, queued->frames[0]);
+  // an error stays queued until it is released
+  ASSERT_EQ(queued, bsg_notify_queue_peek(&queue));
+  bsg_notify_queue_release(&queue);
+
+  queued = bsg_notify_queue_peek(&queue);
+  ASSERT(queued != NULL);
+  ASSERT_FALSE(queued->has_message);
+  ASSERT_EQ(0x20, queued->frames[0]);
+  bsg_notify_queue_release(&queue);
+  ASSERT_EQ(NULL, bsg_notify_queue_peek(&queue));
+  PASS();
+}
+
+TEST test_notify_queue_full(void) {
+  bsg_notify_queue_init(&queue);
+  char message[16];
+  for (int i = 0; i < BSG_NOTIFY_QUEUE_SIZE; i++) {
+    sprintf(message, "error %d", i);
+    ASSERT(push_error(message, 0x10 * i));
+  }
+  // errors are dropped once the queue is full, rather than blocking
+  ASSERT_FALSE(push_error("dropped", 0x1000));
+  ASSERT_FALSE(push_error("dropped", 0x1000));
+
+  // and the slot of a reported error is reused on the next lap
+  bsg_notify_queue_release(&queue);
+  ASSERT(push_error("next lap", 0x2000));
+  ASSERT_FALSE(push_error("dropped", 0x1000));
+  for (int i = 1; i < BSG_NOTIFY_QUEUE_SIZE; i++) {
+    const bsg_queued_notify *queued = bsg_notify_queue_peek(&queue);
+    ASSERT(queued != NULL);
+    sprintf(message, "error %d", i);
+    ASSERT_STR_EQ(message, queued->message);
+    bsg_notify_queue_release(&queue);
+  }
+  const bsg_queued_notify *queued = bsg_notify_queue_peek(&queue);
+  ASSERT(queued != NULL);
+  ASSERT_STR_EQ("next lap", queued->message);
+  bsg_notify_queue_release(&queue);
+  ASSERT_EQ(NULL, bsg_notify_queue_peek(&queue));
+  PASS();
+}
+
+TEST test_notify_queue_truncates(void) {
+  bsg_notify_queue_init(&queue);
+  char message[BSG_NOTIFY_MESSAGE_MAX + 64];
+  memset(message, 'a', sizeof(message) - 1);
+  message[sizeof(message) - 1] = '\0';
+  bugsnag_stackframe frames[BUGSNAG_FRAMES_MAX + 1];
+  memset(frames, 0, sizeof(frames));
+  ASSERT(bsg_notify_queue_push(&queue, NULL, message, BSG_SEVERITY_INFO,
+                               frames, BUGSNAG_FRAMES_MAX + 1));
+  const bsg_queued_notify *queued = bsg_notify_queue_peek(&queue);
+  ASSERT(queued != NULL);
+  ASSERT_FALSE(queued->has_name);
+  ASSERT_EQ(BSG_NOTIFY_MESSAGE_MAX - 1, strlen(queued->message));
+  ASSERT_EQ(BUGSNAG_FRAMES_MAX, queued->frame_count);
+  bsg_notify_queue_release(&queue);
+  PASS();
+}
+
+SUITE(suite_notify_queue) {
+  RUN_TEST(test_notify_queue_order);
+  RUN_TEST(test_notify_queue_full);
+  RUN_TEST(test_notify_queue_truncates);
+}
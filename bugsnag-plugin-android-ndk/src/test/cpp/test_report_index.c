@@ -0,0 +1,69 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/report_index.h>
+
+#include "test_alloc.h"
+
+#define REPORT_INDEX_TEST_DIR "/data/data/com.bugsnag.android.ndk.test/cache/"
+
+static void add_indexed_report(const char *path, time_t time,
+                               bool is_launching) {
+  FILE *file = fopen(path, "w");
+  fputs("report", file);
+  fclose(file);
+  bugsnag_event *event = bsg_test_event_calloc();
+  event->device.time = time;
+  event->app.is_launching = is_launching;
+  bsg_report_index_add(path, event);
+  free(event);
+}
+
+TEST test_report_index(void) {
+  remove("/data/data/com.bugsnag.android.ndk.test/cache-reports.index");
+  ASSERT(bsg_report_index_enable(REPORT_INDEX_TEST_DIR "foo.crash"));
+  char *a = REPORT_INDEX_TEST_DIR "a.crash";
+  char *b = REPORT_INDEX_TEST_DIR "b.crash";
+  char *c = REPORT_INDEX_TEST_DIR "c.crash";
+  char *d = REPORT_INDEX_TEST_DIR "d.crash";
+  add_indexed_report(a, 100, false);
+  add_indexed_report(b, 200, false);
+  add_indexed_report(c, 50, true);
+  fclose(fopen(d, "w"));
+
+  // launch crashes first, then the newest, then reports missing from the index
+  char *paths[] = {a, b, c, d};
+  ASSERT_EQ(4, bsg_report_index_order(paths, 4, 0));
+  ASSERT_STR_EQ(c, paths[0]);
+  ASSERT_STR_EQ(b, paths[1]);
+  ASSERT_STR_EQ(a, paths[2]);
+  ASSERT_STR_EQ(d, paths[3]);
+
+  // the records are taken by ordering
+  char *unindexed[] = {a, b, c};
+  ASSERT_EQ(3, bsg_report_index_order(unindexed, 3, 0));
+  ASSERT_STR_EQ(a, unindexed[0]);
+  ASSERT_STR_EQ(c, unindexed[2]);
+
+  // and reports over the limit are deleted
+  add_indexed_report(a, 100, false);
+  add_indexed_report(b, 200, false);
+  char *capped[] = {a, b, d};
+  ASSERT_EQ(1, bsg_report_index_order(capped, 3, 1));
+  ASSERT_STR_EQ(b, capped[0]);
+  ASSERT_EQ(0, access(b, F_OK));
+  ASSERT(access(a, F_OK) != 0);
+  ASSERT(access(d, F_OK) != 0);
+  remove(b);
+  remove(c);
+  PASS();
+}
+
+SUITE(suite_report_index) {
+  RUN_TEST(test_report_index);
+}
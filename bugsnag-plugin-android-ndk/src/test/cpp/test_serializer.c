@@ -64,26 +64,11 @@ void loadDeviceTestCase(bugsnag_event *event) {
 
 void loadCustomMetadataTestCase(bugsnag_event *event) {
     bugsnag_metadata *data = &event->metadata;
-    data->value_count = 4;
-
-    data->values[0].type = BSG_METADATA_CHAR_VALUE;
-    strcpy(data->values[0].section, "custom");
-    strcpy(data->values[0].name, "str");
-    strcpy(data->values[0].char_value, "Foo");
-
-    data->values[1].type = BSG_METADATA_BOOL_VALUE;
-    strcpy(data->values[1].section, "custom");
-    strcpy(data->values[1].name, "bool");
-    data->values[1].bool_value = true;
-
-    data->values[2].type = BSG_METADATA_NUMBER_VALUE;
-    strcpy(data->values[2].section, "custom");
-    strcpy(data->values[2].name, "num");
-    data->values[2].double_value = 55;
-
+    bsg_add_metadata_value_str(data, NULL, "custom", "str", "Foo");
+    bsg_add_metadata_value_bool(data, NULL, "custom", "bool", true);
+    bsg_add_metadata_value_double(data, NULL, "custom", "num", 55);
+    bsg_add_metadata_value_str(data, NULL, "custom", "none", "");
     data->values[3].type = BSG_METADATA_NONE_VALUE;
-    strcpy(data->values[3].section, "custom");
-    strcpy(data->values[3].name, "none");
 }
 
 void loadContextTestCase(bugsnag_event *event) {
@@ -106,64 +91,56 @@ void loadSessionTestCase(bugsnag_event *data) {
 
 void loadBreadcrumbsTestCase(bugsnag_event *event) {
     bugsnag_breadcrumb *crumb = calloc(1, sizeof(bugsnag_breadcrumb));
-    memset(crumb, 0, sizeof(bugsnag_breadcrumb));
-    event->crumb_count = 4;
-    event->crumb_first_index = BUGSNAG_CRUMBS_MAX - 2;
 
-    // ensure that serialization loop is covered by test
+    // ensure that serialization loop is covered by test, by starting the
+    // ring two slots before its end
+    event->crumb_ring.claimed = BUGSNAG_CRUMBS_MAX - 2;
+    event->crumb_ring.reserved_claims = BUGSNAG_CRUMBS_MAX - 2;
+    event->crumb_ring.oldest = BUGSNAG_CRUMBS_MAX - 2;
 
     // first breadcrumb
-    crumb = &event->breadcrumbs[BUGSNAG_CRUMBS_MAX - 2];
     crumb->type = BSG_CRUMB_USER;
     strcpy(crumb->name, "Jane");
-    strcpy(crumb->timestamp, "2018-10-08T12:07:09Z");
+    crumb->timestamp_ms = 1539000429000;
 
     // metadata
     bugsnag_metadata *data = &crumb->metadata;
-    data->value_count = 1;
-    data->values[0].type = BSG_METADATA_CHAR_VALUE;
-    strcpy(data->values[0].section, "custom");
-    strcpy(data->values[0].name, "str");
-    strcpy(data->values[0].char_value, "Foo");
+    bsg_add_metadata_value_str(data, NULL, "custom", "str", "Foo");
+    bugsnag_event_add_breadcrumb(event, crumb);
 
     // second breadcrumb
-    crumb = &event->breadcrumbs[BUGSNAG_CRUMBS_MAX - 1];
+    memset(crumb, 0, sizeof(bugsnag_breadcrumb));
     crumb->type = BSG_CRUMB_MANUAL;
     strcpy(crumb->name, "Something went wrong");
-    strcpy(crumb->timestamp, "2018-10-08T12:07:11Z");
+    crumb->timestamp_ms = 1539000431000;
 
     // metadata
-    data = &crumb->metadata;
-    data->value_count = 1;
-    data->values[0].type = BSG_METADATA_BOOL_VALUE;
-    strcpy(data->values[0].section, "custom");
-    strcpy(data->values[0].name, "bool");
-    data->values[0].bool_value = true;
-
-    // third breadcrumb - using updated timestamp format
-    crumb = &event->breadcrumbs[0];
+    bsg_add_metadata_value_bool(data, NULL, "custom", "bool", true);
+    bugsnag_event_add_breadcrumb(event, crumb);
+
+    // third breadcrumb
+    memset(crumb, 0, sizeof(bugsnag_breadcrumb));
     crumb->type = BSG_CRUMB_NAVIGATION;
     strcpy(crumb->name, "MainActivity");
-    strcpy(crumb->timestamp, "t1539000435563");
+    crumb->timestamp_ms = 1539000435563;
 
     // metadata
-    data = &crumb->metadata;
-    data->values[0].type = BSG_METADATA_NUMBER_VALUE;
-    strcpy(data->values[0].section, "custom");
-    strcpy(data->values[0].name, "num");
-    data->values[0].double_value = 55;
+    bsg_add_metadata_value_double(data, NULL, "custom", "num", 55);
+    // values beyond value_count are not serialized
+    data->value_count = 0;
+    bugsnag_event_add_breadcrumb(event, crumb);
 
     // fourth breadcrumb
-    crumb = &event->breadcrumbs[1];
+    memset(crumb, 0, sizeof(bugsnag_breadcrumb));
     crumb->type = BSG_CRUMB_STATE;
     strcpy(crumb->name, "Updated store");
-    strcpy(crumb->timestamp, "2018-10-08T12:07:16Z");
+    crumb->timestamp_ms = 1539000436000;
 
     // metadata
-    data = &crumb->metadata;
+    bsg_add_metadata_value_str(data, NULL, "custom", "none", "");
     data->values[0].type = BSG_METADATA_NONE_VALUE;
-    strcpy(data->values[0].section, "custom");
-    strcpy(data->values[0].name, "none");
+    bugsnag_event_add_breadcrumb(event, crumb);
+    free(crumb);
 }
 
 bugsnag_stackframe *loadStackframeTestCase() {
@@ -178,6 +155,7 @@ bugsnag_stackframe *loadStackframeTestCase() {
 }
 
 void loadThreadTestCase(bugsnag_event *event) {
+    bsg_event_reserve_threads(event, 1);
     event->thread_count = 1;
     bsg_thread *thread = &event->threads[0];
     strcpy(thread->name, "Binder 1");
@@ -0,0 +1,119 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/serializer/event_reader.h>
+#include <utils/state_journal.h>
+
+#define STATE_JOURNAL_TEST_REPORT \
+  "/data/data/com.bugsnag.android.ndk.test/cache/journal.crash"
+#define STATE_JOURNAL_TEST_FILE \
+  "/data/data/com.bugsnag.android.ndk.test/cache-journal"
+#define STATE_JOURNAL_TEST_LAST_RUN STATE_JOURNAL_TEST_FILE ".last"
+
+bugsnag_event *bsg_generate_event(void);
+
+static void populate_journal(bsg_environment *env) {
+  bugsnag_event *generated = bsg_generate_event();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  strcpy(env->report_header.os_build, "macOS Sierra");
+  memcpy(&env->next_event, generated, sizeof(bugsnag_event));
+  free(generated);
+  env->start_time = time(NULL);
+  bsg_event_state_init(&env->event_state, &env->next_event, 0);
+  env->state_populated = true;
+}
+
+/** Overwrite the version in the header of a journal file */
+static bool set_journal_version(const char *path, uint32_t version) {
+  int fd = open(path, O_WRONLY);
+  if (fd < 0) {
+    return false;
+  }
+  const bool written =
+      pwrite(fd, &version, sizeof(version), sizeof(uint32_t)) ==
+      sizeof(version);
+  close(fd);
+  return written;
+}
+
+TEST test_state_journal_round_trip(void) {
+  char *report = STATE_JOURNAL_TEST_REPORT;
+  remove(report);
+  remove(STATE_JOURNAL_TEST_LAST_RUN);
+  bsg_environment *env = bsg_state_journal_map(report);
+  ASSERT(env != NULL);
+  ASSERT_FALSE(env->state_populated);
+  populate_journal(env);
+  bsg_event_state *state = bsg_event_state_begin_update(&env->event_state);
+  strcpy(state->context, "JournaledActivity");
+  bsg_event_state_publish(&env->event_state);
+
+  // the next launch keeps the last state, and starts a fresh journal
+  bsg_environment *next_env = bsg_state_journal_map(report);
+  ASSERT(next_env != NULL);
+  ASSERT_FALSE(next_env->state_populated);
+  ASSERT_EQ(0, access(STATE_JOURNAL_TEST_LAST_RUN, F_OK));
+  ASSERT(bsg_state_journal_write_last_run(report, "ProcessKilled",
+                                          "The process was killed"));
+  ASSERT(access(STATE_JOURNAL_TEST_LAST_RUN, F_OK) != 0);
+  ASSERT_FALSE(bsg_state_journal_write_last_run(report, "ProcessKilled",
+                                                "The process was killed"));
+
+  bugsnag_event *event = bsg_read_event(report);
+  ASSERT(event != NULL);
+  ASSERT(event->unhandled);
+  ASSERT_EQ(BSG_SEVERITY_ERR, event->severity);
+  ASSERT_STR_EQ("ProcessKilled", event->error.errorClass);
+  ASSERT_STR_EQ("The process was killed", event->error.errorMessage);
+  ASSERT_STR_EQ("JournaledActivity", event->context);
+  ASSERT_STR_EQ("5d1e5fbd39a74caa1200142706a90b20", event->api_key);
+  ASSERT_STR_EQ("foo-hash", event->grouping_hash);
+  free(event);
+  remove(report);
+  PASS();
+}
+
+TEST test_state_journal_version_mismatch(void) {
+  char *report = STATE_JOURNAL_TEST_REPORT;
+  remove(report);
+  remove(STATE_JOURNAL_TEST_LAST_RUN);
+
+  // a journal written by another build is not kept
+  bsg_environment *env = bsg_state_journal_map(report);
+  ASSERT(env != NULL);
+  populate_journal(env);
+  ASSERT(set_journal_version(STATE_JOURNAL_TEST_FILE, 1));
+  env = bsg_state_journal_map(report);
+  ASSERT(env != NULL);
+  ASSERT(access(STATE_JOURNAL_TEST_LAST_RUN, F_OK) != 0);
+
+  // nor is one which a crash handler ran in
+  populate_journal(env);
+  env->handling_crash = true;
+  env = bsg_state_journal_map(report);
+  ASSERT(env != NULL);
+  ASSERT(access(STATE_JOURNAL_TEST_LAST_RUN, F_OK) != 0);
+
+  // and a kept journal is checked again before it is reported
+  populate_journal(env);
+  env = bsg_state_journal_map(report);
+  ASSERT(env != NULL);
+  ASSERT(set_journal_version(STATE_JOURNAL_TEST_LAST_RUN, 1));
+  ASSERT_FALSE(bsg_state_journal_write_last_run(report, "ProcessKilled",
+                                                "The process was killed"));
+  ASSERT(access(STATE_JOURNAL_TEST_LAST_RUN, F_OK) != 0);
+  ASSERT(access(report, F_OK) != 0);
+  PASS();
+}
+
+SUITE(suite_state_journal) {
+  RUN_TEST(test_state_journal_round_trip);
+  RUN_TEST(test_state_journal_version_mismatch);
+}
@@ -0,0 +1,24 @@
+#include <stddef.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/string_ids.h>
+
+TEST test_string_ids(void) {
+  ASSERT_EQ(NULL, bsg_string_id_get(3));
+  ASSERT(bsg_string_id_set(3, "app"));
+  ASSERT_STR_EQ("app", bsg_string_id_get(3));
+  // ids are only registered once, so that lookups are never freed
+  ASSERT_FALSE(bsg_string_id_set(3, "device"));
+  ASSERT_STR_EQ("app", bsg_string_id_get(3));
+
+  ASSERT_FALSE(bsg_string_id_set(-1, "app"));
+  ASSERT_FALSE(bsg_string_id_set(BSG_STRING_ID_COUNT, "app"));
+  ASSERT_FALSE(bsg_string_id_set(4, NULL));
+  ASSERT_EQ(NULL, bsg_string_id_get(BSG_STRING_ID_COUNT));
+  PASS();
+}
+
+SUITE(suite_string_ids) {
+  RUN_TEST(test_string_ids);
+}
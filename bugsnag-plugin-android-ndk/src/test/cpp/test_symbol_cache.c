@@ -0,0 +1,47 @@
+#include <stdio.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/symbol_cache.h>
+
+#define SYMBOL_CACHE_TEST_FILE \
+  "/data/data/com.bugsnag.android.ndk.test/cache/symbols.cache"
+
+TEST test_symbol_cache(void) {
+  const uint8_t build_id[] = {0xde, 0xad, 0xbe, 0xef};
+  const uint8_t other_build_id[] = {0xde, 0xad};
+  char name[256];
+  uint64_t offset = 0;
+  remove(SYMBOL_CACHE_TEST_FILE);
+  bsg_symbol_cache_init(SYMBOL_CACHE_TEST_FILE, "build-1");
+  ASSERT_FALSE(bsg_symbol_cache_lookup(build_id, sizeof(build_id), 0x40, name,
+                                       sizeof(name), &offset));
+
+  bsg_symbol_cache_add(build_id, sizeof(build_id), 0x40, "crash_here", 0x30);
+  bsg_symbol_cache_add(build_id, sizeof(build_id), 0x90, "", 0);
+  bsg_symbol_cache_save();
+
+  // entries are read back from disk for the same app build
+  bsg_symbol_cache_init(SYMBOL_CACHE_TEST_FILE, "build-1");
+  ASSERT(bsg_symbol_cache_lookup(build_id, sizeof(build_id), 0x40, name,
+                                 sizeof(name), &offset));
+  ASSERT_STR_EQ("crash_here", name);
+  ASSERT_EQ(0x30, offset);
+  ASSERT(bsg_symbol_cache_lookup(build_id, sizeof(build_id), 0x90, name,
+                                 sizeof(name), &offset));
+  ASSERT_STR_EQ("", name);
+  ASSERT_FALSE(bsg_symbol_cache_lookup(other_build_id, sizeof(other_build_id),
+                                       0x40, name, sizeof(name), &offset));
+
+  // and dropped once the app is updated
+  bsg_symbol_cache_init(SYMBOL_CACHE_TEST_FILE, "build-2");
+  ASSERT_FALSE(bsg_symbol_cache_lookup(build_id, sizeof(build_id), 0x40, name,
+                                       sizeof(name), &offset));
+  bsg_symbol_cache_init("", "");
+  remove(SYMBOL_CACHE_TEST_FILE);
+  PASS();
+}
+
+SUITE(suite_symbol_cache) {
+  RUN_TEST(test_symbol_cache);
+}
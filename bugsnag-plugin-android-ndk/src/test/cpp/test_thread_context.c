@@ -0,0 +1,66 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/thread_context.h>
+
+bugsnag_event *bsg_generate_event(void);
+
+static pid_t context_worker_tid;
+
+static void *set_worker_context(void *unused) {
+  context_worker_tid = (pid_t)syscall(SYS_gettid);
+  bsg_thread_context_set_operation("worker operation");
+  bsg_thread_context_set_value("job", "resize");
+  return NULL;
+}
+
+TEST test_thread_context(void) {
+  const pid_t tid = (pid_t)syscall(SYS_gettid);
+  bugsnag_event *event = bsg_generate_event();
+  ASSERT_FALSE(bsg_thread_context_apply(tid, event));
+
+  bsg_thread_context_set_operation("decoding frame");
+  ASSERT(bsg_thread_context_set_value("codec", "h264"));
+  ASSERT(bsg_thread_context_set_value("frame", "12"));
+  ASSERT(bsg_thread_context_set_value("frame", "13"));
+  ASSERT(bsg_thread_context_set_value("codec", NULL));
+  for (int i = 0; i < BSG_THREAD_CONTEXT_VALUES_MAX - 1; i++) {
+    char name[16];
+    sprintf(name, "extra %d", i);
+    ASSERT(bsg_thread_context_set_value(name, "value"));
+  }
+  ASSERT_FALSE(bsg_thread_context_set_value("one too many", "value"));
+
+  ASSERT(bsg_thread_context_apply(tid, event));
+  ASSERT_STR_EQ("decoding frame", event->context);
+  ASSERT_STR_EQ("13", bugsnag_event_get_metadata_string(
+                          event, BSG_THREAD_CONTEXT_SECTION, "frame"));
+  ASSERT_EQ(BSG_METADATA_NONE_VALUE,
+            bugsnag_event_has_metadata(event, BSG_THREAD_CONTEXT_SECTION,
+                                       "codec"));
+
+  // another thread's context is only merged for that thread, and released
+  // when it exits
+  pthread_t worker;
+  ASSERT_EQ(0, pthread_create(&worker, NULL, set_worker_context, NULL));
+  pthread_join(worker, NULL);
+  ASSERT_FALSE(bsg_thread_context_apply(context_worker_tid, event));
+  ASSERT_STR_EQ("decoding frame", event->context);
+
+  bsg_thread_context_clear();
+  strcpy(event->context, "global");
+  ASSERT(bsg_thread_context_apply(tid, event));
+  ASSERT_STR_EQ("global", event->context);
+  free(event);
+  PASS();
+}
+
+SUITE(suite_thread_context) {
+  RUN_TEST(test_thread_context);
+}
@@ -0,0 +1,63 @@
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <greatest/greatest.h>
+
+#include <utils/thread_registry.h>
+#include <utils/threads.h>
+
+TEST test_thread_registry(void) {
+  bsg_thread thread;
+  const pid_t tid = (pid_t)syscall(SYS_gettid);
+  ASSERT_FALSE(bsg_thread_registry_find(tid, &thread));
+
+  // enabling the registry fills it with the current threads
+  bsg_thread_registry_set_enabled(true);
+  ASSERT(bsg_thread_registry_find(tid, &thread));
+  ASSERT_EQ(tid, thread.id);
+  ASSERT_STR_EQ(BSG_THREAD_REGISTRY_STATE, thread.state);
+
+  bsg_thread_registry_add(tid, "renamed-thread");
+  bsg_thread threads[BUGSNAG_THREADS_MAX];
+  bool truncated;
+  size_t count = bsg_capture_thread_states(-1, threads, BUGSNAG_THREADS_MAX, 0,
+                                           &truncated);
+  ASSERT(count > 0);
+  bool found = false;
+  for (size_t i = 0; i < count; i++) {
+    if (threads[i].id == tid) {
+      ASSERT_STR_EQ("renamed-thread", threads[i].name);
+      found = true;
+    }
+  }
+  ASSERT(found);
+
+  // a thread sharing the same slot is found after one which was removed
+  const pid_t other_tid = tid + BSG_THREAD_REGISTRY_SIZE;
+  bsg_thread_registry_add(other_tid, "other-thread");
+  bsg_thread_registry_remove(tid);
+  ASSERT_FALSE(bsg_thread_registry_find(tid, &thread));
+  ASSERT(bsg_thread_registry_find(other_tid, &thread));
+  ASSERT_STR_EQ("other-thread", thread.name);
+
+  // unregistered threads are read from their stat files
+  count = bsg_capture_thread_states(-1, threads, BUGSNAG_THREADS_MAX, 0,
+                                    &truncated);
+  found = false;
+  for (size_t i = 0; i < count; i++) {
+    if (threads[i].id == tid) {
+      ASSERT(strcmp(BSG_THREAD_REGISTRY_STATE, threads[i].state) != 0);
+      found = true;
+    }
+  }
+  ASSERT(found);
+
+  bsg_thread_registry_set_enabled(false);
+  ASSERT_FALSE(bsg_thread_registry_find(other_tid, &thread));
+  PASS();
+}
+
+SUITE(suite_thread_registry) {
+  RUN_TEST(test_thread_registry);
+}
@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include <greatest/greatest.h>
+
+#include <handlers/cpp_throw_sites.h>
+
+static bsg_throw_ring ring;
+
+/** Record a throw of exception from a stack with frame_count frames */
+static void add_throw(const void *exception, ssize_t frame_count) {
+  bsg_throw_site *site = bsg_throw_ring_add(&ring, exception);
+  for (ssize_t i = 0; i < frame_count; i++) {
+    site->frames[i] = (uintptr_t)exception + i;
+  }
+  site->frame_count = frame_count;
+}
+
+TEST test_throw_ring_find(void) {
+  memset(&ring, 0, sizeof(ring));
+  uintptr_t frames[BSG_THROW_FRAMES_MAX];
+  int exceptions[2];
+  ASSERT_EQ(0, bsg_throw_ring_find(&ring, &exceptions[0], frames));
+
+  add_throw(&exceptions[0], 3);
+  add_throw(&exceptions[1], BSG_THROW_FRAMES_MAX);
+  ASSERT_EQ(3, bsg_throw_ring_find(&ring, &exceptions[0], frames));
+  ASSERT_EQ((uintptr_t)&exceptions[0], frames[0]);
+  ASSERT_EQ((uintptr_t)&exceptions[0] + 2, frames[2]);
+  ASSERT_EQ(BSG_THROW_FRAMES_MAX,
+            bsg_throw_ring_find(&ring, &exceptions[1], frames));
+  ASSERT_EQ((uintptr_t)&exceptions[1] + BSG_THROW_FRAMES_MAX - 1,
+            frames[BSG_THROW_FRAMES_MAX - 1]);
+  PASS();
+}
+
+TEST test_throw_ring_wraparound(void) {
+  memset(&ring, 0, sizeof(ring));
+  uintptr_t frames[BSG_THROW_FRAMES_MAX];
+  int exceptions[BSG_THROW_SITES_MAX + 2];
+  for (int i = 0; i < BSG_THROW_SITES_MAX + 2; i++) {
+    add_throw(&exceptions[i], i + 1);
+  }
+  // the oldest throws are replaced once the ring is full
+  ASSERT_EQ(0, bsg_throw_ring_find(&ring, &exceptions[0], frames));
+  ASSERT_EQ(0, bsg_throw_ring_find(&ring, &exceptions[1], frames));
+  for (int i = 2; i < BSG_THROW_SITES_MAX + 2; i++) {
+    ASSERT_EQ(i + 1, bsg_throw_ring_find(&ring, &exceptions[i], frames));
+    ASSERT_EQ((uintptr_t)&exceptions[i], frames[0]);
+  }
+  PASS();
+}
+
+TEST test_throw_ring_latest_first(void) {
+  memset(&ring, 0, sizeof(ring));
+  uintptr_t frames[BSG_THROW_FRAMES_MAX];
+  int exceptions[2];
+  // an exception freed after its throw can be reused by a later throw, which
+  // is the one being handled, wherever the ring has wrapped to
+  for (int lap = 0; lap < BSG_THROW_SITES_MAX; lap++) {
+    add_throw(&exceptions[0], 2);
+    add_throw(&exceptions[1], 1);
+    add_throw(&exceptions[0], 5);
+    ASSERT_EQ(5, bsg_throw_ring_find(&ring, &exceptions[0], frames));
+    ASSERT_EQ(1, bsg_throw_ring_find(&ring, &exceptions[1], frames));
+  }
+  PASS();
+}
+
+SUITE(suite_throw_ring) {
+  RUN_TEST(test_throw_ring_find);
+  RUN_TEST(test_throw_ring_wraparound);
+  RUN_TEST(test_throw_ring_latest_first);
+}
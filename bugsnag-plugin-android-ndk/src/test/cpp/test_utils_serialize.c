@@ -1,18 +1,77 @@
 #include <fcntl.h>
+#include <math.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include <greatest/greatest.h>
 #include <parson/parson.h>
 
 #include <featureflags.h>
+#include <utils/crash_info.h>
+#include <utils/crash_memory.h>
+#include <utils/health_counters.h>
+#include <utils/module_index.h>
+#include <utils/pending_reports.h>
+#include <utils/threads.h>
 #include <utils/serializer.h>
 #include <utils/serializer/migrate.h>
 #include <utils/serializer/event_reader.h>
+#include <utils/serializer/json_arena.h>
+#include <utils/serializer/json_number.h>
+#include <utils/serializer/json_writer.h>
+
+#include "test_alloc.h"
 
 #define SERIALIZE_TEST_FILE "/data/data/com.bugsnag.android.ndk.test/cache/foo.crash"
 
 bugsnag_breadcrumb *init_breadcrumb(const char *name, char *message, bugsnag_breadcrumb_type type);
+bsg_breadcrumb_view get_breadcrumb(const bugsnag_event *event, int slot);
+
+/**
+ * Metadata as it was stored by v1-v9, with the names inline
+ */
+static void generate_metadata_v1(bugsnag_metadata_v1 *metadata) {
+  metadata->value_count = 4;
+  metadata->values[0] = (bsg_metadata_value_v1) {
+    .name = {"weather"},
+    .section = {"app"},
+    .type = BSG_METADATA_CHAR_VALUE,
+    .char_value = {"rain"},
+  };
+  metadata->values[1] = (bsg_metadata_value_v1) {
+    .name = {"experimentX"},
+    .section = {"metrics"},
+    .type = BSG_METADATA_BOOL_VALUE,
+    .bool_value = false,
+  };
+  metadata->values[2] = (bsg_metadata_value_v1) {
+    .name = {"subject"},
+    .section = {"metrics"},
+    .type = BSG_METADATA_CHAR_VALUE,
+    .char_value = {"percy"},
+  };
+  metadata->values[3] = (bsg_metadata_value_v1) {
+    .name = {"counter"},
+    .section = {"metrics"},
+    .type = BSG_METADATA_NUMBER_VALUE,
+    .double_value = 47.8,
+  };
+}
+
+static void init_breadcrumb_v2(bugsnag_breadcrumb_v2 *crumb, const char *name,
+                               const char *message,
+                               bugsnag_breadcrumb_type type) {
+  crumb->type = type;
+  strcpy(crumb->name, name);
+  strcpy(crumb->timestamp, "2018-08-29T21:41:39Z");
+  crumb->metadata.value_count = 1;
+  bsg_metadata_value_v1 *value = &crumb->metadata.values[0];
+  strcpy(value->section, "metaData");
+  strcpy(value->name, "message");
+  value->type = BSG_METADATA_CHAR_VALUE;
+  strcpy(value->char_value, message);
+}
 
 bool bsg_report_header_write(bsg_report_header *header, int fd);
 
@@ -125,31 +184,13 @@ void generate_basic_report(bugsnag_event *event) {
   strcpy(event->user.id, "fex");
   event->device.total_memory = 234678100;
   event->app.duration = 6502;
-  event->metadata.value_count = 4;
-  event->metadata.values[0] = (bsg_metadata_value) {
-    .name = {"weather"},
-    .section = {"app"},
-    .type = BSG_METADATA_CHAR_VALUE,
-    .char_value = {"rain"},
-  };
-  event->metadata.values[1] = (bsg_metadata_value) {
-    .name = {"experimentX"},
-    .section = {"metrics"},
-    .type = BSG_METADATA_BOOL_VALUE,
-    .bool_value = false,
-  };
-  event->metadata.values[2] = (bsg_metadata_value) {
-    .name = {"subject"},
-    .section = {"metrics"},
-    .type = BSG_METADATA_CHAR_VALUE,
-    .char_value = {"percy"},
-  };
-  event->metadata.values[3] = (bsg_metadata_value) {
-    .name = {"counter"},
-    .section = {"metrics"},
-    .type = BSG_METADATA_NUMBER_VALUE,
-    .double_value = 47.8,
-  };
+  bsg_add_metadata_value_str(&event->metadata, NULL, "app", "weather", "rain");
+  bsg_add_metadata_value_bool(&event->metadata, NULL, "metrics", "experimentX",
+                              false);
+  bsg_add_metadata_value_str(&event->metadata, NULL, "metrics", "subject",
+                             "percy");
+  bsg_add_metadata_value_double(&event->metadata, NULL, "metrics", "counter",
+                                47.8);
 
   event->crumb_count = 0;
   event->crumb_first_index = 0;
@@ -194,17 +235,12 @@ bugsnag_report_v5 *bsg_generate_report_v5(void) {
   strcpy(event->user.id, "fex");
   event->device.total_memory = 234678100;
   event->app.duration = 6502;
-  bugsnag_event_add_metadata_bool(event, "metrics", "experimentX", false);
-  bugsnag_event_add_metadata_string(event, "metrics", "subject", "percy");
-  bugsnag_event_add_metadata_string(event, "app", "weather", "rain");
-  bugsnag_event_add_metadata_double(event, "metrics", "counter", 47.8);
+  generate_metadata_v1(&event->metadata);
 
-  bugsnag_breadcrumb *crumb1 = init_breadcrumb("decrease torque", "Moving laterally 26º",
-                                               BSG_CRUMB_STATE);
-  bugsnag_breadcrumb *crumb2 = init_breadcrumb("enable blasters", "this is a drill.",
-                                               BSG_CRUMB_USER);
-  memcpy(&event->breadcrumbs[0], crumb1, sizeof(bugsnag_breadcrumb));
-  memcpy(&event->breadcrumbs[1], crumb2, sizeof(bugsnag_breadcrumb));
+  init_breadcrumb_v2(&event->breadcrumbs[0], "decrease torque",
+                     "Moving laterally 26º", BSG_CRUMB_STATE);
+  init_breadcrumb_v2(&event->breadcrumbs[1], "enable blasters",
+                     "this is a drill.", BSG_CRUMB_USER);
   event->crumb_count = 2;
   event->crumb_first_index = 0;
 
@@ -244,17 +280,12 @@ bugsnag_report_v4 *bsg_generate_report_v4(void) {
   strcpy(event->user.id, "fex");
   event->device.total_memory = 234678100;
   event->app.duration = 6502;
-  bugsnag_event_add_metadata_bool(event, "metrics", "experimentX", false);
-  bugsnag_event_add_metadata_string(event, "metrics", "subject", "percy");
-  bugsnag_event_add_metadata_string(event, "app", "weather", "rain");
-  bugsnag_event_add_metadata_double(event, "metrics", "counter", 47.8);
+  generate_metadata_v1(&event->metadata);
 
-  bugsnag_breadcrumb *crumb1 = init_breadcrumb("decrease torque", "Moving laterally 26º",
-                                               BSG_CRUMB_STATE);
-  bugsnag_breadcrumb *crumb2 = init_breadcrumb("enable blasters", "this is a drill.",
-                                               BSG_CRUMB_USER);
-  memcpy(&event->breadcrumbs[0], crumb1, sizeof(bugsnag_breadcrumb));
-  memcpy(&event->breadcrumbs[1], crumb2, sizeof(bugsnag_breadcrumb));
+  init_breadcrumb_v2(&event->breadcrumbs[0], "decrease torque",
+                     "Moving laterally 26º", BSG_CRUMB_STATE);
+  init_breadcrumb_v2(&event->breadcrumbs[1], "enable blasters",
+                     "this is a drill.", BSG_CRUMB_USER);
   event->crumb_count = 2;
   event->crumb_first_index = 0;
 
@@ -293,17 +324,12 @@ bugsnag_report_v3 *bsg_generate_report_v3(void) {
   strcpy(event->user.id, "fex");
   event->device.total_memory = 234678100;
   event->app.duration = 6502;
-  bugsnag_event_add_metadata_bool(event, "metrics", "experimentX", false);
-  bugsnag_event_add_metadata_string(event, "metrics", "subject", "percy");
-  bugsnag_event_add_metadata_string(event, "app", "weather", "rain");
-  bugsnag_event_add_metadata_double(event, "metrics", "counter", 47.8);
+  generate_metadata_v1(&event->metadata);
 
-  bugsnag_breadcrumb *crumb1 = init_breadcrumb("decrease torque", "Moving laterally 26º",
-                                               BSG_CRUMB_STATE);
-  bugsnag_breadcrumb *crumb2 = init_breadcrumb("enable blasters", "this is a drill.",
-                                               BSG_CRUMB_USER);
-  memcpy(&event->breadcrumbs[0], crumb1, sizeof(bugsnag_breadcrumb));
-  memcpy(&event->breadcrumbs[1], crumb2, sizeof(bugsnag_breadcrumb));
+  init_breadcrumb_v2(&event->breadcrumbs[0], "decrease torque",
+                     "Moving laterally 26º", BSG_CRUMB_STATE);
+  init_breadcrumb_v2(&event->breadcrumbs[1], "enable blasters",
+                     "this is a drill.", BSG_CRUMB_USER);
   event->crumb_count = 2;
   event->crumb_first_index = 0;
 
@@ -333,31 +359,7 @@ bugsnag_report_v2 *bsg_generate_report_v2(void) {
   strcpy(event->user.id, "fex");
   event->device.total_memory = 234678100;
   event->app.duration = 6502;
-  event->metadata.value_count = 4;
-  event->metadata.values[0] = (bsg_metadata_value) {
-    .name = {"weather"},
-    .section = {"app"},
-    .type = BSG_METADATA_CHAR_VALUE,
-    .char_value = {"rain"},
-  };
-  event->metadata.values[1] = (bsg_metadata_value) {
-    .name = {"experimentX"},
-    .section = {"metrics"},
-    .type = BSG_METADATA_BOOL_VALUE,
-    .bool_value = false,
-  };
-  event->metadata.values[2] = (bsg_metadata_value) {
-    .name = {"subject"},
-    .section = {"metrics"},
-    .type = BSG_METADATA_CHAR_VALUE,
-    .char_value = {"percy"},
-  };
-  event->metadata.values[3] = (bsg_metadata_value) {
-    .name = {"counter"},
-    .section = {"metrics"},
-    .type = BSG_METADATA_NUMBER_VALUE,
-    .double_value = 47.8,
-  };
+  generate_metadata_v1(&event->metadata);
 
   event->handled_events = 1;
   event->unhandled_events = 1;
@@ -406,7 +408,7 @@ bugsnag_report_v1 *bsg_generate_report_v1(void) {
 }
 
 bugsnag_event *bsg_generate_event(void) {
-  bugsnag_event *report = calloc(1, sizeof(bugsnag_event));
+  bugsnag_event *report = bsg_test_event_calloc();
   strcpy(report->grouping_hash, "foo-hash");
   strcpy(report->api_key, "5d1e5fbd39a74caa1200142706a90b20");
   strcpy(report->context, "SomeActivity");
@@ -458,7 +460,7 @@ bugsnag_event *bsg_generate_event(void) {
 }
 
 
-void bsg_update_next_run_info(bsg_environment *env);
+void bsg_update_next_run_info(bsg_environment *env, bool launching);
 
 char *test_read_last_run_info(const bsg_environment *env) {
   int fd = open(SERIALIZE_TEST_FILE, O_RDONLY);
@@ -469,27 +471,56 @@ char *test_read_last_run_info(const bsg_environment *env) {
 }
 
 TEST test_last_run_info_serialization(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   strcpy(env->last_run_info_path, SERIALIZE_TEST_FILE);
   
   // update LastRunInfo with defaults
-  env->next_event.app.is_launching = false;
   env->consecutive_launch_crashes = 1;
-  bsg_update_next_run_info(env);
+  bsg_update_next_run_info(env, false);
   ASSERT_STR_EQ("consecutiveLaunchCrashes=1\ncrashed=true\ncrashedDuringLaunch=false\0", env->next_last_run_info);
 
   // update LastRunInfo with consecutive crashes
-  env->next_event.app.is_launching = true;
   env->consecutive_launch_crashes = 7;
-  bsg_update_next_run_info(env);
+  bsg_update_next_run_info(env, true);
   ASSERT_STR_EQ("consecutiveLaunchCrashes=8\ncrashed=true\ncrashedDuringLaunch=true\0", env->next_last_run_info);
 
   free(env);
   PASS();
 }
 
+TEST test_last_run_info_prepared_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  strcpy(env->last_run_info_path, SERIALIZE_TEST_FILE);
+  FILE *previous = fopen(SERIALIZE_TEST_FILE, "w");
+  fputs("consecutiveLaunchCrashes=0\ncrashed=false\ncrashedDuringLaunch=false",
+        previous);
+  fclose(previous);
+
+  // opening the file leaves the info of the previous run to be read
+  ASSERT(bsg_serialize_prepare_last_run_info_file(env));
+  struct stat st;
+  ASSERT_EQ(0, stat(SERIALIZE_TEST_FILE, &st));
+  ASSERT(st.st_size > 0);
+
+  // a shorter write replaces all of the previous info
+  strcpy(env->next_last_run_info, "crashed=true");
+  ASSERT(bsg_serialize_last_run_info_to_file(env));
+  ASSERT_EQ(0, stat(SERIALIZE_TEST_FILE, &st));
+  ASSERT_EQ(strlen("crashed=true"), (size_t)st.st_size);
+  FILE *written = fopen(SERIALIZE_TEST_FILE, "r");
+  char contents[64] = {0};
+  fread(contents, 1, sizeof(contents) - 1, written);
+  fclose(written);
+  ASSERT_STR_EQ("crashed=true", contents);
+
+  close(env->last_run_info_fd);
+  remove(SERIALIZE_TEST_FILE);
+  free(env);
+  PASS();
+}
+
 TEST test_report_to_file(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   env->report_header.version = 7;
   env->report_header.big_endian = 1;
   bugsnag_event *report = bsg_generate_event();
@@ -503,8 +534,8 @@ TEST test_report_to_file(void) {
 }
 
 TEST test_report_with_feature_flags_to_file(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
-  env->report_header.version = 8;
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
   env->report_header.big_endian = 1;
   bugsnag_event *report = bsg_generate_event();
   memcpy(&env->next_event, report, sizeof(bugsnag_event));
@@ -519,7 +550,7 @@ TEST test_report_with_feature_flags_to_file(void) {
 }
 
 TEST test_file_to_report(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   env->report_header.version = BSG_MIGRATOR_CURRENT_VERSION;
   env->report_header.big_endian = 1;
   strcpy(env->report_header.os_build, "macOS Sierra");
@@ -539,8 +570,8 @@ TEST test_file_to_report(void) {
 }
 
 TEST test_report_with_feature_flags_from_file(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
-  env->report_header.version = 8;
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
   env->report_header.big_endian = 1;
   bugsnag_event *report = bsg_generate_event();
   memcpy(&env->next_event, report, sizeof(bugsnag_event));
@@ -560,13 +591,631 @@ TEST test_report_with_feature_flags_from_file(void) {
   PASS();
 }
 
+TEST test_report_with_many_feature_flags_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+
+  // enough flags to fill the writer several times over
+  char name[32];
+  for (int i = 0; i < 300; i++) {
+    sprintf(name, "flag_%03d", i);
+    bsg_set_feature_flag(&env->next_event, name, i % 2 ? "on" : NULL);
+  }
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_EQ(300, event->feature_flag_count);
+  ASSERT_STR_EQ("flag_000", event->feature_flags[0].name);
+  ASSERT_EQ(NULL, event->feature_flags[0].variant);
+  ASSERT_STR_EQ("flag_299", event->feature_flags[299].name);
+  ASSERT_STR_EQ("on", event->feature_flags[299].variant);
+
+  bsg_free_feature_flags(event);
+  free(event);
+  bsg_free_feature_flags(&env->next_event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_to_file_is_compact(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+
+  // fill the breadcrumb ring so that it wraps around
+  for (int i = 0; i < BUGSNAG_CRUMBS_MAX + 2; i++) {
+    bugsnag_breadcrumb *crumb =
+        init_breadcrumb("decrease torque", "Moving laterally 26º", BSG_CRUMB_STATE);
+    sprintf(crumb->name, "crumb %d", i);
+    bugsnag_event_add_breadcrumb(&env->next_event, crumb);
+    free(crumb);
+  }
+  ASSERT(bsg_event_reserve_threads(&env->next_event, 2));
+  env->next_event.thread_count = 2;
+  env->next_event.threads[1].id = 3021;
+  strcpy(env->next_event.threads[1].name, "worker");
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  int fd = open(SERIALIZE_TEST_FILE, O_RDONLY);
+  off_t file_size = lseek(fd, 0, SEEK_END);
+  close(fd);
+  ASSERT(file_size < sizeof(bsg_report_header) + sizeof(bugsnag_event));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_STR_EQ("SIGBUS", event->error.errorClass);
+  ASSERT_EQ(report->error.frame_count, event->error.frame_count);
+  ASSERT_EQ(report->metadata.value_count, event->metadata.value_count);
+  ASSERT_EQ(BUGSNAG_CRUMBS_MAX, event->crumb_count);
+  ASSERT_EQ(0, event->crumb_first_index);
+  ASSERT_STR_EQ("crumb 2", get_breadcrumb(event, 0).name);
+  char newest_name[32];
+  sprintf(newest_name, "crumb %d", BUGSNAG_CRUMBS_MAX + 1);
+  ASSERT_STR_EQ(newest_name,
+                get_breadcrumb(event, BUGSNAG_CRUMBS_MAX - 1).name);
+  ASSERT_EQ(1, get_breadcrumb(event, 0).values_remaining);
+  ASSERT_EQ(2, event->thread_count);
+  ASSERT_EQ(3021, event->threads[1].id);
+  ASSERT_STR_EQ("worker", event->threads[1].name);
+
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_header_records_layout(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bsg_report_header header;
+  int fd = open(SERIALIZE_TEST_FILE, O_RDONLY);
+  ASSERT_EQ(sizeof(header), read(fd, &header, sizeof(header)));
+  close(fd);
+  ASSERT_EQ(BUGSNAG_EVENT_VERSION, header.version);
+  ASSERT_EQ(BUGSNAG_METADATA_MAX, header.layout.metadata_max);
+  ASSERT_EQ(BUGSNAG_CRUMBS_MAX, header.layout.crumbs_max);
+  ASSERT_EQ(BUGSNAG_THREADS_MAX, header.layout.threads_max);
+  ASSERT_EQ(BUGSNAG_FRAMES_MAX, header.layout.frames_max);
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_EQ(report->error.frame_count, event->error.frame_count);
+  ASSERT_EQ(report->metadata.value_count, event->metadata.value_count);
+
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_with_repeated_frames_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  // a recursive stack, alternating between two functions in one library
+  const int frame_count = BUGSNAG_FRAMES_MAX < 40 ? BUGSNAG_FRAMES_MAX : 40;
+  report->error.frame_count = frame_count;
+  for (int i = 0; i < frame_count; i++) {
+    bugsnag_stackframe *frame = &report->error.stacktrace[i];
+    memset(frame, 0, sizeof(*frame));
+    frame->frame_address = 0x5000 + i * 16;
+    frame->load_address = 0x4000;
+    frame->symbol_address = i % 2 == 0 ? 0x4800 : 0x4900;
+    frame->line_number = i;
+    strcpy(frame->filename, "libfoo.so");
+    strcpy(frame->method, i % 2 == 0 ? "recurse" : "descend");
+  }
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  // each frame costs its address, line number and two indices
+  struct stat st;
+  ASSERT_EQ(0, stat(SERIALIZE_TEST_FILE, &st));
+  ASSERT(st.st_size < sizeof(bsg_report_header) + sizeof(bugsnag_event) -
+                          sizeof(report->error.stacktrace) +
+                          frame_count * (2 * sizeof(uintptr_t) + 4));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_EQ(frame_count, event->error.frame_count);
+  for (int i = 0; i < frame_count; i++) {
+    bugsnag_stackframe *expected = &report->error.stacktrace[i];
+    bugsnag_stackframe *frame = &event->error.stacktrace[i];
+    ASSERT_EQ(expected->frame_address, frame->frame_address);
+    ASSERT_EQ(expected->load_address, frame->load_address);
+    ASSERT_EQ(expected->symbol_address, frame->symbol_address);
+    ASSERT_EQ(expected->line_number, frame->line_number);
+    ASSERT_STR_EQ(expected->filename, frame->filename);
+    ASSERT_STR_EQ(expected->method, frame->method);
+  }
+
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_with_metadata_arena_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+
+  char long_value[300];
+  memset(long_value, 'z', sizeof(long_value) - 1);
+  long_value[sizeof(long_value) - 1] = '\0';
+  ASSERT(bsg_metadata_arena_reserve(&env->next_event.metadata_arena, 4096));
+  bugsnag_event_add_metadata_string(&env->next_event, "large", "text",
+                                    long_value);
+  ASSERT(env->next_event.metadata_arena.length > 0);
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_EQ(env->next_event.metadata_arena.length,
+            event->metadata_arena.length);
+  ASSERT_STR_EQ(long_value,
+                bugsnag_event_get_metadata_string(event, "large", "text"));
+
+  bsg_metadata_arena_free(&event->metadata_arena);
+  free(event);
+  bsg_metadata_arena_free(&env->next_event.metadata_arena);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_with_deferred_frames_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+
+  bsg_error *error = &env->next_event.error;
+  memset(error->stacktrace, 0, sizeof(error->stacktrace));
+  const uintptr_t frames[] = {(uintptr_t)fopen + 1, (uintptr_t)fclose, 1};
+  error->frame_count = 3;
+  for (int i = 0; i < error->frame_count; i++) {
+    error->stacktrace[i].frame_address = frames[i];
+  }
+  bsg_module_index_refresh();
+  ASSERT(bsg_record_frame_modules(&env->next_event.frame_modules, frames,
+                                  error->frame_count));
+  ASSERT_EQ(1, env->next_event.frame_modules.count);
+  ASSERT_EQ(BSG_NO_FRAME_MODULE,
+            env->next_event.frame_modules.frame_modules[2]);
+  ASSERT_STR_EQ("", error->stacktrace[0].method);
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_EQ(1, event->frame_modules.count);
+  bsg_resolve_frame_modules(&event->frame_modules, event->error.stacktrace,
+                            event->error.frame_count);
+  bugsnag_stackframe *frame = &event->error.stacktrace[0];
+  ASSERT_STR_EQ("fopen", frame->method);
+  ASSERT_EQ((uintptr_t)fopen, frame->symbol_address);
+  ASSERT_EQ(frame->frame_address - frame->load_address, frame->line_number);
+  ASSERT_STR_EQ(env->next_event.frame_modules.modules[0].path,
+                frame->filename);
+  ASSERT_EQ((uintptr_t)fclose, event->error.stacktrace[1].symbol_address);
+  ASSERT_STR_EQ("", event->error.stacktrace[2].method);
+  ASSERT_EQ(0, event->error.stacktrace[2].load_address);
+
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_with_handler_timing_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+
+  bsg_end_handler_phase(&env->next_event, BSG_HANDLER_PHASE_POPULATE);
+  ASSERT_EQ(0, env->next_event.handler_timing.phase_ended_ns);
+  bsg_start_handler_timing(&env->next_event);
+  const uint64_t started_ns = env->next_event.handler_timing.started_ns;
+  ASSERT(started_ns > 0);
+  bsg_end_handler_phase(&env->next_event, BSG_HANDLER_PHASE_UNWIND);
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  const bsg_handler_timing *timing = &event->handler_timing;
+  ASSERT_EQ(started_ns, timing->started_ns);
+  ASSERT(timing->serialized_ns >= started_ns);
+  ASSERT_EQ(0, timing->phase_ns[BSG_HANDLER_PHASE_POPULATE]);
+  uint64_t total_ns = 0;
+  for (int phase = 0; phase < BSG_HANDLER_PHASE_COUNT; phase++) {
+    total_ns += timing->phase_ns[phase];
+  }
+  ASSERT_EQ(timing->serialized_ns - started_ns, total_ns);
+
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_with_health_counters_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+
+  bsg_health_counters counters;
+  bsg_health_read(&counters, true);
+  bsg_health_count(BSG_HEALTH_METADATA_DROPPED);
+  bsg_health_count(BSG_HEALTH_UNWIND_SINGLE_FRAME);
+  bsg_health_count(BSG_HEALTH_UNWIND_SINGLE_FRAME);
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  uint32_t expected[BSG_HEALTH_COUNTER_COUNT] = {0};
+  expected[BSG_HEALTH_METADATA_DROPPED] = 1;
+  expected[BSG_HEALTH_UNWIND_SINGLE_FRAME] = 2;
+  for (int i = 0; i < BSG_HEALTH_COUNTER_COUNT; i++) {
+    ASSERT_EQ_FMT(expected[i], event->health_counters.counts[i], "%u");
+  }
+
+  // reading with a reset starts the counts again
+  bsg_health_read(&counters, true);
+  ASSERT_EQ(2, counters.counts[BSG_HEALTH_UNWIND_SINGLE_FRAME]);
+  bsg_health_read(&counters, false);
+  ASSERT_EQ(0, counters.counts[BSG_HEALTH_UNWIND_SINGLE_FRAME]);
+
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+/**
+ * The offset of the start of a section of a report file, from its framing
+ */
+static off_t report_section_offset(int fd, int section) {
+  off_t offset = sizeof(bsg_report_header);
+  for (int i = 0; i < section; i++) {
+    uint32_t length;
+    if (pread(fd, &length, sizeof(length), offset) != sizeof(length)) {
+      return -1;
+    }
+    offset += 2 * sizeof(uint32_t) + length;
+  }
+  return offset;
+}
+
+TEST test_report_with_partial_write_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  // cut the write short partway through the breadcrumbs, leaving the rest of
+  // the file zero-filled as a pre-allocated file would be
+  int fd = open(SERIALIZE_TEST_FILE, O_RDWR);
+  ASSERT(fd >= 0);
+  struct stat st;
+  ASSERT_EQ(0, fstat(fd, &st));
+  const off_t breadcrumbs = report_section_offset(fd, 3);
+  ASSERT(breadcrumbs > 0 && breadcrumbs + 16 < st.st_size);
+  ASSERT_EQ(0, ftruncate(fd, breadcrumbs + 16));
+  ASSERT_EQ(0, ftruncate(fd, st.st_size));
+  close(fd);
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_STR_EQ(report->error.errorClass, event->error.errorClass);
+  ASSERT_EQ(report->error.frame_count, event->error.frame_count);
+  ASSERT_EQ(report->metadata.value_count, event->metadata.value_count);
+  ASSERT_EQ(0, event->crumb_count);
+  ASSERT(event->handler_fallbacks & BSG_HANDLER_FALLBACK_REPORT_TRUNCATED);
+  free(event);
+
+  // a section which does not match its checksum is not read
+  ASSERT(bsg_serialize_event_to_file(env));
+  fd = open(SERIALIZE_TEST_FILE, O_RDWR);
+  ASSERT(fd >= 0);
+  const off_t error = report_section_offset(fd, 1);
+  const char damage = 0x7f;
+  ASSERT_EQ(1, pwrite(fd, &damage, 1, error + 2 * sizeof(uint32_t) + 1));
+  close(fd);
+  ASSERT_EQ(NULL, bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE));
+
+  // and a complete event is not marked as truncated
+  ASSERT(bsg_serialize_event_to_file(env));
+  event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_FALSE(event->handler_fallbacks &
+               BSG_HANDLER_FALLBACK_REPORT_TRUNCATED);
+
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_with_truncated_threads_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+
+  ASSERT(bsg_event_reserve_threads(&env->next_event, BUGSNAG_THREADS_MAX));
+
+  // the current thread is always found, so a budget of none truncates
+  const int task_dir_fd = bsg_open_task_dir();
+  ASSERT(task_dir_fd >= 0);
+  env->next_event.thread_count = bsg_capture_thread_states(
+      task_dir_fd, env->next_event.threads, 0, 0,
+      &env->next_event.threads_truncated);
+  ASSERT_EQ(0, env->next_event.thread_count);
+  ASSERT(env->next_event.threads_truncated);
+
+  // the directory is read from the start each time
+  env->next_event.thread_count = bsg_capture_thread_states(
+      task_dir_fd, env->next_event.threads, BUGSNAG_THREADS_MAX, 0,
+      &env->next_event.threads_truncated);
+  close(task_dir_fd);
+  ASSERT(env->next_event.thread_count > 0);
+  ASSERT_FALSE(env->next_event.threads_truncated);
+  env->next_event.threads_truncated = true;
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_EQ(env->next_event.thread_count, event->thread_count);
+  ASSERT_EQ(event->thread_count, event->thread_capacity);
+  ASSERT(event->threads_truncated);
+
+  bsg_event_free_threads(event);
+  bsg_event_free_threads(&env->next_event);
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_with_many_threads_from_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BUGSNAG_EVENT_VERSION;
+  env->report_header.big_endian = 1;
+  bugsnag_event *report = bsg_generate_event();
+  memcpy(&env->next_event, report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+
+  // more threads than the default are kept once they are reserved
+  const int thread_count = BUGSNAG_THREADS_MAX + 64;
+  ASSERT(bsg_event_reserve_threads(&env->next_event, thread_count));
+  env->next_event.thread_count = thread_count;
+  for (int i = 0; i < thread_count; i++) {
+    env->next_event.threads[i].id = 1000 + i;
+    sprintf(env->next_event.threads[i].name, "worker %d", i);
+  }
+  ASSERT(bsg_serialize_prepare_event_file(env));
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *event = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(event != NULL);
+  ASSERT_EQ(thread_count, event->thread_count);
+  ASSERT_EQ(1000 + thread_count - 1, event->threads[thread_count - 1].id);
+  char last_name[32];
+  sprintf(last_name, "worker %d", thread_count - 1);
+  ASSERT_STR_EQ(last_name, event->threads[thread_count - 1].name);
+
+  bsg_event_free_threads(event);
+  bsg_event_free_threads(&env->next_event);
+  free(event);
+  free(report);
+  free(env);
+  PASS();
+}
+
+TEST test_prepare_crash_memory(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  ASSERT(bsg_event_reserve_threads(&env->next_event, 10));
+  ASSERT(bsg_metadata_arena_reserve(&env->next_event.metadata_arena, 4096));
+
+  bsg_crash_memory_footprint footprint[BSG_CRASH_MEMORY_REGION_COUNT];
+  bsg_prepare_crash_memory(env, false, footprint);
+  const bsg_crash_memory_footprint *item =
+      &footprint[BSG_CRASH_MEMORY_ENVIRONMENT];
+  ASSERT_EQ(sizeof(bsg_environment), item->size);
+  ASSERT(item->page_count * getpagesize() >= item->size);
+  ASSERT_FALSE(item->locked);
+  item = &footprint[BSG_CRASH_MEMORY_THREADS];
+  ASSERT_EQ(10 * sizeof(bsg_thread), item->size);
+  ASSERT(item->page_count >= 1);
+  ASSERT_EQ(4096, footprint[BSG_CRASH_MEMORY_METADATA_ARENA].size);
+  // regions which are not in use are left empty
+  ASSERT_EQ(0, footprint[BSG_CRASH_MEMORY_EVENT_FILE].size);
+  ASSERT_EQ(0, footprint[BSG_CRASH_MEMORY_EVENT_FILE].page_count);
+
+  // the contents are left as they were
+  ASSERT_EQ(0, env->next_event.threads[0].id);
+
+  bsg_event_free_threads(&env->next_event);
+  bsg_metadata_arena_free(&env->next_event.metadata_arena);
+  free(env);
+  PASS();
+}
+
+TEST test_file_to_supplied_report(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BSG_MIGRATOR_CURRENT_VERSION;
+  env->report_header.big_endian = 1;
+  strcpy(env->report_header.os_build, "macOS Sierra");
+  bugsnag_event *generated_report = bsg_generate_event();
+  memcpy(&env->next_event, generated_report, sizeof(bugsnag_event));
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+  bsg_set_feature_flag(&env->next_event, "sample_group", "a");
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *report = bsg_event_alloc();
+  memset(report, 0xff, sizeof(bugsnag_event));
+  ASSERT(bsg_read_event_into(SERIALIZE_TEST_FILE, report));
+  ASSERT_STR_EQ("SIGBUS", report->error.errorClass);
+  ASSERT_STR_EQ("SomeActivity", report->context);
+  ASSERT_EQ(2, report->crumb_count);
+  ASSERT_EQ(0, report->thread_count);
+  ASSERT_EQ(1, report->feature_flag_count);
+  ASSERT_STR_EQ("sample_group", report->feature_flags[0].name);
+  bsg_free_feature_flags(report);
+
+  // a truncated file is rejected and leaves the event zeroed
+  ASSERT_EQ(0, truncate(SERIALIZE_TEST_FILE, sizeof(bsg_report_header) + 16));
+  ASSERT_FALSE(bsg_read_event_into(SERIALIZE_TEST_FILE, report));
+  ASSERT_EQ(0, report->crumb_count);
+  ASSERT_STR_EQ("", report->error.errorClass);
+
+  free(report);
+  bsg_free_feature_flags(&env->next_event);
+  free(generated_report);
+  free(env);
+  PASS();
+}
+
+typedef struct {
+  int count;
+  int inflated;
+  char error_classes[8][64];
+} pending_report_results;
+
+static void collect_pending_report(const char *path,
+                                   bsg_pending_report *report, void *context) {
+  pending_report_results *results = context;
+  char json[16384] = {0};
+  if (report->is_gzip) {
+    z_stream stream = {0};
+    inflateInit2(&stream, 15 + 16);
+    stream.next_in = (Bytef *)report->payload;
+    stream.avail_in = (uInt)report->payload_length;
+    stream.next_out = (Bytef *)json;
+    stream.avail_out = sizeof(json) - 1;
+    results->inflated += inflate(&stream, Z_FINISH) == Z_STREAM_END;
+    inflateEnd(&stream);
+  } else {
+    memcpy(json, report->payload, report->payload_length);
+  }
+  JSON_Value *root = json_parse_string(json);
+  JSON_Object *event = json_value_get_object(root);
+  JSON_Array *exceptions = json_object_get_array(event, "exceptions");
+  const char *error_class =
+      json_object_get_string(json_array_get_object(exceptions, 0), "errorClass");
+  strcpy(results->error_classes[results->count++], error_class);
+  json_value_free(root);
+}
+
+TEST test_prepare_pending_reports_in_order(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BSG_MIGRATOR_CURRENT_VERSION;
+  env->report_header.big_endian = 1;
+  strcpy(env->report_header.os_build, "macOS Sierra");
+  bugsnag_event *generated_report = bsg_generate_event();
+
+  char paths[6][64];
+  const char *path_list[6];
+  for (int i = 0; i < 6; i++) {
+    memcpy(&env->next_event, generated_report, sizeof(bugsnag_event));
+    sprintf(env->next_event.error.errorClass, "SIG%d", i);
+    sprintf(paths[i], "%s.%d", SERIALIZE_TEST_FILE, i);
+    strcpy(env->next_event_path, paths[i]);
+    ASSERT(bsg_serialize_event_to_file(env));
+    path_list[i] = paths[i];
+  }
+
+  pending_report_results results = {0};
+  bsg_prepare_pending_reports(path_list, 6, collect_pending_report, &results);
+  ASSERT_EQ(6, results.count);
+#if BSG_PENDING_REPORT_COMPRESSION
+  // repeated keys make every payload smaller once compressed
+  ASSERT_EQ(6, results.inflated);
+#endif
+  for (int i = 0; i < 6; i++) {
+    char expected[16];
+    sprintf(expected, "SIG%d", i);
+    ASSERT_STR_EQ(expected, results.error_classes[i]);
+    // the stored reports are removed once read
+    ASSERT_EQ(-1, access(paths[i], F_OK));
+  }
+
+  free(generated_report);
+  free(env);
+  PASS();
+}
+
+TEST test_report_to_prepared_file(void) {
+  bsg_environment *env = bsg_test_environment_calloc();
+  env->report_header.version = BSG_MIGRATOR_CURRENT_VERSION;
+  env->report_header.big_endian = 1;
+  strcpy(env->report_header.os_build, "macOS Sierra");
+  strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
+  ASSERT(bsg_serialize_prepare_event_file(env));
+  ASSERT(env->next_event_mapping != NULL);
+
+  // an unused pre-allocated file is not a valid event
+  ASSERT_EQ(NULL, bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE));
+
+  bugsnag_event *generated_report = bsg_generate_event();
+  memcpy(&env->next_event, generated_report, sizeof(bugsnag_event));
+  bsg_set_feature_flag(&env->next_event, "sample_group", "a");
+  ASSERT(bsg_serialize_event_to_file(env));
+
+  bugsnag_event *report = bsg_deserialize_event_from_file(SERIALIZE_TEST_FILE);
+  ASSERT(report != NULL);
+  ASSERT_STR_EQ("SIGBUS", report->error.errorClass);
+  ASSERT_EQ(1, report->feature_flag_count);
+  ASSERT_STR_EQ("sample_group", report->feature_flags[0].name);
+  ASSERT_STR_EQ("a", report->feature_flags[0].variant);
+
+  bsg_free_feature_flags(report);
+  free(report);
+  bsg_free_feature_flags(&env->next_event);
+  free(generated_report);
+  free(env);
+  PASS();
+}
+
 TEST test_report_v1_migration(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   env->report_header.version = 1;
   env->report_header.big_endian = 1;
   strcpy(env->report_header.os_build, "macOS Sierra");
   bugsnag_report_v1 *generated_report = bsg_generate_report_v1();
-  memcpy(&env->next_event, generated_report, sizeof(bugsnag_report_v1));
   strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
   bsg_serialize_report_v1_to_file(env, generated_report);
 
@@ -586,10 +1235,9 @@ TEST test_report_v1_migration(void) {
 }
 
 TEST test_report_v2_migration(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
 
   bugsnag_report_v2 *generated_report = bsg_generate_report_v2();
-  memcpy(&env->next_event, generated_report, sizeof(bugsnag_report_v2));
   strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
 
   env->report_header.version = 2;
@@ -615,6 +1263,10 @@ TEST test_report_v2_migration(void) {
   // event.device
   ASSERT_STR_EQ("android", event->device.os_name);
 
+  // event.app, including fields which were widened
+  ASSERT_EQ(57, event->app.version_code);
+  ASSERT_EQ(6502, event->app.duration);
+
   // package_name/version_name are migrated to metadata
   ASSERT_STR_EQ("com.example.foo", event->metadata.values[4].char_value);
   ASSERT_STR_EQ("2.5", event->metadata.values[5].char_value);
@@ -641,13 +1293,12 @@ TEST test_report_v2_migration(void) {
 }
 
 TEST test_report_v3_migration(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   env->report_header.version = 3;
   env->report_header.big_endian = 1;
   strcpy(env->report_header.os_build, "macOS Sierra");
 
   bugsnag_report_v3 *generated_report = bsg_generate_report_v3();
-  memcpy(&env->next_event, generated_report, sizeof(bugsnag_report_v3));
   strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
   bsg_serialize_report_v3_to_file(env, generated_report);
 
@@ -656,6 +1307,7 @@ TEST test_report_v3_migration(void) {
 
   // api key is set to sensible default
   ASSERT_STR_EQ("", event->api_key);
+  ASSERT_STR_EQ("SomeActivity", event->context);
 
   // other fields appear reasonable and are copied over
   ASSERT_STR_EQ("Test Notifier", event->notifier.name);
@@ -674,13 +1326,12 @@ TEST test_report_v3_migration(void) {
 }
 
 TEST test_report_v4_migration(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   env->report_header.version = 4;
   env->report_header.big_endian = 1;
   strcpy(env->report_header.os_build, "macOS Sierra");
 
   bugsnag_report_v4 *generated_report = bsg_generate_report_v4();
-  memcpy(&env->next_event, generated_report, sizeof(bugsnag_report_v4));
   strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
   bsg_serialize_report_v4_to_file(env, generated_report);
 
@@ -711,20 +1362,18 @@ void prepare_v5_report(bsg_environment *env, bugsnag_report_v5 *generated_report
     int index = k % V2_BUGSNAG_CRUMBS_MAX;
     char *str = calloc(1, sizeof(char) * 64);
     sprintf(str, "%d", k);
-    bugsnag_breadcrumb *crumb = init_breadcrumb(str, "Oh crumbs", BSG_CRUMB_STATE);
-    memcpy(&generated_report->breadcrumbs[index], crumb, sizeof(bugsnag_breadcrumb));
-    free(crumb);
+    init_breadcrumb_v2(&generated_report->breadcrumbs[index], str, "Oh crumbs",
+                       BSG_CRUMB_STATE);
     free(str);
   }
   generated_report->crumb_count = V2_BUGSNAG_CRUMBS_MAX;
   generated_report->crumb_first_index = first_crumb_index;
-  memcpy(&env->next_event, generated_report, sizeof(bugsnag_report_v5));
   strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
   bsg_serialize_report_v5_to_file(env, generated_report);
 }
 
 TEST test_report_v5_migration(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   env->report_header.version = 5;
   env->report_header.big_endian = 1;
   strcpy(env->report_header.os_build, "macOS Sierra");
@@ -743,9 +1392,10 @@ TEST test_report_v5_migration(void) {
   for (int k = 0; k < V2_BUGSNAG_CRUMBS_MAX; ++k) {
     char *str = calloc(1, sizeof(char) * 64);
     sprintf(str, "%d", k);
-    bugsnag_breadcrumb *crumb = &event->breadcrumbs[k];
-    ASSERT_STR_EQ(str, crumb->name);
-    ASSERT_EQ(BSG_CRUMB_STATE, crumb->type);
+    bsg_breadcrumb_view crumb = get_breadcrumb(event, k);
+    ASSERT_STR_EQ(str, crumb.name);
+    ASSERT_EQ(BSG_CRUMB_STATE, crumb.type);
+    ASSERT_EQ(1535578899000, crumb.timestamp_ms);
     free(str);
   }
 
@@ -758,7 +1408,7 @@ TEST test_report_v5_migration(void) {
 }
 
 TEST test_report_v5_migration_crumb_index(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   env->report_header.version = 5;
   env->report_header.big_endian = 1;
   strcpy(env->report_header.os_build, "macOS Sierra");
@@ -778,10 +1428,10 @@ TEST test_report_v5_migration_crumb_index(void) {
   ASSERT_EQ(25, event->crumb_count);
   ASSERT_EQ(0, event->crumb_first_index);
 
-  ASSERT_STR_EQ("12", event->breadcrumbs[0].name);
-  ASSERT_STR_EQ("13", event->breadcrumbs[1].name);
-  ASSERT_STR_EQ("26", event->breadcrumbs[14].name);
-  ASSERT_STR_EQ("36", event->breadcrumbs[24].name);
+  ASSERT_STR_EQ("12", get_breadcrumb(event, 0).name);
+  ASSERT_STR_EQ("13", get_breadcrumb(event, 1).name);
+  ASSERT_STR_EQ("26", get_breadcrumb(event, 14).name);
+  ASSERT_STR_EQ("36", get_breadcrumb(event, 24).name);
 
   free(generated_report);
   free(env);
@@ -790,13 +1440,12 @@ TEST test_report_v5_migration_crumb_index(void) {
 }
 
 TEST test_report_v6_migration(void) {
-  bsg_environment *env = calloc(1, sizeof(bsg_environment));
+  bsg_environment *env = bsg_test_environment_calloc();
   env->report_header.version = 4;
   env->report_header.big_endian = 1;
   strcpy(env->report_header.os_build, "macOS Sierra");
 
   bugsnag_report_v5 *generated_report = bsg_generate_report_v5();
-  memcpy(&env->next_event, generated_report, sizeof(bugsnag_report_v5));
   strcpy(env->next_event_path, SERIALIZE_TEST_FILE);
   bsg_serialize_report_v5_to_file(env, generated_report);
 
@@ -944,11 +1593,340 @@ TEST test_breadcrumbs_to_json(void) {
   PASS();
 }
 
+// helper function, compares the streaming output with the parson tree output
+static bool json_stream_matches_tree(bugsnag_event *event) {
+  char *expected = bsg_event_to_json(event);
+  char *actual = bsg_event_to_json_stream(event);
+  bool matches = expected != NULL && actual != NULL &&
+                 strcmp(expected, actual) == 0;
+  if (!matches) {
+    printf("expected: %s\nactual:   %s\n", expected, actual);
+  }
+  free(expected);
+  free(actual);
+  return matches;
+}
+
+// helper function, compares the single pass output with the sized output
+static bool json_single_pass_matches_sized(JSON_Value *value) {
+  size_t size = json_serialization_size(value);
+  char *expected = malloc(size);
+  json_serialize_to_buffer(value, expected, size);
+  char *actual = json_serialize_to_string(value);
+  size_t pretty_size = json_serialization_size_pretty(value);
+  char *expected_pretty = malloc(pretty_size);
+  json_serialize_to_buffer_pretty(value, expected_pretty, pretty_size);
+  char *actual_pretty = json_serialize_to_string_pretty(value);
+  // start from a buffer too small for anything, so that it has to grow
+  size_t buf_size = 1;
+  char *into = json_serialize_into_buffer(value, malloc(buf_size), &buf_size);
+  bool matches = actual != NULL && strcmp(expected, actual) == 0 &&
+                 actual_pretty != NULL &&
+                 strcmp(expected_pretty, actual_pretty) == 0 &&
+                 into != NULL && strcmp(expected, into) == 0 &&
+                 buf_size > strlen(into);
+  if (!matches) {
+    printf("expected: %s\nactual:   %s\n", expected, actual);
+  }
+  free(expected);
+  json_free_serialized_string(actual);
+  free(expected_pretty);
+  json_free_serialized_string(actual_pretty);
+  free(into);
+  return matches;
+}
+
+TEST test_json_format_number(void) {
+  char buf[BSG_JSON_NUMBER_MAX + 1];
+  const double values[] = {0,           7,        -7,       42,
+                           1234567890,  -100,     0.1,      -0.5,
+                           1.0 / 3,     1e300,    -0.0,     9007199254740992.0,
+                           123456789012345.0,     2.5e-8};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    size_t length = bsg_json_format_number(values[i], buf);
+    ASSERT_EQ(strlen(buf), length);
+    // round-trips, in no more digits than printf needs
+    ASSERT_EQ(values[i], strtod(buf, NULL));
+    char expected[64];
+    snprintf(expected, sizeof(expected), "%1.17g", values[i]);
+    ASSERT(length <= strlen(expected));
+  }
+  bsg_json_format_number(1234567890, buf);
+  ASSERT_STR_EQ("1234567890", buf);
+  bsg_json_format_number(-100, buf);
+  ASSERT_STR_EQ("-100", buf);
+  bsg_json_format_number(0.1, buf);
+  ASSERT_STR_EQ("0.1", buf);
+  bsg_json_format_number(-0.0, buf);
+  ASSERT_STR_EQ("-0", buf);
+
+  bsg_json_format_hex(0, buf);
+  ASSERT_STR_EQ("0x0", buf);
+  bsg_json_format_hex(0x7f00ab12c0, buf);
+  ASSERT_STR_EQ("0x7f00ab12c0", buf);
+  ASSERT_EQ(18, bsg_json_format_hex(UINT64_MAX, buf));
+  ASSERT_STR_EQ("0xffffffffffffffff", buf);
+  PASS();
+}
+
+TEST test_json_string_unescaped_length(void) {
+  const char escapes[] = {'"', '\\', '/', '\n', '\x01', '\x1f'};
+  char string[48];
+  for (size_t e = 0; e < sizeof(escapes); e++) {
+    // place the character at every offset either side of a 16 byte block
+    for (size_t pos = 0; pos < sizeof(string); pos++) {
+      for (size_t i = 0; i < sizeof(string); i++) {
+        // bytes with the top bit set must not pass for control characters
+        string[i] = i % 3 == 0 ? (char)0xc3 : 'a';
+      }
+      string[pos] = escapes[e];
+      ASSERT_EQ(pos, json_string_unescaped_length(string, sizeof(string)));
+      ASSERT_EQ(pos < 20 ? pos : 20, json_string_unescaped_length(string, 20));
+    }
+  }
+  ASSERT_EQ(0, json_string_unescaped_length("", 0));
+  ASSERT_EQ(5, json_string_unescaped_length("hello", 5));
+  PASS();
+}
+
+TEST test_json_single_pass_matches_sized(void) {
+  JSON_Value *root_value = bsg_generate_json();
+  ASSERT(json_single_pass_matches_sized(root_value));
+  json_value_free(root_value);
+
+  root_value = json_value_init_object();
+  JSON_Object *root = json_value_get_object(root_value);
+  json_object_set_string(root, "escapes",
+                         "\"quoted\" \\ a/b \b\f\n\r\t \x01\x1f caf\xc3\xa9");
+  json_object_set_number(root, "pi", 3.14159);
+  json_object_set_number(root, "big", 1e300);
+  json_object_set_boolean(root, "yes", true);
+  json_object_set_null(root, "none");
+  json_object_set_value(root, "empty", json_value_init_array());
+  json_object_dotset_string(root, "nested.key", "value");
+  ASSERT(json_single_pass_matches_sized(root_value));
+  json_value_free(root_value);
+  PASS();
+}
+
+TEST test_json_stream_matches_tree(void) {
+  bugsnag_event *event = bsg_generate_event();
+  ASSERT(json_stream_matches_tree(event));
+
+  strcpy(event->app.active_screen, "MainActivity");
+  event->device.time = 1539000429;
+  event->device.api_level = 29;
+  strcpy(event->device.cpu_abi[0].value, "arm64-v8a");
+  strcpy(event->device.cpu_abi[1].value, "armeabi-v7a");
+  event->device.cpu_abi_count = 2;
+  ASSERT(bsg_event_reserve_threads(event, 2));
+  event->thread_count = 2;
+  event->threads[0].id = 1;
+  strcpy(event->threads[0].name, "main");
+  strcpy(event->threads[0].state, "running");
+  event->threads[1].id = 22;
+  strcpy(event->threads[1].name, "worker");
+  bsg_set_feature_flag(event, "demo", "on");
+  bsg_set_feature_flag(event, "sample", NULL);
+  ASSERT(json_stream_matches_tree(event));
+  bsg_event_free_threads(event);
+  free(event);
+  PASS();
+}
+
+TEST test_json_stream_matches_tree_escapes(void) {
+  bugsnag_event *event = bsg_generate_event();
+  strcpy(event->context, "quote\" slash/ back\\ tab\t newline\n \x01\x0b\x1f");
+  strcpy(event->error.stacktrace[1].filename, "/system/lib64/libc.so");
+  // invalid UTF-8 is not serialized
+  strcpy(event->error.errorMessage, "bad \xc3\x28 byte");
+  strcpy(event->app.active_screen, "\xed\xa0\x80");
+  strcpy(event->user.name, "\xff");
+  strcpy(event->user.email, "");
+  strcpy(event->user.id, "");
+  bugsnag_event_add_metadata_string(event, "metrics", "broken", "\xe2\x82");
+  bugsnag_event_add_metadata_double(event, "metrics", "nan", NAN);
+  ASSERT(json_stream_matches_tree(event));
+  free(event);
+  PASS();
+}
+
+TEST test_json_stream_matches_tree_metadata(void) {
+  bugsnag_event *event = bsg_generate_event();
+  strcpy(event->app.active_screen, "MainActivity");
+  // replaced values keep their original position
+  bugsnag_event_add_metadata_string(event, "app", "activeScreen", "Other");
+  bugsnag_event_add_metadata_double(event, "metrics", "subject", 12);
+  bugsnag_event_add_metadata_bool(event, "extra", "enabled", true);
+  event->metadata.values[1].type = BSG_METADATA_NONE_VALUE;
+  ASSERT(json_stream_matches_tree(event));
+
+  // nested keys are left to the parson serializer
+  bugsnag_event_add_metadata_string(event, "extra.nested", "key", "value");
+  ASSERT(json_stream_matches_tree(event));
+  free(event);
+  PASS();
+}
+
+TEST test_json_severity_reason_handled(void) {
+  bugsnag_event *event = bsg_generate_event();
+  event->unhandled = false;
+  event->handler_timing.started_ns = 0;
+  ASSERT(json_stream_matches_tree(event));
+  char *json = bsg_event_to_json_stream(event);
+  JSON_Value *root = json_parse_string(json);
+  JSON_Object *obj = json_value_get_object(root);
+  ASSERT_STR_EQ("handledException",
+                json_object_dotget_string(obj, "severityReason.type"));
+  ASSERT_FALSE(
+      json_object_dotget_boolean(obj, "severityReason.unhandledOverridden"));
+  json_value_free(root);
+  free(json);
+
+  // a crash whose on_error callback marked it handled
+  event->handler_timing.started_ns = 1;
+  ASSERT(json_stream_matches_tree(event));
+  json = bsg_event_to_json_stream(event);
+  root = json_parse_string(json);
+  obj = json_value_get_object(root);
+  ASSERT_STR_EQ("signal", json_object_dotget_string(obj, "severityReason.type"));
+  ASSERT(
+      json_object_dotget_boolean(obj, "severityReason.unhandledOverridden"));
+  json_value_free(root);
+  free(json);
+  free(event);
+  PASS();
+}
+
+TEST test_json_stream_matches_tree_metadata_arena(void) {
+  bugsnag_event *event = bsg_generate_event();
+  char long_value[128];
+  memset(long_value, 'y', sizeof(long_value) - 1);
+  long_value[sizeof(long_value) - 1] = '\0';
+  ASSERT(bsg_metadata_arena_reserve(&event->metadata_arena, 1024));
+  bugsnag_event_add_metadata_string(event, "metrics", "long", long_value);
+  bugsnag_event_add_metadata_string(event, "large", "text", long_value);
+
+  char *json = bsg_event_to_json_stream(event);
+  ASSERT(json != NULL);
+  ASSERT(strstr(json, long_value) != NULL);
+  free(json);
+  ASSERT(json_stream_matches_tree(event));
+
+  bsg_metadata_arena_free(&event->metadata_arena);
+  free(event);
+  PASS();
+}
+
+TEST test_json_stream_matches_tree_breadcrumbs(void) {
+  bugsnag_event *event = bsg_generate_event();
+  for (int i = 0; i < BUGSNAG_CRUMBS_MAX + 5; i++) {
+    char name[32];
+    sprintf(name, "crumb %d", i);
+    bugsnag_breadcrumb *crumb = init_breadcrumb(name, "message", BSG_CRUMB_LOG);
+    if (i % 2 == 0) {
+      crumb->timestamp_ms = 1539000429123;
+      bsg_add_metadata_value_str(&crumb->metadata, NULL, "metaData",
+                                 "message", "again");
+    }
+    bugsnag_event_add_breadcrumb(event, crumb);
+    free(crumb);
+  }
+  ASSERT(json_stream_matches_tree(event));
+  free(event);
+  PASS();
+}
+
+TEST test_json_arena_fits_event(void) {
+  bugsnag_event *event = bsg_generate_event();
+  for (int i = 0; i < BUGSNAG_CRUMBS_MAX; i++) {
+    bugsnag_breadcrumb *crumb =
+        init_breadcrumb("crumb", "message", BSG_CRUMB_LOG);
+    bsg_add_metadata_value_str(&crumb->metadata, NULL, "metaData", "message",
+                               "again");
+    bugsnag_event_add_breadcrumb(event, crumb);
+    free(crumb);
+  }
+  event->error.frame_count = BUGSNAG_FRAMES_MAX;
+  for (int i = 0; i < BUGSNAG_FRAMES_MAX; i++) {
+    bugsnag_stackframe *frame = &event->error.stacktrace[i];
+    frame->frame_address = 0x1000 + i;
+    strcpy(frame->filename, "/data/app/com.example/lib/arm64/libexample.so");
+    strcpy(frame->method, "example::Widget::frobnicate(int)");
+  }
+
+  char *json = bsg_event_to_json(event);
+  ASSERT(json != NULL);
+  // the estimate covers the whole tree, so it is built in a single chunk
+  ASSERT(bsg_json_arena_used() > 0);
+  ASSERT(bsg_json_arena_used() <= bsg_json_arena_size(event));
+  // the arena is released along with the tree, leaving the output intact
+  JSON_Value *root = json_parse_string(json);
+  ASSERT(root != NULL);
+  ASSERT_EQ(event->crumb_count,
+            json_array_get_count(json_object_get_array(
+                json_value_get_object(root), "breadcrumbs")));
+  json_value_free(root);
+  free(json);
+  free(event);
+  PASS();
+}
+
+static bool json_stream_cached_matches(bugsnag_event *event,
+                                       bsg_json_fragment_cache *cache) {
+  char *expected = bsg_event_to_json_stream(event);
+  char *actual = bsg_event_to_json_stream_cached(event, cache);
+  bool matches = expected != NULL && actual != NULL &&
+                 strcmp(expected, actual) == 0;
+  if (!matches) {
+    printf("expected: %s\nactual:   %s\n", expected, actual);
+  }
+  free(expected);
+  free(actual);
+  return matches;
+}
+
+TEST test_json_stream_cached_fragments(void) {
+  bsg_json_fragment_cache *cache = bsg_json_fragment_cache_new();
+  ASSERT(cache != NULL);
+  bugsnag_event *event = bsg_generate_event();
+  ASSERT(json_stream_cached_matches(event, cache));
+  ASSERT(json_stream_cached_matches(event, cache));
+
+  // fields outside of the fragments change freely
+  event->app.duration = 9000;
+  event->app.in_foreground = false;
+  strcpy(event->device.orientation, "landscape");
+  event->device.time = 1539000429;
+  ASSERT(json_stream_cached_matches(event, cache));
+
+  // fragments are encoded again when their values change
+  strcpy(event->app.version, "2.0.0");
+  strcpy(event->app.build_uuid, "");
+  ASSERT(json_stream_cached_matches(event, cache));
+  strcpy(event->device.model, "Pixel \"4\"");
+  ASSERT(json_stream_cached_matches(event, cache));
+  strcpy(event->device.cpu_abi[0].value, "x86");
+  event->device.cpu_abi_count = 1;
+  ASSERT(json_stream_cached_matches(event, cache));
+
+  // an empty fragment is reused without a stray separator
+  memset(&event->device, 0, sizeof(bsg_device_info));
+  strcpy(event->device.orientation, "portrait");
+  strcpy(event->device.os_name, "\xff");
+  ASSERT(json_stream_cached_matches(event, cache));
+  ASSERT(json_stream_cached_matches(event, cache));
+
+  bsg_json_fragment_cache_free(cache);
+  free(event);
+  PASS();
+}
+
 void migrate_app_v2(bugsnag_report_v4 *report_v4, bugsnag_event *event);
 
 TEST test_migrate_app_v2(void) {
   bugsnag_report_v4 *report_v4 = calloc(1, sizeof(bugsnag_report_v4));
-  bugsnag_event *event = calloc(1, sizeof(bugsnag_event));
+  bugsnag_event *event = bsg_test_event_calloc();
   bsg_app_info_v2 *seed = &report_v4->app;
   bsg_app_info *app = &event->app;
 
@@ -984,6 +1962,7 @@ TEST test_migrate_app_v2(void) {
 
 SUITE(suite_json_serialization) {
   RUN_TEST(test_last_run_info_serialization);
+  RUN_TEST(test_last_run_info_prepared_file);
   RUN_TEST(test_session_handled_counts);
   RUN_TEST(test_context_to_json);
   RUN_TEST(test_grouping_hash_to_json);
@@ -993,6 +1972,17 @@ SUITE(suite_json_serialization) {
   RUN_TEST(test_custom_info_to_json);
   RUN_TEST(test_exception_to_json);
   RUN_TEST(test_breadcrumbs_to_json);
+  RUN_TEST(test_json_format_number);
+  RUN_TEST(test_json_string_unescaped_length);
+  RUN_TEST(test_json_single_pass_matches_sized);
+  RUN_TEST(test_json_stream_matches_tree);
+  RUN_TEST(test_json_stream_matches_tree_escapes);
+  RUN_TEST(test_json_stream_matches_tree_metadata);
+  RUN_TEST(test_json_stream_matches_tree_metadata_arena);
+  RUN_TEST(test_json_severity_reason_handled);
+  RUN_TEST(test_json_stream_matches_tree_breadcrumbs);
+  RUN_TEST(test_json_arena_fits_event);
+  RUN_TEST(test_json_stream_cached_fragments);
 }
 
 SUITE(suite_struct_to_file) {
@@ -1000,6 +1990,21 @@ SUITE(suite_struct_to_file) {
   RUN_TEST(test_file_to_report);
   RUN_TEST(test_report_with_feature_flags_to_file);
   RUN_TEST(test_report_with_feature_flags_from_file);
+  RUN_TEST(test_report_with_many_feature_flags_from_file);
+  RUN_TEST(test_report_to_file_is_compact);
+  RUN_TEST(test_report_header_records_layout);
+  RUN_TEST(test_report_with_repeated_frames_from_file);
+  RUN_TEST(test_report_to_prepared_file);
+  RUN_TEST(test_report_with_metadata_arena_from_file);
+  RUN_TEST(test_report_with_deferred_frames_from_file);
+  RUN_TEST(test_report_with_handler_timing_from_file);
+  RUN_TEST(test_report_with_health_counters_from_file);
+  RUN_TEST(test_report_with_partial_write_from_file);
+  RUN_TEST(test_report_with_truncated_threads_from_file);
+  RUN_TEST(test_report_with_many_threads_from_file);
+  RUN_TEST(test_prepare_crash_memory);
+  RUN_TEST(test_file_to_supplied_report);
+  RUN_TEST(test_prepare_pending_reports_in_order);
 }
 
 SUITE(suite_struct_migration) {
@@ -1,6 +1,7 @@
 #include <greatest/greatest.h>
 #include <utils/string.h>
 #include <stdlib.h>
+#include <string.h>
 
 TEST test_copy_empty_string(void) {
     char *src = "";
@@ -46,11 +47,55 @@ TEST length_null_string(void) {
     PASS();
 }
 
+// the byte loops which the word-at-a-time implementations must match
+static size_t byte_strlen(const char *str) {
+    size_t length = 0;
+    while (str[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+static void byte_strncpy(char *dst, const char *src, size_t dst_size) {
+    size_t i = 0;
+    for (; i + 1 < dst_size && src[i] != '\0'; i++) {
+        dst[i] = src[i];
+    }
+    dst[i] = '\0';
+}
+
+TEST test_word_at_a_time_matches_byte_loops(void) {
+    // every source alignment, length and destination size around a few words
+    char buffer[64 + 8];
+    char expected[64];
+    char actual[64];
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length < 40; length++) {
+            char *src = buffer + offset;
+            memset(buffer, 0, sizeof(buffer));
+            for (size_t i = 0; i < length; i++) {
+                // include bytes with the top bit set, which are not zero
+                src[i] = (char)(i % 5 == 0 ? 0x80 + i : 'a' + i % 26);
+            }
+            ASSERT_EQ(byte_strlen(src), bsg_strlen(src));
+            for (size_t size = 1; size < sizeof(actual); size++) {
+                memset(expected, 'x', sizeof(expected));
+                memset(actual, 'x', sizeof(actual));
+                byte_strncpy(expected, src, size);
+                bsg_strncpy(actual, src, size);
+                ASSERT_MEM_EQ(expected, actual, sizeof(expected));
+            }
+        }
+    }
+    PASS();
+}
+
 SUITE(suite_string_utils) {
     RUN_TEST(test_copy_empty_string);
     RUN_TEST(test_copy_literal_string);
     RUN_TEST(length_empty_string);
     RUN_TEST(length_literal_string);
     RUN_TEST(length_null_string);
+    RUN_TEST(test_word_at_a_time_matches_byte_loops);
 }
 
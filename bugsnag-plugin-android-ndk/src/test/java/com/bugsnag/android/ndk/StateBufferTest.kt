@@ -0,0 +1,96 @@
+package com.bugsnag.android.ndk
+
+import org.junit.Assert.assertArrayEquals
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Test
+import java.io.ByteArrayOutputStream
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+class StateBufferTest {
+
+    private class Batch(val changed: Int, val flags: Int, val packed: ByteArray)
+
+    private val singles = mutableListOf<StateBuffer.Change>()
+    private val batches = mutableListOf<Batch>()
+
+    // only flushed explicitly, so the scheduled flush never races the test
+    private val buffer = StateBuffer(
+        flushDelayMs = 60_000L,
+        updateSingle = { singles.add(it) },
+        updateState = { changed, flags, packed -> batches.add(Batch(changed, flags, packed)) }
+    )
+
+    @Test
+    fun singleChangeIsPassedAlone() {
+        buffer.updateOrientation("landscape")
+        buffer.flush()
+
+        assertTrue(batches.isEmpty())
+        assertEquals(1, singles.size)
+        assertEquals(StateBuffer.ORIENTATION, singles[0].field)
+        assertEquals("landscape", singles[0].string)
+    }
+
+    @Test
+    fun changesAreCoalesced() {
+        buffer.updateContext("Launch")
+        buffer.updateInForeground(true, "MainActivity")
+        buffer.updateContext("Main")
+        buffer.flush()
+
+        assertTrue(singles.isEmpty())
+        assertEquals(1, batches.size)
+        val batch = batches[0]
+        assertEquals(StateBuffer.CONTEXT or StateBuffer.IN_FOREGROUND, batch.changed)
+        assertEquals(FLAG_IN_FOREGROUND, batch.flags)
+        // the later context replaces the earlier one, and strings are packed in field order
+        assertArrayEquals(pack("Main", "MainActivity"), batch.packed)
+    }
+
+    @Test
+    fun flagsAreMappedToNativeValues() {
+        buffer.updateLowMemory(true, "TRIM_MEMORY_COMPLETE")
+        buffer.updateIsLaunching(true)
+        buffer.updateInForeground(false, "")
+        buffer.flush()
+
+        val batch = batches.single()
+        assertEquals(
+            StateBuffer.IN_FOREGROUND or StateBuffer.IS_LAUNCHING or StateBuffer.LOW_MEMORY,
+            batch.changed
+        )
+        assertEquals(FLAG_IS_LAUNCHING or FLAG_LOW_MEMORY, batch.flags)
+        assertArrayEquals(pack("", "TRIM_MEMORY_COMPLETE"), batch.packed)
+    }
+
+    @Test
+    fun flushWithoutChangesPassesNothing() {
+        buffer.flush()
+        buffer.updateContext("Main")
+        buffer.flush()
+        buffer.flush()
+
+        assertTrue(batches.isEmpty())
+        assertEquals(1, singles.size)
+    }
+
+    private fun pack(vararg strings: String): ByteArray {
+        val packed = ByteArrayOutputStream()
+        strings.forEach {
+            val bytes = it.toByteArray(Charsets.UTF_8)
+            val length = ByteBuffer.allocate(4).order(ByteOrder.nativeOrder())
+            packed.write(length.putInt(bytes.size).array())
+            packed.write(bytes)
+        }
+        return packed.toByteArray()
+    }
+
+    private companion object {
+        // the BSG_STATE_FLAG_ values in bugsnag_ndk.c
+        const val FLAG_IN_FOREGROUND = 1 shl 0
+        const val FLAG_IS_LAUNCHING = 1 shl 1
+        const val FLAG_LOW_MEMORY = 1 shl 2
+    }
+}
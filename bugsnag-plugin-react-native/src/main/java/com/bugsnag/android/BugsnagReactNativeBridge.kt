@@ -1,6 +1,7 @@
 package com.bugsnag.android
 
 import com.bugsnag.android.StateEvent.AddFeatureFlag
+import com.bugsnag.android.StateEvent.AddFeatureFlags
 import com.bugsnag.android.StateEvent.AddMetadata
 import com.bugsnag.android.StateEvent.ClearFeatureFlag
 import com.bugsnag.android.StateEvent.ClearFeatureFlags
@@ -20,6 +21,12 @@ internal class BugsnagReactNativeBridge(
 ) : StateObserver {
 
     override fun onStateChange(event: StateEvent) {
+        if (event is AddFeatureFlags) {
+            // the JS layer is sent each flag in a batch separately
+            event.featureFlags.forEach { onStateChange(AddFeatureFlag(it.name, it.variant)) }
+            return
+        }
+
         val msgEvent: MessageEvent? = when (event) {
             is UpdateContext -> {
                 MessageEvent("ContextUpdate", event.context)
@@ -13,6 +13,7 @@ import org.mockito.Mock;
 import org.mockito.Mockito;
 import org.mockito.junit.MockitoJUnitRunner;
 
+import java.util.Arrays;
 import java.util.Collections;
 import java.util.HashMap;
 import java.util.Map;
@@ -115,6 +116,25 @@ public class BugsnagReactNativeBridgeTest {
         assertEquals(data, cb.event.getData());
     }
 
+    @Test
+    public void addFeatureFlags() {
+        MessageEventCb cb = new MessageEventCb();
+        BugsnagReactNativeBridge bridge = new BugsnagReactNativeBridge(client, cb);
+
+        StateEvent.AddFeatureFlags arg = new StateEvent.AddFeatureFlags(Arrays.asList(
+                new FeatureFlag("feature", "var"),
+                new FeatureFlag("other")
+        ));
+        bridge.onStateChange(arg);
+        assertNotNull(cb.event);
+        assertEquals("AddFeatureFlag", cb.event.getType());
+
+        Map<String, Object> data = new HashMap<>();
+        data.put("name", "other");
+        data.put("variant", null);
+        assertEquals(data, cb.event.getData());
+    }
+
     @Test
     public void clearFeatureFlag() {
         MessageEventCb cb = new MessageEventCb();
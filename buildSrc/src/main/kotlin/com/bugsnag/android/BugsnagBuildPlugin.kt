@@ -70,6 +70,13 @@ class BugsnagBuildPlugin : Plugin<Project> {
         defaultConfig {
             externalNativeBuild.cmake.arguments += listOf("-DANDROID_CPP_FEATURES=exceptions", "-DANDROID_STL=c++_static")
 
+            // capacities of the native event, see bugsnag-plugin-android-ndk/src/main/CMakeLists.txt
+            listOf("BUGSNAG_METADATA_MAX", "BUGSNAG_CRUMBS_MAX", "BUGSNAG_THREADS_MAX", "BUGSNAG_FRAMES_MAX")
+                .forEach { name ->
+                    val capacity: String? = project.findProperty(name) as String?
+                    capacity?.let { externalNativeBuild.cmake.arguments += "-D$name=$it" }
+                }
+
             val override: String? = project.findProperty("ABI_FILTERS") as String?
             val abis = override?.split(",") ?: mutableSetOf(
                 "arm64-v8a",
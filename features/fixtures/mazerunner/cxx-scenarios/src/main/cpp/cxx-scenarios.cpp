@@ -363,4 +363,34 @@ JNIEXPORT void JNICALL
 Java_com_bugsnag_android_mazerunner_scenarios_UnhandledNdkAutoNotifyFalseScenario_crash(JNIEnv *env) {
   abort();
 }
+
+static void __attribute__((noinline)) throw_uncaught(void) {
+  throw std::runtime_error("Handler latency");
+}
+
+JNIEXPORT void JNICALL
+Java_com_bugsnag_android_mazerunner_scenarios_CXXHandlerLatencyScenario_crash(JNIEnv *env,
+                                                                              jobject instance,
+                                                                              jstring trigger) {
+  static const struct {
+    const char *name;
+    int signum;
+  } signals[] = {{"SIGILL", SIGILL}, {"SIGTRAP", SIGTRAP}, {"SIGABRT", SIGABRT},
+                 {"SIGBUS", SIGBUS}, {"SIGFPE", SIGFPE}, {"SIGSEGV", SIGSEGV}};
+  const char *name = env->GetStringUTFChars(trigger, NULL);
+  int signum = 0;
+  for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+    if (strcmp(name, signals[i].name) == 0) {
+      signum = signals[i].signum;
+    }
+  }
+  env->ReleaseStringUTFChars(trigger, name);
+
+  if (signum != 0) {
+    raise(signum);
+  } else {
+    // reaches std::terminate, and so bsg_handle_cpp_terminate
+    throw_uncaught();
+  }
+}
 }
@@ -0,0 +1,74 @@
+package com.bugsnag.android.mazerunner.scenarios
+
+import android.content.Context
+import com.bugsnag.android.Bugsnag
+import com.bugsnag.android.Configuration
+import java.util.concurrent.CountDownLatch
+
+private const val METADATA_SECTIONS = 10
+private const val METADATA_VALUES_PER_SECTION = 10
+private const val METADATA_VALUE_LENGTH = 200
+private const val IDLE_THREADS = 100
+private const val FEATURE_FLAGS = 200
+
+/**
+ * Crashes with a handled signal or C++ std::terminate, named first in the
+ * event metadata, to time the NDK crash handlers. The metadata
+ * may also name "metadata", "threads" and "flags" to crash with large
+ * metadata, many threads or many feature flags.
+ */
+class CXXHandlerLatencyScenario(
+    config: Configuration,
+    context: Context,
+    eventMetadata: String?
+) : Scenario(config, context, eventMetadata) {
+
+    companion object {
+        init {
+            System.loadLibrary("cxx-scenarios")
+        }
+    }
+
+    private val idleLatch = CountDownLatch(1)
+
+    external fun crash(trigger: String)
+
+    override fun startScenario() {
+        super.startScenario()
+
+        val options = eventMetadata.orEmpty().split(" ")
+        if ("metadata" in options) {
+            addLargeMetadata()
+        }
+        if ("threads" in options) {
+            startIdleThreads()
+        }
+        if ("flags" in options) {
+            addFeatureFlags()
+        }
+        crash(options.first())
+    }
+
+    private fun addLargeMetadata() {
+        val value = "x".repeat(METADATA_VALUE_LENGTH)
+        for (section in 0 until METADATA_SECTIONS) {
+            for (key in 0 until METADATA_VALUES_PER_SECTION) {
+                Bugsnag.addMetadata("section$section", "key$key", value)
+            }
+        }
+    }
+
+    private fun startIdleThreads() {
+        repeat(IDLE_THREADS) { index ->
+            val thread = Thread({ idleLatch.await() }, "idle-$index")
+            thread.isDaemon = true
+            thread.start()
+        }
+    }
+
+    private fun addFeatureFlags() {
+        for (index in 0 until FEATURE_FLAGS) {
+            Bugsnag.addFeatureFlag("flag_$index", "variant_$index")
+        }
+    }
+}
@@ -0,0 +1,41 @@
+Feature: Native crash handler latency
+
+    Scenario Outline: Time the crash handler for <trigger> with <configuration>
+        When I configure the app to run in the "<trigger> <configuration>" state
+        And I run "CXXHandlerLatencyScenario" and relaunch the app
+        And I configure Bugsnag for "CXXHandlerLatencyScenario"
+        And I wait to receive an error
+        And the error payload contains a completed unhandled native report
+        And the event "unhandled" is true
+        And the crash handler latency is recorded
+
+        Examples:
+        | trigger   | configuration |
+        | SIGILL    | defaults      |
+        | SIGTRAP   | defaults      |
+        | SIGABRT   | defaults      |
+        | SIGBUS    | defaults      |
+        | SIGFPE    | defaults      |
+        | SIGSEGV   | defaults      |
+        | terminate | defaults      |
+        | SIGILL    | metadata      |
+        | SIGTRAP   | metadata      |
+        | SIGABRT   | metadata      |
+        | SIGBUS    | metadata      |
+        | SIGFPE    | metadata      |
+        | SIGSEGV   | metadata      |
+        | terminate | metadata      |
+        | SIGILL    | threads       |
+        | SIGTRAP   | threads       |
+        | SIGABRT   | threads       |
+        | SIGBUS    | threads       |
+        | SIGFPE    | threads       |
+        | SIGSEGV   | threads       |
+        | terminate | threads       |
+        | SIGILL    | flags         |
+        | SIGTRAP   | flags         |
+        | SIGABRT   | flags         |
+        | SIGBUS    | flags         |
+        | SIGFPE    | flags         |
+        | SIGSEGV   | flags         |
+        | terminate | flags         |
@@ -185,6 +185,18 @@ Then("the error payload contains a completed unhandled native report") do
     end
 end
 
+Then("the crash handler latency is recorded") do
+  latency = Maze::Helper.read_key_path(Maze::Server.errors.current[:body], "events.0.metaData.crashHandler.latencyNs")
+  Maze.check.not_nil(latency, "The crash handler latency was not recorded")
+  Maze.check.true(latency > 0, "The crash handler latency #{latency} is not positive")
+  phases = %w[populateNs unwindNs threadsNs onErrorNs writeNs].map do |phase|
+    value = Maze::Helper.read_key_path(Maze::Server.errors.current[:body], "events.0.metaData.crashHandler.#{phase}")
+    Maze.check.not_nil(value, "The crash handler #{phase} was not recorded")
+    "#{phase} #{(value / 1_000_000.0).round(3)} ms"
+  end
+  $logger.info "Crash handler latency: #{(latency / 1_000_000.0).round(3)} ms (#{phases.join(', ')})"
+end
+
 Then("the event contains session info") do
   steps %Q{
     Then the error payload field "events.0.session.startedAt" is not null